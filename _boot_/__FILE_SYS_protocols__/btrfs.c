@@ -12,6 +12,7 @@
 #include <holy/types.h>
 #include <holy/lib/crc.h>
 #include <holy/deflate.h>
+#include <holy/zstd.h>
 #include <minilzo.h>
 #include <holy/i18n.h>
 #include <holy/btrfs.h>
@@ -198,6 +199,7 @@ struct holy_btrfs_extent_data
 #define holy_BTRFS_COMPRESSION_NONE 0
 #define holy_BTRFS_COMPRESSION_ZLIB 1
 #define holy_BTRFS_COMPRESSION_LZO  2
+#define holy_BTRFS_COMPRESSION_ZSTD 3
 
 #define holy_BTRFS_OBJECT_ID_CHUNK 0x100
 
@@ -873,6 +875,31 @@ holy_btrfs_unmount (struct holy_btrfs_data *data)
   holy_free (data);
 }
 
+static void *
+holy_btrfs_mount_device (holy_device_t device)
+{
+  return holy_btrfs_mount (device);
+}
+
+/* The extent cache is keyed by inode and tree, so it stays valid.  Only
+   the first device changes: it is the one the file was opened on.  */
+static holy_err_t
+holy_btrfs_remount (void *mount, holy_device_t device)
+{
+  struct holy_btrfs_data *data = mount;
+
+  data->devices_attached[0].dev = device;
+  return holy_ERR_NONE;
+}
+
+static void
+holy_btrfs_unmount_data (void *mount)
+{
+  holy_btrfs_unmount (mount);
+}
+
+static struct holy_fs holy_btrfs_fs;
+
 static holy_err_t
 holy_btrfs_read_inode (struct holy_btrfs_data *data,
 		       struct holy_btrfs_inode *inode, holy_uint64_t num,
@@ -1073,7 +1100,8 @@ holy_btrfs_extent_read (struct holy_btrfs_data *data,
 
       if (data->extent->compression != holy_BTRFS_COMPRESSION_NONE
 	  && data->extent->compression != holy_BTRFS_COMPRESSION_ZLIB
-	  && data->extent->compression != holy_BTRFS_COMPRESSION_LZO)
+	  && data->extent->compression != holy_BTRFS_COMPRESSION_LZO
+	  && data->extent->compression != holy_BTRFS_COMPRESSION_ZSTD)
 	{
 	  holy_error (holy_ERR_NOT_IMPLEMENTED_YET,
 		      "compression type 0x%x not supported",
@@ -1113,6 +1141,20 @@ holy_btrfs_extent_read (struct holy_btrfs_data *data,
 		  != (holy_ssize_t) csize)
 		return -1;
 	    }
+	  else if (data->extent->compression == holy_BTRFS_COMPRESSION_ZSTD)
+	    {
+	      if (holy_zstd_decompress (data->extent->inl, data->extsize -
+					((holy_uint8_t *) data->extent->inl
+					 - (holy_uint8_t *) data->extent),
+					extoff, buf, csize)
+		  != (holy_ssize_t) csize)
+		{
+		  if (!holy_errno)
+		    holy_error (holy_ERR_BAD_COMPRESSED_DATA,
+				"premature end of compressed");
+		  return -1;
+		}
+	    }
 	  else
 	    holy_memcpy (buf, data->extent->inl + extoff, csize);
 	  break;
@@ -1150,6 +1192,10 @@ holy_btrfs_extent_read (struct holy_btrfs_data *data,
 		ret = holy_btrfs_lzo_decompress (tmp, zsize, extoff
 				    + holy_le_to_cpu64 (data->extent->offset),
 				    buf, csize);
+	      else if (data->extent->compression == holy_BTRFS_COMPRESSION_ZSTD)
+		ret = holy_zstd_decompress (tmp, zsize, extoff
+				    + holy_le_to_cpu64 (data->extent->offset),
+				    buf, csize);
 	      else
 		ret = -1;
 
@@ -1495,7 +1541,7 @@ static holy_err_t
 holy_btrfs_dir (holy_device_t device, const char *path,
 		holy_fs_dir_hook_t hook, void *hook_data)
 {
-  struct holy_btrfs_data *data = holy_btrfs_mount (device);
+  struct holy_btrfs_data *data = holy_fs_mount (&holy_btrfs_fs, device);
   struct holy_btrfs_key key_in, key_out;
   holy_err_t err;
   holy_disk_addr_t elemaddr;
@@ -1513,12 +1559,12 @@ holy_btrfs_dir (holy_device_t device, const char *path,
   err = find_path (data, path, &key_in, &tree, &type);
   if (err)
     {
-      holy_btrfs_unmount (data);
+      holy_fs_unmount (&holy_btrfs_fs, data);
       return err;
     }
   if (type != holy_BTRFS_DIR_ITEM_TYPE_DIRECTORY)
     {
-      holy_btrfs_unmount (data);
+      holy_fs_unmount (&holy_btrfs_fs, data);
       return holy_error (holy_ERR_BAD_FILE_TYPE, N_("not a directory"));
     }
 
@@ -1526,7 +1572,7 @@ holy_btrfs_dir (holy_device_t device, const char *path,
 		     &elemaddr, &elemsize, &desc, 0);
   if (err)
     {
-      holy_btrfs_unmount (data);
+      holy_fs_unmount (&holy_btrfs_fs, data);
       return err;
     }
   if (key_out.type != holy_BTRFS_ITEM_TYPE_DIR_ITEM
@@ -1599,7 +1645,7 @@ out:
   holy_free (direl);
 
   free_iterator (&desc);
-  holy_btrfs_unmount (data);
+  holy_fs_unmount (&holy_btrfs_fs, data);
 
   return -r;
 }
@@ -1607,7 +1653,7 @@ out:
 static holy_err_t
 holy_btrfs_open (struct holy_file *file, const char *name)
 {
-  struct holy_btrfs_data *data = holy_btrfs_mount (file->device);
+  struct holy_btrfs_data *data = holy_fs_mount (&holy_btrfs_fs, file->device);
   holy_err_t err;
   struct holy_btrfs_inode inode;
   holy_uint8_t type;
@@ -1619,12 +1665,12 @@ holy_btrfs_open (struct holy_file *file, const char *name)
   err = find_path (data, name, &key_in, &data->tree, &type);
   if (err)
     {
-      holy_btrfs_unmount (data);
+      holy_fs_unmount (&holy_btrfs_fs, data);
       return err;
     }
   if (type != holy_BTRFS_DIR_ITEM_TYPE_REGULAR)
     {
-      holy_btrfs_unmount (data);
+      holy_fs_unmount (&holy_btrfs_fs, data);
       return holy_error (holy_ERR_BAD_FILE_TYPE, N_("not a regular file"));
     }
 
@@ -1632,7 +1678,7 @@ holy_btrfs_open (struct holy_file *file, const char *name)
   err = holy_btrfs_read_inode (data, &inode, data->inode, data->tree);
   if (err)
     {
-      holy_btrfs_unmount (data);
+      holy_fs_unmount (&holy_btrfs_fs, data);
       return err;
     }
 
@@ -1645,7 +1691,7 @@ holy_btrfs_open (struct holy_file *file, const char *name)
 static holy_err_t
 holy_btrfs_close (holy_file_t file)
 {
-  holy_btrfs_unmount (file->data);
+  holy_fs_unmount (&holy_btrfs_fs, file->data);
 
   return holy_ERR_NONE;
 }
@@ -1666,7 +1712,7 @@ holy_btrfs_uuid (holy_device_t device, char **uuid)
 
   *uuid = NULL;
 
-  data = holy_btrfs_mount (device);
+  data = holy_fs_mount (&holy_btrfs_fs, device);
   if (!data)
     return holy_errno;
 
@@ -1680,7 +1726,7 @@ holy_btrfs_uuid (holy_device_t device, char **uuid)
 			  holy_be_to_cpu16 (data->sblock.uuid[6]),
 			  holy_be_to_cpu16 (data->sblock.uuid[7]));
 
-  holy_btrfs_unmount (data);
+  holy_fs_unmount (&holy_btrfs_fs, data);
 
   return holy_errno;
 }
@@ -1692,13 +1738,13 @@ holy_btrfs_label (holy_device_t device, char **label)
 
   *label = NULL;
 
-  data = holy_btrfs_mount (device);
+  data = holy_fs_mount (&holy_btrfs_fs, device);
   if (!data)
     return holy_errno;
 
   *label = holy_strndup (data->sblock.label, sizeof (data->sblock.label));
 
-  holy_btrfs_unmount (data);
+  holy_fs_unmount (&holy_btrfs_fs, data);
 
   return holy_errno;
 }
@@ -1743,6 +1789,9 @@ static struct holy_fs holy_btrfs_fs = {
   .close = holy_btrfs_close,
   .uuid = holy_btrfs_uuid,
   .label = holy_btrfs_label,
+  .mount = holy_btrfs_mount_device,
+  .remount = holy_btrfs_remount,
+  .unmount = holy_btrfs_unmount_data,
 #ifdef holy_UTIL
   .embed = holy_btrfs_embed,
   .reserved_first_sector = 1,
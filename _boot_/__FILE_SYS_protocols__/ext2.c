@@ -124,6 +124,22 @@ holy_MOD_LICENSE ("GPLv2+");
 #define EXT3_JOURNAL_FLAG_LAST_TAG	8
 
 #define EXT4_EXTENTS_FLAG		0x80000
+#define EXT2_INDEX_FLAG			0x1000
+
+/* Superblock flags.  */
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002
+
+/* Directory index hash functions.  */
+#define EXT2_HASH_LEGACY		0
+#define EXT2_HASH_HALF_MD4		1
+#define EXT2_HASH_TEA			2
+#define EXT2_HASH_LEGACY_UNSIGNED	3
+#define EXT2_HASH_HALF_MD4_UNSIGNED	4
+#define EXT2_HASH_TEA_UNSIGNED		5
+
+/* Levels of index blocks below the root of a directory index.  Two need
+   the largedir feature.  */
+#define EXT2_DX_MAX_INDIRECT		2
 
 /* The ext2 superblock.  */
 struct holy_ext2_sblock
@@ -178,6 +194,12 @@ struct holy_ext2_sblock
   holy_uint32_t first_meta_bg;
   holy_uint32_t mkfs_time;
   holy_uint32_t jnl_blocks[17];
+  holy_uint32_t total_blocks_hi;
+  holy_uint32_t reserved_blocks_hi;
+  holy_uint32_t free_blocks_hi;
+  holy_uint16_t min_extra_isize;
+  holy_uint16_t want_extra_isize;
+  holy_uint32_t flags;
 };
 
 /* The ext2 blockgroup.  */
@@ -274,7 +296,37 @@ struct holy_ext3_journal_sblock
   holy_uint32_t start;
 };
 
+/* The start of the first block of an indexed directory: "." and ".."
+   entries, with the latter spanning the rest of the block.  */
+struct holy_ext2_dx_root
+{
+  struct ext2_dirent dot;
+  char dot_name[4];
+  struct ext2_dirent dotdot;
+  char dotdot_name[4];
+  holy_uint32_t reserved_zero;
+  holy_uint8_t hash_version;
+  holy_uint8_t info_length;
+  holy_uint8_t indirect_levels;
+  holy_uint8_t unused_flags;
+};
+
+/* Index entries.  The hash of the first one holds the limit and count of
+   entries of its block instead.  */
+struct holy_ext2_dx_entry
+{
+  holy_uint32_t hash;
+  holy_uint32_t block;
+};
+
+struct holy_ext2_dx_countlimit
+{
+  holy_uint16_t limit;
+  holy_uint16_t count;
+};
+
 #define EXT4_EXT_MAGIC		0xf30a
+#define EXT4_EXT_MAX_DEPTH	5
 
 struct holy_ext4_extent_header
 {
@@ -309,6 +361,25 @@ struct holy_fshelp_node
   int inode_read;
 };
 
+/* Where the last extent lookup ended up, so that the next one, which
+   for sequential reads is in the same leaf, need not walk down from the
+   inode again.  Level 0 is the root in the inode and level N the node N
+   steps below it.  Nodes are kept by disk block, so they stay valid when
+   another inode is looked up; only the leaf range is per inode.  */
+struct holy_ext4_extent_cursor
+{
+  /* The inode the leaf belongs to, or 0.  */
+  int ino;
+  /* The level of the leaf, and the file blocks it covers.  */
+  int leaf_level;
+  holy_uint64_t leaf_first;
+  holy_uint64_t leaf_end;
+  /* The extent of the leaf used last.  */
+  int hint;
+  holy_disk_addr_t blocks[EXT4_EXT_MAX_DEPTH + 1];
+  struct holy_ext4_extent_header *nodes[EXT4_EXT_MAX_DEPTH + 1];
+};
+
 /* Information about a "mounted" ext2 filesystem.  */
 struct holy_ext2_data
 {
@@ -317,10 +388,15 @@ struct holy_ext2_data
   holy_disk_t disk;
   struct holy_ext2_inode *inode;
   struct holy_fshelp_node diropen;
+  struct holy_ext4_extent_cursor cursor;
+  /* The root inode, for when DIROPEN has been taken over by a file.  */
+  struct holy_ext2_inode rootinode;
 };
 
 static holy_dl_t my_mod;
 
+static struct holy_fs holy_ext2_fs;
+
 
 
 /* Check is a = b^x for some x.  */
@@ -388,56 +464,124 @@ holy_ext2_blockgroup (struct holy_ext2_data *data, holy_uint64_t group,
 			 sizeof (struct holy_ext2_block_group), blkgrp);
 }
 
+/* Return the last of the entries of NODE, extents and indexes alike,
+   that starts at FILEBLOCK or before it, or -1 if there is none.  */
+static int
+holy_ext4_search (struct holy_ext4_extent_header *node,
+		  holy_uint32_t fileblock)
+{
+  struct holy_ext4_extent *ent = (struct holy_ext4_extent *) (node + 1);
+  int lo = 0, hi = holy_le_to_cpu16 (node->entries);
+
+  while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+
+      if (fileblock < holy_le_to_cpu32 (ent[mid].block))
+	hi = mid;
+      else
+	lo = mid + 1;
+    }
+  return lo - 1;
+}
+
+static int
+holy_ext4_check_node (struct holy_ext4_extent_header *node, holy_size_t size,
+		      int depth)
+{
+  return (node->magic == holy_cpu_to_le16_compile_time (EXT4_EXT_MAGIC)
+	  && holy_le_to_cpu16 (node->entries)
+	     <= (size - sizeof (*node)) / sizeof (struct holy_ext4_extent)
+	  && (depth < 0 ? holy_le_to_cpu16 (node->depth) <= EXT4_EXT_MAX_DEPTH
+	      : holy_le_to_cpu16 (node->depth) == depth));
+}
+
+/* Find the leaf of the extent tree of NODE that maps FILEBLOCK.  It stays
+   owned by the cursor of the filesystem.  */
 static struct holy_ext4_extent_header *
-holy_ext4_find_leaf (struct holy_ext2_data *data,
-                     struct holy_ext4_extent_header *ext_block,
-                     holy_uint32_t fileblock)
+holy_ext4_find_leaf (holy_fshelp_node_t node, holy_uint32_t fileblock)
 {
-  struct holy_ext4_extent_idx *index;
-  void *buf = NULL;
+  struct holy_ext2_data *data = node->data;
+  struct holy_ext4_extent_cursor *cur = &data->cursor;
+  struct holy_ext4_extent_header *ext_block;
+  holy_uint64_t first = 0, end = 1ULL << 32;
+  int level;
 
-  while (1)
+  ext_block = (struct holy_ext4_extent_header *) node->inode.blocks.dir_blocks;
+  if (cur->ino != node->ino)
     {
-      int i;
-      holy_disk_addr_t block;
+      cur->ino = node->ino;
+      cur->leaf_level = -1;
+    }
 
-      index = (struct holy_ext4_extent_idx *) (ext_block + 1);
+  /* Sequential reads mostly stay within the leaf of the last lookup.  */
+  if (cur->leaf_level >= 0
+      && fileblock >= cur->leaf_first && fileblock < cur->leaf_end)
+    return cur->leaf_level ? cur->nodes[cur->leaf_level] : ext_block;
 
-      if (ext_block->magic != holy_cpu_to_le16_compile_time (EXT4_EXT_MAGIC))
-	goto fail;
+  if (!holy_ext4_check_node (ext_block, sizeof (node->inode.blocks), -1))
+    return 0;
 
-      if (ext_block->depth == 0)
-        return ext_block;
+  for (level = 0; ; level++)
+    {
+      struct holy_ext4_extent_idx *index;
+      holy_disk_addr_t block;
+      int i, depth;
 
-      for (i = 0; i < holy_le_to_cpu16 (ext_block->entries); i++)
-        {
-          if (fileblock < holy_le_to_cpu32(index[i].block))
-            break;
-        }
+      depth = holy_le_to_cpu16 (ext_block->depth);
+      if (depth == 0)
+	{
+	  cur->leaf_level = level;
+	  cur->leaf_first = first;
+	  cur->leaf_end = end;
+	  cur->hint = 0;
+	  return ext_block;
+	}
 
-      if (--i < 0)
-	goto fail;
+      index = (struct holy_ext4_extent_idx *) (ext_block + 1);
+      i = holy_ext4_search (ext_block, fileblock);
+      if (i < 0)
+	return 0;
+
+      if (holy_le_to_cpu32 (index[i].block) > first)
+	first = holy_le_to_cpu32 (index[i].block);
+      if (i + 1 < holy_le_to_cpu16 (ext_block->entries)
+	  && holy_le_to_cpu32 (index[i + 1].block) < end)
+	end = holy_le_to_cpu32 (index[i + 1].block);
 
       block = holy_le_to_cpu16 (index[i].leaf_hi);
       block = (block << 32) | holy_le_to_cpu32 (index[i].leaf);
-      if (!buf)
-	buf = holy_malloc (EXT2_BLOCK_SIZE(data));
-      if (!buf)
-	goto fail;
-      if (holy_disk_read (data->disk,
-                          block << LOG2_EXT2_BLOCK_SIZE (data),
-                          0, EXT2_BLOCK_SIZE(data), buf))
-	goto fail;
 
-      ext_block = buf;
+      if (!cur->nodes[level + 1])
+	cur->nodes[level + 1] = holy_malloc (EXT2_BLOCK_SIZE (data));
+      if (!cur->nodes[level + 1])
+	return 0;
+      if (cur->blocks[level + 1] != block)
+	{
+	  cur->blocks[level + 1] = 0;
+	  if (holy_disk_read (data->disk,
+			      block << LOG2_EXT2_BLOCK_SIZE (data),
+			      0, EXT2_BLOCK_SIZE (data),
+			      cur->nodes[level + 1]))
+	    return 0;
+	  cur->blocks[level + 1] = block;
+	}
+
+      ext_block = cur->nodes[level + 1];
+      if (!holy_ext4_check_node (ext_block, EXT2_BLOCK_SIZE (data),
+				 depth - 1))
+	{
+	  cur->blocks[level + 1] = 0;
+	  return 0;
+	}
     }
- fail:
-  holy_free (buf);
-  return 0;
 }
 
+/* Map FILEBLOCK of NODE to a disk block, and set *LEN to how many blocks
+   from there on are contiguous on disk, or are all holes.  */
 static holy_disk_addr_t
-holy_ext2_read_block (holy_fshelp_node_t node, holy_disk_addr_t fileblock)
+holy_ext2_read_block (holy_fshelp_node_t node, holy_disk_addr_t fileblock,
+		      holy_disk_addr_t *len)
 {
   struct holy_ext2_data *data = node->data;
   struct holy_ext2_inode *inode = &node->inode;
@@ -446,59 +590,91 @@ holy_ext2_read_block (holy_fshelp_node_t node, holy_disk_addr_t fileblock)
   int log2_blksz = LOG2_EXT2_BLOCK_SIZE (data);
   int log_perblock = log2_blksz + 9 - 2;
   holy_uint32_t indir;
+  holy_uint32_t ptrs[32];
+  unsigned n, k;
   int shift;
 
   if (inode->flags & holy_cpu_to_le32_compile_time (EXT4_EXTENTS_FLAG))
     {
+      struct holy_ext4_extent_cursor *cur = &data->cursor;
       struct holy_ext4_extent_header *leaf;
       struct holy_ext4_extent *ext;
-      int i;
-      holy_disk_addr_t ret;
+      int i, entries;
+      holy_disk_addr_t off;
 
-      leaf = holy_ext4_find_leaf (data, (struct holy_ext4_extent_header *) inode->blocks.dir_blocks, fileblock);
+      if (fileblock >= (1ULL << 32))
+	{
+	  holy_error (holy_ERR_BAD_FS, "invalid extent");
+	  return -1;
+	}
+
+      leaf = holy_ext4_find_leaf (node, fileblock);
       if (! leaf)
         {
-          holy_error (holy_ERR_BAD_FS, "invalid extent");
+	  if (!holy_errno)
+	    holy_error (holy_ERR_BAD_FS, "invalid extent");
           return -1;
         }
 
       ext = (struct holy_ext4_extent *) (leaf + 1);
-      for (i = 0; i < holy_le_to_cpu16 (leaf->entries); i++)
-        {
-          if (fileblock < holy_le_to_cpu32 (ext[i].block))
-            break;
-        }
+      entries = holy_le_to_cpu16 (leaf->entries);
+
+      /* Try the extent used last and the one after it before searching
+	 the whole leaf.  */
+      for (i = cur->hint; i < entries && i <= cur->hint + 1; i++)
+	if (fileblock >= holy_le_to_cpu32 (ext[i].block)
+	    && (i + 1 == entries
+		|| fileblock < holy_le_to_cpu32 (ext[i + 1].block)))
+	  break;
+      if (i >= entries || i > cur->hint + 1)
+	i = holy_ext4_search (leaf, fileblock);
+
+      if (i < 0)
+	{
+	  /* A hole before the first extent of the leaf.  */
+	  *len = (entries ? holy_le_to_cpu32 (ext[0].block)
+		  : cur->leaf_end) - fileblock;
+	  return 0;
+	}
+      cur->hint = i;
 
-      if (--i >= 0)
-        {
-          fileblock -= holy_le_to_cpu32 (ext[i].block);
-          if (fileblock >= holy_le_to_cpu16 (ext[i].len))
-	    ret = 0;
-          else
-            {
-              holy_disk_addr_t start;
-
-              start = holy_le_to_cpu16 (ext[i].start_hi);
-              start = (start << 32) + holy_le_to_cpu32 (ext[i].start);
-
-              ret = fileblock + start;
-            }
-        }
+      off = fileblock - holy_le_to_cpu32 (ext[i].block);
+      if (off >= holy_le_to_cpu16 (ext[i].len))
+	{
+	  /* A hole up to the next extent, which may be in the next leaf.  */
+	  *len = (i + 1 < entries ? holy_le_to_cpu32 (ext[i + 1].block)
+		  : cur->leaf_end) - fileblock;
+	  return 0;
+	}
       else
-        {
-          holy_error (holy_ERR_BAD_FS, "something wrong with extent");
-	  ret = -1;
-        }
+	{
+	  holy_disk_addr_t start;
 
-      if (leaf != (struct holy_ext4_extent_header *) inode->blocks.dir_blocks)
-	holy_free (leaf);
+	  start = holy_le_to_cpu16 (ext[i].start_hi);
+	  start = (start << 32) + holy_le_to_cpu32 (ext[i].start);
 
-      return ret;
+	  *len = holy_le_to_cpu16 (ext[i].len) - off;
+	  return off + start;
+	}
     }
 
   /* Direct blocks.  */
   if (fileblock < INDIRECT_BLOCKS)
-    return holy_le_to_cpu32 (inode->blocks.dir_blocks[fileblock]);
+    {
+      holy_uint32_t first;
+
+      first = holy_le_to_cpu32 (inode->blocks.dir_blocks[fileblock]);
+      for (k = 1; fileblock + k < INDIRECT_BLOCKS; k++)
+	{
+	  holy_uint32_t next;
+
+	  next = holy_le_to_cpu32 (inode->blocks.dir_blocks[fileblock + k]);
+	  if (first ? next != first + k : next != 0)
+	    break;
+	}
+      *len = k;
+      return first;
+    }
   fileblock -= INDIRECT_BLOCKS;
   /* Indirect.  */
   if (fileblock < blksz_quarter)
@@ -528,22 +704,44 @@ holy_ext2_read_block (holy_fshelp_node_t node, holy_disk_addr_t fileblock)
   return -1;
 
 indirect:
-  do {
-    /* If the indirect block is zero, all child blocks are absent
-       (i.e. filled with zeros.) */
-    if (indir == 0)
-      return 0;
-    if (holy_disk_read (data->disk,
-			((holy_disk_addr_t) holy_le_to_cpu32 (indir))
-			<< log2_blksz,
-			((fileblock >> (log_perblock * shift))
-			 & ((1 << log_perblock) - 1))
-			* sizeof (indir),
-			sizeof (indir), &indir))
-      return -1;
-  } while (shift--);
-
-  return holy_le_to_cpu32 (indir);
+  while (1)
+    {
+      unsigned idx;
+
+      /* If the indirect block is zero, all child blocks are absent
+	 (i.e. filled with zeros.) */
+      if (indir == 0)
+	{
+	  holy_disk_addr_t span;
+
+	  span = (holy_disk_addr_t) 1 << (log_perblock * (shift + 1));
+	  *len = span - (fileblock & (span - 1));
+	  return 0;
+	}
+
+      /* At the last level take a few neighbours as well, to find out how
+	 far the run goes.  */
+      idx = (fileblock >> (log_perblock * shift)) & ((1 << log_perblock) - 1);
+      n = 1;
+      if (shift == 0)
+	n = (1U << log_perblock) - idx < ARRAY_SIZE (ptrs)
+	  ? (1U << log_perblock) - idx : ARRAY_SIZE (ptrs);
+      if (holy_disk_read (data->disk,
+			  ((holy_disk_addr_t) holy_le_to_cpu32 (indir))
+			  << log2_blksz,
+			  idx * sizeof (indir), n * sizeof (indir), ptrs))
+	return -1;
+      if (shift-- == 0)
+	break;
+      indir = ptrs[0];
+    }
+
+  indir = holy_le_to_cpu32 (ptrs[0]);
+  for (k = 1; k < n; k++)
+    if (indir ? holy_le_to_cpu32 (ptrs[k]) != indir + k : ptrs[k] != 0)
+      break;
+  *len = k;
+  return indir;
 }
 
 /* Read LEN bytes from the file described by DATA starting with byte
@@ -553,12 +751,12 @@ holy_ext2_read_file (holy_fshelp_node_t node,
 		     holy_disk_read_hook_t read_hook, void *read_hook_data,
 		     holy_off_t pos, holy_size_t len, char *buf)
 {
-  return holy_fshelp_read_file (node->data->disk, node,
-				read_hook, read_hook_data,
-				pos, len, buf, holy_ext2_read_block,
-				holy_cpu_to_le32 (node->inode.size)
-				| (((holy_off_t) holy_cpu_to_le32 (node->inode.size_high)) << 32),
-				LOG2_EXT2_BLOCK_SIZE (node->data), 0);
+  return holy_fshelp_read_file_extents (node->data->disk, node,
+					read_hook, read_hook_data,
+					pos, len, buf, holy_ext2_read_block,
+					holy_cpu_to_le32 (node->inode.size)
+					| (((holy_off_t) holy_cpu_to_le32 (node->inode.size_high)) << 32),
+					LOG2_EXT2_BLOCK_SIZE (node->data), 0);
 
 }
 
@@ -664,11 +862,15 @@ holy_ext2_mount (holy_disk_t disk)
   data->diropen.ino = 2;
   data->diropen.inode_read = 1;
 
+  holy_memset (&data->cursor, 0, sizeof (data->cursor));
+  data->cursor.leaf_level = -1;
+
   data->inode = &data->diropen.inode;
 
   holy_ext2_read_inode (data, 2, data->inode);
   if (holy_errno)
     goto fail;
+  data->rootinode = *data->inode;
 
   return data;
 
@@ -720,6 +922,62 @@ holy_ext2_read_symlink (holy_fshelp_node_t node)
   return symlink;
 }
 
+/* Make a node for the file DIRENT of DIRO names, and set *TYPE to its
+   type.  */
+static struct holy_fshelp_node *
+holy_ext2_dirent_node (struct holy_fshelp_node *diro,
+		       const struct ext2_dirent *dirent,
+		       enum holy_fshelp_filetype *type)
+{
+  struct holy_fshelp_node *fdiro;
+
+  fdiro = holy_malloc (sizeof (struct holy_fshelp_node));
+  if (! fdiro)
+    return 0;
+
+  fdiro->data = diro->data;
+  fdiro->ino = holy_le_to_cpu32 (dirent->inode);
+  *type = holy_FSHELP_UNKNOWN;
+
+  if (dirent->filetype != FILETYPE_UNKNOWN)
+    {
+      fdiro->inode_read = 0;
+
+      if (dirent->filetype == FILETYPE_DIRECTORY)
+	*type = holy_FSHELP_DIR;
+      else if (dirent->filetype == FILETYPE_SYMLINK)
+	*type = holy_FSHELP_SYMLINK;
+      else if (dirent->filetype == FILETYPE_REG)
+	*type = holy_FSHELP_REG;
+    }
+  else
+    {
+      /* The filetype can not be read from the dirent, read
+	 the inode to get more information.  */
+      holy_ext2_read_inode (diro->data, holy_le_to_cpu32 (dirent->inode),
+			    &fdiro->inode);
+      if (holy_errno)
+	{
+	  holy_free (fdiro);
+	  return 0;
+	}
+
+      fdiro->inode_read = 1;
+
+      if ((holy_le_to_cpu16 (fdiro->inode.mode)
+	   & FILETYPE_INO_MASK) == FILETYPE_INO_DIRECTORY)
+	*type = holy_FSHELP_DIR;
+      else if ((holy_le_to_cpu16 (fdiro->inode.mode)
+		& FILETYPE_INO_MASK) == FILETYPE_INO_SYMLINK)
+	*type = holy_FSHELP_SYMLINK;
+      else if ((holy_le_to_cpu16 (fdiro->inode.mode)
+		& FILETYPE_INO_MASK) == FILETYPE_INO_REG)
+	*type = holy_FSHELP_REG;
+    }
+
+  return fdiro;
+}
+
 static int
 holy_ext2_iterate_dir (holy_fshelp_node_t dir,
 		       holy_fshelp_iterate_dir_hook_t hook, void *hook_data)
@@ -751,69 +1009,510 @@ holy_ext2_iterate_dir (holy_fshelp_node_t dir,
 	{
 	  char filename[MAX_NAMELEN + 1];
 	  struct holy_fshelp_node *fdiro;
-	  enum holy_fshelp_filetype type = holy_FSHELP_UNKNOWN;
+	  enum holy_fshelp_filetype type;
 
 	  holy_ext2_read_file (diro, 0, 0, fpos + sizeof (struct ext2_dirent),
 			       dirent.namelen, filename);
 	  if (holy_errno)
 	    return 0;
 
-	  fdiro = holy_malloc (sizeof (struct holy_fshelp_node));
+	  filename[dirent.namelen] = '\0';
+
+	  fdiro = holy_ext2_dirent_node (diro, &dirent, &type);
 	  if (! fdiro)
 	    return 0;
 
-	  fdiro->data = diro->data;
-	  fdiro->ino = holy_le_to_cpu32 (dirent.inode);
+	  if (hook (filename, type, fdiro, hook_data))
+	    return 1;
+	}
 
-	  filename[dirent.namelen] = '\0';
+      fpos += holy_le_to_cpu16 (dirent.direntlen);
+    }
+
+  return 0;
+}
+
+/* The legacy directory hash.  */
+static holy_uint32_t
+holy_ext2_dx_hack_hash (const char *name, int len, int unsigned_chars)
+{
+  holy_uint32_t hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+
+  for (; len; len--, name++)
+    {
+      int c = unsigned_chars ? (holy_uint8_t) *name : (holy_int8_t) *name;
+
+      hash = hash1 + (hash0 ^ (holy_uint32_t) (c * 7152373));
+      if (hash & 0x80000000)
+	hash -= 0x7fffffff;
+      hash1 = hash0;
+      hash0 = hash;
+    }
+  return hash0 << 1;
+}
+
+/* Pack up to NUM * 4 characters of NAME into NUM words of BUF, padded
+   with the length.  */
+static void
+holy_ext2_str2hashbuf (const char *name, int len, holy_uint32_t *buf,
+		       int num, int unsigned_chars)
+{
+  holy_uint32_t pad, val;
+  int i;
+
+  pad = (holy_uint32_t) len | ((holy_uint32_t) len << 8);
+  pad |= pad << 16;
+
+  val = pad;
+  if (len > num * 4)
+    len = num * 4;
+  for (i = 0; i < len; i++)
+    {
+      int c = (unsigned_chars ? (holy_uint8_t) name[i]
+	       : (holy_int8_t) name[i]);
 
-	  if (dirent.filetype != FILETYPE_UNKNOWN)
+      val = (holy_uint32_t) c + (val << 8);
+      if ((i % 4) == 3)
+	{
+	  *buf++ = val;
+	  val = pad;
+	  num--;
+	}
+    }
+  if (--num >= 0)
+    *buf++ = val;
+  while (--num >= 0)
+    *buf++ = pad;
+}
+
+static void
+holy_ext2_tea_transform (holy_uint32_t buf[4], const holy_uint32_t in[4])
+{
+  holy_uint32_t sum = 0;
+  holy_uint32_t b0 = buf[0], b1 = buf[1];
+  int n;
+
+  for (n = 0; n < 16; n++)
+    {
+      sum += 0x9e3779b9;
+      b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+      b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+    }
+
+  buf[0] += b0;
+  buf[1] += b1;
+}
+
+#define HALF_MD4_F(x, y, z)	((z) ^ ((x) & ((y) ^ (z))))
+#define HALF_MD4_G(x, y, z)	(((x) & (y)) + (((x) ^ (y)) & (z)))
+#define HALF_MD4_H(x, y, z)	((x) ^ (y) ^ (z))
+#define HALF_MD4_ROUND(f, a, b, c, d, x, s)		\
+  do							\
+    {							\
+      (a) += f ((b), (c), (d)) + (x);			\
+      (a) = ((a) << (s)) | ((a) >> (32 - (s)));		\
+    }							\
+  while (0)
+#define HALF_MD4_K2		013240474631U
+#define HALF_MD4_K3		015666365641U
+
+/* MD4 cut down to three rounds of eight steps.  */
+static void
+holy_ext2_half_md4_transform (holy_uint32_t buf[4], const holy_uint32_t in[8])
+{
+  holy_uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+  HALF_MD4_ROUND (HALF_MD4_F, a, b, c, d, in[0], 3);
+  HALF_MD4_ROUND (HALF_MD4_F, d, a, b, c, in[1], 7);
+  HALF_MD4_ROUND (HALF_MD4_F, c, d, a, b, in[2], 11);
+  HALF_MD4_ROUND (HALF_MD4_F, b, c, d, a, in[3], 19);
+  HALF_MD4_ROUND (HALF_MD4_F, a, b, c, d, in[4], 3);
+  HALF_MD4_ROUND (HALF_MD4_F, d, a, b, c, in[5], 7);
+  HALF_MD4_ROUND (HALF_MD4_F, c, d, a, b, in[6], 11);
+  HALF_MD4_ROUND (HALF_MD4_F, b, c, d, a, in[7], 19);
+
+  HALF_MD4_ROUND (HALF_MD4_G, a, b, c, d, in[1] + HALF_MD4_K2, 3);
+  HALF_MD4_ROUND (HALF_MD4_G, d, a, b, c, in[3] + HALF_MD4_K2, 5);
+  HALF_MD4_ROUND (HALF_MD4_G, c, d, a, b, in[5] + HALF_MD4_K2, 9);
+  HALF_MD4_ROUND (HALF_MD4_G, b, c, d, a, in[7] + HALF_MD4_K2, 13);
+  HALF_MD4_ROUND (HALF_MD4_G, a, b, c, d, in[0] + HALF_MD4_K2, 3);
+  HALF_MD4_ROUND (HALF_MD4_G, d, a, b, c, in[2] + HALF_MD4_K2, 5);
+  HALF_MD4_ROUND (HALF_MD4_G, c, d, a, b, in[4] + HALF_MD4_K2, 9);
+  HALF_MD4_ROUND (HALF_MD4_G, b, c, d, a, in[6] + HALF_MD4_K2, 13);
+
+  HALF_MD4_ROUND (HALF_MD4_H, a, b, c, d, in[3] + HALF_MD4_K3, 3);
+  HALF_MD4_ROUND (HALF_MD4_H, d, a, b, c, in[7] + HALF_MD4_K3, 9);
+  HALF_MD4_ROUND (HALF_MD4_H, c, d, a, b, in[2] + HALF_MD4_K3, 11);
+  HALF_MD4_ROUND (HALF_MD4_H, b, c, d, a, in[6] + HALF_MD4_K3, 15);
+  HALF_MD4_ROUND (HALF_MD4_H, a, b, c, d, in[1] + HALF_MD4_K3, 3);
+  HALF_MD4_ROUND (HALF_MD4_H, d, a, b, c, in[5] + HALF_MD4_K3, 9);
+  HALF_MD4_ROUND (HALF_MD4_H, c, d, a, b, in[0] + HALF_MD4_K3, 11);
+  HALF_MD4_ROUND (HALF_MD4_H, b, c, d, a, in[4] + HALF_MD4_K3, 15);
+
+  buf[0] += a;
+  buf[1] += b;
+  buf[2] += c;
+  buf[3] += d;
+}
+
+/* Hash NAME the way directory index VERSION does, for DATA.  Return 0 with
+   an unknown VERSION, which no real name hashes to.  */
+static holy_uint32_t
+holy_ext2_dx_hash (struct holy_ext2_data *data, int version,
+		   const char *name, int len)
+{
+  holy_uint32_t buf[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+  holy_uint32_t in[8], hash;
+  int i, unsigned_chars = 0;
+
+  for (i = 0; i < 4; i++)
+    if (data->sblock.hash_seed[i])
+      break;
+  if (i < 4)
+    for (i = 0; i < 4; i++)
+      buf[i] = holy_le_to_cpu32 (data->sblock.hash_seed[i]);
+
+  switch (version)
+    {
+    case EXT2_HASH_LEGACY_UNSIGNED:
+      unsigned_chars = 1;
+      /* Fallthrough.  */
+    case EXT2_HASH_LEGACY:
+      hash = holy_ext2_dx_hack_hash (name, len, unsigned_chars);
+      break;
+
+    case EXT2_HASH_HALF_MD4_UNSIGNED:
+      unsigned_chars = 1;
+      /* Fallthrough.  */
+    case EXT2_HASH_HALF_MD4:
+      for (; len > 0; len -= 32, name += 32)
+	{
+	  holy_ext2_str2hashbuf (name, len, in, 8, unsigned_chars);
+	  holy_ext2_half_md4_transform (buf, in);
+	}
+      hash = buf[1];
+      break;
+
+    case EXT2_HASH_TEA_UNSIGNED:
+      unsigned_chars = 1;
+      /* Fallthrough.  */
+    case EXT2_HASH_TEA:
+      for (; len > 0; len -= 16, name += 16)
+	{
+	  holy_ext2_str2hashbuf (name, len, in, 4, unsigned_chars);
+	  holy_ext2_tea_transform (buf, in);
+	}
+      hash = buf[0];
+      break;
+
+    default:
+      return 0;
+    }
+
+  hash &= ~1;
+  /* The end of directory marker for 32-bit readdir cookies.  */
+  if (hash == 0xfffffffe)
+    hash = 0xfffffffc;
+  return hash;
+}
+
+/* Read the block BLOCK of the directory DIRO into BUF.  */
+static holy_err_t
+holy_ext2_read_dir_block (struct holy_fshelp_node *diro, holy_uint32_t block,
+			  char *buf)
+{
+  unsigned int blksz = EXT2_BLOCK_SIZE (diro->data);
+
+  if (((holy_off_t) block + 1) * blksz > holy_le_to_cpu32 (diro->inode.size))
+    return holy_error (holy_ERR_BAD_FS, "invalid directory index");
+  if (holy_ext2_read_file (diro, 0, 0, (holy_off_t) block * blksz, blksz,
+			   buf) != (holy_ssize_t) blksz && !holy_errno)
+    holy_error (holy_ERR_BAD_FS, "invalid directory index");
+  return holy_errno;
+}
+
+/* A node of the path from the root of a directory index to a leaf.  */
+struct holy_ext2_dx_frame
+{
+  struct holy_ext2_dx_entry *entries;
+  unsigned count;
+  unsigned at;
+};
+
+/* Find the entries of the index block BUF, whose header is OFFSET bytes
+   in, and fill FRAME with them.  */
+static int
+holy_ext2_dx_frame (struct holy_ext2_dx_frame *frame, char *buf,
+		    unsigned int offset, unsigned int blksz)
+{
+  struct holy_ext2_dx_countlimit *cl;
+
+  if (offset + sizeof (*cl) > blksz)
+    return 0;
+  cl = (struct holy_ext2_dx_countlimit *) (buf + offset);
+  frame->entries = (struct holy_ext2_dx_entry *) cl;
+  frame->count = holy_le_to_cpu16 (cl->count);
+  frame->at = 0;
+  return (frame->count != 0
+	  && frame->count <= holy_le_to_cpu16 (cl->limit)
+	  && holy_le_to_cpu16 (cl->limit)
+	     <= (blksz - offset) / sizeof (struct holy_ext2_dx_entry));
+}
+
+/* Point FRAME at its last entry whose hash is HASH or lower.  The first
+   entry stands for every hash below the second.  */
+static void
+holy_ext2_dx_search (struct holy_ext2_dx_frame *frame, holy_uint32_t hash)
+{
+  unsigned lo = 1, hi = frame->count;
+
+  while (lo < hi)
+    {
+      unsigned mid = (lo + hi) / 2;
+
+      if (holy_le_to_cpu32 (frame->entries[mid].hash) > hash)
+	hi = mid;
+      else
+	lo = mid + 1;
+    }
+  frame->at = lo - 1;
+}
+
+static holy_uint32_t
+holy_ext2_dx_block (struct holy_ext2_dx_frame *frame)
+{
+  return holy_le_to_cpu32 (frame->entries[frame->at].block) & 0x0fffffff;
+}
+
+/* Look NAME up in the leaf block BUF of directory DIRO.  */
+static holy_err_t
+holy_ext2_dx_leaf_find (struct holy_fshelp_node *diro, const char *buf,
+			const char *name, holy_size_t len,
+			holy_fshelp_node_t *foundnode,
+			enum holy_fshelp_filetype *foundtype)
+{
+  unsigned int blksz = EXT2_BLOCK_SIZE (diro->data);
+  unsigned int pos = 0;
+
+  while (pos + sizeof (struct ext2_dirent) <= blksz)
+    {
+      const struct ext2_dirent *dirent;
+      unsigned int direntlen;
+
+      dirent = (const struct ext2_dirent *) (buf + pos);
+      direntlen = holy_le_to_cpu16 (dirent->direntlen);
+      if (direntlen < sizeof (*dirent) || pos + direntlen > blksz
+	  || sizeof (*dirent) + dirent->namelen > direntlen)
+	return holy_error (holy_ERR_BAD_FS, "invalid directory entry");
+
+      if (dirent->inode != 0 && dirent->namelen == len
+	  && holy_memcmp (dirent + 1, name, len) == 0)
+	{
+	  *foundnode = holy_ext2_dirent_node (diro, dirent, foundtype);
+	  return holy_errno;
+	}
+      pos += direntlen;
+    }
+  return holy_ERR_NONE;
+}
+
+/* Look NAME up in the directory DIR using its hash tree, reading one
+   block per level of it and then the leaf the hash of NAME falls in.
+   Directories without an index are left to holy_ext2_iterate_dir.  */
+static holy_err_t
+holy_ext2_lookup_file (holy_fshelp_node_t dir, const char *name,
+		       holy_fshelp_node_t *foundnode,
+		       enum holy_fshelp_filetype *foundtype)
+{
+  struct holy_fshelp_node *diro = dir;
+  struct holy_ext2_data *data = diro->data;
+  struct holy_ext2_dx_frame frames[EXT2_DX_MAX_INDIRECT + 1];
+  struct holy_ext2_dx_root *root;
+  unsigned int blksz = EXT2_BLOCK_SIZE (data);
+  holy_size_t len = holy_strlen (name);
+  char *bufs[EXT2_DX_MAX_INDIRECT + 2] = { 0 };
+  int levels, version, i;
+  holy_uint32_t hash;
+  holy_err_t err = holy_ERR_NOT_IMPLEMENTED_YET;
+
+  if (! diro->inode_read)
+    {
+      holy_ext2_read_inode (data, diro->ino, &diro->inode);
+      if (holy_errno)
+	return holy_errno;
+      diro->inode_read = 1;
+    }
+
+  if (!(data->sblock.feature_compatibility
+	& holy_cpu_to_le32_compile_time (EXT2_FEATURE_COMPAT_DIR_INDEX))
+      || !(diro->inode.flags
+	   & holy_cpu_to_le32_compile_time (EXT2_INDEX_FLAG)))
+    return holy_ERR_NOT_IMPLEMENTED_YET;
+
+  /* Not a name any directory holds.  */
+  if (len == 0 || len > MAX_NAMELEN)
+    return holy_ERR_NONE;
+
+  for (i = 0; i < EXT2_DX_MAX_INDIRECT + 2; i++)
+    {
+      bufs[i] = holy_malloc (blksz);
+      if (!bufs[i])
+	{
+	  err = holy_errno;
+	  goto out;
+	}
+    }
+
+  if (holy_ext2_read_dir_block (diro, 0, bufs[0]))
+    {
+      err = holy_errno;
+      goto out;
+    }
+
+  /* Anything unexpected in the root, such as a hash function from a
+     newer kernel, means falling back to a linear scan.  */
+  root = (struct holy_ext2_dx_root *) bufs[0];
+  levels = root->indirect_levels;
+  version = root->hash_version;
+  if (root->reserved_zero != 0 || root->info_length != 8
+      || levels > EXT2_DX_MAX_INDIRECT
+      || !holy_ext2_dx_frame (&frames[0], bufs[0],
+			      sizeof (*root), blksz))
+    goto out;
+  if (version <= EXT2_HASH_TEA
+      && (data->sblock.flags
+	  & holy_cpu_to_le32_compile_time (EXT2_FLAGS_UNSIGNED_HASH)))
+    version += EXT2_HASH_LEGACY_UNSIGNED;
+  if (version > EXT2_HASH_TEA_UNSIGNED)
+    goto out;
+
+  hash = holy_ext2_dx_hash (data, version, name, len);
+
+  holy_ext2_dx_search (&frames[0], hash);
+  for (i = 1; i <= levels; i++)
+    {
+      if (holy_ext2_read_dir_block (diro, holy_ext2_dx_block (&frames[i - 1]),
+				    bufs[i]))
+	{
+	  err = holy_errno;
+	  goto out;
+	}
+      if (!holy_ext2_dx_frame (&frames[i], bufs[i],
+			       sizeof (struct ext2_dirent), blksz))
+	goto out;
+      holy_ext2_dx_search (&frames[i], hash);
+    }
+
+  while (1)
+    {
+      int level;
+
+      if (holy_ext2_read_dir_block (diro, holy_ext2_dx_block (&frames[levels]),
+				    bufs[levels + 1]))
+	{
+	  err = holy_errno;
+	  goto out;
+	}
+
+      err = holy_ext2_dx_leaf_find (diro, bufs[levels + 1], name, len,
+				    foundnode, foundtype);
+      if (err || *foundnode)
+	goto out;
+
+      /* Names whose hashes collide may go on in the next leaf, which
+	 then starts with the same hash.  */
+      for (level = levels; level >= 0; level--)
+	if (frames[level].at + 1 < frames[level].count)
+	  break;
+      if (level < 0)
+	break;
+      frames[level].at++;
+      if ((holy_le_to_cpu32 (frames[level].entries[frames[level].at].hash)
+	   & ~1) != hash)
+	break;
+
+      for (level++; level <= levels; level++)
+	{
+	  holy_uint32_t block = holy_ext2_dx_block (&frames[level - 1]);
+
+	  if (holy_ext2_read_dir_block (diro, block, bufs[level]))
 	    {
-	      fdiro->inode_read = 0;
-
-	      if (dirent.filetype == FILETYPE_DIRECTORY)
-		type = holy_FSHELP_DIR;
-	      else if (dirent.filetype == FILETYPE_SYMLINK)
-		type = holy_FSHELP_SYMLINK;
-	      else if (dirent.filetype == FILETYPE_REG)
-		type = holy_FSHELP_REG;
+	      err = holy_errno;
+	      goto out;
 	    }
-	  else
+	  if (!holy_ext2_dx_frame (&frames[level], bufs[level],
+				   sizeof (struct ext2_dirent), blksz))
 	    {
-	      /* The filetype can not be read from the dirent, read
-		 the inode to get more information.  */
-	      holy_ext2_read_inode (diro->data,
-                                    holy_le_to_cpu32 (dirent.inode),
-				    &fdiro->inode);
-	      if (holy_errno)
-		{
-		  holy_free (fdiro);
-		  return 0;
-		}
-
-	      fdiro->inode_read = 1;
-
-	      if ((holy_le_to_cpu16 (fdiro->inode.mode)
-		   & FILETYPE_INO_MASK) == FILETYPE_INO_DIRECTORY)
-		type = holy_FSHELP_DIR;
-	      else if ((holy_le_to_cpu16 (fdiro->inode.mode)
-			& FILETYPE_INO_MASK) == FILETYPE_INO_SYMLINK)
-		type = holy_FSHELP_SYMLINK;
-	      else if ((holy_le_to_cpu16 (fdiro->inode.mode)
-			& FILETYPE_INO_MASK) == FILETYPE_INO_REG)
-		type = holy_FSHELP_REG;
+	      err = holy_error (holy_ERR_BAD_FS, "invalid directory index");
+	      goto out;
 	    }
-
-	  if (hook (filename, type, fdiro, hook_data))
-	    return 1;
 	}
-
-      fpos += holy_le_to_cpu16 (dirent.direntlen);
     }
+  err = holy_ERR_NONE;
 
-  return 0;
+ out:
+  for (i = 0; i < EXT2_DX_MAX_INDIRECT + 2; i++)
+    holy_free (bufs[i]);
+  return err;
+}
+
+static void
+holy_ext2_unmount (struct holy_ext2_data *data)
+{
+  int i;
+
+  if (!data)
+    return;
+  for (i = 0; i <= EXT4_EXT_MAX_DEPTH; i++)
+    holy_free (data->cursor.nodes[i]);
+  holy_free (data);
+}
+
+static void *
+holy_ext2_mount_device (holy_device_t device)
+{
+  return holy_ext2_mount (device->disk);
+}
+
+/* Make a kept mount whose DIROPEN a file took over usable again.  The
+   extent cursor stays, its nodes are keyed by disk block.  */
+static holy_err_t
+holy_ext2_remount (void *mount, holy_device_t device)
+{
+  struct holy_ext2_data *data = mount;
+
+  data->disk = device->disk;
+  data->diropen.ino = 2;
+  data->diropen.inode_read = 1;
+  *data->inode = data->rootinode;
+  return holy_ERR_NONE;
+}
+
+static void
+holy_ext2_unmount_data (void *data)
+{
+  holy_ext2_unmount (data);
+}
+
+static holy_fshelp_node_t
+holy_ext2_dup_node (holy_fshelp_node_t node, holy_fshelp_node_t rootnode)
+{
+  holy_fshelp_node_t copy;
+
+  copy = holy_malloc (sizeof (*copy));
+  if (! copy)
+    return 0;
+  holy_memcpy (copy, node, sizeof (*copy));
+  copy->data = rootnode->data;
+  return copy;
 }
 
+static const struct holy_fshelp_dcache_ops holy_ext2_dcache_ops =
+  {
+    .name = "ext2",
+    .dup_node = holy_ext2_dup_node
+  };
+
 /* Open a file named NAME and initialize FILE.  */
 static holy_err_t
 holy_ext2_open (struct holy_file *file, const char *name)
@@ -824,16 +1523,19 @@ holy_ext2_open (struct holy_file *file, const char *name)
 
   holy_dl_ref (my_mod);
 
-  data = holy_ext2_mount (file->device->disk);
+  data = holy_fs_mount (&holy_ext2_fs, file->device);
   if (! data)
     {
       err = holy_errno;
       goto fail;
     }
 
-  err = holy_fshelp_find_file (name, &data->diropen, &fdiro,
-			       holy_ext2_iterate_dir,
-			       holy_ext2_read_symlink, holy_FSHELP_REG);
+  err = holy_fshelp_find_file_cached (&holy_ext2_dcache_ops, data->disk,
+				      name, &data->diropen, &fdiro,
+				      holy_ext2_iterate_dir,
+				      holy_ext2_lookup_file,
+				      holy_ext2_read_symlink,
+				      holy_FSHELP_REG);
   if (err)
     goto fail;
 
@@ -845,6 +1547,7 @@ holy_ext2_open (struct holy_file *file, const char *name)
     }
 
   holy_memcpy (data->inode, &fdiro->inode, sizeof (struct holy_ext2_inode));
+  data->diropen.ino = fdiro->ino;
   holy_free (fdiro);
 
   file->size = holy_le_to_cpu32 (data->inode->size);
@@ -857,7 +1560,7 @@ holy_ext2_open (struct holy_file *file, const char *name)
  fail:
   if (fdiro != &data->diropen)
     holy_free (fdiro);
-  holy_free (data);
+  holy_fs_unmount (&holy_ext2_fs, data);
 
   holy_dl_unref (my_mod);
 
@@ -867,7 +1570,7 @@ holy_ext2_open (struct holy_file *file, const char *name)
 static holy_err_t
 holy_ext2_close (holy_file_t file)
 {
-  holy_free (file->data);
+  holy_fs_unmount (&holy_ext2_fs, file->data);
 
   holy_dl_unref (my_mod);
 
@@ -933,13 +1636,14 @@ holy_ext2_dir (holy_device_t device, const char *path, holy_fs_dir_hook_t hook,
 
   holy_dl_ref (my_mod);
 
-  ctx.data = holy_ext2_mount (device->disk);
+  ctx.data = holy_fs_mount (&holy_ext2_fs, device);
   if (! ctx.data)
     goto fail;
 
-  holy_fshelp_find_file (path, &ctx.data->diropen, &fdiro,
-			 holy_ext2_iterate_dir, holy_ext2_read_symlink,
-			 holy_FSHELP_DIR);
+  holy_fshelp_find_file_cached (&holy_ext2_dcache_ops, ctx.data->disk,
+				path, &ctx.data->diropen, &fdiro,
+				holy_ext2_iterate_dir, holy_ext2_lookup_file,
+				holy_ext2_read_symlink, holy_FSHELP_DIR);
   if (holy_errno)
     goto fail;
 
@@ -948,7 +1652,7 @@ holy_ext2_dir (holy_device_t device, const char *path, holy_fs_dir_hook_t hook,
  fail:
   if (fdiro != &ctx.data->diropen)
     holy_free (fdiro);
-  holy_free (ctx.data);
+  holy_fs_unmount (&holy_ext2_fs, ctx.data);
 
   holy_dl_unref (my_mod);
 
@@ -959,11 +1663,10 @@ static holy_err_t
 holy_ext2_label (holy_device_t device, char **label)
 {
   struct holy_ext2_data *data;
-  holy_disk_t disk = device->disk;
 
   holy_dl_ref (my_mod);
 
-  data = holy_ext2_mount (disk);
+  data = holy_fs_mount (&holy_ext2_fs, device);
   if (data)
     *label = holy_strndup (data->sblock.volume_name,
 			   sizeof (data->sblock.volume_name));
@@ -972,7 +1675,7 @@ holy_ext2_label (holy_device_t device, char **label)
 
   holy_dl_unref (my_mod);
 
-  holy_free (data);
+  holy_fs_unmount (&holy_ext2_fs, data);
 
   return holy_errno;
 }
@@ -981,11 +1684,10 @@ static holy_err_t
 holy_ext2_uuid (holy_device_t device, char **uuid)
 {
   struct holy_ext2_data *data;
-  holy_disk_t disk = device->disk;
 
   holy_dl_ref (my_mod);
 
-  data = holy_ext2_mount (disk);
+  data = holy_fs_mount (&holy_ext2_fs, device);
   if (data)
     {
       *uuid = holy_xasprintf ("%04x%04x-%04x-%04x-%04x-%04x%04x%04x",
@@ -1003,7 +1705,7 @@ holy_ext2_uuid (holy_device_t device, char **uuid)
 
   holy_dl_unref (my_mod);
 
-  holy_free (data);
+  holy_fs_unmount (&holy_ext2_fs, data);
 
   return holy_errno;
 }
@@ -1013,11 +1715,10 @@ static holy_err_t
 holy_ext2_mtime (holy_device_t device, holy_int32_t *tm)
 {
   struct holy_ext2_data *data;
-  holy_disk_t disk = device->disk;
 
   holy_dl_ref (my_mod);
 
-  data = holy_ext2_mount (disk);
+  data = holy_fs_mount (&holy_ext2_fs, device);
   if (!data)
     *tm = 0;
   else
@@ -1025,7 +1726,7 @@ holy_ext2_mtime (holy_device_t device, holy_int32_t *tm)
 
   holy_dl_unref (my_mod);
 
-  holy_free (data);
+  holy_fs_unmount (&holy_ext2_fs, data);
 
   return holy_errno;
 
@@ -1043,6 +1744,9 @@ static struct holy_fs holy_ext2_fs =
     .label = holy_ext2_label,
     .uuid = holy_ext2_uuid,
     .mtime = holy_ext2_mtime,
+    .mount = holy_ext2_mount_device,
+    .remount = holy_ext2_remount,
+    .unmount = holy_ext2_unmount_data,
 #ifdef holy_UTIL
     .reserved_first_sector = 1,
     .blocklist_install = 1,
@@ -434,6 +434,68 @@ holy_fat_mount (holy_disk_t disk)
   return 0;
 }
 
+/* Look up the cluster after the current one of NODE in the FAT.  Set
+   *NEXT to it, or to 0 at the end of the chain.  */
+static holy_err_t
+holy_fat_next_cluster (holy_disk_t disk, holy_fshelp_node_t node,
+		       holy_uint32_t *next)
+{
+  holy_uint32_t next_cluster;
+  holy_uint32_t fat_offset;
+
+  holy_fshelp_stats.map_calls++;
+  switch (node->data->fat_size)
+    {
+    case 32:
+      fat_offset = node->cur_cluster << 2;
+      break;
+    case 16:
+      fat_offset = node->cur_cluster << 1;
+      break;
+    default:
+      /* case 12: */
+      fat_offset = node->cur_cluster + (node->cur_cluster >> 1);
+      break;
+    }
+
+  /* Read the FAT.  */
+  if (holy_disk_read (disk, node->data->fat_sector, fat_offset,
+		      (node->data->fat_size + 7) >> 3,
+		      (char *) &next_cluster))
+    return holy_errno;
+
+  next_cluster = holy_le_to_cpu32 (next_cluster);
+  switch (node->data->fat_size)
+    {
+    case 16:
+      next_cluster &= 0xFFFF;
+      break;
+    case 12:
+      if (node->cur_cluster & 1)
+	next_cluster >>= 4;
+
+      next_cluster &= 0x0FFF;
+      break;
+    }
+
+  holy_dprintf ("fat", "fat_size=%d, next_cluster=%u\n",
+		node->data->fat_size, next_cluster);
+
+  /* Check the end.  */
+  if (next_cluster >= node->data->cluster_eof_mark)
+    {
+      *next = 0;
+      return holy_ERR_NONE;
+    }
+
+  if (next_cluster < 2 || next_cluster >= node->data->num_clusters)
+    return holy_error (holy_ERR_BAD_FS, "invalid cluster %u",
+		       next_cluster);
+
+  *next = next_cluster;
+  return holy_ERR_NONE;
+}
+
 static holy_ssize_t
 holy_fat_read_data (holy_disk_t disk, holy_fshelp_node_t node,
 		    holy_disk_read_hook_t read_hook, void *read_hook_data,
@@ -497,58 +559,13 @@ holy_fat_read_data (holy_disk_t disk, holy_fshelp_node_t node,
     {
       while (logical_cluster > node->cur_cluster_num)
 	{
-	  /* Find next cluster.  */
 	  holy_uint32_t next_cluster;
-	  holy_uint32_t fat_offset;
 
-	  switch (node->data->fat_size)
-	    {
-	    case 32:
-	      fat_offset = node->cur_cluster << 2;
-	      break;
-	    case 16:
-	      fat_offset = node->cur_cluster << 1;
-	      break;
-	    default:
-	      /* case 12: */
-	      fat_offset = node->cur_cluster + (node->cur_cluster >> 1);
-	      break;
-	    }
-
-	  /* Read the FAT.  */
-	  if (holy_disk_read (disk, node->data->fat_sector, fat_offset,
-			      (node->data->fat_size + 7) >> 3,
-			      (char *) &next_cluster))
+	  if (holy_fat_next_cluster (disk, node, &next_cluster))
 	    return -1;
-
-	  next_cluster = holy_le_to_cpu32 (next_cluster);
-	  switch (node->data->fat_size)
-	    {
-	    case 16:
-	      next_cluster &= 0xFFFF;
-	      break;
-	    case 12:
-	      if (node->cur_cluster & 1)
-		next_cluster >>= 4;
-
-	      next_cluster &= 0x0FFF;
-	      break;
-	    }
-
-	  holy_dprintf ("fat", "fat_size=%d, next_cluster=%u\n",
-			node->data->fat_size, next_cluster);
-
-	  /* Check the end.  */
-	  if (next_cluster >= node->data->cluster_eof_mark)
+	  if (!next_cluster)
 	    return ret;
 
-	  if (next_cluster < 2 || next_cluster >= node->data->num_clusters)
-	    {
-	      holy_error (holy_ERR_BAD_FS, "invalid cluster %u",
-			  next_cluster);
-	      return -1;
-	    }
-
 	  node->cur_cluster = next_cluster;
 	  node->cur_cluster_num++;
 	}
@@ -558,11 +575,29 @@ holy_fat_read_data (holy_disk_t disk, holy_fshelp_node_t node,
 		+ ((node->cur_cluster - 2)
 		   << node->data->cluster_bits));
       size = (1 << logical_cluster_bits) - offset;
+
+      /* Take in the clusters that follow on disk, to read them all at
+	 once.  */
+      while (size < len && !holy_fshelp_per_block)
+	{
+	  holy_uint32_t next_cluster;
+
+	  if (holy_fat_next_cluster (disk, node, &next_cluster))
+	    return -1;
+	  if (next_cluster != node->cur_cluster + 1)
+	    break;
+
+	  node->cur_cluster = next_cluster;
+	  node->cur_cluster_num++;
+	  logical_cluster++;
+	  size += 1 << logical_cluster_bits;
+	}
       if (size > len)
 	size = len;
 
       disk->read_hook = read_hook;
       disk->read_hook_data = read_hook_data;
+      holy_fshelp_stats.disk_reads++;
       holy_disk_read (disk, sector, offset, size, buf);
       disk->read_hook = 0;
       if (holy_errno)
@@ -904,6 +939,32 @@ static holy_err_t lookup_file (holy_fshelp_node_t node,
 
 }
 
+static holy_fshelp_node_t
+holy_fat_dup_node (holy_fshelp_node_t node, holy_fshelp_node_t rootnode)
+{
+  holy_fshelp_node_t copy;
+
+  copy = holy_malloc (sizeof (*copy));
+  if (! copy)
+    return 0;
+  *copy = *node;
+  copy->disk = rootnode->disk;
+  copy->data = rootnode->data;
+  copy->cur_cluster_num = ~0U;
+  copy->cur_cluster = 0;
+  return copy;
+}
+
+static const struct holy_fshelp_dcache_ops holy_fat_dcache_ops =
+  {
+#ifdef MODE_EXFAT
+    .name = "exfat",
+#else
+    .name = "fat",
+#endif
+    .dup_node = holy_fat_dup_node
+  };
+
 static holy_err_t
 holy_fat_dir (holy_device_t device, const char *path, holy_fs_dir_hook_t hook,
 	      void *hook_data)
@@ -933,7 +994,9 @@ holy_fat_dir (holy_device_t device, const char *path, holy_fs_dir_hook_t hook,
 #endif
   };
 
-  err = holy_fshelp_find_file_lookup (path, &root, &found, lookup_file, NULL, holy_FSHELP_DIR);
+  err = holy_fshelp_find_file_cached (&holy_fat_dcache_ops, disk, path, &root,
+				      &found, NULL, lookup_file, NULL,
+				      holy_FSHELP_DIR);
   if (err)
     goto fail;
 
@@ -1001,7 +1064,9 @@ holy_fat_open (holy_file_t file, const char *name)
 #endif
   };
 
-  err = holy_fshelp_find_file_lookup (name, &root, &found, lookup_file, NULL, holy_FSHELP_REG);
+  err = holy_fshelp_find_file_cached (&holy_fat_dcache_ops, disk, name, &root,
+				      &found, NULL, lookup_file, NULL,
+				      holy_FSHELP_REG);
   if (err)
     goto fail;
 
@@ -7,6 +7,7 @@
 #include <holy/mm.h>
 #include <holy/misc.h>
 #include <holy/disk.h>
+#include <holy/partition.h>
 #include <holy/fshelp.h>
 #include <holy/dl.h>
 #include <holy/i18n.h>
@@ -26,8 +27,45 @@ struct stack_element {
   struct stack_element *parent;
   holy_fshelp_node_t node;
   enum holy_fshelp_filetype type;
+  /* The name cache entry of NODE, or 0 if it has none.  */
+  holy_uint64_t id;
 };
 
+/* The name cache.  Every name looked up on a cached mount gets an entry,
+   found or not, keyed by the entry of the directory it was looked up in
+   and the name.  The root directory of a mount has an entry of its own,
+   keyed by the disk, the partition and the filesystem.  Entry ids are
+   never reused, so the entries below an evicted directory can no longer
+   be reached and age out of the LRU list.  */
+
+#define DCACHE_BUCKETS	256
+#define DCACHE_MAX	512
+
+struct dentry
+{
+  struct dentry *hash_next;
+  struct dentry *lru_prev;
+  struct dentry *lru_next;
+  holy_uint64_t id;
+  holy_uint64_t parent;
+  unsigned long dev_id;
+  unsigned long disk_id;
+  holy_disk_addr_t part_start;
+  /* A copy of the node found, NULL if the name does not exist.  */
+  holy_fshelp_node_t node;
+  enum holy_fshelp_filetype type;
+  char name[0];
+};
+
+static struct dentry *dcache_table[DCACHE_BUCKETS];
+/* Most recently used first.  */
+static struct dentry *dcache_lru_first, *dcache_lru_last;
+static unsigned dcache_count;
+static holy_uint64_t dcache_next_id = 1;
+/* Bumped every time the cache is flushed.  */
+static unsigned long dcache_generation;
+static int dcache_hook_registered;
+
 /* Context for holy_fshelp_find_file.  */
 struct holy_fshelp_find_file_ctx
 {
@@ -40,8 +78,180 @@ struct holy_fshelp_find_file_ctx
 
   /* Current file being traversed and its parents.  */
   struct stack_element *currnode;
+
+  /* The name cache, when the filesystem uses it.  */
+  const struct holy_fshelp_dcache_ops *dcache;
+  unsigned long dev_id;
+  unsigned long disk_id;
+  holy_disk_addr_t part_start;
+  holy_uint64_t root_id;
 };
 
+static unsigned
+dcache_hash (holy_uint64_t parent, const char *name)
+{
+  holy_uint32_t hash = 2166136261U ^ (holy_uint32_t) parent;
+
+  while (*name)
+    hash = (hash ^ (holy_uint8_t) *name++) * 16777619;
+  return hash % DCACHE_BUCKETS;
+}
+
+static void
+dcache_unlink (struct dentry *d)
+{
+  struct dentry **p;
+
+  for (p = &dcache_table[dcache_hash (d->parent, d->name)]; *p;
+       p = &(*p)->hash_next)
+    if (*p == d)
+      {
+	*p = d->hash_next;
+	break;
+      }
+
+  if (d->lru_prev)
+    d->lru_prev->lru_next = d->lru_next;
+  else
+    dcache_lru_first = d->lru_next;
+  if (d->lru_next)
+    d->lru_next->lru_prev = d->lru_prev;
+  else
+    dcache_lru_last = d->lru_prev;
+  dcache_count--;
+}
+
+static void
+dcache_free (struct dentry *d)
+{
+  holy_free (d->node);
+  holy_free (d);
+}
+
+static void
+dcache_link (struct dentry *d)
+{
+  unsigned bucket = dcache_hash (d->parent, d->name);
+
+  d->hash_next = dcache_table[bucket];
+  dcache_table[bucket] = d;
+  d->lru_prev = 0;
+  d->lru_next = dcache_lru_first;
+  if (dcache_lru_first)
+    dcache_lru_first->lru_prev = d;
+  else
+    dcache_lru_last = d;
+  dcache_lru_first = d;
+  dcache_count++;
+
+  while (dcache_count > DCACHE_MAX)
+    {
+      struct dentry *old = dcache_lru_last;
+
+      dcache_unlink (old);
+      dcache_free (old);
+    }
+}
+
+/* Called whenever the disk cache is dropped, on its timeout, which is
+   what notices a changed medium, as well as when memory runs short, so it
+   must not allocate.  */
+static void
+dcache_flush (void)
+{
+  while (dcache_lru_first)
+    {
+      struct dentry *d = dcache_lru_first;
+
+      dcache_unlink (d);
+      dcache_free (d);
+    }
+  dcache_generation++;
+}
+
+static struct holy_disk_cache_hook dcache_hook =
+  {
+    .invalidate = dcache_flush
+  };
+
+static struct dentry *
+dcache_find (struct holy_fshelp_find_file_ctx *ctx, holy_uint64_t parent,
+	     const char *name)
+{
+  struct dentry *d;
+
+  for (d = dcache_table[dcache_hash (parent, name)]; d; d = d->hash_next)
+    if (d->parent == parent && d->dev_id == ctx->dev_id
+	&& d->disk_id == ctx->disk_id && d->part_start == ctx->part_start
+	&& holy_strcmp (d->name, name) == 0)
+      break;
+  if (!d || d == dcache_lru_first)
+    return d;
+
+  /* Move it to the front of the LRU list.  */
+  d->lru_prev->lru_next = d->lru_next;
+  if (d->lru_next)
+    d->lru_next->lru_prev = d->lru_prev;
+  else
+    dcache_lru_last = d->lru_prev;
+  d->lru_prev = 0;
+  d->lru_next = dcache_lru_first;
+  dcache_lru_first->lru_prev = d;
+  dcache_lru_first = d;
+  return d;
+}
+
+/* Add the name NAME in the directory PARENT, with the node NODE, which
+   the cache takes over.  Return the id of the new entry, or 0 if there is
+   no memory for it.  */
+static holy_uint64_t
+dcache_add (struct holy_fshelp_find_file_ctx *ctx, holy_uint64_t parent,
+	    const char *name, holy_fshelp_node_t node,
+	    enum holy_fshelp_filetype type)
+{
+  struct dentry *d;
+  holy_size_t len = holy_strlen (name);
+
+  d = holy_malloc (sizeof (*d) + len + 1);
+  if (!d)
+    {
+      holy_free (node);
+      holy_errno = holy_ERR_NONE;
+      return 0;
+    }
+  d->id = dcache_next_id++;
+  d->parent = parent;
+  d->dev_id = ctx->dev_id;
+  d->disk_id = ctx->disk_id;
+  d->part_start = ctx->part_start;
+  d->node = node;
+  d->type = type;
+  holy_memcpy (d->name, name, len + 1);
+  dcache_link (d);
+  return d->id;
+}
+
+/* Find the entry of the root directory of the mount CTX is walking, and
+   create it the first time.  */
+static void
+dcache_find_root (struct holy_fshelp_find_file_ctx *ctx)
+{
+  struct dentry *d;
+
+  if (!dcache_hook_registered)
+    {
+      holy_disk_cache_register_hook (&dcache_hook);
+      dcache_hook_registered = 1;
+    }
+
+  d = dcache_find (ctx, 0, ctx->dcache->name);
+  if (d)
+    ctx->root_id = d->id;
+  else
+    ctx->root_id = dcache_add (ctx, 0, ctx->dcache->name, NULL,
+			       holy_FSHELP_DIR);
+}
+
 /* Helper for find_file_iter.  */
 static void
 free_node (holy_fshelp_node_t node, struct holy_fshelp_find_file_ctx *ctx)
@@ -76,7 +286,8 @@ go_up_a_level (struct holy_fshelp_find_file_ctx *ctx)
 }
 
 static holy_err_t
-push_node (struct holy_fshelp_find_file_ctx *ctx, holy_fshelp_node_t node, enum holy_fshelp_filetype filetype)
+push_node (struct holy_fshelp_find_file_ctx *ctx, holy_fshelp_node_t node, enum holy_fshelp_filetype filetype,
+	   holy_uint64_t id)
 {
   struct stack_element *nst;
   nst = holy_malloc (sizeof (*nst));
@@ -84,6 +295,7 @@ push_node (struct holy_fshelp_find_file_ctx *ctx, holy_fshelp_node_t node, enum
     return holy_errno;
   nst->node = node;
   nst->type = filetype & ~holy_FSHELP_CASE_INSENSITIVE;
+  nst->id = id;
   nst->parent = ctx->currnode;
   ctx->currnode = nst;
   return holy_ERR_NONE;
@@ -93,7 +305,7 @@ static holy_err_t
 go_to_root (struct holy_fshelp_find_file_ctx *ctx)
 {
   free_stack (ctx);
-  return push_node (ctx, ctx->rootnode, holy_FSHELP_DIR);
+  return push_node (ctx, ctx->rootnode, holy_FSHELP_DIR, ctx->root_id);
 }
 
 struct holy_fshelp_find_file_iter_ctx
@@ -144,6 +356,89 @@ directory_find_file (holy_fshelp_node_t node, const char *name, holy_fshelp_node
   return holy_ERR_NONE;
 }
 
+static holy_err_t
+lookup_name (struct holy_fshelp_find_file_ctx *ctx, const char *name,
+	     holy_fshelp_node_t *foundnode,
+	     enum holy_fshelp_filetype *foundtype,
+	     iterate_dir_func iterate_dir, lookup_file_func lookup_file)
+{
+  holy_err_t err;
+
+  if (lookup_file)
+    {
+      err = lookup_file (ctx->currnode->node, name, foundnode, foundtype);
+      /* The directory has no index, so search it entry by entry.  */
+      if (err == holy_ERR_NOT_IMPLEMENTED_YET && iterate_dir)
+	{
+	  holy_errno = holy_ERR_NONE;
+	  err = directory_find_file (ctx->currnode->node, name, foundnode,
+				     foundtype, iterate_dir);
+	}
+      return err;
+    }
+  return directory_find_file (ctx->currnode->node, name, foundnode,
+			      foundtype, iterate_dir);
+}
+
+/* Like lookup_name, but ask the name cache first and remember the answer
+   in it.  *ID is set to the entry of the node found, or 0.  */
+static holy_err_t
+lookup_name_cached (struct holy_fshelp_find_file_ctx *ctx, const char *name,
+		    holy_fshelp_node_t *foundnode,
+		    enum holy_fshelp_filetype *foundtype, holy_uint64_t *id,
+		    iterate_dir_func iterate_dir,
+		    lookup_file_func lookup_file)
+{
+  holy_uint64_t parent = ctx->currnode->id;
+  holy_fshelp_node_t copy = NULL;
+  struct dentry *d;
+  holy_err_t err;
+
+  *id = 0;
+  if (!parent)
+    return lookup_name (ctx, name, foundnode, foundtype, iterate_dir,
+			lookup_file);
+
+  d = dcache_find (ctx, parent, name);
+  if (d)
+    {
+      unsigned long generation = dcache_generation;
+
+      holy_fshelp_stats.dentry_hits++;
+      if (!d->node)
+	return holy_ERR_NONE;
+
+      *id = d->id;
+      *foundtype = d->type;
+      /* Copying allocates, which may flush the cache under us.  */
+      dcache_unlink (d);
+      *foundnode = ctx->dcache->dup_node (d->node, ctx->rootnode);
+      if (generation == dcache_generation)
+	dcache_link (d);
+      else
+	dcache_free (d);
+      return *foundnode ? holy_ERR_NONE : holy_errno;
+    }
+
+  holy_fshelp_stats.dentry_misses++;
+  err = lookup_name (ctx, name, foundnode, foundtype, iterate_dir,
+		     lookup_file);
+  if (err)
+    return err;
+
+  if (*foundnode)
+    {
+      copy = ctx->dcache->dup_node (*foundnode, ctx->rootnode);
+      if (!copy)
+	{
+	  holy_errno = holy_ERR_NONE;
+	  return holy_ERR_NONE;
+	}
+    }
+  *id = dcache_add (ctx, parent, name, copy, *foundtype);
+  return holy_ERR_NONE;
+}
+
 static holy_err_t
 find_file (char *currpath,
 	   iterate_dir_func iterate_dir, lookup_file_func lookup_file,
@@ -157,6 +452,7 @@ find_file (char *currpath,
       char c;
       holy_fshelp_node_t foundnode = NULL;
       enum holy_fshelp_filetype foundtype = 0;
+      holy_uint64_t id = 0;
 
       /* Remove all leading slashes.  */
       while (*name == '/')
@@ -188,10 +484,12 @@ find_file (char *currpath,
       /* Iterate over the directory.  */
       c = *next;
       *next = '\0';
-      if (lookup_file)
-	err = lookup_file (ctx->currnode->node, name, &foundnode, &foundtype);
+      if (ctx->dcache)
+	err = lookup_name_cached (ctx, name, &foundnode, &foundtype, &id,
+				  iterate_dir, lookup_file);
       else
-	err = directory_find_file (ctx->currnode->node, name, &foundnode, &foundtype, iterate_dir);
+	err = lookup_name (ctx, name, &foundnode, &foundtype, iterate_dir,
+			   lookup_file);
       *next = c;
 
       if (err)
@@ -200,7 +498,7 @@ find_file (char *currpath,
       if (!foundnode)
 	break;
 
-      push_node (ctx, foundnode, foundtype);
+      push_node (ctx, foundnode, foundtype, id);
  
       /* Read in the symlink and follow it.  */
       if (ctx->currnode->type == holy_FSHELP_SYMLINK)
@@ -245,7 +543,9 @@ find_file (char *currpath,
 }
 
 static holy_err_t
-holy_fshelp_find_file_real (const char *path, holy_fshelp_node_t rootnode,
+holy_fshelp_find_file_real (const struct holy_fshelp_dcache_ops *dcache,
+			    holy_disk_t disk,
+			    const char *path, holy_fshelp_node_t rootnode,
 			    holy_fshelp_node_t *foundnode,
 			    iterate_dir_func iterate_dir,
 			    lookup_file_func lookup_file,
@@ -267,6 +567,15 @@ holy_fshelp_find_file_real (const char *path, holy_fshelp_node_t rootnode,
       return holy_error (holy_ERR_BAD_FILENAME, N_("invalid file name `%s'"), path);
     }
 
+  if (dcache && disk)
+    {
+      ctx.dcache = dcache;
+      ctx.dev_id = disk->dev->id;
+      ctx.disk_id = disk->id;
+      ctx.part_start = holy_partition_get_start (disk->partition);
+      dcache_find_root (&ctx);
+    }
+
   err = go_to_root (&ctx);
   if (err)
     return err;
@@ -311,7 +620,7 @@ holy_fshelp_find_file (const char *path, holy_fshelp_node_t rootnode,
 		       read_symlink_func read_symlink,
 		       enum holy_fshelp_filetype expecttype)
 {
-  return holy_fshelp_find_file_real (path, rootnode, foundnode,
+  return holy_fshelp_find_file_real (NULL, NULL, path, rootnode, foundnode,
 				     iterate_dir, NULL, 
 				     read_symlink, expecttype);
 
@@ -324,29 +633,97 @@ holy_fshelp_find_file_lookup (const char *path, holy_fshelp_node_t rootnode,
 			      read_symlink_func read_symlink,
 			      enum holy_fshelp_filetype expecttype)
 {
-  return holy_fshelp_find_file_real (path, rootnode, foundnode,
+  return holy_fshelp_find_file_real (NULL, NULL, path, rootnode, foundnode,
 				     NULL, lookup_file, 
 				     read_symlink, expecttype);
 
 }
 
-/* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
-   beginning with the block POS.  READ_HOOK should be set before
-   reading a block from the file.  READ_HOOK_DATA is passed through as
-   the DATA argument to READ_HOOK.  GET_BLOCK is used to translate
-   file blocks to disk blocks.  The file is FILESIZE bytes big and the
-   blocks have a size of LOG2BLOCKSIZE (in log2).  */
-holy_ssize_t
-holy_fshelp_read_file (holy_disk_t disk, holy_fshelp_node_t node,
-		       holy_disk_read_hook_t read_hook, void *read_hook_data,
-		       holy_off_t pos, holy_size_t len, char *buf,
-		       holy_disk_addr_t (*get_block) (holy_fshelp_node_t node,
-                                                      holy_disk_addr_t block),
-		       holy_off_t filesize, int log2blocksize,
-		       holy_disk_addr_t blocks_start)
+/* Like holy_fshelp_find_file, but LOOKUP_FILE is tried first on each
+   directory, for filesystems that can find a name in an indexed directory
+   without reading all of it.  When it returns holy_ERR_NOT_IMPLEMENTED_YET
+   the directory is searched with ITERATE_DIR instead.  */
+holy_err_t
+holy_fshelp_find_file_indexed (const char *path, holy_fshelp_node_t rootnode,
+			       holy_fshelp_node_t *foundnode,
+			       iterate_dir_func iterate_dir,
+			       lookup_file_func lookup_file,
+			       read_symlink_func read_symlink,
+			       enum holy_fshelp_filetype expecttype)
+{
+  return holy_fshelp_find_file_real (NULL, NULL, path, rootnode, foundnode,
+				     iterate_dir, lookup_file,
+				     read_symlink, expecttype);
+}
+
+holy_err_t
+holy_fshelp_find_file_cached (const struct holy_fshelp_dcache_ops *ops,
+			      holy_disk_t disk,
+			      const char *path, holy_fshelp_node_t rootnode,
+			      holy_fshelp_node_t *foundnode,
+			      iterate_dir_func iterate_dir,
+			      lookup_file_func lookup_file,
+			      read_symlink_func read_symlink,
+			      enum holy_fshelp_filetype expecttype)
+{
+  return holy_fshelp_find_file_real (ops, disk, path, rootnode, foundnode,
+				     iterate_dir, lookup_file,
+				     read_symlink, expecttype);
+}
+
+struct holy_fshelp_stats holy_fshelp_stats;
+int holy_fshelp_per_block;
+
+/* Map up to WANT file blocks of NODE starting with BLOCK.  Return the disk
+   block they start at, or 0 for a hole, and in *RUN how many of them follow
+   on contiguously (or are all holes).  Neighbouring mappings are merged, so
+   filesystems without GET_EXTENT still get one disk read per run.  */
+static holy_disk_addr_t
+map_run (holy_fshelp_node_t node, holy_disk_addr_t block,
+	 holy_disk_addr_t want, holy_fshelp_get_block_t get_block,
+	 holy_fshelp_get_extent_t get_extent, holy_disk_addr_t *run)
+{
+  holy_disk_addr_t start = 0, n = 0;
+
+  while (n < want)
+    {
+      holy_disk_addr_t blknr, len = 1;
+
+      holy_fshelp_stats.map_calls++;
+      if (get_extent)
+	blknr = get_extent (node, block + n, &len);
+      else
+	blknr = get_block (node, block + n);
+      if (holy_errno)
+	return 0;
+      if (len == 0 || holy_fshelp_per_block)
+	len = 1;
+
+      if (n == 0)
+	start = blknr;
+      else if (start ? blknr != start + n : blknr != 0)
+	break;
+      n += len;
+      if (holy_fshelp_per_block)
+	break;
+    }
+
+  *run = n < want ? n : want;
+  return start;
+}
+
+static holy_ssize_t
+read_file_real (holy_disk_t disk, holy_fshelp_node_t node,
+		holy_disk_read_hook_t read_hook, void *read_hook_data,
+		holy_off_t pos, holy_size_t len, char *buf,
+		holy_fshelp_get_block_t get_block,
+		holy_fshelp_get_extent_t get_extent,
+		holy_off_t filesize, int log2blocksize,
+		holy_disk_addr_t blocks_start)
 {
-  holy_disk_addr_t i, blockcnt;
-  int blocksize = 1 << (log2blocksize + holy_DISK_SECTOR_BITS);
+  int shift = log2blocksize + holy_DISK_SECTOR_BITS;
+  holy_off_t end;
+  holy_disk_addr_t last;
 
   if (pos > filesize)
     {
@@ -358,39 +735,26 @@ holy_fshelp_read_file (holy_disk_t disk, holy_fshelp_node_t node,
   /* Adjust LEN so it we can't read past the end of the file.  */
   if (pos + len > filesize)
     len = filesize - pos;
+  if (len == 0)
+    return 0;
 
-  blockcnt = ((len + pos) + blocksize - 1) >> (log2blocksize + holy_DISK_SECTOR_BITS);
+  end = pos + len;
+  last = (end - 1) >> shift;
 
-  for (i = pos >> (log2blocksize + holy_DISK_SECTOR_BITS); i < blockcnt; i++)
+  while (pos < end)
     {
-      holy_disk_addr_t blknr;
-      int blockoff = pos & (blocksize - 1);
-      int blockend = blocksize;
+      holy_disk_addr_t block = pos >> shift;
+      holy_disk_addr_t blknr, run;
+      holy_off_t size;
 
-      int skipfirst = 0;
-
-      blknr = get_block (node, i);
+      blknr = map_run (node, block, last - block + 1, get_block, get_extent,
+		       &run);
       if (holy_errno)
 	return -1;
 
-      blknr = blknr << log2blocksize;
-
-      /* Last block.  */
-      if (i == blockcnt - 1)
-	{
-	  blockend = (len + pos) & (blocksize - 1);
-
-	  /* The last portion is exactly blocksize.  */
-	  if (! blockend)
-	    blockend = blocksize;
-	}
-
-      /* First block.  */
-      if (i == (pos >> (log2blocksize + holy_DISK_SECTOR_BITS)))
-	{
-	  skipfirst = blockoff;
-	  blockend -= skipfirst;
-	}
+      size = (((holy_off_t) block + run) << shift) - pos;
+      if (size > end - pos)
+	size = end - pos;
 
       /* If the block number is 0 this block is not stored on disk but
 	 is zero filled instead.  */
@@ -399,17 +763,62 @@ holy_fshelp_read_file (holy_disk_t disk, holy_fshelp_node_t node,
 	  disk->read_hook = read_hook;
 	  disk->read_hook_data = read_hook_data;
 
-	  holy_disk_read (disk, blknr + blocks_start, skipfirst,
-			  blockend, buf);
+	  holy_fshelp_stats.disk_reads++;
+	  holy_disk_read (disk, (blknr << log2blocksize) + blocks_start,
+			  pos & ((1 << shift) - 1), size, buf);
 	  disk->read_hook = 0;
 	  if (holy_errno)
 	    return -1;
 	}
       else
-	holy_memset (buf, 0, blockend);
+	holy_memset (buf, 0, size);
 
-      buf += blocksize - skipfirst;
+      holy_fshelp_stats.bytes += size;
+      buf += size;
+      pos += size;
     }
 
   return len;
 }
+
+/* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
+   beginning with the block POS.  READ_HOOK should be set before
+   reading a block from the file.  READ_HOOK_DATA is passed through as
+   the DATA argument to READ_HOOK.  GET_BLOCK is used to translate
+   file blocks to disk blocks.  The file is FILESIZE bytes big and the
+   blocks have a size of LOG2BLOCKSIZE (in log2).  */
+holy_ssize_t
+holy_fshelp_read_file (holy_disk_t disk, holy_fshelp_node_t node,
+		       holy_disk_read_hook_t read_hook, void *read_hook_data,
+		       holy_off_t pos, holy_size_t len, char *buf,
+		       holy_fshelp_get_block_t get_block,
+		       holy_off_t filesize, int log2blocksize,
+		       holy_disk_addr_t blocks_start)
+{
+  return read_file_real (disk, node, read_hook, read_hook_data, pos, len,
+			 buf, get_block, NULL, filesize, log2blocksize,
+			 blocks_start);
+}
+
+/* Like holy_fshelp_read_file, but GET_EXTENT maps whole runs of blocks,
+   which are then read with one disk request each.  */
+holy_ssize_t
+holy_fshelp_read_file_extents (holy_disk_t disk, holy_fshelp_node_t node,
+			       holy_disk_read_hook_t read_hook,
+			       void *read_hook_data,
+			       holy_off_t pos, holy_size_t len, char *buf,
+			       holy_fshelp_get_extent_t get_extent,
+			       holy_off_t filesize, int log2blocksize,
+			       holy_disk_addr_t blocks_start)
+{
+  return read_file_real (disk, node, read_hook, read_hook_data, pos, len,
+			 buf, NULL, get_extent, filesize, log2blocksize,
+			 blocks_start);
+}
+
+holy_MOD_FINI(fshelp)
+{
+  if (dcache_hook_registered)
+    holy_disk_cache_unregister_hook (&dcache_hook);
+  dcache_flush ();
+}
@@ -958,6 +958,25 @@ holy_nilfs2_iterate_dir (holy_fshelp_node_t dir,
   return 0;
 }
 
+static holy_fshelp_node_t
+holy_nilfs2_dup_node (holy_fshelp_node_t node, holy_fshelp_node_t rootnode)
+{
+  holy_fshelp_node_t copy;
+
+  copy = holy_malloc (sizeof (*copy));
+  if (!copy)
+    return 0;
+  holy_memcpy (copy, node, sizeof (*copy));
+  copy->data = rootnode->data;
+  return copy;
+}
+
+static const struct holy_fshelp_dcache_ops holy_nilfs2_dcache_ops =
+  {
+    .name = "nilfs2",
+    .dup_node = holy_nilfs2_dup_node
+  };
+
 /* Open a file named NAME and initialize FILE.  */
 static holy_err_t
 holy_nilfs2_open (struct holy_file *file, const char *name)
@@ -971,9 +990,10 @@ holy_nilfs2_open (struct holy_file *file, const char *name)
   if (!data)
     goto fail;
 
-  holy_fshelp_find_file (name, &data->diropen, &fdiro,
-			 holy_nilfs2_iterate_dir, holy_nilfs2_read_symlink,
-			 holy_FSHELP_REG);
+  holy_fshelp_find_file_cached (&holy_nilfs2_dcache_ops, data->disk, name,
+				&data->diropen, &fdiro,
+				holy_nilfs2_iterate_dir, NULL,
+				holy_nilfs2_read_symlink, holy_FSHELP_REG);
   if (holy_errno)
     goto fail;
 
@@ -1075,9 +1095,10 @@ holy_nilfs2_dir (holy_device_t device, const char *path,
   if (!ctx.data)
     goto fail;
 
-  holy_fshelp_find_file (path, &ctx.data->diropen, &fdiro,
-			 holy_nilfs2_iterate_dir, holy_nilfs2_read_symlink,
-			 holy_FSHELP_DIR);
+  holy_fshelp_find_file_cached (&holy_nilfs2_dcache_ops, ctx.data->disk,
+				path, &ctx.data->diropen, &fdiro,
+				holy_nilfs2_iterate_dir, NULL,
+				holy_nilfs2_read_symlink, holy_FSHELP_DIR);
   if (holy_errno)
     goto fail;
 
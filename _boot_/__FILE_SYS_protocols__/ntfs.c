@@ -332,7 +332,8 @@ retry:
 }
 
 static holy_disk_addr_t
-holy_ntfs_read_block (holy_fshelp_node_t node, holy_disk_addr_t block)
+holy_ntfs_read_block (holy_fshelp_node_t node, holy_disk_addr_t block,
+		      holy_disk_addr_t *len)
 {
   struct holy_ntfs_rlst *ctx;
 
@@ -341,11 +342,16 @@ holy_ntfs_read_block (holy_fshelp_node_t node, holy_disk_addr_t block)
     {
       if (holy_ntfs_read_run_list (ctx))
 	return -1;
+      *len = ctx->next_vcn - block;
       return ctx->curr_lcn;
     }
   else
-    return (ctx->flags & holy_NTFS_RF_BLNK) ? 0 : (block -
-					 ctx->curr_vcn + ctx->curr_lcn);
+    {
+      /* The rest of the current run.  */
+      *len = ctx->next_vcn - block;
+      return (ctx->flags & holy_NTFS_RF_BLNK) ? 0 : (block -
+					   ctx->curr_vcn + ctx->curr_lcn);
+    }
 }
 
 static holy_err_t
@@ -420,11 +426,11 @@ read_data (struct holy_ntfs_attr *at, holy_uint8_t *pa, holy_uint8_t *dest,
       return 0;
     }
 
-  holy_fshelp_read_file (ctx->comp.disk, (holy_fshelp_node_t) ctx,
-			 read_hook, read_hook_data, ofs, len,
-			 (char *) dest,
-			 holy_ntfs_read_block, ofs + len,
-			 ctx->comp.log_spc, 0);
+  holy_fshelp_read_file_extents (ctx->comp.disk, (holy_fshelp_node_t) ctx,
+				 read_hook, read_hook_data, ofs, len,
+				 (char *) dest,
+				 holy_ntfs_read_block, ofs + len,
+				 ctx->comp.log_spc, 0);
   return holy_errno;
 }
 
@@ -612,8 +612,10 @@ make_root_node (struct holy_squash_data *data, struct holy_fshelp_node *root)
 }
 
 static void
-squash_unmount (struct holy_squash_data *data)
+squash_unmount (void *mount)
 {
+  struct holy_squash_data *data = mount;
+
   if (data->xzdec)
     xz_dec_end (data->xzdec);
   holy_free (data->xzbuf);
@@ -622,6 +624,28 @@ squash_unmount (struct holy_squash_data *data)
   holy_free (data);
 }
 
+static void *
+squash_mount_device (holy_device_t device)
+{
+  return squash_mount (device->disk);
+}
+
+/* Forget the block lists of the file the mount was last used for.  */
+static holy_err_t
+squash_remount (void *mount, holy_device_t device)
+{
+  struct holy_squash_data *data = mount;
+
+  data->disk = device->disk;
+  holy_free (data->ino.cumulated_block_sizes);
+  holy_free (data->ino.block_sizes);
+  data->ino.cumulated_block_sizes = NULL;
+  data->ino.block_sizes = NULL;
+  return holy_ERR_NONE;
+}
+
+static struct holy_fs holy_squash_fs;
+
 
 /* Context for holy_squash_dir.  */
 struct holy_squash_dir_ctx
@@ -656,20 +680,23 @@ holy_squash_dir (holy_device_t device, const char *path,
   struct holy_fshelp_node root;
   holy_err_t err;
 
-  data = squash_mount (device->disk);
+  data = holy_fs_mount (&holy_squash_fs, device);
   if (! data)
     return holy_errno;
 
   err = make_root_node (data, &root);
   if (err)
-    return err;
+    {
+      holy_fs_unmount (&holy_squash_fs, data);
+      return err;
+    }
 
   holy_fshelp_find_file (path, &root, &fdiro, holy_squash_iterate_dir,
 			 holy_squash_read_symlink, holy_FSHELP_DIR);
   if (!holy_errno)
     holy_squash_iterate_dir (fdiro, holy_squash_dir_iter, &ctx);
 
-  squash_unmount (data);
+  holy_fs_unmount (&holy_squash_fs, data);
 
   return holy_errno;
 }
@@ -682,19 +709,22 @@ holy_squash_open (struct holy_file *file, const char *name)
   struct holy_fshelp_node root;
   holy_err_t err;
 
-  data = squash_mount (file->device->disk);
+  data = holy_fs_mount (&holy_squash_fs, file->device);
   if (! data)
     return holy_errno;
 
   err = make_root_node (data, &root);
   if (err)
-    return err;
+    {
+      holy_fs_unmount (&holy_squash_fs, data);
+      return err;
+    }
 
   holy_fshelp_find_file (name, &root, &fdiro, holy_squash_iterate_dir,
 			 holy_squash_read_symlink, holy_FSHELP_REG);
   if (holy_errno)
     {
-      squash_unmount (data);
+      holy_fs_unmount (&holy_squash_fs, data);
       return holy_errno;
     }
 
@@ -717,7 +747,7 @@ holy_squash_open (struct holy_file *file, const char *name)
       {
 	holy_uint16_t type = holy_le_to_cpu16 (fdiro->ino.type);
 	holy_free (fdiro);
-	squash_unmount (data);
+	holy_fs_unmount (&holy_squash_fs, data);
 	return holy_error (holy_ERR_BAD_FS, "unexpected ino type 0x%x", type);
       }
     }
@@ -961,7 +991,7 @@ holy_squash_read (holy_file_t file, char *buf, holy_size_t len)
 static holy_err_t
 holy_squash_close (holy_file_t file)
 {
-  squash_unmount (file->data);
+  holy_fs_unmount (&holy_squash_fs, file->data);
   return holy_ERR_NONE;
 }
 
@@ -970,11 +1000,11 @@ holy_squash_mtime (holy_device_t dev, holy_int32_t *tm)
 {
   struct holy_squash_data *data = 0;
 
-  data = squash_mount (dev->disk);
+  data = holy_fs_mount (&holy_squash_fs, dev);
   if (! data)
     return holy_errno;
   *tm = holy_le_to_cpu32 (data->sb.creation_time);
-  squash_unmount (data);
+  holy_fs_unmount (&holy_squash_fs, data);
   return holy_ERR_NONE;
 } 
 
@@ -986,6 +1016,9 @@ static struct holy_fs holy_squash_fs =
     .read = holy_squash_read,
     .close = holy_squash_close,
     .mtime = holy_squash_mtime,
+    .mount = squash_mount_device,
+    .remount = squash_remount,
+    .unmount = squash_unmount,
 #ifdef holy_UTIL
     .reserved_first_sector = 0,
     .blocklist_install = 0,
@@ -410,7 +410,8 @@ holy_udf_read_icb (struct holy_udf_data *data,
 }
 
 static holy_disk_addr_t
-holy_udf_read_block (holy_fshelp_node_t node, holy_disk_addr_t fileblock)
+holy_udf_read_block (holy_fshelp_node_t node, holy_disk_addr_t fileblock,
+		     holy_disk_addr_t *run)
 {
   char *buf = NULL;
   char *ptr;
@@ -476,6 +477,8 @@ holy_udf_read_block (holy_fshelp_node_t node, holy_disk_addr_t fileblock)
 	  if (filebytes < adlen)
 	    {
 	      holy_uint32_t ad_pos = ad->position;
+	      *run = ((adlen - filebytes + U32 (node->data->lvd.bsize) - 1)
+		      >> (holy_DISK_SECTOR_BITS + node->data->lbshift));
 	      holy_free (buf);
 	      return ((U32 (ad_pos) & holy_UDF_EXT_MASK) ? 0 :
 		      (holy_udf_get_block (node->data, node->part_ref, ad_pos)
@@ -530,6 +533,8 @@ holy_udf_read_block (holy_fshelp_node_t node, holy_disk_addr_t fileblock)
 	    {
 	      holy_uint32_t ad_block_num = ad->block.block_num;
 	      holy_uint32_t ad_part_ref = ad->block.part_ref;
+	      *run = ((adlen - filebytes + U32 (node->data->lvd.bsize) - 1)
+		      >> (holy_DISK_SECTOR_BITS + node->data->lbshift));
 	      holy_free (buf);
 	      return ((U32 (ad_block_num) & holy_UDF_EXT_MASK) ?  0 :
 		      (holy_udf_get_block (node->data, ad_part_ref,
@@ -577,11 +582,11 @@ holy_udf_read_file (holy_fshelp_node_t node,
       return 0;
     }
 
-  return holy_fshelp_read_file (node->data->disk, node,
-				read_hook, read_hook_data,
-				pos, len, buf, holy_udf_read_block,
-				U64 (node->block.fe.file_size),
-				node->data->lbshift, 0);
+  return holy_fshelp_read_file_extents (node->data->disk, node,
+					read_hook, read_hook_data,
+					pos, len, buf, holy_udf_read_block,
+					U64 (node->block.fe.file_size),
+					node->data->lbshift, 0);
 }
 
 static unsigned sblocklist[] = { 256, 512, 0 };
@@ -209,6 +209,8 @@ struct holy_xfs_data
 
 static holy_dl_t my_mod;
 
+static struct holy_fs holy_xfs_fs;
+
 
 
 static int holy_xfs_sb_hascrc(struct holy_xfs_data *data)
@@ -487,7 +489,8 @@ get_fsb (const void *keys, int idx)
 }
 
 static holy_disk_addr_t
-holy_xfs_read_block (holy_fshelp_node_t node, holy_disk_addr_t fileblock)
+holy_xfs_read_block (holy_fshelp_node_t node, holy_disk_addr_t fileblock,
+		     holy_disk_addr_t *len)
 {
   struct holy_xfs_btree_node *leaf = 0;
   int ex, nrec;
@@ -577,10 +580,16 @@ holy_xfs_read_block (holy_fshelp_node_t node, holy_disk_addr_t fileblock)
 
       /* Sparse block.  */
       if (fileblock < offset)
-        break;
+	{
+	  *len = offset - fileblock;
+	  break;
+	}
       else if (fileblock < offset + size)
         {
           ret = (fileblock - offset + start);
+	  /* An extent never crosses an allocation group, so it stays
+	     contiguous on disk.  */
+	  *len = offset + size - fileblock;
           break;
         }
     }
@@ -598,12 +607,13 @@ holy_xfs_read_file (holy_fshelp_node_t node,
 		    holy_disk_read_hook_t read_hook, void *read_hook_data,
 		    holy_off_t pos, holy_size_t len, char *buf, holy_uint32_t header_size)
 {
-  return holy_fshelp_read_file (node->data->disk, node,
-				read_hook, read_hook_data,
-				pos, len, buf, holy_xfs_read_block,
-				holy_be_to_cpu64 (node->inode.size) + header_size,
-				node->data->sblock.log2_bsize
-				- holy_DISK_SECTOR_BITS, 0);
+  return holy_fshelp_read_file_extents (node->data->disk, node,
+					read_hook, read_hook_data,
+					pos, len, buf, holy_xfs_read_block,
+					holy_be_to_cpu64 (node->inode.size)
+					+ header_size,
+					node->data->sblock.log2_bsize
+					- holy_DISK_SECTOR_BITS, 0);
 }
 
 
@@ -920,6 +930,31 @@ holy_xfs_mount (holy_disk_t disk)
 
   return 0;
 }
+static void *
+holy_xfs_mount_device (holy_device_t device)
+{
+  return holy_xfs_mount (device->disk);
+}
+
+/* Point DIROPEN, which the last file opened took over, back at the root
+   directory.  */
+static holy_err_t
+holy_xfs_remount (void *mount, holy_device_t device)
+{
+  struct holy_xfs_data *data = mount;
+
+  data->disk = device->disk;
+  data->diropen.ino = holy_be_to_cpu64 (data->sblock.rootino);
+  data->diropen.inode_read = 1;
+  return holy_xfs_read_inode (data, data->diropen.ino,
+			      &data->diropen.inode);
+}
+
+static void
+holy_xfs_unmount (void *data)
+{
+  holy_free (data);
+}
 
 
 /* Context for holy_xfs_dir.  */
@@ -948,6 +983,28 @@ holy_xfs_dir_iter (const char *filename, enum holy_fshelp_filetype filetype,
   return ctx->hook (filename, &info, ctx->hook_data);
 }
 
+/* The size of a node only depends on the filesystem, so NODE may be
+   copied with the size from the mount of ROOTNODE.  */
+static holy_fshelp_node_t
+holy_xfs_dup_node (holy_fshelp_node_t node, holy_fshelp_node_t rootnode)
+{
+  holy_fshelp_node_t copy;
+  holy_size_t size = holy_xfs_fshelp_size (rootnode->data);
+
+  copy = holy_malloc (size + 1);
+  if (!copy)
+    return 0;
+  holy_memcpy (copy, node, size);
+  copy->data = rootnode->data;
+  return copy;
+}
+
+static const struct holy_fshelp_dcache_ops holy_xfs_dcache_ops =
+  {
+    .name = "xfs",
+    .dup_node = holy_xfs_dup_node
+  };
+
 static holy_err_t
 holy_xfs_dir (holy_device_t device, const char *path,
 	      holy_fs_dir_hook_t hook, void *hook_data)
@@ -958,12 +1015,13 @@ holy_xfs_dir (holy_device_t device, const char *path,
 
   holy_dl_ref (my_mod);
 
-  data = holy_xfs_mount (device->disk);
+  data = holy_fs_mount (&holy_xfs_fs, device);
   if (!data)
     goto mount_fail;
 
-  holy_fshelp_find_file (path, &data->diropen, &fdiro, holy_xfs_iterate_dir,
-			 holy_xfs_read_symlink, holy_FSHELP_DIR);
+  holy_fshelp_find_file_cached (&holy_xfs_dcache_ops, data->disk, path,
+				&data->diropen, &fdiro, holy_xfs_iterate_dir,
+				NULL, holy_xfs_read_symlink, holy_FSHELP_DIR);
   if (holy_errno)
     goto fail;
 
@@ -972,7 +1030,7 @@ holy_xfs_dir (holy_device_t device, const char *path,
  fail:
   if (fdiro != &data->diropen)
     holy_free (fdiro);
-  holy_free (data);
+  holy_fs_unmount (&holy_xfs_fs, data);
 
  mount_fail:
 
@@ -991,12 +1049,13 @@ holy_xfs_open (struct holy_file *file, const char *name)
 
   holy_dl_ref (my_mod);
 
-  data = holy_xfs_mount (file->device->disk);
+  data = holy_fs_mount (&holy_xfs_fs, file->device);
   if (!data)
     goto mount_fail;
 
-  holy_fshelp_find_file (name, &data->diropen, &fdiro, holy_xfs_iterate_dir,
-			 holy_xfs_read_symlink, holy_FSHELP_REG);
+  holy_fshelp_find_file_cached (&holy_xfs_dcache_ops, data->disk, name,
+				&data->diropen, &fdiro, holy_xfs_iterate_dir,
+				NULL, holy_xfs_read_symlink, holy_FSHELP_REG);
   if (holy_errno)
     goto fail;
 
@@ -1022,7 +1081,7 @@ holy_xfs_open (struct holy_file *file, const char *name)
  fail:
   if (fdiro != &data->diropen)
     holy_free (fdiro);
-  holy_free (data);
+  holy_fs_unmount (&holy_xfs_fs, data);
 
  mount_fail:
   holy_dl_unref (my_mod);
@@ -1046,7 +1105,7 @@ holy_xfs_read (holy_file_t file, char *buf, holy_size_t len)
 static holy_err_t
 holy_xfs_close (holy_file_t file)
 {
-  holy_free (file->data);
+  holy_fs_unmount (&holy_xfs_fs, file->data);
 
   holy_dl_unref (my_mod);
 
@@ -1058,11 +1117,10 @@ static holy_err_t
 holy_xfs_label (holy_device_t device, char **label)
 {
   struct holy_xfs_data *data;
-  holy_disk_t disk = device->disk;
 
   holy_dl_ref (my_mod);
 
-  data = holy_xfs_mount (disk);
+  data = holy_fs_mount (&holy_xfs_fs, device);
   if (data)
     *label = holy_strndup ((char *) (data->sblock.label), 12);
   else
@@ -1070,7 +1128,7 @@ holy_xfs_label (holy_device_t device, char **label)
 
   holy_dl_unref (my_mod);
 
-  holy_free (data);
+  holy_fs_unmount (&holy_xfs_fs, data);
 
   return holy_errno;
 }
@@ -1079,11 +1137,10 @@ static holy_err_t
 holy_xfs_uuid (holy_device_t device, char **uuid)
 {
   struct holy_xfs_data *data;
-  holy_disk_t disk = device->disk;
 
   holy_dl_ref (my_mod);
 
-  data = holy_xfs_mount (disk);
+  data = holy_fs_mount (&holy_xfs_fs, device);
   if (data)
     {
       *uuid = holy_xasprintf ("%04x%04x-%04x-%04x-%04x-%04x%04x%04x",
@@ -1101,7 +1158,7 @@ holy_xfs_uuid (holy_device_t device, char **uuid)
 
   holy_dl_unref (my_mod);
 
-  holy_free (data);
+  holy_fs_unmount (&holy_xfs_fs, data);
 
   return holy_errno;
 }
@@ -1117,6 +1174,9 @@ static struct holy_fs holy_xfs_fs =
     .close = holy_xfs_close,
     .label = holy_xfs_label,
     .uuid = holy_xfs_uuid,
+    .mount = holy_xfs_mount_device,
+    .remount = holy_xfs_remount,
+    .unmount = holy_xfs_unmount,
 #ifdef holy_UTIL
     .reserved_first_sector = 0,
     .blocklist_install = 1,
@@ -27,6 +27,7 @@
 #include <holy/zfs/dsl_dataset.h>
 #include <holy/deflate.h>
 #include <holy/crypto.h>
+#include <holy/gf256.h>
 #include <holy/i18n.h>
 
 holy_MOD_LICENSE ("GPLv2+");
@@ -1246,41 +1247,44 @@ scan_devices (struct holy_zfs_data *data)
   return holy_ERR_NONE;
 }
 
-/* x**y.  */
-static holy_uint8_t powx[255 * 2];
-/* Such an s that x**s = y */
-static int powx_inv[256];
-static const holy_uint8_t poly = 0x1d;
-
 /* perform the operation a ^= b * (x ** (known_idx * recovery_pow) ) */
 static inline void
 xor_out (holy_uint8_t *a, const holy_uint8_t *b, holy_size_t s,
 	 unsigned known_idx, unsigned recovery_pow)
 {
-  unsigned add;
-
-  /* Simple xor.  */
-  if (known_idx == 0 || recovery_pow == 0)
-    {
-      holy_crypto_xor (a, a, b, s);
-      return;
-    }
-  add = (known_idx * recovery_pow) % 255;
-  for (;s--; b++, a++)
-    if (*b)
-      *a ^= powx[powx_inv[*b] + add];
+  holy_gf256_muladd_block (a, b, holy_gf256_exp (known_idx * recovery_pow),
+			   s);
 }
 
-static inline holy_uint8_t
-gf_mul (holy_uint8_t a, holy_uint8_t b)
+#define MAX_NBUFS 4
+/* Bytes of each buffer run through the matrix at a time.  */
+#define MATRIX_CHUNK 512
+
+/* bufs = matrix * bufs, in place.  */
+static void
+apply_matrix (holy_uint8_t *bufs[], holy_size_t s, const int nbufs,
+	      holy_uint8_t matrix[MAX_NBUFS][MAX_NBUFS])
 {
-  if (a == 0 || b == 0)
-    return 0;
-  return powx[powx_inv[a] + powx_inv[b]];
+  holy_uint8_t tmp[MAX_NBUFS][MATRIX_CHUNK];
+  holy_size_t off, len;
+  int j, k;
+
+  for (off = 0; off < s; off += len)
+    {
+      len = s - off;
+      if (len > MATRIX_CHUNK)
+	len = MATRIX_CHUNK;
+      for (j = 0; j < nbufs; j++)
+	holy_memcpy (tmp[j], bufs[j] + off, len);
+      for (j = 0; j < nbufs; j++)
+	{
+	  holy_memset (bufs[j] + off, 0, len);
+	  for (k = 0; k < nbufs; k++)
+	    holy_gf256_muladd_block (bufs[j] + off, tmp[k], matrix[j][k], len);
+	}
+    }
 }
 
-#define MAX_NBUFS 4
-
 static holy_err_t
 recovery (holy_uint8_t *bufs[4], holy_size_t s, const int nbufs,
 	  const unsigned *powers,
@@ -1295,43 +1299,33 @@ recovery (holy_uint8_t *bufs[4], holy_size_t s, const int nbufs,
       /* Easy: r_0 = bufs[0] / (x << (powers[i] * idx[j])).  */
     case 1:
       {
-	int add;
-	holy_uint8_t *a;
 	if (powers[0] == 0 || idx[0] == 0)
 	  return holy_ERR_NONE;
-	add = 255 - ((powers[0] * idx[0]) % 255);
-	for (a = bufs[0]; s--; a++)
-	  if (*a)
-	    *a = powx[powx_inv[*a] + add];
+	holy_gf256_mul_block (bufs[0],
+			      holy_gf256_exp (255 - ((powers[0] * idx[0])
+						     % 255)), s);
 	return holy_ERR_NONE;
       }
       /* Case 2x2: Let's use the determinant formula.  */
     case 2:
       {
 	holy_uint8_t det, det_inv;
-	holy_uint8_t matrixinv[2][2];
-	unsigned i;
+	holy_uint8_t matrixinv[MAX_NBUFS][MAX_NBUFS];
 	/* The determinant is: */
-	det = (powx[(powers[0] * idx[0] + powers[1] * idx[1]) % 255]
-	       ^ powx[(powers[0] * idx[1] + powers[1] * idx[0]) % 255]);
+	det = (holy_gf256_exp (powers[0] * idx[0] + powers[1] * idx[1])
+	       ^ holy_gf256_exp (powers[0] * idx[1] + powers[1] * idx[0]));
 	if (det == 0)
 	  return holy_error (holy_ERR_BAD_FS, "singular recovery matrix");
-	det_inv = powx[255 - powx_inv[det]];
-	matrixinv[0][0] = gf_mul (powx[(powers[1] * idx[1]) % 255], det_inv);
-	matrixinv[1][1] = gf_mul (powx[(powers[0] * idx[0]) % 255], det_inv);
-	matrixinv[0][1] = gf_mul (powx[(powers[0] * idx[1]) % 255], det_inv);
-	matrixinv[1][0] = gf_mul (powx[(powers[1] * idx[0]) % 255], det_inv);
-	for (i = 0; i < s; i++)
-	  {
-	    holy_uint8_t b0, b1;
-	    b0 = bufs[0][i];
-	    b1 = bufs[1][i];
-
-	    bufs[0][i] = (gf_mul (b0, matrixinv[0][0])
-			  ^ gf_mul (b1, matrixinv[0][1]));
-	    bufs[1][i] = (gf_mul (b0, matrixinv[1][0])
-			  ^ gf_mul (b1, matrixinv[1][1]));
-	  }
+	det_inv = holy_gf256_inv (det);
+	matrixinv[0][0] = holy_gf256_mul (holy_gf256_exp (powers[1] * idx[1]),
+					  det_inv);
+	matrixinv[1][1] = holy_gf256_mul (holy_gf256_exp (powers[0] * idx[0]),
+					  det_inv);
+	matrixinv[0][1] = holy_gf256_mul (holy_gf256_exp (powers[0] * idx[1]),
+					  det_inv);
+	matrixinv[1][0] = holy_gf256_mul (holy_gf256_exp (powers[1] * idx[0]),
+					  det_inv);
+	apply_matrix (bufs, s, 2, matrixinv);
 	return holy_ERR_NONE;
       }
       /* Otherwise use Gauss.  */
@@ -1342,7 +1336,7 @@ recovery (holy_uint8_t *bufs[4], holy_size_t s, const int nbufs,
 
 	for (i = 0; i < nbufs; i++)
 	  for (j = 0; j < nbufs; j++)
-	    matrix1[i][j] = powx[(powers[i] * idx[j]) % 255];
+	    matrix1[i][j] = holy_gf256_exp (powers[i] * idx[j]);
 	for (i = 0; i < nbufs; i++)
 	  for (j = 0; j < nbufs; j++)
 	    matrix2[i][j] = 0;
@@ -1376,18 +1370,18 @@ recovery (holy_uint8_t *bufs[4], holy_size_t s, const int nbufs,
 		    matrix2[i][j] = t;
 		  }
 	      }
-	    mul = powx[255 - powx_inv[matrix1[i][i]]];
+	    mul = holy_gf256_inv (matrix1[i][i]);
 	    for (j = 0; j < nbufs; j++)
-	      matrix1[i][j] = gf_mul (matrix1[i][j], mul);
+	      matrix1[i][j] = holy_gf256_mul (matrix1[i][j], mul);
 	    for (j = 0; j < nbufs; j++)
-	      matrix2[i][j] = gf_mul (matrix2[i][j], mul);
+	      matrix2[i][j] = holy_gf256_mul (matrix2[i][j], mul);
 	    for (j = i + 1; j < nbufs; j++)
 	      {
 		mul = matrix1[j][i];
 		for (k = 0; k < nbufs; k++)
-		  matrix1[j][k] ^= gf_mul (matrix1[i][k], mul);
+		  matrix1[j][k] ^= holy_gf256_mul (matrix1[i][k], mul);
 		for (k = 0; k < nbufs; k++)
-		  matrix2[j][k] ^= gf_mul (matrix2[i][k], mul);
+		  matrix2[j][k] ^= holy_gf256_mul (matrix2[i][k], mul);
 	      }
 	  }
 	for (i = nbufs - 1; i >= 0; i--)
@@ -1397,24 +1391,13 @@ recovery (holy_uint8_t *bufs[4], holy_size_t s, const int nbufs,
 		holy_uint8_t mul;
 		mul = matrix1[j][i];
 		for (k = 0; k < nbufs; k++)
-		  matrix1[j][k] ^= gf_mul (matrix1[i][k], mul);
+		  matrix1[j][k] ^= holy_gf256_mul (matrix1[i][k], mul);
 		for (k = 0; k < nbufs; k++)
-		  matrix2[j][k] ^= gf_mul (matrix2[i][k], mul);
+		  matrix2[j][k] ^= holy_gf256_mul (matrix2[i][k], mul);
 	      }
 	  }
 
-	for (i = 0; i < (int) s; i++)
-	  {
-	    holy_uint8_t b[MAX_NBUFS];
-	    for (j = 0; j < nbufs; j++)
-	      b[j] = bufs[j][i];
-	    for (j = 0; j < nbufs; j++)
-	      {
-		bufs[j][i] = 0;
-		for (k = 0; k < nbufs; k++)
-		  bufs[j][i] ^= gf_mul (matrix2[j][k], b[k]);
-	      }
-	  }
+	apply_matrix (bufs, s, nbufs, matrix2);
 	return holy_ERR_NONE;
       }
     default:
@@ -1551,22 +1534,6 @@ read_device (holy_uint64_t offset, struct holy_zfs_device_desc *desc,
 	    unsigned i, j;
 	    holy_err_t err;
 
-	    /* Compute mul. x**s has a period of 255.  */
-	    if (powx[0] == 0)
-	      {
-		holy_uint8_t cur = 1;
-		for (i = 0; i < 255; i++)
-		  {
-		    powx[i] = cur;
-		    powx[i + 255] = cur;
-		    powx_inv[cur] = i;
-		    if (cur & 0x80)
-		      cur = (cur << 1) ^ poly;
-		    else
-		      cur <<= 1;
-		  }
-	      }
-
 	    /* Read redundancy data.  */
 	    for (n_redundancy = 0, cur_redundancy_pow = 0;
 		 n_redundancy < failed_devices;
@@ -3659,17 +3626,74 @@ zfs_mount (holy_device_t dev)
   return data;
 }
 
+static void *
+zfs_mount_device (holy_device_t dev)
+{
+  return zfs_mount (dev);
+}
+
+/* Point the leaves found on the device we were mounted from at DEV.  The
+   other leaves were opened by the mount itself and stay open with it.  */
+static void
+remount_device (struct holy_zfs_device_desc *desc, holy_device_t dev)
+{
+  unsigned i;
+  switch (desc->type)
+    {
+    case DEVICE_LEAF:
+      if (desc->original)
+	desc->dev = dev;
+      return;
+    case DEVICE_RAIDZ:
+    case DEVICE_MIRROR:
+      for (i = 0; i < desc->n_children; i++)
+	remount_device (&desc->children[i], dev);
+      return;
+    }
+}
+
+/* Reuse a cached mount for another file: the MOS and the dnode cache stay,
+   the file block and the keys of the last dataset go.  */
+static holy_err_t
+zfs_remount (void *mount, holy_device_t dev)
+{
+  struct holy_zfs_data *data = mount;
+  unsigned i;
+
+  for (i = 0; i < data->n_devices_attached; i++)
+    remount_device (&data->devices_attached[i], dev);
+
+  holy_free (data->file_buf);
+  data->file_buf = NULL;
+  data->file_start = data->file_end = 0;
+
+  for (i = 0; i < data->subvol.nkeys; i++)
+    holy_crypto_cipher_close (data->subvol.keyring[i].cipher);
+  holy_free (data->subvol.keyring);
+  data->subvol.keyring = NULL;
+  data->subvol.nkeys = 0;
+  return holy_ERR_NONE;
+}
+
+static void
+zfs_unmount_data (void *mount)
+{
+  zfs_unmount (mount);
+}
+
+static struct holy_fs holy_zfs_fs;
+
 holy_err_t
 holy_zfs_fetch_nvlist (holy_device_t dev, char **nvlist)
 {
   struct holy_zfs_data *zfs;
   holy_err_t err;
 
-  zfs = zfs_mount (dev);
+  zfs = holy_fs_mount (&holy_zfs_fs, dev);
   if (!zfs)
     return holy_errno;
   err = zfs_fetch_nvlist (zfs->device_original, nvlist);
-  zfs_unmount (zfs);
+  holy_fs_unmount (&holy_zfs_fs, zfs);
   return err;
 }
 
@@ -3680,20 +3704,20 @@ zfs_label (holy_device_t device, char **label)
   holy_err_t err;
   struct holy_zfs_data *data;
 
-  data = zfs_mount (device);
+  data = holy_fs_mount (&holy_zfs_fs, device);
   if (! data)
     return holy_errno;
 
   err = zfs_fetch_nvlist (data->device_original, &nvlist);
   if (err)      
     {
-      zfs_unmount (data);
+      holy_fs_unmount (&holy_zfs_fs, data);
       return err;
     }
 
   *label = holy_zfs_nvlist_lookup_string (nvlist, ZPOOL_CONFIG_POOL_NAME);
   holy_free (nvlist);
-  zfs_unmount (data);
+  holy_fs_unmount (&holy_zfs_fs, data);
   return holy_errno;
 }
 
@@ -3704,12 +3728,12 @@ zfs_uuid (holy_device_t device, char **uuid)
 
   *uuid = 0;
 
-  data = zfs_mount (device);
+  data = holy_fs_mount (&holy_zfs_fs, device);
   if (! data)
     return holy_errno;
 
   *uuid = holy_xasprintf ("%016llx", (long long unsigned) data->guid);
-  zfs_unmount (data);
+  holy_fs_unmount (&holy_zfs_fs, data);
   if (! *uuid)
     return holy_errno;
   return holy_ERR_NONE;
@@ -3724,7 +3748,7 @@ zfs_mtime (holy_device_t device, holy_int32_t *mt)
 
   *mt = 0;
 
-  data = zfs_mount (device);
+  data = holy_fs_mount (&holy_zfs_fs, device);
   if (! data)
     return holy_errno;
 
@@ -3734,7 +3758,7 @@ zfs_mtime (holy_device_t device, holy_int32_t *mt)
 	       ? holy_ZFS_LITTLE_ENDIAN : holy_ZFS_BIG_ENDIAN);
 
   *mt = holy_zfs_to_cpu64 (ub->ub_timestamp, ub_endian);
-  zfs_unmount (data);
+  holy_fs_unmount (&holy_zfs_fs, data);
   return holy_ERR_NONE;
 }
 
@@ -3749,7 +3773,7 @@ holy_zfs_open (struct holy_file *file, const char *fsfilename)
   holy_err_t err;
   int isfs;
 
-  data = zfs_mount (file->device);
+  data = holy_fs_mount (&holy_zfs_fs, file->device);
   if (! data)
     return holy_errno;
 
@@ -3757,20 +3781,20 @@ holy_zfs_open (struct holy_file *file, const char *fsfilename)
 			    &(data->dnode), &isfs, data);
   if (err)
     {
-      zfs_unmount (data);
+      holy_fs_unmount (&holy_zfs_fs, data);
       return err;
     }
 
   if (isfs)
     {
-      zfs_unmount (data);
+      holy_fs_unmount (&holy_zfs_fs, data);
       return holy_error (holy_ERR_BAD_FILE_TYPE, N_("missing `%c' symbol"), '@');
     }
 
   /* We found the dnode for this file. Verify if it is a plain file. */
   if (data->dnode.dn.dn_type != DMU_OT_PLAIN_FILE_CONTENTS) 
     {
-      zfs_unmount (data);
+      holy_fs_unmount (&holy_zfs_fs, data);
       return holy_error (holy_ERR_BAD_FILE_TYPE, N_("not a regular file"));
     }
 
@@ -3900,7 +3924,7 @@ holy_zfs_read (holy_file_t file, char *buf, holy_size_t len)
 static holy_err_t
 holy_zfs_close (holy_file_t file)
 {
-  zfs_unmount ((struct holy_zfs_data *) file->data);
+  holy_fs_unmount (&holy_zfs_fs, file->data);
 
 #ifndef holy_UTIL
   holy_dl_unref (my_mod);
@@ -3917,14 +3941,14 @@ holy_zfs_getmdnobj (holy_device_t dev, const char *fsfilename,
   holy_err_t err;
   int isfs;
 
-  data = zfs_mount (dev);
+  data = holy_fs_mount (&holy_zfs_fs, dev);
   if (! data)
     return holy_errno;
 
   err = dnode_get_fullpath (fsfilename, &(data->subvol),
 			    &(data->dnode), &isfs, data);
   *mdnobj = data->subvol.obj;
-  zfs_unmount (data);
+  holy_fs_unmount (&holy_zfs_fs, data);
   return err;
 }
 
@@ -4151,13 +4175,13 @@ holy_zfs_dir (holy_device_t device, const char *path,
   holy_err_t err;
   int isfs;
 
-  data = zfs_mount (device);
+  data = holy_fs_mount (&holy_zfs_fs, device);
   if (! data)
     return holy_errno;
   err = dnode_get_fullpath (path, &(data->subvol), &(data->dnode), &isfs, data);
   if (err)
     {
-      zfs_unmount (data);
+      holy_fs_unmount (&holy_zfs_fs, data);
       return err;
     }
   ctx.data = data;
@@ -4172,12 +4196,12 @@ holy_zfs_dir (holy_device_t device, const char *path,
       err = fill_fs_info (&info, data->dnode, data);
       if (err)
 	{
-	  zfs_unmount (data);
+	  holy_fs_unmount (&holy_zfs_fs, data);
 	  return err;
 	}
       if (hook ("@", &info, hook_data))
 	{
-	  zfs_unmount (data);
+	  holy_fs_unmount (&holy_zfs_fs, data);
 	  return holy_ERR_NONE;
 	}
 
@@ -4187,7 +4211,7 @@ holy_zfs_dir (holy_device_t device, const char *path,
 		       DMU_OT_DSL_DIR_CHILD_MAP, &dn, data);
       if (err)
 	{
-	  zfs_unmount (data);
+	  holy_fs_unmount (&holy_zfs_fs, data);
 	  return err;
 	}
 
@@ -4196,7 +4220,7 @@ holy_zfs_dir (holy_device_t device, const char *path,
       err = dnode_get (&(data->mos), headobj, DMU_OT_DSL_DATASET, &dn, data);
       if (err)
 	{
-	  zfs_unmount (data);
+	  holy_fs_unmount (&holy_zfs_fs, data);
 	  return err;
 	}
 
@@ -4206,7 +4230,7 @@ holy_zfs_dir (holy_device_t device, const char *path,
 		       DMU_OT_DSL_DS_SNAP_MAP, &dn, data);
       if (err)
 	{
-	  zfs_unmount (data);
+	  holy_fs_unmount (&holy_zfs_fs, data);
 	  return err;
 	}
 
@@ -4216,12 +4240,12 @@ holy_zfs_dir (holy_device_t device, const char *path,
     {
       if (data->dnode.dn.dn_type != DMU_OT_DIRECTORY_CONTENTS)
 	{
-	  zfs_unmount (data);
+	  holy_fs_unmount (&holy_zfs_fs, data);
 	  return holy_error (holy_ERR_BAD_FILE_TYPE, N_("not a directory"));
 	}
       zap_iterate_u64 (&(data->dnode), iterate_zap, data, &ctx);
     }
-  zfs_unmount (data);
+  holy_fs_unmount (&holy_zfs_fs, data);
   return holy_errno;
 }
 
@@ -4328,6 +4352,9 @@ static struct holy_fs holy_zfs_fs = {
   .label = zfs_label,
   .uuid = zfs_uuid,
   .mtime = zfs_mtime,
+  .mount = zfs_mount_device,
+  .remount = zfs_remount,
+  .unmount = zfs_unmount_data,
 #ifdef holy_UTIL
   .embed = holy_zfs_embed,
   .reserved_first_sector = 1,
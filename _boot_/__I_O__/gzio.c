@@ -26,6 +26,38 @@ holy_MOD_LICENSE ("GPLv2+");
 
 #define INBUFSIZ  0x2000
 
+/* Literal/length codes of up to FAST_BITS bits, and pairs of literals
+   whose codes fit together in FAST_BITS, are decoded with a single lookup
+   in a flat table built on top of the huft tables.  */
+#define FAST_BITS	10
+#define FAST_MASK	((1 << FAST_BITS) - 1)
+
+#define FAST_ENTRY(count, len, lit1, lit2) \
+  (((count) << 24) | ((len) << 16) | ((lit2) << 8) | (lit1))
+#define FAST_COUNT(f)	((f) >> 24)
+#define FAST_LEN(f)	(((f) >> 16) & 0xff)
+
+/* Backward seeks restart from the closest snapshot of the decoder state
+   taken at a block boundary, instead of from the start of the stream.
+   Snapshots are taken every GZIO_RESTART_INTERVAL bytes of output; when
+   all GZIO_MAX_RESTART slots are used every other one is dropped and
+   the interval doubled, so memory stays bounded for any file size.  */
+#define GZIO_RESTART_INTERVAL	(1 << 20)
+#define GZIO_MAX_RESTART	8
+
+struct gzio_restart
+{
+  /* Uncompressed offset of the snapshot.  */
+  holy_off_t out;
+  /* Offset of the next compressed byte.  */
+  holy_off_t in;
+  holy_uint64_t bb;
+  unsigned bk;
+  unsigned wp;
+  /* Copy of the sliding window.  */
+  holy_uint8_t *window;
+};
+
 /* The state stored in filesystem-specific data.  */
 struct holy_gzio
 {
@@ -51,8 +83,12 @@ struct holy_gzio
   /* The input buffer.  */
   holy_uint8_t inbuf[INBUFSIZ];
   int inbuf_d;
+  /* The number of valid bytes in inbuf.  */
+  int inbuf_len;
+  /* The offset of inbuf in the underlying file.  */
+  holy_off_t inbuf_pos;
   /* The bit buffer.  */
-  unsigned long bb;
+  holy_uint64_t bb;
   /* The bits in the bit buffer.  */
   unsigned bk;
   /* The sliding window in uncompressed data.  */
@@ -67,8 +103,14 @@ struct holy_gzio
   int bl;
   /* The lookup bits for the distance code table.  */
   int bd;
+  /* Single and paired literal decoding for the current block.  */
+  holy_uint32_t fast[1 << FAST_BITS];
   /* The original offset value.  */
   holy_off_t saved_offset;
+  /* Restart points for backward seeks.  */
+  struct gzio_restart restart[GZIO_MAX_RESTART];
+  int n_restart;
+  holy_off_t restart_interval;
 };
 typedef struct holy_gzio *holy_gzio_t;
 
@@ -332,8 +374,9 @@ static ush mask_bits[] =
   0x01ff, 0x03ff, 0x07ff, 0x0fff, 0x1fff, 0x3fff, 0x7fff, 0xffff
 };
 
-#define NEEDBITS(n) do {while(k<(n)){b|=((ulg)get_byte(gzio))<<k;k+=8;}} while (0)
+#define NEEDBITS(n) do {while(k<(n)){b|=((holy_uint64_t)get_byte(gzio))<<k;k+=8;}} while (0)
 #define DUMPBITS(n) do {b>>=(n);k-=(n);} while (0)
+#define FILLBITS() fill_bits (gzio, &b, &k)
 
 static int
 get_byte (holy_gzio_t gzio)
@@ -345,17 +388,58 @@ get_byte (holy_gzio_t gzio)
       return 0;
     }
 
-  if (gzio->file && (holy_file_tell (gzio->file)
-		     == (holy_off_t) gzio->data_offset
-		     || gzio->inbuf_d == INBUFSIZ))
+  if (gzio->file && gzio->inbuf_d >= gzio->inbuf_len)
     {
+      holy_ssize_t r;
+
+      gzio->inbuf_pos = holy_file_tell (gzio->file);
+      r = holy_file_read (gzio->file, gzio->inbuf, INBUFSIZ);
       gzio->inbuf_d = 0;
-      holy_file_read (gzio->file, gzio->inbuf, INBUFSIZ);
+      gzio->inbuf_len = r > 0 ? r : 0;
+      if (! gzio->inbuf_len)
+	return 0;
     }
 
   return gzio->inbuf[gzio->inbuf_d++];
 }
 
+/* Top the bit buffer up to at least 56 bits with one unaligned load when
+   8 bytes of input are already buffered; otherwise leave it to NEEDBITS.
+   The bits loaded above the new count are the real following input, so
+   OR-ing them in again on the next refill is harmless.  */
+static inline void
+fill_bits (holy_gzio_t gzio, holy_uint64_t *b, unsigned *k)
+{
+  const holy_uint8_t *p;
+
+  if (gzio->mem_input)
+    {
+      if (gzio->mem_input_off + 8 > gzio->mem_input_size)
+	return;
+      p = gzio->mem_input + gzio->mem_input_off;
+      gzio->mem_input_off += (63 - *k) >> 3;
+    }
+  else
+    {
+      if (gzio->inbuf_d + 8 > gzio->inbuf_len)
+	return;
+      p = gzio->inbuf + gzio->inbuf_d;
+      gzio->inbuf_d += (63 - *k) >> 3;
+    }
+
+  *b |= holy_le_to_cpu64 (holy_get_unaligned64 (p)) << *k;
+  *k |= 56;
+}
+
+/* Offset of the next byte get_byte will return.  */
+static holy_off_t
+gzio_input_pos (holy_gzio_t gzio)
+{
+  if (gzio->mem_input)
+    return gzio->mem_input_off;
+  return gzio->inbuf_pos + gzio->inbuf_d;
+}
+
 static void
 gzio_seek (holy_gzio_t gzio, holy_off_t off)
 {
@@ -368,13 +452,17 @@ gzio_seek (holy_gzio_t gzio, holy_off_t off)
 	gzio->mem_input_off = off;
     }
   else
-    holy_file_seek (gzio->file, off);
+    {
+      holy_file_seek (gzio->file, off);
+      gzio->inbuf_d = gzio->inbuf_len = 0;
+    }
 }
 
 /* more function prototypes */
 static int huft_build (unsigned *, unsigned, unsigned, ush *, ush *,
 		       struct huft **, int *);
 static int huft_free (struct huft *);
+static void build_fast_table (holy_gzio_t);
 static int inflate_codes_in_window (holy_gzio_t);
 
 
@@ -596,6 +684,58 @@ huft_free (struct huft *t)
 }
 
 
+/* Look up CODE in the table T of BITS lookup bits, using no more than AVAIL
+   bits of CODE.  Return the final entry and store the code length in LEN,
+   or return NULL if the code is longer than AVAIL or invalid.  */
+static struct huft *
+huft_peek (struct huft *t, int bits, unsigned code, unsigned avail,
+	   unsigned *len)
+{
+  unsigned e;
+
+  if (! t)
+    return NULL;
+
+  *len = 0;
+  t += code & mask_bits[bits];
+  for (;;)
+    {
+      e = t->e;
+      if (e == 99 || t->b > avail)
+	return NULL;
+      *len += t->b;
+      if (e <= 16)
+	return t;
+      code >>= t->b;
+      avail -= t->b;
+      t = t->v.t + (code & mask_bits[e - 16]);
+    }
+}
+
+
+/* Fill the fast table from the literal/length huft table.  Entries decode
+   one or two literals; everything else is left to the huft tables.  */
+static void
+build_fast_table (holy_gzio_t gzio)
+{
+  struct huft *t1, *t2;
+  unsigned i, l1, l2;
+
+  for (i = 0; i < (1 << FAST_BITS); i++)
+    {
+      gzio->fast[i] = 0;
+      t1 = huft_peek (gzio->tl, gzio->bl, i, FAST_BITS, &l1);
+      if (! t1 || t1->e != 16)
+	continue;
+      t2 = huft_peek (gzio->tl, gzio->bl, i >> l1, FAST_BITS - l1, &l2);
+      if (t2 && t2->e == 16)
+	gzio->fast[i] = FAST_ENTRY (2, l1 + l2, t1->v.n, t2->v.n);
+      else
+	gzio->fast[i] = FAST_ENTRY (1, l1, t1->v.n, 0);
+    }
+}
+
+
 /*
  *  inflate (decompress) the codes in a deflated (compressed) block.
  *  Return an error code or zero if it all goes ok.
@@ -609,8 +749,10 @@ inflate_codes_in_window (holy_gzio_t gzio)
   unsigned w;			/* current window position */
   struct huft *t;		/* pointer to table entry */
   unsigned ml, md;		/* masks for bl and bd bits */
-  register ulg b;		/* bit buffer */
-  register unsigned k;		/* number of bits in bit buffer */
+  holy_uint32_t f;		/* fast table entry */
+  unsigned s;			/* start of an overlapping copy */
+  holy_uint64_t b;		/* bit buffer */
+  unsigned k;			/* number of bits in bit buffer */
 
   /* make local copies of globals */
   d = gzio->inflate_d;
@@ -626,6 +768,25 @@ inflate_codes_in_window (holy_gzio_t gzio)
     {
       if (! gzio->code_state)
 	{
+	  if (k < 32)
+	    FILLBITS ();
+
+	  /* One or two literals in a single lookup.  */
+	  if (k >= FAST_BITS)
+	    {
+	      f = gzio->fast[(unsigned) b & FAST_MASK];
+	      if (FAST_COUNT (f) && w + FAST_COUNT (f) <= WSIZE)
+		{
+		  gzio->slide[w++] = (uch) f;
+		  if (FAST_COUNT (f) == 2)
+		    gzio->slide[w++] = (uch) (f >> 8);
+		  DUMPBITS (FAST_LEN (f));
+		  if (w == WSIZE)
+		    break;
+		  continue;
+		}
+	    }
+
 	  NEEDBITS ((unsigned) gzio->bl);
 	  if ((e = (t = gzio->tl + ((unsigned) b & ml))->e) > 16)
 	    do
@@ -697,17 +858,27 @@ inflate_codes_in_window (holy_gzio_t gzio)
 	      n -= (e = (e = WSIZE - ((d &= WSIZE - 1) > w ? d : w)) > n ? n
 		    : e);
 
-	      if (w - d >= e)
+	      if (w - d >= e || w == d)
 		{
 		  holy_memmove (gzio->slide + w, gzio->slide + d, e);
 		  w += e;
 		  d += e;
 		}
 	      else
-		/* purposefully use the overlap for extra copies here!! */
 		{
-		  while (e--)
-		    gzio->slide[w++] = gzio->slide[d++];
+		  /* The source overlaps the destination, so the match repeats
+		     the w - d bytes before w.  Copy that pattern in pieces
+		     that double each time, none of which overlap.  */
+		  s = d;
+		  while (e)
+		    {
+		      unsigned c = w - s < e ? w - s : e;
+
+		      holy_memcpy (gzio->slide + w, gzio->slide + s, c);
+		      w += c;
+		      d += c;
+		      e -= c;
+		    }
 		}
 
 	      if (w == WSIZE)
@@ -740,7 +911,7 @@ inflate_codes_in_window (holy_gzio_t gzio)
 static void
 init_stored_block (holy_gzio_t gzio)
 {
-  register ulg b;		/* bit buffer */
+  holy_uint64_t b;		/* bit buffer */
   register unsigned k;		/* number of bits in bit buffer */
 
   /* make local copies of globals */
@@ -760,6 +931,10 @@ init_stored_block (holy_gzio_t gzio)
 		"the length of a stored block does not match");
   DUMPBITS (16);
 
+  /* The block data is taken from whole bytes left in the bit buffer and
+     then straight from the input, so drop any bits loaded past them.  */
+  b &= ((holy_uint64_t) 1 << k) - 1;
+
   /* restore global variables */
   gzio->bb = b;
   gzio->bk = k;
@@ -808,6 +983,8 @@ init_fixed_block (holy_gzio_t gzio)
       return;
     }
 
+  build_fast_table (gzio);
+
   /* indicate we're now working on a block */
   gzio->code_state = 0;
   gzio->block_len++;
@@ -828,7 +1005,7 @@ init_dynamic_block (holy_gzio_t gzio)
   unsigned nl;			/* number of literal/length codes */
   unsigned nd;			/* number of distance codes */
   unsigned ll[286 + 30];	/* literal/length and distance code lengths */
-  register ulg b;		/* bit buffer */
+  holy_uint64_t b;		/* bit buffer */
   register unsigned k;		/* number of bits in bit buffer */
 
   /* make local bit buffer */
@@ -953,6 +1130,8 @@ init_dynamic_block (holy_gzio_t gzio)
       return;
     }
 
+  build_fast_table (gzio);
+
   /* indicate we're now working on a block */
   gzio->code_state = 0;
   gzio->block_len++;
@@ -962,7 +1141,7 @@ init_dynamic_block (holy_gzio_t gzio)
 static void
 get_new_block (holy_gzio_t gzio)
 {
-  register ulg b;		/* bit buffer */
+  holy_uint64_t b;		/* bit buffer */
   register unsigned k;		/* number of bits in bit buffer */
 
   /* make local bit buffer */
@@ -1000,11 +1179,111 @@ get_new_block (holy_gzio_t gzio)
 }
 
 
+/* Record a restart point at uncompressed offset OUT.  Only called between
+   blocks, so no Huffman tables need to be saved.  Failing to allocate a
+   snapshot is not an error; seeks just go further back.  */
+static void
+gzio_restart_save (holy_gzio_t gzio, holy_off_t out)
+{
+  struct gzio_restart *r;
+  holy_off_t last;
+  int i;
+
+  if (! gzio->restart_interval)
+    gzio->restart_interval = GZIO_RESTART_INTERVAL;
+
+  last = gzio->n_restart ? gzio->restart[gzio->n_restart - 1].out : 0;
+  if (out < last + gzio->restart_interval)
+    return;
+
+  if (gzio->n_restart == GZIO_MAX_RESTART)
+    {
+      for (i = 0; i < GZIO_MAX_RESTART; i += 2)
+	holy_free (gzio->restart[i].window);
+      for (i = 0; i < GZIO_MAX_RESTART / 2; i++)
+	gzio->restart[i] = gzio->restart[2 * i + 1];
+      gzio->n_restart = GZIO_MAX_RESTART / 2;
+      gzio->restart_interval *= 2;
+      if (out < gzio->restart[gzio->n_restart - 1].out
+	  + gzio->restart_interval)
+	return;
+    }
+
+  r = &gzio->restart[gzio->n_restart];
+  r->window = holy_malloc (WSIZE);
+  if (! r->window)
+    {
+      holy_errno = holy_ERR_NONE;
+      return;
+    }
+
+  holy_memcpy (r->window, gzio->slide, WSIZE);
+  r->out = out;
+  r->in = gzio_input_pos (gzio);
+  r->bb = gzio->bb & (((holy_uint64_t) 1 << gzio->bk) - 1);
+  r->bk = gzio->bk;
+  r->wp = gzio->wp;
+  gzio->n_restart++;
+
+  holy_dprintf ("gzio", "restart point %d at %llu (input %llu)\n",
+		gzio->n_restart - 1, (unsigned long long) r->out,
+		(unsigned long long) r->in);
+}
+
+/* Resume decompression from the last restart point at or before OFFSET,
+   if that is closer than where the decoder is now or OFFSET has already
+   left the window.  Return 1 if a restart point was used.  */
+static int
+gzio_restart_load (holy_gzio_t gzio, holy_off_t offset)
+{
+  struct gzio_restart *r = NULL;
+  int i;
+
+  for (i = 0; i < gzio->n_restart && gzio->restart[i].out <= offset; i++)
+    r = &gzio->restart[i];
+  if (! r)
+    return 0;
+  if (r->out <= gzio->saved_offset && gzio->saved_offset <= offset + WSIZE)
+    return 0;
+
+  gzio_seek (gzio, r->in);
+  holy_memcpy (gzio->slide, r->window, WSIZE);
+  gzio->wp = r->wp;
+  gzio->saved_offset = r->out;
+  gzio->bb = r->bb;
+  gzio->bk = r->bk;
+  gzio->last_block = 0;
+  gzio->block_len = 0;
+
+  huft_free (gzio->tl);
+  huft_free (gzio->td);
+  gzio->tl = NULL;
+  gzio->td = NULL;
+
+  return 1;
+}
+
+static void
+gzio_restart_free (holy_gzio_t gzio)
+{
+  int i;
+
+  for (i = 0; i < gzio->n_restart; i++)
+    holy_free (gzio->restart[i].window);
+  gzio->n_restart = 0;
+}
+
+
 static void
 inflate_window (holy_gzio_t gzio)
 {
-  /* initialize window */
-  gzio->wp = 0;
+  unsigned start;
+
+  /* Start a new window, unless resuming a partial one at a restart
+     point.  */
+  if (gzio->wp == WSIZE)
+    gzio->wp = 0;
+  start = gzio->wp;
 
   /*
    *  Main decompression loop.
@@ -1017,6 +1296,7 @@ inflate_window (holy_gzio_t gzio)
 	  if (gzio->last_block)
 	    break;
 
+	  gzio_restart_save (gzio, gzio->saved_offset + gzio->wp - start);
 	  get_new_block (gzio);
 	}
 
@@ -1038,6 +1318,14 @@ inflate_window (holy_gzio_t gzio)
 	   *  This is basically a glorified pass-through
 	   */
 
+	  while (gzio->block_len && w < WSIZE && gzio->bk)
+	    {
+	      gzio->slide[w++] = (uch) gzio->bb;
+	      gzio->bb >>= 8;
+	      gzio->bk -= 8;
+	      gzio->block_len--;
+	    }
+
 	  while (gzio->block_len && w < WSIZE && holy_errno == holy_ERR_NONE)
 	    {
 	      gzio->slide[w++] = get_byte (gzio);
@@ -1062,7 +1350,7 @@ inflate_window (holy_gzio_t gzio)
 	}
     }
 
-  gzio->saved_offset += gzio->wp;
+  gzio->saved_offset += gzio->wp - start;
 
   /* XXX do CRC calculation here! */
 }
@@ -1077,6 +1365,7 @@ initialize_tables (holy_gzio_t gzio)
   /* Initialize the bit buffer.  */
   gzio->bk = 0;
   gzio->bb = 0;
+  gzio->wp = 0;
 
   /* Reset partial decompression code.  */
   gzio->last_block = 0;
@@ -1188,8 +1477,10 @@ holy_gzio_read_real (holy_gzio_t gzio, holy_off_t offset,
 {
   holy_ssize_t ret = 0;
 
-  /* Do we reset decompression to the beginning of the file?  */
-  if (gzio->saved_offset > offset + WSIZE)
+  /* Do we reset decompression to a restart point or to the beginning of
+     the file?  */
+  if (! gzio_restart_load (gzio, offset)
+      && gzio->saved_offset > offset + WSIZE)
     initialize_tables (gzio);
 
   /*
@@ -1205,16 +1496,17 @@ holy_gzio_read_real (holy_gzio_t gzio, holy_off_t offset,
 
       while (offset >= gzio->saved_offset)
 	{
+	  holy_off_t prev = gzio->saved_offset;
+
 	  inflate_window (gzio);
-	  if (gzio->wp == 0)
+	  if (gzio->saved_offset == prev)
 	    goto out;
 	}
 
-      if (gzio->wp == 0)
-	goto out;
-
       srcaddr = (char *) ((offset & (WSIZE - 1)) + gzio->slide);
       size = gzio->saved_offset - offset;
+      if (size > WSIZE - (offset & (WSIZE - 1)))
+	size = WSIZE - (offset & (WSIZE - 1));
       if (size > len)
 	size = len;
 
@@ -1256,6 +1548,7 @@ holy_gzio_close (holy_file_t file)
   holy_file_close (gzio->file);
   huft_free (gzio->tl);
   huft_free (gzio->td);
+  gzio_restart_free (gzio);
   holy_free (gzio);
 
   /* No need to close the same device twice.  */
@@ -1286,6 +1579,9 @@ holy_zlib_decompress (char *inbuf, holy_size_t insize, holy_off_t off,
     }
 
   ret = holy_gzio_read_real (gzio, off, outbuf, outsize);
+  huft_free (gzio->tl);
+  huft_free (gzio->td);
+  gzio_restart_free (gzio);
   holy_free (gzio);
 
   /* FIXME: Check Adler.  */
@@ -1309,6 +1605,9 @@ holy_deflate_decompress (char *inbuf, holy_size_t insize, holy_off_t off,
   initialize_tables (gzio);
 
   ret = holy_gzio_read_real (gzio, off, outbuf, outsize);
+  huft_free (gzio->tl);
+  huft_free (gzio->td);
+  gzio_restart_free (gzio);
   holy_free (gzio);
 
   return ret;
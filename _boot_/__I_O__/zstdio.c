@@ -0,0 +1,312 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#include <holy/err.h>
+#include <holy/mm.h>
+#include <holy/misc.h>
+#include <holy/file.h>
+#include <holy/fs.h>
+#include <holy/dl.h>
+#include <holy/zstd.h>
+#include <holy/i18n.h>
+
+holy_MOD_LICENSE ("GPLv2+");
+
+struct holy_zstdio
+{
+  holy_file_t file;
+  struct holy_zstd_dctx *dctx;
+  /* One compressed block, header included.  */
+  holy_uint8_t *cbuf;
+  /* Inside a frame, and whether that frame ends with a checksum.  */
+  int in_frame;
+  int has_checksum;
+  int eof;
+  /* Output of the last decoded block and its uncompressed offset.  */
+  const holy_uint8_t *out;
+  holy_size_t out_len;
+  holy_off_t out_off;
+};
+
+typedef struct holy_zstdio *holy_zstdio_t;
+static struct holy_fs holy_zstdio_fs;
+
+static holy_err_t
+corrupted (void)
+{
+  if (!holy_errno)
+    holy_error (holy_ERR_BAD_COMPRESSED_DATA, N_("zstd file corrupted"));
+  return holy_errno;
+}
+
+/* Read the frame header at the current position of IO and leave IO just
+   past it.  Skippable frames are stepped over, and *END is set instead
+   when there are no more frames.  */
+static holy_err_t
+read_frame_header (holy_file_t io, struct holy_zstd_frame *frame, int *end)
+{
+  holy_uint8_t hdr[holy_ZSTD_FRAME_HEADER_MAX];
+  holy_off_t start;
+  holy_ssize_t n, hsize;
+  holy_uint32_t magic;
+
+  *end = 0;
+  while (1)
+    {
+      start = holy_file_tell (io);
+      n = holy_file_read (io, hdr, sizeof (hdr));
+      if (n < 0)
+	return holy_errno;
+      if (n == 0)
+	{
+	  *end = 1;
+	  return holy_ERR_NONE;
+	}
+      if (n < 8)
+	return corrupted ();
+
+      magic = holy_le_to_cpu32 (holy_get_unaligned32 (hdr));
+      if ((magic & holy_ZSTD_SKIPPABLE_MASK) != holy_ZSTD_SKIPPABLE_MAGIC)
+	break;
+      holy_file_seek (io, start + 8
+		      + holy_le_to_cpu32 (holy_get_unaligned32 (hdr + 4)));
+    }
+
+  hsize = holy_zstd_frame_header (hdr, n, frame);
+  if (hsize == 0)
+    return corrupted ();
+  if (hsize < 0)
+    return holy_errno;
+  holy_file_seek (io, start + hsize);
+  return holy_ERR_NONE;
+}
+
+/* Add up the content sizes of all frames.  Only the block headers are
+   read, so this does not decompress anything.  */
+static holy_off_t
+stream_size (holy_file_t io)
+{
+  struct holy_zstd_frame frame;
+  holy_uint8_t hdr[holy_ZSTD_BLOCK_HEADER_SIZE];
+  holy_off_t total = 0;
+  holy_size_t bsize;
+  int end, last;
+
+  while (1)
+    {
+      if (read_frame_header (io, &frame, &end))
+	return holy_FILE_SIZE_UNKNOWN;
+      if (end)
+	return total;
+      if (frame.content_size == holy_ZSTD_CONTENT_SIZE_UNKNOWN)
+	return holy_FILE_SIZE_UNKNOWN;
+      total += frame.content_size;
+
+      do
+	{
+	  if (holy_file_read (io, hdr, sizeof (hdr)) != sizeof (hdr))
+	    return holy_FILE_SIZE_UNKNOWN;
+	  bsize = holy_zstd_block_size (hdr, &last);
+	  holy_file_seek (io, holy_file_tell (io) + bsize - sizeof (hdr));
+	}
+      while (!last);
+
+      if (frame.has_checksum)
+	holy_file_seek (io, holy_file_tell (io) + holy_ZSTD_CHECKSUM_SIZE);
+    }
+}
+
+/* Decode the next block of the stream into zstdio->out.  */
+static holy_err_t
+next_block (holy_zstdio_t zstdio)
+{
+  holy_file_t io = zstdio->file;
+  holy_size_t bsize;
+  holy_ssize_t n;
+  int last;
+
+  if (!zstdio->in_frame)
+    {
+      struct holy_zstd_frame frame;
+      int end;
+
+      if (read_frame_header (io, &frame, &end))
+	return holy_errno;
+      if (end)
+	{
+	  zstdio->eof = 1;
+	  zstdio->out_len = 0;
+	  return holy_ERR_NONE;
+	}
+      if (holy_zstd_frame_begin (zstdio->dctx, &frame))
+	return holy_errno;
+      zstdio->in_frame = 1;
+      zstdio->has_checksum = frame.has_checksum;
+    }
+
+  if (holy_file_read (io, zstdio->cbuf, holy_ZSTD_BLOCK_HEADER_SIZE)
+      != holy_ZSTD_BLOCK_HEADER_SIZE)
+    return corrupted ();
+  bsize = holy_zstd_block_size (zstdio->cbuf, &last);
+  if (bsize > holy_ZSTD_BLOCK_HEADER_SIZE + holy_ZSTD_BLOCK_MAX)
+    return corrupted ();
+  bsize -= holy_ZSTD_BLOCK_HEADER_SIZE;
+  if (holy_file_read (io, zstdio->cbuf + holy_ZSTD_BLOCK_HEADER_SIZE, bsize)
+      != (holy_ssize_t) bsize)
+    return corrupted ();
+
+  n = holy_zstd_decode_block (zstdio->dctx, zstdio->cbuf, &zstdio->out);
+  if (n < 0)
+    return corrupted ();
+  zstdio->out_len = n;
+
+  if (last)
+    {
+      zstdio->in_frame = 0;
+      if (zstdio->has_checksum)
+	holy_file_seek (io, holy_file_tell (io) + holy_ZSTD_CHECKSUM_SIZE);
+    }
+  return holy_ERR_NONE;
+}
+
+static holy_file_t
+holy_zstdio_open (holy_file_t io,
+		  const char *name __attribute__ ((unused)))
+{
+  holy_file_t file;
+  holy_zstdio_t zstdio;
+  holy_uint32_t magic;
+
+  if (holy_file_tell (io) != 0)
+    holy_file_seek (io, 0);
+  if (holy_file_read (io, &magic, sizeof (magic)) != sizeof (magic))
+    {
+      holy_errno = holy_ERR_NONE;
+      holy_file_seek (io, 0);
+      return io;
+    }
+  holy_file_seek (io, 0);
+  magic = holy_le_to_cpu32 (magic);
+  if (magic != holy_ZSTD_MAGIC
+      && (magic & holy_ZSTD_SKIPPABLE_MASK) != holy_ZSTD_SKIPPABLE_MAGIC)
+    return io;
+
+  file = (holy_file_t) holy_zalloc (sizeof (*file));
+  if (!file)
+    return 0;
+
+  zstdio = holy_zalloc (sizeof (*zstdio));
+  if (!zstdio)
+    {
+      holy_free (file);
+      return 0;
+    }
+
+  zstdio->file = io;
+  zstdio->dctx = holy_zstd_dctx_new ();
+  zstdio->cbuf = holy_malloc (holy_ZSTD_BLOCK_HEADER_SIZE
+			      + holy_ZSTD_BLOCK_MAX);
+  if (!zstdio->dctx || !zstdio->cbuf)
+    {
+      holy_zstd_dctx_free (zstdio->dctx);
+      holy_free (zstdio->cbuf);
+      holy_free (zstdio);
+      holy_free (file);
+      return 0;
+    }
+
+  file->device = io->device;
+  file->data = zstdio;
+  file->fs = &holy_zstdio_fs;
+  file->not_easily_seekable = 1;
+
+  /* FIXME: don't walk the block headers on not easily seekable files.  */
+  file->size = stream_size (io);
+  holy_errno = holy_ERR_NONE;
+  holy_file_seek (io, 0);
+
+  return file;
+}
+
+static holy_ssize_t
+holy_zstdio_read (holy_file_t file, char *buf, holy_size_t len)
+{
+  holy_zstdio_t zstdio = file->data;
+  holy_ssize_t ret = 0;
+
+  /* Only the last block is kept, so going further back means starting
+     over.  */
+  if (file->offset < zstdio->out_off)
+    {
+      zstdio->in_frame = 0;
+      zstdio->eof = 0;
+      zstdio->out_len = 0;
+      zstdio->out_off = 0;
+      holy_file_seek (zstdio->file, 0);
+    }
+
+  while (len > 0)
+    {
+      holy_off_t pos = file->offset + ret;
+
+      if (pos < zstdio->out_off + zstdio->out_len)
+	{
+	  holy_size_t skip = pos - zstdio->out_off;
+	  holy_size_t take = holy_min (zstdio->out_len - skip, len);
+
+	  holy_memcpy (buf, zstdio->out + skip, take);
+	  buf += take;
+	  len -= take;
+	  ret += take;
+	  continue;
+	}
+
+      if (zstdio->eof)
+	break;
+      zstdio->out_off += zstdio->out_len;
+      if (next_block (zstdio))
+	return -1;
+    }
+
+  return ret;
+}
+
+/* Release everything, including the underlying file object.  */
+static holy_err_t
+holy_zstdio_close (holy_file_t file)
+{
+  holy_zstdio_t zstdio = file->data;
+
+  holy_zstd_dctx_free (zstdio->dctx);
+  holy_free (zstdio->cbuf);
+
+  holy_file_close (zstdio->file);
+  holy_free (zstdio);
+
+  /* Device must not be closed twice.  */
+  file->device = 0;
+  file->name = 0;
+  return holy_errno;
+}
+
+static struct holy_fs holy_zstdio_fs = {
+  .name = "zstdio",
+  .dir = 0,
+  .open = 0,
+  .read = holy_zstdio_read,
+  .close = holy_zstdio_close,
+  .label = 0,
+  .next = 0
+};
+
+holy_MOD_INIT (zstdio)
+{
+  holy_file_filter_register (holy_FILE_FILTER_ZSTDIO, holy_zstdio_open);
+}
+
+holy_MOD_FINI (zstdio)
+{
+  holy_file_filter_unregister (holy_FILE_FILTER_ZSTDIO);
+}
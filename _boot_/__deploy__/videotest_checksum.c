@@ -5,8 +5,12 @@
 
 #include <holy/test.h>
 #include <holy/dl.h>
+#include <holy/misc.h>
+#include <holy/time.h>
 #include <holy/video.h>
 #include <holy/video_fb.h>
+#include <holy/bitmap.h>
+#include <holy/fbsimd.h>
 #include <holy/command.h>
 #include <holy/font.h>
 
@@ -14,6 +18,166 @@ holy_MOD_LICENSE ("GPLv2+");
 
 #define FONT_NAME "Unknown Regular 16"
 
+#define BLIT_WIDTH 3840
+#define BLIT_HEIGHT 2160
+#define BLIT_TILE 256
+#define BLIT_ROUNDS 4
+
+static const char *const blit_impls[] = { "avx2", "sse2", "generic" };
+
+/* Bitmaps are RGBA and this framebuffer is BGRA, as with most firmware,
+   so both replacing and blending go through the channel swapping
+   kernels.  */
+static struct holy_video_mode_info blit_mode =
+  {
+    .width = BLIT_WIDTH,
+    .height = BLIT_HEIGHT,
+    .pitch = BLIT_WIDTH * 4,
+    holy_VIDEO_MI_BGRA8888()
+  };
+
+/* Bands of transparent, opaque and translucent pixels, like icons and
+   antialiased text over a theme background.  */
+static struct holy_video_bitmap *
+make_tile (void)
+{
+  struct holy_video_bitmap *bitmap;
+  holy_uint32_t *data;
+  unsigned x, y;
+
+  if (holy_video_bitmap_create (&bitmap, BLIT_TILE, BLIT_TILE,
+				holy_VIDEO_BLIT_FORMAT_RGBA_8888))
+    return 0;
+  data = holy_video_bitmap_get_data (bitmap);
+  for (y = 0; y < BLIT_TILE; y++)
+    for (x = 0; x < BLIT_TILE; x++)
+      {
+	holy_uint32_t alpha;
+
+	switch ((x / 16 + y / 16) % 3)
+	  {
+	  case 0:
+	    alpha = 0;
+	    break;
+	  case 1:
+	    alpha = 255;
+	    break;
+	  default:
+	    alpha = (x * 7 + y * 3) & 0xff;
+	    break;
+	  }
+	data[y * BLIT_TILE + x] = ((alpha << 24) | ((x ^ y) << 16)
+				   | (y << 8) | x);
+      }
+  return bitmap;
+}
+
+static unsigned
+blit_all (struct holy_video_bitmap *bitmap,
+	  enum holy_video_blit_operators oper)
+{
+  unsigned x, y, n = 0;
+
+  for (y = 0; y < BLIT_HEIGHT; y += BLIT_TILE)
+    for (x = 0; x < BLIT_WIDTH; x += BLIT_TILE)
+      {
+	holy_video_blit_bitmap (bitmap, oper, x, y, 0, 0,
+				BLIT_TILE, BLIT_TILE);
+	n++;
+      }
+  return n;
+}
+
+static holy_uint32_t
+frame_hash (void)
+{
+  holy_uint32_t *fb = holy_video_capture_get_framebuffer ();
+  holy_uint32_t hash = 2166136261U;
+  unsigned i;
+
+  for (i = 0; i < BLIT_WIDTH * BLIT_HEIGHT; i++)
+    hash = (hash ^ fb[i]) * 16777619;
+  return hash;
+}
+
+/* Time fills, replacing blits and blending blits of a 4K frame with each
+   implementation that runs here, and check they all draw the same.  */
+static void
+videotest_blit (void)
+{
+  struct holy_video_bitmap *bitmap;
+  const char *saved;
+  holy_uint32_t hash[2];
+  int have_hash = 0;
+  unsigned i;
+
+  bitmap = make_tile ();
+  if (!bitmap)
+    {
+      holy_test_assert (0, "can't create bitmap: %s", holy_errmsg);
+      return;
+    }
+
+  saved = holy_video_fb_simd_implementation ();
+  for (i = 0; i < ARRAY_SIZE (blit_impls); i++)
+    {
+      holy_uint64_t start, fill_ms, replace_ms, blend_ms;
+      unsigned round, blits = 0;
+      holy_uint32_t h[2];
+
+      if (holy_video_fb_simd_select (blit_impls[i]) != 0)
+	continue;
+
+      if (holy_video_capture_start (&blit_mode, holy_video_fbstd_colors,
+				    blit_mode.number_of_colors))
+	{
+	  holy_test_assert (0, "can't start capture: %s", holy_errmsg);
+	  break;
+	}
+
+      start = holy_get_time_ms ();
+      for (round = 0; round < BLIT_ROUNDS; round++)
+	holy_video_fill_rect (holy_video_map_rgb (round, 0x40, 0x80),
+			      0, 0, BLIT_WIDTH, BLIT_HEIGHT);
+      fill_ms = holy_get_time_ms () - start;
+
+      start = holy_get_time_ms ();
+      for (round = 0; round < BLIT_ROUNDS; round++)
+	blits = blit_all (bitmap, holy_VIDEO_BLIT_REPLACE);
+      replace_ms = holy_get_time_ms () - start;
+      h[0] = frame_hash ();
+
+      holy_video_fill_rect (holy_video_map_rgb (0x20, 0x40, 0x80),
+			    0, 0, BLIT_WIDTH, BLIT_HEIGHT);
+      start = holy_get_time_ms ();
+      for (round = 0; round < BLIT_ROUNDS; round++)
+	blit_all (bitmap, holy_VIDEO_BLIT_BLEND);
+      blend_ms = holy_get_time_ms () - start;
+
+      h[1] = frame_hash ();
+      holy_video_capture_end ();
+
+      holy_printf ("%s: fill %lld ms, replace %lld blits/s, "
+		   "blend %lld blits/s\n", blit_impls[i],
+		   (long long) fill_ms / BLIT_ROUNDS,
+		   (long long) (replace_ms ? 1000ULL * BLIT_ROUNDS * blits
+				/ replace_ms : 0),
+		   (long long) (blend_ms ? 1000ULL * BLIT_ROUNDS * blits
+				/ blend_ms : 0));
+
+      holy_test_assert (!have_hash || h[0] == hash[0],
+			"%s replaces differently", blit_impls[i]);
+      holy_test_assert (!have_hash || h[1] == hash[1],
+			"%s blends differently", blit_impls[i]);
+      hash[0] = h[0];
+      hash[1] = h[1];
+      have_hash = 1;
+    }
+
+  holy_video_fb_simd_select (saved);
+  holy_video_bitmap_destroy (bitmap);
+}
+
 /* Functional test main method.  */
 static void
 videotest_checksum (void)
@@ -60,6 +224,10 @@ videotest_checksum (void)
       holy_video_checksum_end ();
       holy_video_capture_end ();
     }
+
+#if !defined (holy_MACHINE_MIPS_QEMU_MIPS) && !defined (holy_MACHINE_IEEE1275)
+  videotest_blit ();
+#endif
 }
 
 /* Register example_test method as a functional test.  */
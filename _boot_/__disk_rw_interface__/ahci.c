@@ -39,6 +39,18 @@ struct holy_ahci_cmd_table
   struct holy_ahci_prdt_entry prdt[1];
 };
 
+/* Queued commands take up to this many bounce fragments, one PRDT entry
+   each.  */
+#define holy_AHCI_QUEUED_MAX_FRAGS 16
+
+struct holy_ahci_queued_table
+{
+  holy_uint8_t cfis[0x40];
+  holy_uint8_t command[0x10];
+  holy_uint8_t reserved[0x30];
+  struct holy_ahci_prdt_entry prdt[holy_AHCI_QUEUED_MAX_FRAGS];
+};
+
 struct holy_ahci_hba_port
 {
   holy_uint64_t command_list_base;
@@ -88,8 +100,15 @@ struct holy_ahci_received_fis
 
 enum
   {
-    holy_AHCI_HBA_CAP_NPORTS_MASK = 0x1f
+    holy_AHCI_HBA_CAP_NPORTS_MASK = 0x1f,
+    holy_AHCI_HBA_CAP_SNCQ = 0x40000000
   };
+#define holy_AHCI_HBA_CAP_NCS_SHIFT 8
+#define holy_AHCI_HBA_CAP_NCS_MASK 0x1f
+
+/* Task file, host bus data, host bus fatal and interface fatal
+   errors.  */
+#define holy_AHCI_HBA_PORT_IS_ERRORS 0x78000000
 
 enum
   {
@@ -107,6 +126,21 @@ enum
   };
 
 
+/* Native command queuing: queue slots 1 to holy_AHCI_MAX_QUEUED, slot 0
+   being the one for non-queued commands.  The slots share a pool of
+   bounce fragments.  */
+#define holy_AHCI_MAX_QUEUED 8
+#define holy_AHCI_NFRAGS 32
+#define holy_AHCI_FRAG_SIZE 0x10000
+
+struct holy_ahci_queued_cmd
+{
+  char *dest;
+  holy_size_t len;
+  /* Fragments holding the data, in the order of the PRDT.  */
+  holy_uint32_t frags;
+};
+
 struct holy_ahci_device
 {
   struct holy_ahci_device *next;
@@ -121,6 +155,18 @@ struct holy_ahci_device
   struct holy_pci_dma_chunk *rfis;
   int present;
   int atapi;
+  /* Cleared after a queued command fails; the device then gets
+     non-queued commands only.  */
+  int ncq;
+  unsigned ncq_slots;
+  struct holy_pci_dma_chunk *queued_table_chunk;
+  volatile struct holy_ahci_queued_table *queued_tables;
+  struct holy_pci_dma_chunk *frags[holy_AHCI_NFRAGS];
+  holy_uint32_t free_frags;
+  holy_uint32_t busy_slots;
+  struct holy_ahci_queued_cmd queued[holy_AHCI_MAX_QUEUED + 1];
+  /* Set when queued commands failed, until read_wait reports it.  */
+  int queue_failed;
 };
 
 static holy_err_t
@@ -152,6 +198,86 @@ enum
 static struct holy_ahci_device *holy_ahci_devices;
 static int numdevs;
 
+static void
+holy_ahci_free_queue (struct holy_ahci_device *dev)
+{
+  unsigned i;
+
+  if (dev->queued_table_chunk)
+    holy_dma_free (dev->queued_table_chunk);
+  dev->queued_table_chunk = NULL;
+  for (i = 0; i < holy_AHCI_NFRAGS; i++)
+    if (dev->frags[i])
+      {
+	holy_dma_free (dev->frags[i]);
+	dev->frags[i] = NULL;
+      }
+  dev->ncq = 0;
+  dev->busy_slots = 0;
+  dev->free_frags = 0;
+}
+
+/* Note whether the controller can queue commands on DEV.  The memory for
+   it is left to holy_ahci_alloc_queue.  */
+static void
+holy_ahci_init_queue (struct holy_ahci_device *dev)
+{
+  holy_uint32_t cap = dev->hba->cap;
+
+  dev->ncq = 0;
+  dev->busy_slots = 0;
+  dev->free_frags = 0;
+  dev->queue_failed = 0;
+  if (dev->atapi || ! (cap & holy_AHCI_HBA_CAP_SNCQ))
+    return;
+
+  /* NCS is the highest slot number.  */
+  dev->ncq_slots = ((cap >> holy_AHCI_HBA_CAP_NCS_SHIFT)
+		    & holy_AHCI_HBA_CAP_NCS_MASK);
+  if (dev->ncq_slots > holy_AHCI_MAX_QUEUED)
+    dev->ncq_slots = holy_AHCI_MAX_QUEUED;
+  if (! dev->ncq_slots)
+    return;
+  dev->ncq = 1;
+}
+
+/* Allocate the command tables and bounce fragments for queuing.  This
+   waits for the first queued read, that is for IDENTIFY to report NCQ,
+   so that ports whose disks can't queue don't hold 2 MiB of DMA memory
+   each.  Without the memory the device is simply driven one command at a
+   time.  */
+static void
+holy_ahci_alloc_queue (struct holy_ahci_device *dev)
+{
+  unsigned i;
+
+  if (dev->queued_table_chunk)
+    return;
+
+  dev->queued_table_chunk
+    = holy_memalign_dma32 (128, dev->ncq_slots
+			   * sizeof (struct holy_ahci_queued_table));
+  if (! dev->queued_table_chunk)
+    goto fail;
+  dev->queued_tables = holy_dma_get_virt (dev->queued_table_chunk);
+  holy_memset ((void *) dev->queued_tables, 0,
+	       dev->ncq_slots * sizeof (struct holy_ahci_queued_table));
+
+  for (i = 0; i < holy_AHCI_NFRAGS; i++)
+    {
+      dev->frags[i] = holy_memalign_dma32 (4096, holy_AHCI_FRAG_SIZE);
+      if (! dev->frags[i])
+	goto fail;
+      dev->free_frags |= 1U << i;
+    }
+  return;
+
+ fail:
+  holy_dprintf ("ahci", "no memory for queuing on port %d\n", dev->port);
+  holy_errno = holy_ERR_NONE;
+  holy_ahci_free_queue (dev);
+}
+
 static int
 holy_ahci_pciinit (holy_pci_device_t dev,
 		   holy_pci_id_t pciid __attribute__ ((unused)),
@@ -625,6 +751,7 @@ holy_ahci_pciinit (holy_pci_device_t dev,
   for (i = 0; i < nports; i++)
     if (adevs[i])
       {
+	holy_ahci_init_queue (adevs[i]);
 	holy_list_push (holy_AS_LIST_P (&holy_ahci_devices),
 			holy_AS_LIST (adevs[i]));
       }
@@ -668,6 +795,7 @@ holy_ahci_fini_hw (int noreturn __attribute__ ((unused)))
       holy_dma_free (dev->command_list_chunk);
       holy_dma_free (dev->command_table_chunk);
       holy_dma_free (dev->rfis);
+      holy_ahci_free_queue (dev);
       dev->command_list_chunk = NULL;
       dev->command_table_chunk = NULL;
       dev->rfis = NULL;
@@ -682,7 +810,8 @@ reinit_port (struct holy_ahci_device *dev)
   struct holy_pci_dma_chunk *command_table;
   holy_uint64_t endtime;
 
-  command_list = holy_memalign_dma32 (1024, sizeof (struct holy_ahci_cmd_head));
+  command_list = holy_memalign_dma32 (1024,
+				      sizeof (struct holy_ahci_cmd_head) * 32);
   if (!command_list)
     return 1;
 
@@ -750,6 +879,8 @@ reinit_port (struct holy_ahci_device *dev)
   dev->command_list->command_table_base
     = holy_dma_get_phys (command_table);
 
+  holy_ahci_init_queue (dev);
+
   return 0;
  out_stop_fr:
   dev->hba->ports[dev->port].command &= ~holy_AHCI_HBA_PORT_CMD_FRE;
@@ -1063,12 +1194,278 @@ holy_ahci_readwrite_real (struct holy_ahci_device *dev,
   return err;
 }
 
+/* Give up on every queued command, reset the port and stop queuing on
+   it.  */
+static holy_err_t
+holy_ahci_queue_fail (struct holy_ahci_device *dev, const char *why)
+{
+  volatile struct holy_ahci_hba_port *port = &dev->hba->ports[dev->port];
+
+  holy_dprintf ("ahci", "queued command %s <%x %x %x %x %x>\n", why,
+		dev->busy_slots, port->sata_active, port->command_issue,
+		port->intstatus, port->task_file_data);
+  dev->ncq = 0;
+  dev->busy_slots = 0;
+  dev->free_frags = (holy_uint32_t) ((1ULL << holy_AHCI_NFRAGS) - 1);
+  dev->queue_failed = 1;
+  holy_ahci_reset_port (dev, 1);
+  return holy_error (holy_ERR_READ_ERROR, "AHCI queued read %s", why);
+}
+
+/* Copy out the data of the queued commands that are done.  */
+static holy_err_t
+holy_ahci_queue_poll (struct holy_ahci_device *dev)
+{
+  volatile struct holy_ahci_hba_port *port = &dev->hba->ports[dev->port];
+  holy_uint32_t done;
+  unsigned tag, i;
+
+  /* The device clears the SActive bit of a command when it sends the Set
+     Device Bits FIS for it, after all of its data.  */
+  done = dev->busy_slots & ~port->sata_active;
+  for (tag = 1; done; tag++)
+    if (done & (1U << tag))
+      {
+	struct holy_ahci_queued_cmd *q = &dev->queued[tag];
+	char *dest = q->dest;
+	holy_size_t left = q->len;
+
+	for (i = 0; left; i++)
+	  if (q->frags & (1U << i))
+	    {
+	      holy_size_t n = left < holy_AHCI_FRAG_SIZE
+		? left : holy_AHCI_FRAG_SIZE;
+	      holy_memcpy (dest, (char *) holy_dma_get_virt (dev->frags[i]), n);
+	      dest += n;
+	      left -= n;
+	    }
+	dev->free_frags |= q->frags;
+	dev->busy_slots &= ~(1U << tag);
+	done &= ~(1U << tag);
+      }
+
+  if (dev->busy_slots && (port->intstatus & holy_AHCI_HBA_PORT_IS_ERRORS))
+    return holy_ahci_queue_fail (dev, "failed");
+  return holy_ERR_NONE;
+}
+
+/* Wait for every queued command.  */
+static holy_err_t
+holy_ahci_queue_drain (struct holy_ahci_device *dev)
+{
+  holy_uint64_t endtime = holy_get_time_ms () + holy_ATA_TOUT_DATA;
+  holy_uint32_t busy = dev->busy_slots;
+  holy_err_t err;
+
+  while (dev->busy_slots)
+    {
+      err = holy_ahci_queue_poll (dev);
+      if (err)
+	return err;
+      if (dev->busy_slots != busy)
+	{
+	  busy = dev->busy_slots;
+	  endtime = holy_get_time_ms () + holy_ATA_TOUT_DATA;
+	}
+      else if (holy_get_time_ms () > endtime)
+	return holy_ahci_queue_fail (dev, "timed out");
+    }
+  return holy_ERR_NONE;
+}
+
+/* The first N free fragments, or 0 if there are fewer.  */
+static holy_uint32_t
+holy_ahci_take_frags (holy_uint32_t free, unsigned n)
+{
+  holy_uint32_t taken = 0;
+  unsigned i;
+
+  for (i = 0; n && i < holy_AHCI_NFRAGS; i++)
+    if (free & (1U << i))
+      {
+	taken |= 1U << i;
+	n--;
+      }
+  return n ? 0 : taken;
+}
+
+/* Read without queuing, for a device whose queuing was turned off after
+   an error.  Queuing devices always have LBA48.  */
+static holy_err_t
+holy_ahci_read_unqueued (struct holy_ata *ata, holy_disk_addr_t sector,
+			 holy_size_t size, char *buf)
+{
+  holy_size_t max = holy_AHCI_PRDT_MAX_CHUNK_LENGTH >> ata->log_sector_size;
+
+  if (max > 65535)
+    max = 65535;
+  while (size)
+    {
+      struct holy_disk_ata_pass_through_parms parms;
+      holy_size_t n = size < max ? size : max;
+      holy_err_t err;
+
+      holy_memset (&parms, 0, sizeof (parms));
+      parms.taskfile.disk = 0xE0;
+      parms.taskfile.sectors = n & 0xff;
+      parms.taskfile.sectors48 = n >> 8;
+      parms.taskfile.lba_low = sector & 0xff;
+      parms.taskfile.lba_mid = (sector >> 8) & 0xff;
+      parms.taskfile.lba_high = (sector >> 16) & 0xff;
+      parms.taskfile.lba48_low = (sector >> 24) & 0xff;
+      parms.taskfile.lba48_mid = (sector >> 32) & 0xff;
+      parms.taskfile.lba48_high = (sector >> 40) & 0xff;
+      parms.taskfile.cmd = holy_ATA_CMD_READ_SECTORS_DMA_EXT;
+      parms.buffer = buf;
+      parms.size = n << ata->log_sector_size;
+      parms.dma = 1;
+      err = holy_ahci_readwrite_real (ata->data, &parms, 0, 0);
+      if (err)
+	return err;
+      sector += n;
+      size -= n;
+      buf += n << ata->log_sector_size;
+    }
+  return holy_ERR_NONE;
+}
+
+static holy_err_t
+holy_ahci_read_submit (struct holy_ata *ata, holy_disk_addr_t sector,
+		       holy_size_t size, char *buf)
+{
+  struct holy_ahci_device *dev = ata->data;
+  volatile struct holy_ahci_hba_port *port = &dev->hba->ports[dev->port];
+  holy_size_t max = ((holy_AHCI_QUEUED_MAX_FRAGS * holy_AHCI_FRAG_SIZE)
+		     >> ata->log_sector_size);
+  /* Tags must be below the device's queue depth.  */
+  unsigned last = dev->ncq_slots;
+
+  if (ata->queue_depth - 1 < last)
+    last = ata->queue_depth - 1;
+  if (dev->ncq && last)
+    holy_ahci_alloc_queue (dev);
+
+  while (size)
+    {
+      volatile struct holy_ahci_queued_table *table;
+      holy_size_t n = size < max ? size : max;
+      holy_size_t len = n << ata->log_sector_size, left;
+      unsigned nfrags = ALIGN_UP (len, holy_AHCI_FRAG_SIZE)
+	/ holy_AHCI_FRAG_SIZE;
+      holy_uint64_t endtime = holy_get_time_ms () + holy_ATA_TOUT_DATA;
+      holy_uint32_t frags;
+      unsigned tag, i, j;
+      holy_err_t err;
+
+      if (! dev->ncq || ! last)
+	return holy_ahci_read_unqueued (ata, sector, size, buf);
+
+      /* Wait for a slot and enough fragments.  */
+      while (1)
+	{
+	  err = holy_ahci_queue_poll (dev);
+	  if (err)
+	    return err;
+	  for (tag = 1; tag <= last; tag++)
+	    if (! (dev->busy_slots & (1U << tag)))
+	      break;
+	  frags = holy_ahci_take_frags (dev->free_frags, nfrags);
+	  if (tag <= last && frags)
+	    break;
+	  if (holy_get_time_ms () > endtime)
+	    return holy_ahci_queue_fail (dev, "timed out");
+	}
+
+      if (! dev->busy_slots)
+	{
+	  port->intstatus = ~0;
+	  port->sata_error = port->sata_error;
+	}
+
+      table = &dev->queued_tables[tag - 1];
+      holy_memset ((char *) table, 0, sizeof (*table));
+      for (i = 0, j = 0, left = len; left; i++)
+	if (frags & (1U << i))
+	  {
+	    holy_size_t chunk = left < holy_AHCI_FRAG_SIZE
+	      ? left : holy_AHCI_FRAG_SIZE;
+	    table->prdt[j].data_base = holy_dma_get_phys (dev->frags[i]);
+	    table->prdt[j].size = chunk - 1;
+	    j++;
+	    left -= chunk;
+	  }
+
+      /* READ FPDMA QUEUED: the count goes in the features registers and
+	 the tag in bits 7:3 of the count.  */
+      table->cfis[0] = holy_AHCI_FIS_REG_H2D;
+      table->cfis[1] = 0x80;
+      table->cfis[2] = holy_ATA_CMD_READ_FPDMA_QUEUED;
+      table->cfis[3] = n & 0xff;
+      table->cfis[4] = sector & 0xff;
+      table->cfis[5] = (sector >> 8) & 0xff;
+      table->cfis[6] = (sector >> 16) & 0xff;
+      table->cfis[7] = 0x40;
+      table->cfis[8] = (sector >> 24) & 0xff;
+      table->cfis[9] = (sector >> 32) & 0xff;
+      table->cfis[10] = (sector >> 40) & 0xff;
+      table->cfis[11] = (n >> 8) & 0xff;
+      table->cfis[12] = tag << 3;
+
+      dev->command_list[tag].config
+	= (5 << holy_AHCI_CONFIG_CFIS_LENGTH_SHIFT)
+	| (nfrags << holy_AHCI_CONFIG_PRDT_LENGTH_SHIFT);
+      dev->command_list[tag].transferred = 0;
+      dev->command_list[tag].command_table_base
+	= holy_dma_get_phys (dev->queued_table_chunk)
+	+ (tag - 1) * sizeof (struct holy_ahci_queued_table);
+
+      dev->queued[tag].dest = buf;
+      dev->queued[tag].len = len;
+      dev->queued[tag].frags = frags;
+      dev->free_frags &= ~frags;
+      dev->busy_slots |= 1U << tag;
+
+      __asm__ __volatile__ ("" : : : "memory");
+      port->sata_active = 1U << tag;
+      port->command_issue = 1U << tag;
+
+      sector += n;
+      size -= n;
+      buf += len;
+    }
+
+  return holy_ERR_NONE;
+}
+
+static holy_err_t
+holy_ahci_read_wait (struct holy_ata *ata)
+{
+  struct holy_ahci_device *dev = ata->data;
+  holy_err_t err;
+
+  err = holy_ahci_queue_drain (dev);
+  if (dev->queue_failed)
+    {
+      dev->queue_failed = 0;
+      if (! err)
+	err = holy_error (holy_ERR_READ_ERROR, "AHCI queued read failed");
+    }
+  return err;
+}
+
 static holy_err_t
 holy_ahci_readwrite (holy_ata_t disk,
 		     struct holy_disk_ata_pass_through_parms *parms,
 		     int spinup)
 {
-  return holy_ahci_readwrite_real (disk->data, parms, spinup, 0);
+  struct holy_ahci_device *dev = disk->data;
+
+  /* Queued and non-queued commands can't be mixed; a failure here is
+     left for read_wait to report.  */
+  if (dev->busy_slots && holy_ahci_queue_drain (dev))
+    holy_errno = holy_ERR_NONE;
+
+  return holy_ahci_readwrite_real (dev, parms, spinup, 0);
 }
 
 static holy_err_t
@@ -1092,6 +1489,8 @@ holy_ahci_open (int id, int devnum, struct holy_ata *ata)
   ata->dma = 1;
   ata->atapi = dev->atapi;
   ata->maxbuffer = holy_AHCI_PRDT_MAX_CHUNK_LENGTH;
+  /* Tag 0 stays with non-queued commands.  */
+  ata->queue_depth = dev->ncq ? dev->ncq_slots + 1 : 0;
   ata->present = &dev->present;
 
   return holy_ERR_NONE;
@@ -1102,6 +1501,8 @@ static struct holy_ata_dev holy_ahci_dev =
     .iterate = holy_ahci_iterate,
     .open = holy_ahci_open,
     .readwrite = holy_ahci_readwrite,
+    .read_submit = holy_ahci_read_submit,
+    .read_wait = holy_ahci_read_wait,
   };
 
 
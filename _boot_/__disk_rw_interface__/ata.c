@@ -77,6 +77,7 @@ holy_atapi_identify (struct holy_ata *dev)
     }
 
   dev->atapi = 1;
+  dev->queue_depth = 0;
 
   holy_ata_dumpinfo (dev, info);
 
@@ -154,6 +155,13 @@ holy_ata_identify (struct holy_ata *dev)
 	dev->addr = holy_ATA_LBA;
     }
 
+  /* Native command queuing needs LBA48 and the controller's queue.  */
+  if (dev->addr != holy_ATA_LBA48 || ! dev->dev->read_submit
+      || ! (info16[76] & holy_cpu_to_le16_compile_time ((1 << 8))))
+    dev->queue_depth = 0;
+  else if (dev->queue_depth > (holy_le_to_cpu16 (info16[75]) & 0x1f) + 1U)
+    dev->queue_depth = (holy_le_to_cpu16 (info16[75]) & 0x1f) + 1;
+
   /* Determine the amount of sectors.  */
   if (dev->addr != holy_ATA_LBA48)
     dev->size = holy_le_to_cpu32 (info32[30]);
@@ -457,7 +465,10 @@ holy_ata_open (const char *name, holy_disk_t disk)
 
   disk->total_sectors = ata->size;
   disk->max_agglomerate = (ata->maxbuffer >> (holy_DISK_CACHE_BITS + holy_DISK_SECTOR_BITS));
-  if (disk->max_agglomerate > (256U >> (holy_DISK_CACHE_BITS + holy_DISK_SECTOR_BITS - ata->log_sector_size)))
+  /* Queued commands are not limited to 256 sectors, and larger reads keep
+     more of them in flight.  */
+  if (! ata->queue_depth
+      && disk->max_agglomerate > (256U >> (holy_DISK_CACHE_BITS + holy_DISK_SECTOR_BITS - ata->log_sector_size)))
     disk->max_agglomerate = (256U >> (holy_DISK_CACHE_BITS + holy_DISK_SECTOR_BITS - ata->log_sector_size));
 
   disk->log_sector_size = ata->log_sector_size;
@@ -476,11 +487,40 @@ holy_ata_close (holy_disk_t disk)
   holy_ata_real_close (ata);
 }
 
+static holy_err_t
+holy_ata_read_submit (holy_disk_t disk, holy_disk_addr_t sector,
+		      holy_size_t size, char *buf)
+{
+  struct holy_ata *ata = disk->data;
+
+  if (! ata->queue_depth)
+    return holy_ata_readwrite (disk, sector, size, buf, 0);
+  return ata->dev->read_submit (ata, sector, size, buf);
+}
+
+static holy_err_t
+holy_ata_read_wait (holy_disk_t disk)
+{
+  struct holy_ata *ata = disk->data;
+
+  if (! ata->queue_depth)
+    return holy_ERR_NONE;
+  return ata->dev->read_wait (ata);
+}
+
 static holy_err_t
 holy_ata_read (holy_disk_t disk, holy_disk_addr_t sector,
 	       holy_size_t size, char *buf)
 {
-  return holy_ata_readwrite (disk, sector, size, buf, 0);
+  struct holy_ata *ata = disk->data;
+  holy_err_t err, werr;
+
+  if (! ata->queue_depth)
+    return holy_ata_readwrite (disk, sector, size, buf, 0);
+
+  err = ata->dev->read_submit (ata, sector, size, buf);
+  werr = ata->dev->read_wait (ata);
+  return err ? err : werr;
 }
 
 static holy_err_t
@@ -501,6 +541,8 @@ static struct holy_disk_dev holy_atadisk_dev =
     .close = holy_ata_close,
     .read = holy_ata_read,
     .write = holy_ata_write,
+    .read_submit = holy_ata_read_submit,
+    .read_wait = holy_ata_read_wait,
     .next = 0
   };
 
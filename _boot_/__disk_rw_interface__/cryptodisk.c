@@ -208,42 +208,54 @@ lrw_xor (const struct lrw_sector *sec,
 		   dev->lrw_precalc, sec->low_byte * holy_CRYPTODISK_GF_BYTES);
 }
 
-static gcry_err_code_t
-holy_cryptodisk_endecrypt (struct holy_cryptodisk *dev,
-			   holy_uint8_t * data, holy_size_t len,
-			   holy_disk_addr_t sector, int do_encrypt)
+/* Whether the AES code can do the bulk of the work for DEV.  */
+static int
+cryptodisk_use_aes (const struct holy_cryptodisk *dev)
 {
-  holy_size_t i;
-  gcry_err_code_t err;
-
-  if (dev->cipher->cipher->blocksize > holy_CRYPTO_MAX_CIPHER_BLOCKSIZE)
-    return GPG_ERR_INV_ARG;
+  return (dev->cipher->cipher->blocksize == holy_AES_BLOCK_SIZE
+	  && holy_strncmp (dev->cipher->cipher->name, "AES", 3) == 0
+	  && (dev->mode == holy_CRYPTODISK_MODE_ECB
+	      || dev->mode == holy_CRYPTODISK_MODE_CBC
+	      || dev->mode == holy_CRYPTODISK_MODE_XTS));
+}
 
-  /* The only mode without IV.  */
-  if (dev->mode == holy_CRYPTODISK_MODE_ECB && !dev->rekey)
-    return (do_encrypt ? holy_crypto_ecb_encrypt (dev->cipher, data, data, len)
-	    : holy_crypto_ecb_decrypt (dev->cipher, data, data, len));
+/* Sectors whose IVs are computed together, before any data is touched.  */
+#define IV_BATCH 64
 
-  for (i = 0; i < len; i += (1U << dev->log_sector_size))
+/* Allocate the scratch space endecrypt needs, once per device.  */
+static gcry_err_code_t
+cryptodisk_alloc_scratch (struct holy_cryptodisk *dev)
+{
+  if (!dev->ivs)
+    dev->ivs = holy_malloc (IV_BATCH * holy_CRYPTO_MAX_CIPHER_BLOCKSIZE);
+  if (!dev->ivs)
+    return GPG_ERR_OUT_OF_MEMORY;
+  if (dev->mode_iv == holy_CRYPTODISK_MODE_IV_BYTECOUNT64_HASH
+      && !dev->iv_hash_ctx)
     {
-      holy_size_t sz = ((dev->cipher->cipher->blocksize
-			 + sizeof (holy_uint32_t) - 1)
-			/ sizeof (holy_uint32_t));
-      holy_uint32_t iv[(holy_CRYPTO_MAX_CIPHER_BLOCKSIZE + 3) / 4];
+      dev->iv_hash_ctx = holy_zalloc (dev->iv_hash->contextsize);
+      if (!dev->iv_hash_ctx)
+	return GPG_ERR_OUT_OF_MEMORY;
+    }
+  return GPG_ERR_NO_ERROR;
+}
 
-      if (dev->rekey)
-	{
-	  holy_uint64_t zone = sector >> dev->rekey_shift;
-	  if (zone != dev->last_rekey)
-	    {
-	      err = dev->rekey (dev, zone);
-	      if (err)
-		return err;
-	      dev->last_rekey = zone;
-	    }
-	}
+/* Compute the IVs of the NSEC sectors starting at SECTOR into dev->ivs,
+   one cipher block apart.  For XTS they are also encrypted with the tweak
+   key, so that every IV is ready to use.  */
+static gcry_err_code_t
+cryptodisk_make_ivs (struct holy_cryptodisk *dev, holy_disk_addr_t sector,
+		     unsigned nsec)
+{
+  holy_size_t bs = dev->cipher->cipher->blocksize;
+  holy_size_t sz = (bs + sizeof (holy_uint32_t) - 1) / sizeof (holy_uint32_t);
+  holy_uint32_t *iv;
+  unsigned k;
 
-      holy_memset (iv, 0, sizeof (iv));
+  holy_memset (dev->ivs, 0, nsec * bs);
+  for (k = 0; k < nsec; k++, sector++)
+    {
+      iv = (holy_uint32_t *) (dev->ivs + k * bs);
       switch (dev->mode_iv)
 	{
 	case holy_CRYPTODISK_MODE_IV_NULL:
@@ -251,11 +263,7 @@ holy_cryptodisk_endecrypt (struct holy_cryptodisk *dev,
 	case holy_CRYPTODISK_MODE_IV_BYTECOUNT64_HASH:
 	  {
 	    holy_uint64_t tmp;
-	    void *ctx;
-
-	    ctx = holy_zalloc (dev->iv_hash->contextsize);
-	    if (!ctx)
-	      return GPG_ERR_OUT_OF_MEMORY;
+	    void *ctx = dev->iv_hash_ctx;
 
 	    tmp = holy_cpu_to_le64 (sector << dev->log_sector_size);
 	    dev->iv_hash->init (ctx);
@@ -263,15 +271,23 @@ holy_cryptodisk_endecrypt (struct holy_cryptodisk *dev,
 	    dev->iv_hash->write (ctx, &tmp, sizeof (tmp));
 	    dev->iv_hash->final (ctx);
 
-	    holy_memcpy (iv, dev->iv_hash->read (ctx), sizeof (iv));
-	    holy_free (ctx);
+	    holy_memcpy (iv, dev->iv_hash->read (ctx),
+			 holy_min (bs, dev->iv_hash->mdlen));
 	  }
 	  break;
 	case holy_CRYPTODISK_MODE_IV_PLAIN64:
-	  iv[1] = holy_cpu_to_le32 (sector >> 32);
-	  /* FALLTHROUGH */
 	case holy_CRYPTODISK_MODE_IV_PLAIN:
-	  iv[0] = holy_cpu_to_le32 (sector & 0xFFFFFFFF);
+	case holy_CRYPTODISK_MODE_IV_ESSIV:
+	  {
+	    /* dm-crypt counts these in 512-byte units, even on volumes with
+	       larger sectors.  */
+	    holy_uint64_t num = sector << (dev->log_sector_size
+					   - holy_DISK_SECTOR_BITS);
+
+	    iv[0] = holy_cpu_to_le32 (num & 0xFFFFFFFF);
+	    if (dev->mode_iv == holy_CRYPTODISK_MODE_IV_PLAIN64)
+	      iv[1] = holy_cpu_to_le32 (num >> 32);
+	  }
 	  break;
 	case holy_CRYPTODISK_MODE_IV_BYTECOUNT64:
 	  iv[1] = holy_cpu_to_le32 (sector >> (32 - dev->log_sector_size));
@@ -285,100 +301,208 @@ holy_cryptodisk_endecrypt (struct holy_cryptodisk *dev,
 	    iv[sz - 1] = holy_cpu_to_be32 (num & 0xFFFFFFFF);
 	  }
 	  break;
-	case holy_CRYPTODISK_MODE_IV_ESSIV:
-	  iv[0] = holy_cpu_to_le32 (sector & 0xFFFFFFFF);
-	  err = holy_crypto_ecb_encrypt (dev->essiv_cipher, iv, iv,
-					 dev->cipher->cipher->blocksize);
-	  if (err)
-	    return err;
 	}
+    }
+
+  /* The IVs are independent blocks, so one ECB call does them all.  */
+  if (dev->mode_iv == holy_CRYPTODISK_MODE_IV_ESSIV)
+    {
+      gcry_err_code_t err;
+
+      err = holy_crypto_ecb_encrypt (dev->essiv_cipher, dev->ivs, dev->ivs,
+				     nsec * bs);
+      if (err)
+	return err;
+    }
 
-      switch (dev->mode)
+  if (dev->mode == holy_CRYPTODISK_MODE_XTS)
+    {
+      if (dev->aes)
+	holy_aes_ecb_encrypt (&dev->aes[1], dev->ivs, dev->ivs, nsec);
+      else
+	return holy_crypto_ecb_encrypt (dev->secondary_cipher, dev->ivs,
+					dev->ivs, nsec * bs);
+    }
+  return GPG_ERR_NO_ERROR;
+}
+
+static gcry_err_code_t
+holy_cryptodisk_endecrypt (struct holy_cryptodisk *dev,
+			   holy_uint8_t * data, holy_size_t len,
+			   holy_disk_addr_t sector, int do_encrypt)
+{
+  holy_size_t i, bs = dev->cipher->cipher->blocksize;
+  holy_size_t sector_size = 1U << dev->log_sector_size;
+  gcry_err_code_t err;
+
+  if (bs > holy_CRYPTO_MAX_CIPHER_BLOCKSIZE)
+    return GPG_ERR_INV_ARG;
+
+  /* The only mode without IV.  */
+  if (dev->mode == holy_CRYPTODISK_MODE_ECB && !dev->rekey)
+    {
+      if (dev->aes)
 	{
-	case holy_CRYPTODISK_MODE_CBC:
 	  if (do_encrypt)
-	    err = holy_crypto_cbc_encrypt (dev->cipher, data + i, data + i,
-					   (1U << dev->log_sector_size), iv);
+	    holy_aes_ecb_encrypt (dev->aes, data, data,
+				  len / holy_AES_BLOCK_SIZE);
 	  else
-	    err = holy_crypto_cbc_decrypt (dev->cipher, data + i, data + i,
-					   (1U << dev->log_sector_size), iv);
-	  if (err)
-	    return err;
-	  break;
+	    holy_aes_ecb_decrypt (dev->aes, data, data,
+				  len / holy_AES_BLOCK_SIZE);
+	  return GPG_ERR_NO_ERROR;
+	}
+      return (do_encrypt
+	      ? holy_crypto_ecb_encrypt (dev->cipher, data, data, len)
+	      : holy_crypto_ecb_decrypt (dev->cipher, data, data, len));
+    }
 
-	case holy_CRYPTODISK_MODE_PCBC:
-	  if (do_encrypt)
-	    err = holy_crypto_pcbc_encrypt (dev->cipher, data + i, data + i,
-					    (1U << dev->log_sector_size), iv);
-	  else
-	    err = holy_crypto_pcbc_decrypt (dev->cipher, data + i, data + i,
-					    (1U << dev->log_sector_size), iv);
-	  if (err)
-	    return err;
-	  break;
-	case holy_CRYPTODISK_MODE_XTS:
-	  {
-	    unsigned j;
-	    err = holy_crypto_ecb_encrypt (dev->secondary_cipher, iv, iv,
-					   dev->cipher->cipher->blocksize);
-	    if (err)
-	      return err;
-	    
-	    for (j = 0; j < (1U << dev->log_sector_size);
-		 j += dev->cipher->cipher->blocksize)
+  err = cryptodisk_alloc_scratch (dev);
+  if (err)
+    return err;
+
+  i = 0;
+  while (i < len)
+    {
+      unsigned nsec, k;
+
+      nsec = holy_min ((len - i + sector_size - 1) >> dev->log_sector_size,
+		       IV_BATCH);
+
+      /* A batch must not cross a rekey boundary, as the IVs of XTS depend
+	 on the key.  */
+      if (dev->rekey)
+	{
+	  holy_uint64_t zone = sector >> dev->rekey_shift;
+	  holy_uint64_t left = ((zone + 1) << dev->rekey_shift) - sector;
+
+	  if (zone != dev->last_rekey)
+	    {
+	      err = dev->rekey (dev, zone);
+	      if (err)
+		return err;
+	      dev->last_rekey = zone;
+	    }
+	  if (nsec > left)
+	    nsec = left;
+	}
+
+      err = cryptodisk_make_ivs (dev, sector, nsec);
+      if (err)
+	return err;
+
+      for (k = 0; k < nsec; k++, i += sector_size, sector++)
+	{
+	  holy_uint8_t *iv = dev->ivs + k * bs;
+
+	  if (dev->aes)
+	    {
+	      holy_size_t nblocks = sector_size / holy_AES_BLOCK_SIZE;
+
+	      switch (dev->mode)
+		{
+		case holy_CRYPTODISK_MODE_CBC:
+		  if (do_encrypt)
+		    holy_aes_cbc_encrypt (dev->aes, data + i, data + i,
+					  nblocks, iv);
+		  else
+		    holy_aes_cbc_decrypt (dev->aes, data + i, data + i,
+					  nblocks, iv);
+		  break;
+		case holy_CRYPTODISK_MODE_XTS:
+		  if (do_encrypt)
+		    holy_aes_xts_encrypt (dev->aes, data + i, data + i,
+					  nblocks, iv);
+		  else
+		    holy_aes_xts_decrypt (dev->aes, data + i, data + i,
+					  nblocks, iv);
+		  break;
+		default:
+		  if (do_encrypt)
+		    holy_aes_ecb_encrypt (dev->aes, data + i, data + i,
+					  nblocks);
+		  else
+		    holy_aes_ecb_decrypt (dev->aes, data + i, data + i,
+					  nblocks);
+		  break;
+		}
+	      continue;
+	    }
+
+	  switch (dev->mode)
+	    {
+	    case holy_CRYPTODISK_MODE_CBC:
+	      if (do_encrypt)
+		err = holy_crypto_cbc_encrypt (dev->cipher, data + i,
+					       data + i, sector_size, iv);
+	      else
+		err = holy_crypto_cbc_decrypt (dev->cipher, data + i,
+					       data + i, sector_size, iv);
+	      if (err)
+		return err;
+	      break;
+
+	    case holy_CRYPTODISK_MODE_PCBC:
+	      if (do_encrypt)
+		err = holy_crypto_pcbc_encrypt (dev->cipher, data + i,
+						data + i, sector_size, iv);
+	      else
+		err = holy_crypto_pcbc_decrypt (dev->cipher, data + i,
+						data + i, sector_size, iv);
+	      if (err)
+		return err;
+	      break;
+	    case holy_CRYPTODISK_MODE_XTS:
+	      {
+		unsigned j;
+
+		for (j = 0; j < sector_size; j += bs)
+		  {
+		    holy_crypto_xor (data + i + j, data + i + j, iv, bs);
+		    if (do_encrypt)
+		      err = holy_crypto_ecb_encrypt (dev->cipher, data + i + j,
+						     data + i + j, bs);
+		    else
+		      err = holy_crypto_ecb_decrypt (dev->cipher, data + i + j,
+						     data + i + j, bs);
+		    if (err)
+		      return err;
+		    holy_crypto_xor (data + i + j, data + i + j, iv, bs);
+		    gf_mul_x (iv);
+		  }
+	      }
+	      break;
+	    case holy_CRYPTODISK_MODE_LRW:
 	      {
-		holy_crypto_xor (data + i + j, data + i + j, iv,
-				 dev->cipher->cipher->blocksize);
+		struct lrw_sector sec;
+
+		generate_lrw_sector (&sec, dev, iv);
+		lrw_xor (&sec, dev, data + i);
+
 		if (do_encrypt)
-		  err = holy_crypto_ecb_encrypt (dev->cipher, data + i + j,
-						 data + i + j,
-						 dev->cipher->cipher->blocksize);
+		  err = holy_crypto_ecb_encrypt (dev->cipher, data + i,
+						 data + i, sector_size);
 		else
-		  err = holy_crypto_ecb_decrypt (dev->cipher, data + i + j,
-						 data + i + j,
-						 dev->cipher->cipher->blocksize);
+		  err = holy_crypto_ecb_decrypt (dev->cipher, data + i,
+						 data + i, sector_size);
 		if (err)
 		  return err;
-		holy_crypto_xor (data + i + j, data + i + j, iv,
-				 dev->cipher->cipher->blocksize);
-		gf_mul_x ((holy_uint8_t *) iv);
+		lrw_xor (&sec, dev, data + i);
 	      }
-	  }
-	  break;
-	case holy_CRYPTODISK_MODE_LRW:
-	  {
-	    struct lrw_sector sec;
-
-	    generate_lrw_sector (&sec, dev, (holy_uint8_t *) iv);
-	    lrw_xor (&sec, dev, data + i);
-
-	    if (do_encrypt)
-	      err = holy_crypto_ecb_encrypt (dev->cipher, data + i,
-					     data + i,
-					     (1U << dev->log_sector_size));
-	    else
-	      err = holy_crypto_ecb_decrypt (dev->cipher, data + i,
-					     data + i,
-					     (1U << dev->log_sector_size));
-	    if (err)
-	      return err;
-	    lrw_xor (&sec, dev, data + i);
-	  }
-	  break;
-	case holy_CRYPTODISK_MODE_ECB:
-	  if (do_encrypt)
-	    err = holy_crypto_ecb_encrypt (dev->cipher, data + i, data + i,
-					   (1U << dev->log_sector_size));
-	  else
-	    err = holy_crypto_ecb_decrypt (dev->cipher, data + i, data + i,
-					   (1U << dev->log_sector_size));
-	  if (err)
-	    return err;
-	  break;
-	default:
-	  return GPG_ERR_NOT_IMPLEMENTED;
+	      break;
+	    case holy_CRYPTODISK_MODE_ECB:
+	      if (do_encrypt)
+		err = holy_crypto_ecb_encrypt (dev->cipher, data + i, data + i,
+					       sector_size);
+	      else
+		err = holy_crypto_ecb_decrypt (dev->cipher, data + i, data + i,
+					       sector_size);
+	      if (err)
+		return err;
+	      break;
+	    default:
+	      return GPG_ERR_NOT_IMPLEMENTED;
+	    }
 	}
-      sector++;
     }
   return GPG_ERR_NO_ERROR;
 }
@@ -391,6 +515,153 @@ holy_cryptodisk_decrypt (struct holy_cryptodisk *dev,
   return holy_cryptodisk_endecrypt (dev, data, len, sector, 0);
 }
 
+/* Open the ciphers for CIPHERNAME in CIPHERMODE, as in "aes" and
+   "xts-plain64", and make them those of DEV in place of any it had.  */
+holy_err_t
+holy_cryptodisk_setcipher (holy_cryptodisk_t dev, const char *ciphername,
+			   const char *ciphermode)
+{
+  const char *cipheriv = NULL;
+  holy_crypto_cipher_handle_t cipher = NULL, secondary_cipher = NULL;
+  holy_crypto_cipher_handle_t essiv_cipher = NULL;
+  const gcry_md_spec_t *essiv_hash = NULL;
+  const struct gcry_cipher_spec *ciph;
+  holy_cryptodisk_mode_t mode;
+  holy_cryptodisk_mode_iv_t mode_iv = holy_CRYPTODISK_MODE_IV_PLAIN64;
+  int benbi_log = 0;
+
+  ciph = holy_crypto_lookup_cipher_by_name (ciphername);
+  if (!ciph)
+    return holy_error (holy_ERR_FILE_NOT_FOUND, "Cipher %s isn't available",
+		       ciphername);
+
+  /* Configure the cipher used for the bulk data.  */
+  cipher = holy_crypto_cipher_open (ciph);
+  if (!cipher)
+    return holy_errno;
+
+  /* Configure the cipher mode.  */
+  if (holy_strcmp (ciphermode, "ecb") == 0)
+    {
+      mode = holy_CRYPTODISK_MODE_ECB;
+      mode_iv = holy_CRYPTODISK_MODE_IV_PLAIN;
+      cipheriv = NULL;
+    }
+  else if (holy_strcmp (ciphermode, "plain") == 0)
+    {
+      mode = holy_CRYPTODISK_MODE_CBC;
+      mode_iv = holy_CRYPTODISK_MODE_IV_PLAIN;
+      cipheriv = NULL;
+    }
+  else if (holy_memcmp (ciphermode, "cbc-", sizeof ("cbc-") - 1) == 0)
+    {
+      mode = holy_CRYPTODISK_MODE_CBC;
+      cipheriv = ciphermode + sizeof ("cbc-") - 1;
+    }
+  else if (holy_memcmp (ciphermode, "pcbc-", sizeof ("pcbc-") - 1) == 0)
+    {
+      mode = holy_CRYPTODISK_MODE_PCBC;
+      cipheriv = ciphermode + sizeof ("pcbc-") - 1;
+    }
+  else if (holy_memcmp (ciphermode, "xts-", sizeof ("xts-") - 1) == 0)
+    {
+      mode = holy_CRYPTODISK_MODE_XTS;
+      cipheriv = ciphermode + sizeof ("xts-") - 1;
+      secondary_cipher = holy_crypto_cipher_open (ciph);
+      if (!secondary_cipher)
+	goto fail;
+      if (cipher->cipher->blocksize != holy_CRYPTODISK_GF_BYTES)
+	{
+	  holy_error (holy_ERR_BAD_ARGUMENT, "Unsupported XTS block size: %d",
+		      cipher->cipher->blocksize);
+	  goto fail;
+	}
+    }
+  else if (holy_memcmp (ciphermode, "lrw-", sizeof ("lrw-") - 1) == 0)
+    {
+      mode = holy_CRYPTODISK_MODE_LRW;
+      cipheriv = ciphermode + sizeof ("lrw-") - 1;
+      if (cipher->cipher->blocksize != holy_CRYPTODISK_GF_BYTES)
+	{
+	  holy_error (holy_ERR_BAD_ARGUMENT, "Unsupported LRW block size: %d",
+		      cipher->cipher->blocksize);
+	  goto fail;
+	}
+    }
+  else
+    {
+      holy_error (holy_ERR_BAD_ARGUMENT, "Unknown cipher mode: %s",
+		  ciphermode);
+      goto fail;
+    }
+
+  if (cipheriv == NULL);
+  else if (holy_memcmp (cipheriv, "plain", sizeof ("plain") - 1) == 0)
+      mode_iv = holy_CRYPTODISK_MODE_IV_PLAIN;
+  else if (holy_memcmp (cipheriv, "plain64", sizeof ("plain64") - 1) == 0)
+      mode_iv = holy_CRYPTODISK_MODE_IV_PLAIN64;
+  else if (holy_memcmp (cipheriv, "benbi", sizeof ("benbi") - 1) == 0)
+    {
+      if (cipher->cipher->blocksize & (cipher->cipher->blocksize - 1)
+	  || cipher->cipher->blocksize == 0)
+	holy_error (holy_ERR_BAD_ARGUMENT, "Unsupported benbi blocksize: %d",
+		    cipher->cipher->blocksize);
+	/* FIXME should we return an error here? */
+      for (benbi_log = 0; 
+	   (cipher->cipher->blocksize << benbi_log) < holy_DISK_SECTOR_SIZE;
+	   benbi_log++);
+      mode_iv = holy_CRYPTODISK_MODE_IV_BENBI;
+    }
+  else if (holy_memcmp (cipheriv, "null", sizeof ("null") - 1) == 0)
+      mode_iv = holy_CRYPTODISK_MODE_IV_NULL;
+  else if (holy_memcmp (cipheriv, "essiv:", sizeof ("essiv:") - 1) == 0)
+    {
+      const char *hash_str = cipheriv + 6;
+
+      mode_iv = holy_CRYPTODISK_MODE_IV_ESSIV;
+
+      /* Configure the hash and cipher used for ESSIV.  */
+      essiv_hash = holy_crypto_lookup_md_by_name (hash_str);
+      if (!essiv_hash)
+	{
+	  holy_error (holy_ERR_FILE_NOT_FOUND,
+		      "Couldn't load %s hash", hash_str);
+	  goto fail;
+	}
+      essiv_cipher = holy_crypto_cipher_open (ciph);
+      if (!essiv_cipher)
+	goto fail;
+    }
+  else
+    {
+      holy_error (holy_ERR_BAD_ARGUMENT, "Unknown IV mode: %s",
+		  cipheriv);
+      goto fail;
+    }
+
+  holy_crypto_cipher_close (dev->cipher);
+  holy_crypto_cipher_close (dev->secondary_cipher);
+  holy_crypto_cipher_close (dev->essiv_cipher);
+  /* The AES keys belong to the old cipher; setkey makes new ones.  */
+  holy_free (dev->aes);
+  dev->aes = NULL;
+
+  dev->cipher = cipher;
+  dev->secondary_cipher = secondary_cipher;
+  dev->essiv_cipher = essiv_cipher;
+  dev->essiv_hash = essiv_hash;
+  dev->benbi_log = benbi_log;
+  dev->mode = mode;
+  dev->mode_iv = mode_iv;
+  return holy_ERR_NONE;
+
+ fail:
+  holy_crypto_cipher_close (cipher);
+  holy_crypto_cipher_close (secondary_cipher);
+  holy_crypto_cipher_close (essiv_cipher);
+  return holy_errno;
+}
+
 gcry_err_code_t
 holy_cryptodisk_setkey (holy_cryptodisk_t dev, holy_uint8_t *key, holy_size_t keysize)
 {
@@ -452,7 +723,26 @@ holy_cryptodisk_setkey (holy_cryptodisk_t dev, holy_uint8_t *key, holy_size_t ke
 	  gf_mul_be (dev->lrw_precalc + i, idx, dev->lrw_key);
 	}
     }
-  return GPG_ERR_NO_ERROR;
+
+  if (cryptodisk_use_aes (dev))
+    {
+      if (!dev->aes)
+	dev->aes = holy_malloc (2 * sizeof (*dev->aes));
+      if (!dev->aes)
+	return GPG_ERR_OUT_OF_MEMORY;
+      err = holy_aes_set_key (&dev->aes[0], key, real_keysize);
+      if (!err && dev->mode == holy_CRYPTODISK_MODE_XTS)
+	err = holy_aes_set_key (&dev->aes[1], key + real_keysize,
+				keysize / 2);
+      /* Let the generic code deal with it.  */
+      if (err)
+	{
+	  holy_free (dev->aes);
+	  dev->aes = NULL;
+	}
+    }
+
+  return cryptodisk_alloc_scratch (dev);
 }
 
 static int
@@ -803,6 +1093,9 @@ cryptodisk_close (holy_cryptodisk_t dev)
   holy_crypto_cipher_close (dev->cipher);
   holy_crypto_cipher_close (dev->secondary_cipher);
   holy_crypto_cipher_close (dev->essiv_cipher);
+  holy_free (dev->aes);
+  holy_free (dev->ivs);
+  holy_free (dev->iv_hash_ctx);
   holy_free (dev);
 }
 
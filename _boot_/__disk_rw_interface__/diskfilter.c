@@ -562,8 +562,8 @@ validate_segment (struct holy_diskfilter_segment *seg)
 }
 
 static holy_err_t
-read_segment (struct holy_diskfilter_segment *seg, holy_disk_addr_t sector,
-	      holy_size_t size, char *buf)
+read_segment_serial (struct holy_diskfilter_segment *seg,
+		     holy_disk_addr_t sector, holy_size_t size, char *buf)
 {
   holy_err_t err;
   switch (seg->type)
@@ -816,13 +816,19 @@ read_segment (struct holy_diskfilter_segment *seg, holy_disk_addr_t sector,
 		      }
 		    else
 		      {
-			disknr -= seg->node_count;
-			if ((disknr >= p && disknr < p + n)
-			    || (disknr + seg->node_count >= p
-				&& disknr + seg->node_count < p + n))
-			  disknr = p + n;
-			if (disknr >= seg->node_count)
-			  disknr -= seg->node_count;
+			holy_uint32_t q;
+
+			/* The row starts at its first data disk, after P
+			   if it is disk 0, or after Q if that is.  */
+			q = p + (n - 1);
+			if (q >= seg->node_count)
+			  q -= seg->node_count;
+			if (p == 0)
+			  disknr = n;
+			else if (q == 0)
+			  disknr = 1;
+			else
+			  disknr = 0;
 		      }
 		  }
 		else
@@ -837,6 +843,147 @@ read_segment (struct holy_diskfilter_segment *seg, holy_disk_addr_t sector,
     }
 }
 
+/* Member reads handed to the disk layer at once.  */
+#define BATCH_MAX_REQS	64
+
+/* Return the member of SEG, which is striped or RAID4/5/6, that holds
+   data chunk CHUNK, and set *MEMBER_SECTOR to where the chunk starts on
+   it, the same way read_segment_serial finds its first chunk.  */
+static unsigned int
+locate_chunk (const struct holy_diskfilter_segment *seg, holy_uint64_t chunk,
+	      holy_disk_addr_t *member_sector)
+{
+  holy_uint64_t row, disknr, p, n;
+
+  if (seg->type == holy_DISKFILTER_STRIPED)
+    {
+      row = holy_divmod64 (chunk, seg->node_count, &disknr);
+      *member_sector = row * seg->stripe_size;
+      return disknr;
+    }
+
+  /* n = 1 for level 4 and 5, 2 for level 6.  */
+  n = seg->type / 3;
+  row = holy_divmod64 (chunk, seg->node_count - n, &disknr);
+  if (seg->type >= 5)
+    {
+      holy_divmod64 (row, seg->node_count, &p);
+
+      if (! (seg->layout & holy_RAID_LAYOUT_RIGHT_MASK))
+	p = seg->node_count - 1 - p;
+
+      if (seg->layout & holy_RAID_LAYOUT_SYMMETRIC_MASK)
+	disknr += p + n;
+      else
+	{
+	  holy_uint32_t q;
+
+	  q = p + (n - 1);
+	  if (q >= seg->node_count)
+	    q -= seg->node_count;
+
+	  if (disknr >= p)
+	    disknr += n;
+	  else if (disknr >= q)
+	    disknr += q + 1;
+	}
+
+      if (disknr >= seg->node_count)
+	disknr -= seg->node_count;
+    }
+  *member_sector = row * seg->stripe_size;
+  return disknr;
+}
+
+/* Whether reads from SEG can be planned as plain member reads: it has to
+   stripe over several members, all of them disks we have open.  Anything
+   else, in particular a RAID with a missing member, takes the serial path
+   with its recovery.  */
+static int
+segment_batchable (const struct holy_diskfilter_segment *seg)
+{
+  unsigned int i;
+
+  if (seg->type != holy_DISKFILTER_STRIPED
+      && seg->type != holy_DISKFILTER_RAID4
+      && seg->type != holy_DISKFILTER_RAID5
+      && seg->type != holy_DISKFILTER_RAID6)
+    return 0;
+  if (seg->node_count < 2)
+    return 0;
+  for (i = 0; i < seg->node_count; i++)
+    if (! seg->nodes[i].pv || ! seg->nodes[i].pv->disk)
+      return 0;
+  return 1;
+}
+
+/* Split the read into one member read per chunk and give them to the
+   disk layer in batches, so that members with queued I/O work at the same
+   time.  A batch that runs into a bad member is read again the serial
+   way, which rebuilds the data from parity.  */
+static holy_err_t
+read_segment_batched (struct holy_diskfilter_segment *seg,
+		      holy_disk_addr_t sector, holy_size_t size, char *buf)
+{
+  struct holy_disk_read_req reqs[BATCH_MAX_REQS];
+
+  while (size)
+    {
+      holy_disk_addr_t batch_sector = sector;
+      holy_size_t batch_size = 0;
+      char *batch_buf = buf;
+      unsigned nreqs;
+      holy_err_t err;
+
+      for (nreqs = 0; size && nreqs < BATCH_MAX_REQS; nreqs++)
+	{
+	  const struct holy_diskfilter_node *node;
+	  holy_disk_addr_t member_sector;
+	  holy_uint64_t chunk, b;
+	  holy_size_t read_size;
+
+	  chunk = holy_divmod64 (sector, seg->stripe_size, &b);
+	  node = &seg->nodes[locate_chunk (seg, chunk, &member_sector)];
+	  read_size = seg->stripe_size - b;
+	  if (read_size > size)
+	    read_size = size;
+
+	  reqs[nreqs].disk = node->pv->disk;
+	  reqs[nreqs].sector = (member_sector + b + node->start
+				+ node->pv->start_sector);
+	  reqs[nreqs].size = read_size << holy_DISK_SECTOR_BITS;
+	  reqs[nreqs].buf = buf;
+
+	  sector += read_size;
+	  size -= read_size;
+	  batch_size += read_size;
+	  buf += read_size << holy_DISK_SECTOR_BITS;
+	}
+
+      err = holy_disk_read_batch (reqs, nreqs);
+      if (err && seg->type != holy_DISKFILTER_STRIPED
+	  && (err == holy_ERR_READ_ERROR || err == holy_ERR_UNKNOWN_DEVICE))
+	{
+	  holy_errno = holy_ERR_NONE;
+	  err = read_segment_serial (seg, batch_sector, batch_size,
+				     batch_buf);
+	}
+      if (err)
+	return err;
+    }
+  return holy_ERR_NONE;
+}
+
+static holy_err_t
+read_segment (struct holy_diskfilter_segment *seg, holy_disk_addr_t sector,
+	      holy_size_t size, char *buf)
+{
+  /* A read within one chunk is a single member read either way.  */
+  if (size > seg->stripe_size && segment_batchable (seg))
+    return read_segment_batched (seg, sector, size, buf);
+  return read_segment_serial (seg, sector, size, buf);
+}
+
 static holy_err_t
 read_lv (struct holy_diskfilter_lv *lv, holy_disk_addr_t sector,
 	 holy_size_t size, char *buf)
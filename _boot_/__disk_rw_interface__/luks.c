@@ -62,15 +62,7 @@ configure_ciphers (holy_disk_t disk, const char *check_uuid,
   char uuid[sizeof (header.uuid) + 1];
   char ciphername[sizeof (header.cipherName) + 1];
   char ciphermode[sizeof (header.cipherMode) + 1];
-  char *cipheriv = NULL;
   char hashspec[sizeof (header.hashSpec) + 1];
-  holy_crypto_cipher_handle_t cipher = NULL, secondary_cipher = NULL;
-  holy_crypto_cipher_handle_t essiv_cipher = NULL;
-  const gcry_md_spec_t *hash = NULL, *essiv_hash = NULL;
-  const struct gcry_cipher_spec *ciph;
-  holy_cryptodisk_mode_t mode;
-  holy_cryptodisk_mode_iv_t mode_iv = holy_CRYPTODISK_MODE_IV_PLAIN64;
-  int benbi_log = 0;
   holy_err_t err;
 
   if (check_boot)
@@ -113,179 +105,39 @@ configure_ciphers (holy_disk_t disk, const char *check_uuid,
   holy_memcpy (hashspec, header.hashSpec, sizeof (header.hashSpec));
   hashspec[sizeof (header.hashSpec)] = 0;
 
-  ciph = holy_crypto_lookup_cipher_by_name (ciphername);
-  if (!ciph)
-    {
-      holy_error (holy_ERR_FILE_NOT_FOUND, "Cipher %s isn't available",
-		  ciphername);
-      return NULL;
-    }
-
-  /* Configure the cipher used for the bulk data.  */
-  cipher = holy_crypto_cipher_open (ciph);
-  if (!cipher)
-    return NULL;
-
   if (holy_be_to_cpu32 (header.keyBytes) > 1024)
     {
       holy_error (holy_ERR_BAD_ARGUMENT, "invalid keysize %d",
 		  holy_be_to_cpu32 (header.keyBytes));
-      holy_crypto_cipher_close (cipher);
-      return NULL;
-    }
-
-  /* Configure the cipher mode.  */
-  if (holy_strcmp (ciphermode, "ecb") == 0)
-    {
-      mode = holy_CRYPTODISK_MODE_ECB;
-      mode_iv = holy_CRYPTODISK_MODE_IV_PLAIN;
-      cipheriv = NULL;
-    }
-  else if (holy_strcmp (ciphermode, "plain") == 0)
-    {
-      mode = holy_CRYPTODISK_MODE_CBC;
-      mode_iv = holy_CRYPTODISK_MODE_IV_PLAIN;
-      cipheriv = NULL;
-    }
-  else if (holy_memcmp (ciphermode, "cbc-", sizeof ("cbc-") - 1) == 0)
-    {
-      mode = holy_CRYPTODISK_MODE_CBC;
-      cipheriv = ciphermode + sizeof ("cbc-") - 1;
-    }
-  else if (holy_memcmp (ciphermode, "pcbc-", sizeof ("pcbc-") - 1) == 0)
-    {
-      mode = holy_CRYPTODISK_MODE_PCBC;
-      cipheriv = ciphermode + sizeof ("pcbc-") - 1;
-    }
-  else if (holy_memcmp (ciphermode, "xts-", sizeof ("xts-") - 1) == 0)
-    {
-      mode = holy_CRYPTODISK_MODE_XTS;
-      cipheriv = ciphermode + sizeof ("xts-") - 1;
-      secondary_cipher = holy_crypto_cipher_open (ciph);
-      if (!secondary_cipher)
-	{
-	  holy_crypto_cipher_close (cipher);
-	  return NULL;
-	}
-      if (cipher->cipher->blocksize != holy_CRYPTODISK_GF_BYTES)
-	{
-	  holy_error (holy_ERR_BAD_ARGUMENT, "Unsupported XTS block size: %d",
-		      cipher->cipher->blocksize);
-	  holy_crypto_cipher_close (cipher);
-	  holy_crypto_cipher_close (secondary_cipher);
-	  return NULL;
-	}
-      if (secondary_cipher->cipher->blocksize != holy_CRYPTODISK_GF_BYTES)
-	{
-	  holy_crypto_cipher_close (cipher);
-	  holy_error (holy_ERR_BAD_ARGUMENT, "Unsupported XTS block size: %d",
-		      secondary_cipher->cipher->blocksize);
-	  holy_crypto_cipher_close (secondary_cipher);
-	  return NULL;
-	}
-    }
-  else if (holy_memcmp (ciphermode, "lrw-", sizeof ("lrw-") - 1) == 0)
-    {
-      mode = holy_CRYPTODISK_MODE_LRW;
-      cipheriv = ciphermode + sizeof ("lrw-") - 1;
-      if (cipher->cipher->blocksize != holy_CRYPTODISK_GF_BYTES)
-	{
-	  holy_error (holy_ERR_BAD_ARGUMENT, "Unsupported LRW block size: %d",
-		      cipher->cipher->blocksize);
-	  holy_crypto_cipher_close (cipher);
-	  return NULL;
-	}
-    }
-  else
-    {
-      holy_crypto_cipher_close (cipher);
-      holy_error (holy_ERR_BAD_ARGUMENT, "Unknown cipher mode: %s",
-		  ciphermode);
       return NULL;
     }
 
-  if (cipheriv == NULL);
-  else if (holy_memcmp (cipheriv, "plain", sizeof ("plain") - 1) == 0)
-      mode_iv = holy_CRYPTODISK_MODE_IV_PLAIN;
-  else if (holy_memcmp (cipheriv, "plain64", sizeof ("plain64") - 1) == 0)
-      mode_iv = holy_CRYPTODISK_MODE_IV_PLAIN64;
-  else if (holy_memcmp (cipheriv, "benbi", sizeof ("benbi") - 1) == 0)
-    {
-      if (cipher->cipher->blocksize & (cipher->cipher->blocksize - 1)
-	  || cipher->cipher->blocksize == 0)
-	holy_error (holy_ERR_BAD_ARGUMENT, "Unsupported benbi blocksize: %d",
-		    cipher->cipher->blocksize);
-	/* FIXME should we return an error here? */
-      for (benbi_log = 0; 
-	   (cipher->cipher->blocksize << benbi_log) < holy_DISK_SECTOR_SIZE;
-	   benbi_log++);
-      mode_iv = holy_CRYPTODISK_MODE_IV_BENBI;
-    }
-  else if (holy_memcmp (cipheriv, "null", sizeof ("null") - 1) == 0)
-      mode_iv = holy_CRYPTODISK_MODE_IV_NULL;
-  else if (holy_memcmp (cipheriv, "essiv:", sizeof ("essiv:") - 1) == 0)
-    {
-      char *hash_str = cipheriv + 6;
-
-      mode_iv = holy_CRYPTODISK_MODE_IV_ESSIV;
+  newdev = holy_zalloc (sizeof (struct holy_cryptodisk));
+  if (!newdev)
+    return NULL;
 
-      /* Configure the hash and cipher used for ESSIV.  */
-      essiv_hash = holy_crypto_lookup_md_by_name (hash_str);
-      if (!essiv_hash)
-	{
-	  holy_crypto_cipher_close (cipher);
-	  holy_crypto_cipher_close (secondary_cipher);
-	  holy_error (holy_ERR_FILE_NOT_FOUND,
-		      "Couldn't load %s hash", hash_str);
-	  return NULL;
-	}
-      essiv_cipher = holy_crypto_cipher_open (ciph);
-      if (!essiv_cipher)
-	{
-	  holy_crypto_cipher_close (cipher);
-	  holy_crypto_cipher_close (secondary_cipher);
-	  return NULL;
-	}
-    }
-  else
+  /* Configure the ciphers used for the bulk data.  */
+  if (holy_cryptodisk_setcipher (newdev, ciphername, ciphermode))
     {
-      holy_crypto_cipher_close (cipher);
-      holy_crypto_cipher_close (secondary_cipher);
-      holy_error (holy_ERR_BAD_ARGUMENT, "Unknown IV mode: %s",
-		  cipheriv);
+      holy_free (newdev);
       return NULL;
     }
 
   /* Configure the hash used for the AF splitter and HMAC.  */
-  hash = holy_crypto_lookup_md_by_name (hashspec);
-  if (!hash)
+  newdev->hash = holy_crypto_lookup_md_by_name (hashspec);
+  if (!newdev->hash)
     {
-      holy_crypto_cipher_close (cipher);
-      holy_crypto_cipher_close (essiv_cipher);
-      holy_crypto_cipher_close (secondary_cipher);
+      holy_crypto_cipher_close (newdev->cipher);
+      holy_crypto_cipher_close (newdev->essiv_cipher);
+      holy_crypto_cipher_close (newdev->secondary_cipher);
+      holy_free (newdev);
       holy_error (holy_ERR_FILE_NOT_FOUND, "Couldn't load %s hash",
 		  hashspec);
       return NULL;
     }
 
-  newdev = holy_zalloc (sizeof (struct holy_cryptodisk));
-  if (!newdev)
-    {
-      holy_crypto_cipher_close (cipher);
-      holy_crypto_cipher_close (essiv_cipher);
-      holy_crypto_cipher_close (secondary_cipher);
-      return NULL;
-    }
-  newdev->cipher = cipher;
   newdev->offset = holy_be_to_cpu32 (header.payloadOffset);
   newdev->source_disk = NULL;
-  newdev->benbi_log = benbi_log;
-  newdev->mode = mode;
-  newdev->mode_iv = mode_iv;
-  newdev->secondary_cipher = secondary_cipher;
-  newdev->essiv_cipher = essiv_cipher;
-  newdev->essiv_hash = essiv_hash;
-  newdev->hash = hash;
   newdev->log_sector_size = 9;
   newdev->total_length = holy_disk_get_size (disk) - newdev->offset;
   holy_memcpy (newdev->uuid, uuid, sizeof (newdev->uuid));
@@ -294,6 +146,80 @@ configure_ciphers (holy_disk_t disk, const char *check_uuid,
   return newdev;
 }
 
+/* Check whether DIGEST, the PBKDF2 of the passphrase for key slot I,
+   opens it, and set the master key of DEV if so.  Return
+   holy_ERR_ACCESS_DENIED, without raising it, if it does not.  */
+static holy_err_t
+luks_try_slot (holy_disk_t source, holy_cryptodisk_t dev,
+	       const struct holy_luks_phdr *header, unsigned i,
+	       holy_uint8_t *digest, holy_uint8_t *split_key)
+{
+  gcry_err_code_t gcry_err;
+  holy_uint8_t candidate_key[holy_CRYPTODISK_MAX_KEYLEN];
+  holy_uint8_t candidate_digest[sizeof (header->mkDigest)];
+  holy_size_t keysize = holy_be_to_cpu32 (header->keyBytes);
+  holy_size_t length;
+  holy_err_t err;
+
+  gcry_err = holy_cryptodisk_setkey (dev, digest, keysize);
+  if (gcry_err)
+    return holy_crypto_gcry_error (gcry_err);
+
+  length = (keysize * holy_be_to_cpu32 (header->keyblock[i].stripes));
+
+  /* Read and decrypt the key material from the disk.  */
+  err = holy_disk_read (source,
+			holy_be_to_cpu32 (header->keyblock
+					  [i].keyMaterialOffset), 0,
+			length, split_key);
+  if (err)
+    return err;
+
+  gcry_err = holy_cryptodisk_decrypt (dev, split_key, length, 0);
+  if (gcry_err)
+    return holy_crypto_gcry_error (gcry_err);
+
+  /* Merge the decrypted key material to get the candidate master key.  */
+  gcry_err = AF_merge (dev->hash, split_key, candidate_key, keysize,
+		       holy_be_to_cpu32 (header->keyblock[i].stripes));
+  if (gcry_err)
+    return holy_crypto_gcry_error (gcry_err);
+
+  holy_dprintf ("luks", "candidate key recovered\n");
+
+  /* Calculate the PBKDF2 of the candidate master key.  */
+  gcry_err = holy_crypto_pbkdf2 (dev->hash, candidate_key,
+				 holy_be_to_cpu32 (header->keyBytes),
+				 header->mkDigestSalt,
+				 sizeof (header->mkDigestSalt),
+				 holy_be_to_cpu32
+				 (header->mkDigestIterations),
+				 candidate_digest,
+				 sizeof (candidate_digest));
+  if (gcry_err)
+    return holy_crypto_gcry_error (gcry_err);
+
+  /* Compare the calculated PBKDF2 to the digest stored
+     in the header to see if it's correct.  */
+  if (holy_memcmp (candidate_digest, header->mkDigest,
+		   sizeof (header->mkDigest)) != 0)
+    {
+      holy_dprintf ("luks", "bad digest\n");
+      return holy_ERR_ACCESS_DENIED;
+    }
+
+  /* TRANSLATORS: It's a cryptographic key slot: one element of an array
+     where each element is either empty or holds a key.  */
+  holy_printf_ (N_("Slot %d opened\n"), i);
+
+  /* Set the master key.  */
+  gcry_err = holy_cryptodisk_setkey (dev, candidate_key, keysize);
+  if (gcry_err)
+    return holy_crypto_gcry_error (gcry_err);
+
+  return holy_ERR_NONE;
+}
+
 static holy_err_t
 luks_recover_key (holy_disk_t source,
 		  holy_cryptodisk_t dev)
@@ -302,9 +228,7 @@ luks_recover_key (holy_disk_t source,
   holy_size_t keysize;
   holy_uint8_t *split_key = NULL;
   char passphrase[MAX_PASSPHRASE] = "";
-  holy_uint8_t candidate_digest[sizeof (header.mkDigest)];
   unsigned i;
-  holy_size_t length;
   holy_err_t err;
   holy_size_t max_stripes = 1;
   char *tmp;
@@ -341,11 +265,12 @@ luks_recover_key (holy_disk_t source,
       return holy_error (holy_ERR_BAD_ARGUMENT, "Passphrase not supplied");
     }
 
-  /* Try to recover master key from each active keyslot.  */
+  /* Try to recover master key from each active keyslot.  Each slot is
+     tried as soon as its key is derived, so that a passphrase for an early
+     slot costs a single PBKDF2.  */
   for (i = 0; i < ARRAY_SIZE (header.keyblock); i++)
     {
       gcry_err_code_t gcry_err;
-      holy_uint8_t candidate_key[holy_CRYPTODISK_MAX_KEYLEN];
       holy_uint8_t digest[holy_CRYPTODISK_MAX_KEYLEN];
 
       /* Check if keyslot is enabled.  */
@@ -362,7 +287,6 @@ luks_recover_key (holy_disk_t source,
 				     holy_be_to_cpu32 (header.keyblock[i].
 						       passwordIterations),
 				     digest, keysize);
-
       if (gcry_err)
 	{
 	  holy_free (split_key);
@@ -371,83 +295,13 @@ luks_recover_key (holy_disk_t source,
 
       holy_dprintf ("luks", "PBKDF2 done\n");
 
-      gcry_err = holy_cryptodisk_setkey (dev, digest, keysize);
-      if (gcry_err)
-	{
-	  holy_free (split_key);
-	  return holy_crypto_gcry_error (gcry_err);
-	}
-
-      length = (keysize * holy_be_to_cpu32 (header.keyblock[i].stripes));
-
-      /* Read and decrypt the key material from the disk.  */
-      err = holy_disk_read (source,
-			    holy_be_to_cpu32 (header.keyblock
-					      [i].keyMaterialOffset), 0,
-			    length, split_key);
-      if (err)
+      err = luks_try_slot (source, dev, &header, i, digest, split_key);
+      holy_memset (digest, 0, sizeof (digest));
+      if (err != holy_ERR_ACCESS_DENIED)
 	{
 	  holy_free (split_key);
 	  return err;
 	}
-
-      gcry_err = holy_cryptodisk_decrypt (dev, split_key, length, 0);
-      if (gcry_err)
-	{
-	  holy_free (split_key);
-	  return holy_crypto_gcry_error (gcry_err);
-	}
-
-      /* Merge the decrypted key material to get the candidate master key.  */
-      gcry_err = AF_merge (dev->hash, split_key, candidate_key, keysize,
-			   holy_be_to_cpu32 (header.keyblock[i].stripes));
-      if (gcry_err)
-	{
-	  holy_free (split_key);
-	  return holy_crypto_gcry_error (gcry_err);
-	}
-
-      holy_dprintf ("luks", "candidate key recovered\n");
-
-      /* Calculate the PBKDF2 of the candidate master key.  */
-      gcry_err = holy_crypto_pbkdf2 (dev->hash, candidate_key,
-				     holy_be_to_cpu32 (header.keyBytes),
-				     header.mkDigestSalt,
-				     sizeof (header.mkDigestSalt),
-				     holy_be_to_cpu32
-				     (header.mkDigestIterations),
-				     candidate_digest,
-				     sizeof (candidate_digest));
-      if (gcry_err)
-	{
-	  holy_free (split_key);
-	  return holy_crypto_gcry_error (gcry_err);
-	}
-
-      /* Compare the calculated PBKDF2 to the digest stored
-         in the header to see if it's correct.  */
-      if (holy_memcmp (candidate_digest, header.mkDigest,
-		       sizeof (header.mkDigest)) != 0)
-	{
-	  holy_dprintf ("luks", "bad digest\n");
-	  continue;
-	}
-
-      /* TRANSLATORS: It's a cryptographic key slot: one element of an array
-	 where each element is either empty or holds a key.  */
-      holy_printf_ (N_("Slot %d opened\n"), i);
-
-      /* Set the master key.  */
-      gcry_err = holy_cryptodisk_setkey (dev, candidate_key, keysize);
-      if (gcry_err)
-	{
-	  holy_free (split_key);
-	  return holy_crypto_gcry_error (gcry_err);
-	}
-
-      holy_free (split_key);
-
-      return holy_ERR_NONE;
     }
 
   holy_free (split_key);
@@ -0,0 +1,846 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#include <holy/cryptodisk.h>
+#include <holy/types.h>
+#include <holy/misc.h>
+#include <holy/mm.h>
+#include <holy/dl.h>
+#include <holy/err.h>
+#include <holy/disk.h>
+#include <holy/crypto.h>
+#include <holy/partition.h>
+#include <holy/time.h>
+#include <holy/i18n.h>
+#include <holy/json.h>
+#include <holy/argon2.h>
+
+holy_MOD_LICENSE ("GPLv2+");
+
+#define MAX_PASSPHRASE 256
+
+#define LUKS_MAGIC_1ST "LUKS\xBA\xBE"
+#define LUKS_MAGIC_2ND "SKUL\xBA\xBE"
+
+/* Where the secondary header may be, for each header size cryptsetup
+   can make, in case the primary one is unreadable.  */
+static const holy_uint64_t luks2_secondary_offsets[] =
+  {
+    0x4000, 0x8000, 0x10000, 0x20000, 0x40000, 0x80000, 0x100000,
+    0x200000, 0x400000
+  };
+
+/* Largest JSON area accepted.  */
+#define LUKS2_MAX_HDR_SIZE (4 * 1024 * 1024)
+
+/* On disk binary header, followed by the JSON area.  */
+struct luks2_header
+{
+  char magic[6];
+  holy_uint16_t version;
+  holy_uint64_t hdr_size;
+  holy_uint64_t seqid;
+  char label[48];
+  char csum_alg[32];
+  holy_uint8_t salt[64];
+  char uuid[40];
+  char subsystem[48];
+  holy_uint64_t hdr_offset;
+  char _padding[184];
+  holy_uint8_t csum[64];
+  char _padding4096[7 * 512];
+} holy_PACKED;
+
+struct luks2_keyslot
+{
+  holy_uint64_t key_size;
+  holy_uint64_t priority;
+  struct
+  {
+    const char *encryption;
+    holy_uint64_t offset;
+    holy_uint64_t size;
+    holy_uint64_t key_size;
+  } area;
+  struct
+  {
+    const char *hash;
+    holy_uint64_t stripes;
+  } af;
+  struct
+  {
+    const char *type;
+    const char *salt;
+    /* pbkdf2.  */
+    const char *hash;
+    holy_uint64_t iterations;
+    /* argon2i and argon2id.  */
+    holy_uint64_t time;
+    holy_uint64_t memory;
+    holy_uint64_t cpus;
+  } kdf;
+};
+
+struct luks2_segment
+{
+  holy_uint64_t offset;
+  const char *size;
+  const char *encryption;
+  holy_uint64_t sector_size;
+};
+
+struct luks2_digest
+{
+  holy_json_t keyslots;
+  holy_json_t segments;
+  const char *salt;
+  const char *digest;
+  const char *hash;
+  holy_uint64_t iterations;
+};
+
+gcry_err_code_t AF_merge (const gcry_md_spec_t * hash, holy_uint8_t * src,
+			  holy_uint8_t * dst, holy_size_t blocksize,
+			  holy_size_t blocknumbers);
+
+static int
+base64_value (char c)
+{
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= 'a' && c <= 'z')
+    return c - 'a' + 26;
+  if (c >= '0' && c <= '9')
+    return c - '0' + 52;
+  if (c == '+')
+    return 62;
+  if (c == '/')
+    return 63;
+  return -1;
+}
+
+/* Decode the base64 IN into at most *OUTLEN bytes at OUT, and set
+   *OUTLEN to the number of bytes decoded.  */
+static holy_err_t
+base64_decode (const char *in, holy_uint8_t *out, holy_size_t *outlen)
+{
+  holy_uint32_t acc = 0;
+  holy_size_t n = 0;
+  unsigned bits = 0;
+
+  for (; *in && *in != '='; in++)
+    {
+      int v = base64_value (*in);
+
+      if (v < 0)
+	return holy_error (holy_ERR_BAD_ARGUMENT, "invalid base64 string");
+      acc = (acc << 6) | v;
+      bits += 6;
+      if (bits >= 8)
+	{
+	  bits -= 8;
+	  if (n == *outlen)
+	    return holy_error (holy_ERR_BAD_ARGUMENT,
+			       "base64 string is too long");
+	  out[n++] = acc >> bits;
+	}
+    }
+  *outlen = n;
+  return holy_ERR_NONE;
+}
+
+/* Read the binary header at OFFSET, and check that it is the one of
+   that place.  */
+static holy_err_t
+luks2_read_binary_header (holy_disk_t disk, holy_uint64_t offset,
+			  const char *magic, struct luks2_header *header)
+{
+  holy_err_t err;
+
+  err = holy_disk_read (disk, offset >> holy_DISK_SECTOR_BITS,
+			offset & (holy_DISK_SECTOR_SIZE - 1),
+			sizeof (*header), header);
+  if (err)
+    return err;
+
+  if (holy_memcmp (header->magic, magic, sizeof (header->magic))
+      || holy_be_to_cpu16 (header->version) != 2
+      || holy_be_to_cpu64 (header->hdr_offset) != offset
+      || holy_be_to_cpu64 (header->hdr_size) <= sizeof (*header)
+      || holy_be_to_cpu64 (header->hdr_size) > LUKS2_MAX_HDR_SIZE)
+    return holy_error (holy_ERR_BAD_SIGNATURE, "not a LUKS2 header");
+  return holy_ERR_NONE;
+}
+
+/* Read the JSON area that follows HEADER, and check the checksum over
+   both.  */
+static holy_err_t
+luks2_read_json (holy_disk_t disk, const struct luks2_header *header,
+		 char **json, holy_size_t *json_len)
+{
+  holy_uint64_t offset = holy_be_to_cpu64 (header->hdr_offset);
+  holy_size_t len = holy_be_to_cpu64 (header->hdr_size) - sizeof (*header);
+  const gcry_md_spec_t *csum;
+  char csum_alg[sizeof (header->csum_alg) + 1];
+  char *buf;
+  holy_err_t err;
+
+  buf = holy_malloc (len);
+  if (!buf)
+    return holy_errno;
+  offset += sizeof (*header);
+  err = holy_disk_read (disk, offset >> holy_DISK_SECTOR_BITS,
+			offset & (holy_DISK_SECTOR_SIZE - 1), len, buf);
+  if (err)
+    {
+      holy_free (buf);
+      return err;
+    }
+
+  holy_memcpy (csum_alg, header->csum_alg, sizeof (header->csum_alg));
+  csum_alg[sizeof (header->csum_alg)] = 0;
+  csum = holy_crypto_lookup_md_by_name (csum_alg);
+  if (!csum)
+    {
+      holy_free (buf);
+      return holy_error (holy_ERR_FILE_NOT_FOUND, "Couldn't load %s hash",
+			 csum_alg);
+    }
+  if (csum->mdlen <= sizeof (header->csum))
+    {
+      struct luks2_header copy = *header;
+      holy_uint8_t *ctx;
+      int ok;
+
+      ctx = holy_zalloc (csum->contextsize);
+      if (!ctx)
+	{
+	  holy_free (buf);
+	  return holy_errno;
+	}
+      holy_memset (copy.csum, 0, sizeof (copy.csum));
+      csum->init (ctx);
+      csum->write (ctx, &copy, sizeof (copy));
+      csum->write (ctx, buf, len);
+      csum->final (ctx);
+      ok = holy_memcmp (csum->read (ctx), header->csum, csum->mdlen) == 0;
+      holy_free (ctx);
+      if (!ok)
+	{
+	  holy_free (buf);
+	  return holy_error (holy_ERR_BAD_FS,
+			     "LUKS2 header checksum mismatch");
+	}
+    }
+
+  *json = buf;
+  *json_len = len;
+  return holy_ERR_NONE;
+}
+
+/* Find the valid header with the highest sequence number, and read its
+   JSON area too if JSON is not NULL.  */
+static holy_err_t
+luks2_read_header (holy_disk_t disk, struct luks2_header *header,
+		   char **json, holy_size_t *json_len)
+{
+  struct luks2_header primary, secondary;
+  int have_primary, have_secondary = 0;
+  char *primary_json = NULL, *secondary_json = NULL;
+  holy_size_t primary_len = 0, secondary_len = 0;
+  unsigned i;
+
+  have_primary = (luks2_read_binary_header (disk, 0, LUKS_MAGIC_1ST,
+					    &primary) == holy_ERR_NONE);
+  if (have_primary && json
+      && luks2_read_json (disk, &primary, &primary_json, &primary_len))
+    have_primary = 0;
+  holy_errno = holy_ERR_NONE;
+
+  /* The secondary header only matters if it may be newer.  */
+  for (i = 0; i < ARRAY_SIZE (luks2_secondary_offsets)
+	 && (json || !have_primary); i++)
+    {
+      /* With a good primary header, only its size is worth trying.  */
+      if (have_primary && luks2_secondary_offsets[i]
+	  != holy_be_to_cpu64 (primary.hdr_size))
+	continue;
+      if (luks2_read_binary_header (disk, luks2_secondary_offsets[i],
+				    LUKS_MAGIC_2ND, &secondary) == 0)
+	{
+	  have_secondary = 1;
+	  break;
+	}
+      holy_errno = holy_ERR_NONE;
+    }
+  if (have_secondary && json
+      && luks2_read_json (disk, &secondary, &secondary_json, &secondary_len))
+    have_secondary = 0;
+  holy_errno = holy_ERR_NONE;
+
+  if (!have_primary && !have_secondary)
+    return holy_error (holy_ERR_BAD_SIGNATURE, "no valid LUKS2 header");
+
+  if (have_primary && (!have_secondary
+		       || holy_be_to_cpu64 (primary.seqid)
+		       >= holy_be_to_cpu64 (secondary.seqid)))
+    {
+      *header = primary;
+      holy_free (secondary_json);
+      if (json)
+	{
+	  *json = primary_json;
+	  *json_len = primary_len;
+	}
+    }
+  else
+    {
+      *header = secondary;
+      holy_free (primary_json);
+      if (json)
+	{
+	  *json = secondary_json;
+	  *json_len = secondary_len;
+	}
+    }
+  return holy_ERR_NONE;
+}
+
+static holy_cryptodisk_t
+luks2_scan (holy_disk_t disk, const char *check_uuid, int check_boot)
+{
+  holy_cryptodisk_t newdev;
+  struct luks2_header header;
+  char uuid[sizeof (header.uuid) + 1];
+  holy_size_t i, j;
+
+  if (check_boot)
+    return NULL;
+
+  if (luks2_read_header (disk, &header, NULL, NULL))
+    {
+      holy_errno = holy_ERR_NONE;
+      return NULL;
+    }
+
+  for (i = 0, j = 0; i < sizeof (header.uuid) && header.uuid[i]; i++)
+    if (header.uuid[i] != '-')
+      uuid[j++] = header.uuid[i];
+  uuid[j] = 0;
+
+  if (check_uuid && holy_strcasecmp (check_uuid, uuid) != 0)
+    {
+      holy_dprintf ("luks2", "%s != %s\n", uuid, check_uuid);
+      return NULL;
+    }
+
+  newdev = holy_zalloc (sizeof (struct holy_cryptodisk));
+  if (!newdev)
+    return NULL;
+  holy_memcpy (newdev->uuid, uuid, sizeof (uuid));
+  newdev->modname = "luks2";
+  COMPILE_TIME_ASSERT (sizeof (newdev->uuid) >= sizeof (uuid));
+  return newdev;
+}
+
+static holy_err_t
+luks2_parse_keyslot (struct luks2_keyslot *out, const holy_json_t *keyslot)
+{
+  holy_json_t area, af, kdf;
+  const char *type;
+
+  if (holy_json_getstring (&type, keyslot, "type"))
+    return holy_errno;
+  if (holy_strcmp (type, "luks2") != 0)
+    return holy_error (holy_ERR_BAD_ARGUMENT,
+		       "unsupported keyslot type %s", type);
+  if (holy_json_getuint64 (&out->key_size, keyslot, "key_size"))
+    return holy_errno;
+  if (holy_json_getuint64 (&out->priority, keyslot, "priority"))
+    {
+      holy_errno = holy_ERR_NONE;
+      out->priority = 1;
+    }
+
+  if (holy_json_getvalue (&area, keyslot, "area")
+      || holy_json_getstring (&type, &area, "type"))
+    return holy_errno;
+  if (holy_strcmp (type, "raw") != 0)
+    return holy_error (holy_ERR_BAD_ARGUMENT,
+		       "unsupported key area type %s", type);
+  if (holy_json_getuint64 (&out->area.offset, &area, "offset")
+      || holy_json_getuint64 (&out->area.size, &area, "size")
+      || holy_json_getstring (&out->area.encryption, &area, "encryption")
+      || holy_json_getuint64 (&out->area.key_size, &area, "key_size"))
+    return holy_errno;
+
+  if (holy_json_getvalue (&kdf, keyslot, "kdf")
+      || holy_json_getstring (&out->kdf.type, &kdf, "type")
+      || holy_json_getstring (&out->kdf.salt, &kdf, "salt"))
+    return holy_errno;
+  if (holy_strcmp (out->kdf.type, "pbkdf2") == 0)
+    {
+      if (holy_json_getstring (&out->kdf.hash, &kdf, "hash")
+	  || holy_json_getuint64 (&out->kdf.iterations, &kdf, "iterations"))
+	return holy_errno;
+    }
+  else if (holy_strcmp (out->kdf.type, "argon2i") == 0
+	   || holy_strcmp (out->kdf.type, "argon2id") == 0)
+    {
+      if (holy_json_getuint64 (&out->kdf.time, &kdf, "time")
+	  || holy_json_getuint64 (&out->kdf.memory, &kdf, "memory")
+	  || holy_json_getuint64 (&out->kdf.cpus, &kdf, "cpus"))
+	return holy_errno;
+    }
+  else
+    return holy_error (holy_ERR_BAD_ARGUMENT, "unsupported KDF %s",
+		       out->kdf.type);
+
+  if (holy_json_getvalue (&af, keyslot, "af")
+      || holy_json_getstring (&type, &af, "type"))
+    return holy_errno;
+  if (holy_strcmp (type, "luks1") != 0)
+    return holy_error (holy_ERR_BAD_ARGUMENT,
+		       "unsupported AF type %s", type);
+  if (holy_json_getuint64 (&out->af.stripes, &af, "stripes")
+      || holy_json_getstring (&out->af.hash, &af, "hash"))
+    return holy_errno;
+
+  return holy_ERR_NONE;
+}
+
+static holy_err_t
+luks2_parse_segment (struct luks2_segment *out, const holy_json_t *segment)
+{
+  holy_json_t integrity;
+  const char *type;
+
+  if (holy_json_getstring (&type, segment, "type"))
+    return holy_errno;
+  if (holy_strcmp (type, "crypt") != 0)
+    return holy_error (holy_ERR_BAD_ARGUMENT,
+		       "unsupported segment type %s", type);
+  if (holy_json_getuint64 (&out->offset, segment, "offset")
+      || holy_json_getstring (&out->size, segment, "size")
+      || holy_json_getstring (&out->encryption, segment, "encryption")
+      || holy_json_getuint64 (&out->sector_size, segment, "sector_size"))
+    return holy_errno;
+  /* The data of such segments is interleaved with authentication tags,
+     which we neither skip nor check.  */
+  if (holy_json_getvalue (&integrity, segment, "integrity") == holy_ERR_NONE)
+    return holy_error (holy_ERR_NOT_IMPLEMENTED_YET,
+		       "segments with integrity protection are not supported");
+  holy_errno = holy_ERR_NONE;
+  return holy_ERR_NONE;
+}
+
+static holy_err_t
+luks2_parse_digest (struct luks2_digest *out, const holy_json_t *digest)
+{
+  const char *type;
+
+  if (holy_json_getstring (&type, digest, "type"))
+    return holy_errno;
+  if (holy_strcmp (type, "pbkdf2") != 0)
+    return holy_error (holy_ERR_BAD_ARGUMENT,
+		       "unsupported digest type %s", type);
+  if (holy_json_getvalue (&out->keyslots, digest, "keyslots")
+      || holy_json_getvalue (&out->segments, digest, "segments")
+      || holy_json_getstring (&out->salt, digest, "salt")
+      || holy_json_getstring (&out->digest, digest, "digest")
+      || holy_json_getstring (&out->hash, digest, "hash")
+      || holy_json_getuint64 (&out->iterations, digest, "iterations"))
+    return holy_errno;
+  return holy_ERR_NONE;
+}
+
+/* Whether the array of names LIST has NAME in it.  */
+static int
+luks2_list_has (const holy_json_t *list, const char *name)
+{
+  holy_size_t i, size;
+
+  if (holy_json_getsize (&size, list))
+    return 0;
+  for (i = 0; i < size; i++)
+    {
+      holy_json_t entry;
+      const char *s;
+
+      if (holy_json_getchild (&entry, list, i)
+	  || holy_json_getstring (&s, &entry, NULL))
+	return 0;
+      if (holy_strcmp (s, name) == 0)
+	return 1;
+    }
+  return 0;
+}
+
+/* Fill K from keyslot I of ROOT, and D and S from the digest that checks
+   it and the first segment that digest covers.  */
+static holy_err_t
+luks2_get_keyslot (struct luks2_keyslot *k, struct luks2_digest *d,
+		   struct luks2_segment *s, const char **name,
+		   const holy_json_t *root, holy_size_t i)
+{
+  holy_json_t keyslots, keyslot, digests, digest, segments, segment;
+  holy_size_t j, size;
+  const char *key;
+
+  if (holy_json_getvalue (&keyslots, root, "keyslots")
+      || holy_json_getkey (name, &keyslots, i)
+      || holy_json_getchild (&keyslot, &keyslots, i)
+      || luks2_parse_keyslot (k, &keyslot))
+    return holy_errno;
+
+  if (holy_json_getvalue (&digests, root, "digests")
+      || holy_json_getsize (&size, &digests))
+    return holy_errno;
+  for (j = 0; j < size; j++)
+    {
+      if (holy_json_getchild (&digest, &digests, j)
+	  || luks2_parse_digest (d, &digest))
+	return holy_errno;
+      if (luks2_list_has (&d->keyslots, *name))
+	break;
+    }
+  if (j == size)
+    return holy_error (holy_ERR_FILE_NOT_FOUND,
+		       "no digest for keyslot %s", *name);
+
+  if (holy_json_getvalue (&segments, root, "segments")
+      || holy_json_getsize (&size, &segments))
+    return holy_errno;
+  for (j = 0; j < size; j++)
+    {
+      if (holy_json_getkey (&key, &segments, j))
+	return holy_errno;
+      if (!luks2_list_has (&d->segments, key))
+	continue;
+      if (holy_json_getchild (&segment, &segments, j)
+	  || luks2_parse_segment (s, &segment))
+	return holy_errno;
+      return holy_ERR_NONE;
+    }
+  return holy_error (holy_ERR_FILE_NOT_FOUND,
+		     "no segment for keyslot %s", *name);
+}
+
+/* Split an encryption spec such as "aes-xts-plain64" and make it the one
+   of CRYPT.  */
+static holy_err_t
+luks2_setcipher (holy_cryptodisk_t crypt, const char *encryption)
+{
+  char cipher[32];
+  const char *mode;
+
+  mode = holy_strchr (encryption, '-');
+  if (!mode || (holy_size_t) (mode - encryption) >= sizeof (cipher))
+    return holy_error (holy_ERR_BAD_ARGUMENT,
+		       "invalid encryption %s", encryption);
+  holy_memcpy (cipher, encryption, mode - encryption);
+  cipher[mode - encryption] = 0;
+  return holy_cryptodisk_setcipher (crypt, cipher, mode + 1);
+}
+
+/* Derive the key of the area of keyslot K from the passphrase, and use it
+   to get the candidate master key out of the area.  */
+static holy_err_t
+luks2_decrypt_key (holy_uint8_t *out_key, holy_disk_t source,
+		   holy_cryptodisk_t crypt, const struct luks2_keyslot *k,
+		   const holy_uint8_t *passphrase, holy_size_t passphrase_len)
+{
+  holy_uint8_t area_key[holy_CRYPTODISK_MAX_KEYLEN];
+  holy_uint8_t salt[holy_CRYPTODISK_MAX_KEYLEN];
+  holy_size_t salt_len = sizeof (salt), size;
+  holy_uint8_t *split_key = NULL;
+  const gcry_md_spec_t *hash;
+  gcry_err_code_t gcry_err;
+  holy_uint64_t start;
+  holy_err_t err;
+
+  if (k->area.key_size > sizeof (area_key)
+      || k->key_size > holy_CRYPTODISK_MAX_KEYLEN)
+    return holy_error (holy_ERR_BAD_ARGUMENT, "key is too long");
+  if (k->af.stripes == 0 || k->af.stripes > 0x100000)
+    return holy_error (holy_ERR_BAD_ARGUMENT, "invalid AF stripes");
+  size = ALIGN_UP (k->key_size * k->af.stripes, holy_DISK_SECTOR_SIZE);
+  if (size > k->area.size)
+    return holy_error (holy_ERR_BAD_ARGUMENT, "key area is too small");
+
+  if (base64_decode (k->kdf.salt, salt, &salt_len))
+    return holy_errno;
+
+  start = holy_get_time_ms ();
+  if (holy_strcmp (k->kdf.type, "pbkdf2") == 0)
+    {
+      hash = holy_crypto_lookup_md_by_name (k->kdf.hash);
+      if (!hash)
+	return holy_error (holy_ERR_FILE_NOT_FOUND, "Couldn't load %s hash",
+			   k->kdf.hash);
+      gcry_err = holy_crypto_pbkdf2 (hash, passphrase, passphrase_len,
+				     salt, salt_len, k->kdf.iterations,
+				     area_key, k->area.key_size);
+      if (gcry_err)
+	return holy_crypto_gcry_error (gcry_err);
+    }
+  else
+    {
+      struct holy_argon2_params params;
+
+      holy_memset (&params, 0, sizeof (params));
+      params.type = (holy_strcmp (k->kdf.type, "argon2i") == 0
+		     ? holy_ARGON2_I : holy_ARGON2_ID);
+      params.t_cost = k->kdf.time;
+      params.m_cost = k->kdf.memory;
+      params.lanes = k->kdf.cpus;
+      if (params.t_cost != k->kdf.time || params.m_cost != k->kdf.memory
+	  || params.lanes != k->kdf.cpus)
+	return holy_error (holy_ERR_BAD_ARGUMENT, "invalid Argon2 cost");
+      err = holy_argon2 (&params, passphrase, passphrase_len, salt, salt_len,
+			 area_key, k->area.key_size);
+      if (err)
+	return err;
+    }
+  holy_dprintf ("luks2", "%s took %llu ms\n", k->kdf.type,
+		(unsigned long long) (holy_get_time_ms () - start));
+
+  /* The key area is always in sectors of 512 bytes.  */
+  err = luks2_setcipher (crypt, k->area.encryption);
+  if (err)
+    goto out;
+  crypt->log_sector_size = holy_DISK_SECTOR_BITS;
+  gcry_err = holy_cryptodisk_setkey (crypt, area_key, k->area.key_size);
+  if (gcry_err)
+    {
+      err = holy_crypto_gcry_error (gcry_err);
+      goto out;
+    }
+
+  split_key = holy_malloc (size);
+  if (!split_key)
+    {
+      err = holy_errno;
+      goto out;
+    }
+  err = holy_disk_read (source, k->area.offset >> holy_DISK_SECTOR_BITS,
+			k->area.offset & (holy_DISK_SECTOR_SIZE - 1),
+			size, split_key);
+  if (err)
+    goto out;
+  gcry_err = holy_cryptodisk_decrypt (crypt, split_key, size, 0);
+  if (gcry_err)
+    {
+      err = holy_crypto_gcry_error (gcry_err);
+      goto out;
+    }
+
+  hash = holy_crypto_lookup_md_by_name (k->af.hash);
+  if (!hash)
+    {
+      err = holy_error (holy_ERR_FILE_NOT_FOUND, "Couldn't load %s hash",
+			k->af.hash);
+      goto out;
+    }
+  gcry_err = AF_merge (hash, split_key, out_key, k->key_size,
+		       k->af.stripes);
+  if (gcry_err)
+    err = holy_crypto_gcry_error (gcry_err);
+
+ out:
+  holy_memset (area_key, 0, sizeof (area_key));
+  if (split_key)
+    {
+      holy_memset (split_key, 0, size);
+      holy_free (split_key);
+    }
+  return err;
+}
+
+/* Check the candidate KEY against digest D.  Return holy_ERR_ACCESS_DENIED,
+   without raising it, if it is wrong.  */
+static holy_err_t
+luks2_verify_key (const struct luks2_digest *d, holy_uint8_t *key,
+		  holy_size_t key_len)
+{
+  holy_uint8_t digest[holy_CRYPTODISK_MAX_KEYLEN];
+  holy_uint8_t candidate[holy_CRYPTODISK_MAX_KEYLEN];
+  holy_uint8_t salt[holy_CRYPTODISK_MAX_KEYLEN];
+  holy_size_t digest_len = sizeof (digest), salt_len = sizeof (salt);
+  const gcry_md_spec_t *hash;
+  gcry_err_code_t gcry_err;
+
+  if (base64_decode (d->digest, digest, &digest_len)
+      || base64_decode (d->salt, salt, &salt_len))
+    return holy_errno;
+
+  hash = holy_crypto_lookup_md_by_name (d->hash);
+  if (!hash)
+    return holy_error (holy_ERR_FILE_NOT_FOUND, "Couldn't load %s hash",
+		       d->hash);
+
+  gcry_err = holy_crypto_pbkdf2 (hash, key, key_len, salt, salt_len,
+				 d->iterations, candidate, digest_len);
+  if (gcry_err)
+    return holy_crypto_gcry_error (gcry_err);
+
+  if (holy_memcmp (candidate, digest, digest_len) != 0)
+    return holy_ERR_ACCESS_DENIED;
+  return holy_ERR_NONE;
+}
+
+static holy_err_t
+luks2_recover_key (holy_disk_t source, holy_cryptodisk_t crypt)
+{
+  holy_uint8_t candidate_key[holy_CRYPTODISK_MAX_KEYLEN];
+  char passphrase[MAX_PASSPHRASE] = "";
+  struct luks2_header header;
+  struct luks2_keyslot keyslot;
+  struct luks2_digest digest;
+  struct luks2_segment segment;
+  holy_json_t *json = NULL, keyslots;
+  char *json_header = NULL, *part;
+  holy_size_t json_len, nkeyslots, i;
+  const char *name = NULL;
+  holy_uint64_t priority;
+  gcry_err_code_t gcry_err;
+  holy_err_t err;
+  int found = 0;
+
+  err = luks2_read_header (source, &header, &json_header, &json_len);
+  if (err)
+    return err;
+  err = holy_json_parse (&json, json_header, json_len);
+  if (err)
+    goto out;
+  if (holy_json_getvalue (&keyslots, json, "keyslots")
+      || holy_json_getsize (&nkeyslots, &keyslots))
+    {
+      err = holy_errno;
+      goto out;
+    }
+
+  /* Get the passphrase from the user.  */
+  part = NULL;
+  if (source->partition)
+    part = holy_partition_get_name (source->partition);
+  holy_printf_ (N_("Enter passphrase for %s%s%s (%s): "), source->name,
+		source->partition ? "," : "", part ? : "", crypt->uuid);
+  holy_free (part);
+  if (!holy_password_get (passphrase, MAX_PASSPHRASE))
+    {
+      err = holy_error (holy_ERR_BAD_ARGUMENT, "Passphrase not supplied");
+      goto out;
+    }
+
+  /* Keyslots of high priority first, then the normal ones.  Those of
+     priority 0 are only for explicit use.  */
+  for (priority = 2; priority > 0 && !found; priority--)
+    for (i = 0; i < nkeyslots && !found; i++)
+      {
+	if (luks2_get_keyslot (&keyslot, &digest, &segment, &name, json, i))
+	  {
+	    holy_dprintf ("luks2", "skipping keyslot %" PRIuholy_SIZE ": %s\n",
+			  i, holy_errmsg);
+	    holy_errno = holy_ERR_NONE;
+	    continue;
+	  }
+	if (keyslot.priority != priority)
+	  continue;
+
+	holy_dprintf ("luks2", "Trying keyslot %s\n", name);
+	err = luks2_decrypt_key (candidate_key, source, crypt, &keyslot,
+				 (const holy_uint8_t *) passphrase,
+				 holy_strlen (passphrase));
+	if (!err)
+	  err = luks2_verify_key (&digest, candidate_key, keyslot.key_size);
+	if (err)
+	  {
+	    holy_dprintf ("luks2", "keyslot %s failed\n", name);
+	    /* A wrong passphrase is expected; anything else, such as too
+	       little memory for the KDF, the user should hear about.  */
+	    if (err != holy_ERR_ACCESS_DENIED)
+	      holy_print_error ();
+	    holy_errno = holy_ERR_NONE;
+	    continue;
+	  }
+	found = 1;
+      }
+
+  if (!found)
+    {
+      err = holy_ACCESS_DENIED;
+      goto out;
+    }
+
+  /* TRANSLATORS: It's a cryptographic key slot: one element of an array
+     where each element is either empty or holds a key.  */
+  holy_printf_ (N_("Slot %s opened\n"), name);
+
+  if (segment.sector_size < holy_DISK_SECTOR_SIZE
+      || segment.sector_size > 4096
+      || (segment.sector_size & (segment.sector_size - 1)))
+    {
+      err = holy_error (holy_ERR_BAD_ARGUMENT, "invalid sector size %"
+			PRIuholy_UINT64_T, segment.sector_size);
+      goto out;
+    }
+
+  err = luks2_setcipher (crypt, segment.encryption);
+  if (err)
+    goto out;
+  crypt->log_sector_size = 0;
+  while ((1U << crypt->log_sector_size) < segment.sector_size)
+    crypt->log_sector_size++;
+  crypt->offset = segment.offset >> holy_DISK_SECTOR_BITS;
+  if (holy_strcmp (segment.size, "dynamic") == 0)
+    crypt->total_length = ((holy_disk_get_size (source) - crypt->offset)
+			   >> (crypt->log_sector_size
+			       - holy_DISK_SECTOR_BITS));
+  else
+    {
+      const char *end;
+      holy_uint64_t bytes;
+
+      holy_errno = holy_ERR_NONE;
+      bytes = holy_strtoull (segment.size, (char **) &end, 10);
+      if (holy_errno || *end)
+	{
+	  err = holy_error (holy_ERR_BAD_ARGUMENT, "invalid segment size %s",
+			    segment.size);
+	  goto out;
+	}
+      crypt->total_length = bytes >> crypt->log_sector_size;
+    }
+
+  gcry_err = holy_cryptodisk_setkey (crypt, candidate_key, keyslot.key_size);
+  if (gcry_err)
+    err = holy_crypto_gcry_error (gcry_err);
+
+ out:
+  holy_memset (candidate_key, 0, sizeof (candidate_key));
+  holy_memset (passphrase, 0, sizeof (passphrase));
+  holy_json_free (json);
+  holy_free (json_header);
+  return err;
+}
+
+struct holy_cryptodisk_dev luks2_crypto = {
+  .scan = luks2_scan,
+  .recover_key = luks2_recover_key
+};
+
+holy_MOD_INIT (luks2)
+{
+  COMPILE_TIME_ASSERT (sizeof (struct luks2_header) == 4096);
+  COMPILE_TIME_ASSERT (sizeof (((struct luks2_header *) 0)->uuid)
+		       < holy_CRYPTODISK_MAX_UUID_LENGTH);
+  holy_cryptodisk_dev_register (&luks2_crypto);
+}
+
+holy_MOD_FINI (luks2)
+{
+  holy_cryptodisk_dev_unregister (&luks2_crypto);
+}
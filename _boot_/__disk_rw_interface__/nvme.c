@@ -0,0 +1,914 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+/* NVMe driver.  Each controller gets one I/O queue pair, polled for
+   completions.  Data goes through per-command bounce buffers below 4GiB
+   whose PRP lists are built once, and up to NVME_SLOTS commands are
+   outstanding at a time, so copying one buffer out overlaps with the
+   device filling the others.  */
+
+#include <holy/dl.h>
+#include <holy/disk.h>
+#include <holy/mm.h>
+#include <holy/time.h>
+#include <holy/pci.h>
+#include <holy/misc.h>
+#include <holy/list.h>
+#include <holy/loader.h>
+#include <holy/i18n.h>
+
+holy_MOD_LICENSE ("GPLv2+");
+
+/* Controller registers.  */
+enum
+  {
+    NVME_REG_CAP = 0x00,
+    NVME_REG_VS = 0x08,
+    NVME_REG_CC = 0x14,
+    NVME_REG_CSTS = 0x1c,
+    NVME_REG_AQA = 0x24,
+    NVME_REG_ASQ = 0x28,
+    NVME_REG_ACQ = 0x30,
+    NVME_REG_DOORBELLS = 0x1000
+  };
+
+enum
+  {
+    NVME_CC_EN = 0x1,
+    /* 64-byte submission and 16-byte completion entries.  */
+    NVME_CC_IOSQES = 6 << 16,
+    NVME_CC_IOCQES = 4 << 20
+  };
+
+enum
+  {
+    NVME_CSTS_RDY = 0x1,
+    NVME_CSTS_CFS = 0x2
+  };
+
+enum
+  {
+    NVME_ADMIN_CREATE_SQ = 0x01,
+    NVME_ADMIN_CREATE_CQ = 0x05,
+    NVME_ADMIN_IDENTIFY = 0x06
+  };
+
+enum
+  {
+    NVME_CMD_FLUSH = 0x00,
+    NVME_CMD_WRITE = 0x01,
+    NVME_CMD_READ = 0x02
+  };
+
+enum
+  {
+    NVME_IDENTIFY_NAMESPACE = 0,
+    NVME_IDENTIFY_CONTROLLER = 1
+  };
+
+#define NVME_PAGE_SIZE		4096
+#define NVME_ADMIN_QUEUE_SIZE	8
+#define NVME_IO_QUEUE_SIZE	32
+/* Commands in flight on the I/O queue, each with its own buffer.  */
+#define NVME_SLOTS		8
+#define NVME_SLOT_SIZE		(256 * 1024)
+#define NVME_MAX_NAMESPACES	16
+#define NVME_IO_TIMEOUT		10000
+
+struct holy_nvme_sqe
+{
+  holy_uint32_t cdw0;
+  holy_uint32_t nsid;
+  holy_uint32_t cdw2;
+  holy_uint32_t cdw3;
+  holy_uint64_t mptr;
+  holy_uint64_t prp1;
+  holy_uint64_t prp2;
+  holy_uint32_t cdw10;
+  holy_uint32_t cdw11;
+  holy_uint32_t cdw12;
+  holy_uint32_t cdw13;
+  holy_uint32_t cdw14;
+  holy_uint32_t cdw15;
+} holy_PACKED;
+
+struct holy_nvme_cqe
+{
+  holy_uint32_t dw0;
+  holy_uint32_t dw1;
+  holy_uint16_t sq_head;
+  holy_uint16_t sq_id;
+  holy_uint16_t cid;
+  holy_uint16_t status;
+} holy_PACKED;
+
+struct holy_nvme_queue
+{
+  unsigned id;
+  unsigned size;
+  struct holy_pci_dma_chunk *sq_chunk;
+  volatile struct holy_nvme_sqe *sq;
+  struct holy_pci_dma_chunk *cq_chunk;
+  volatile struct holy_nvme_cqe *cq;
+  unsigned sq_tail;
+  unsigned cq_head;
+  holy_uint16_t phase;
+};
+
+struct holy_nvme_slot
+{
+  int busy;
+  /* Where the data of a finished read goes; NULL for other commands.  */
+  char *dest;
+  holy_size_t len;
+};
+
+struct holy_nvme_ctrl;
+
+struct holy_nvme_ns
+{
+  struct holy_nvme_ctrl *ctrl;
+  holy_uint32_t nsid;
+  holy_uint64_t nsectors;
+  unsigned log_sector_size;
+};
+
+struct holy_nvme_ctrl
+{
+  struct holy_nvme_ctrl *next;
+  struct holy_nvme_ctrl **prev;
+  holy_pci_device_t pcidev;
+  volatile holy_uint8_t *regs;
+  unsigned num;
+  /* Log2 of the doorbell stride in bytes.  */
+  unsigned doorbell_shift;
+  /* Time the controller may take to become ready, in ms.  */
+  holy_uint32_t ready_timeout;
+  holy_uint32_t max_queue_size;
+  struct holy_nvme_queue admin;
+  struct holy_nvme_queue io;
+  /* NVME_PAGE_SIZE bytes for identify data.  */
+  struct holy_pci_dma_chunk *identify_chunk;
+  /* The slot buffers, SLOT_SIZE bytes each, and a PRP list page for
+     each one.  */
+  struct holy_pci_dma_chunk *data_chunk;
+  struct holy_pci_dma_chunk *prp_chunk;
+  holy_size_t slot_size;
+  unsigned nslots;
+  struct holy_nvme_slot slots[NVME_SLOTS];
+  unsigned busy;
+  /* Status and opcode of the first failed command since the last drain,
+     reported by it.  */
+  holy_uint16_t failed_status;
+  holy_uint8_t failed_opcode;
+  /* Set after a timeout; the device may still own the buffers.  */
+  int dead;
+  unsigned nns;
+  struct holy_nvme_ns ns[NVME_MAX_NAMESPACES];
+};
+
+static struct holy_nvme_ctrl *holy_nvme_ctrls;
+static unsigned numctrls;
+
+static inline void
+nvme_barrier (void)
+{
+  __asm__ __volatile__ ("" : : : "memory");
+}
+
+static inline holy_uint32_t
+nvme_read32 (struct holy_nvme_ctrl *ctrl, unsigned reg)
+{
+  return holy_le_to_cpu32 (*(volatile holy_uint32_t *) (ctrl->regs + reg));
+}
+
+static inline void
+nvme_write32 (struct holy_nvme_ctrl *ctrl, unsigned reg, holy_uint32_t val)
+{
+  *(volatile holy_uint32_t *) (ctrl->regs + reg) = holy_cpu_to_le32 (val);
+}
+
+/* 64-bit registers are accessed as two halves, low one first, which
+   every controller has to accept.  */
+static inline holy_uint64_t
+nvme_read64 (struct holy_nvme_ctrl *ctrl, unsigned reg)
+{
+  holy_uint64_t lo = nvme_read32 (ctrl, reg);
+
+  return lo | ((holy_uint64_t) nvme_read32 (ctrl, reg + 4) << 32);
+}
+
+static inline void
+nvme_write64 (struct holy_nvme_ctrl *ctrl, unsigned reg, holy_uint64_t val)
+{
+  nvme_write32 (ctrl, reg, val);
+  nvme_write32 (ctrl, reg + 4, val >> 32);
+}
+
+static inline void
+nvme_ring (struct holy_nvme_ctrl *ctrl, unsigned idx, holy_uint32_t val)
+{
+  nvme_write32 (ctrl, NVME_REG_DOORBELLS + (idx << ctrl->doorbell_shift),
+		val);
+}
+
+static inline char *
+nvme_slot_buf (struct holy_nvme_ctrl *ctrl, unsigned slot)
+{
+  return ((char *) holy_dma_get_virt (ctrl->data_chunk)
+	  + slot * ctrl->slot_size);
+}
+
+static void
+nvme_submit (struct holy_nvme_ctrl *ctrl, struct holy_nvme_queue *q,
+	     const struct holy_nvme_sqe *cmd)
+{
+  q->sq[q->sq_tail] = *cmd;
+  if (++q->sq_tail == q->size)
+    q->sq_tail = 0;
+  nvme_barrier ();
+  nvme_ring (ctrl, 2 * q->id, q->sq_tail);
+}
+
+/* Take the next completion of Q into *CQE, if there is one.  */
+static int
+nvme_reap (struct holy_nvme_ctrl *ctrl, struct holy_nvme_queue *q,
+	   struct holy_nvme_cqe *cqe)
+{
+  volatile struct holy_nvme_cqe *e = &q->cq[q->cq_head];
+
+  if ((holy_le_to_cpu16 (e->status) & 1) != q->phase)
+    return 0;
+  nvme_barrier ();
+  cqe->cid = holy_le_to_cpu16 (e->cid);
+  cqe->status = holy_le_to_cpu16 (e->status);
+  cqe->dw0 = holy_le_to_cpu32 (e->dw0);
+  if (++q->cq_head == q->size)
+    {
+      q->cq_head = 0;
+      q->phase ^= 1;
+    }
+  nvme_ring (ctrl, 2 * q->id + 1, q->cq_head);
+  return 1;
+}
+
+/* Run an admin command and wait for it.  */
+static holy_err_t
+nvme_admin (struct holy_nvme_ctrl *ctrl, struct holy_nvme_sqe *cmd)
+{
+  struct holy_nvme_cqe cqe;
+  holy_uint64_t endtime;
+
+  nvme_submit (ctrl, &ctrl->admin, cmd);
+  endtime = holy_get_time_ms () + NVME_IO_TIMEOUT;
+  while (! nvme_reap (ctrl, &ctrl->admin, &cqe))
+    if (holy_get_time_ms () > endtime)
+      {
+	ctrl->dead = 1;
+	return holy_error (holy_ERR_IO, "NVMe admin command timed out");
+      }
+  if (cqe.status >> 1)
+    return holy_error (holy_ERR_IO, "NVMe admin command 0x%x failed: 0x%x",
+		       holy_le_to_cpu32 (cmd->cdw0) & 0xff, cqe.status >> 1);
+  return holy_ERR_NONE;
+}
+
+static holy_err_t
+nvme_identify (struct holy_nvme_ctrl *ctrl, holy_uint32_t cns,
+	       holy_uint32_t nsid)
+{
+  struct holy_nvme_sqe cmd;
+
+  holy_memset (&cmd, 0, sizeof (cmd));
+  cmd.cdw0 = holy_cpu_to_le32 (NVME_ADMIN_IDENTIFY);
+  cmd.nsid = holy_cpu_to_le32 (nsid);
+  cmd.prp1 = holy_cpu_to_le64 (holy_dma_get_phys (ctrl->identify_chunk));
+  cmd.cdw10 = holy_cpu_to_le32 (cns);
+  return nvme_admin (ctrl, &cmd);
+}
+
+/* Handle the completions that are there.  */
+static void
+nvme_complete (struct holy_nvme_ctrl *ctrl)
+{
+  struct holy_nvme_cqe cqe;
+
+  while (nvme_reap (ctrl, &ctrl->io, &cqe))
+    {
+      struct holy_nvme_slot *s;
+
+      if (cqe.cid >= ctrl->nslots || ! ctrl->slots[cqe.cid].busy)
+	{
+	  holy_dprintf ("nvme", "stray completion %u\n", cqe.cid);
+	  continue;
+	}
+      s = &ctrl->slots[cqe.cid];
+      if (cqe.status >> 1)
+	{
+	  if (! ctrl->failed_status)
+	    ctrl->failed_status = cqe.status >> 1;
+	}
+      else if (s->dest)
+	holy_memcpy (s->dest, nvme_slot_buf (ctrl, cqe.cid), s->len);
+      s->busy = 0;
+      ctrl->busy--;
+    }
+}
+
+/* Return a free slot, waiting for one if need be, or -1 on timeout.  */
+static int
+nvme_get_slot (struct holy_nvme_ctrl *ctrl)
+{
+  holy_uint64_t endtime = 0;
+  unsigned i;
+
+  while (1)
+    {
+      for (i = 0; i < ctrl->nslots; i++)
+	if (! ctrl->slots[i].busy)
+	  return i;
+      nvme_complete (ctrl);
+      if (ctrl->busy < ctrl->nslots)
+	continue;
+      if (! endtime)
+	endtime = holy_get_time_ms () + NVME_IO_TIMEOUT;
+      else if (holy_get_time_ms () > endtime)
+	{
+	  ctrl->dead = 1;
+	  return -1;
+	}
+    }
+}
+
+/* Wait for everything in flight and report the first failure.  */
+static holy_err_t
+nvme_drain (struct holy_nvme_ctrl *ctrl)
+{
+  holy_uint64_t endtime = holy_get_time_ms () + NVME_IO_TIMEOUT;
+  unsigned busy = ctrl->busy;
+  holy_uint16_t status;
+
+  while (ctrl->busy)
+    {
+      nvme_complete (ctrl);
+      if (ctrl->busy != busy)
+	{
+	  busy = ctrl->busy;
+	  endtime = holy_get_time_ms () + NVME_IO_TIMEOUT;
+	}
+      else if (holy_get_time_ms () > endtime)
+	{
+	  ctrl->dead = 1;
+	  return holy_error (holy_ERR_IO, "NVMe command timed out");
+	}
+    }
+
+  status = ctrl->failed_status;
+  ctrl->failed_status = 0;
+  if (status)
+    return holy_error (ctrl->failed_opcode == NVME_CMD_READ
+		       ? holy_ERR_READ_ERROR : holy_ERR_WRITE_ERROR,
+		       N_("NVMe command 0x%x failed: 0x%x"),
+		       ctrl->failed_opcode, status);
+  return holy_ERR_NONE;
+}
+
+/* Start OPCODE on SIZE sectors at SECTOR of NS, split into commands of
+   at most one slot each.  Reads land in BUF once they complete; writes
+   are copied from BUF now.  */
+static holy_err_t
+nvme_queue_rw (struct holy_nvme_ns *ns, holy_uint8_t opcode,
+	       holy_disk_addr_t sector, holy_size_t size, char *buf)
+{
+  struct holy_nvme_ctrl *ctrl = ns->ctrl;
+  holy_size_t max = ctrl->slot_size >> ns->log_sector_size;
+
+  if (ctrl->dead)
+    return holy_error (holy_ERR_IO, "NVMe controller is not responding");
+
+  do
+    {
+      struct holy_nvme_sqe cmd;
+      holy_size_t n = size < max ? size : max;
+      holy_size_t len = n << ns->log_sector_size;
+      holy_uint32_t phys;
+      int slot;
+
+      slot = nvme_get_slot (ctrl);
+      if (slot < 0)
+	return holy_error (holy_ERR_IO, "NVMe command timed out");
+
+      ctrl->slots[slot].busy = 1;
+      ctrl->slots[slot].dest = opcode == NVME_CMD_READ ? buf : NULL;
+      ctrl->slots[slot].len = len;
+      ctrl->busy++;
+      if (! ctrl->failed_status)
+	ctrl->failed_opcode = opcode;
+      if (opcode == NVME_CMD_WRITE)
+	holy_memcpy (nvme_slot_buf (ctrl, slot), buf, len);
+
+      phys = holy_dma_get_phys (ctrl->data_chunk) + slot * ctrl->slot_size;
+      holy_memset (&cmd, 0, sizeof (cmd));
+      cmd.cdw0 = holy_cpu_to_le32 (opcode | (slot << 16));
+      cmd.nsid = holy_cpu_to_le32 (ns->nsid);
+      if (len)
+	{
+	  cmd.prp1 = holy_cpu_to_le64 (phys);
+	  if (len > 2 * NVME_PAGE_SIZE)
+	    cmd.prp2 = holy_cpu_to_le64 (holy_dma_get_phys (ctrl->prp_chunk)
+					 + slot * NVME_PAGE_SIZE);
+	  else if (len > NVME_PAGE_SIZE)
+	    cmd.prp2 = holy_cpu_to_le64 (phys + NVME_PAGE_SIZE);
+	  cmd.cdw10 = holy_cpu_to_le32 (sector);
+	  cmd.cdw11 = holy_cpu_to_le32 ((holy_uint64_t) sector >> 32);
+	  cmd.cdw12 = holy_cpu_to_le32 (n - 1);
+	}
+      nvme_submit (ctrl, &ctrl->io, &cmd);
+
+      sector += n;
+      size -= n;
+      buf += len;
+    }
+  while (size);
+
+  return holy_ERR_NONE;
+}
+
+static void
+nvme_free_chunk (struct holy_pci_dma_chunk **chunk)
+{
+  if (*chunk)
+    holy_dma_free (*chunk);
+  *chunk = NULL;
+}
+
+static void
+nvme_free_dma (struct holy_nvme_ctrl *ctrl)
+{
+  nvme_free_chunk (&ctrl->admin.sq_chunk);
+  nvme_free_chunk (&ctrl->admin.cq_chunk);
+  nvme_free_chunk (&ctrl->io.sq_chunk);
+  nvme_free_chunk (&ctrl->io.cq_chunk);
+  nvme_free_chunk (&ctrl->identify_chunk);
+  nvme_free_chunk (&ctrl->data_chunk);
+  nvme_free_chunk (&ctrl->prp_chunk);
+}
+
+static holy_err_t
+nvme_alloc_queue (struct holy_nvme_queue *q, unsigned id, unsigned size)
+{
+  q->id = id;
+  q->size = size;
+  q->sq_chunk = holy_memalign_dma32 (NVME_PAGE_SIZE,
+				     size * sizeof (struct holy_nvme_sqe));
+  q->cq_chunk = holy_memalign_dma32 (NVME_PAGE_SIZE,
+				     size * sizeof (struct holy_nvme_cqe));
+  if (! q->sq_chunk || ! q->cq_chunk)
+    return holy_errno;
+  q->sq = holy_dma_get_virt (q->sq_chunk);
+  q->cq = holy_dma_get_virt (q->cq_chunk);
+  holy_memset ((void *) q->cq, 0, size * sizeof (struct holy_nvme_cqe));
+  q->sq_tail = 0;
+  q->cq_head = 0;
+  q->phase = 1;
+  return holy_ERR_NONE;
+}
+
+static holy_err_t
+nvme_wait_ready (struct holy_nvme_ctrl *ctrl, int ready)
+{
+  holy_uint64_t endtime = holy_get_time_ms () + ctrl->ready_timeout;
+
+  while (!!(nvme_read32 (ctrl, NVME_REG_CSTS) & NVME_CSTS_RDY) != ready)
+    {
+      if (nvme_read32 (ctrl, NVME_REG_CSTS) & NVME_CSTS_CFS)
+	return holy_error (holy_ERR_IO, "NVMe controller fatal status");
+      if (holy_get_time_ms () > endtime)
+	return holy_error (holy_ERR_IO, "NVMe controller did not become %s",
+			   ready ? "ready" : "idle");
+    }
+  return holy_ERR_NONE;
+}
+
+static holy_err_t
+nvme_disable (struct holy_nvme_ctrl *ctrl)
+{
+  nvme_write32 (ctrl, NVME_REG_CC,
+		nvme_read32 (ctrl, NVME_REG_CC) & ~NVME_CC_EN);
+  return nvme_wait_ready (ctrl, 0);
+}
+
+/* Reset the controller and set up the admin and I/O queues and the slot
+   buffers.  */
+static holy_err_t
+nvme_start (struct holy_nvme_ctrl *ctrl)
+{
+  struct holy_nvme_sqe cmd;
+  holy_uint64_t *prp;
+  unsigned i, j, io_size;
+  holy_err_t err;
+
+  ctrl->dead = 0;
+  ctrl->busy = 0;
+  ctrl->failed_status = 0;
+  for (i = 0; i < NVME_SLOTS; i++)
+    ctrl->slots[i].busy = 0;
+
+  err = nvme_disable (ctrl);
+  if (err)
+    return err;
+
+  io_size = NVME_IO_QUEUE_SIZE;
+  if (io_size > ctrl->max_queue_size)
+    io_size = ctrl->max_queue_size;
+  /* One entry always stays empty.  */
+  ctrl->nslots = io_size - 1 < NVME_SLOTS ? io_size - 1 : NVME_SLOTS;
+
+  if (nvme_alloc_queue (&ctrl->admin, 0, NVME_ADMIN_QUEUE_SIZE)
+      || nvme_alloc_queue (&ctrl->io, 1, io_size))
+    goto fail;
+  ctrl->identify_chunk = holy_memalign_dma32 (NVME_PAGE_SIZE,
+					      NVME_PAGE_SIZE);
+  ctrl->data_chunk = holy_memalign_dma32 (NVME_PAGE_SIZE,
+					  ctrl->nslots * ctrl->slot_size);
+  ctrl->prp_chunk = holy_memalign_dma32 (NVME_PAGE_SIZE,
+					 ctrl->nslots * NVME_PAGE_SIZE);
+  if (! ctrl->identify_chunk || ! ctrl->data_chunk || ! ctrl->prp_chunk)
+    goto fail;
+
+  /* The buffers never move, so their PRP lists are fixed: entry J of
+     slot I points at page J + 1 of its buffer.  */
+  prp = (holy_uint64_t *) holy_dma_get_virt (ctrl->prp_chunk);
+  for (i = 0; i < ctrl->nslots; i++)
+    for (j = 0; j + 1 < ctrl->slot_size / NVME_PAGE_SIZE; j++)
+      prp[i * (NVME_PAGE_SIZE / 8) + j]
+	= holy_cpu_to_le64 (holy_dma_get_phys (ctrl->data_chunk)
+			    + i * ctrl->slot_size
+			    + (j + 1) * NVME_PAGE_SIZE);
+
+  nvme_write32 (ctrl, NVME_REG_AQA, ((NVME_ADMIN_QUEUE_SIZE - 1) << 16)
+		| (NVME_ADMIN_QUEUE_SIZE - 1));
+  nvme_write64 (ctrl, NVME_REG_ASQ, holy_dma_get_phys (ctrl->admin.sq_chunk));
+  nvme_write64 (ctrl, NVME_REG_ACQ, holy_dma_get_phys (ctrl->admin.cq_chunk));
+  nvme_write32 (ctrl, NVME_REG_CC,
+		NVME_CC_EN | NVME_CC_IOSQES | NVME_CC_IOCQES);
+  err = nvme_wait_ready (ctrl, 1);
+  if (err)
+    goto fail_err;
+
+  holy_memset (&cmd, 0, sizeof (cmd));
+  cmd.cdw0 = holy_cpu_to_le32 (NVME_ADMIN_CREATE_CQ);
+  cmd.prp1 = holy_cpu_to_le64 (holy_dma_get_phys (ctrl->io.cq_chunk));
+  cmd.cdw10 = holy_cpu_to_le32 (((io_size - 1) << 16) | ctrl->io.id);
+  /* Physically contiguous, no interrupts.  */
+  cmd.cdw11 = holy_cpu_to_le32 (1);
+  err = nvme_admin (ctrl, &cmd);
+  if (err)
+    goto fail_err;
+
+  holy_memset (&cmd, 0, sizeof (cmd));
+  cmd.cdw0 = holy_cpu_to_le32 (NVME_ADMIN_CREATE_SQ);
+  cmd.prp1 = holy_cpu_to_le64 (holy_dma_get_phys (ctrl->io.sq_chunk));
+  cmd.cdw10 = holy_cpu_to_le32 (((io_size - 1) << 16) | ctrl->io.id);
+  cmd.cdw11 = holy_cpu_to_le32 ((ctrl->io.id << 16) | 1);
+  err = nvme_admin (ctrl, &cmd);
+  if (err)
+    goto fail_err;
+
+  return holy_ERR_NONE;
+
+ fail:
+  err = holy_errno;
+ fail_err:
+  nvme_disable (ctrl);
+  nvme_free_dma (ctrl);
+  return err;
+}
+
+static void
+nvme_scan_namespaces (struct holy_nvme_ctrl *ctrl, holy_uint32_t nn)
+{
+  const holy_uint8_t *id;
+  holy_uint32_t nsid;
+
+  id = (const holy_uint8_t *) holy_dma_get_virt (ctrl->identify_chunk);
+  for (nsid = 1; nsid <= nn && ctrl->nns < NVME_MAX_NAMESPACES; nsid++)
+    {
+      struct holy_nvme_ns *ns = &ctrl->ns[ctrl->nns];
+      holy_uint32_t lbaf;
+      unsigned lbads;
+
+      if (nvme_identify (ctrl, NVME_IDENTIFY_NAMESPACE, nsid))
+	{
+	  holy_errno = holy_ERR_NONE;
+	  continue;
+	}
+      ns->nsectors = holy_le_to_cpu64 (holy_get_unaligned64 (id));
+      if (! ns->nsectors)
+	continue;
+      /* The LBA format in use, FLBAS bits 3:0.  */
+      lbaf = holy_le_to_cpu32 (holy_get_unaligned32 (id + 128
+						      + 4 * (id[26] & 0xf)));
+      lbads = (lbaf >> 16) & 0xff;
+      /* Metadata interleaved with the data is not supported.  */
+      if ((lbaf & 0xffff) || lbads < holy_DISK_SECTOR_BITS || lbads > 14)
+	{
+	  holy_dprintf ("nvme", "nvme%u: skipping namespace %u, LBA format"
+			" 0x%x\n", ctrl->num, nsid, lbaf);
+	  continue;
+	}
+      ns->ctrl = ctrl;
+      ns->nsid = nsid;
+      ns->log_sector_size = lbads;
+      ctrl->nns++;
+      holy_dprintf ("nvme", "nvme%un%u: %llu sectors of %u bytes\n",
+		    ctrl->num, nsid, (unsigned long long) ns->nsectors,
+		    1U << lbads);
+    }
+}
+
+static int
+holy_nvme_pciinit (holy_pci_device_t dev,
+		   holy_pci_id_t pciid __attribute__ ((unused)),
+		   void *data __attribute__ ((unused)))
+{
+  struct holy_nvme_ctrl *ctrl;
+  holy_pci_address_t addr;
+  holy_uint64_t base, cap;
+  holy_uint32_t class, bar, nn;
+  const holy_uint8_t *id;
+  unsigned mdts;
+
+  addr = holy_pci_make_address (dev, holy_PCI_REG_CLASS);
+  class = holy_pci_read (addr);
+  /* Mass storage, non-volatile memory, NVMe.  */
+  if (class >> 8 != 0x010802)
+    return 0;
+
+  addr = holy_pci_make_address (dev, holy_PCI_REG_ADDRESS_REG0);
+  bar = holy_pci_read (addr);
+  if ((bar & holy_PCI_ADDR_SPACE_MASK) != holy_PCI_ADDR_SPACE_MEMORY)
+    return 0;
+  base = bar & holy_PCI_ADDR_MEM_MASK;
+  if ((bar & holy_PCI_ADDR_MEM_TYPE_MASK) == holy_PCI_ADDR_MEM_TYPE_64)
+    {
+      addr = holy_pci_make_address (dev, holy_PCI_REG_ADDRESS_REG1);
+      base |= (holy_uint64_t) holy_pci_read (addr) << 32;
+    }
+  if (base != (holy_addr_t) base)
+    {
+      holy_dprintf ("nvme", "%x:%x.%x: registers out of reach\n",
+		    dev.bus, dev.device, dev.function);
+      return 0;
+    }
+
+  ctrl = holy_zalloc (sizeof (*ctrl));
+  if (! ctrl)
+    {
+      holy_errno = holy_ERR_NONE;
+      return 0;
+    }
+  ctrl->pcidev = dev;
+
+  addr = holy_pci_make_address (dev, holy_PCI_REG_COMMAND);
+  holy_pci_write_word (addr, holy_pci_read_word (addr)
+		       | holy_PCI_COMMAND_MEM_ENABLED
+		       | holy_PCI_COMMAND_BUS_MASTER);
+
+  ctrl->regs = holy_pci_device_map_range (dev, base, NVME_REG_DOORBELLS);
+  cap = nvme_read64 (ctrl, NVME_REG_CAP);
+  ctrl->doorbell_shift = 2 + ((cap >> 32) & 0xf);
+  ctrl->max_queue_size = (cap & 0xffff) + 1;
+  ctrl->ready_timeout = ((cap >> 24) & 0xff) * 500 + 500;
+  holy_pci_device_unmap_range (dev, ctrl->regs, NVME_REG_DOORBELLS);
+  ctrl->regs = holy_pci_device_map_range (dev, base, NVME_REG_DOORBELLS
+					  + (4 << ctrl->doorbell_shift));
+
+  holy_dprintf ("nvme", "%x:%x.%x: version 0x%x, cap 0x%llx\n",
+		dev.bus, dev.device, dev.function,
+		nvme_read32 (ctrl, NVME_REG_VS), (unsigned long long) cap);
+
+  /* NVM command set and 4KiB pages.  */
+  if (! ((cap >> 37) & 1) || ((cap >> 48) & 0xf) || ctrl->max_queue_size < 2)
+    {
+      holy_dprintf ("nvme", "unsupported controller\n");
+      goto fail_unmap;
+    }
+
+  /* The slot size is not known before identify, which needs a slot-sized
+     allocation to have been made already; start small.  */
+  ctrl->slot_size = NVME_PAGE_SIZE;
+  if (nvme_start (ctrl))
+    goto fail;
+
+  if (nvme_identify (ctrl, NVME_IDENTIFY_CONTROLLER, 0))
+    goto fail_started;
+  id = (const holy_uint8_t *) holy_dma_get_virt (ctrl->identify_chunk);
+  mdts = id[77];
+  nn = holy_le_to_cpu32 (holy_get_unaligned32 (id + 516));
+
+  ctrl->slot_size = NVME_SLOT_SIZE;
+  if (mdts && (NVME_PAGE_SIZE << mdts) < NVME_SLOT_SIZE)
+    ctrl->slot_size = NVME_PAGE_SIZE << mdts;
+  nvme_free_dma (ctrl);
+  if (nvme_start (ctrl))
+    goto fail;
+
+  ctrl->num = numctrls++;
+  nvme_scan_namespaces (ctrl, nn);
+  holy_dprintf ("nvme", "nvme%u: %u namespaces, %u commands of %u KiB\n",
+		ctrl->num, ctrl->nns, ctrl->nslots,
+		(unsigned) (ctrl->slot_size >> 10));
+
+  holy_list_push (holy_AS_LIST_P (&holy_nvme_ctrls), holy_AS_LIST (ctrl));
+  return 0;
+
+ fail_started:
+  nvme_disable (ctrl);
+  nvme_free_dma (ctrl);
+ fail:
+  holy_dprintf ("nvme", "%x:%x.%x: %s\n", dev.bus, dev.device, dev.function,
+		holy_errmsg);
+  holy_errno = holy_ERR_NONE;
+ fail_unmap:
+  holy_pci_device_unmap_range (dev, ctrl->regs, NVME_REG_DOORBELLS
+			       + (4 << ctrl->doorbell_shift));
+  holy_free (ctrl);
+  return 0;
+}
+
+static int
+holy_nvme_iterate (holy_disk_dev_iterate_hook_t hook, void *hook_data,
+		   holy_disk_pull_t pull)
+{
+  struct holy_nvme_ctrl *ctrl;
+  char name[32];
+  unsigned i;
+
+  if (pull != holy_DISK_PULL_NONE)
+    return 0;
+
+  FOR_LIST_ELEMENTS (ctrl, holy_nvme_ctrls)
+    for (i = 0; i < ctrl->nns; i++)
+      {
+	holy_snprintf (name, sizeof (name), "nvme%un%u", ctrl->num,
+		       ctrl->ns[i].nsid);
+	if (hook (name, hook_data))
+	  return 1;
+      }
+  return 0;
+}
+
+static holy_err_t
+holy_nvme_open (const char *name, holy_disk_t disk)
+{
+  struct holy_nvme_ctrl *ctrl;
+  unsigned long num, nsid;
+  const char *p;
+  char *end;
+  unsigned i;
+
+  if (holy_strncmp (name, "nvme", 4) != 0 || ! holy_isdigit (name[4]))
+    return holy_error (holy_ERR_UNKNOWN_DEVICE, "not an NVMe disk");
+  num = holy_strtoul (name + 4, &end, 10);
+  p = end;
+  if (*p != 'n' || ! holy_isdigit (p[1]))
+    return holy_error (holy_ERR_UNKNOWN_DEVICE, "not an NVMe disk");
+  nsid = holy_strtoul (p + 1, &end, 10);
+  if (*end)
+    return holy_error (holy_ERR_UNKNOWN_DEVICE, "not an NVMe disk");
+
+  FOR_LIST_ELEMENTS (ctrl, holy_nvme_ctrls)
+    if (ctrl->num == num)
+      break;
+  if (! ctrl)
+    return holy_error (holy_ERR_UNKNOWN_DEVICE, "no such NVMe controller");
+  for (i = 0; i < ctrl->nns; i++)
+    if (ctrl->ns[i].nsid == nsid)
+      break;
+  if (i == ctrl->nns)
+    return holy_error (holy_ERR_UNKNOWN_DEVICE, "no such NVMe namespace");
+
+  disk->total_sectors = ctrl->ns[i].nsectors;
+  disk->log_sector_size = ctrl->ns[i].log_sector_size;
+  disk->max_agglomerate = holy_DISK_MAX_MAX_AGGLOMERATE;
+  disk->id = (num << 16) | nsid;
+  disk->data = &ctrl->ns[i];
+  return holy_ERR_NONE;
+}
+
+static holy_err_t
+holy_nvme_read_submit (holy_disk_t disk, holy_disk_addr_t sector,
+		       holy_size_t size, char *buf)
+{
+  return nvme_queue_rw (disk->data, NVME_CMD_READ, sector, size, buf);
+}
+
+static holy_err_t
+holy_nvme_read_wait (holy_disk_t disk)
+{
+  struct holy_nvme_ns *ns = disk->data;
+
+  return nvme_drain (ns->ctrl);
+}
+
+static holy_err_t
+holy_nvme_read (holy_disk_t disk, holy_disk_addr_t sector,
+		holy_size_t size, char *buf)
+{
+  struct holy_nvme_ns *ns = disk->data;
+  holy_err_t err, werr;
+
+  err = nvme_queue_rw (ns, NVME_CMD_READ, sector, size, buf);
+  werr = nvme_drain (ns->ctrl);
+  return err ? err : werr;
+}
+
+static holy_err_t
+holy_nvme_write (holy_disk_t disk, holy_disk_addr_t sector,
+		 holy_size_t size, const char *buf)
+{
+  struct holy_nvme_ns *ns = disk->data;
+  holy_err_t err;
+
+  err = nvme_queue_rw (ns, NVME_CMD_WRITE, sector, size, (char *) buf);
+  if (! err)
+    err = nvme_drain (ns->ctrl);
+  if (! err)
+    err = nvme_queue_rw (ns, NVME_CMD_FLUSH, 0, 0, NULL);
+  if (! err)
+    err = nvme_drain (ns->ctrl);
+  else
+    nvme_drain (ns->ctrl);
+  return err;
+}
+
+static holy_err_t
+holy_nvme_fini_hw (int noreturn __attribute__ ((unused)))
+{
+  struct holy_nvme_ctrl *ctrl;
+
+  FOR_LIST_ELEMENTS (ctrl, holy_nvme_ctrls)
+    {
+      if (nvme_disable (ctrl))
+	{
+	  holy_dprintf ("nvme", "nvme%u: %s\n", ctrl->num, holy_errmsg);
+	  holy_errno = holy_ERR_NONE;
+	}
+      nvme_free_dma (ctrl);
+    }
+  return holy_ERR_NONE;
+}
+
+static holy_err_t
+holy_nvme_restore_hw (void)
+{
+  struct holy_nvme_ctrl *ctrl;
+
+  FOR_LIST_ELEMENTS (ctrl, holy_nvme_ctrls)
+    if (nvme_start (ctrl))
+      {
+	holy_dprintf ("nvme", "nvme%u: %s\n", ctrl->num, holy_errmsg);
+	holy_errno = holy_ERR_NONE;
+	ctrl->dead = 1;
+      }
+  return holy_ERR_NONE;
+}
+
+static struct holy_disk_dev holy_nvme_dev =
+  {
+    .name = "nvme",
+    .id = holy_DISK_DEVICE_NVME_ID,
+    .iterate = holy_nvme_iterate,
+    .open = holy_nvme_open,
+    .read = holy_nvme_read,
+    .write = holy_nvme_write,
+    .read_submit = holy_nvme_read_submit,
+    .read_wait = holy_nvme_read_wait,
+    .next = 0
+  };
+
+static struct holy_preboot *fini_hnd;
+
+holy_MOD_INIT(nvme)
+{
+  holy_stop_disk_firmware ();
+
+  holy_pci_iterate (holy_nvme_pciinit, NULL);
+
+  holy_disk_dev_register (&holy_nvme_dev);
+
+  fini_hnd = holy_loader_register_preboot_hook (holy_nvme_fini_hw,
+						holy_nvme_restore_hw,
+						holy_LOADER_PREBOOT_HOOK_PRIO_DISK);
+}
+
+holy_MOD_FINI(nvme)
+{
+  holy_nvme_fini_hw (0);
+  holy_loader_unregister_preboot_hook (fini_hnd);
+
+  holy_disk_dev_unregister (&holy_nvme_dev);
+}
@@ -9,56 +9,10 @@
 #include <holy/err.h>
 #include <holy/misc.h>
 #include <holy/diskfilter.h>
-#include <holy/crypto.h>
+#include <holy/gf256.h>
 
 holy_MOD_LICENSE ("GPLv2+");
 
-/* x**y.  */
-static holy_uint8_t powx[255 * 2];
-/* Such an s that x**s = y */
-static unsigned powx_inv[256];
-static const holy_uint8_t poly = 0x1d;
-
-static void
-holy_raid_block_mulx (unsigned mul, char *buf, holy_size_t size)
-{
-  holy_size_t i;
-  holy_uint8_t *p;
-
-  p = (holy_uint8_t *) buf;
-  for (i = 0; i < size; i++, p++)
-    if (*p)
-      *p = powx[mul + powx_inv[*p]];
-}
-
-static void
-holy_raid6_init_table (void)
-{
-  unsigned i;
-
-  holy_uint8_t cur = 1;
-  for (i = 0; i < 255; i++)
-    {
-      powx[i] = cur;
-      powx[i + 255] = cur;
-      powx_inv[cur] = i;
-      if (cur & 0x80)
-	cur = (cur << 1) ^ poly;
-      else
-	cur <<= 1;
-    }
-}
-
-static unsigned
-mod_255 (unsigned x)
-{
-  while (x > 0xff)
-    x = (x >> 8) + (x & 0xff);
-  if (x == 0xff)
-    return 0;
-  return x;
-}
-
 static holy_err_t
 holy_raid6_recover (struct holy_diskfilter_segment *array, int disknr, int p,
                     char *buf, holy_disk_addr_t sector, holy_size_t size)
@@ -98,9 +52,9 @@ holy_raid6_recover (struct holy_diskfilter_segment *array, int disknr, int p,
           if (! holy_diskfilter_read_node (&array->nodes[pos], sector,
 					   size >> holy_DISK_SECTOR_BITS, buf))
             {
-              holy_crypto_xor (pbuf, pbuf, buf, size);
-              holy_raid_block_mulx (c, buf, size);
-              holy_crypto_xor (qbuf, qbuf, buf, size);
+              holy_gf256_xor_block (pbuf, buf, size);
+              holy_gf256_muladd_block (qbuf, buf, holy_gf256_exp (c),
+				       size);
             }
           else
             {
@@ -128,7 +82,7 @@ holy_raid6_recover (struct holy_diskfilter_segment *array, int disknr, int p,
       if ((! holy_diskfilter_read_node (&array->nodes[p], sector,
 					size >> holy_DISK_SECTOR_BITS, buf)))
         {
-          holy_crypto_xor (buf, buf, pbuf, size);
+          holy_gf256_xor_block (buf, pbuf, size);
           goto quit;
         }
 
@@ -137,9 +91,8 @@ holy_raid6_recover (struct holy_diskfilter_segment *array, int disknr, int p,
 				     size >> holy_DISK_SECTOR_BITS, buf))
         goto quit;
 
-      holy_crypto_xor (buf, buf, qbuf, size);
-      holy_raid_block_mulx (255 - bad1, buf,
-                           size);
+      holy_gf256_xor_block (buf, qbuf, size);
+      holy_gf256_mul_block (buf, holy_gf256_exp (255 - bad1), size);
     }
   else
     {
@@ -150,22 +103,24 @@ holy_raid6_recover (struct holy_diskfilter_segment *array, int disknr, int p,
 				     size >> holy_DISK_SECTOR_BITS, buf))
         goto quit;
 
-      holy_crypto_xor (pbuf, pbuf, buf, size);
+      holy_gf256_xor_block (pbuf, buf, size);
 
       if (holy_diskfilter_read_node (&array->nodes[q], sector,
 				     size >> holy_DISK_SECTOR_BITS, buf))
         goto quit;
 
-      holy_crypto_xor (qbuf, qbuf, buf, size);
+      holy_gf256_xor_block (qbuf, buf, size);
 
-      c = mod_255((255 ^ bad1)
-		  + (255 ^ powx_inv[(powx[bad2 + (bad1 ^ 255)] ^ 1)]));
-      holy_raid_block_mulx (c, qbuf, size);
+      /* Exponents are reduced modulo 255 by holy_gf256_exp.  */
+      c = ((255 ^ bad1)
+	   + (255 ^ holy_gf256_log (holy_gf256_exp (bad2 + (bad1 ^ 255))
+				    ^ 1)));
+      holy_gf256_mul_block (qbuf, holy_gf256_exp (c), size);
 
-      c = mod_255((unsigned) bad2 + c);
-      holy_raid_block_mulx (c, pbuf, size);
+      holy_gf256_mul_block (pbuf, holy_gf256_exp ((unsigned) bad2 + c),
+			    size);
 
-      holy_crypto_xor (pbuf, pbuf, qbuf, size);
+      holy_gf256_xor_block (pbuf, qbuf, size);
       holy_memcpy (buf, pbuf, size);
     }
 
@@ -178,7 +133,6 @@ quit:
 
 holy_MOD_INIT(raid6rec)
 {
-  holy_raid6_init_table ();
   holy_raid6_recover_func = holy_raid6_recover;
 }
 
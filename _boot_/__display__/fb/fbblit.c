@@ -6,6 +6,7 @@
 #include <holy/video_fb.h>
 #include <holy/fbblit.h>
 #include <holy/fbutil.h>
+#include <holy/fbsimd.h>
 #include <holy/misc.h>
 #include <holy/types.h>
 #include <holy/video.h>
@@ -743,48 +744,18 @@ holy_video_fbblit_replace_BGRX8888_RGBX8888 (struct holy_video_fbblit_info *dst,
 					     int width, int height,
 					     int offset_x, int offset_y)
 {
-  int i;
   int j;
-  holy_uint8_t *srcptr;
-  holy_uint8_t *dstptr;
-  unsigned int srcrowskip;
-  unsigned int dstrowskip;
-
-  /* Calculate the number of bytes to advance from the end of one line
-     to the beginning of the next line.  */
-  srcrowskip = src->mode_info->pitch - src->mode_info->bytes_per_pixel * width;
-  dstrowskip = dst->mode_info->pitch - dst->mode_info->bytes_per_pixel * width;
+  holy_uint32_t *srcptr;
+  holy_uint32_t *dstptr;
 
   srcptr = holy_video_fb_get_video_ptr (src, offset_x, offset_y);
   dstptr = holy_video_fb_get_video_ptr (dst, x, y);
 
   for (j = 0; j < height; j++)
     {
-      for (i = 0; i < width; i++)
-        {
-#ifdef holy_CPU_WORDS_BIGENDIAN
-          holy_uint8_t a = *srcptr++;
-#endif
-          holy_uint8_t r = *srcptr++;
-          holy_uint8_t g = *srcptr++;
-          holy_uint8_t b = *srcptr++;
-#ifndef holy_CPU_WORDS_BIGENDIAN
-          holy_uint8_t a = *srcptr++;
-#endif
-
-#ifdef holy_CPU_WORDS_BIGENDIAN
-          *dstptr++ = a;
-#endif
-          *dstptr++ = b;
-          *dstptr++ = g;
-          *dstptr++ = r;
-#ifndef holy_CPU_WORDS_BIGENDIAN
-          *dstptr++ = a;
-#endif
-        }
-
-      srcptr += srcrowskip;
-      dstptr += dstrowskip;
+      holy_video_fb_swap_rb32 (dstptr, srcptr, width);
+      holy_VIDEO_FB_ADVANCE_POINTER (srcptr, src->mode_info->pitch);
+      holy_VIDEO_FB_ADVANCE_POINTER (dstptr, dst->mode_info->pitch);
     }
 }
 
@@ -1121,20 +1092,6 @@ holy_video_fbblit_replace_index_RGB888 (struct holy_video_fbblit_info *dst,
     }
 }
 
-static inline holy_uint8_t
-alpha_dilute (holy_uint8_t bg, holy_uint8_t fg, holy_uint8_t alpha)
-{
-  holy_uint16_t s;
-  holy_uint16_t h, l;
-  s = (fg * alpha) + (bg * (255 ^ alpha));
-  /* Optimised division by 255.  */
-  h = s >> 8;
-  l = s & 0xff;
-  if (h + l >= 255)
-    h++;
-  return h;
-}
-
 /* Generic blending blitter.  Works for every supported format.  */
 static void
 holy_video_fbblit_blend (struct holy_video_fbblit_info *dst,
@@ -1201,76 +1158,18 @@ holy_video_fbblit_blend_BGRA8888_RGBA8888 (struct holy_video_fbblit_info *dst,
 					   int width, int height,
 					   int offset_x, int offset_y)
 {
+  int j;
   holy_uint32_t *srcptr;
   holy_uint32_t *dstptr;
-  unsigned int srcrowskip;
-  unsigned int dstrowskip;
-  int i;
-  int j;
-
-  /* Calculate the number of bytes to advance from the end of one line
-     to the beginning of the next line.  */
-  srcrowskip = src->mode_info->pitch - src->mode_info->bytes_per_pixel * width;
-  dstrowskip = dst->mode_info->pitch - dst->mode_info->bytes_per_pixel * width;
 
   srcptr = holy_video_fb_get_video_ptr (src, offset_x, offset_y);
   dstptr = holy_video_fb_get_video_ptr (dst, x, y);
 
   for (j = 0; j < height; j++)
     {
-      for (i = 0; i < width; i++)
-        {
-          holy_uint32_t color;
-          unsigned int sr;
-          unsigned int sg;
-          unsigned int sb;
-          unsigned int a;
-          unsigned int dr;
-          unsigned int dg;
-          unsigned int db;
-
-          color = *srcptr++;
-
-          a = color >> 24;
-
-          if (a == 0)
-            {
-              /* Skip transparent source pixels.  */
-              dstptr++;
-              continue;
-            }
-
-          sr = (color >> 0) & 0xFF;
-          sg = (color >> 8) & 0xFF;
-          sb = (color >> 16) & 0xFF;
-
-          if (a == 255)
-            {
-              /* Opaque pixel shortcut.  */
-              dr = sr;
-              dg = sg;
-              db = sb;
-            }
-          else
-            {
-              /* General pixel color blending.  */
-              color = *dstptr;
-
-              dr = (color >> 16) & 0xFF;
-              dr = alpha_dilute (dr, sr, a);
-              dg = (color >> 8) & 0xFF;
-              dg = alpha_dilute (dg, sg, a);
-              db = (color >> 0) & 0xFF;
-              db = alpha_dilute (db, sb, a);
-            }
-
-          color = (a << 24) | (dr << 16) | (dg << 8) | db;
-
-          *dstptr++ = color;
-        }
-
-      holy_VIDEO_FB_ADVANCE_POINTER (srcptr, srcrowskip);
-      holy_VIDEO_FB_ADVANCE_POINTER (dstptr, dstrowskip);
+      holy_video_fb_blend32 (dstptr, srcptr, width, 1);
+      holy_VIDEO_FB_ADVANCE_POINTER (srcptr, src->mode_info->pitch);
+      holy_VIDEO_FB_ADVANCE_POINTER (dstptr, dst->mode_info->pitch);
     }
 }
 
@@ -1376,67 +1275,18 @@ holy_video_fbblit_blend_RGBA8888_RGBA8888 (struct holy_video_fbblit_info *dst,
 					   int width, int height,
 					   int offset_x, int offset_y)
 {
-  holy_uint32_t color;
-  int i;
   int j;
   holy_uint32_t *srcptr;
   holy_uint32_t *dstptr;
-  unsigned int sr;
-  unsigned int sg;
-  unsigned int sb;
-  unsigned int a;
-  unsigned int dr;
-  unsigned int dg;
-  unsigned int db;
-  holy_size_t srcrowskip;
-  holy_size_t dstrowskip;
-
-  srcrowskip = src->mode_info->pitch - 4 * width;
-  dstrowskip = dst->mode_info->pitch - 4 * width;
 
   srcptr = holy_video_fb_get_video_ptr (src, offset_x, offset_y);
   dstptr = holy_video_fb_get_video_ptr (dst, x, y);
 
   for (j = 0; j < height; j++)
     {
-      for (i = 0; i < width; i++)
-        {
-          color = *srcptr++;
-
-          a = color >> 24;
-
-          if (a == 0)
-            {
-              dstptr++;
-              continue;
-            }
-
-          if (a == 255)
-            {
-              *dstptr++ = color;
-              continue;
-            }
-
-          sr = (color >> 0) & 0xFF;
-          sg = (color >> 8) & 0xFF;
-          sb = (color >> 16) & 0xFF;
-
-          color = *dstptr;
-
-          dr = (color >> 0) & 0xFF;
-          dg = (color >> 8) & 0xFF;
-          db = (color >> 16) & 0xFF;
-
-          dr = alpha_dilute (dr, sr, a);
-          dg = alpha_dilute (dg, sg, a);
-          db = alpha_dilute (db, sb, a);
-
-          color = (a << 24) | (db << 16) | (dg << 8) | dr;
-
-          *dstptr++ = color;
-        }
-      holy_VIDEO_FB_ADVANCE_POINTER (srcptr, srcrowskip);
-      holy_VIDEO_FB_ADVANCE_POINTER (dstptr, dstrowskip);
+      holy_video_fb_blend32 (dstptr, srcptr, width, 0);
+      holy_VIDEO_FB_ADVANCE_POINTER (srcptr, src->mode_info->pitch);
+      holy_VIDEO_FB_ADVANCE_POINTER (dstptr, dst->mode_info->pitch);
     }
 }
 
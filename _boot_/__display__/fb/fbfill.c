@@ -6,6 +6,7 @@
 #include <holy/video_fb.h>
 #include <holy/fbfill.h>
 #include <holy/fbutil.h>
+#include <holy/fbsimd.h>
 #include <holy/types.h>
 #include <holy/video.h>
 
@@ -30,25 +31,18 @@ holy_video_fbfill_direct32 (struct holy_video_fbblit_info *dst,
 			    holy_video_color_t color, int x, int y,
 			    int width, int height)
 {
-  int i;
   int j;
   holy_uint32_t *dstptr;
-  holy_size_t rowskip;
-
-  /* Calculate the number of bytes to advance from the end of one line
-     to the beginning of the next line.  */
-  rowskip = dst->mode_info->pitch - dst->mode_info->bytes_per_pixel * width;
 
   /* Get the start address.  */
   dstptr = holy_video_fb_get_video_ptr (dst, x, y);
 
   for (j = 0; j < height; j++)
     {
-      for (i = 0; i < width; i++)
-        *dstptr++ = color;
+      holy_video_fb_fill32 (dstptr, color, width);
 
-      /* Advance the dest pointer to the right location on the next line.  */
-      holy_VIDEO_FB_ADVANCE_POINTER (dstptr, rowskip);
+      /* Advance the dest pointer to the start of the next line.  */
+      holy_VIDEO_FB_ADVANCE_POINTER (dstptr, dst->mode_info->pitch);
     }
 }
 
@@ -0,0 +1,278 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+/* The 32-bit replace, blend and fill kernels.  The vector versions work
+   on 16-bit lanes holding every other byte of a pixel, so the products of
+   the blend need no unpacking, and then divide by 255 the same way
+   alpha_dilute does, which keeps them pixel-exact with the generic code.
+   Runs of fully transparent or fully opaque source pixels skip the
+   arithmetic, and transparent ones skip reading the destination too.  */
+
+#include <holy/types.h>
+#include <holy/misc.h>
+#include <holy/fbutil.h>
+#include <holy/fbsimd.h>
+#include <holy/cpu_impl.h>
+
+#ifdef __x86_64__
+#define FB_SIMD	1
+#endif
+
+struct fb_simd_impl
+{
+  struct holy_cpu_impl cpu;
+  void (*swap_rb) (holy_uint32_t *dst, const holy_uint32_t *src,
+		   unsigned int n);
+  void (*blend) (holy_uint32_t *dst, const holy_uint32_t *src,
+		 unsigned int n, int swap_rb);
+  void (*fill) (holy_uint32_t *dst, holy_uint32_t color, unsigned int n);
+};
+
+static const struct fb_simd_impl *impl;
+
+static void fb_simd_probe (void);
+
+static inline void
+fb_simd_init (void)
+{
+  if (!impl)
+    fb_simd_probe ();
+}
+
+static inline holy_uint32_t
+swap_rb_pixel (holy_uint32_t color)
+{
+  return ((color & 0xff00ff00) | ((color >> 16) & 0xff)
+	  | ((color & 0xff) << 16));
+}
+
+static inline holy_uint32_t
+blend_pixel (holy_uint32_t dst, holy_uint32_t src)
+{
+  unsigned int a = src >> 24;
+
+  if (a == 0)
+    return dst;
+  if (a == 255)
+    return src;
+  return ((a << 24)
+	  | (alpha_dilute ((dst >> 16) & 0xff, (src >> 16) & 0xff, a) << 16)
+	  | (alpha_dilute ((dst >> 8) & 0xff, (src >> 8) & 0xff, a) << 8)
+	  | alpha_dilute (dst & 0xff, src & 0xff, a));
+}
+
+static void
+generic_swap_rb (holy_uint32_t *dst, const holy_uint32_t *src, unsigned int n)
+{
+  for (; n; n--)
+    *dst++ = swap_rb_pixel (*src++);
+}
+
+static void
+generic_blend (holy_uint32_t *dst, const holy_uint32_t *src, unsigned int n,
+	       int swap_rb)
+{
+  for (; n; n--, src++, dst++)
+    {
+      holy_uint32_t color = *src;
+
+      if ((color >> 24) == 0)
+	continue;
+      *dst = blend_pixel (*dst, swap_rb ? swap_rb_pixel (color) : color);
+    }
+}
+
+static void
+generic_fill (holy_uint32_t *dst, holy_uint32_t color, unsigned int n)
+{
+  for (; n; n--)
+    *dst++ = color;
+}
+
+#ifdef FB_SIMD
+#define SSE2_FN		__attribute__ ((target ("sse2")))
+#define AVX2_FN		__attribute__ ((target ("avx2")))
+
+typedef holy_uint32_t v4su __attribute__ ((vector_size (16)));
+typedef holy_uint16_t v8hu __attribute__ ((vector_size (16)));
+typedef holy_int16_t v8hi __attribute__ ((vector_size (16)));
+typedef char v16qi __attribute__ ((vector_size (16)));
+typedef holy_uint32_t v8su __attribute__ ((vector_size (32)));
+typedef holy_uint16_t v16hu __attribute__ ((vector_size (32)));
+typedef holy_int16_t v16hi __attribute__ ((vector_size (32)));
+typedef char v32qi __attribute__ ((vector_size (32)));
+
+/* Define the kernels of PREFIX on vectors of type U32, viewed as U16 and
+   S16 for the arithmetic.  MOVEMASK gathers the top bit of each byte.  */
+#define FB_SIMD_KERNELS(PREFIX, FN, U32, U16, S16, MOVEMASK)		\
+static inline FN U32							\
+PREFIX##_load (const void *p)						\
+{									\
+  U32 v;								\
+									\
+  __builtin_memcpy (&v, p, sizeof (v));					\
+  return v;								\
+}									\
+									\
+static inline FN void							\
+PREFIX##_store (void *p, U32 v)						\
+{									\
+  __builtin_memcpy (p, &v, sizeof (v));					\
+}									\
+									\
+static inline FN U32							\
+PREFIX##_swap (U32 v)							\
+{									\
+  return (v & 0xff00ff00) | ((v >> 16) & 0xff) | ((v & 0xff) << 16);	\
+}									\
+									\
+/* T / 255 for T <= 255 * 255, as alpha_dilute computes it.  */	\
+static inline FN U16							\
+PREFIX##_div255 (U16 t)							\
+{									\
+  U16 h = t >> 8;							\
+									\
+  return h - (U16) ((S16) (h + (t & 0xff)) > 254);			\
+}									\
+									\
+static FN void								\
+PREFIX##_swap_rb (holy_uint32_t *dst, const holy_uint32_t *src,		\
+		  unsigned int n)					\
+{									\
+  const unsigned int w = sizeof (U32) / 4;				\
+									\
+  for (; n >= 2 * w; n -= 2 * w, src += 2 * w, dst += 2 * w)		\
+    {									\
+      U32 v0 = PREFIX##_load (src), v1 = PREFIX##_load (src + w);	\
+									\
+      PREFIX##_store (dst, PREFIX##_swap (v0));				\
+      PREFIX##_store (dst + w, PREFIX##_swap (v1));			\
+    }									\
+  generic_swap_rb (dst, src, n);					\
+}									\
+									\
+static FN void								\
+PREFIX##_blend (holy_uint32_t *dst, const holy_uint32_t *src,		\
+		unsigned int n, int swap_rb)				\
+{									\
+  const unsigned int w = sizeof (U32) / 4;				\
+  const int all = (int) ((1ULL << sizeof (U32)) - 1);			\
+									\
+  for (; n >= w; n -= w, src += w, dst += w)				\
+    {									\
+      U32 s = PREFIX##_load (src), d, a, clear, r;			\
+      U16 as, ad, even, odd;						\
+									\
+      if (swap_rb)							\
+	s = PREFIX##_swap (s);						\
+      a = s >> 24;							\
+      clear = (U32) (a == 0);						\
+      if (MOVEMASK (clear) == all)					\
+	continue;							\
+      if (MOVEMASK ((U32) (a == 255)) == all)				\
+	{								\
+	  PREFIX##_store (dst, s);					\
+	  continue;							\
+	}								\
+									\
+      /* Each 16-bit lane gets the alpha of its pixel.  */		\
+      as = (U16) (a | (a << 16));					\
+      ad = 255 - as;							\
+      d = PREFIX##_load (dst);						\
+      even = PREFIX##_div255 (((U16) s & 0xff) * as			\
+			      + ((U16) d & 0xff) * ad);			\
+      odd = PREFIX##_div255 (((U16) s >> 8) * as + ((U16) d >> 8) * ad); \
+      r = (U32) (even | (odd << 8));					\
+      r = (r & 0x00ffffff) | (s & 0xff000000);				\
+      PREFIX##_store (dst, (d & clear) | (r & ~clear));			\
+    }									\
+  generic_blend (dst, src, n, swap_rb);					\
+}									\
+									\
+static FN void								\
+PREFIX##_fill (holy_uint32_t *dst, holy_uint32_t color, unsigned int n)	\
+{									\
+  const unsigned int w = sizeof (U32) / 4;				\
+  U32 v = (U32) {} + color;						\
+									\
+  for (; n >= 4 * w; n -= 4 * w, dst += 4 * w)				\
+    {									\
+      PREFIX##_store (dst, v);						\
+      PREFIX##_store (dst + w, v);					\
+      PREFIX##_store (dst + 2 * w, v);					\
+      PREFIX##_store (dst + 3 * w, v);					\
+    }									\
+  for (; n >= w; n -= w, dst += w)					\
+    PREFIX##_store (dst, v);						\
+  generic_fill (dst, color, n);						\
+}
+
+#define SSE2_MOVEMASK(v)	__builtin_ia32_pmovmskb128 ((v16qi) (v))
+#define AVX2_MOVEMASK(v)	__builtin_ia32_pmovmskb256 ((v32qi) (v))
+
+FB_SIMD_KERNELS (sse2, SSE2_FN, v4su, v8hu, v8hi, SSE2_MOVEMASK)
+FB_SIMD_KERNELS (avx2, AVX2_FN, v8su, v16hu, v16hi, AVX2_MOVEMASK)
+
+#endif
+
+static const struct fb_simd_impl impls[] =
+  {
+#ifdef FB_SIMD
+    { { "avx2", holy_CPU_AVX2 }, avx2_swap_rb, avx2_blend, avx2_fill },
+    { { "sse2", holy_CPU_SSE2 }, sse2_swap_rb, sse2_blend, sse2_fill },
+#endif
+    { { "generic", 0 }, generic_swap_rb, generic_blend, generic_fill },
+  };
+
+static void
+fb_simd_probe (void)
+{
+  impl = holy_cpu_impl_find (impls, ARRAY_SIZE (impls), sizeof (impls[0]),
+			     NULL);
+}
+
+int
+holy_video_fb_simd_select (const char *name)
+{
+  const void *found;
+
+  found = holy_cpu_impl_find (impls, ARRAY_SIZE (impls), sizeof (impls[0]),
+			      name);
+  if (!found)
+    return -1;
+  impl = found;
+  return 0;
+}
+
+const char *
+holy_video_fb_simd_implementation (void)
+{
+  fb_simd_init ();
+  return impl->cpu.name;
+}
+
+void
+holy_video_fb_swap_rb32 (holy_uint32_t *dst, const holy_uint32_t *src,
+			 unsigned int n)
+{
+  fb_simd_init ();
+  impl->swap_rb (dst, src, n);
+}
+
+void
+holy_video_fb_blend32 (holy_uint32_t *dst, const holy_uint32_t *src,
+		       unsigned int n, int swap_rb)
+{
+  fb_simd_init ();
+  impl->blend (dst, src, n, swap_rb);
+}
+
+void
+holy_video_fb_fill32 (holy_uint32_t *dst, holy_uint32_t color,
+		      unsigned int n)
+{
+  fb_simd_init ();
+  impl->fill (dst, color, n);
+}
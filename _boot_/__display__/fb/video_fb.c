@@ -18,12 +18,6 @@ holy_MOD_LICENSE ("GPLv2+");
 typedef holy_err_t (*holy_video_fb_doublebuf_update_screen_t) (void);
 typedef volatile void *framebuf_t;
 
-struct dirty
-{
-  int first_line;
-  int last_line;
-};
-
 static struct
 {
   struct holy_video_fbrender_target *render_target;
@@ -33,8 +27,8 @@ static struct
 
   unsigned int palette_size;
 
-  struct dirty current_dirty;
-  struct dirty previous_dirty;
+  struct holy_video_damage current_dirty;
+  struct holy_video_damage previous_dirty;
 
   /* For page flipping strategy.  */
   int displayed_page;           /* The page # that is the front buffer.  */
@@ -817,14 +811,11 @@ holy_video_fb_unmap_color_int (struct holy_video_fbblit_info * source,
 }
 
 static void
-dirty (int y, int height)
+dirty (int x, int y, int width, int height)
 {
   if (framebuffer.render_target != framebuffer.back_target)
     return;
-  if (framebuffer.current_dirty.first_line > y)
-    framebuffer.current_dirty.first_line = y;
-  if (framebuffer.current_dirty.last_line < y + height)
-    framebuffer.current_dirty.last_line = y + height;
+  holy_video_damage_add (&framebuffer.current_dirty, x, y, width, height);
 }
 
 holy_err_t
@@ -882,7 +873,7 @@ holy_video_fb_fill_rect (holy_video_color_t color, int x, int y,
   x += area_x;
   y += area_y;
 
-  dirty (y, height);
+  dirty (x, y, width, height);
 
   /* Use fbblit_info to encapsulate rendering.  */
   target.mode_info = &framebuffer.render_target->mode_info;
@@ -995,7 +986,7 @@ holy_video_fb_blit_source (struct holy_video_fbblit_info *source,
   target.data = framebuffer.render_target->data;
 
   /* Do actual blitting.  */
-  dirty (y, height);
+  dirty (x, y, width, height);
   holy_video_fb_dispatch_blit (&target, source, oper, x, y, width, height,
                                offset_x, offset_y);
 
@@ -1047,7 +1038,9 @@ holy_video_fb_scroll (holy_video_color_t color, int dx, int dy)
   width = framebuffer.render_target->viewport.width - holy_abs (dx);
   height = framebuffer.render_target->viewport.height - holy_abs (dy);
 
-  dirty (framebuffer.render_target->viewport.y,
+  dirty (framebuffer.render_target->viewport.x,
+	 framebuffer.render_target->viewport.y,
+	 framebuffer.render_target->viewport.width,
 	 framebuffer.render_target->viewport.height);
 
   if (dx < 0)
@@ -1399,23 +1392,57 @@ holy_video_fb_get_active_render_target (struct holy_video_fbrender_target **targ
   return holy_ERR_NONE;
 }
 
+/* Copy the damaged rectangles of the back buffer to PAGE, a row at a time
+   unless they span whole lines, and account for what was copied.  */
+static void
+flush_damage (framebuf_t page, const struct holy_video_damage *damage)
+{
+  struct holy_video_mode_info *mode_info
+    = &framebuffer.back_target->mode_info;
+  holy_uint64_t bytes = 0;
+  unsigned i;
+
+  for (i = 0; i < damage->count; i++)
+    {
+      const holy_video_rect_t *r = &damage->rects[i];
+      unsigned x1 = r->x, y1 = r->y;
+      unsigned x2 = r->x + r->width, y2 = r->y + r->height;
+      holy_size_t start, len, y;
+
+      if (x2 > mode_info->width)
+	x2 = mode_info->width;
+      if (y2 > mode_info->height)
+	y2 = mode_info->height;
+      if (x1 >= x2 || y1 >= y2)
+	continue;
+
+      start = (holy_size_t) x1 * mode_info->bpp / 8;
+      len = ((holy_size_t) x2 * mode_info->bpp + 7) / 8 - start;
+      if (x1 == 0 && x2 == mode_info->width)
+	{
+	  start = 0;
+	  len = (holy_size_t) mode_info->pitch * (y2 - y1);
+	  y2 = y1 + 1;
+	}
+      for (y = y1; y < y2; y++)
+	holy_memcpy ((char *) page + y * mode_info->pitch + start,
+		     (char *) framebuffer.back_target->data
+		     + y * mode_info->pitch + start, len);
+      bytes += (holy_uint64_t) len * (y2 - y1);
+    }
+
+  holy_video_flush_stats.frames++;
+  holy_video_flush_stats.bytes += bytes;
+  holy_video_flush_stats.last_bytes = bytes;
+  holy_dprintf ("video", "flushed %llu bytes in %u rectangles\n",
+		(unsigned long long) bytes, damage->count);
+}
+
 static holy_err_t
 doublebuf_blit_update_screen (void)
 {
-  if (framebuffer.current_dirty.first_line
-      <= framebuffer.current_dirty.last_line)
-    holy_memcpy ((char *) framebuffer.pages[0]
-		 + framebuffer.current_dirty.first_line
-		 * framebuffer.back_target->mode_info.pitch,
-		 (char *) framebuffer.back_target->data
-		 + framebuffer.current_dirty.first_line
-		 * framebuffer.back_target->mode_info.pitch,
-		 framebuffer.back_target->mode_info.pitch
-		 * (framebuffer.current_dirty.last_line
-		    - framebuffer.current_dirty.first_line));
-  framebuffer.current_dirty.first_line
-    = framebuffer.back_target->mode_info.height;
-  framebuffer.current_dirty.last_line = 0;
+  flush_damage (framebuffer.pages[0], &framebuffer.current_dirty);
+  holy_video_damage_reset (&framebuffer.current_dirty);
 
   return holy_ERR_NONE;
 }
@@ -1448,8 +1475,7 @@ holy_video_fb_doublebuf_blit_init (struct holy_video_fbrender_target **back,
   framebuffer.pages[0] = framebuf;
   framebuffer.displayed_page = 0;
   framebuffer.render_page = 0;
-  framebuffer.current_dirty.first_line = mode_info.height;
-  framebuffer.current_dirty.last_line = 0;
+  holy_video_damage_reset (&framebuffer.current_dirty);
 
   return holy_ERR_NONE;
 }
@@ -1459,26 +1485,14 @@ doublebuf_pageflipping_update_screen (void)
 {
   int new_displayed_page;
   holy_err_t err;
-  int first_line, last_line;
-
-  first_line = framebuffer.current_dirty.first_line;
-  last_line = framebuffer.current_dirty.last_line;
-  if (first_line > framebuffer.previous_dirty.first_line)
-    first_line = framebuffer.previous_dirty.first_line;
-  if (last_line < framebuffer.previous_dirty.last_line)
-    last_line = framebuffer.previous_dirty.last_line;
-
-  if (first_line <= last_line)
-    holy_memcpy ((char *) framebuffer.pages[framebuffer.render_page]
-		 + first_line * framebuffer.back_target->mode_info.pitch,
-		 (char *) framebuffer.back_target->data
-		 + first_line * framebuffer.back_target->mode_info.pitch,
-		 framebuffer.back_target->mode_info.pitch
-		 * (last_line - first_line));
+  struct holy_video_damage damage;
+
+  /* The page about to be drawn last saw the frame before this one.  */
+  damage = framebuffer.current_dirty;
+  holy_video_damage_merge (&damage, &framebuffer.previous_dirty);
+  flush_damage (framebuffer.pages[framebuffer.render_page], &damage);
   framebuffer.previous_dirty = framebuffer.current_dirty;
-  framebuffer.current_dirty.first_line
-    = framebuffer.back_target->mode_info.height;
-  framebuffer.current_dirty.last_line = 0;
+  holy_video_damage_reset (&framebuffer.current_dirty);
 
   /* Swap the page numbers in the framebuffer struct.  */
   new_displayed_page = framebuffer.render_page;
@@ -1531,12 +1545,8 @@ doublebuf_pageflipping_init (struct holy_video_mode_info *mode_info,
   framebuffer.pages[0] = page0_ptr;
   framebuffer.pages[1] = page1_ptr;
 
-  framebuffer.current_dirty.first_line
-    = framebuffer.back_target->mode_info.height;
-  framebuffer.current_dirty.last_line = 0;
-  framebuffer.previous_dirty.first_line
-    = framebuffer.back_target->mode_info.height;
-  framebuffer.previous_dirty.last_line = 0;
+  holy_video_damage_reset (&framebuffer.current_dirty);
+  holy_video_damage_reset (&framebuffer.previous_dirty);
 
   /* Set the framebuffer memory data pointer and display the right page.  */
   err = set_page_in (framebuffer.displayed_page);
@@ -1622,9 +1632,7 @@ holy_video_fb_setup (unsigned int mode_type, unsigned int mode_mask,
   framebuffer.displayed_page = 0;
   framebuffer.render_page = 0;
   framebuffer.set_page = 0;
-  framebuffer.current_dirty.first_line
-    = framebuffer.back_target->mode_info.height;
-  framebuffer.current_dirty.last_line = 0;
+  holy_video_damage_reset (&framebuffer.current_dirty);
 
   mode_info->mode_type &= ~holy_VIDEO_MODE_TYPE_DOUBLE_BUFFERED;
 
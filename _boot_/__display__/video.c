@@ -18,6 +18,9 @@ holy_video_adapter_t holy_video_adapter_list = NULL;
 /* Active video adapter.  */
 holy_video_adapter_t holy_video_adapter_active;
 
+/* Bytes copied to the screen by double buffered drivers.  */
+struct holy_video_flush_stats holy_video_flush_stats;
+
 /* Restore back to initial mode (where applicable).  */
 holy_err_t
 holy_video_restore (void)
@@ -362,6 +365,114 @@ holy_video_swap_buffers (void)
   return holy_video_adapter_active->swap_buffers ();
 }
 
+void
+holy_video_damage_reset (struct holy_video_damage *damage)
+{
+  damage->count = 0;
+}
+
+static holy_uint64_t
+rect_area (const holy_video_rect_t *r)
+{
+  return (holy_uint64_t) r->width * r->height;
+}
+
+static void
+rect_union (holy_video_rect_t *r, const holy_video_rect_t *a,
+	    const holy_video_rect_t *b)
+{
+  unsigned x1 = a->x < b->x ? a->x : b->x;
+  unsigned y1 = a->y < b->y ? a->y : b->y;
+  unsigned x2 = a->x + a->width > b->x + b->width
+    ? a->x + a->width : b->x + b->width;
+  unsigned y2 = a->y + a->height > b->y + b->height
+    ? a->y + a->height : b->y + b->height;
+
+  r->x = x1;
+  r->y = y1;
+  r->width = x2 - x1;
+  r->height = y2 - y1;
+}
+
+/* Add a rectangle, clipped to positive coordinates.  Keep merging it with
+   any rectangle whose union with it is no bigger than the two apart, such
+   as neighbouring glyphs on a line, or, once the list is full, with the one
+   it grows the least.  */
+void
+holy_video_damage_add (struct holy_video_damage *damage, int x, int y,
+		       unsigned int width, unsigned int height)
+{
+  holy_video_rect_t r;
+
+  if (x < 0)
+    {
+      if ((unsigned) -x >= width)
+	return;
+      width += x;
+      x = 0;
+    }
+  if (y < 0)
+    {
+      if ((unsigned) -y >= height)
+	return;
+      height += y;
+      y = 0;
+    }
+  if (width == 0 || height == 0)
+    return;
+
+  r.x = x;
+  r.y = y;
+  r.width = width;
+  r.height = height;
+
+  while (1)
+    {
+      holy_uint64_t best_cost = 0;
+      int best = -1;
+      unsigned i;
+
+      for (i = 0; i < damage->count; i++)
+	{
+	  holy_video_rect_t u;
+	  holy_uint64_t cost;
+
+	  rect_union (&u, &r, &damage->rects[i]);
+	  if (rect_area (&u)
+	      <= rect_area (&r) + rect_area (&damage->rects[i]))
+	    {
+	      best = i;
+	      break;
+	    }
+	  cost = rect_area (&u) - rect_area (&damage->rects[i]);
+	  if (damage->count == holy_VIDEO_DAMAGE_MAX_RECTS
+	      && (best < 0 || cost < best_cost))
+	    {
+	      best = i;
+	      best_cost = cost;
+	    }
+	}
+      if (best < 0)
+	break;
+
+      rect_union (&r, &r, &damage->rects[best]);
+      damage->rects[best] = damage->rects[--damage->count];
+    }
+
+  damage->rects[damage->count++] = r;
+}
+
+void
+holy_video_damage_merge (struct holy_video_damage *dst,
+			 const struct holy_video_damage *src)
+{
+  unsigned i;
+
+  for (i = 0; i < src->count; i++)
+    holy_video_damage_add (dst, src->rects[i].x, src->rects[i].y,
+			   src->rects[i].width, src->rects[i].height);
+}
+
 /* Create new render target.  */
 holy_err_t
 holy_video_create_render_target (struct holy_video_render_target **result,
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#include <holy/dl.h>
+#include <holy/misc.h>
+#include <holy/command.h>
+#include <holy/i18n.h>
+#include <holy/fs.h>
+#include <holy/fshelp.h>
+
+holy_MOD_LICENSE ("GPLv2+");
+
+/* What the hits would have cost, at the average cost of a miss.  */
+static unsigned long long
+saved_ms (holy_uint64_t hits, holy_uint64_t misses, holy_uint64_t ms)
+{
+  if (! misses)
+    return 0;
+  return hits * ms / misses;
+}
+
+static holy_err_t
+holy_cmd_fs_cache_stats (struct holy_command *cmd __attribute__ ((unused)),
+			 int argc __attribute__ ((unused)),
+			 char *argv[] __attribute__ ((unused)))
+{
+  struct holy_fs_cache_stats *s = &holy_fs_cache_stats;
+
+  holy_printf_ (N_("Probes: hits = %llu, probes = %llu taking %llu ms\n"),
+		(unsigned long long) s->probe_hits,
+		(unsigned long long) s->probes,
+		(unsigned long long) s->probe_ms);
+  holy_printf_ (N_("Mounts: hits = %llu, mounts = %llu taking %llu ms\n"),
+		(unsigned long long) s->mount_hits,
+		(unsigned long long) s->mounts,
+		(unsigned long long) s->mount_ms);
+  holy_printf_ (N_("Lookups: hits = %llu, misses = %llu\n"),
+		(unsigned long long) holy_fshelp_stats.dentry_hits,
+		(unsigned long long) holy_fshelp_stats.dentry_misses);
+  holy_printf_ (N_("Estimated time saved: %llu ms\n"),
+		saved_ms (s->probe_hits, s->probes, s->probe_ms)
+		+ saved_ms (s->mount_hits, s->mounts, s->mount_ms));
+
+  return 0;
+}
+
+static holy_command_t cmd;
+
+holy_MOD_INIT(fscache)
+{
+  cmd = holy_register_command ("fs_cache_stats", holy_cmd_fs_cache_stats,
+			       0, N_("Show how much probing, mounting and "
+				     "name lookup the filesystem caches "
+				     "saved."));
+}
+
+holy_MOD_FINI(fscache)
+{
+  holy_unregister_command (cmd);
+}
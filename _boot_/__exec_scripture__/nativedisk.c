@@ -21,7 +21,7 @@ holy_MOD_LICENSE ("GPLv2+");
 static const char *modnames_def[] = { 
   /* FIXME: autogenerate this.  */
 #if defined (__i386__) || defined (__x86_64__) || defined (holy_MACHINE_MIPS_LOONGSON)
-  "pata", "ahci", "usbms", "ohci", "uhci", "ehci"
+  "pata", "ahci", "nvme", "usbms", "ohci", "uhci", "ehci"
 #elif defined (holy_MACHINE_MIPS_QEMU_MIPS)
   "pata"
 #else
@@ -63,6 +63,7 @@ get_uuid (const char *name, char **uuid, int getnative)
       /* Native disks.  */
     case holy_DISK_DEVICE_ATA_ID:
     case holy_DISK_DEVICE_SCSI_ID:
+    case holy_DISK_DEVICE_NVME_ID:
     case holy_DISK_DEVICE_XEN:
       if (getnative)
 	break;
@@ -308,7 +309,7 @@ static holy_command_t cmd;
 holy_MOD_INIT(nativedisk)
 {
   cmd = holy_register_command ("nativedisk", holy_cmd_nativedisk, N_("[MODULE1 MODULE2 ...]"),
-			       N_("Switch to native disk drivers. If no modules are specified default set (pata,ahci,usbms,ohci,uhci,ehci) is used"));
+			       N_("Switch to native disk drivers. If no modules are specified default set (pata,ahci,nvme,usbms,ohci,uhci,ehci) is used"));
 }
 
 holy_MOD_FINI(nativedisk)
@@ -208,6 +208,13 @@ holy_cmd_videoinfo (holy_command_t cmd __attribute__ ((unused)),
 	  }
       }
   }
+
+  if (holy_video_flush_stats.frames)
+    holy_printf_ (N_("Screen updates: %llu, last %llu bytes, "
+		     "%llu bytes in total\n"),
+		  (unsigned long long) holy_video_flush_stats.frames,
+		  (unsigned long long) holy_video_flush_stats.last_bytes,
+		  (unsigned long long) holy_video_flush_stats.bytes);
   return holy_ERR_NONE;
 }
 
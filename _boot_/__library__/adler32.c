@@ -5,6 +5,12 @@
 
 #include <holy/dl.h>
 #include <holy/crypto.h>
+#include <holy/lib/crc.h>
+#include <holy/cpu_impl.h>
+
+#ifdef __x86_64__
+#define ADLER32_SIMD	1
+#endif
 
 holy_MOD_LICENSE ("GPLv2+");
 
@@ -25,27 +31,214 @@ adler32_init (void *context)
 
 #define MOD 65521
 
-static holy_uint16_t
-mod_add (holy_uint16_t a, holy_uint16_t b)
+/* Largest n such that 255n(n+1)/2 + (n+1)(MOD-1) fits in 32 bits, i.e. the
+   number of bytes which may be summed before reducing.  */
+#define NMAX 5552
+
+#define DO1(i) do { a += ptr[i]; b += a; } while (0)
+
+/* Add SIZE bytes at PTR to the sums *A and *B, both reduced.  */
+typedef void (*adler32_update_t) (holy_uint32_t *a, holy_uint32_t *b,
+				  const holy_uint8_t *ptr, holy_size_t size);
+
+static void
+adler32_generic (holy_uint32_t *pa, holy_uint32_t *pb,
+		 const holy_uint8_t *ptr, holy_size_t inlen)
+{
+  holy_uint32_t a = *pa, b = *pb;
+
+  while (inlen)
+    {
+      holy_size_t n = inlen < NMAX ? inlen : NMAX;
+
+      inlen -= n;
+      for (; n >= 8; n -= 8, ptr += 8)
+	{
+	  DO1 (0); DO1 (1); DO1 (2); DO1 (3);
+	  DO1 (4); DO1 (5); DO1 (6); DO1 (7);
+	}
+      for (; n; n--, ptr++)
+	DO1 (0);
+      a %= MOD;
+      b %= MOD;
+    }
+
+  *pa = a;
+  *pb = b;
+}
+
+#ifdef ADLER32_SIMD
+#define SSSE3_FN	__attribute__ ((target ("sse2,ssse3")))
+#define AVX2_FN		__attribute__ ((target ("avx2")))
+
+typedef long long v2di __attribute__ ((vector_size (16)));
+typedef char v16qi __attribute__ ((vector_size (16)));
+typedef short v8hi __attribute__ ((vector_size (16)));
+typedef int v4si __attribute__ ((vector_size (16)));
+typedef long long v4di __attribute__ ((vector_size (32)));
+typedef char v32qi __attribute__ ((vector_size (32)));
+typedef short v16hi __attribute__ ((vector_size (32)));
+typedef int v8si __attribute__ ((vector_size (32)));
+
+/* Over a run of N bytes x_i, A grows by the sum of the x_i and B by
+   N * A plus the sum of (N - i) * x_i.  The SIMD code takes 32-byte
+   blocks: psadbw sums the bytes, pmaddubsw and pmaddwd weigh them by 32
+   down to 1 within the block, and the sums of the earlier blocks, added
+   up once per block, supply the rest of each weight in steps of 32.  A
+   run stays within NMAX bytes, so no 32-bit lane can overflow.  */
+
+/* Fold the sums of a run of N bytes into *PA and *PB.  */
+static inline void
+adler32_add_run (holy_uint32_t *pa, holy_uint32_t *pb, holy_size_t n,
+		 holy_uint64_t bytes, holy_uint64_t prev, holy_uint64_t weighed)
+{
+  holy_uint64_t a = *pa, b = *pb;
+
+  b += n * a + 32 * prev + weighed;
+  a += bytes;
+  *pa = a % MOD;
+  *pb = b % MOD;
+}
+
+static SSSE3_FN void
+adler32_ssse3 (holy_uint32_t *pa, holy_uint32_t *pb,
+	       const holy_uint8_t *ptr, holy_size_t inlen)
+{
+  const v16qi w0 = { 32, 31, 30, 29, 28, 27, 26, 25,
+		     24, 23, 22, 21, 20, 19, 18, 17 };
+  const v16qi w1 = { 16, 15, 14, 13, 12, 11, 10, 9,
+		     8, 7, 6, 5, 4, 3, 2, 1 };
+  const v8hi ones = { 1, 1, 1, 1, 1, 1, 1, 1 };
+
+  while (inlen >= 32)
+    {
+      holy_size_t n = (inlen < NMAX ? inlen : NMAX) & ~(holy_size_t) 31;
+      v2di bytes = { 0, 0 }, prev = { 0, 0 };
+      v4si weighed = { 0, 0, 0, 0 };
+      holy_size_t i;
+
+      for (i = 0; i < n; i += 32, ptr += 32)
+	{
+	  v16qi x0, x1;
+
+	  __builtin_memcpy (&x0, ptr, sizeof (x0));
+	  __builtin_memcpy (&x1, ptr + 16, sizeof (x1));
+	  prev += bytes;
+	  bytes += (__builtin_ia32_psadbw128 (x0, (v16qi) { 0 })
+		    + __builtin_ia32_psadbw128 (x1, (v16qi) { 0 }));
+	  weighed += (__builtin_ia32_pmaddwd128
+		      (__builtin_ia32_pmaddubsw128 (x0, w0), ones)
+		      + __builtin_ia32_pmaddwd128
+		      (__builtin_ia32_pmaddubsw128 (x1, w1), ones));
+	}
+
+      adler32_add_run (pa, pb, n, bytes[0] + bytes[1], prev[0] + prev[1],
+		       (holy_uint64_t) (holy_uint32_t) weighed[0]
+		       + (holy_uint32_t) weighed[1]
+		       + (holy_uint32_t) weighed[2]
+		       + (holy_uint32_t) weighed[3]);
+      inlen -= n;
+    }
+
+  adler32_generic (pa, pb, ptr, inlen);
+}
+
+static AVX2_FN void
+adler32_avx2 (holy_uint32_t *pa, holy_uint32_t *pb,
+	      const holy_uint8_t *ptr, holy_size_t inlen)
 {
-  if ((holy_uint32_t) a + (holy_uint32_t) b >= MOD)
-    return a + b - MOD;
-  return a + b;
+  const v32qi w = { 32, 31, 30, 29, 28, 27, 26, 25,
+		    24, 23, 22, 21, 20, 19, 18, 17,
+		    16, 15, 14, 13, 12, 11, 10, 9,
+		    8, 7, 6, 5, 4, 3, 2, 1 };
+  const v16hi ones = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+
+  while (inlen >= 32)
+    {
+      holy_size_t n = (inlen < NMAX ? inlen : NMAX) & ~(holy_size_t) 31;
+      v4di bytes = { 0, 0, 0, 0 }, prev = { 0, 0, 0, 0 };
+      v8si weighed = { 0, 0, 0, 0, 0, 0, 0, 0 };
+      holy_uint64_t sum = 0;
+      holy_size_t i;
+
+      for (i = 0; i < n; i += 32, ptr += 32)
+	{
+	  v32qi x;
+
+	  __builtin_memcpy (&x, ptr, sizeof (x));
+	  prev += bytes;
+	  bytes += (v4di) __builtin_ia32_psadbw256 (x, (v32qi) { 0 });
+	  weighed += __builtin_ia32_pmaddwd256
+	    (__builtin_ia32_pmaddubsw256 (x, w), ones);
+	}
+
+      for (i = 0; i < 8; i++)
+	sum += (holy_uint32_t) weighed[i];
+      adler32_add_run (pa, pb, n, bytes[0] + bytes[1] + bytes[2] + bytes[3],
+		       prev[0] + prev[1] + prev[2] + prev[3], sum);
+      inlen -= n;
+    }
+
+  adler32_generic (pa, pb, ptr, inlen);
+}
+#endif
+
+struct adler32_impl
+{
+  struct holy_cpu_impl cpu;
+  adler32_update_t update;
+};
+
+static const struct adler32_impl impls[] =
+  {
+#ifdef ADLER32_SIMD
+    { { "avx2", holy_CPU_AVX2 }, adler32_avx2 },
+    { { "ssse3", holy_CPU_SSE2 | holy_CPU_SSSE3 }, adler32_ssse3 },
+#endif
+    { { "generic", 0 }, adler32_generic },
+  };
+
+static const struct adler32_impl *impl;
+
+static void
+adler32_probe (void)
+{
+  impl = holy_cpu_impl_find (impls, ARRAY_SIZE (impls), sizeof (impls[0]),
+			     NULL);
+}
+
+const char *
+holy_adler32_implementation (void)
+{
+  if (!impl)
+    adler32_probe ();
+  return impl->cpu.name;
+}
+
+int
+holy_adler32_select (const char *name)
+{
+  const void *found;
+
+  found = holy_cpu_impl_find (impls, ARRAY_SIZE (impls), sizeof (impls[0]),
+			      name);
+  if (!found)
+    return -1;
+  impl = found;
+  return 0;
 }
 
 static void
 adler32_write (void *context, const void *inbuf, holy_size_t inlen)
 {
   struct adler32_context *ctx = context;
-  const holy_uint8_t *ptr = inbuf;
+  holy_uint32_t a = ctx->a, b = ctx->b;
 
-  while (inlen)
-    {
-      ctx->a = mod_add (ctx->a, *ptr);
-      ctx->b = mod_add (ctx->a, ctx->b);
-      inlen--;
-      ptr++;
-    }
+  if (!impl)
+    adler32_probe ();
+  impl->update (&a, &b, inbuf, inlen);
+  ctx->a = a;
+  ctx->b = b;
 }
 
 static void
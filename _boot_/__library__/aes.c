@@ -0,0 +1,1247 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+/* AES for bulk disk decryption.  There are two implementations of the
+   same interface: AES-NI on x86_64, with a VAES variant that works on two
+   blocks per 256-bit register, and a portable bitsliced one that
+   processes four blocks at once with no secret-dependent memory access
+   or branches.  The gcrypt rijndael module stays the reference.  */
+
+#include <holy/types.h>
+#include <holy/misc.h>
+#include <holy/dl.h>
+#include <holy/aes.h>
+#include <holy/cpu_impl.h>
+
+#ifdef __x86_64__
+#define AES_NI	1
+#define AES_VAES	1
+#endif
+
+holy_MOD_LICENSE ("GPLv2+");
+
+#define BS	holy_AES_BLOCK_SIZE
+/* Blocks per call of the bitsliced core.  */
+#define BS_WAY	4
+
+struct aes_impl
+{
+  struct holy_cpu_impl cpu;
+  void (*ecb_encrypt) (const struct holy_aes_key *key, holy_uint8_t *out,
+		       const holy_uint8_t *in, holy_size_t nblocks);
+  void (*ecb_decrypt) (const struct holy_aes_key *key, holy_uint8_t *out,
+		       const holy_uint8_t *in, holy_size_t nblocks);
+  void (*cbc_encrypt) (const struct holy_aes_key *key, holy_uint8_t *out,
+		       const holy_uint8_t *in, holy_size_t nblocks,
+		       holy_uint8_t *iv);
+  void (*cbc_decrypt) (const struct holy_aes_key *key, holy_uint8_t *out,
+		       const holy_uint8_t *in, holy_size_t nblocks,
+		       holy_uint8_t *iv);
+  void (*xts_encrypt) (const struct holy_aes_key *key, holy_uint8_t *out,
+		       const holy_uint8_t *in, holy_size_t nblocks,
+		       holy_uint8_t *tweak);
+  void (*xts_decrypt) (const struct holy_aes_key *key, holy_uint8_t *out,
+		       const holy_uint8_t *in, holy_size_t nblocks,
+		       holy_uint8_t *tweak);
+};
+
+static const struct aes_impl *impl;
+
+/* Bitsliced AES.  Four blocks are spread over eight 64-bit words: bit
+   16 * R + 4 * C + K of Q[B] is bit B of the state byte at row R and
+   column C of block K.  Each row is then a 16-bit lane, so moving a
+   column up by one row is a rotation of the whole word.  */
+
+static inline holy_uint64_t
+rotr64 (holy_uint64_t x, unsigned n)
+{
+  return (x >> n) | (x << (64 - n));
+}
+
+/* The S-box circuit of Boyar and Peralta, 113 gates.  */
+static void
+bs_sbox (holy_uint64_t *q)
+{
+  holy_uint64_t x0, x1, x2, x3, x4, x5, x6, x7;
+  holy_uint64_t y1, y2, y3, y4, y5, y6, y7, y8, y9;
+  holy_uint64_t y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+  holy_uint64_t y20, y21;
+  holy_uint64_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+  holy_uint64_t z10, z11, z12, z13, z14, z15, z16, z17;
+  holy_uint64_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+  holy_uint64_t t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+  holy_uint64_t t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+  holy_uint64_t t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+  holy_uint64_t t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+  holy_uint64_t t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+  holy_uint64_t t60, t61, t62, t63, t64, t65, t66, t67;
+  holy_uint64_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+  x0 = q[7];
+  x1 = q[6];
+  x2 = q[5];
+  x3 = q[4];
+  x4 = q[3];
+  x5 = q[2];
+  x6 = q[1];
+  x7 = q[0];
+
+  /* Top linear transformation.  */
+  y14 = x3 ^ x5;
+  y13 = x0 ^ x6;
+  y9 = x0 ^ x3;
+  y8 = x0 ^ x5;
+  t0 = x1 ^ x2;
+  y1 = t0 ^ x7;
+  y4 = y1 ^ x3;
+  y12 = y13 ^ y14;
+  y2 = y1 ^ x0;
+  y5 = y1 ^ x6;
+  y3 = y5 ^ y8;
+  t1 = x4 ^ y12;
+  y15 = t1 ^ x5;
+  y20 = t1 ^ x1;
+  y6 = y15 ^ x7;
+  y10 = y15 ^ t0;
+  y11 = y20 ^ y9;
+  y7 = x7 ^ y11;
+  y17 = y10 ^ y11;
+  y19 = y10 ^ y8;
+  y16 = t0 ^ y11;
+  y21 = y13 ^ y16;
+  y18 = x0 ^ y16;
+
+  /* Non-linear section.  */
+  t2 = y12 & y15;
+  t3 = y3 & y6;
+  t4 = t3 ^ t2;
+  t5 = y4 & x7;
+  t6 = t5 ^ t2;
+  t7 = y13 & y16;
+  t8 = y5 & y1;
+  t9 = t8 ^ t7;
+  t10 = y2 & y7;
+  t11 = t10 ^ t7;
+  t12 = y9 & y11;
+  t13 = y14 & y17;
+  t14 = t13 ^ t12;
+  t15 = y8 & y10;
+  t16 = t15 ^ t12;
+  t17 = t4 ^ t14;
+  t18 = t6 ^ t16;
+  t19 = t9 ^ t14;
+  t20 = t11 ^ t16;
+  t21 = t17 ^ y20;
+  t22 = t18 ^ y19;
+  t23 = t19 ^ y21;
+  t24 = t20 ^ y18;
+
+  t25 = t21 ^ t22;
+  t26 = t21 & t23;
+  t27 = t24 ^ t26;
+  t28 = t25 & t27;
+  t29 = t28 ^ t22;
+  t30 = t23 ^ t24;
+  t31 = t22 ^ t26;
+  t32 = t31 & t30;
+  t33 = t32 ^ t24;
+  t34 = t23 ^ t33;
+  t35 = t27 ^ t33;
+  t36 = t24 & t35;
+  t37 = t36 ^ t34;
+  t38 = t27 ^ t36;
+  t39 = t29 & t38;
+  t40 = t25 ^ t39;
+
+  t41 = t40 ^ t37;
+  t42 = t29 ^ t33;
+  t43 = t29 ^ t40;
+  t44 = t33 ^ t37;
+  t45 = t42 ^ t41;
+  z0 = t44 & y15;
+  z1 = t37 & y6;
+  z2 = t33 & x7;
+  z3 = t43 & y16;
+  z4 = t40 & y1;
+  z5 = t29 & y7;
+  z6 = t42 & y11;
+  z7 = t45 & y17;
+  z8 = t41 & y10;
+  z9 = t44 & y12;
+  z10 = t37 & y3;
+  z11 = t33 & y4;
+  z12 = t43 & y13;
+  z13 = t40 & y5;
+  z14 = t29 & y2;
+  z15 = t42 & y9;
+  z16 = t45 & y14;
+  z17 = t41 & y8;
+
+  /* Bottom linear transformation.  */
+  t46 = z15 ^ z16;
+  t47 = z10 ^ z11;
+  t48 = z5 ^ z13;
+  t49 = z9 ^ z10;
+  t50 = z2 ^ z12;
+  t51 = z2 ^ z5;
+  t52 = z7 ^ z8;
+  t53 = z0 ^ z3;
+  t54 = z6 ^ z7;
+  t55 = z16 ^ z17;
+  t56 = z12 ^ t48;
+  t57 = t50 ^ t53;
+  t58 = z4 ^ t46;
+  t59 = z3 ^ t54;
+  t60 = t46 ^ t57;
+  t61 = z14 ^ t57;
+  t62 = t52 ^ t58;
+  t63 = t49 ^ t58;
+  t64 = z4 ^ t59;
+  t65 = t61 ^ t62;
+  t66 = z1 ^ t63;
+  s0 = t59 ^ t63;
+  s6 = t56 ^ ~t62;
+  s7 = t48 ^ ~t60;
+  t67 = t64 ^ t65;
+  s3 = t53 ^ t66;
+  s4 = t51 ^ t66;
+  s5 = t47 ^ t65;
+  s1 = t64 ^ ~s3;
+  s2 = t55 ^ ~t67;
+
+  q[7] = s0;
+  q[6] = s1;
+  q[5] = s2;
+  q[4] = s3;
+  q[3] = s4;
+  q[2] = s5;
+  q[1] = s6;
+  q[0] = s7;
+}
+
+/* Inverse of the affine map in the S-box.  Field inversion is its own
+   inverse, so the inverse S-box is the forward one between two of
+   these.  */
+static void
+bs_inv_affine (holy_uint64_t *q)
+{
+  holy_uint64_t q0, q1, q2, q3, q4, q5, q6, q7;
+
+  q0 = ~q[0];
+  q1 = ~q[1];
+  q2 = q[2];
+  q3 = q[3];
+  q4 = q[4];
+  q5 = ~q[5];
+  q6 = ~q[6];
+  q7 = q[7];
+  q[7] = q1 ^ q4 ^ q6;
+  q[6] = q0 ^ q3 ^ q5;
+  q[5] = q7 ^ q2 ^ q4;
+  q[4] = q6 ^ q1 ^ q3;
+  q[3] = q5 ^ q0 ^ q2;
+  q[2] = q4 ^ q7 ^ q1;
+  q[1] = q3 ^ q6 ^ q0;
+  q[0] = q2 ^ q5 ^ q7;
+}
+
+static void
+bs_inv_sbox (holy_uint64_t *q)
+{
+  bs_inv_affine (q);
+  bs_sbox (q);
+  bs_inv_affine (q);
+}
+
+/* Transpose the 8x8 bit matrix in X, one byte per row.  */
+static inline holy_uint64_t
+transpose8 (holy_uint64_t x)
+{
+  holy_uint64_t t;
+
+  t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+  x ^= t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+  x ^= t ^ (t << 14);
+  t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+  x ^= t ^ (t << 28);
+  return x;
+}
+
+#define SWAPMOVE(a, b, mask, n)				\
+  do							\
+    {							\
+      holy_uint64_t tmp = ((b) ^ ((a) >> (n))) & (mask);	\
+      (b) ^= tmp;					\
+      (a) ^= tmp << (n);				\
+    }							\
+  while (0)
+
+/* Transpose the 8x8 byte matrix with one word per row.  */
+static void
+transpose_bytes (holy_uint64_t *q)
+{
+  SWAPMOVE (q[0], q[4], 0x00000000ffffffffULL, 32);
+  SWAPMOVE (q[1], q[5], 0x00000000ffffffffULL, 32);
+  SWAPMOVE (q[2], q[6], 0x00000000ffffffffULL, 32);
+  SWAPMOVE (q[3], q[7], 0x00000000ffffffffULL, 32);
+  SWAPMOVE (q[0], q[2], 0x0000ffff0000ffffULL, 16);
+  SWAPMOVE (q[1], q[3], 0x0000ffff0000ffffULL, 16);
+  SWAPMOVE (q[4], q[6], 0x0000ffff0000ffffULL, 16);
+  SWAPMOVE (q[5], q[7], 0x0000ffff0000ffffULL, 16);
+  SWAPMOVE (q[0], q[1], 0x00ff00ff00ff00ffULL, 8);
+  SWAPMOVE (q[2], q[3], 0x00ff00ff00ff00ffULL, 8);
+  SWAPMOVE (q[4], q[5], 0x00ff00ff00ff00ffULL, 8);
+  SWAPMOVE (q[6], q[7], 0x00ff00ff00ff00ffULL, 8);
+}
+
+/* The transposes leave bit 16 * K + 4 * C + R; swap the K and R fields
+   of the bit index.  This is its own inverse.  */
+static inline holy_uint64_t
+swap_block_row (holy_uint64_t x)
+{
+  holy_uint64_t t;
+
+  t = (x ^ (x >> 15)) & 0x0000aaaa0000aaaaULL;
+  x ^= t ^ (t << 15);
+  t = (x ^ (x >> 30)) & 0x00000000ccccccccULL;
+  x ^= t ^ (t << 30);
+  return x;
+}
+
+static void
+bs_load (holy_uint64_t *q, const holy_uint8_t *in, unsigned nblocks)
+{
+  unsigned i;
+
+  for (i = 0; i < 8; i++)
+    q[i] = (i < 2 * nblocks
+	    ? transpose8 (holy_le_to_cpu64 (holy_get_unaligned64 (in + 8 * i)))
+	    : 0);
+  transpose_bytes (q);
+  for (i = 0; i < 8; i++)
+    q[i] = swap_block_row (q[i]);
+}
+
+static void
+bs_store (holy_uint8_t *out, holy_uint64_t *q, unsigned nblocks)
+{
+  unsigned i;
+
+  for (i = 0; i < 8; i++)
+    q[i] = swap_block_row (q[i]);
+  transpose_bytes (q);
+  for (i = 0; i < 2 * nblocks; i++)
+    holy_set_unaligned64 (out + 8 * i, holy_cpu_to_le64 (transpose8 (q[i])));
+}
+
+static inline void
+bs_add_round_key (holy_uint64_t *q, const holy_uint64_t *sk)
+{
+  unsigned b;
+
+  for (b = 0; b < 8; b++)
+    q[b] ^= sk[b];
+}
+
+static inline void
+bs_shift_rows (holy_uint64_t *q)
+{
+  unsigned b;
+
+  for (b = 0; b < 8; b++)
+    {
+      holy_uint64_t x = q[b];
+
+      q[b] = ((x & 0x000000000000ffffULL)
+	      | ((x & 0x00000000fff00000ULL) >> 4)
+	      | ((x & 0x00000000000f0000ULL) << 12)
+	      | ((x & 0x0000ff0000000000ULL) >> 8)
+	      | ((x & 0x000000ff00000000ULL) << 8)
+	      | ((x & 0x0fff000000000000ULL) << 4)
+	      | ((x & 0xf000000000000000ULL) >> 12));
+    }
+}
+
+static inline void
+bs_inv_shift_rows (holy_uint64_t *q)
+{
+  unsigned b;
+
+  for (b = 0; b < 8; b++)
+    {
+      holy_uint64_t x = q[b];
+
+      q[b] = ((x & 0x000000000000ffffULL)
+	      | ((x & 0x000000000fff0000ULL) << 4)
+	      | ((x & 0x00000000f0000000ULL) >> 12)
+	      | ((x & 0x0000ff0000000000ULL) >> 8)
+	      | ((x & 0x000000ff00000000ULL) << 8)
+	      | ((x & 0xfff0000000000000ULL) >> 4)
+	      | ((x & 0x000f000000000000ULL) << 12));
+    }
+}
+
+/* Move every byte one or two rows up within its column.  */
+static inline holy_uint64_t
+rot_row1 (holy_uint64_t x)
+{
+  return rotr64 (x, 16);
+}
+
+static inline holy_uint64_t
+rot_row2 (holy_uint64_t x)
+{
+  return rotr64 (x, 32);
+}
+
+/* Multiply every byte by x in GF(2^8).  */
+static inline void
+bs_xtime (holy_uint64_t *q)
+{
+  holy_uint64_t hi = q[7];
+
+  q[7] = q[6];
+  q[6] = q[5];
+  q[5] = q[4];
+  q[4] = q[3] ^ hi;
+  q[3] = q[2] ^ hi;
+  q[2] = q[1];
+  q[1] = q[0] ^ hi;
+  q[0] = hi;
+}
+
+/* out[r] = 2 a[r] + 3 a[r+1] + a[r+2] + a[r+3]
+          = 2 (a[r] + a[r+1]) + a[r+1] + (a[r+2] + a[r+3]).  */
+static void
+bs_mix_columns (holy_uint64_t *q)
+{
+  holy_uint64_t r1[8], t[8];
+  unsigned b;
+
+  for (b = 0; b < 8; b++)
+    {
+      r1[b] = rot_row1 (q[b]);
+      t[b] = q[b] ^ r1[b];
+      q[b] = r1[b] ^ rot_row2 (t[b]);
+    }
+  bs_xtime (t);
+  for (b = 0; b < 8; b++)
+    q[b] ^= t[b];
+}
+
+/* InvMixColumns is MixColumns after adding 4 (a[r] + a[r+2]) to every
+   byte.  */
+static void
+bs_inv_mix_columns (holy_uint64_t *q)
+{
+  holy_uint64_t u[8];
+  unsigned b;
+
+  for (b = 0; b < 8; b++)
+    u[b] = q[b] ^ rot_row2 (q[b]);
+  bs_xtime (u);
+  bs_xtime (u);
+  for (b = 0; b < 8; b++)
+    q[b] ^= u[b];
+  bs_mix_columns (q);
+}
+
+static void
+bs_encrypt (const struct holy_aes_key *key, holy_uint8_t *out,
+	    const holy_uint8_t *in, unsigned nblocks)
+{
+  holy_uint64_t q[8];
+  unsigned r;
+
+  bs_load (q, in, nblocks);
+  bs_add_round_key (q, key->planes[0]);
+  for (r = 1; r < key->rounds; r++)
+    {
+      bs_sbox (q);
+      bs_shift_rows (q);
+      bs_mix_columns (q);
+      bs_add_round_key (q, key->planes[r]);
+    }
+  bs_sbox (q);
+  bs_shift_rows (q);
+  bs_add_round_key (q, key->planes[key->rounds]);
+  bs_store (out, q, nblocks);
+}
+
+static void
+bs_decrypt (const struct holy_aes_key *key, holy_uint8_t *out,
+	    const holy_uint8_t *in, unsigned nblocks)
+{
+  holy_uint64_t q[8];
+  unsigned r;
+
+  bs_load (q, in, nblocks);
+  bs_add_round_key (q, key->planes[key->rounds]);
+  for (r = key->rounds - 1; r > 0; r--)
+    {
+      bs_inv_shift_rows (q);
+      bs_inv_sbox (q);
+      bs_add_round_key (q, key->planes[r]);
+      bs_inv_mix_columns (q);
+    }
+  bs_inv_shift_rows (q);
+  bs_inv_sbox (q);
+  bs_add_round_key (q, key->planes[0]);
+  bs_store (out, q, nblocks);
+}
+
+static void
+bs_ecb_encrypt (const struct holy_aes_key *key, holy_uint8_t *out,
+		const holy_uint8_t *in, holy_size_t nblocks)
+{
+  while (nblocks)
+    {
+      unsigned n = holy_min (nblocks, BS_WAY);
+
+      bs_encrypt (key, out, in, n);
+      in += n * BS;
+      out += n * BS;
+      nblocks -= n;
+    }
+}
+
+static void
+bs_ecb_decrypt (const struct holy_aes_key *key, holy_uint8_t *out,
+		const holy_uint8_t *in, holy_size_t nblocks)
+{
+  while (nblocks)
+    {
+      unsigned n = holy_min (nblocks, BS_WAY);
+
+      bs_decrypt (key, out, in, n);
+      in += n * BS;
+      out += n * BS;
+      nblocks -= n;
+    }
+}
+
+static void
+bs_cbc_encrypt (const struct holy_aes_key *key, holy_uint8_t *out,
+		const holy_uint8_t *in, holy_size_t nblocks, holy_uint8_t *iv)
+{
+  for (; nblocks; nblocks--, in += BS, out += BS)
+    {
+      holy_crypto_xor (iv, iv, in, BS);
+      bs_encrypt (key, iv, iv, 1);
+      holy_memcpy (out, iv, BS);
+    }
+}
+
+static void
+bs_cbc_decrypt (const struct holy_aes_key *key, holy_uint8_t *out,
+		const holy_uint8_t *in, holy_size_t nblocks, holy_uint8_t *iv)
+{
+  holy_uint8_t prev[(BS_WAY + 1) * BS];
+
+  holy_memcpy (prev, iv, BS);
+  while (nblocks)
+    {
+      unsigned n = holy_min (nblocks, BS_WAY);
+
+      /* Keep the ciphertext, OUT may be IN.  */
+      holy_memcpy (prev + BS, in, n * BS);
+      bs_decrypt (key, out, in, n);
+      holy_crypto_xor (out, out, prev, n * BS);
+      holy_memcpy (prev, prev + n * BS, BS);
+      in += n * BS;
+      out += n * BS;
+      nblocks -= n;
+    }
+  holy_memcpy (iv, prev, BS);
+}
+
+/* Multiply the XTS tweak by x.  */
+static inline void
+xts_next (holy_uint64_t *t)
+{
+  holy_uint64_t carry = t[1] >> 63;
+
+  t[1] = (t[1] << 1) | (t[0] >> 63);
+  t[0] = (t[0] << 1) ^ (0x87 & -carry);
+}
+
+static void
+bs_xts (const struct holy_aes_key *key, holy_uint8_t *out,
+	const holy_uint8_t *in, holy_size_t nblocks, holy_uint8_t *tweak,
+	void (*crypt) (const struct holy_aes_key *key, holy_uint8_t *out,
+		       const holy_uint8_t *in, unsigned nblocks))
+{
+  holy_uint64_t t[2];
+  holy_uint8_t pad[BS_WAY * BS];
+  unsigned i;
+
+  t[0] = holy_le_to_cpu64 (holy_get_unaligned64 (tweak));
+  t[1] = holy_le_to_cpu64 (holy_get_unaligned64 (tweak + 8));
+  while (nblocks)
+    {
+      unsigned n = holy_min (nblocks, BS_WAY);
+
+      for (i = 0; i < n; i++)
+	{
+	  holy_set_unaligned64 (pad + i * BS, holy_cpu_to_le64 (t[0]));
+	  holy_set_unaligned64 (pad + i * BS + 8, holy_cpu_to_le64 (t[1]));
+	  xts_next (t);
+	}
+      holy_crypto_xor (out, in, pad, n * BS);
+      crypt (key, out, out, n);
+      holy_crypto_xor (out, out, pad, n * BS);
+      in += n * BS;
+      out += n * BS;
+      nblocks -= n;
+    }
+  holy_set_unaligned64 (tweak, holy_cpu_to_le64 (t[0]));
+  holy_set_unaligned64 (tweak + 8, holy_cpu_to_le64 (t[1]));
+}
+
+static void
+bs_xts_encrypt (const struct holy_aes_key *key, holy_uint8_t *out,
+		const holy_uint8_t *in, holy_size_t nblocks,
+		holy_uint8_t *tweak)
+{
+  bs_xts (key, out, in, nblocks, tweak, bs_encrypt);
+}
+
+static void
+bs_xts_decrypt (const struct holy_aes_key *key, holy_uint8_t *out,
+		const holy_uint8_t *in, holy_size_t nblocks,
+		holy_uint8_t *tweak)
+{
+  bs_xts (key, out, in, nblocks, tweak, bs_decrypt);
+}
+
+#ifdef AES_NI
+#define AESNI_FN	__attribute__ ((target ("sse2,aes")))
+
+typedef long long v2di __attribute__ ((vector_size (16)));
+typedef int v4si __attribute__ ((vector_size (16)));
+
+static inline AESNI_FN v2di
+loadu (const void *p)
+{
+  v2di v;
+
+  __builtin_memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+static inline AESNI_FN void
+storeu (void *p, v2di v)
+{
+  __builtin_memcpy (p, &v, sizeof (v));
+}
+
+static inline AESNI_FN v2di
+ni_xts_next (v2di t)
+{
+  const v4si poly = { 0x87, 0, 1, 0 };
+  v2di carry;
+
+  /* Spread the top bit of each half to where it has to go: the low half
+     gets 0x87 from bit 127, the high half a 1 from bit 63.  */
+  carry = (v2di) __builtin_ia32_psradi128 (__builtin_ia32_pshufd ((v4si) t,
+								   0x13), 31);
+  return (t + t) ^ (carry & (v2di) poly);
+}
+
+#define ROUNDS4(op, rk, b0, b1, b2, b3)		\
+  do						\
+    {						\
+      b0 = op (b0, rk);				\
+      b1 = op (b1, rk);				\
+      b2 = op (b2, rk);				\
+      b3 = op (b3, rk);				\
+    }						\
+  while (0)
+
+/* Run all rounds over four independent blocks, which keeps the AES unit
+   busy while each one waits for the previous round.  */
+static inline AESNI_FN void
+ni_encrypt4 (const v2di *rk, unsigned rounds,
+	     v2di *b0, v2di *b1, v2di *b2, v2di *b3)
+{
+  v2di x0 = *b0 ^ rk[0], x1 = *b1 ^ rk[0], x2 = *b2 ^ rk[0], x3 = *b3 ^ rk[0];
+  unsigned r;
+
+  for (r = 1; r < rounds; r++)
+    ROUNDS4 (__builtin_ia32_aesenc128, rk[r], x0, x1, x2, x3);
+  ROUNDS4 (__builtin_ia32_aesenclast128, rk[rounds], x0, x1, x2, x3);
+  *b0 = x0;
+  *b1 = x1;
+  *b2 = x2;
+  *b3 = x3;
+}
+
+static inline AESNI_FN void
+ni_decrypt4 (const v2di *rk, unsigned rounds,
+	     v2di *b0, v2di *b1, v2di *b2, v2di *b3)
+{
+  v2di x0 = *b0 ^ rk[0], x1 = *b1 ^ rk[0], x2 = *b2 ^ rk[0], x3 = *b3 ^ rk[0];
+  unsigned r;
+
+  for (r = 1; r < rounds; r++)
+    ROUNDS4 (__builtin_ia32_aesdec128, rk[r], x0, x1, x2, x3);
+  ROUNDS4 (__builtin_ia32_aesdeclast128, rk[rounds], x0, x1, x2, x3);
+  *b0 = x0;
+  *b1 = x1;
+  *b2 = x2;
+  *b3 = x3;
+}
+
+static inline AESNI_FN v2di
+ni_encrypt1 (const v2di *rk, unsigned rounds, v2di x)
+{
+  unsigned r;
+
+  x ^= rk[0];
+  for (r = 1; r < rounds; r++)
+    x = __builtin_ia32_aesenc128 (x, rk[r]);
+  return __builtin_ia32_aesenclast128 (x, rk[rounds]);
+}
+
+static inline AESNI_FN v2di
+ni_decrypt1 (const v2di *rk, unsigned rounds, v2di x)
+{
+  unsigned r;
+
+  x ^= rk[0];
+  for (r = 1; r < rounds; r++)
+    x = __builtin_ia32_aesdec128 (x, rk[r]);
+  return __builtin_ia32_aesdeclast128 (x, rk[rounds]);
+}
+
+static inline AESNI_FN void
+ni_load_keys (v2di *rk, const holy_uint8_t (*keys)[BS], unsigned rounds)
+{
+  unsigned r;
+
+  for (r = 0; r <= rounds; r++)
+    rk[r] = loadu (keys[r]);
+}
+
+static AESNI_FN void
+ni_ecb_encrypt (const struct holy_aes_key *key, holy_uint8_t *out,
+		const holy_uint8_t *in, holy_size_t nblocks)
+{
+  v2di rk[holy_AES_MAX_ROUNDS + 1];
+  v2di b0, b1, b2, b3;
+
+  ni_load_keys (rk, key->enc, key->rounds);
+  for (; nblocks >= 4; nblocks -= 4, in += 4 * BS, out += 4 * BS)
+    {
+      b0 = loadu (in);
+      b1 = loadu (in + BS);
+      b2 = loadu (in + 2 * BS);
+      b3 = loadu (in + 3 * BS);
+      ni_encrypt4 (rk, key->rounds, &b0, &b1, &b2, &b3);
+      storeu (out, b0);
+      storeu (out + BS, b1);
+      storeu (out + 2 * BS, b2);
+      storeu (out + 3 * BS, b3);
+    }
+  for (; nblocks; nblocks--, in += BS, out += BS)
+    storeu (out, ni_encrypt1 (rk, key->rounds, loadu (in)));
+}
+
+static AESNI_FN void
+ni_ecb_decrypt (const struct holy_aes_key *key, holy_uint8_t *out,
+		const holy_uint8_t *in, holy_size_t nblocks)
+{
+  v2di rk[holy_AES_MAX_ROUNDS + 1];
+  v2di b0, b1, b2, b3;
+
+  ni_load_keys (rk, key->dec, key->rounds);
+  for (; nblocks >= 4; nblocks -= 4, in += 4 * BS, out += 4 * BS)
+    {
+      b0 = loadu (in);
+      b1 = loadu (in + BS);
+      b2 = loadu (in + 2 * BS);
+      b3 = loadu (in + 3 * BS);
+      ni_decrypt4 (rk, key->rounds, &b0, &b1, &b2, &b3);
+      storeu (out, b0);
+      storeu (out + BS, b1);
+      storeu (out + 2 * BS, b2);
+      storeu (out + 3 * BS, b3);
+    }
+  for (; nblocks; nblocks--, in += BS, out += BS)
+    storeu (out, ni_decrypt1 (rk, key->rounds, loadu (in)));
+}
+
+static AESNI_FN void
+ni_cbc_encrypt (const struct holy_aes_key *key, holy_uint8_t *out,
+		const holy_uint8_t *in, holy_size_t nblocks, holy_uint8_t *iv)
+{
+  v2di rk[holy_AES_MAX_ROUNDS + 1];
+  v2di x = loadu (iv);
+
+  ni_load_keys (rk, key->enc, key->rounds);
+  for (; nblocks; nblocks--, in += BS, out += BS)
+    {
+      x = ni_encrypt1 (rk, key->rounds, x ^ loadu (in));
+      storeu (out, x);
+    }
+  storeu (iv, x);
+}
+
+static AESNI_FN void
+ni_cbc_decrypt (const struct holy_aes_key *key, holy_uint8_t *out,
+		const holy_uint8_t *in, holy_size_t nblocks, holy_uint8_t *iv)
+{
+  v2di rk[holy_AES_MAX_ROUNDS + 1];
+  v2di prev = loadu (iv);
+  v2di c0, c1, c2, c3, b0, b1, b2, b3;
+
+  ni_load_keys (rk, key->dec, key->rounds);
+  for (; nblocks >= 4; nblocks -= 4, in += 4 * BS, out += 4 * BS)
+    {
+      b0 = c0 = loadu (in);
+      b1 = c1 = loadu (in + BS);
+      b2 = c2 = loadu (in + 2 * BS);
+      b3 = c3 = loadu (in + 3 * BS);
+      ni_decrypt4 (rk, key->rounds, &b0, &b1, &b2, &b3);
+      storeu (out, b0 ^ prev);
+      storeu (out + BS, b1 ^ c0);
+      storeu (out + 2 * BS, b2 ^ c1);
+      storeu (out + 3 * BS, b3 ^ c2);
+      prev = c3;
+    }
+  for (; nblocks; nblocks--, in += BS, out += BS)
+    {
+      c0 = loadu (in);
+      storeu (out, ni_decrypt1 (rk, key->rounds, c0) ^ prev);
+      prev = c0;
+    }
+  storeu (iv, prev);
+}
+
+/* The tweaks for each group of four blocks are derived from the last
+   one without leaving the vector registers.  */
+#define NI_XTS(fn, keys, crypt4, crypt1)				\
+static AESNI_FN void							\
+fn (const struct holy_aes_key *key, holy_uint8_t *out,			\
+    const holy_uint8_t *in, holy_size_t nblocks, holy_uint8_t *tweak)	\
+{									\
+  v2di rk[holy_AES_MAX_ROUNDS + 1];					\
+  v2di t0 = loadu (tweak), t1, t2, t3;					\
+  v2di b0, b1, b2, b3;							\
+									\
+  ni_load_keys (rk, key->keys, key->rounds);				\
+  for (; nblocks >= 4; nblocks -= 4, in += 4 * BS, out += 4 * BS)	\
+    {									\
+      t1 = ni_xts_next (t0);						\
+      t2 = ni_xts_next (t1);						\
+      t3 = ni_xts_next (t2);						\
+      b0 = loadu (in) ^ t0;						\
+      b1 = loadu (in + BS) ^ t1;					\
+      b2 = loadu (in + 2 * BS) ^ t2;					\
+      b3 = loadu (in + 3 * BS) ^ t3;					\
+      crypt4 (rk, key->rounds, &b0, &b1, &b2, &b3);			\
+      storeu (out, b0 ^ t0);						\
+      storeu (out + BS, b1 ^ t1);					\
+      storeu (out + 2 * BS, b2 ^ t2);					\
+      storeu (out + 3 * BS, b3 ^ t3);					\
+      t0 = ni_xts_next (t3);						\
+    }									\
+  for (; nblocks; nblocks--, in += BS, out += BS)			\
+    {									\
+      storeu (out, crypt1 (rk, key->rounds, loadu (in) ^ t0) ^ t0);	\
+      t0 = ni_xts_next (t0);						\
+    }									\
+  storeu (tweak, t0);							\
+}
+
+NI_XTS (ni_xts_encrypt, enc, ni_encrypt4, ni_encrypt1)
+NI_XTS (ni_xts_decrypt, dec, ni_decrypt4, ni_decrypt1)
+
+#endif
+
+#ifdef AES_VAES
+#define VAES_FN		__attribute__ ((target ("avx2,aes,vaes")))
+
+typedef long long v4di __attribute__ ((vector_size (32)));
+typedef unsigned long long v4du __attribute__ ((vector_size (32)));
+typedef int v8si __attribute__ ((vector_size (32)));
+typedef char v32qi __attribute__ ((vector_size (32)));
+
+/* Not memcpy, which GCC splits into 128-bit halves through the stack.  */
+static inline VAES_FN v4di
+loadu256 (const void *p)
+{
+  return (v4di) __builtin_ia32_loaddqu256 ((const char *) p);
+}
+
+static inline VAES_FN void
+storeu256 (void *p, v4di v)
+{
+  __builtin_ia32_storedqu256 ((char *) p, (v32qi) v);
+}
+
+static inline VAES_FN v4di
+pair (v2di lo, v2di hi)
+{
+  return (v4di) { lo[0], lo[1], hi[0], hi[1] };
+}
+
+static inline VAES_FN void
+vaes_load_keys (v4di *rk, const holy_uint8_t (*keys)[BS], unsigned rounds)
+{
+  unsigned r;
+
+  for (r = 0; r <= rounds; r++)
+    rk[r] = pair (loadu (keys[r]), loadu (keys[r]));
+}
+
+#define VAES(op, x, k)						\
+  ((v4di) __builtin_ia32_ ## op ((v32qi) (x), (v32qi) (k)))
+
+/* As ni_encrypt4 and ni_decrypt4, on eight blocks in four registers.  */
+static inline VAES_FN void
+vaes_encrypt8 (const v4di *rk, unsigned rounds, v4di *b)
+{
+  v4di x0 = b[0] ^ rk[0], x1 = b[1] ^ rk[0];
+  v4di x2 = b[2] ^ rk[0], x3 = b[3] ^ rk[0];
+  unsigned r;
+
+  for (r = 1; r < rounds; r++)
+    {
+      x0 = VAES (vaesenc_v32qi, x0, rk[r]);
+      x1 = VAES (vaesenc_v32qi, x1, rk[r]);
+      x2 = VAES (vaesenc_v32qi, x2, rk[r]);
+      x3 = VAES (vaesenc_v32qi, x3, rk[r]);
+    }
+  b[0] = VAES (vaesenclast_v32qi, x0, rk[rounds]);
+  b[1] = VAES (vaesenclast_v32qi, x1, rk[rounds]);
+  b[2] = VAES (vaesenclast_v32qi, x2, rk[rounds]);
+  b[3] = VAES (vaesenclast_v32qi, x3, rk[rounds]);
+}
+
+static inline VAES_FN void
+vaes_decrypt8 (const v4di *rk, unsigned rounds, v4di *b)
+{
+  v4di x0 = b[0] ^ rk[0], x1 = b[1] ^ rk[0];
+  v4di x2 = b[2] ^ rk[0], x3 = b[3] ^ rk[0];
+  unsigned r;
+
+  for (r = 1; r < rounds; r++)
+    {
+      x0 = VAES (vaesdec_v32qi, x0, rk[r]);
+      x1 = VAES (vaesdec_v32qi, x1, rk[r]);
+      x2 = VAES (vaesdec_v32qi, x2, rk[r]);
+      x3 = VAES (vaesdec_v32qi, x3, rk[r]);
+    }
+  b[0] = VAES (vaesdeclast_v32qi, x0, rk[rounds]);
+  b[1] = VAES (vaesdeclast_v32qi, x1, rk[rounds]);
+  b[2] = VAES (vaesdeclast_v32qi, x2, rk[rounds]);
+  b[3] = VAES (vaesdeclast_v32qi, x3, rk[rounds]);
+}
+
+/* Eight blocks at a time here; what is left over, and CBC encryption,
+   which cannot run blocks side by side, go to the AES-NI code.  */
+#define VAES_ECB(fn, keys, crypt8, rest)				\
+static VAES_FN void							\
+fn (const struct holy_aes_key *key, holy_uint8_t *out,			\
+    const holy_uint8_t *in, holy_size_t nblocks)			\
+{									\
+  v4di rk[holy_AES_MAX_ROUNDS + 1];					\
+  v4di b[4];								\
+  unsigned i;								\
+									\
+  vaes_load_keys (rk, key->keys, key->rounds);				\
+  for (; nblocks >= 8; nblocks -= 8, in += 8 * BS, out += 8 * BS)	\
+    {									\
+      for (i = 0; i < 4; i++)						\
+	b[i] = loadu256 (in + 2 * i * BS);				\
+      crypt8 (rk, key->rounds, b);					\
+      for (i = 0; i < 4; i++)						\
+	storeu256 (out + 2 * i * BS, b[i]);				\
+    }									\
+  rest (key, out, in, nblocks);						\
+}
+
+VAES_ECB (vaes_ecb_encrypt, enc, vaes_encrypt8, ni_ecb_encrypt)
+VAES_ECB (vaes_ecb_decrypt, dec, vaes_decrypt8, ni_ecb_decrypt)
+
+static VAES_FN void
+vaes_cbc_decrypt (const struct holy_aes_key *key, holy_uint8_t *out,
+		  const holy_uint8_t *in, holy_size_t nblocks,
+		  holy_uint8_t *iv)
+{
+  v4di rk[holy_AES_MAX_ROUNDS + 1];
+  v2di prev = loadu (iv);
+  v4di b[4], c[4];
+  unsigned i;
+
+  vaes_load_keys (rk, key->dec, key->rounds);
+  for (; nblocks >= 8; nblocks -= 8, in += 8 * BS, out += 8 * BS)
+    {
+      /* Each block is XORed with the ciphertext one block before it,
+	 which vperm2i128 picks out of the registers loaded.  */
+      for (i = 0; i < 4; i++)
+	b[i] = loadu256 (in + 2 * i * BS);
+      c[0] = pair (prev, (v2di) { b[0][0], b[0][1] });
+      for (i = 1; i < 4; i++)
+	c[i] = __builtin_ia32_permti256 (b[i - 1], b[i], 0x21);
+      prev = (v2di) { b[3][2], b[3][3] };
+      vaes_decrypt8 (rk, key->rounds, b);
+      for (i = 0; i < 4; i++)
+	storeu256 (out + 2 * i * BS, b[i] ^ c[i]);
+    }
+  storeu (iv, prev);
+  ni_cbc_decrypt (key, out, in, nblocks, iv);
+}
+
+/* Multiply the tweak in each half of T by x^2: the two bits shifted out
+   of the top come back as 0x87 and 0x10e.  */
+static inline VAES_FN v4di
+vaes_xts_next2 (v4di t)
+{
+  v4du u = (v4du) t, c, top;
+
+  /* Bits 62 and 63 of the other 64-bit half of each 128-bit lane.  */
+  c = (v4du) __builtin_ia32_pshufd256 ((v8si) (u >> 62), 0x4e);
+  top = c & (v4du) { 3, 0, 3, 0 };
+  return (v4di) ((u << 2) ^ (c & (v4du) { 0, 3, 0, 3 })
+		 ^ (-(top & 1) & 0x87) ^ (-(top >> 1) & 0x10e));
+}
+
+/* Consecutive tweaks go in the halves of a register, and each register
+   is the one before times x^2, so the tweaks come four steps apart
+   rather than eight.  */
+#define VAES_XTS(fn, keys, crypt8, rest)				\
+static VAES_FN void							\
+fn (const struct holy_aes_key *key, holy_uint8_t *out,			\
+    const holy_uint8_t *in, holy_size_t nblocks, holy_uint8_t *tweak)	\
+{									\
+  v4di rk[holy_AES_MAX_ROUNDS + 1];					\
+  v2di t = loadu (tweak);						\
+  v4di b[4], tw[4], next = pair (t, ni_xts_next (t));			\
+  unsigned i;								\
+									\
+  vaes_load_keys (rk, key->keys, key->rounds);				\
+  for (; nblocks >= 8; nblocks -= 8, in += 8 * BS, out += 8 * BS)	\
+    {									\
+      for (i = 0; i < 4; i++)						\
+	{								\
+	  tw[i] = next;							\
+	  next = vaes_xts_next2 (next);					\
+	  b[i] = loadu256 (in + 2 * i * BS) ^ tw[i];			\
+	}								\
+      crypt8 (rk, key->rounds, b);					\
+      for (i = 0; i < 4; i++)						\
+	storeu256 (out + 2 * i * BS, b[i] ^ tw[i]);			\
+    }									\
+  storeu (tweak, (v2di) { next[0], next[1] });				\
+  rest (key, out, in, nblocks, tweak);					\
+}
+
+VAES_XTS (vaes_xts_encrypt, enc, vaes_encrypt8, ni_xts_encrypt)
+VAES_XTS (vaes_xts_decrypt, dec, vaes_decrypt8, ni_xts_decrypt)
+
+#undef VAES
+#endif
+
+static const struct aes_impl impls[] =
+  {
+#ifdef AES_VAES
+    { { "vaes", holy_CPU_AVX2 | holy_CPU_AES | holy_CPU_VAES },
+      vaes_ecb_encrypt, vaes_ecb_decrypt, ni_cbc_encrypt, vaes_cbc_decrypt,
+      vaes_xts_encrypt, vaes_xts_decrypt },
+#endif
+#ifdef AES_NI
+    { { "aesni", holy_CPU_SSE2 | holy_CPU_AES },
+      ni_ecb_encrypt, ni_ecb_decrypt, ni_cbc_encrypt, ni_cbc_decrypt,
+      ni_xts_encrypt, ni_xts_decrypt },
+#endif
+    { { "bitslice", 0 },
+      bs_ecb_encrypt, bs_ecb_decrypt, bs_cbc_encrypt, bs_cbc_decrypt,
+      bs_xts_encrypt, bs_xts_decrypt },
+  };
+
+static void
+aes_probe (void)
+{
+  impl = holy_cpu_impl_find (impls, ARRAY_SIZE (impls), sizeof (impls[0]),
+			     NULL);
+}
+
+int
+holy_aes_select (const char *name)
+{
+  const void *found;
+
+  found = holy_cpu_impl_find (impls, ARRAY_SIZE (impls), sizeof (impls[0]),
+			      name);
+  if (!found)
+    return -1;
+  impl = found;
+  return 0;
+}
+
+const char *
+holy_aes_implementation (void)
+{
+  if (!impl)
+    aes_probe ();
+  return impl->cpu.name;
+}
+
+/* Key schedule.  S-box lookups go through the bitsliced circuit so that
+   this does not depend on tables either.  */
+
+static holy_uint32_t
+sub_word (holy_uint32_t w)
+{
+  holy_uint64_t q[8];
+  holy_uint32_t r = 0;
+  unsigned b, i;
+
+  for (b = 0; b < 8; b++)
+    {
+      q[b] = 0;
+      for (i = 0; i < 4; i++)
+	q[b] |= (holy_uint64_t) ((w >> (8 * i + b)) & 1) << i;
+    }
+  bs_sbox (q);
+  for (b = 0; b < 8; b++)
+    for (i = 0; i < 4; i++)
+      r |= (holy_uint32_t) ((q[b] >> i) & 1) << (8 * i + b);
+  return r;
+}
+
+static inline holy_uint8_t
+xtime (holy_uint8_t x)
+{
+  return (x << 1) ^ (0x1b & -(x >> 7));
+}
+
+static void
+inv_mix_column (holy_uint8_t *out, const holy_uint8_t *in)
+{
+  unsigned r;
+
+  for (r = 0; r < 4; r++)
+    {
+      holy_uint8_t a0 = in[r], a1 = in[(r + 1) & 3];
+      holy_uint8_t a2 = in[(r + 2) & 3], a3 = in[(r + 3) & 3];
+      holy_uint8_t x2, x4, x8;
+
+      /* 14 a0 + 11 a1 + 13 a2 + 9 a3.  */
+      x2 = xtime (a0 ^ a1);
+      x4 = xtime (xtime (a0 ^ a2));
+      x8 = xtime (xtime (xtime (a0 ^ a1 ^ a2 ^ a3)));
+      out[r] = x8 ^ x4 ^ x2 ^ a1 ^ a2 ^ a3;
+    }
+}
+
+gcry_err_code_t
+holy_aes_set_key (struct holy_aes_key *key, const void *data,
+		  holy_size_t len)
+{
+  holy_uint32_t w[4 * (holy_AES_MAX_ROUNDS + 1)];
+  holy_uint32_t rcon = 1;
+  unsigned nk, i, b, r;
+
+  if (len != 16 && len != 24 && len != 32)
+    return GPG_ERR_INV_KEYLEN;
+  if (!impl)
+    aes_probe ();
+
+  nk = len / 4;
+  key->rounds = nk + 6;
+  for (i = 0; i < nk; i++)
+    w[i] = holy_le_to_cpu32 (holy_get_unaligned32 ((const holy_uint8_t *)
+						   data + 4 * i));
+  for (; i < 4 * (key->rounds + 1); i++)
+    {
+      holy_uint32_t t = w[i - 1];
+
+      if (i % nk == 0)
+	{
+	  t = sub_word ((t >> 8) | (t << 24)) ^ rcon;
+	  rcon = xtime (rcon);
+	}
+      else if (nk > 6 && i % nk == 4)
+	t = sub_word (t);
+      w[i] = w[i - nk] ^ t;
+    }
+
+  for (r = 0; r <= key->rounds; r++)
+    {
+      for (i = 0; i < 4; i++)
+	holy_set_unaligned32 (key->enc[r] + 4 * i,
+			      holy_cpu_to_le32 (w[4 * r + i]));
+      for (b = 0; b < 8; b++)
+	{
+	  holy_uint64_t p = 0;
+
+	  /* Byte I is at row I % 4 and column I / 4, in all four blocks.  */
+	  for (i = 0; i < BS; i++)
+	    p |= ((holy_uint64_t) (0xf & -((key->enc[r][i] >> b) & 1))
+		  << (16 * (i % 4) + 4 * (i / 4)));
+	  key->planes[r][b] = p;
+	}
+    }
+
+  holy_memcpy (key->dec[0], key->enc[key->rounds], BS);
+  for (r = 1; r < key->rounds; r++)
+    for (i = 0; i < BS; i += 4)
+      inv_mix_column (key->dec[r] + i, key->enc[key->rounds - r] + i);
+  holy_memcpy (key->dec[key->rounds], key->enc[0], BS);
+
+  holy_memset (w, 0, sizeof (w));
+  return GPG_ERR_NO_ERROR;
+}
+
+void
+holy_aes_ecb_encrypt (const struct holy_aes_key *key, void *out,
+		      const void *in, holy_size_t nblocks)
+{
+  impl->ecb_encrypt (key, out, in, nblocks);
+}
+
+void
+holy_aes_ecb_decrypt (const struct holy_aes_key *key, void *out,
+		      const void *in, holy_size_t nblocks)
+{
+  impl->ecb_decrypt (key, out, in, nblocks);
+}
+
+void
+holy_aes_cbc_encrypt (const struct holy_aes_key *key, void *out,
+		      const void *in, holy_size_t nblocks, void *iv)
+{
+  impl->cbc_encrypt (key, out, in, nblocks, iv);
+}
+
+void
+holy_aes_cbc_decrypt (const struct holy_aes_key *key, void *out,
+		      const void *in, holy_size_t nblocks, void *iv)
+{
+  impl->cbc_decrypt (key, out, in, nblocks, iv);
+}
+
+void
+holy_aes_xts_encrypt (const struct holy_aes_key *key, void *out,
+		      const void *in, holy_size_t nblocks, void *tweak)
+{
+  impl->xts_encrypt (key, out, in, nblocks, tweak);
+}
+
+void
+holy_aes_xts_decrypt (const struct holy_aes_key *key, void *out,
+		      const void *in, holy_size_t nblocks, void *tweak)
+{
+  impl->xts_decrypt (key, out, in, nblocks, tweak);
+}
+
+holy_MOD_INIT (aes)
+{
+  aes_probe ();
+}
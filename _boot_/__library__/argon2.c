@@ -0,0 +1,1053 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+/* Argon2 version 1.3 (RFC 9106), for LUKS2 key slots.
+
+   The memory is not one allocation but an arena of equal chunks, sized
+   against what the heap has left: a gigabyte of contiguous heap is rare
+   at boot, while the same amount in pieces often is there.  The arena is
+   wiped and released as a whole when the hash is done, so none of it
+   stays behind to fragment the heap.  Lanes are filled one after the
+   other, which gives the same result as one thread per lane.
+
+   Block mixing has three implementations: AVX2 and SSE2 on x86_64, and
+   portable C.  */
+
+#include <holy/types.h>
+#include <holy/misc.h>
+#include <holy/mm.h>
+#include <holy/dl.h>
+#include <holy/disk.h>
+#include <holy/time.h>
+#include <holy/i18n.h>
+#include <holy/argon2.h>
+#include <holy/cpu_impl.h>
+
+#ifdef __x86_64__
+#define ARGON2_SSE2	1
+#define ARGON2_AVX2	1
+#endif
+
+holy_MOD_LICENSE ("GPLv2+");
+
+#define ARGON2_VERSION		0x13
+#define ARGON2_BLOCK_SIZE	1024
+#define ARGON2_QWORDS		(ARGON2_BLOCK_SIZE / 8)
+#define ARGON2_SYNC_POINTS	4
+#define ARGON2_PREHASH_LEN	64
+/* Blocks per chunk of the arena, as powers of two: 64 KiB to 16 MiB.  */
+#define ARGON2_MIN_CHUNK_LOG	6
+#define ARGON2_MAX_CHUNK_LOG	14
+/* Heap left over for the rest of the unlock.  */
+#define ARGON2_HEAP_RESERVE	(1024 * 1024)
+
+struct argon2_block
+{
+  holy_uint64_t v[ARGON2_QWORDS];
+};
+
+struct argon2_impl
+{
+  struct holy_cpu_impl cpu;
+  /* NEXT = G (PREV ^ REF), or NEXT ^= G (PREV ^ REF) if WITH_XOR.  */
+  void (*fill_block) (const struct argon2_block *prev,
+		      const struct argon2_block *ref,
+		      struct argon2_block *next, int with_xor);
+};
+
+static const struct argon2_impl *impl;
+
+static inline holy_uint64_t
+rotr64 (holy_uint64_t x, unsigned n)
+{
+  return (x >> n) | (x << (64 - n));
+}
+
+/* BLAKE2b, unkeyed, as far as Argon2 needs it.  */
+
+struct blake2b_ctx
+{
+  holy_uint64_t h[8];
+  /* Bytes hashed so far; the inputs here are far from 2^64.  */
+  holy_uint64_t t;
+  holy_uint8_t buf[128];
+  unsigned buflen;
+  unsigned outlen;
+};
+
+static const holy_uint64_t blake2b_iv[8] =
+  {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+    0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+  };
+
+static const holy_uint8_t blake2b_sigma[12][16] =
+  {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 },
+    { 11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4 },
+    { 7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8 },
+    { 9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13 },
+    { 2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9 },
+    { 12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11 },
+    { 13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10 },
+    { 6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5 },
+    { 10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0 },
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 }
+  };
+
+#define B2B_G(a, b, c, d, x, y)			\
+  do						\
+    {						\
+      a = a + b + (x);				\
+      d = rotr64 (d ^ a, 32);			\
+      c = c + d;				\
+      b = rotr64 (b ^ c, 24);			\
+      a = a + b + (y);				\
+      d = rotr64 (d ^ a, 16);			\
+      c = c + d;				\
+      b = rotr64 (b ^ c, 63);			\
+    }						\
+  while (0)
+
+static void
+blake2b_compress (struct blake2b_ctx *ctx, const holy_uint8_t *block,
+		  int last)
+{
+  holy_uint64_t m[16], v[16];
+  unsigned i, r;
+
+  for (i = 0; i < 16; i++)
+    m[i] = holy_le_to_cpu64 (holy_get_unaligned64 (block + 8 * i));
+  for (i = 0; i < 8; i++)
+    {
+      v[i] = ctx->h[i];
+      v[i + 8] = blake2b_iv[i];
+    }
+  v[12] ^= ctx->t;
+  if (last)
+    v[14] = ~v[14];
+
+  for (r = 0; r < 12; r++)
+    {
+      const holy_uint8_t *s = blake2b_sigma[r];
+
+      B2B_G (v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+      B2B_G (v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+      B2B_G (v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+      B2B_G (v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+      B2B_G (v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+      B2B_G (v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+      B2B_G (v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+      B2B_G (v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+    }
+
+  for (i = 0; i < 8; i++)
+    ctx->h[i] ^= v[i] ^ v[i + 8];
+}
+
+static void
+blake2b_init (struct blake2b_ctx *ctx, unsigned outlen)
+{
+  holy_memcpy (ctx->h, blake2b_iv, sizeof (ctx->h));
+  ctx->h[0] ^= 0x01010000 ^ outlen;
+  ctx->t = 0;
+  ctx->buflen = 0;
+  ctx->outlen = outlen;
+}
+
+static void
+blake2b_update (struct blake2b_ctx *ctx, const void *data, holy_size_t len)
+{
+  const holy_uint8_t *p = data;
+
+  while (len)
+    {
+      holy_size_t n;
+
+      /* The last block must wait for blake2b_final.  */
+      if (ctx->buflen == sizeof (ctx->buf))
+	{
+	  ctx->t += sizeof (ctx->buf);
+	  blake2b_compress (ctx, ctx->buf, 0);
+	  ctx->buflen = 0;
+	}
+      n = sizeof (ctx->buf) - ctx->buflen;
+      if (n > len)
+	n = len;
+      holy_memcpy (ctx->buf + ctx->buflen, p, n);
+      ctx->buflen += n;
+      p += n;
+      len -= n;
+    }
+}
+
+static void
+blake2b_update32 (struct blake2b_ctx *ctx, holy_uint32_t x)
+{
+  holy_uint32_t le = holy_cpu_to_le32 (x);
+
+  blake2b_update (ctx, &le, sizeof (le));
+}
+
+static void
+blake2b_final (struct blake2b_ctx *ctx, holy_uint8_t *out)
+{
+  holy_uint8_t h[64];
+  unsigned i;
+
+  ctx->t += ctx->buflen;
+  holy_memset (ctx->buf + ctx->buflen, 0, sizeof (ctx->buf) - ctx->buflen);
+  blake2b_compress (ctx, ctx->buf, 1);
+  for (i = 0; i < 8; i++)
+    holy_set_unaligned64 (h + 8 * i, holy_cpu_to_le64 (ctx->h[i]));
+  holy_memcpy (out, h, ctx->outlen);
+}
+
+/* H' of RFC 9106, section 3.3: a hash of any length.  */
+static void
+blake2b_long (holy_uint8_t *out, holy_size_t outlen,
+	      const void *in, holy_size_t inlen)
+{
+  struct blake2b_ctx ctx;
+  holy_uint8_t v[64];
+
+  if (outlen <= 64)
+    {
+      blake2b_init (&ctx, outlen);
+      blake2b_update32 (&ctx, outlen);
+      blake2b_update (&ctx, in, inlen);
+      blake2b_final (&ctx, out);
+      return;
+    }
+
+  blake2b_init (&ctx, 64);
+  blake2b_update32 (&ctx, outlen);
+  blake2b_update (&ctx, in, inlen);
+  blake2b_final (&ctx, v);
+  holy_memcpy (out, v, 32);
+  out += 32;
+  outlen -= 32;
+
+  while (outlen > 64)
+    {
+      blake2b_init (&ctx, 64);
+      blake2b_update (&ctx, v, 64);
+      blake2b_final (&ctx, v);
+      holy_memcpy (out, v, 32);
+      out += 32;
+      outlen -= 32;
+    }
+
+  blake2b_init (&ctx, outlen);
+  blake2b_update (&ctx, v, 64);
+  blake2b_final (&ctx, out);
+}
+
+/* The compression function G of Argon2: BLAKE2b rounds, without the
+   message, in which the additions carry a product of the low halves.  */
+
+static inline holy_uint64_t
+blamka (holy_uint64_t x, holy_uint64_t y)
+{
+  return x + y + 2 * (x & 0xffffffff) * (y & 0xffffffff);
+}
+
+#define BLAMKA_G(a, b, c, d)			\
+  do						\
+    {						\
+      a = blamka (a, b);			\
+      d = rotr64 (d ^ a, 32);			\
+      c = blamka (c, d);			\
+      b = rotr64 (b ^ c, 24);			\
+      a = blamka (a, b);			\
+      d = rotr64 (d ^ a, 16);			\
+      c = blamka (c, d);			\
+      b = rotr64 (b ^ c, 63);			\
+    }						\
+  while (0)
+
+#define BLAMKA_ROUND(v, i0, i1, i2, i3, i4, i5, i6, i7,		\
+		     i8, i9, i10, i11, i12, i13, i14, i15)		\
+  do									\
+    {									\
+      BLAMKA_G (v[i0], v[i4], v[i8], v[i12]);				\
+      BLAMKA_G (v[i1], v[i5], v[i9], v[i13]);				\
+      BLAMKA_G (v[i2], v[i6], v[i10], v[i14]);				\
+      BLAMKA_G (v[i3], v[i7], v[i11], v[i15]);				\
+      BLAMKA_G (v[i0], v[i5], v[i10], v[i15]);				\
+      BLAMKA_G (v[i1], v[i6], v[i11], v[i12]);				\
+      BLAMKA_G (v[i2], v[i7], v[i8], v[i13]);				\
+      BLAMKA_G (v[i3], v[i4], v[i9], v[i14]);				\
+    }									\
+  while (0)
+
+static void
+generic_fill_block (const struct argon2_block *prev,
+		    const struct argon2_block *ref,
+		    struct argon2_block *next, int with_xor)
+{
+  holy_uint64_t r[ARGON2_QWORDS], t[ARGON2_QWORDS];
+  unsigned i;
+
+  for (i = 0; i < ARGON2_QWORDS; i++)
+    {
+      r[i] = prev->v[i] ^ ref->v[i];
+      t[i] = with_xor ? r[i] ^ next->v[i] : r[i];
+    }
+
+  /* The block is an 8x8 matrix of 16-byte registers: mix its rows, then
+     its columns.  */
+  for (i = 0; i < 8; i++)
+    BLAMKA_ROUND (r, 16 * i, 16 * i + 1, 16 * i + 2, 16 * i + 3,
+		  16 * i + 4, 16 * i + 5, 16 * i + 6, 16 * i + 7,
+		  16 * i + 8, 16 * i + 9, 16 * i + 10, 16 * i + 11,
+		  16 * i + 12, 16 * i + 13, 16 * i + 14, 16 * i + 15);
+  for (i = 0; i < 8; i++)
+    BLAMKA_ROUND (r, 2 * i, 2 * i + 1, 2 * i + 16, 2 * i + 17,
+		  2 * i + 32, 2 * i + 33, 2 * i + 48, 2 * i + 49,
+		  2 * i + 64, 2 * i + 65, 2 * i + 80, 2 * i + 81,
+		  2 * i + 96, 2 * i + 97, 2 * i + 112, 2 * i + 113);
+
+  for (i = 0; i < ARGON2_QWORDS; i++)
+    next->v[i] = t[i] ^ r[i];
+}
+
+#ifdef ARGON2_SSE2
+/* The same with two lanes of G in each register.  A row of four words
+   is in two registers, and the diagonal step moves the halves between
+   them with unpacks, as SSE2 has no shuffle across registers.  */
+
+#define SSE2_FN	__attribute__ ((target ("sse2")))
+
+typedef long long v2di __attribute__ ((vector_size (16)));
+typedef unsigned long long v2du __attribute__ ((vector_size (16)));
+typedef int v4si __attribute__ ((vector_size (16)));
+
+static inline SSE2_FN v2di
+loadu (const void *p)
+{
+  v2di v;
+
+  __builtin_memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+static inline SSE2_FN void
+storeu (void *p, v2di v)
+{
+  __builtin_memcpy (p, &v, sizeof (v));
+}
+
+static inline SSE2_FN v2di
+sse2_blamka (v2di x, v2di y)
+{
+  v2di z = (v2di) __builtin_ia32_pmuludq128 ((v4si) x, (v4si) y);
+
+  return x + y + z + z;
+}
+
+static inline SSE2_FN v2di
+sse2_rotr (v2di x, int n)
+{
+  return (v2di) (((v2du) x >> n) | ((v2du) x << (64 - n)));
+}
+
+static inline SSE2_FN v2di
+sse2_rotr32 (v2di x)
+{
+  return (v2di) __builtin_ia32_pshufd ((v4si) x, 0xb1);
+}
+
+static inline SSE2_FN v2di
+sse2_rotr63 (v2di x)
+{
+  return (v2di) (((v2du) x >> 63) | (v2du) (x + x));
+}
+
+#define UNPACKHI(a, b)	__builtin_ia32_punpckhqdq128 (a, b)
+#define UNPACKLO(a, b)	__builtin_ia32_punpcklqdq128 (a, b)
+
+#define SSE2_G(a0, b0, c0, d0, a1, b1, c1, d1)	\
+  do						\
+    {						\
+      a0 = sse2_blamka (a0, b0);		\
+      a1 = sse2_blamka (a1, b1);		\
+      d0 = sse2_rotr32 (d0 ^ a0);		\
+      d1 = sse2_rotr32 (d1 ^ a1);		\
+      c0 = sse2_blamka (c0, d0);		\
+      c1 = sse2_blamka (c1, d1);		\
+      b0 = sse2_rotr (b0 ^ c0, 24);		\
+      b1 = sse2_rotr (b1 ^ c1, 24);		\
+      a0 = sse2_blamka (a0, b0);		\
+      a1 = sse2_blamka (a1, b1);		\
+      d0 = sse2_rotr (d0 ^ a0, 16);		\
+      d1 = sse2_rotr (d1 ^ a1, 16);		\
+      c0 = sse2_blamka (c0, d0);		\
+      c1 = sse2_blamka (c1, d1);		\
+      b0 = sse2_rotr63 (b0 ^ c0);		\
+      b1 = sse2_rotr63 (b1 ^ c1);		\
+    }						\
+  while (0)
+
+#define SSE2_DIAGONALIZE(b0, c0, d0, b1, c1, d1)	\
+  do							\
+    {							\
+      v2di t0 = d0, t1 = b0;				\
+      d0 = c0;						\
+      c0 = c1;						\
+      c1 = d0;						\
+      d0 = UNPACKHI (d1, UNPACKLO (t0, t0));		\
+      d1 = UNPACKHI (t0, UNPACKLO (d1, d1));		\
+      b0 = UNPACKHI (b0, UNPACKLO (b1, b1));		\
+      b1 = UNPACKHI (b1, UNPACKLO (t1, t1));		\
+    }							\
+  while (0)
+
+#define SSE2_UNDIAGONALIZE(b0, c0, d0, b1, c1, d1)	\
+  do							\
+    {							\
+      v2di t0 = c0, t1;					\
+      c0 = c1;						\
+      c1 = t0;						\
+      t0 = b0;						\
+      t1 = d0;						\
+      b0 = UNPACKHI (b1, UNPACKLO (b0, b0));		\
+      b1 = UNPACKHI (t0, UNPACKLO (b1, b1));		\
+      d0 = UNPACKHI (d0, UNPACKLO (d1, d1));		\
+      d1 = UNPACKHI (d1, UNPACKLO (t1, t1));		\
+    }							\
+  while (0)
+
+#define SSE2_ROUND(a0, a1, b0, b1, c0, c1, d0, d1)		\
+  do								\
+    {								\
+      SSE2_G (a0, b0, c0, d0, a1, b1, c1, d1);			\
+      SSE2_DIAGONALIZE (b0, c0, d0, b1, c1, d1);		\
+      SSE2_G (a0, b0, c0, d0, a1, b1, c1, d1);			\
+      SSE2_UNDIAGONALIZE (b0, c0, d0, b1, c1, d1);		\
+    }								\
+  while (0)
+
+static SSE2_FN void
+sse2_fill_block (const struct argon2_block *prev,
+		 const struct argon2_block *ref,
+		 struct argon2_block *next, int with_xor)
+{
+  v2di r[ARGON2_QWORDS / 2], t[ARGON2_QWORDS / 2];
+  unsigned i;
+
+  for (i = 0; i < ARGON2_QWORDS / 2; i++)
+    {
+      r[i] = loadu (&prev->v[2 * i]) ^ loadu (&ref->v[2 * i]);
+      t[i] = with_xor ? r[i] ^ loadu (&next->v[2 * i]) : r[i];
+    }
+
+  for (i = 0; i < 8; i++)
+    SSE2_ROUND (r[8 * i], r[8 * i + 1], r[8 * i + 2], r[8 * i + 3],
+		r[8 * i + 4], r[8 * i + 5], r[8 * i + 6], r[8 * i + 7]);
+  for (i = 0; i < 8; i++)
+    SSE2_ROUND (r[i], r[i + 8], r[i + 16], r[i + 24],
+		r[i + 32], r[i + 40], r[i + 48], r[i + 56]);
+
+  for (i = 0; i < ARGON2_QWORDS / 2; i++)
+    storeu (&next->v[2 * i], t[i] ^ r[i]);
+}
+#endif
+
+#ifdef ARGON2_AVX2
+/* Four lanes of G in each register, so that a row is four registers.
+   For the columns, one register holds two columns of a row, and two
+   column rounds run at once.  The words are moved into place with
+   vpermq and vpblendd.  */
+
+#define AVX2_FN	__attribute__ ((target ("avx2")))
+
+typedef long long v4di __attribute__ ((vector_size (32)));
+typedef unsigned long long v4du __attribute__ ((vector_size (32)));
+typedef int v8si __attribute__ ((vector_size (32)));
+
+static inline AVX2_FN v4di
+avx2_blamka (v4di x, v4di y)
+{
+  v4di z = (v4di) __builtin_ia32_pmuludq256 ((v8si) x, (v8si) y);
+
+  return x + y + z + z;
+}
+
+typedef char v32qi __attribute__ ((vector_size (32)));
+
+/* Rotations by whole bytes are a vpshufb.  */
+static inline AVX2_FN v4di
+avx2_rotr24 (v4di x)
+{
+  const v32qi m = { 3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+		    3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10 };
+
+  return (v4di) __builtin_ia32_pshufb256 ((v32qi) x, m);
+}
+
+static inline AVX2_FN v4di
+avx2_rotr16 (v4di x)
+{
+  const v32qi m = { 2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+		    2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9 };
+
+  return (v4di) __builtin_ia32_pshufb256 ((v32qi) x, m);
+}
+
+static inline AVX2_FN v4di
+avx2_rotr32 (v4di x)
+{
+  return (v4di) __builtin_ia32_pshufd256 ((v8si) x, 0xb1);
+}
+
+static inline AVX2_FN v4di
+avx2_rotr63 (v4di x)
+{
+  return (v4di) (((v4du) x >> 63) | (v4du) (x + x));
+}
+
+#define PERMQ(x, imm)	__builtin_ia32_permdi256 (x, imm)
+#define BLENDD(a, b, imm)						\
+  ((v4di) __builtin_ia32_pblendd256 ((v8si) (a), (v8si) (b), (imm)))
+
+#define AVX2_G(a0, b0, c0, d0, a1, b1, c1, d1)	\
+  do						\
+    {						\
+      a0 = avx2_blamka (a0, b0);		\
+      a1 = avx2_blamka (a1, b1);		\
+      d0 = avx2_rotr32 (d0 ^ a0);		\
+      d1 = avx2_rotr32 (d1 ^ a1);		\
+      c0 = avx2_blamka (c0, d0);		\
+      c1 = avx2_blamka (c1, d1);		\
+      b0 = avx2_rotr24 (b0 ^ c0);		\
+      b1 = avx2_rotr24 (b1 ^ c1);		\
+      a0 = avx2_blamka (a0, b0);		\
+      a1 = avx2_blamka (a1, b1);		\
+      d0 = avx2_rotr16 (d0 ^ a0);		\
+      d1 = avx2_rotr16 (d1 ^ a1);		\
+      c0 = avx2_blamka (c0, d0);		\
+      c1 = avx2_blamka (c1, d1);		\
+      b0 = avx2_rotr63 (b0 ^ c0);		\
+      b1 = avx2_rotr63 (b1 ^ c1);		\
+    }						\
+  while (0)
+
+/* Rows: rotate B, C and D of each row by one, two and three words.  */
+#define AVX2_DIAGONALIZE_ROWS(b0, c0, d0, b1, c1, d1)	\
+  do							\
+    {							\
+      b0 = PERMQ (b0, 0x39);				\
+      c0 = PERMQ (c0, 0x4e);				\
+      d0 = PERMQ (d0, 0x93);				\
+      b1 = PERMQ (b1, 0x39);				\
+      c1 = PERMQ (c1, 0x4e);				\
+      d1 = PERMQ (d1, 0x93);				\
+    }							\
+  while (0)
+
+#define AVX2_UNDIAGONALIZE_ROWS(b0, c0, d0, b1, c1, d1)	\
+  do							\
+    {							\
+      b0 = PERMQ (b0, 0x93);				\
+      c0 = PERMQ (c0, 0x4e);				\
+      d0 = PERMQ (d0, 0x39);				\
+      b1 = PERMQ (b1, 0x93);				\
+      c1 = PERMQ (c1, 0x4e);				\
+      d1 = PERMQ (d1, 0x39);				\
+    }							\
+  while (0)
+
+/* Columns: each register holds one word of B, C or D from either
+   column, so words are traded between the two registers.  */
+#define AVX2_DIAGONALIZE_COLS(b0, c0, d0, b1, c1, d1)	\
+  do							\
+    {							\
+      v4di t0 = BLENDD (b0, b1, 0xcc);			\
+      v4di t1 = BLENDD (b0, b1, 0x33);			\
+      b1 = PERMQ (t0, 0xb1);				\
+      b0 = PERMQ (t1, 0xb1);				\
+      t0 = c0;						\
+      c0 = c1;						\
+      c1 = t0;						\
+      t0 = BLENDD (d0, d1, 0xcc);			\
+      t1 = BLENDD (d0, d1, 0x33);			\
+      d0 = PERMQ (t0, 0xb1);				\
+      d1 = PERMQ (t1, 0xb1);				\
+    }							\
+  while (0)
+
+#define AVX2_UNDIAGONALIZE_COLS(b0, c0, d0, b1, c1, d1)	\
+  do							\
+    {							\
+      v4di t0 = BLENDD (b0, b1, 0xcc);			\
+      v4di t1 = BLENDD (b0, b1, 0x33);			\
+      b0 = PERMQ (t0, 0xb1);				\
+      b1 = PERMQ (t1, 0xb1);				\
+      t0 = c0;						\
+      c0 = c1;						\
+      c1 = t0;						\
+      t0 = BLENDD (d0, d1, 0x33);			\
+      t1 = BLENDD (d0, d1, 0xcc);			\
+      d0 = PERMQ (t0, 0xb1);				\
+      d1 = PERMQ (t1, 0xb1);				\
+    }							\
+  while (0)
+
+#define AVX2_ROUND(kind, a0, a1, b0, b1, c0, c1, d0, d1)		\
+  do									\
+    {									\
+      AVX2_G (a0, b0, c0, d0, a1, b1, c1, d1);				\
+      AVX2_DIAGONALIZE_ ## kind (b0, c0, d0, b1, c1, d1);		\
+      AVX2_G (a0, b0, c0, d0, a1, b1, c1, d1);				\
+      AVX2_UNDIAGONALIZE_ ## kind (b0, c0, d0, b1, c1, d1);		\
+    }									\
+  while (0)
+
+static AVX2_FN void
+avx2_fill_block (const struct argon2_block *prev,
+		 const struct argon2_block *ref,
+		 struct argon2_block *next, int with_xor)
+{
+  v4di r[ARGON2_QWORDS / 4], t[ARGON2_QWORDS / 4], x;
+  unsigned i;
+
+  for (i = 0; i < ARGON2_QWORDS / 4; i++)
+    {
+      __builtin_memcpy (&r[i], &prev->v[4 * i], sizeof (r[i]));
+      __builtin_memcpy (&x, &ref->v[4 * i], sizeof (x));
+      r[i] ^= x;
+      t[i] = r[i];
+      if (with_xor)
+	{
+	  __builtin_memcpy (&x, &next->v[4 * i], sizeof (x));
+	  t[i] ^= x;
+	}
+    }
+
+  for (i = 0; i < 4; i++)
+    AVX2_ROUND (ROWS, r[8 * i], r[8 * i + 4], r[8 * i + 1], r[8 * i + 5],
+		r[8 * i + 2], r[8 * i + 6], r[8 * i + 3], r[8 * i + 7]);
+  for (i = 0; i < 4; i++)
+    AVX2_ROUND (COLS, r[i], r[i + 4], r[i + 8], r[i + 12],
+		r[i + 16], r[i + 20], r[i + 24], r[i + 28]);
+
+  for (i = 0; i < ARGON2_QWORDS / 4; i++)
+    {
+      x = t[i] ^ r[i];
+      __builtin_memcpy (&next->v[4 * i], &x, sizeof (x));
+    }
+}
+
+#undef PERMQ
+#undef BLENDD
+#endif
+
+static const struct argon2_impl impls[] =
+  {
+#ifdef ARGON2_AVX2
+    { { "avx2", holy_CPU_AVX2 }, avx2_fill_block },
+#endif
+#ifdef ARGON2_SSE2
+    { { "sse2", holy_CPU_SSE2 }, sse2_fill_block },
+#endif
+    { { "generic", 0 }, generic_fill_block },
+  };
+
+static void
+argon2_probe (void)
+{
+  impl = holy_cpu_impl_find (impls, ARRAY_SIZE (impls), sizeof (impls[0]),
+			     NULL);
+}
+
+int
+holy_argon2_select (const char *name)
+{
+  const void *found;
+
+  found = holy_cpu_impl_find (impls, ARRAY_SIZE (impls), sizeof (impls[0]),
+			      name);
+  if (!found)
+    return -1;
+  impl = found;
+  return 0;
+}
+
+const char *
+holy_argon2_implementation (void)
+{
+  if (!impl)
+    argon2_probe ();
+  return impl->cpu.name;
+}
+
+/* The arena: NBLOCKS blocks in chunks of 1 << CHUNK_LOG, the last one
+   possibly shorter.  */
+struct argon2_arena
+{
+  struct argon2_block **chunks;
+  holy_uint32_t nchunks;
+  holy_uint32_t nblocks;
+  unsigned chunk_log;
+};
+
+static inline struct argon2_block *
+arena_block (const struct argon2_arena *a, holy_uint32_t i)
+{
+  return &a->chunks[i >> a->chunk_log][i & ((1U << a->chunk_log) - 1)];
+}
+
+static holy_size_t
+arena_chunk_blocks (const struct argon2_arena *a, holy_uint32_t i)
+{
+  holy_uint32_t left = a->nblocks - (i << a->chunk_log);
+
+  return left < (1U << a->chunk_log) ? left : (1U << a->chunk_log);
+}
+
+static void
+arena_free (struct argon2_arena *a)
+{
+  holy_uint32_t i;
+
+  if (!a->chunks)
+    return;
+  for (i = 0; i < a->nchunks; i++)
+    if (a->chunks[i])
+      {
+	holy_memset (a->chunks[i], 0,
+		     arena_chunk_blocks (a, i) * ARGON2_BLOCK_SIZE);
+	holy_free (a->chunks[i]);
+      }
+  holy_free (a->chunks);
+  a->chunks = NULL;
+}
+
+static holy_err_t
+arena_try (struct argon2_arena *a, holy_uint32_t nblocks, unsigned log)
+{
+  holy_uint32_t i;
+
+  a->nblocks = nblocks;
+  a->chunk_log = log;
+  a->nchunks = ((holy_uint64_t) nblocks + (1U << log) - 1) >> log;
+  a->chunks = holy_zalloc (a->nchunks * sizeof (a->chunks[0]));
+  if (!a->chunks)
+    return holy_errno;
+
+  for (i = 0; i < a->nchunks; i++)
+    {
+      a->chunks[i] = holy_malloc (arena_chunk_blocks (a, i)
+				  * ARGON2_BLOCK_SIZE);
+      if (!a->chunks[i])
+	{
+	  arena_free (a);
+	  return holy_errno;
+	}
+    }
+  return holy_ERR_NONE;
+}
+
+/* Get NBLOCKS blocks, in chunks as large as the free heap allows, or
+   fail at once if there is not enough of it.  */
+static holy_err_t
+arena_alloc (struct argon2_arena *a, holy_uint32_t nblocks)
+{
+  holy_uint64_t need = (holy_uint64_t) nblocks * ARGON2_BLOCK_SIZE;
+  holy_size_t total, largest;
+  unsigned log;
+
+  holy_mm_get_free (&total, &largest);
+  if (need + ARGON2_HEAP_RESERVE > total)
+    {
+      /* The disk cache would give way to the chunks anyway.  */
+      holy_disk_cache_invalidate_all ();
+      holy_mm_get_free (&total, &largest);
+    }
+  if (need + ARGON2_HEAP_RESERVE > total)
+    return holy_error (holy_ERR_OUT_OF_MEMORY,
+		       N_("Argon2 needs %llu KiB of memory but only %llu KiB"
+			  " is free"),
+		       (unsigned long long) (need >> 10),
+		       (unsigned long long) (total >> 10));
+
+  log = ARGON2_MAX_CHUNK_LOG;
+  while (log > ARGON2_MIN_CHUNK_LOG
+	 && ((1U << (log - 1)) >= nblocks
+	     || ((holy_uint64_t) ARGON2_BLOCK_SIZE << log) > largest))
+    log--;
+
+  /* Fragmentation may still defeat the estimate; then try smaller
+     chunks.  */
+  while (arena_try (a, nblocks, log) != holy_ERR_NONE)
+    {
+      if (log == ARGON2_MIN_CHUNK_LOG)
+	return holy_errno;
+      holy_errno = holy_ERR_NONE;
+      log--;
+    }
+  return holy_ERR_NONE;
+}
+
+struct argon2_ctx
+{
+  struct argon2_arena arena;
+  holy_argon2_type_t type;
+  holy_uint32_t passes;
+  holy_uint32_t lanes;
+  holy_uint32_t memory_blocks;
+  holy_uint32_t lane_length;
+  holy_uint32_t segment_length;
+};
+
+/* Next block of pseudo-random reference positions, for the data
+   independent addressing of Argon2i and the first half pass of
+   Argon2id.  */
+static void
+next_addresses (struct argon2_block *address, struct argon2_block *input,
+		const struct argon2_block *zero)
+{
+  input->v[6]++;
+  impl->fill_block (zero, input, address, 0);
+  impl->fill_block (zero, address, address, 0);
+}
+
+/* Map the pseudo-random RAND to the block to use as reference for block
+   INDEX of a segment, among those already known to every lane.  */
+static holy_uint32_t
+index_alpha (const struct argon2_ctx *ctx, holy_uint32_t pass,
+	     holy_uint32_t slice, holy_uint32_t index, holy_uint32_t rand,
+	     int same_lane)
+{
+  holy_uint64_t area, pos, start = 0;
+
+  if (pass == 0)
+    {
+      if (slice == 0)
+	area = index - 1;
+      else if (same_lane)
+	area = (holy_uint64_t) slice * ctx->segment_length + index - 1;
+      else
+	area = (holy_uint64_t) slice * ctx->segment_length - (index == 0);
+    }
+  else
+    {
+      if (same_lane)
+	area = ctx->lane_length - ctx->segment_length + index - 1;
+      else
+	area = ctx->lane_length - ctx->segment_length - (index == 0);
+      if (slice != ARGON2_SYNC_POINTS - 1)
+	start = (holy_uint64_t) (slice + 1) * ctx->segment_length;
+    }
+
+  pos = (holy_uint64_t) rand * rand >> 32;
+  pos = start + area - 1 - (area * pos >> 32);
+  if (pos >= ctx->lane_length)
+    pos -= ctx->lane_length;
+  return pos;
+}
+
+static void
+fill_segment (const struct argon2_ctx *ctx, holy_uint32_t pass,
+	      holy_uint32_t lane, holy_uint32_t slice)
+{
+  struct argon2_block address, input, zero;
+  holy_uint32_t i = 0, curr, prev;
+  int data_independent;
+
+  data_independent = (ctx->type == holy_ARGON2_I
+		      || (ctx->type == holy_ARGON2_ID && pass == 0
+			  && slice < ARGON2_SYNC_POINTS / 2));
+  if (data_independent)
+    {
+      holy_memset (&zero, 0, sizeof (zero));
+      holy_memset (&input, 0, sizeof (input));
+      input.v[0] = pass;
+      input.v[1] = lane;
+      input.v[2] = slice;
+      input.v[3] = ctx->memory_blocks;
+      input.v[4] = ctx->passes;
+      input.v[5] = ctx->type;
+    }
+
+  /* The first two blocks of each lane come from the initial hash.  */
+  if (pass == 0 && slice == 0)
+    {
+      i = 2;
+      if (data_independent)
+	next_addresses (&address, &input, &zero);
+    }
+
+  curr = lane * ctx->lane_length + slice * ctx->segment_length + i;
+  if (curr % ctx->lane_length == 0)
+    prev = curr + ctx->lane_length - 1;
+  else
+    prev = curr - 1;
+
+  for (; i < ctx->segment_length; i++, curr++, prev++)
+    {
+      struct argon2_block *prev_block;
+      holy_uint64_t rand;
+      holy_uint32_t ref_lane, ref_index;
+
+      /* Past the wrap around from the end of the lane.  */
+      if (curr % ctx->lane_length == 1)
+	prev = curr - 1;
+      prev_block = arena_block (&ctx->arena, prev);
+
+      if (data_independent)
+	{
+	  if (i % ARGON2_QWORDS == 0)
+	    next_addresses (&address, &input, &zero);
+	  rand = address.v[i % ARGON2_QWORDS];
+	}
+      else
+	rand = prev_block->v[0];
+
+      if (pass == 0 && slice == 0)
+	ref_lane = lane;
+      else
+	ref_lane = (holy_uint32_t) (rand >> 32) % ctx->lanes;
+      ref_index = index_alpha (ctx, pass, slice, i, rand & 0xffffffff,
+			       ref_lane == lane);
+
+      impl->fill_block (prev_block,
+			arena_block (&ctx->arena,
+				     ref_lane * ctx->lane_length + ref_index),
+			arena_block (&ctx->arena, curr), pass != 0);
+    }
+}
+
+static void
+load_block (struct argon2_block *b, const holy_uint8_t *in)
+{
+  unsigned i;
+
+  for (i = 0; i < ARGON2_QWORDS; i++)
+    b->v[i] = holy_le_to_cpu64 (holy_get_unaligned64 (in + 8 * i));
+}
+
+static void
+store_block (holy_uint8_t *out, const struct argon2_block *b)
+{
+  unsigned i;
+
+  for (i = 0; i < ARGON2_QWORDS; i++)
+    holy_set_unaligned64 (out + 8 * i, holy_cpu_to_le64 (b->v[i]));
+}
+
+holy_err_t
+holy_argon2 (const struct holy_argon2_params *params,
+	     const void *pwd, holy_size_t pwd_len,
+	     const void *salt, holy_size_t salt_len,
+	     void *out, holy_size_t out_len)
+{
+  struct argon2_ctx ctx;
+  struct blake2b_ctx h0;
+  struct argon2_block acc;
+  holy_uint8_t prehash[ARGON2_PREHASH_LEN + 8];
+  holy_uint8_t bytes[ARGON2_BLOCK_SIZE];
+  holy_uint64_t start;
+  holy_uint32_t pass, slice, lane;
+  holy_err_t err;
+
+  if (params->type > holy_ARGON2_ID || params->t_cost < 1
+      || params->lanes < 1 || params->lanes > 0xffffff
+      || out_len < 4 || out_len > 0xffffffff || salt_len < 8)
+    return holy_error (holy_ERR_BAD_ARGUMENT,
+		       N_("invalid Argon2 parameters"));
+
+  if (!impl)
+    argon2_probe ();
+
+  ctx.type = params->type;
+  ctx.passes = params->t_cost;
+  ctx.lanes = params->lanes;
+  ctx.memory_blocks = params->m_cost;
+  if (ctx.memory_blocks < 2 * ARGON2_SYNC_POINTS * ctx.lanes)
+    ctx.memory_blocks = 2 * ARGON2_SYNC_POINTS * ctx.lanes;
+  ctx.segment_length = ctx.memory_blocks / (ctx.lanes * ARGON2_SYNC_POINTS);
+  ctx.lane_length = ctx.segment_length * ARGON2_SYNC_POINTS;
+  ctx.memory_blocks = ctx.lane_length * ctx.lanes;
+
+  start = holy_get_time_ms ();
+  err = arena_alloc (&ctx.arena, ctx.memory_blocks);
+  if (err)
+    return err;
+
+  /* H0: every parameter and input, each with its length.  */
+  blake2b_init (&h0, ARGON2_PREHASH_LEN);
+  blake2b_update32 (&h0, ctx.lanes);
+  blake2b_update32 (&h0, out_len);
+  blake2b_update32 (&h0, params->m_cost);
+  blake2b_update32 (&h0, ctx.passes);
+  blake2b_update32 (&h0, ARGON2_VERSION);
+  blake2b_update32 (&h0, ctx.type);
+  blake2b_update32 (&h0, pwd_len);
+  blake2b_update (&h0, pwd, pwd_len);
+  blake2b_update32 (&h0, salt_len);
+  blake2b_update (&h0, salt, salt_len);
+  blake2b_update32 (&h0, params->secret ? params->secret_len : 0);
+  if (params->secret)
+    blake2b_update (&h0, params->secret, params->secret_len);
+  blake2b_update32 (&h0, params->ad ? params->ad_len : 0);
+  if (params->ad)
+    blake2b_update (&h0, params->ad, params->ad_len);
+  blake2b_final (&h0, prehash);
+
+  for (lane = 0; lane < ctx.lanes; lane++)
+    {
+      holy_set_unaligned32 (prehash + ARGON2_PREHASH_LEN + 4,
+			    holy_cpu_to_le32 (lane));
+      holy_set_unaligned32 (prehash + ARGON2_PREHASH_LEN,
+			    holy_cpu_to_le32 (0));
+      blake2b_long (bytes, ARGON2_BLOCK_SIZE, prehash, sizeof (prehash));
+      load_block (arena_block (&ctx.arena, lane * ctx.lane_length), bytes);
+      holy_set_unaligned32 (prehash + ARGON2_PREHASH_LEN,
+			    holy_cpu_to_le32 (1));
+      blake2b_long (bytes, ARGON2_BLOCK_SIZE, prehash, sizeof (prehash));
+      load_block (arena_block (&ctx.arena, lane * ctx.lane_length + 1),
+		  bytes);
+    }
+
+  for (pass = 0; pass < ctx.passes; pass++)
+    for (slice = 0; slice < ARGON2_SYNC_POINTS; slice++)
+      for (lane = 0; lane < ctx.lanes; lane++)
+	fill_segment (&ctx, pass, lane, slice);
+
+  /* The last block of every lane, XORed together, gives the tag.  */
+  acc = *arena_block (&ctx.arena, ctx.lane_length - 1);
+  for (lane = 1; lane < ctx.lanes; lane++)
+    {
+      const struct argon2_block *b;
+      unsigned i;
+
+      b = arena_block (&ctx.arena, (lane + 1) * ctx.lane_length - 1);
+      for (i = 0; i < ARGON2_QWORDS; i++)
+	acc.v[i] ^= b->v[i];
+    }
+  store_block (bytes, &acc);
+  blake2b_long (out, out_len, bytes, sizeof (bytes));
+
+  holy_memset (prehash, 0, sizeof (prehash));
+  holy_memset (bytes, 0, sizeof (bytes));
+  holy_memset (&acc, 0, sizeof (acc));
+  arena_free (&ctx.arena);
+
+  holy_dprintf ("argon2", "%s: %u KiB, %u passes, %u lanes in %llu ms\n",
+		impl->cpu.name, ctx.memory_blocks, ctx.passes, ctx.lanes,
+		(unsigned long long) (holy_get_time_ms () - start));
+  return holy_ERR_NONE;
+}
+
+holy_MOD_INIT (argon2)
+{
+  argon2_probe ();
+}
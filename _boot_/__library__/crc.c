@@ -6,57 +6,81 @@
 #include <holy/types.h>
 #include <holy/lib/crc.h>
 
-static holy_uint32_t crc32c_table [256];
+#include "crc32c_table.h"
+
+#if (defined (__i386__) || defined (__x86_64__)) && !defined (holy_UTIL)
+#include <holy/i386/cpuid.h>
+#define CRC32C_HW	1
+#endif
+
+#ifdef CRC32C_HW
+/* -1 until probed, then whether SSE4.2 crc32 is available.  The crc32
+   instruction only uses general purpose registers, so it is safe even
+   where the FPU/SSE state is not set up.  */
+static int crc32c_have_hw = -1;
 
-/* Helper for init_crc32c_table.  */
 static holy_uint32_t
-reflect (holy_uint32_t ref, int len)
+crc32c_hw (holy_uint32_t crc, const holy_uint8_t *data, holy_size_t size)
 {
-  holy_uint32_t result = 0;
-  int i;
-
-  for (i = 1; i <= len; i++)
-    {
-      if (ref & 1)
-	result |= 1 << (len - i);
-      ref >>= 1;
-    }
+#ifdef __x86_64__
+  holy_uint64_t crc64 = crc;
 
-  return result;
+  for (; size >= 8; size -= 8, data += 8)
+    asm ("crc32q %1, %0" : "+r" (crc64)
+	 : "rm" (holy_get_unaligned64 (data)));
+  crc = crc64;
+#endif
+  for (; size >= 4; size -= 4, data += 4)
+    asm ("crc32l %1, %0" : "+r" (crc)
+	 : "rm" (holy_get_unaligned32 (data)));
+  for (; size; size--, data++)
+    asm ("crc32b %1, %0" : "+r" (crc) : "rm" (*data));
+  return crc;
 }
+#endif
 
-static void
-init_crc32c_table (void)
+/* Slice-by-8: eight bytes per step with independent table lookups.  */
+static holy_uint32_t
+crc32c_sw (holy_uint32_t crc, const holy_uint8_t *data, holy_size_t size)
 {
-  holy_uint32_t polynomial = 0x1edc6f41;
-  int i, j;
+  for (; size && ((holy_addr_t) data & 7); size--, data++)
+    crc = (crc >> 8) ^ crc32c_table[0][(crc & 0xff) ^ *data];
 
-  for(i = 0; i < 256; i++)
+  for (; size >= 8; size -= 8, data += 8)
     {
-      crc32c_table[i] = reflect(i, 8) << 24;
-      for (j = 0; j < 8; j++)
-        crc32c_table[i] = (crc32c_table[i] << 1) ^
-            (crc32c_table[i] & (1 << 31) ? polynomial : 0);
-      crc32c_table[i] = reflect(crc32c_table[i], 32);
+      holy_uint32_t lo = crc ^ holy_le_to_cpu32 (*(const holy_uint32_t *) data);
+      holy_uint32_t hi = holy_le_to_cpu32 (*(const holy_uint32_t *) (data + 4));
+
+      crc = (crc32c_table[7][lo & 0xff]
+	     ^ crc32c_table[6][(lo >> 8) & 0xff]
+	     ^ crc32c_table[5][(lo >> 16) & 0xff]
+	     ^ crc32c_table[4][lo >> 24]
+	     ^ crc32c_table[3][hi & 0xff]
+	     ^ crc32c_table[2][(hi >> 8) & 0xff]
+	     ^ crc32c_table[1][(hi >> 16) & 0xff]
+	     ^ crc32c_table[0][hi >> 24]);
     }
+
+  for (; size; size--, data++)
+    crc = (crc >> 8) ^ crc32c_table[0][(crc & 0xff) ^ *data];
+
+  return crc;
 }
 
 holy_uint32_t
 holy_getcrc32c (holy_uint32_t crc, const void *buf, int size)
 {
-  int i;
-  const holy_uint8_t *data = buf;
+  if (size <= 0)
+    return crc;
 
-  if (! crc32c_table[1])
-    init_crc32c_table ();
+  crc ^= 0xffffffff;
 
-  crc^= 0xffffffff;
-
-  for (i = 0; i < size; i++)
-    {
-      crc = (crc >> 8) ^ crc32c_table[(crc & 0xFF) ^ *data];
-      data++;
-    }
+#ifdef CRC32C_HW
+  if (crc32c_have_hw < 0)
+    crc32c_have_hw = holy_cpu_has (holy_CPU_SSE4_2);
+  if (crc32c_have_hw)
+    return crc32c_hw (crc, buf, size) ^ 0xffffffff;
+#endif
 
-  return crc ^ 0xffffffff;
+  return crc32c_sw (crc, buf, size) ^ 0xffffffff;
 }
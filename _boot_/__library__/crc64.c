@@ -6,67 +6,171 @@
 #include <holy/types.h>
 #include <holy/dl.h>
 #include <holy/crypto.h>
+#include <holy/lib/crc.h>
+#include <holy/cpu_impl.h>
+
+#include "crc64_table.h"
+
+#ifdef __x86_64__
+#define CRC64_PCLMUL	1
+#endif
 
 holy_MOD_LICENSE ("GPLv2+");
 
-static holy_uint64_t crc64_table [256];
+/* CRC64 of SIZE bytes at DATA, carrying on from the raw register CRC
+   (that is, without the final inversion).  */
+typedef holy_uint64_t (*crc64_update_t) (holy_uint64_t crc,
+					 const holy_uint8_t *data,
+					 holy_size_t size);
 
-/* Helper for init_crc64_table.  */
 static holy_uint64_t
-reflect (holy_uint64_t ref, int len)
+crc64_slice8 (holy_uint64_t crc, const holy_uint8_t *data, holy_size_t size)
 {
-  holy_uint64_t result = 0;
-  int i;
-
-  for (i = 1; i <= len; i++)
+  for (; size >= 8; size -= 8, data += 8)
     {
-      if (ref & 1)
-	result |= 1ULL << (len - i);
-      ref >>= 1;
+      holy_uint64_t v = crc ^ holy_le_to_cpu64 (holy_get_unaligned64 (data));
+
+      crc = (crc64_table[7][v & 0xff]
+	     ^ crc64_table[6][(v >> 8) & 0xff]
+	     ^ crc64_table[5][(v >> 16) & 0xff]
+	     ^ crc64_table[4][(v >> 24) & 0xff]
+	     ^ crc64_table[3][(v >> 32) & 0xff]
+	     ^ crc64_table[2][(v >> 40) & 0xff]
+	     ^ crc64_table[1][(v >> 48) & 0xff]
+	     ^ crc64_table[0][v >> 56]);
     }
 
-  return result;
+  for (; size; size--, data++)
+    crc = (crc >> 8) ^ crc64_table[0][(crc & 0xFF) ^ *data];
+
+  return crc;
 }
 
-static void
-init_crc64_table (void)
+#ifdef CRC64_PCLMUL
+#define PCLMUL_FN	__attribute__ ((target ("sse2,pclmul")))
+
+typedef long long v2di __attribute__ ((vector_size (16)));
+
+/* x^n mod P, bit-reflected.  Folding a 128-bit block D bits further on
+   multiplies its first half by x^(D + 63) and its second by x^(D - 1); the
+   odd exponents make up for the product of two reflected 64-bit values
+   coming out one bit low.  */
+#define X127	0xdabe95afc7875f40ULL
+#define X191	0xe05dd497ca393ae4ULL
+#define X511	0x081f6054a7842df4ULL
+#define X575	0x6ae3efbb9dd441f3ULL
+
+static inline PCLMUL_FN v2di
+loadu (const void *p)
+{
+  v2di v;
+
+  __builtin_memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+static inline PCLMUL_FN v2di
+fold (v2di x, v2di k)
 {
-  holy_uint64_t polynomial = 0x42f0e1eba9ea3693ULL;
-  int i, j;
+  return (__builtin_ia32_pclmulqdq128 (x, k, 0x00)
+	  ^ __builtin_ia32_pclmulqdq128 (x, k, 0x11));
+}
 
-  for(i = 0; i < 256; i++)
+/* Fold 64 bytes at a time in four independent streams, then the streams
+   into one another, then whole 16-byte blocks.  What is left over is an
+   ordinary message whose CRC from zero is that of everything so far.  */
+static PCLMUL_FN holy_uint64_t
+crc64_pclmul (holy_uint64_t crc, const holy_uint8_t *data, holy_size_t size)
+{
+  v2di k128 = { X191, X127 }, k512 = { X575, X511 };
+  v2di x0, x1, x2, x3;
+  holy_uint8_t rest[16];
+
+  if (size < 64)
+    return crc64_slice8 (crc, data, size);
+
+  x0 = loadu (data) ^ (v2di) { crc, 0 };
+  x1 = loadu (data + 16);
+  x2 = loadu (data + 32);
+  x3 = loadu (data + 48);
+  for (data += 64, size -= 64; size >= 64; data += 64, size -= 64)
     {
-      crc64_table[i] = reflect(i, 8) << 56;
-      for (j = 0; j < 8; j++)
-	{
-	  crc64_table[i] = (crc64_table[i] << 1) ^
-            (crc64_table[i] & (1ULL << 63) ? polynomial : 0);
-	}
-      crc64_table[i] = reflect(crc64_table[i], 64);
+      x0 = fold (x0, k512) ^ loadu (data);
+      x1 = fold (x1, k512) ^ loadu (data + 16);
+      x2 = fold (x2, k512) ^ loadu (data + 32);
+      x3 = fold (x3, k512) ^ loadu (data + 48);
     }
+
+  x1 ^= fold (x0, k128);
+  x2 ^= fold (x1, k128);
+  x3 ^= fold (x2, k128);
+  for (; size >= 16; data += 16, size -= 16)
+    x3 = fold (x3, k128) ^ loadu (data);
+
+  __builtin_memcpy (rest, &x3, sizeof (rest));
+  crc = crc64_slice8 (0, rest, sizeof (rest));
+  return crc64_slice8 (crc, data, size);
+}
+#endif
+
+struct crc64_impl
+{
+  struct holy_cpu_impl cpu;
+  crc64_update_t update;
+};
+
+static const struct crc64_impl impls[] =
+  {
+#ifdef CRC64_PCLMUL
+    { { "pclmul", holy_CPU_SSE2 | holy_CPU_PCLMUL }, crc64_pclmul },
+#endif
+    { { "slice8", 0 }, crc64_slice8 },
+  };
+
+static const struct crc64_impl *impl;
+
+static void
+crc64_probe (void)
+{
+  impl = holy_cpu_impl_find (impls, ARRAY_SIZE (impls), sizeof (impls[0]),
+			     NULL);
+}
+
+const char *
+holy_crc64_implementation (void)
+{
+  if (!impl)
+    crc64_probe ();
+  return impl->cpu.name;
+}
+
+int
+holy_crc64_select (const char *name)
+{
+  const void *found;
+
+  found = holy_cpu_impl_find (impls, ARRAY_SIZE (impls), sizeof (impls[0]),
+			      name);
+  if (!found)
+    return -1;
+  impl = found;
+  return 0;
 }
 
 static void
 crc64_init (void *context)
 {
-  if (! crc64_table[1])
-    init_crc64_table ();
+  if (!impl)
+    crc64_probe ();
   *(holy_uint64_t *) context = 0;
 }
 
 static void
 crc64_write (void *context, const void *buf, holy_size_t size)
 {
-  unsigned i;
-  const holy_uint8_t *data = buf;
   holy_uint64_t crc = ~holy_le_to_cpu64 (*(holy_uint64_t *) context);
 
-  for (i = 0; i < size; i++)
-    {
-      crc = (crc >> 8) ^ crc64_table[(crc & 0xFF) ^ *data];
-      data++;
-    }
-
+  crc = impl->update (crc, buf, size);
   *(holy_uint64_t *) context = holy_cpu_to_le64 (~crc);
 }
 
@@ -21,20 +21,15 @@ static void
 holy_disk_cache_invalidate (unsigned long dev_id, unsigned long disk_id,
 			    holy_disk_addr_t sector)
 {
-  unsigned cache_index;
   struct holy_disk_cache *cache;
 
   sector &= ~((holy_disk_addr_t) holy_DISK_CACHE_SIZE - 1);
-  cache_index = holy_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = holy_disk_cache_table + cache_index;
+  cache = holy_disk_cache_lookup (dev_id, disk_id, sector);
 
-  if (cache->dev_id == dev_id && cache->disk_id == disk_id
-      && cache->sector == sector && cache->data)
+  if (cache)
     {
-      cache->lock = 1;
-      holy_free (cache->data);
-      cache->data = 0;
-      cache->lock = 0;
+      cache->valid = 0;
+      cache->stamp = 0;
     }
 }
 
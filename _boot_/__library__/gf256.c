@@ -0,0 +1,501 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+/* GF(2^8) block kernels for RAID parity reconstruction.  Multiplying a
+   block by a constant C is linear, so C * b = C * (b & 0x0f) + C * (b &
+   0xf0) and two 16-entry tables per constant do the job: with SSSE3 one
+   pshufb looks up 16 bytes at once, and with AVX2 one vpshufb 32.  Without
+   them the portable code doubles eight bytes at a time in a 64-bit word and
+   adds up the powers of two set in C.  The log/exp table version is kept as the reference.  */
+
+#include <holy/types.h>
+#include <holy/misc.h>
+#include <holy/dl.h>
+#include <holy/crypto.h>
+#include <holy/gf256.h>
+#include <holy/cpu_impl.h>
+
+#ifdef __x86_64__
+#define GF256_SSSE3	1
+#define GF256_AVX2	1
+#endif
+
+holy_MOD_LICENSE ("GPLv2+");
+
+static const holy_uint8_t poly = 0x1d;
+
+/* x**y, twice over so that sums of two logarithms need no reduction.  */
+static holy_uint8_t powx[255 * 2];
+/* Such an s that x**s = y.  */
+static holy_uint8_t powx_inv[256];
+
+struct gf256_impl
+{
+  struct holy_cpu_impl cpu;
+  void (*mul) (holy_uint8_t *buf, holy_uint8_t c, holy_size_t size);
+  void (*muladd) (holy_uint8_t *dst, const holy_uint8_t *src,
+		  holy_uint8_t c, holy_size_t size);
+  void (*xor) (holy_uint8_t *dst, const holy_uint8_t *src,
+	       holy_size_t size);
+};
+
+static const struct gf256_impl *impl;
+
+static void gf256_probe (void);
+
+static inline void
+gf256_init (void)
+{
+  if (!impl)
+    gf256_probe ();
+}
+
+holy_uint8_t
+holy_gf256_mul (holy_uint8_t a, holy_uint8_t b)
+{
+  gf256_init ();
+  if (a == 0 || b == 0)
+    return 0;
+  return powx[powx_inv[a] + powx_inv[b]];
+}
+
+holy_uint8_t
+holy_gf256_exp (unsigned e)
+{
+  gf256_init ();
+  return powx[e % 255];
+}
+
+unsigned
+holy_gf256_log (holy_uint8_t a)
+{
+  gf256_init ();
+  return powx_inv[a];
+}
+
+holy_uint8_t
+holy_gf256_inv (holy_uint8_t a)
+{
+  gf256_init ();
+  return powx[255 - powx_inv[a]];
+}
+
+/* Reference code, one byte at a time through the tables.  */
+
+static void
+table_mul (holy_uint8_t *buf, holy_uint8_t c, holy_size_t size)
+{
+  unsigned lc = powx_inv[c];
+
+  for (; size--; buf++)
+    if (*buf)
+      *buf = powx[powx_inv[*buf] + lc];
+}
+
+static void
+table_muladd (holy_uint8_t *dst, const holy_uint8_t *src, holy_uint8_t c,
+	      holy_size_t size)
+{
+  unsigned lc = powx_inv[c];
+
+  for (; size--; src++, dst++)
+    if (*src)
+      *dst ^= powx[powx_inv[*src] + lc];
+}
+
+static void
+table_xor (holy_uint8_t *dst, const holy_uint8_t *src, holy_size_t size)
+{
+  for (; size--; src++, dst++)
+    *dst ^= *src;
+}
+
+/* Eight field elements in a 64-bit word.  */
+
+#define SWAR_LOW7	0x7f7f7f7f7f7f7f7fULL
+#define SWAR_ONES	0x0101010101010101ULL
+
+/* Multiply every byte of V by x.  */
+static inline holy_uint64_t
+swar_mulx (holy_uint64_t v)
+{
+  return ((v & SWAR_LOW7) << 1) ^ (((v >> 7) & SWAR_ONES) * poly);
+}
+
+/* Four words at a time: they are independent, which keeps the doubling
+   chains from stalling on each other.  */
+#define SWAR_MULC4(c)							\
+  do									\
+    {									\
+      holy_uint8_t bits_ = (c);						\
+      r0 = r1 = r2 = r3 = 0;						\
+      for (;;)								\
+	{								\
+	  if (bits_ & 1)						\
+	    {								\
+	      r0 ^= v0;							\
+	      r1 ^= v1;							\
+	      r2 ^= v2;							\
+	      r3 ^= v3;							\
+	    }								\
+	  bits_ >>= 1;							\
+	  if (!bits_)							\
+	    break;							\
+	  v0 = swar_mulx (v0);						\
+	  v1 = swar_mulx (v1);						\
+	  v2 = swar_mulx (v2);						\
+	  v3 = swar_mulx (v3);						\
+	}								\
+    }									\
+  while (0)
+
+static void
+swar_mul (holy_uint8_t *buf, holy_uint8_t c, holy_size_t size)
+{
+  holy_uint64_t v0, v1, v2, v3, r0, r1, r2, r3;
+
+  for (; size >= 32; size -= 32, buf += 32)
+    {
+      v0 = holy_get_unaligned64 (buf);
+      v1 = holy_get_unaligned64 (buf + 8);
+      v2 = holy_get_unaligned64 (buf + 16);
+      v3 = holy_get_unaligned64 (buf + 24);
+      SWAR_MULC4 (c);
+      holy_set_unaligned64 (buf, r0);
+      holy_set_unaligned64 (buf + 8, r1);
+      holy_set_unaligned64 (buf + 16, r2);
+      holy_set_unaligned64 (buf + 24, r3);
+    }
+  table_mul (buf, c, size);
+}
+
+static void
+swar_muladd (holy_uint8_t *dst, const holy_uint8_t *src, holy_uint8_t c,
+	     holy_size_t size)
+{
+  holy_uint64_t v0, v1, v2, v3, r0, r1, r2, r3;
+
+  for (; size >= 32; size -= 32, src += 32, dst += 32)
+    {
+      v0 = holy_get_unaligned64 (src);
+      v1 = holy_get_unaligned64 (src + 8);
+      v2 = holy_get_unaligned64 (src + 16);
+      v3 = holy_get_unaligned64 (src + 24);
+      SWAR_MULC4 (c);
+      holy_set_unaligned64 (dst, holy_get_unaligned64 (dst) ^ r0);
+      holy_set_unaligned64 (dst + 8, holy_get_unaligned64 (dst + 8) ^ r1);
+      holy_set_unaligned64 (dst + 16, holy_get_unaligned64 (dst + 16) ^ r2);
+      holy_set_unaligned64 (dst + 24, holy_get_unaligned64 (dst + 24) ^ r3);
+    }
+  table_muladd (dst, src, c, size);
+}
+
+static void
+swar_xor (holy_uint8_t *dst, const holy_uint8_t *src, holy_size_t size)
+{
+  holy_crypto_xor (dst, dst, src, size);
+}
+
+#ifdef GF256_SSSE3
+#define SSSE3_FN	__attribute__ ((target ("sse2,ssse3")))
+
+typedef long long v2di __attribute__ ((vector_size (16)));
+typedef char v16qi __attribute__ ((vector_size (16)));
+typedef short v8hi __attribute__ ((vector_size (16)));
+
+static inline SSSE3_FN v2di
+loadu (const void *p)
+{
+  v2di v;
+
+  __builtin_memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+static inline SSSE3_FN void
+storeu (void *p, v2di v)
+{
+  __builtin_memcpy (p, &v, sizeof (v));
+}
+
+/* Products of C with every value of the low and the high nibble.  */
+static inline SSSE3_FN void
+ssse3_tables (holy_uint8_t c, v2di *lo, v2di *hi)
+{
+  holy_uint8_t l[16], h[16];
+  unsigned i;
+
+  for (i = 0; i < 16; i++)
+    {
+      l[i] = holy_gf256_mul (c, i);
+      h[i] = holy_gf256_mul (c, i << 4);
+    }
+  *lo = loadu (l);
+  *hi = loadu (h);
+}
+
+static inline SSSE3_FN v2di
+ssse3_mulc (v2di v, v2di lo, v2di hi, v2di mask)
+{
+  v2di l = v & mask;
+  v2di h = (v2di) __builtin_ia32_psrlwi128 ((v8hi) v, 4) & mask;
+
+  return ((v2di) __builtin_ia32_pshufb128 ((v16qi) lo, (v16qi) l)
+	  ^ (v2di) __builtin_ia32_pshufb128 ((v16qi) hi, (v16qi) h));
+}
+
+static SSSE3_FN void
+ssse3_mul (holy_uint8_t *buf, holy_uint8_t c, holy_size_t size)
+{
+  v2di lo, hi, mask = (v2di) { 0x0f0f0f0f0f0f0f0fLL, 0x0f0f0f0f0f0f0f0fLL };
+
+  ssse3_tables (c, &lo, &hi);
+  for (; size >= 32; size -= 32, buf += 32)
+    {
+      v2di v0 = loadu (buf), v1 = loadu (buf + 16);
+
+      storeu (buf, ssse3_mulc (v0, lo, hi, mask));
+      storeu (buf + 16, ssse3_mulc (v1, lo, hi, mask));
+    }
+  for (; size >= 16; size -= 16, buf += 16)
+    storeu (buf, ssse3_mulc (loadu (buf), lo, hi, mask));
+  table_mul (buf, c, size);
+}
+
+static SSSE3_FN void
+ssse3_muladd (holy_uint8_t *dst, const holy_uint8_t *src, holy_uint8_t c,
+	      holy_size_t size)
+{
+  v2di lo, hi, mask = (v2di) { 0x0f0f0f0f0f0f0f0fLL, 0x0f0f0f0f0f0f0f0fLL };
+
+  ssse3_tables (c, &lo, &hi);
+  for (; size >= 32; size -= 32, src += 32, dst += 32)
+    {
+      v2di v0 = ssse3_mulc (loadu (src), lo, hi, mask);
+      v2di v1 = ssse3_mulc (loadu (src + 16), lo, hi, mask);
+
+      storeu (dst, loadu (dst) ^ v0);
+      storeu (dst + 16, loadu (dst + 16) ^ v1);
+    }
+  for (; size >= 16; size -= 16, src += 16, dst += 16)
+    storeu (dst, loadu (dst) ^ ssse3_mulc (loadu (src), lo, hi, mask));
+  table_muladd (dst, src, c, size);
+}
+
+static SSSE3_FN void
+ssse3_xor (holy_uint8_t *dst, const holy_uint8_t *src, holy_size_t size)
+{
+  for (; size >= 32; size -= 32, src += 32, dst += 32)
+    {
+      v2di v0 = loadu (src), v1 = loadu (src + 16);
+
+      storeu (dst, loadu (dst) ^ v0);
+      storeu (dst + 16, loadu (dst + 16) ^ v1);
+    }
+  table_xor (dst, src, size);
+}
+#endif
+
+#ifdef GF256_AVX2
+#define AVX2_FN		__attribute__ ((target ("avx2")))
+
+typedef long long v4di __attribute__ ((vector_size (32)));
+typedef char v32qi __attribute__ ((vector_size (32)));
+typedef short v16hi __attribute__ ((vector_size (32)));
+
+static inline AVX2_FN v4di
+loadu256 (const void *p)
+{
+  v4di v;
+
+  __builtin_memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+static inline AVX2_FN void
+storeu256 (void *p, v4di v)
+{
+  __builtin_memcpy (p, &v, sizeof (v));
+}
+
+/* As ssse3_tables, but vpshufb looks up within each 128-bit half, so both
+   halves get the tables.  */
+static inline AVX2_FN void
+avx2_tables (holy_uint8_t c, v4di *lo, v4di *hi)
+{
+  holy_uint8_t l[32], h[32];
+  unsigned i;
+
+  for (i = 0; i < 16; i++)
+    {
+      l[i] = l[i + 16] = holy_gf256_mul (c, i);
+      h[i] = h[i + 16] = holy_gf256_mul (c, i << 4);
+    }
+  *lo = loadu256 (l);
+  *hi = loadu256 (h);
+}
+
+static inline AVX2_FN v4di
+avx2_mulc (v4di v, v4di lo, v4di hi, v4di mask)
+{
+  v4di l = v & mask;
+  v4di h = (v4di) __builtin_ia32_psrlwi256 ((v16hi) v, 4) & mask;
+
+  return ((v4di) __builtin_ia32_pshufb256 ((v32qi) lo, (v32qi) l)
+	  ^ (v4di) __builtin_ia32_pshufb256 ((v32qi) hi, (v32qi) h));
+}
+
+#define AVX2_NIBBLES							\
+  ((v4di) { 0x0f0f0f0f0f0f0f0fLL, 0x0f0f0f0f0f0f0f0fLL,			\
+	    0x0f0f0f0f0f0f0f0fLL, 0x0f0f0f0f0f0f0f0fLL })
+
+static AVX2_FN void
+avx2_mul (holy_uint8_t *buf, holy_uint8_t c, holy_size_t size)
+{
+  v4di lo, hi, mask = AVX2_NIBBLES;
+
+  avx2_tables (c, &lo, &hi);
+  for (; size >= 64; size -= 64, buf += 64)
+    {
+      v4di v0 = loadu256 (buf), v1 = loadu256 (buf + 32);
+
+      storeu256 (buf, avx2_mulc (v0, lo, hi, mask));
+      storeu256 (buf + 32, avx2_mulc (v1, lo, hi, mask));
+    }
+  for (; size >= 32; size -= 32, buf += 32)
+    storeu256 (buf, avx2_mulc (loadu256 (buf), lo, hi, mask));
+  table_mul (buf, c, size);
+}
+
+static AVX2_FN void
+avx2_muladd (holy_uint8_t *dst, const holy_uint8_t *src, holy_uint8_t c,
+	     holy_size_t size)
+{
+  v4di lo, hi, mask = AVX2_NIBBLES;
+
+  avx2_tables (c, &lo, &hi);
+  for (; size >= 64; size -= 64, src += 64, dst += 64)
+    {
+      v4di v0 = avx2_mulc (loadu256 (src), lo, hi, mask);
+      v4di v1 = avx2_mulc (loadu256 (src + 32), lo, hi, mask);
+
+      storeu256 (dst, loadu256 (dst) ^ v0);
+      storeu256 (dst + 32, loadu256 (dst + 32) ^ v1);
+    }
+  for (; size >= 32; size -= 32, src += 32, dst += 32)
+    storeu256 (dst, loadu256 (dst) ^ avx2_mulc (loadu256 (src), lo, hi,
+						 mask));
+  table_muladd (dst, src, c, size);
+}
+
+static AVX2_FN void
+avx2_xor (holy_uint8_t *dst, const holy_uint8_t *src, holy_size_t size)
+{
+  for (; size >= 64; size -= 64, src += 64, dst += 64)
+    {
+      v4di v0 = loadu256 (src), v1 = loadu256 (src + 32);
+
+      storeu256 (dst, loadu256 (dst) ^ v0);
+      storeu256 (dst + 32, loadu256 (dst + 32) ^ v1);
+    }
+  table_xor (dst, src, size);
+}
+
+#undef AVX2_NIBBLES
+#endif
+
+static const struct gf256_impl impls[] =
+  {
+#ifdef GF256_AVX2
+    { { "avx2", holy_CPU_AVX2 }, avx2_mul, avx2_muladd, avx2_xor },
+#endif
+#ifdef GF256_SSSE3
+    { { "ssse3", holy_CPU_SSE2 | holy_CPU_SSSE3 },
+      ssse3_mul, ssse3_muladd, ssse3_xor },
+#endif
+    { { "swar", 0 }, swar_mul, swar_muladd, swar_xor },
+    { { "table", 0 }, table_mul, table_muladd, table_xor },
+  };
+
+static void
+gf256_probe (void)
+{
+  holy_uint8_t cur = 1;
+  unsigned i;
+
+  for (i = 0; i < 255; i++)
+    {
+      powx[i] = cur;
+      powx[i + 255] = cur;
+      powx_inv[cur] = i;
+      if (cur & 0x80)
+	cur = (cur << 1) ^ poly;
+      else
+	cur <<= 1;
+    }
+
+  impl = holy_cpu_impl_find (impls, ARRAY_SIZE (impls), sizeof (impls[0]),
+			     NULL);
+}
+
+int
+holy_gf256_select (const char *name)
+{
+  const void *found;
+
+  gf256_init ();
+  found = holy_cpu_impl_find (impls, ARRAY_SIZE (impls), sizeof (impls[0]),
+			      name);
+  if (!found)
+    return -1;
+  impl = found;
+  return 0;
+}
+
+const char *
+holy_gf256_implementation (void)
+{
+  gf256_init ();
+  return impl->cpu.name;
+}
+
+void
+holy_gf256_mul_block (void *buf, holy_uint8_t c, holy_size_t size)
+{
+  gf256_init ();
+  if (c == 1)
+    return;
+  if (c == 0)
+    {
+      holy_memset (buf, 0, size);
+      return;
+    }
+  impl->mul (buf, c, size);
+}
+
+void
+holy_gf256_muladd_block (void *dst, const void *src, holy_uint8_t c,
+			 holy_size_t size)
+{
+  gf256_init ();
+  if (c == 0)
+    return;
+  if (c == 1)
+    impl->xor (dst, src, size);
+  else
+    impl->muladd (dst, src, c, size);
+}
+
+void
+holy_gf256_xor_block (void *dst, const void *src, holy_size_t size)
+{
+  gf256_init ();
+  impl->xor (dst, src, size);
+}
+
+holy_MOD_INIT(gf256)
+{
+  gf256_init ();
+}
@@ -0,0 +1,532 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+/* A small JSON parser for metadata such as LUKS2 headers.  The document
+   is parsed once into a flat array of tokens, in document order, each of
+   which knows where the next value after it starts: walking to a child
+   skips whole subtrees instead of scanning them.  The array is allocated
+   in one piece after a first pass has counted the tokens.  */
+
+#include <holy/types.h>
+#include <holy/misc.h>
+#include <holy/mm.h>
+#include <holy/dl.h>
+#include <holy/i18n.h>
+#include <holy/json.h>
+
+holy_MOD_LICENSE ("GPLv2+");
+
+/* Deepest nesting accepted, to bound the recursion.  */
+#define JSON_MAX_DEPTH	32
+
+struct holy_json_token
+{
+  holy_json_type_t type;
+  /* Text of strings and primitives, without quotes.  */
+  holy_size_t start;
+  holy_size_t end;
+  /* Elements of an array, or members of an object.  */
+  holy_size_t size;
+  /* Index of the first token after this value.  */
+  holy_size_t next;
+};
+
+struct json_parser
+{
+  char *s;
+  holy_size_t len;
+  holy_size_t pos;
+  /* NULL while counting.  */
+  struct holy_json_token *tokens;
+  holy_size_t ntokens;
+};
+
+static void
+skip_space (struct json_parser *p)
+{
+  while (p->pos < p->len
+	 && (p->s[p->pos] == ' ' || p->s[p->pos] == '\t'
+	     || p->s[p->pos] == '\n' || p->s[p->pos] == '\r'))
+    p->pos++;
+}
+
+static holy_size_t
+new_token (struct json_parser *p, holy_json_type_t type)
+{
+  if (p->tokens)
+    {
+      p->tokens[p->ntokens].type = type;
+      p->tokens[p->ntokens].start = p->pos;
+      p->tokens[p->ntokens].end = p->pos;
+      p->tokens[p->ntokens].size = 0;
+    }
+  return p->ntokens++;
+}
+
+static int
+hex_value (char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+/* Parse a string at the opening quote.  Escapes are undone in place when
+   filling the tokens; the text only ever gets shorter.  */
+static int
+parse_string (struct json_parser *p)
+{
+  holy_size_t t, out;
+
+  t = new_token (p, holy_JSON_STRING);
+  p->pos++;
+  out = p->pos;
+  if (p->tokens)
+    p->tokens[t].start = out;
+
+  for (; p->pos < p->len; p->pos++)
+    {
+      char c = p->s[p->pos];
+      holy_uint32_t u;
+      int i;
+
+      if (c == '"')
+	{
+	  if (p->tokens)
+	    {
+	      p->tokens[t].end = out;
+	      p->tokens[t].next = t + 1;
+	    }
+	  p->pos++;
+	  return 0;
+	}
+      if ((unsigned char) c < 0x20)
+	return -1;
+      if (c != '\\')
+	{
+	  if (p->tokens)
+	    p->s[out] = c;
+	  out++;
+	  continue;
+	}
+
+      if (++p->pos >= p->len)
+	return -1;
+      switch (p->s[p->pos])
+	{
+	case '"':
+	case '\\':
+	case '/':
+	  c = p->s[p->pos];
+	  break;
+	case 'b':
+	  c = '\b';
+	  break;
+	case 'f':
+	  c = '\f';
+	  break;
+	case 'n':
+	  c = '\n';
+	  break;
+	case 'r':
+	  c = '\r';
+	  break;
+	case 't':
+	  c = '\t';
+	  break;
+	case 'u':
+	  if (p->pos + 4 >= p->len)
+	    return -1;
+	  for (u = 0, i = 1; i <= 4; i++)
+	    {
+	      int h = hex_value (p->s[p->pos + i]);
+
+	      if (h < 0)
+		return -1;
+	      u = (u << 4) | h;
+	    }
+	  p->pos += 4;
+	  /* Six characters always have room for the UTF-8 of one code
+	     unit; surrogates are kept as they are.  */
+	  if (u >= 0x800)
+	    {
+	      if (p->tokens)
+		{
+		  p->s[out] = 0xe0 | (u >> 12);
+		  p->s[out + 1] = 0x80 | ((u >> 6) & 0x3f);
+		  p->s[out + 2] = 0x80 | (u & 0x3f);
+		}
+	      out += 3;
+	      continue;
+	    }
+	  if (u >= 0x80)
+	    {
+	      if (p->tokens)
+		{
+		  p->s[out] = 0xc0 | (u >> 6);
+		  p->s[out + 1] = 0x80 | (u & 0x3f);
+		}
+	      out += 2;
+	      continue;
+	    }
+	  c = u;
+	  break;
+	default:
+	  return -1;
+	}
+      if (p->tokens)
+	p->s[out] = c;
+      out++;
+    }
+  return -1;
+}
+
+static int
+parse_primitive (struct json_parser *p)
+{
+  holy_size_t t, start = p->pos;
+
+  t = new_token (p, holy_JSON_PRIMITIVE);
+  while (p->pos < p->len
+	 && (holy_isalpha (p->s[p->pos]) || holy_isdigit (p->s[p->pos])
+	     || p->s[p->pos] == '-' || p->s[p->pos] == '+'
+	     || p->s[p->pos] == '.'))
+    p->pos++;
+
+  if (p->pos == start)
+    return -1;
+  if (holy_isalpha (p->s[start])
+      && !(p->pos - start == 4 && holy_memcmp (p->s + start, "true", 4) == 0)
+      && !(p->pos - start == 5 && holy_memcmp (p->s + start, "false", 5) == 0)
+      && !(p->pos - start == 4 && holy_memcmp (p->s + start, "null", 4) == 0))
+    return -1;
+
+  if (p->tokens)
+    {
+      p->tokens[t].end = p->pos;
+      p->tokens[t].next = t + 1;
+    }
+  return 0;
+}
+
+static int
+parse_value (struct json_parser *p, unsigned depth)
+{
+  holy_size_t t, size = 0;
+  char close;
+
+  skip_space (p);
+  if (p->pos >= p->len)
+    return -1;
+  if (p->s[p->pos] == '"')
+    return parse_string (p);
+  if (p->s[p->pos] != '{' && p->s[p->pos] != '[')
+    return parse_primitive (p);
+
+  if (depth >= JSON_MAX_DEPTH)
+    return -1;
+  close = p->s[p->pos] == '{' ? '}' : ']';
+  t = new_token (p, close == '}' ? holy_JSON_OBJECT : holy_JSON_ARRAY);
+  p->pos++;
+
+  skip_space (p);
+  if (p->pos < p->len && p->s[p->pos] == close)
+    p->pos++;
+  else
+    for (;;)
+      {
+	if (close == '}')
+	  {
+	    skip_space (p);
+	    if (p->pos >= p->len || p->s[p->pos] != '"'
+		|| parse_string (p) < 0)
+	      return -1;
+	    skip_space (p);
+	    if (p->pos >= p->len || p->s[p->pos] != ':')
+	      return -1;
+	    p->pos++;
+	  }
+	if (parse_value (p, depth + 1) < 0)
+	  return -1;
+	size++;
+
+	skip_space (p);
+	if (p->pos >= p->len)
+	  return -1;
+	if (p->s[p->pos] == close)
+	  {
+	    p->pos++;
+	    break;
+	  }
+	if (p->s[p->pos] != ',')
+	  return -1;
+	p->pos++;
+      }
+
+  if (p->tokens)
+    {
+      p->tokens[t].size = size;
+      p->tokens[t].next = p->ntokens;
+    }
+  return 0;
+}
+
+static int
+parse_document (struct json_parser *p)
+{
+  p->pos = 0;
+  p->ntokens = 0;
+  /* Only objects and arrays, so that every string and primitive is
+     followed by a character token_string can overwrite.  */
+  skip_space (p);
+  if (p->pos >= p->len || (p->s[p->pos] != '{' && p->s[p->pos] != '['))
+    return -1;
+  if (parse_value (p, 0) < 0)
+    return -1;
+  skip_space (p);
+  /* LUKS2 pads its JSON area with zeros.  */
+  while (p->pos < p->len && p->s[p->pos] == '\0')
+    p->pos++;
+  return p->pos == p->len ? 0 : -1;
+}
+
+holy_err_t
+holy_json_parse (holy_json_t **out, char *string, holy_size_t string_len)
+{
+  struct json_parser p;
+  holy_json_t *json;
+
+  p.s = string;
+  p.len = string_len;
+  p.tokens = NULL;
+
+  if (parse_document (&p) < 0)
+    return holy_error (holy_ERR_BAD_ARGUMENT,
+		       N_("invalid JSON at offset %llu"),
+		       (unsigned long long) p.pos);
+
+  json = holy_zalloc (sizeof (*json));
+  if (!json)
+    return holy_errno;
+  p.tokens = holy_malloc (p.ntokens * sizeof (p.tokens[0]));
+  if (!p.tokens)
+    {
+      holy_free (json);
+      return holy_errno;
+    }
+  parse_document (&p);
+
+  json->tokens = p.tokens;
+  json->string = string;
+  json->idx = 0;
+  *out = json;
+  return holy_ERR_NONE;
+}
+
+void
+holy_json_free (holy_json_t *json)
+{
+  if (!json)
+    return;
+  holy_free (json->tokens);
+  holy_free (json);
+}
+
+holy_json_type_t
+holy_json_gettype (const holy_json_t *json)
+{
+  return json->tokens[json->idx].type;
+}
+
+holy_err_t
+holy_json_getsize (holy_size_t *out, const holy_json_t *json)
+{
+  const struct holy_json_token *t = &json->tokens[json->idx];
+
+  if (t->type != holy_JSON_OBJECT && t->type != holy_JSON_ARRAY)
+    return holy_error (holy_ERR_BAD_ARGUMENT, N_("JSON value has no size"));
+  *out = t->size;
+  return holy_ERR_NONE;
+}
+
+/* Index of the token of element N of PARENT, or of the name of member N
+   if PARENT is an object.  */
+static holy_err_t
+child_index (holy_size_t *out, const holy_json_t *parent, holy_size_t n)
+{
+  const struct holy_json_token *t = &parent->tokens[parent->idx];
+  holy_size_t i = parent->idx + 1;
+
+  if (t->type != holy_JSON_OBJECT && t->type != holy_JSON_ARRAY)
+    return holy_error (holy_ERR_BAD_ARGUMENT,
+		       N_("JSON value has no children"));
+  if (n >= t->size)
+    return holy_error (holy_ERR_OUT_OF_RANGE,
+		       N_("JSON child %llu out of range"),
+		       (unsigned long long) n);
+
+  while (n--)
+    {
+      if (t->type == holy_JSON_OBJECT)
+	i++;
+      i = parent->tokens[i].next;
+    }
+  *out = i;
+  return holy_ERR_NONE;
+}
+
+holy_err_t
+holy_json_getchild (holy_json_t *out, const holy_json_t *parent,
+		    holy_size_t n)
+{
+  holy_size_t i;
+
+  if (child_index (&i, parent, n))
+    return holy_errno;
+  if (parent->tokens[parent->idx].type == holy_JSON_OBJECT)
+    i++;
+  out->tokens = parent->tokens;
+  out->string = parent->string;
+  out->idx = i;
+  return holy_ERR_NONE;
+}
+
+static const char *
+token_string (const holy_json_t *json, holy_size_t i)
+{
+  /* The character after the text is a quote or a delimiter, neither of
+     which is needed once the document is parsed.  */
+  json->string[json->tokens[i].end] = '\0';
+  return json->string + json->tokens[i].start;
+}
+
+holy_err_t
+holy_json_getkey (const char **out, const holy_json_t *parent,
+		  holy_size_t n)
+{
+  holy_size_t i;
+
+  if (parent->tokens[parent->idx].type != holy_JSON_OBJECT)
+    return holy_error (holy_ERR_BAD_ARGUMENT,
+		       N_("JSON value is not an object"));
+  if (child_index (&i, parent, n))
+    return holy_errno;
+  *out = token_string (parent, i);
+  return holy_ERR_NONE;
+}
+
+holy_err_t
+holy_json_getvalue (holy_json_t *out, const holy_json_t *parent,
+		    const char *key)
+{
+  const struct holy_json_token *t = &parent->tokens[parent->idx];
+  holy_size_t i = parent->idx + 1, n;
+
+  if (t->type != holy_JSON_OBJECT)
+    return holy_error (holy_ERR_BAD_ARGUMENT,
+		       N_("JSON value is not an object"));
+
+  for (n = 0; n < t->size; n++)
+    {
+      if (holy_strcmp (token_string (parent, i), key) == 0)
+	{
+	  out->tokens = parent->tokens;
+	  out->string = parent->string;
+	  out->idx = i + 1;
+	  return holy_ERR_NONE;
+	}
+      i = parent->tokens[i + 1].next;
+    }
+  return holy_error (holy_ERR_FILE_NOT_FOUND, N_("JSON key `%s' not found"),
+		     key);
+}
+
+static holy_err_t
+get_scalar (holy_json_t *out, const holy_json_t *parent, const char *key)
+{
+  holy_json_type_t type;
+
+  if (key)
+    {
+      if (holy_json_getvalue (out, parent, key))
+	return holy_errno;
+    }
+  else
+    *out = *parent;
+
+  type = holy_json_gettype (out);
+  if (type != holy_JSON_STRING && type != holy_JSON_PRIMITIVE)
+    return holy_error (holy_ERR_BAD_ARGUMENT,
+		       N_("JSON value is not a string or a number"));
+  return holy_ERR_NONE;
+}
+
+holy_err_t
+holy_json_getstring (const char **out, const holy_json_t *parent,
+		     const char *key)
+{
+  holy_json_t v;
+
+  if (get_scalar (&v, parent, key))
+    return holy_errno;
+  *out = token_string (&v, v.idx);
+  return holy_ERR_NONE;
+}
+
+static holy_err_t
+get_number (holy_uint64_t *out, int *negative, const holy_json_t *parent,
+	    const char *key)
+{
+  const char *s;
+  char *end;
+
+  if (holy_json_getstring (&s, parent, key))
+    return holy_errno;
+  *negative = (*s == '-');
+  if (*negative)
+    s++;
+  if (!holy_isdigit (*s))
+    return holy_error (holy_ERR_BAD_NUMBER, N_("invalid JSON number"));
+  holy_errno = holy_ERR_NONE;
+  *out = holy_strtoull (s, &end, 10);
+  if (holy_errno)
+    return holy_errno;
+  if (*end)
+    return holy_error (holy_ERR_BAD_NUMBER, N_("invalid JSON number"));
+  return holy_ERR_NONE;
+}
+
+holy_err_t
+holy_json_getuint64 (holy_uint64_t *out, const holy_json_t *parent,
+		     const char *key)
+{
+  int negative;
+
+  if (get_number (out, &negative, parent, key))
+    return holy_errno;
+  if (negative && *out)
+    return holy_error (holy_ERR_OUT_OF_RANGE, N_("negative JSON number"));
+  return holy_ERR_NONE;
+}
+
+holy_err_t
+holy_json_getint64 (holy_int64_t *out, const holy_json_t *parent,
+		    const char *key)
+{
+  holy_uint64_t u;
+  int negative;
+
+  if (get_number (&u, &negative, parent, key))
+    return holy_errno;
+  if (u > (holy_uint64_t) 1 << 63
+      || (!negative && u == (holy_uint64_t) 1 << 63))
+    return holy_error (holy_ERR_OUT_OF_RANGE, N_("overflow is detected"));
+  *out = negative ? -(holy_int64_t) (u - 1) - 1 : (holy_int64_t) u;
+  return holy_ERR_NONE;
+}
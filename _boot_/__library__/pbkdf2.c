@@ -3,92 +3,892 @@
  * SPDX-License-Identifier: GPL-2.0
  */
 
+/* Every PBKDF2 iteration is an HMAC under the same key, so the hash states
+   after the inner and outer pads are computed once and copied for each
+   iteration, which halves the work and avoids all allocation in the loop.
+   For SHA-1 and SHA-256 the iterations after the first one run on our own
+   compression functions: the message is always a single padded block, so
+   there is neither buffering nor byte swapping, and independent output
+   blocks (of one or several jobs) are run side by side.  */
+
 #include <holy/crypto.h>
 #include <holy/mm.h>
 #include <holy/misc.h>
 #include <holy/dl.h>
+#include <holy/cpu_impl.h>
+
+#ifdef __x86_64__
+#define PBKDF2_SHA_NI	1
+#define PBKDF2_AVX2	1
+#endif
 
 holy_MOD_LICENSE ("GPLv2+");
 
-/* Implement PKCS#5 PBKDF2 as per RFC 2898.  The PRF to use is HMAC variant
-   of digest supplied by MD.  Inputs are the password P of length PLEN,
-   the salt S of length SLEN, the iteration counter C (> 0), and the
-   desired derived output length DKLEN.  Output buffer is DK which
-   must have room for at least DKLEN octets.  The output buffer will
-   be filled with the derived data.  */
+/* Largest digest handled by the word-oriented code, in 32-bit words.  */
+#define MAX_WORDS	8
+/* Chains run side by side.  */
+#define LANES		2
+/* Chains in the vector lanes of the multi-buffer code, which only pays
+   off with at least X8_MIN of them.  */
+#define X8		8
+#define X8_MIN		2
+
+typedef void (*compress_t) (holy_uint32_t *state,
+			    const holy_uint32_t *block);
+/* Compress X8 blocks into X8 states at once.  Word K of lane J is at
+   [K][J].  */
+typedef void (*compress_x8_t) (holy_uint32_t (*state)[X8],
+			       const holy_uint32_t (*block)[X8]);
+
+/* One output block of one job: T_i = U_1 ^ U_2 ^ ... ^ U_c.  */
+struct pbkdf2_chain
+{
+  holy_uint32_t u[MAX_WORDS];
+  holy_uint32_t t[MAX_WORDS];
+  unsigned int left;
+};
+
+static inline holy_uint32_t
+rol (holy_uint32_t x, int n)
+{
+  return (x << n) | (x >> (32 - n));
+}
+
+static inline holy_uint32_t
+ror (holy_uint32_t x, int n)
+{
+  return (x >> n) | (x << (32 - n));
+}
+
+static const holy_uint32_t sha1_iv[5] =
+  {
+    0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+  };
+
+static const holy_uint32_t sha256_iv[8] =
+  {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+
+static const holy_uint32_t sha256_k[64] =
+  {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+  };
+
+/* BLOCK is the message as big-endian words, already loaded.  */
+static void
+sha1_compress (holy_uint32_t *state, const holy_uint32_t *block)
+{
+  holy_uint32_t w[16], a, b, c, d, e, t;
+  int i;
+
+  holy_memcpy (w, block, sizeof (w));
+  a = state[0];
+  b = state[1];
+  c = state[2];
+  d = state[3];
+  e = state[4];
+
+#define SHA1_STEP(f, k)							\
+  do									\
+    {									\
+      if (i >= 16)							\
+	w[i & 15] = rol (w[(i + 13) & 15] ^ w[(i + 8) & 15]		\
+			 ^ w[(i + 2) & 15] ^ w[i & 15], 1);		\
+      t = rol (a, 5) + (f) + e + (k) + w[i & 15];			\
+      e = d;								\
+      d = c;								\
+      c = rol (b, 30);							\
+      b = a;								\
+      a = t;								\
+    }									\
+  while (0)
+
+  for (i = 0; i < 20; i++)
+    SHA1_STEP (d ^ (b & (c ^ d)), 0x5a827999);
+  for (; i < 40; i++)
+    SHA1_STEP (b ^ c ^ d, 0x6ed9eba1);
+  for (; i < 60; i++)
+    SHA1_STEP ((b & c) | (d & (b | c)), 0x8f1bbcdc);
+  for (; i < 80; i++)
+    SHA1_STEP (b ^ c ^ d, 0xca62c1d6);
+#undef SHA1_STEP
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+}
+
+static void
+sha256_compress (holy_uint32_t *state, const holy_uint32_t *block)
+{
+  holy_uint32_t w[16], a, b, c, d, e, f, g, h, t1, t2;
+  int i;
+
+  holy_memcpy (w, block, sizeof (w));
+  a = state[0];
+  b = state[1];
+  c = state[2];
+  d = state[3];
+  e = state[4];
+  f = state[5];
+  g = state[6];
+  h = state[7];
+
+  for (i = 0; i < 64; i++)
+    {
+      if (i >= 16)
+	{
+	  holy_uint32_t w1 = w[(i + 1) & 15], w14 = w[(i + 14) & 15];
+
+	  w[i & 15] += ((ror (w14, 17) ^ ror (w14, 19) ^ (w14 >> 10))
+			+ w[(i + 9) & 15]
+			+ (ror (w1, 7) ^ ror (w1, 18) ^ (w1 >> 3)));
+	}
+      t1 = (h + (ror (e, 6) ^ ror (e, 11) ^ ror (e, 25))
+	    + (g ^ (e & (f ^ g))) + sha256_k[i] + w[i & 15]);
+      t2 = ((ror (a, 2) ^ ror (a, 13) ^ ror (a, 22))
+	    + ((a & b) | (c & (a | b))));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+#ifdef PBKDF2_SHA_NI
+#define SHANI_FN	__attribute__ ((target ("sse4.1,sha")))
+
+/* SHA words are unsigned and their sums wrap; the builtins want the
+   signed types, so they are wrapped below.  */
+typedef holy_uint32_t v4su __attribute__ ((vector_size (16)));
+typedef long long v2di __attribute__ ((vector_size (16)));
+typedef int v4si __attribute__ ((vector_size (16)));
+typedef short v8hi __attribute__ ((vector_size (16)));
+
+static inline SHANI_FN v4su
+loadu (const holy_uint32_t *p)
+{
+  v4su r;
+
+  __builtin_memcpy (&r, p, sizeof (r));
+  return r;
+}
+
+static inline SHANI_FN void
+storeu (holy_uint32_t *p, v4su v)
+{
+  __builtin_memcpy (p, &v, sizeof (v));
+}
+
+#define PSHUFD(a, imm)	((v4su) __builtin_ia32_pshufd ((v4si) (a), (imm)))
+#define ALIGNR(a, b, n)							\
+  ((v4su) __builtin_ia32_palignr128 ((v2di) (a), (v2di) (b), (n) * 8))
+#define BLENDW(a, b, imm)						\
+  ((v4su) __builtin_ia32_pblendw128 ((v8hi) (a), (v8hi) (b), (imm)))
+#define SHA_NI2(insn, a, b)						\
+  ((v4su) __builtin_ia32_ ## insn ((v4si) (a), (v4si) (b)))
+#define SHA1RNDS4(a, b, f)						\
+  ((v4su) __builtin_ia32_sha1rnds4 ((v4si) (a), (v4si) (b), (f)))
+#define SHA256RNDS2(a, b, k)						\
+  ((v4su) __builtin_ia32_sha256rnds2 ((v4si) (a), (v4si) (b), (v4si) (k)))
+
+static SHANI_FN void
+sha1_compress_ni (holy_uint32_t *state, const holy_uint32_t *block)
+{
+  v4su abcd, abcd_save, e, e_save, prev, m[4];
+
+  /* The instructions want A and W0 in the top lane.  */
+  abcd = PSHUFD (loadu (state), 0x1b);
+  e = (v4su) { 0, 0, 0, state[4] };
+  abcd_save = abcd;
+  e_save = e;
+  prev = abcd;
+  m[0] = PSHUFD (loadu (block), 0x1b);
+  m[1] = PSHUFD (loadu (block + 4), 0x1b);
+  m[2] = PSHUFD (loadu (block + 8), 0x1b);
+  m[3] = PSHUFD (loadu (block + 12), 0x1b);
+
+  /* Rounds 4Q to 4Q + 3.  W[Q] = msg2 (msg1 (W[Q-4], W[Q-3]) ^ W[Q-2],
+     W[Q-1]), with W[Q-4] being overwritten.  */
+#define SHA1_NI(q)							\
+  do									\
+    {									\
+      if ((q) >= 4)							\
+	m[(q) & 3] = SHA_NI2 (sha1msg2,					\
+			      SHA_NI2 (sha1msg1, m[(q) & 3],		\
+				       m[((q) + 1) & 3])		\
+			      ^ m[((q) + 2) & 3], m[((q) + 3) & 3]);	\
+      e = ((q) ? SHA_NI2 (sha1nexte, prev, m[(q) & 3]) : e + m[0]);	\
+      prev = abcd;							\
+      abcd = SHA1RNDS4 (abcd, e, (q) / 5);				\
+    }									\
+  while (0)
+
+  SHA1_NI (0); SHA1_NI (1); SHA1_NI (2); SHA1_NI (3); SHA1_NI (4);
+  SHA1_NI (5); SHA1_NI (6); SHA1_NI (7); SHA1_NI (8); SHA1_NI (9);
+  SHA1_NI (10); SHA1_NI (11); SHA1_NI (12); SHA1_NI (13); SHA1_NI (14);
+  SHA1_NI (15); SHA1_NI (16); SHA1_NI (17); SHA1_NI (18); SHA1_NI (19);
+#undef SHA1_NI
+
+  e = SHA_NI2 (sha1nexte, prev, e_save);
+  abcd += abcd_save;
+  storeu (state, PSHUFD (abcd, 0x1b));
+  state[4] = e[3];
+}
+
+static SHANI_FN void
+sha256_compress_ni (holy_uint32_t *state, const holy_uint32_t *block)
+{
+  v4su s0, s1, t, abef, cdgh, k, m[4];
+
+  /* The instructions keep the state as ABEF and CDGH.  */
+  t = PSHUFD (loadu (state), 0xb1);
+  s1 = PSHUFD (loadu (state + 4), 0x1b);
+  s0 = ALIGNR (t, s1, 8);
+  s1 = BLENDW (s1, t, 0xf0);
+  abef = s0;
+  cdgh = s1;
+  m[0] = loadu (block);
+  m[1] = loadu (block + 4);
+  m[2] = loadu (block + 8);
+  m[3] = loadu (block + 12);
+
+  /* Rounds 4Q to 4Q + 3, with the schedule of SHA1_NI above.  */
+#define SHA256_NI(q)							\
+  do									\
+    {									\
+      if ((q) >= 4)							\
+	m[(q) & 3] = SHA_NI2 (sha256msg2,				\
+			      SHA_NI2 (sha256msg1, m[(q) & 3],		\
+				       m[((q) + 1) & 3])		\
+			      + ALIGNR (m[((q) + 3) & 3],		\
+					m[((q) + 2) & 3], 4),		\
+			      m[((q) + 3) & 3]);			\
+      k = m[(q) & 3] + loadu (sha256_k + 4 * (q));			\
+      s1 = SHA256RNDS2 (s1, s0, k);					\
+      s0 = SHA256RNDS2 (s0, s1, PSHUFD (k, 0x0e));			\
+    }									\
+  while (0)
+
+  SHA256_NI (0); SHA256_NI (1); SHA256_NI (2); SHA256_NI (3);
+  SHA256_NI (4); SHA256_NI (5); SHA256_NI (6); SHA256_NI (7);
+  SHA256_NI (8); SHA256_NI (9); SHA256_NI (10); SHA256_NI (11);
+  SHA256_NI (12); SHA256_NI (13); SHA256_NI (14); SHA256_NI (15);
+#undef SHA256_NI
+
+  s0 += abef;
+  s1 += cdgh;
+  t = PSHUFD (s0, 0x1b);
+  s1 = PSHUFD (s1, 0xb1);
+  storeu (state, BLENDW (t, s1, 0xf0));
+  storeu (state + 4, ALIGNR (s1, t, 8));
+}
+
+#endif
+
+#ifdef PBKDF2_AVX2
+#define AVX2_FN		__attribute__ ((target ("avx2")))
+
+/* One chain per 32-bit lane, with the same rounds as the portable code
+   above.  */
+typedef holy_uint32_t v8su __attribute__ ((vector_size (32)));
+
+#define ROL8(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+#define ROR8(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+static AVX2_FN void
+sha1_compress_x8 (holy_uint32_t (*state)[X8],
+		  const holy_uint32_t (*block)[X8])
+{
+  v8su w[16], a, b, c, d, e, t;
+  int i;
+
+  __builtin_memcpy (w, block, sizeof (w));
+  __builtin_memcpy (&a, state[0], sizeof (a));
+  __builtin_memcpy (&b, state[1], sizeof (b));
+  __builtin_memcpy (&c, state[2], sizeof (c));
+  __builtin_memcpy (&d, state[3], sizeof (d));
+  __builtin_memcpy (&e, state[4], sizeof (e));
+
+#define SHA1_STEP(f, k)							\
+  do									\
+    {									\
+      if (i >= 16)							\
+	w[i & 15] = ROL8 (w[(i + 13) & 15] ^ w[(i + 8) & 15]		\
+			  ^ w[(i + 2) & 15] ^ w[i & 15], 1);		\
+      t = ROL8 (a, 5) + (f) + e + (holy_uint32_t) (k) + w[i & 15];	\
+      e = d;								\
+      d = c;								\
+      c = ROL8 (b, 30);							\
+      b = a;								\
+      a = t;								\
+    }									\
+  while (0)
+
+  for (i = 0; i < 20; i++)
+    SHA1_STEP (d ^ (b & (c ^ d)), 0x5a827999);
+  for (; i < 40; i++)
+    SHA1_STEP (b ^ c ^ d, 0x6ed9eba1);
+  for (; i < 60; i++)
+    SHA1_STEP ((b & c) | (d & (b | c)), 0x8f1bbcdc);
+  for (; i < 80; i++)
+    SHA1_STEP (b ^ c ^ d, 0xca62c1d6);
+#undef SHA1_STEP
+
+#define SHA_ADD8(k, v)							\
+  do									\
+    {									\
+      v8su x;								\
+      __builtin_memcpy (&x, state[k], sizeof (x));			\
+      x += (v);								\
+      __builtin_memcpy (state[k], &x, sizeof (x));			\
+    }									\
+  while (0)
+
+  SHA_ADD8 (0, a);
+  SHA_ADD8 (1, b);
+  SHA_ADD8 (2, c);
+  SHA_ADD8 (3, d);
+  SHA_ADD8 (4, e);
+}
+
+static AVX2_FN void
+sha256_compress_x8 (holy_uint32_t (*state)[X8],
+		    const holy_uint32_t (*block)[X8])
+{
+  v8su w[16], a, b, c, d, e, f, g, h, t1, t2;
+  int i;
+
+  __builtin_memcpy (w, block, sizeof (w));
+  __builtin_memcpy (&a, state[0], sizeof (a));
+  __builtin_memcpy (&b, state[1], sizeof (b));
+  __builtin_memcpy (&c, state[2], sizeof (c));
+  __builtin_memcpy (&d, state[3], sizeof (d));
+  __builtin_memcpy (&e, state[4], sizeof (e));
+  __builtin_memcpy (&f, state[5], sizeof (f));
+  __builtin_memcpy (&g, state[6], sizeof (g));
+  __builtin_memcpy (&h, state[7], sizeof (h));
+
+  for (i = 0; i < 64; i++)
+    {
+      if (i >= 16)
+	{
+	  v8su w1 = w[(i + 1) & 15], w14 = w[(i + 14) & 15];
+
+	  w[i & 15] += ((ROR8 (w14, 17) ^ ROR8 (w14, 19) ^ (w14 >> 10))
+			+ w[(i + 9) & 15]
+			+ (ROR8 (w1, 7) ^ ROR8 (w1, 18) ^ (w1 >> 3)));
+	}
+      t1 = (h + (ROR8 (e, 6) ^ ROR8 (e, 11) ^ ROR8 (e, 25))
+	    + (g ^ (e & (f ^ g))) + sha256_k[i] + w[i & 15]);
+      t2 = ((ROR8 (a, 2) ^ ROR8 (a, 13) ^ ROR8 (a, 22))
+	    + ((a & b) | (c & (a | b))));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+
+  SHA_ADD8 (0, a);
+  SHA_ADD8 (1, b);
+  SHA_ADD8 (2, c);
+  SHA_ADD8 (3, d);
+  SHA_ADD8 (4, e);
+  SHA_ADD8 (5, f);
+  SHA_ADD8 (6, g);
+  SHA_ADD8 (7, h);
+#undef SHA_ADD8
+}
+
+#undef ROL8
+#undef ROR8
+#endif
+
+struct pbkdf2_impl
+{
+  struct holy_cpu_impl cpu;
+  compress_t sha1;
+  compress_t sha256;
+  /* Multi-buffer versions, or NULL.  */
+  compress_x8_t sha1_x8;
+  compress_x8_t sha256_x8;
+};
+
+static const struct pbkdf2_impl impls[] =
+  {
+#ifdef PBKDF2_SHA_NI
+    { { "shani", holy_CPU_SSE4_1 | holy_CPU_SHA },
+      sha1_compress_ni, sha256_compress_ni, NULL, NULL },
+#endif
+#ifdef PBKDF2_AVX2
+    /* Eight AVX2 lanes are slower than SHA-NI even when full.  */
+    { { "avx2", holy_CPU_AVX2 }, sha1_compress, sha256_compress,
+      sha1_compress_x8, sha256_compress_x8 },
+#endif
+    { { "generic", 0 }, sha1_compress, sha256_compress, NULL, NULL },
+  };
+
+static const struct pbkdf2_impl *impl;
+
+static void
+pbkdf2_probe (void)
+{
+  impl = holy_cpu_impl_find (impls, ARRAY_SIZE (impls), sizeof (impls[0]),
+			     NULL);
+}
+
+const char *
+holy_crypto_pbkdf2_implementation (void)
+{
+  if (!impl)
+    pbkdf2_probe ();
+  return impl->cpu.name;
+}
+
+int
+holy_crypto_pbkdf2_select (const char *name)
+{
+  const void *found;
+
+  found = holy_cpu_impl_find (impls, ARRAY_SIZE (impls), sizeof (impls[0]),
+			      name);
+  if (!found)
+    return -1;
+  impl = found;
+  return 0;
+}
+
+/* Run N more iterations of the NLANES chains in LANE.  IST and OST are the
+   states after the inner and outer pads, WORDS the digest size.  */
+static void
+sha_iterate (compress_t compress, unsigned words,
+	     const holy_uint32_t *ist, const holy_uint32_t *ost,
+	     struct pbkdf2_chain **lane, unsigned nlanes, unsigned int n)
+{
+  holy_uint32_t block[LANES][16], s[LANES][MAX_WORDS];
+  unsigned j, k;
+
+  /* Both messages are one digest after one block, so the padding never
+     changes.  */
+  for (j = 0; j < nlanes; j++)
+    {
+      holy_memset (block[j], 0, sizeof (block[j]));
+      block[j][words] = 0x80000000;
+      block[j][15] = (64 + 4 * words) * 8;
+    }
+
+  /* The chains do not depend on each other, so the CPU can overlap the
+     compressions of different lanes.  */
+  while (n--)
+    {
+      for (j = 0; j < nlanes; j++)
+	{
+	  holy_memcpy (block[j], lane[j]->u, 4 * words);
+	  holy_memcpy (s[j], ist, sizeof (s[j]));
+	  compress (s[j], block[j]);
+	}
+      for (j = 0; j < nlanes; j++)
+	{
+	  holy_memcpy (block[j], s[j], 4 * words);
+	  holy_memcpy (lane[j]->u, ost, sizeof (lane[j]->u));
+	  compress (lane[j]->u, block[j]);
+	  for (k = 0; k < words; k++)
+	    lane[j]->t[k] ^= lane[j]->u[k];
+	}
+    }
+
+  holy_memset (block, 0, sizeof (block));
+  holy_memset (s, 0, sizeof (s));
+}
+
+/* The same with COMPRESS_X8, whose lanes past NLANES compute nothing
+   useful.  */
+static void
+sha_iterate_x8 (compress_x8_t compress_x8, unsigned words,
+		const holy_uint32_t *ist, const holy_uint32_t *ost,
+		struct pbkdf2_chain **lane, unsigned nlanes, unsigned int n)
+{
+  holy_uint32_t block[16][X8], s[MAX_WORDS][X8];
+  holy_uint32_t u[MAX_WORDS][X8], t[MAX_WORDS][X8];
+  unsigned j, k;
+
+  holy_memset (block, 0, sizeof (block));
+  holy_memset (u, 0, sizeof (u));
+  holy_memset (t, 0, sizeof (t));
+  for (j = 0; j < X8; j++)
+    {
+      block[words][j] = 0x80000000;
+      block[15][j] = (64 + 4 * words) * 8;
+    }
+  for (j = 0; j < nlanes; j++)
+    for (k = 0; k < words; k++)
+      {
+	u[k][j] = lane[j]->u[k];
+	t[k][j] = lane[j]->t[k];
+      }
+
+  while (n--)
+    {
+      for (k = 0; k < words; k++)
+	for (j = 0; j < X8; j++)
+	  {
+	    block[k][j] = u[k][j];
+	    s[k][j] = ist[k];
+	  }
+      compress_x8 (s, (const holy_uint32_t (*)[X8]) block);
+      for (k = 0; k < words; k++)
+	for (j = 0; j < X8; j++)
+	  {
+	    block[k][j] = s[k][j];
+	    u[k][j] = ost[k];
+	  }
+      compress_x8 (u, (const holy_uint32_t (*)[X8]) block);
+      for (k = 0; k < words; k++)
+	for (j = 0; j < X8; j++)
+	  t[k][j] ^= u[k][j];
+    }
+
+  for (j = 0; j < nlanes; j++)
+    for (k = 0; k < words; k++)
+      {
+	lane[j]->u[k] = u[k][j];
+	lane[j]->t[k] = t[k][j];
+      }
+
+  holy_memset (block, 0, sizeof (block));
+  holy_memset (s, 0, sizeof (s));
+  holy_memset (u, 0, sizeof (u));
+  holy_memset (t, 0, sizeof (t));
+}
+
+/* Finish all NCHAINS chains, LANES at a time, or X8 at a time through
+   COMPRESS_X8 if it is not NULL and there are enough of them.  A lane
+   whose chain is done takes the next one, so jobs with different
+   iteration counts still share the lanes.  */
+static void
+sha_run (compress_t compress, compress_x8_t compress_x8, unsigned words,
+	 const holy_uint32_t *ist, const holy_uint32_t *ost,
+	 struct pbkdf2_chain *chains, unsigned nchains)
+{
+  struct pbkdf2_chain *lane[X8];
+  unsigned nlanes = 0, next = 0, width = LANES, j;
+  unsigned int n;
+
+  if (compress_x8 && nchains >= X8_MIN)
+    width = X8;
+
+  while (1)
+    {
+      while (nlanes < width && next < nchains)
+	{
+	  if (chains[next].left)
+	    lane[nlanes++] = &chains[next];
+	  next++;
+	}
+      if (!nlanes)
+	break;
+
+      n = lane[0]->left;
+      for (j = 1; j < nlanes; j++)
+	if (lane[j]->left < n)
+	  n = lane[j]->left;
+
+      if (width == X8)
+	sha_iterate_x8 (compress_x8, words, ist, ost, lane, nlanes, n);
+      else
+	sha_iterate (compress, words, ist, ost, lane, nlanes, n);
+
+      for (j = 0; j < nlanes;)
+	{
+	  lane[j]->left -= n;
+	  if (!lane[j]->left)
+	    lane[j] = lane[--nlanes];
+	  else
+	    j++;
+	}
+    }
+}
+
+/* One HMAC under the key whose padded states are ICTX and OCTX, using CTX
+   as scratch.  OUT may overlap MSG.  */
+static void
+hmac_ctx (const struct gcry_md_spec *md, const void *ictx, const void *octx,
+	  void *ctx, const void *msg, holy_size_t len, holy_uint8_t *out)
+{
+  holy_uint8_t inner[holy_CRYPTO_MAX_MDLEN];
+
+  holy_memcpy (ctx, ictx, md->contextsize);
+  md->write (ctx, msg, len);
+  md->final (ctx);
+  holy_memcpy (inner, md->read (ctx), md->mdlen);
+
+  holy_memcpy (ctx, octx, md->contextsize);
+  md->write (ctx, inner, md->mdlen);
+  md->final (ctx);
+  holy_memcpy (out, md->read (ctx), md->mdlen);
+
+  holy_memset (inner, 0, sizeof (inner));
+}
+
+static void
+be_to_words (holy_uint32_t *w, const holy_uint8_t *b, unsigned words)
+{
+  unsigned k;
+
+  for (k = 0; k < words; k++)
+    w[k] = holy_be_to_cpu32 (holy_get_unaligned32 (b + 4 * k));
+}
+
+static void
+words_to_be (holy_uint8_t *b, const holy_uint32_t *w, unsigned words)
+{
+  unsigned k;
+
+  for (k = 0; k < words; k++)
+    holy_set_unaligned32 (b + 4 * k, holy_cpu_to_be32 (w[k]));
+}
 
 gcry_err_code_t
-holy_crypto_pbkdf2 (const struct gcry_md_spec *md,
-		    const holy_uint8_t *P, holy_size_t Plen,
-		    const holy_uint8_t *S, holy_size_t Slen,
-		    unsigned int c,
-		    holy_uint8_t *DK, holy_size_t dkLen)
+holy_crypto_pbkdf2_multi (const struct gcry_md_spec *md,
+			  const holy_uint8_t *P, holy_size_t Plen,
+			  const struct holy_crypto_pbkdf2_job *jobs,
+			  unsigned njobs)
 {
   unsigned int hLen = md->mdlen;
+  holy_uint8_t key[holy_CRYPTO_MAX_MDLEN];
   holy_uint8_t U[holy_CRYPTO_MAX_MDLEN];
   holy_uint8_t T[holy_CRYPTO_MAX_MDLEN];
-  unsigned int u;
-  unsigned int l;
-  unsigned int r;
-  unsigned int i;
-  unsigned int k;
-  gcry_err_code_t rc;
-  holy_uint8_t *tmp;
-  holy_size_t tmplen = Slen + 4;
-
-  if (md->mdlen > holy_CRYPTO_MAX_MDLEN || md->mdlen == 0)
-    return GPG_ERR_INV_ARG;
+  holy_uint32_t ist[MAX_WORDS], ost[MAX_WORDS], pad[16];
+  holy_uint8_t *ipad = NULL, *opad = NULL, *tmp = NULL;
+  void *ictx = NULL, *octx = NULL, *ctx = NULL;
+  struct pbkdf2_chain *chains = NULL;
+  compress_t compress = NULL;
+  compress_x8_t compress_x8 = NULL;
+  unsigned words = hLen / 4;
+  unsigned nchains = 0, ch, j, l;
+  holy_size_t maxslen = 0;
+  gcry_err_code_t rc = GPG_ERR_OUT_OF_MEMORY;
+  unsigned int i, u, k;
 
-  if (c == 0)
+  if (md->mdlen > holy_CRYPTO_MAX_MDLEN || md->mdlen == 0
+      || md->mdlen > md->blocksize)
     return GPG_ERR_INV_ARG;
 
-  if (dkLen == 0)
-    return GPG_ERR_INV_ARG;
+  for (j = 0; j < njobs; j++)
+    {
+      if (jobs[j].iterations == 0 || jobs[j].dk_len == 0
+	  || jobs[j].dk_len > 4294967295U)
+	return GPG_ERR_INV_ARG;
+      nchains += ((jobs[j].dk_len - 1) / hLen) + 1;
+      if (jobs[j].salt_len > maxslen)
+	maxslen = jobs[j].salt_len;
+    }
 
-  if (dkLen > 4294967295U)
-    return GPG_ERR_INV_ARG;
+  if (!impl)
+    pbkdf2_probe ();
+  if (md->blocksize == 64 && holy_strcmp (md->name, "SHA1") == 0)
+    {
+      compress = impl->sha1;
+      compress_x8 = impl->sha1_x8;
+    }
+  else if (md->blocksize == 64 && holy_strcmp (md->name, "SHA256") == 0)
+    {
+      compress = impl->sha256;
+      compress_x8 = impl->sha256_x8;
+    }
 
-  l = ((dkLen - 1) / hLen) + 1;
-  r = dkLen - (l - 1) * hLen;
+  ipad = holy_zalloc (md->blocksize);
+  opad = holy_zalloc (md->blocksize);
+  ictx = holy_malloc (md->contextsize);
+  octx = holy_malloc (md->contextsize);
+  ctx = holy_malloc (md->contextsize);
+  tmp = holy_malloc (maxslen + 4);
+  if (compress)
+    chains = holy_malloc (nchains * sizeof (*chains));
+  if (!ipad || !opad || !ictx || !octx || !ctx || !tmp
+      || (compress && !chains))
+    goto out;
 
-  tmp = holy_malloc (tmplen);
-  if (tmp == NULL)
-    return GPG_ERR_OUT_OF_MEMORY;
+  /* HMAC key setup, as in holy_crypto_hmac_init.  */
+  if (Plen > md->blocksize)
+    {
+      holy_crypto_hash (md, key, P, Plen);
+      P = key;
+      Plen = hLen;
+    }
+  holy_memcpy (ipad, P, Plen);
+  holy_memcpy (opad, P, Plen);
+  for (k = 0; k < md->blocksize; k++)
+    {
+      ipad[k] ^= 0x36;
+      opad[k] ^= 0x5c;
+    }
+  md->init (ictx);
+  md->write (ictx, ipad, md->blocksize);
+  md->init (octx);
+  md->write (octx, opad, md->blocksize);
 
-  holy_memcpy (tmp, S, Slen);
+  if (compress)
+    {
+      holy_memset (ist, 0, sizeof (ist));
+      holy_memset (ost, 0, sizeof (ost));
+      holy_memcpy (ist, words == 5 ? sha1_iv : sha256_iv, 4 * words);
+      holy_memcpy (ost, ist, sizeof (ost));
+      be_to_words (pad, ipad, 16);
+      compress (ist, pad);
+      be_to_words (pad, opad, 16);
+      compress (ost, pad);
+    }
 
-  for (i = 1; i - 1 < l; i++)
+  /* U_1 = PRF (P, S || INT (i)) has a message of any length, so it always
+     goes through the generic code.  */
+  ch = 0;
+  for (j = 0; j < njobs; j++)
     {
-      holy_memset (T, 0, hLen);
+      const struct holy_crypto_pbkdf2_job *job = &jobs[j];
 
-      for (u = 0; u < c; u++)
+      l = ((job->dk_len - 1) / hLen) + 1;
+      holy_memcpy (tmp, job->salt, job->salt_len);
+      for (i = 1; i - 1 < l; i++)
 	{
-	  if (u == 0)
-	    {
-	      tmp[Slen + 0] = (i & 0xff000000) >> 24;
-	      tmp[Slen + 1] = (i & 0x00ff0000) >> 16;
-	      tmp[Slen + 2] = (i & 0x0000ff00) >> 8;
-	      tmp[Slen + 3] = (i & 0x000000ff) >> 0;
+	  tmp[job->salt_len + 0] = (i & 0xff000000) >> 24;
+	  tmp[job->salt_len + 1] = (i & 0x00ff0000) >> 16;
+	  tmp[job->salt_len + 2] = (i & 0x0000ff00) >> 8;
+	  tmp[job->salt_len + 3] = (i & 0x000000ff) >> 0;
+	  hmac_ctx (md, ictx, octx, ctx, tmp, job->salt_len + 4, U);
 
-	      rc = holy_crypto_hmac_buffer (md, P, Plen, tmp, tmplen, U);
+	  if (compress)
+	    {
+	      be_to_words (chains[ch].u, U, words);
+	      holy_memcpy (chains[ch].t, chains[ch].u, 4 * words);
+	      chains[ch].left = job->iterations - 1;
+	      ch++;
+	      continue;
 	    }
-	  else
-	    rc = holy_crypto_hmac_buffer (md, P, Plen, U, hLen, U);
 
-	  if (rc != GPG_ERR_NO_ERROR)
+	  holy_memcpy (T, U, hLen);
+	  for (u = 1; u < job->iterations; u++)
 	    {
-	      holy_free (tmp);
-	      return rc;
+	      hmac_ctx (md, ictx, octx, ctx, U, hLen, U);
+	      for (k = 0; k < hLen; k++)
+		T[k] ^= U[k];
 	    }
-
-	  for (k = 0; k < hLen; k++)
-	    T[k] ^= U[k];
+	  holy_memcpy (job->dk + (i - 1) * hLen, T,
+		       i == l ? job->dk_len - (l - 1) * hLen : hLen);
 	}
+    }
+
+  if (compress)
+    {
+      sha_run (compress, compress_x8, words, ist, ost, chains, nchains);
 
-      holy_memcpy (DK + (i - 1) * hLen, T, i == l ? r : hLen);
+      ch = 0;
+      for (j = 0; j < njobs; j++)
+	{
+	  const struct holy_crypto_pbkdf2_job *job = &jobs[j];
+
+	  l = ((job->dk_len - 1) / hLen) + 1;
+	  for (i = 1; i - 1 < l; i++, ch++)
+	    {
+	      words_to_be (T, chains[ch].t, words);
+	      holy_memcpy (job->dk + (i - 1) * hLen, T,
+			   i == l ? job->dk_len - (l - 1) * hLen : hLen);
+	    }
+	}
     }
 
+  rc = GPG_ERR_NO_ERROR;
+
+ out:
+  holy_memset (key, 0, sizeof (key));
+  holy_memset (U, 0, sizeof (U));
+  holy_memset (T, 0, sizeof (T));
+  holy_memset (ist, 0, sizeof (ist));
+  holy_memset (ost, 0, sizeof (ost));
+  holy_memset (pad, 0, sizeof (pad));
+  if (ipad)
+    holy_memset (ipad, 0, md->blocksize);
+  if (opad)
+    holy_memset (opad, 0, md->blocksize);
+  if (ictx)
+    holy_memset (ictx, 0, md->contextsize);
+  if (octx)
+    holy_memset (octx, 0, md->contextsize);
+  if (ctx)
+    holy_memset (ctx, 0, md->contextsize);
+  if (chains)
+    holy_memset (chains, 0, nchains * sizeof (*chains));
+  holy_free (ipad);
+  holy_free (opad);
+  holy_free (ictx);
+  holy_free (octx);
+  holy_free (ctx);
   holy_free (tmp);
+  holy_free (chains);
+  return rc;
+}
 
-  return GPG_ERR_NO_ERROR;
+/* Implement PKCS#5 PBKDF2 as per RFC 2898.  The PRF to use is HMAC variant
+   of digest supplied by MD.  Inputs are the password P of length PLEN,
+   the salt S of length SLEN, the iteration counter C (> 0), and the
+   desired derived output length DKLEN.  Output buffer is DK which
+   must have room for at least DKLEN octets.  The output buffer will
+   be filled with the derived data.  */
+
+gcry_err_code_t
+holy_crypto_pbkdf2 (const struct gcry_md_spec *md,
+		    const holy_uint8_t *P, holy_size_t Plen,
+		    const holy_uint8_t *S, holy_size_t Slen,
+		    unsigned int c,
+		    holy_uint8_t *DK, holy_size_t dkLen)
+{
+  struct holy_crypto_pbkdf2_job job;
+
+  job.salt = S;
+  job.salt_len = Slen;
+  job.iterations = c;
+  job.dk = DK;
+  job.dk_len = dkLen;
+  return holy_crypto_pbkdf2_multi (md, P, Plen, &job, 1);
+}
+
+holy_MOD_INIT (pbkdf2)
+{
+  pbkdf2_probe ();
 }
@@ -420,6 +420,9 @@ malloc_in_range (struct holy_relocator *rel,
 		(unsigned long) start, (unsigned long) end,
 		(unsigned long) align, (unsigned long) size);
 
+  /* Small cached blocks would otherwise split the free ranges we scan.  */
+  holy_mm_flush_quick ();
+
   start = ALIGN_UP (start, align);
   end = ALIGN_DOWN (end - size, align) + size;
 
@@ -0,0 +1,1140 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+/* Zstandard decoder (RFC 8878).  Dictionaries are not supported and the
+   content checksum is skipped.  */
+
+#include <holy/types.h>
+#include <holy/err.h>
+#include <holy/mm.h>
+#include <holy/misc.h>
+#include <holy/dl.h>
+#include <holy/zstd.h>
+
+holy_MOD_LICENSE ("GPLv2+");
+
+#define ZSTD_WINDOW_LOG_MIN	10
+#define ZSTD_WINDOW_LOG_MAX	27
+
+enum
+  {
+    BLOCK_RAW,
+    BLOCK_RLE,
+    BLOCK_COMPRESSED,
+    BLOCK_RESERVED
+  };
+
+enum
+  {
+    LITERALS_RAW,
+    LITERALS_RLE,
+    LITERALS_COMPRESSED,
+    LITERALS_TREELESS
+  };
+
+enum
+  {
+    MODE_PREDEFINED,
+    MODE_RLE,
+    MODE_FSE,
+    MODE_REPEAT
+  };
+
+/* The three sequence codes, in the order their tables are described.  */
+enum
+  {
+    SEQ_LL,
+    SEQ_OF,
+    SEQ_ML,
+    SEQ_COUNT
+  };
+
+#define HUF_MAX_BITS		11
+#define HUF_MAX_WEIGHTS		255
+#define HUF_WEIGHT_LOG_MAX	6
+#define FSE_LOG_MAX		9
+
+struct fse_entry
+{
+  holy_uint16_t base;
+  holy_uint8_t sym;
+  holy_uint8_t bits;
+};
+
+struct fse_table
+{
+  unsigned log;
+  struct fse_entry e[1 << FSE_LOG_MAX];
+};
+
+struct huf_entry
+{
+  holy_uint8_t sym;
+  holy_uint8_t bits;
+};
+
+struct holy_zstd_dctx
+{
+  /* Window and output of the current block.  */
+  holy_uint8_t *buf;
+  holy_size_t buf_size;
+  holy_size_t pos;
+  holy_uint64_t window_size;
+  holy_size_t block_max;
+  /* Whether old output has to be moved down to make room.  */
+  int slide;
+
+  holy_uint32_t rep[3];
+
+  int have_huf;
+  unsigned huf_log;
+  struct huf_entry huf[1 << HUF_MAX_BITS];
+
+  struct fse_table seq[SEQ_COUNT];
+  const struct fse_table *seq_cur[SEQ_COUNT];
+
+  holy_uint8_t lit[holy_ZSTD_BLOCK_MAX];
+};
+
+static const unsigned seq_max_sym[SEQ_COUNT] = { 35, 31, 52 };
+static const unsigned seq_max_log[SEQ_COUNT] = { 9, 8, 9 };
+
+static const holy_int16_t ll_default[36] =
+  {
+    4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+    -1, -1, -1, -1
+  };
+
+static const holy_int16_t of_default[29] =
+  {
+    1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+  };
+
+static const holy_int16_t ml_default[53] =
+  {
+    1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+    -1, -1, -1, -1, -1
+  };
+
+static const holy_uint32_t ll_base[36] =
+  {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096,
+    8192, 16384, 32768, 65536
+  };
+
+static const holy_uint8_t ll_bits[36] =
+  {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+    13, 14, 15, 16
+  };
+
+static const holy_uint32_t ml_base[53] =
+  {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+    19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+    35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051,
+    4099, 8195, 16387, 32771, 65539
+  };
+
+static const holy_uint8_t ml_bits[53] =
+  {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+    12, 13, 14, 15, 16
+  };
+
+static struct fse_table seq_default[SEQ_COUNT];
+static int seq_default_built;
+
+static inline unsigned
+highbit (holy_uint32_t v)
+{
+  unsigned n = 0;
+
+  while (v >>= 1)
+    n++;
+  return n;
+}
+
+static holy_ssize_t
+corrupted (void)
+{
+  holy_error (holy_ERR_BAD_COMPRESSED_DATA, "zstd data is corrupted");
+  return -1;
+}
+
+/* Backward bit stream: read from the end towards the start, most
+   significant bit first, as used by Huffman and FSE coded data.  POS is
+   the number of unread bits and goes negative on overrun.  */
+struct bits
+{
+  const holy_uint8_t *start;
+  holy_size_t size;
+  holy_int64_t pos;
+};
+
+static int
+bits_init (struct bits *b, const holy_uint8_t *src, holy_size_t size)
+{
+  /* The last byte holds a marker bit above the data.  */
+  if (!size || !src[size - 1])
+    return -1;
+  b->start = src;
+  b->size = size;
+  b->pos = 8 * (holy_int64_t) (size - 1) + highbit (src[size - 1]);
+  return 0;
+}
+
+/* At least 57 bits starting at bit LO; bits outside the stream read as
+   zeros.  */
+static holy_uint64_t
+bits_window (const struct bits *b, holy_int64_t lo)
+{
+  holy_uint64_t v = 0;
+  holy_size_t i, byte;
+
+  if (lo < 0)
+    return lo > -64 ? bits_window (b, 0) << -lo : 0;
+
+  byte = lo >> 3;
+  if (byte + 8 <= b->size)
+    return holy_le_to_cpu64 (holy_get_unaligned64 (b->start + byte))
+      >> (lo & 7);
+
+  for (i = 0; i < 8 && byte + i < b->size; i++)
+    v |= (holy_uint64_t) b->start[byte + i] << (8 * i);
+  return v >> (lo & 7);
+}
+
+static inline holy_uint64_t
+bits_read (struct bits *b, unsigned n)
+{
+  if (!n)
+    return 0;
+  b->pos -= n;
+  return bits_window (b, b->pos) & (((holy_uint64_t) 1 << n) - 1);
+}
+
+static inline unsigned
+bits_peek (const struct bits *b, unsigned n)
+{
+  return bits_window (b, b->pos - n) & ((1 << n) - 1);
+}
+
+/* Forward bit stream, least significant bit first, used by FSE table
+   descriptions.  */
+struct fwd_bits
+{
+  const holy_uint8_t *src;
+  holy_size_t size;
+  holy_size_t pos;
+};
+
+static unsigned
+fwd_peek (const struct fwd_bits *b, unsigned n)
+{
+  holy_uint32_t v = 0;
+  holy_size_t byte = b->pos >> 3;
+  unsigned i;
+
+  for (i = 0; i < 4 && byte + i < b->size; i++)
+    v |= (holy_uint32_t) b->src[byte + i] << (8 * i);
+  return (v >> (b->pos & 7)) & ((1 << n) - 1);
+}
+
+/* Parse an FSE table description into PROB.  Return the number of bytes
+   used or -1.  */
+static holy_ssize_t
+fse_read_ncount (const holy_uint8_t *src, holy_size_t size,
+		 holy_int16_t *prob, unsigned max_sym, unsigned max_log,
+		 unsigned *log, unsigned *nsym)
+{
+  struct fwd_bits b = { src, size, 0 };
+  int remaining, threshold, max, count;
+  unsigned nbits, sym = 0, repeat, i;
+
+  if (!size)
+    return -1;
+
+  *log = fwd_peek (&b, 4) + 5;
+  b.pos += 4;
+  if (*log > max_log)
+    return -1;
+
+  remaining = (1 << *log) + 1;
+  threshold = 1 << *log;
+  nbits = *log + 1;
+
+  while (remaining > 1 && sym <= max_sym)
+    {
+      unsigned v = fwd_peek (&b, nbits);
+
+      max = (2 * threshold - 1) - remaining;
+      if ((int) (v & (threshold - 1)) < max)
+	{
+	  count = v & (threshold - 1);
+	  b.pos += nbits - 1;
+	}
+      else
+	{
+	  count = v & (2 * threshold - 1);
+	  if (count >= threshold)
+	    count -= max;
+	  b.pos += nbits;
+	}
+
+      count--;
+      remaining -= count < 0 ? -count : count;
+      prob[sym++] = count;
+
+      if (!count)
+	do
+	  {
+	    repeat = fwd_peek (&b, 2);
+	    b.pos += 2;
+	    if (sym + repeat > max_sym)
+	      return -1;
+	    for (i = 0; i < repeat; i++)
+	      prob[sym++] = 0;
+	  }
+	while (repeat == 3);
+
+      while (remaining < threshold && threshold > 1)
+	{
+	  nbits--;
+	  threshold >>= 1;
+	}
+    }
+
+  if (remaining != 1 || b.pos > 8 * size)
+    return -1;
+
+  *nsym = sym;
+  return (b.pos + 7) >> 3;
+}
+
+static int
+fse_build (struct fse_table *t, const holy_int16_t *prob, unsigned nsym,
+	   unsigned log)
+{
+  holy_uint16_t next[256];
+  unsigned size = 1 << log, high = size - 1;
+  unsigned step = (size >> 1) + (size >> 3) + 3;
+  unsigned s, u, pos = 0;
+  int i;
+
+  t->log = log;
+
+  for (s = 0; s < nsym; s++)
+    if (prob[s] == -1)
+      {
+	t->e[high--].sym = s;
+	next[s] = 1;
+      }
+    else
+      next[s] = prob[s];
+
+  for (s = 0; s < nsym; s++)
+    for (i = 0; i < prob[s]; i++)
+      {
+	t->e[pos].sym = s;
+	do
+	  pos = (pos + step) & (size - 1);
+	while (pos > high);
+      }
+  if (pos)
+    return -1;
+
+  for (u = 0; u < size; u++)
+    {
+      unsigned state = next[t->e[u].sym]++;
+
+      t->e[u].bits = log - highbit (state);
+      t->e[u].base = (state << t->e[u].bits) - size;
+    }
+
+  return 0;
+}
+
+static void
+build_seq_default (void)
+{
+  fse_build (&seq_default[SEQ_LL], ll_default, 36, 6);
+  fse_build (&seq_default[SEQ_OF], of_default, 29, 5);
+  fse_build (&seq_default[SEQ_ML], ml_default, 53, 6);
+  seq_default_built = 1;
+}
+
+/* Decode the FSE compressed Huffman weights.  Return their number or -1.  */
+static int
+huf_fse_weights (const holy_uint8_t *src, holy_size_t size,
+		 holy_uint8_t *weights)
+{
+  holy_int16_t prob[256];
+  struct fse_table t;
+  struct bits b;
+  unsigned log, nsym, s1, s2;
+  holy_ssize_t n;
+  int count = 0;
+
+  n = fse_read_ncount (src, size, prob, 255, HUF_WEIGHT_LOG_MAX, &log, &nsym);
+  if (n < 0 || fse_build (&t, prob, nsym, log) < 0
+      || bits_init (&b, src + n, size - n) < 0)
+    return -1;
+
+  s1 = bits_read (&b, log);
+  s2 = bits_read (&b, log);
+
+  /* The two states alternate until the stream is overrun; the other
+     state then still holds one last symbol.  */
+  for (;;)
+    {
+      if (count >= HUF_MAX_WEIGHTS)
+	return -1;
+      weights[count++] = t.e[s1].sym;
+      s1 = t.e[s1].base + bits_read (&b, t.e[s1].bits);
+      if (b.pos < 0)
+	{
+	  weights[count++] = t.e[s2].sym;
+	  break;
+	}
+
+      if (count >= HUF_MAX_WEIGHTS)
+	return -1;
+      weights[count++] = t.e[s2].sym;
+      s2 = t.e[s2].base + bits_read (&b, t.e[s2].bits);
+      if (b.pos < 0)
+	{
+	  weights[count++] = t.e[s1].sym;
+	  break;
+	}
+    }
+
+  return count;
+}
+
+/* Read a Huffman tree description and build the decoding table.  Return
+   the number of bytes used or -1.  */
+static holy_ssize_t
+huf_read_table (struct holy_zstd_dctx *dctx, const holy_uint8_t *src,
+		holy_size_t size)
+{
+  holy_uint8_t weights[HUF_MAX_WEIGHTS + 2];
+  unsigned rank[HUF_MAX_BITS + 2];
+  holy_uint32_t total = 0, rest;
+  unsigned max_bits, s, i;
+  holy_ssize_t used;
+  int count;
+
+  if (!size)
+    return -1;
+
+  if (src[0] >= 128)
+    {
+      count = src[0] - 127;
+      used = 1 + (count + 1) / 2;
+      if ((holy_size_t) used > size)
+	return -1;
+      for (i = 0; i < (unsigned) count; i++)
+	weights[i] = (i & 1) ? src[1 + i / 2] & 0xf : src[1 + i / 2] >> 4;
+    }
+  else
+    {
+      used = 1 + src[0];
+      if ((holy_size_t) used > size)
+	return -1;
+      count = huf_fse_weights (src + 1, src[0], weights);
+      if (count < 0)
+	return -1;
+    }
+
+  if (count > HUF_MAX_WEIGHTS)
+    return -1;
+  for (i = 0; i < (unsigned) count; i++)
+    {
+      if (weights[i] > HUF_MAX_BITS)
+	return -1;
+      if (weights[i])
+	total += 1 << (weights[i] - 1);
+    }
+  if (!total)
+    return -1;
+
+  /* The weight of the last symbol is implied by the others completing a
+     power of two.  */
+  max_bits = highbit (total) + 1;
+  rest = (1 << max_bits) - total;
+  if (max_bits > HUF_MAX_BITS || (rest & (rest - 1)))
+    return -1;
+  weights[count++] = highbit (rest) + 1;
+
+  holy_memset (rank, 0, sizeof (rank));
+  for (s = 0; s < (unsigned) count; s++)
+    rank[weights[s]]++;
+  for (i = 1, total = 0; i <= max_bits; i++)
+    {
+      rest = rank[i] << (i - 1);
+      rank[i] = total;
+      total += rest;
+    }
+
+  for (s = 0; s < (unsigned) count; s++)
+    {
+      unsigned w = weights[s], len;
+
+      if (!w)
+	continue;
+      len = 1 << (w - 1);
+      for (i = rank[w]; i < rank[w] + len; i++)
+	{
+	  dctx->huf[i].sym = s;
+	  dctx->huf[i].bits = max_bits + 1 - w;
+	}
+      rank[w] += len;
+    }
+
+  dctx->huf_log = max_bits;
+  dctx->have_huf = 1;
+  return used;
+}
+
+static int
+huf_decode_stream (struct holy_zstd_dctx *dctx, const holy_uint8_t *src,
+		   holy_size_t size, holy_uint8_t *out, holy_size_t n)
+{
+  const struct huf_entry *e;
+  struct bits b;
+  holy_size_t i;
+
+  if (bits_init (&b, src, size) < 0)
+    return -1;
+
+  for (i = 0; i < n; i++)
+    {
+      e = &dctx->huf[bits_peek (&b, dctx->huf_log)];
+      out[i] = e->sym;
+      b.pos -= e->bits;
+    }
+
+  return b.pos == 0 ? 0 : -1;
+}
+
+/* Decode the literals section into dctx->lit, or point *LIT at raw
+   literals in the input.  Return the size of the section or -1.  */
+static holy_ssize_t
+decode_literals (struct holy_zstd_dctx *dctx, const holy_uint8_t *src,
+		 holy_size_t size, const holy_uint8_t **lit,
+		 holy_size_t *lit_size)
+{
+  unsigned type, format, hsize;
+  holy_size_t regen, csize, section;
+  holy_uint64_t hdr;
+  unsigned i;
+
+  if (!size)
+    return -1;
+
+  type = src[0] & 3;
+  format = (src[0] >> 2) & 3;
+
+  if (type == LITERALS_RAW || type == LITERALS_RLE)
+    {
+      /* Size_Format 0 and 2 use one header byte, 1 two and 3 three.  */
+      hsize = (format & 1) ? format / 2 + 2 : 1;
+      if (hsize > size)
+	return -1;
+      if (hsize == 1)
+	regen = src[0] >> 3;
+      else if (hsize == 2)
+	regen = (src[0] >> 4) | (src[1] << 4);
+      else
+	regen = (src[0] >> 4) | (src[1] << 4) | (src[2] << 12);
+      if (regen > dctx->block_max)
+	return -1;
+
+      *lit_size = regen;
+      if (type == LITERALS_RAW)
+	{
+	  if (hsize + regen > size)
+	    return -1;
+	  *lit = src + hsize;
+	  return hsize + regen;
+	}
+      if (hsize + 1 > size)
+	return -1;
+      holy_memset (dctx->lit, src[hsize], regen);
+      *lit = dctx->lit;
+      return hsize + 1;
+    }
+
+  hsize = format < 2 ? 3 : format + 2;
+  if (hsize > size)
+    return -1;
+  for (i = 0, hdr = 0; i < hsize; i++)
+    hdr |= (holy_uint64_t) src[i] << (8 * i);
+  if (hsize == 3)
+    {
+      regen = (hdr >> 4) & 0x3ff;
+      csize = (hdr >> 14) & 0x3ff;
+    }
+  else if (hsize == 4)
+    {
+      regen = (hdr >> 4) & 0x3fff;
+      csize = (hdr >> 18) & 0x3fff;
+    }
+  else
+    {
+      regen = (hdr >> 4) & 0x3ffff;
+      csize = (hdr >> 22) & 0x3ffff;
+    }
+  if (regen > dctx->block_max || hsize + csize > size)
+    return -1;
+  section = hsize + csize;
+
+  src += hsize;
+  if (type == LITERALS_COMPRESSED)
+    {
+      holy_ssize_t used = huf_read_table (dctx, src, csize);
+
+      if (used < 0)
+	return -1;
+      src += used;
+      csize -= used;
+    }
+  else if (!dctx->have_huf)
+    return -1;
+
+  if (format == 0)
+    {
+      if (huf_decode_stream (dctx, src, csize, dctx->lit, regen) < 0)
+	return -1;
+    }
+  else
+    {
+      /* Four streams behind a jump table of the first three sizes.  */
+      holy_size_t seg = (regen + 3) / 4, sizes[4], off = 6;
+
+      if (csize < 6 || 3 * seg > regen)
+	return -1;
+      sizes[0] = src[0] | (src[1] << 8);
+      sizes[1] = src[2] | (src[3] << 8);
+      sizes[2] = src[4] | (src[5] << 8);
+      if (6 + sizes[0] + sizes[1] + sizes[2] > csize)
+	return -1;
+      sizes[3] = csize - 6 - sizes[0] - sizes[1] - sizes[2];
+
+      for (i = 0; i < 4; i++)
+	{
+	  if (huf_decode_stream (dctx, src + off, sizes[i], dctx->lit + i * seg,
+				 i < 3 ? seg : regen - 3 * seg) < 0)
+	    return -1;
+	  off += sizes[i];
+	}
+    }
+
+  *lit = dctx->lit;
+  *lit_size = regen;
+  return section;
+}
+
+/* Set up the decoding table for one sequence code.  Return the new input
+   position or NULL.  */
+static const holy_uint8_t *
+seq_table (struct holy_zstd_dctx *dctx, int which, unsigned mode,
+	   const holy_uint8_t *p, const holy_uint8_t *end)
+{
+  struct fse_table *t = &dctx->seq[which];
+  holy_int16_t prob[256];
+  unsigned log, nsym;
+  holy_ssize_t n;
+
+  switch (mode)
+    {
+    case MODE_PREDEFINED:
+      dctx->seq_cur[which] = &seq_default[which];
+      break;
+
+    case MODE_RLE:
+      if (p >= end || *p > seq_max_sym[which])
+	return NULL;
+      t->log = 0;
+      t->e[0].sym = *p++;
+      t->e[0].bits = 0;
+      t->e[0].base = 0;
+      dctx->seq_cur[which] = t;
+      break;
+
+    case MODE_FSE:
+      n = fse_read_ncount (p, end - p, prob, seq_max_sym[which],
+			   seq_max_log[which], &log, &nsym);
+      if (n < 0 || fse_build (t, prob, nsym, log) < 0)
+	return NULL;
+      p += n;
+      dctx->seq_cur[which] = t;
+      break;
+
+    case MODE_REPEAT:
+      if (!dctx->seq_cur[which])
+	return NULL;
+      break;
+    }
+
+  return p;
+}
+
+/* Copy LEN bytes from OFFSET bytes back; the areas overlap when OFFSET is
+   less than LEN, which repeats the last OFFSET bytes.  */
+static inline void
+copy_match (holy_uint8_t *out, holy_size_t offset, holy_size_t len)
+{
+  const holy_uint8_t *src = out - offset;
+
+  if (offset >= len)
+    {
+      holy_memcpy (out, src, len);
+      return;
+    }
+
+  while (len)
+    {
+      holy_size_t c = ((holy_size_t) (out - src) < len
+		       ? (holy_size_t) (out - src) : len);
+
+      holy_memcpy (out, src, c);
+      out += c;
+      len -= c;
+    }
+}
+
+/* Decode the sequences section and execute it.  Return the number of
+   bytes produced or -1.  */
+static holy_ssize_t
+decode_sequences (struct holy_zstd_dctx *dctx, const holy_uint8_t *src,
+		  holy_size_t size, const holy_uint8_t *lit,
+		  holy_size_t lit_size)
+{
+  const holy_uint8_t *p = src, *end = src + size;
+  const holy_uint8_t *lit_end = lit + lit_size;
+  holy_uint8_t *start = dctx->buf + dctx->pos, *out = start, *oend;
+  const struct fse_table *ll, *of, *ml;
+  unsigned ll_state, of_state, ml_state;
+  holy_size_t nseq, i;
+  struct bits b;
+
+  oend = start + holy_min (dctx->buf_size - dctx->pos, dctx->block_max);
+
+  if (!size)
+    return -1;
+  if (p[0] < 128)
+    nseq = *p++;
+  else if (p[0] < 255)
+    {
+      if (size < 2)
+	return -1;
+      nseq = ((p[0] - 128) << 8) | p[1];
+      p += 2;
+    }
+  else
+    {
+      if (size < 3)
+	return -1;
+      nseq = (p[1] | (p[2] << 8)) + 0x7f00;
+      p += 3;
+    }
+
+  if (nseq)
+    {
+      unsigned modes;
+
+      if (p >= end)
+	return -1;
+      modes = *p++;
+      if (modes & 3)
+	return -1;
+      p = seq_table (dctx, SEQ_LL, modes >> 6, p, end);
+      if (p)
+	p = seq_table (dctx, SEQ_OF, (modes >> 4) & 3, p, end);
+      if (p)
+	p = seq_table (dctx, SEQ_ML, (modes >> 2) & 3, p, end);
+      if (!p || bits_init (&b, p, end - p) < 0)
+	return -1;
+
+      ll = dctx->seq_cur[SEQ_LL];
+      of = dctx->seq_cur[SEQ_OF];
+      ml = dctx->seq_cur[SEQ_ML];
+      ll_state = bits_read (&b, ll->log);
+      of_state = bits_read (&b, of->log);
+      ml_state = bits_read (&b, ml->log);
+
+      for (i = 0; i < nseq; i++)
+	{
+	  unsigned ofc = of->e[of_state].sym;
+	  unsigned mlc = ml->e[ml_state].sym;
+	  unsigned llc = ll->e[ll_state].sym;
+	  holy_size_t offset, match, literals;
+
+	  if (ofc > 31)
+	    return -1;
+	  offset = ((holy_uint64_t) 1 << ofc) + bits_read (&b, ofc);
+	  match = ml_base[mlc] + bits_read (&b, ml_bits[mlc]);
+	  literals = ll_base[llc] + bits_read (&b, ll_bits[llc]);
+
+	  if (offset > 3)
+	    {
+	      offset -= 3;
+	      dctx->rep[2] = dctx->rep[1];
+	      dctx->rep[1] = dctx->rep[0];
+	      dctx->rep[0] = offset;
+	    }
+	  else
+	    {
+	      /* Repeat offsets shift by one when there are no literals.  */
+	      unsigned idx = offset - 1 + (literals == 0);
+
+	      if (idx)
+		{
+		  offset = idx == 3 ? dctx->rep[0] - 1 : dctx->rep[idx];
+		  if (idx > 1)
+		    dctx->rep[2] = dctx->rep[1];
+		  dctx->rep[1] = dctx->rep[0];
+		  dctx->rep[0] = offset;
+		}
+	      else
+		offset = dctx->rep[0];
+	    }
+
+	  if (literals > (holy_size_t) (lit_end - lit)
+	      || literals + match > (holy_size_t) (oend - out))
+	    return -1;
+	  holy_memcpy (out, lit, literals);
+	  out += literals;
+	  lit += literals;
+
+	  if (!offset || offset > (holy_size_t) (out - dctx->buf))
+	    return -1;
+	  copy_match (out, offset, match);
+	  out += match;
+
+	  if (i + 1 < nseq)
+	    {
+	      ll_state = ll->e[ll_state].base
+		+ bits_read (&b, ll->e[ll_state].bits);
+	      ml_state = ml->e[ml_state].base
+		+ bits_read (&b, ml->e[ml_state].bits);
+	      of_state = of->e[of_state].base
+		+ bits_read (&b, of->e[of_state].bits);
+	    }
+	}
+
+      if (b.pos != 0)
+	return -1;
+    }
+
+  if ((holy_size_t) (lit_end - lit) > (holy_size_t) (oend - out))
+    return -1;
+  holy_memcpy (out, lit, lit_end - lit);
+  out += lit_end - lit;
+
+  return out - start;
+}
+
+holy_ssize_t
+holy_zstd_frame_header (const holy_uint8_t *in, holy_size_t size,
+			struct holy_zstd_frame *frame)
+{
+  static const unsigned dict_bytes[4] = { 0, 1, 2, 4 };
+  static const unsigned fcs_bytes[4] = { 0, 2, 4, 8 };
+  unsigned desc, single, dict_len, fcs_len, i, j;
+  holy_size_t hsize;
+  holy_uint32_t dict_id = 0;
+  holy_uint64_t fcs = 0;
+
+  if (size < 5)
+    return 0;
+  if (holy_le_to_cpu32 (holy_get_unaligned32 (in)) != holy_ZSTD_MAGIC)
+    {
+      holy_error (holy_ERR_BAD_COMPRESSED_DATA, "not a zstd frame");
+      return -1;
+    }
+
+  desc = in[4];
+  single = (desc >> 5) & 1;
+  dict_len = dict_bytes[desc & 3];
+  fcs_len = fcs_bytes[desc >> 6];
+  if (single && !fcs_len)
+    fcs_len = 1;
+  if (desc & 8)
+    {
+      holy_error (holy_ERR_BAD_COMPRESSED_DATA,
+		  "zstd frame header reserved bit set");
+      return -1;
+    }
+
+  hsize = 5 + !single + dict_len + fcs_len;
+  if (size < hsize)
+    return 0;
+
+  i = 5;
+  if (!single)
+    {
+      unsigned exponent = in[i] >> 3, mantissa = in[i] & 7;
+      holy_uint64_t base;
+
+      if (ZSTD_WINDOW_LOG_MIN + exponent > ZSTD_WINDOW_LOG_MAX)
+	{
+	  holy_error (holy_ERR_BAD_COMPRESSED_DATA,
+		      "zstd window of 2^%u bytes is too large",
+		      ZSTD_WINDOW_LOG_MIN + exponent);
+	  return -1;
+	}
+      base = (holy_uint64_t) 1 << (ZSTD_WINDOW_LOG_MIN + exponent);
+      frame->window_size = base + (base / 8) * mantissa;
+      i++;
+    }
+
+  for (j = 0; j < dict_len; j++)
+    dict_id |= (holy_uint32_t) in[i + j] << (8 * j);
+  i += dict_len;
+  if (dict_id)
+    {
+      holy_error (holy_ERR_NOT_IMPLEMENTED_YET,
+		  "zstd dictionaries are not supported");
+      return -1;
+    }
+
+  for (j = 0; j < fcs_len; j++)
+    fcs |= (holy_uint64_t) in[i + j] << (8 * j);
+  if (fcs_len == 2)
+    fcs += 256;
+
+  frame->content_size = fcs_len ? fcs : holy_ZSTD_CONTENT_SIZE_UNKNOWN;
+  if (single)
+    {
+      if (fcs > ((holy_uint64_t) 1 << ZSTD_WINDOW_LOG_MAX))
+	{
+	  holy_error (holy_ERR_BAD_COMPRESSED_DATA, "zstd frame is too large");
+	  return -1;
+	}
+      frame->window_size = fcs;
+    }
+  frame->has_checksum = (desc >> 2) & 1;
+  frame->header_size = hsize;
+
+  return hsize;
+}
+
+struct holy_zstd_dctx *
+holy_zstd_dctx_new (void)
+{
+  if (!seq_default_built)
+    build_seq_default ();
+  return holy_zalloc (sizeof (struct holy_zstd_dctx));
+}
+
+void
+holy_zstd_dctx_free (struct holy_zstd_dctx *dctx)
+{
+  if (!dctx)
+    return;
+  holy_free (dctx->buf);
+  holy_free (dctx);
+}
+
+holy_err_t
+holy_zstd_frame_begin (struct holy_zstd_dctx *dctx,
+		       const struct holy_zstd_frame *frame)
+{
+  holy_size_t size;
+
+  dctx->window_size = frame->window_size;
+  dctx->block_max = holy_min (frame->window_size, holy_ZSTD_BLOCK_MAX);
+
+  /* Keep a full window of history below the block being decoded.  When
+     the whole frame fits in that much, never move anything.  */
+  size = 2 * frame->window_size + dctx->block_max;
+  dctx->slide = 1;
+  if (frame->content_size <= size)
+    {
+      size = frame->content_size;
+      dctx->slide = 0;
+    }
+  if (!size)
+    size = 1;
+
+  if (dctx->buf_size < size)
+    {
+      holy_free (dctx->buf);
+      dctx->buf_size = 0;
+      dctx->buf = holy_malloc (size);
+      if (!dctx->buf)
+	return holy_errno;
+    }
+  dctx->buf_size = size;
+  dctx->pos = 0;
+
+  dctx->rep[0] = 1;
+  dctx->rep[1] = 4;
+  dctx->rep[2] = 8;
+  dctx->have_huf = 0;
+  dctx->seq_cur[SEQ_LL] = NULL;
+  dctx->seq_cur[SEQ_OF] = NULL;
+  dctx->seq_cur[SEQ_ML] = NULL;
+
+  return holy_ERR_NONE;
+}
+
+holy_size_t
+holy_zstd_block_size (const holy_uint8_t *in, int *last)
+{
+  holy_uint32_t hdr = in[0] | (in[1] << 8) | (in[2] << 16);
+
+  *last = hdr & 1;
+  if (((hdr >> 1) & 3) == BLOCK_RLE)
+    return holy_ZSTD_BLOCK_HEADER_SIZE + 1;
+  return holy_ZSTD_BLOCK_HEADER_SIZE + (hdr >> 3);
+}
+
+holy_ssize_t
+holy_zstd_decode_block (struct holy_zstd_dctx *dctx, const holy_uint8_t *in,
+			const holy_uint8_t **out)
+{
+  holy_uint32_t hdr = in[0] | (in[1] << 8) | (in[2] << 16);
+  holy_size_t size = hdr >> 3, room;
+  const holy_uint8_t *lit;
+  holy_size_t lit_size;
+  holy_ssize_t n;
+
+  if (size > dctx->block_max)
+    return corrupted ();
+
+  if (dctx->slide && dctx->buf_size - dctx->pos < dctx->block_max)
+    {
+      holy_size_t keep = holy_min (dctx->pos, dctx->window_size);
+
+      holy_memmove (dctx->buf, dctx->buf + dctx->pos - keep, keep);
+      dctx->pos = keep;
+    }
+  room = dctx->buf_size - dctx->pos;
+
+  in += holy_ZSTD_BLOCK_HEADER_SIZE;
+  switch ((hdr >> 1) & 3)
+    {
+    case BLOCK_RAW:
+      if (size > room)
+	return corrupted ();
+      holy_memcpy (dctx->buf + dctx->pos, in, size);
+      n = size;
+      break;
+
+    case BLOCK_RLE:
+      if (size > room)
+	return corrupted ();
+      holy_memset (dctx->buf + dctx->pos, in[0], size);
+      n = size;
+      break;
+
+    case BLOCK_COMPRESSED:
+      n = decode_literals (dctx, in, size, &lit, &lit_size);
+      if (n < 0)
+	return corrupted ();
+      n = decode_sequences (dctx, in + n, size - n, lit, lit_size);
+      if (n < 0)
+	return corrupted ();
+      break;
+
+    default:
+      return corrupted ();
+    }
+
+  *out = dctx->buf + dctx->pos;
+  dctx->pos += n;
+  return n;
+}
+
+holy_ssize_t
+holy_zstd_decompress (char *inbuf, holy_size_t insize, holy_off_t off,
+		      char *outbuf, holy_size_t outsize)
+{
+  const holy_uint8_t *p = (const holy_uint8_t *) inbuf, *end = p + insize;
+  struct holy_zstd_dctx *dctx;
+  struct holy_zstd_frame frame;
+  const holy_uint8_t *out;
+  holy_off_t cur = 0;
+  holy_ssize_t ret = 0, n;
+  holy_size_t bsize;
+  holy_uint32_t magic;
+  int last;
+
+  dctx = holy_zstd_dctx_new ();
+  if (!dctx)
+    return -1;
+
+  while (outsize && end - p >= 4)
+    {
+      magic = holy_le_to_cpu32 (holy_get_unaligned32 (p));
+      if ((magic & holy_ZSTD_SKIPPABLE_MASK) == holy_ZSTD_SKIPPABLE_MAGIC)
+	{
+	  if (end - p < 8
+	      || holy_le_to_cpu32 (holy_get_unaligned32 (p + 4))
+	      > (holy_size_t) (end - p - 8))
+	    goto corrupt;
+	  p += 8 + holy_le_to_cpu32 (holy_get_unaligned32 (p + 4));
+	  continue;
+	}
+
+      n = holy_zstd_frame_header (p, end - p, &frame);
+      if (n == 0)
+	goto corrupt;
+      if (n < 0 || holy_zstd_frame_begin (dctx, &frame))
+	goto fail;
+      p += n;
+
+      do
+	{
+	  if (end - p < holy_ZSTD_BLOCK_HEADER_SIZE)
+	    goto corrupt;
+	  bsize = holy_zstd_block_size (p, &last);
+	  if (bsize > (holy_size_t) (end - p))
+	    goto corrupt;
+	  n = holy_zstd_decode_block (dctx, p, &out);
+	  if (n < 0)
+	    goto fail;
+	  p += bsize;
+
+	  if (cur + n > off)
+	    {
+	      holy_size_t skip = off - cur;
+	      holy_size_t take = holy_min (n - skip, outsize);
+
+	      holy_memcpy (outbuf, out + skip, take);
+	      outbuf += take;
+	      outsize -= take;
+	      off += take;
+	      ret += take;
+	    }
+	  cur += n;
+	}
+      while (!last && outsize);
+
+      if (frame.has_checksum)
+	p += holy_ZSTD_CHECKSUM_SIZE;
+    }
+
+  holy_zstd_dctx_free (dctx);
+  return ret;
+
+ corrupt:
+  corrupted ();
+ fail:
+  holy_zstd_dctx_free (dctx);
+  return -1;
+}
@@ -304,8 +304,10 @@ void
 holy_gfxmenu_view_redraw (holy_gfxmenu_view_t view,
 			  const holy_video_rect_t *region)
 {
+  /* Only the part of the terminal this covers needs repainting, so a
+     timeout label next to the terminal does not cost a full window.  */
   if (holy_video_have_common_points (&view->terminal_rect, region))
-    holy_gfxterm_schedule_repaint ();
+    holy_gfxterm_schedule_repaint_rect (region);
 
   holy_video_set_active_render_target (holy_VIDEO_RENDER_TARGET_DISPLAY);
   holy_video_area_status_t area_status;
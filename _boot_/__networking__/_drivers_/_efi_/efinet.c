@@ -83,43 +83,36 @@ get_card_packet (struct holy_net_card *dev)
 {
   holy_efi_simple_network_t *net = dev->efi_net;
   holy_err_t err;
-  holy_efi_status_t st;
-  holy_efi_uintn_t bufsize = dev->rcvbufsize;
-  struct holy_net_buff *nb;
+  holy_efi_status_t st = holy_EFI_BUFFER_TOO_SMALL;
+  holy_efi_uintn_t bufsize;
+  struct holy_net_buff *nb = NULL;
   int i;
 
   for (i = 0; i < 2; i++)
     {
-      if (!dev->rcvbuf)
-	dev->rcvbuf = holy_malloc (dev->rcvbufsize);
-      if (!dev->rcvbuf)
+      /* Let the firmware write the frame into the buffer passed up the
+	 stack rather than into a bounce buffer.  */
+      nb = holy_net_card_rx_buff (dev, dev->rcvbufsize);
+      if (!nb)
 	return NULL;
+      bufsize = nb->end - nb->data;
 
       st = efi_call_7 (net->receive, net, NULL, &bufsize,
-		       dev->rcvbuf, NULL, NULL, NULL);
+		       nb->data, NULL, NULL, NULL);
       if (st != holy_EFI_BUFFER_TOO_SMALL)
 	break;
+      holy_netbuff_free (nb);
+      nb = NULL;
       dev->rcvbufsize = 2 * ALIGN_UP (dev->rcvbufsize > bufsize
 				      ? dev->rcvbufsize : bufsize, 64);
-      holy_free (dev->rcvbuf);
-      dev->rcvbuf = 0;
     }
 
   if (st != holy_EFI_SUCCESS)
-    return NULL;
-
-  nb = holy_netbuff_alloc (bufsize + 2);
-  if (!nb)
-    return NULL;
-
-  /* Reserve 2 bytes so that 2 + 14/18 bytes of ethernet header is divisible
-     by 4. So that IP header is aligned on 4 bytes. */
-  if (holy_netbuff_reserve (nb, 2))
     {
       holy_netbuff_free (nb);
       return NULL;
     }
-  holy_memcpy (nb->data, dev->rcvbuf, bufsize);
+
   err = holy_netbuff_put (nb, bufsize);
   if (err)
     {
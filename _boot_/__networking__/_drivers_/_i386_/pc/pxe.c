@@ -153,7 +153,7 @@ holy_pxe_scan (void)
 }
 
 static struct holy_net_buff *
-holy_pxe_recv (struct holy_net_card *dev __attribute__ ((unused)))
+holy_pxe_recv (struct holy_net_card *dev)
 {
   struct holy_pxe_undi_isr *isr;
   static int in_progress = 0;
@@ -199,16 +199,9 @@ holy_pxe_recv (struct holy_net_card *dev __attribute__ ((unused)))
       holy_pxe_call (holy_PXENV_UNDI_ISR, isr, pxe_rm_entry);
     }
 
-  buf = holy_netbuff_alloc (isr->frame_len + 2);
+  buf = holy_net_card_rx_buff (dev, isr->frame_len);
   if (!buf)
     return NULL;
-  /* Reserve 2 bytes so that 2 + 14/18 bytes of ethernet header is divisible
-     by 4. So that IP header is aligned on 4 bytes. */
-  if (holy_netbuff_reserve (buf, 2))
-    {
-      holy_netbuff_free (buf);
-      return NULL;
-    }
   ptr = buf->data;
   end = ptr + isr->frame_len;
   holy_netbuff_put (buf, isr->frame_len);
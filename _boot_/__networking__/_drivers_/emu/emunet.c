@@ -57,19 +57,10 @@ get_card_packet (struct holy_net_card *dev __attribute__ ((unused)))
   holy_ssize_t actual;
   struct holy_net_buff *nb;
 
-  nb = holy_netbuff_alloc (emucard.mtu + 36 + 2);
+  nb = holy_net_card_rx_buff (&emucard, emucard.mtu + 36);
   if (!nb)
     return NULL;
 
-  /* Reserve 2 bytes so that 2 + 14/18 bytes of ethernet header is divisible
-     by 4. So that IP header is aligned on 4 bytes. */
-  holy_netbuff_reserve (nb, 2);
-  if (!nb)
-    {
-      holy_netbuff_free (nb);
-      return NULL;
-    }
-
   actual = holy_emunet_receive (nb->data, emucard.mtu + 36);
   if (actual < 0)
     {
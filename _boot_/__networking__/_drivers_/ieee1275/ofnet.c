@@ -80,12 +80,9 @@ get_card_packet (struct holy_net_card *dev)
   if (actual <= 0)
     return NULL;
 
-  nb = holy_netbuff_alloc (actual + 2);
+  nb = holy_net_card_rx_buff (dev, actual);
   if (!nb)
     return NULL;
-  /* Reserve 2 bytes so that 2 + 14/18 bytes of ethernet header is divisible
-     by 4. So that IP header is aligned on 4 bytes. */
-  holy_netbuff_reserve (nb, 2);
 
   holy_memcpy (nb->data, dev->rcvbuf, actual);
 
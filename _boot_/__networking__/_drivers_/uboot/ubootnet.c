@@ -58,12 +58,9 @@ get_card_packet (struct holy_net_card *dev)
   struct holy_net_buff *nb;
   int actual;
 
-  nb = holy_netbuff_alloc (dev->mtu + 64 + 2);
+  nb = holy_net_card_rx_buff (dev, dev->mtu + 64);
   if (!nb)
     return NULL;
-  /* Reserve 2 bytes so that 2 + 14/18 bytes of ethernet header is divisible
-     by 4. So that IP header is aligned on 4 bytes. */
-  holy_netbuff_reserve (nb, 2);
 
   start_time = holy_get_time_ms ();
   do
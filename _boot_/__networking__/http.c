@@ -12,6 +12,7 @@
 #include <holy/mm.h>
 #include <holy/dl.h>
 #include <holy/file.h>
+#include <holy/env.h>
 #include <holy/i18n.h>
 
 holy_MOD_LICENSE ("GPLv2+");
@@ -21,6 +22,33 @@ enum
     HTTP_PORT = 80
   };
 
+enum
+  {
+    /* Files are split into pieces of this size when fetched over several
+       connections.  */
+    HTTP_RANGE_CHUNK = 1024 * 1024,
+    HTTP_DEFAULT_CONNECTIONS = 4,
+    HTTP_MAX_CONNECTIONS = 8
+  };
+
+/* A connection fetching one piece of the file ahead of the reader.  */
+struct http_range
+{
+  holy_file_t file;
+  holy_net_tcp_socket_t sock;
+  /* Next byte to hand to the reader and end of the piece.  The slot is
+     idle when they are equal.  */
+  holy_off_t start;
+  holy_off_t end;
+  /* Bytes of the body waiting in PACKS.  */
+  holy_off_t pending;
+  char status[sizeof ("HTTP/1.1 206")];
+  holy_size_t status_len;
+  int header_match;
+  int headers_recv;
+  int failed;
+  holy_net_packets_t packs;
+};
 
 typedef struct http_data
 {
@@ -36,6 +64,14 @@ typedef struct http_data
   int chunked;
   holy_size_t chunk_rem;
   int in_chunk_len;
+  int accept_ranges;
+  /* Parallel mode: SOCK only fetches up to RANGE_END and the remaining
+     pieces are assigned to RANGES from NEXT_FETCH on.  */
+  struct http_range *ranges;
+  int n_ranges;
+  holy_off_t range_end;
+  int range_done;
+  holy_off_t next_fetch;
 } *http_data_t;
 
 static holy_off_t
@@ -49,6 +85,57 @@ have_ahead (struct holy_file *file)
   return ret;
 }
 
+/* Hand over the pieces which continue where the reader's data ends.  */
+static void
+http_ranges_deliver (holy_file_t file)
+{
+  http_data_t data = file->data;
+  holy_net_t net = file->device->net;
+  int i;
+
+  if (!data->ranges || !data->range_done)
+    return;
+
+  for (i = 0; i < data->n_ranges; i++)
+    {
+      struct http_range *range = &data->ranges[i];
+      holy_off_t pos = have_ahead (file);
+
+      if (range->start != pos || range->start == range->end)
+	continue;
+
+      while (range->packs.first)
+	{
+	  struct holy_net_buff *nb = range->packs.first->nb;
+
+	  if (holy_net_put_packet (&net->packs, nb))
+	    {
+	      holy_errno = holy_ERR_NONE;
+	      break;
+	    }
+	  holy_net_remove_packet (range->packs.first);
+	  range->start += nb->tail - nb->data;
+	  range->pending -= nb->tail - nb->data;
+	}
+      if (range->start != range->end)
+	break;
+
+      /* Piece complete, the slot may take the next one.  */
+      if (range->sock)
+	holy_net_tcp_close (range->sock, holy_NET_TCP_ABORT);
+      range->sock = 0;
+      i = -1;
+    }
+
+  if (have_ahead (file) == (holy_off_t) file->size)
+    {
+      net->eof = 1;
+      net->stall = 1;
+    }
+  else if (net->packs.count >= 20)
+    net->stall = 1;
+}
+
 static holy_err_t
 parse_line (holy_file_t file, http_data_t data, char *ptr, holy_size_t len)
 {
@@ -131,6 +218,12 @@ parse_line (holy_file_t file, http_data_t data, char *ptr, holy_size_t len)
       data->chunked = 1;
       return holy_ERR_NONE;
     }
+  if (holy_memcmp (ptr, "Accept-Ranges: bytes",
+		   sizeof ("Accept-Ranges: bytes") - 1) == 0)
+    {
+      data->accept_ranges = 1;
+      return holy_ERR_NONE;
+    }
 
   return holy_ERR_NONE;
 }
@@ -148,6 +241,9 @@ http_err (holy_net_tcp_socket_t sock __attribute__ ((unused)),
   if (data->current_line)
     holy_free (data->current_line);
   data->current_line = 0;
+  /* The rest of the file comes from the other connections.  */
+  if (data->ranges && data->range_done)
+    return;
   file->device->net->eof = 1;
   file->device->net->stall = 1;
   if (file->size == holy_FILE_SIZE_UNKNOWN)
@@ -259,6 +355,19 @@ http_receive (holy_net_tcp_socket_t sock __attribute__ ((unused)),
       if (!(data->chunked && (holy_ssize_t) data->chunk_rem
 	    < nb->tail - nb->data))
 	{
+	  if (data->ranges)
+	    {
+	      holy_off_t ahead = have_ahead (file);
+
+	      if (ahead + (nb->tail - nb->data) > data->range_end)
+		holy_netbuff_unput (nb, ahead + (nb->tail - nb->data)
+				    - data->range_end);
+	      if (nb->tail == nb->data)
+		{
+		  holy_netbuff_free (nb);
+		  return holy_ERR_NONE;
+		}
+	    }
 	  holy_net_put_packet (&file->device->net->packs, nb);
 	  if (file->device->net->packs.count >= 20)
 	    file->device->net->stall = 1;
@@ -268,6 +377,14 @@ http_receive (holy_net_tcp_socket_t sock __attribute__ ((unused)),
 
 	  if (data->chunked)
 	    data->chunk_rem -= nb->tail - nb->data;
+
+	  if (data->ranges && have_ahead (file) == data->range_end)
+	    {
+	      holy_net_tcp_close (data->sock, holy_NET_TCP_ABORT);
+	      data->sock = 0;
+	      data->range_done = 1;
+	      http_ranges_deliver (file);
+	    }
 	  return holy_ERR_NONE;
 	}
       if (data->chunk_rem)
@@ -291,12 +408,14 @@ http_receive (holy_net_tcp_socket_t sock __attribute__ ((unused)),
     }
 }
 
-static holy_err_t
-http_establish (struct holy_file *file, holy_off_t offset, int initial)
+/* Build a GET request for the file.  Unless RANGE is zero, only the bytes
+   from OFFSET on are asked for, up to END if it is not zero.  */
+static struct holy_net_buff *
+http_request (struct holy_file *file, holy_off_t offset, holy_off_t end,
+	      int range)
 {
   http_data_t data = file->data;
   holy_uint8_t *ptr;
-  int i, port;
   struct holy_net_buff *nb;
   holy_err_t err;
 
@@ -308,9 +427,9 @@ http_establish (struct holy_file *file, holy_off_t offset, int initial)
 			   + sizeof ("\r\nUser-Agent: " PACKAGE_STRING
 				     "\r\n") - 1
 			   + sizeof ("Range: bytes=XXXXXXXXXXXXXXXXXXXX"
-				     "-\r\n\r\n"));
+				     "-XXXXXXXXXXXXXXXXXXXX\r\n\r\n"));
   if (!nb)
-    return holy_errno;
+    return NULL;
 
   holy_netbuff_reserve (nb, holy_NET_TCP_RESERVE_SIZE);
   ptr = nb->tail;
@@ -318,7 +437,7 @@ http_establish (struct holy_file *file, holy_off_t offset, int initial)
   if (err)
     {
       holy_netbuff_free (nb);
-      return err;
+      return NULL;
     }
   holy_memcpy (ptr, "GET ", sizeof ("GET ") - 1);
 
@@ -328,7 +447,7 @@ http_establish (struct holy_file *file, holy_off_t offset, int initial)
   if (err)
     {
       holy_netbuff_free (nb);
-      return err;
+      return NULL;
     }
   holy_memcpy (ptr, data->filename, holy_strlen (data->filename));
 
@@ -337,7 +456,7 @@ http_establish (struct holy_file *file, holy_off_t offset, int initial)
   if (err)
     {
       holy_netbuff_free (nb);
-      return err;
+      return NULL;
     }
   holy_memcpy (ptr, " HTTP/1.1\r\nHost: ",
 	       sizeof (" HTTP/1.1\r\nHost: ") - 1);
@@ -347,7 +466,7 @@ http_establish (struct holy_file *file, holy_off_t offset, int initial)
   if (err)
     {
       holy_netbuff_free (nb);
-      return err;
+      return NULL;
     }
   holy_memcpy (ptr, file->device->net->server,
 	       holy_strlen (file->device->net->server));
@@ -359,30 +478,57 @@ http_establish (struct holy_file *file, holy_off_t offset, int initial)
   if (err)
     {
       holy_netbuff_free (nb);
-      return err;
+      return NULL;
     }
   holy_memcpy (ptr, "\r\nUser-Agent: " PACKAGE_STRING "\r\n",
 	       sizeof ("\r\nUser-Agent: " PACKAGE_STRING "\r\n") - 1);
-  if (!initial)
+  if (range)
     {
       ptr = nb->tail;
-      holy_snprintf ((char *) ptr,
-		     sizeof ("Range: bytes=XXXXXXXXXXXXXXXXXXXX-"
-			     "\r\n"),
-		     "Range: bytes=%" PRIuholy_UINT64_T "-\r\n",
-		     offset);
+      if (end)
+	holy_snprintf ((char *) ptr,
+		       sizeof ("Range: bytes=XXXXXXXXXXXXXXXXXXXX-"
+			       "XXXXXXXXXXXXXXXXXXXX\r\n"),
+		       "Range: bytes=%" PRIuholy_UINT64_T "-%"
+		       PRIuholy_UINT64_T "\r\n",
+		       (holy_uint64_t) offset, (holy_uint64_t) end - 1);
+      else
+	holy_snprintf ((char *) ptr,
+		       sizeof ("Range: bytes=XXXXXXXXXXXXXXXXXXXX-"
+			       "\r\n"),
+		       "Range: bytes=%" PRIuholy_UINT64_T "-\r\n",
+		       (holy_uint64_t) offset);
       holy_netbuff_put (nb, holy_strlen ((char *) ptr));
     }
   ptr = nb->tail;
   holy_netbuff_put (nb, 2);
   holy_memcpy (ptr, "\r\n", 2);
 
+  return nb;
+}
+
+static int
+http_port (struct holy_file *file)
+{
   if (file->device->net->port)
-    port = file->device->net->port;
-  else
-    port = HTTP_PORT;
+    return file->device->net->port;
+  return HTTP_PORT;
+}
+
+static holy_err_t
+http_establish (struct holy_file *file, holy_off_t offset, int initial)
+{
+  http_data_t data = file->data;
+  int i;
+  struct holy_net_buff *nb;
+  holy_err_t err;
+
+  nb = http_request (file, offset, 0, !initial);
+  if (!nb)
+    return holy_errno;
+
   data->sock = holy_net_tcp_open (file->device->net->server,
-				  port, http_receive,
+				  http_port (file), http_receive,
 				  http_err, http_err,
 				  file);
   if (!data->sock)
@@ -422,6 +568,288 @@ http_establish (struct holy_file *file, holy_off_t offset, int initial)
   return holy_ERR_NONE;
 }
 
+static holy_err_t
+http_range_receive (holy_net_tcp_socket_t sock __attribute__ ((unused)),
+		    struct holy_net_buff *nb,
+		    void *r)
+{
+  struct http_range *range = r;
+  holy_off_t left;
+
+  if (!range->sock)
+    {
+      holy_netbuff_free (nb);
+      return holy_ERR_NONE;
+    }
+
+  if (!range->headers_recv)
+    {
+      holy_uint8_t *ptr;
+
+      for (ptr = nb->data; ptr < nb->tail && !range->headers_recv; ptr++)
+	{
+	  if (range->status_len < sizeof (range->status) - 1)
+	    range->status[range->status_len++] = *ptr;
+	  if (*ptr == "\r\n\r\n"[range->header_match])
+	    range->header_match++;
+	  else
+	    range->header_match = (*ptr == '\r');
+	  if (range->header_match == 4)
+	    range->headers_recv = 1;
+	}
+      range->status[range->status_len] = 0;
+      /* Anything but a partial response means that the server ignored the
+	 Range header.  */
+      if (range->status_len == sizeof (range->status) - 1
+	  && (holy_memcmp (range->status, "HTTP/1.", sizeof ("HTTP/1.") - 1)
+	      != 0
+	      || holy_strcmp (range->status + sizeof ("HTTP/1.1") - 1,
+			      " 206") != 0))
+	{
+	  holy_dprintf ("http", "range request answered with %s\n",
+			range->status);
+	  range->failed = 1;
+	  holy_net_tcp_close (range->sock, holy_NET_TCP_ABORT);
+	  range->sock = 0;
+	  holy_netbuff_free (nb);
+	  return holy_ERR_NONE;
+	}
+      if (!range->headers_recv)
+	{
+	  holy_netbuff_free (nb);
+	  return holy_ERR_NONE;
+	}
+      holy_netbuff_pull (nb, ptr - nb->data);
+    }
+
+  left = range->end - range->start - range->pending;
+  if (nb->tail - nb->data > left)
+    holy_netbuff_unput (nb, (nb->tail - nb->data) - left);
+  if (nb->tail == nb->data)
+    {
+      holy_netbuff_free (nb);
+      return holy_ERR_NONE;
+    }
+  range->pending += nb->tail - nb->data;
+  if (holy_net_put_packet (&range->packs, nb))
+    {
+      holy_netbuff_free (nb);
+      range->failed = 1;
+      holy_net_tcp_close (range->sock, holy_NET_TCP_ABORT);
+      range->sock = 0;
+      return holy_errno;
+    }
+
+  if (range->start + range->pending == range->end)
+    {
+      holy_net_tcp_close (range->sock, holy_NET_TCP_ABORT);
+      range->sock = 0;
+    }
+
+  http_ranges_deliver (range->file);
+  return holy_ERR_NONE;
+}
+
+static void
+http_range_err (holy_net_tcp_socket_t sock __attribute__ ((unused)),
+		void *r)
+{
+  struct http_range *range = r;
+
+  if (!range->sock)
+    return;
+  holy_net_tcp_close (range->sock, holy_NET_TCP_ABORT);
+  range->sock = 0;
+  if (range->start + range->pending != range->end)
+    range->failed = 1;
+}
+
+/* Start fetching [START, END) on RANGE.  Failures are recorded in the
+   slot and dealt with once the reader gets there.  */
+static void
+http_range_open (struct holy_file *file, struct http_range *range,
+		 holy_off_t start, holy_off_t end)
+{
+  struct holy_net_buff *nb;
+
+  range->start = start;
+  range->end = end;
+  range->pending = 0;
+  range->status_len = 0;
+  range->header_match = 0;
+  range->headers_recv = 0;
+  range->failed = 0;
+
+  nb = http_request (file, start, end, 1);
+  if (!nb)
+    {
+      range->failed = 1;
+      holy_errno = holy_ERR_NONE;
+      return;
+    }
+
+  range->sock = holy_net_tcp_open (file->device->net->server,
+				   http_port (file), http_range_receive,
+				   http_range_err, http_range_err,
+				   range);
+  if (!range->sock)
+    {
+      holy_netbuff_free (nb);
+      range->failed = 1;
+      holy_errno = holy_ERR_NONE;
+      return;
+    }
+
+  if (holy_net_send_tcp_packet (range->sock, nb, 1))
+    {
+      holy_net_tcp_close (range->sock, holy_NET_TCP_ABORT);
+      range->sock = 0;
+      range->failed = 1;
+      holy_errno = holy_ERR_NONE;
+    }
+}
+
+static void
+http_ranges_free (http_data_t data)
+{
+  int i;
+
+  if (!data->ranges)
+    return;
+  for (i = 0; i < data->n_ranges; i++)
+    {
+      struct http_range *range = &data->ranges[i];
+
+      if (range->sock)
+	holy_net_tcp_close (range->sock, holy_NET_TCP_ABORT);
+      while (range->packs.first)
+	{
+	  holy_netbuff_free (range->packs.first->nb);
+	  holy_net_remove_packet (range->packs.first);
+	}
+    }
+  holy_free (data->ranges);
+  data->ranges = 0;
+  data->n_ranges = 0;
+}
+
+/* Switch to parallel mode if the file is large and the server announced
+   range support.  The connection opened by http_establish keeps fetching
+   the first piece.  */
+static void
+http_ranges_start (struct holy_file *file)
+{
+  http_data_t data = file->data;
+  const char *val;
+  unsigned long connections = HTTP_DEFAULT_CONNECTIONS;
+  int i;
+
+  val = holy_env_get ("net_http_connections");
+  if (val)
+    {
+      connections = holy_strtoul (val, 0, 0);
+      if (holy_errno)
+	{
+	  holy_errno = holy_ERR_NONE;
+	  return;
+	}
+      if (connections > HTTP_MAX_CONNECTIONS)
+	connections = HTTP_MAX_CONNECTIONS;
+    }
+
+  if (connections < 2 || !data->accept_ranges || data->chunked
+      || file->size == holy_FILE_SIZE_UNKNOWN
+      || file->size < 2 * HTTP_RANGE_CHUNK
+      || have_ahead (file) >= HTTP_RANGE_CHUNK)
+    return;
+
+  data->ranges = holy_zalloc ((connections - 1) * sizeof (data->ranges[0]));
+  if (!data->ranges)
+    {
+      holy_errno = holy_ERR_NONE;
+      return;
+    }
+  data->n_ranges = connections - 1;
+  for (i = 0; i < data->n_ranges; i++)
+    data->ranges[i].file = file;
+  data->range_end = HTTP_RANGE_CHUNK;
+  data->next_fetch = HTTP_RANGE_CHUNK;
+  holy_dprintf ("http", "fetching %s over %lu connections\n",
+		data->filename, connections);
+}
+
+/* The reader reached a piece which could not be fetched: drop the other
+   connections and continue with a single one from here.  */
+static holy_err_t
+http_ranges_fallback (struct holy_file *file)
+{
+  http_data_t data = file->data;
+  holy_off_t pos = have_ahead (file);
+  holy_err_t err;
+
+  holy_dprintf ("http", "range request failed, continuing at %"
+		PRIuholy_UINT64_T " sequentially\n", (holy_uint64_t) pos);
+  http_ranges_free (data);
+  data->range_end = 0;
+  data->range_done = 0;
+  data->headers_recv = 0;
+  data->first_line_recv = 0;
+  data->chunked = 0;
+  data->in_chunk_len = 0;
+  if (data->current_line)
+    holy_free (data->current_line);
+  data->current_line = 0;
+  data->current_line_len = 0;
+
+  err = http_establish (file, pos, 0);
+  if (err)
+    {
+      file->device->net->eof = 1;
+      file->device->net->stall = 1;
+    }
+  return err;
+}
+
+/* Called whenever the reader consumed data: hand over finished pieces and
+   put idle connections to work on the next ones.  */
+static holy_err_t
+http_ranges_service (struct holy_file *file)
+{
+  http_data_t data = file->data;
+  int i;
+
+  if (!data->ranges)
+    return holy_ERR_NONE;
+
+  http_ranges_deliver (file);
+
+  if (data->range_done)
+    for (i = 0; i < data->n_ranges; i++)
+      if (data->ranges[i].failed
+	  && data->ranges[i].start == have_ahead (file)
+	  && !data->ranges[i].packs.first)
+	return http_ranges_fallback (file);
+
+  for (i = 0; i < data->n_ranges; i++)
+    {
+      struct http_range *range = &data->ranges[i];
+      holy_off_t end;
+
+      if (range->start != range->end
+	  || data->next_fetch >= (holy_off_t) file->size)
+	continue;
+      end = data->next_fetch + HTTP_RANGE_CHUNK;
+      if (end > (holy_off_t) file->size)
+	end = file->size;
+      http_range_open (file, range, data->next_fetch, end);
+      data->next_fetch = end;
+      /* Opening polls the cards, which may have completed other pieces.  */
+      if (!data->ranges)
+	break;
+    }
+  return holy_ERR_NONE;
+}
+
 static holy_err_t
 http_seek (struct holy_file *file, holy_off_t off)
 {
@@ -432,6 +860,7 @@ http_seek (struct holy_file *file, holy_off_t off)
   if (old_data->sock)
     holy_net_tcp_close (old_data->sock, holy_NET_TCP_ABORT);
   old_data->sock = 0;
+  http_ranges_free (old_data);
 
   while (file->device->net->packs.first)
     {
@@ -498,6 +927,10 @@ http_open (struct holy_file *file, const char *filename)
       return err;
     }
 
+  http_ranges_start (file);
+  http_ranges_service (file);
+  holy_errno = holy_ERR_NONE;
+
   return holy_ERR_NONE;
 }
 
@@ -511,6 +944,7 @@ http_close (struct holy_file *file)
 
   if (data->sock)
     holy_net_tcp_close (data->sock, holy_NET_TCP_ABORT);
+  http_ranges_free (data);
   if (data->current_line)
     holy_free (data->current_line);
   holy_free (data->filename);
@@ -530,6 +964,8 @@ http_packets_pulled (struct holy_file *file)
     file->device->net->stall = 0;
   if (data && data->sock)
     holy_net_tcp_unstall (data->sock);
+  if (data)
+    return http_ranges_service (file);
   return 0;
 }
 
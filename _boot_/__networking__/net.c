@@ -179,9 +179,32 @@ holy_net_card_unregister (struct holy_net_card *card)
 	card->driver->close (card);
       card->opened = 0;
     }
+  holy_netbuff_pool_destroy (card->rx_pool);
+  card->rx_pool = NULL;
   holy_list_remove (holy_AS_LIST (card));
 }
 
+/* Buffer for a received frame of up to LEN bytes, with the IP alignment
+   headroom already reserved.  Drivers should receive straight into it.  */
+struct holy_net_buff *
+holy_net_card_rx_buff (struct holy_net_card *card, holy_size_t len)
+{
+  struct holy_net_buff *nb;
+
+  if (card->rx_pool)
+    return holy_netbuff_pool_get (card->rx_pool, len);
+
+  nb = holy_netbuff_alloc (len + holy_NET_RX_HEADROOM);
+  if (!nb)
+    return NULL;
+  if (holy_netbuff_reserve (nb, holy_NET_RX_HEADROOM))
+    {
+      holy_netbuff_free (nb);
+      return NULL;
+    }
+  return nb;
+}
+
 static struct holy_net_slaac_mac_list *
 holy_net_ipv6_get_slaac (struct holy_net_card *card,
 			 const holy_net_link_level_address_t *hwaddr)
@@ -1218,6 +1241,10 @@ holy_cmd_listcards (struct holy_command *cmd __attribute__ ((unused)),
     char buf[holy_NET_MAX_STR_HWADDR_LEN];
     holy_net_hwaddr_to_str (&card->default_address, buf);
     holy_printf ("%s %s\n", card->name, buf);
+    if (card->rx_pool)
+      holy_printf ("  rx pool: %u/%u free, %lu hits, %lu misses\n",
+		   card->rx_pool->n_free, card->rx_pool->count,
+		   card->rx_pool->hits, card->rx_pool->misses);
   }
   return holy_ERR_NONE;
 }
@@ -1483,6 +1510,17 @@ receive_packets (struct holy_net_card *card, int *stop_condition)
 	  return;
 	}
       card->opened = 1;
+      if (!card->rx_pool)
+	{
+	  card->rx_pool = holy_netbuff_pool_new (holy_NET_RX_POOL_SIZE,
+						 ALIGN_UP (card->mtu, 64) + 256,
+						 holy_NET_RX_HEADROOM);
+	  if (!card->rx_pool)
+	    {
+	      holy_dprintf ("net", "%s: no receive pool\n", card->name);
+	      holy_errno = holy_ERR_NONE;
+	    }
+	}
     }
   while (received < 100)
     {
@@ -1497,6 +1535,9 @@ receive_packets (struct holy_net_card *card, int *stop_condition)
       if (!nb)
 	{
 	  card->last_poll = holy_get_time_ms ();
+	  /* The burst is over; acknowledge what was held back.  */
+	  if (received)
+	    holy_net_tcp_flush_acks ();
 	  break;
 	}
       received++;
@@ -1724,6 +1765,8 @@ holy_net_fini_hw (int noreturn __attribute__ ((unused)))
 	if (card->driver->close)
 	  card->driver->close (card);
 	card->opened = 0;
+	holy_netbuff_pool_destroy (card->rx_pool);
+	card->rx_pool = NULL;
       }
   return holy_ERR_NONE;
 }
@@ -81,6 +81,7 @@ holy_netbuff_alloc (holy_size_t len)
 				 + len / sizeof (holy_properly_aligned_t));
   nb->head = nb->data = nb->tail = data;
   nb->end = (holy_uint8_t *) nb;
+  nb->pool = NULL;
   return nb;
 }
 
@@ -104,12 +105,118 @@ holy_netbuff_make_pkt (holy_size_t len)
   return NULL;
 }
 
+static void
+pool_free (struct holy_net_buff_pool *pool)
+{
+  holy_free (pool->free_list);
+  holy_free (pool->mem);
+  holy_free (pool);
+}
+
 void
 holy_netbuff_free (struct holy_net_buff *nb)
 {
+  struct holy_net_buff_pool *pool;
+
   if (!nb)
     return;
-  holy_free (nb->head);
+  pool = nb->pool;
+  if (!pool)
+    {
+      holy_free (nb->head);
+      return;
+    }
+  pool->free_list[pool->n_free++] = nb;
+  if (pool->dead && pool->n_free == pool->count)
+    pool_free (pool);
+}
+
+struct holy_net_buff_pool *
+holy_netbuff_pool_new (unsigned count, holy_size_t size, holy_size_t headroom)
+{
+  struct holy_net_buff_pool *pool;
+  holy_size_t len;
+  unsigned i;
+
+  pool = holy_zalloc (sizeof (*pool));
+  if (!pool)
+    return NULL;
+
+  /* Same layout as holy_netbuff_alloc: the descriptor follows the data.  */
+  len = ALIGN_UP (headroom + size, sizeof (holy_properly_aligned_t));
+  pool->stride = ALIGN_UP (len + sizeof (struct holy_net_buff), NETBUFF_ALIGN);
+  pool->size = size;
+  pool->headroom = headroom;
+  pool->count = count;
+#ifdef holy_MACHINE_EMU
+  pool->mem = holy_malloc (pool->stride * count);
+#else
+  pool->mem = holy_memalign (NETBUFF_ALIGN, pool->stride * count);
+#endif
+  pool->free_list = holy_malloc (count * sizeof (pool->free_list[0]));
+  if (!pool->mem || !pool->free_list)
+    {
+      pool_free (pool);
+      return NULL;
+    }
+
+  for (i = 0; i < count; i++)
+    {
+      holy_uint8_t *head = pool->mem + (holy_size_t) i * pool->stride;
+      struct holy_net_buff *nb;
+
+      nb = (struct holy_net_buff *) (head + len);
+      nb->head = nb->data = nb->tail = head;
+      nb->end = (holy_uint8_t *) nb;
+      nb->pool = pool;
+      pool->free_list[count - i - 1] = nb;
+    }
+  pool->n_free = count;
+  return pool;
+}
+
+/* Get a buffer with LEN bytes of room after the pool headroom, from the
+   heap if the pool is exhausted or LEN does not fit.  */
+struct holy_net_buff *
+holy_netbuff_pool_get (struct holy_net_buff_pool *pool, holy_size_t len)
+{
+  struct holy_net_buff *nb;
+
+  if (!pool->n_free || len > pool->size)
+    {
+      pool->misses++;
+      nb = holy_netbuff_alloc (pool->headroom + len);
+      if (!nb)
+	return NULL;
+    }
+  else
+    {
+      pool->hits++;
+      nb = pool->free_list[--pool->n_free];
+      holy_netbuff_clear (nb);
+    }
+
+  if (holy_netbuff_reserve (nb, pool->headroom))
+    {
+      holy_netbuff_free (nb);
+      return NULL;
+    }
+  return nb;
+}
+
+/* Release POOL.  Buffers still held elsewhere keep it alive until the
+   last one is freed.  */
+void
+holy_netbuff_pool_destroy (struct holy_net_buff_pool *pool)
+{
+  if (!pool)
+    return;
+  if (pool->n_free == pool->count)
+    {
+      pool_free (pool);
+      return;
+    }
+  pool->dead = 1;
 }
 
 holy_err_t
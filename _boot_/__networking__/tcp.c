@@ -8,6 +8,7 @@
 #include <holy/net/tcp.h>
 #include <holy/net/netbuff.h>
 #include <holy/time.h>
+#include <holy/env.h>
 #include <holy/priority_queue.h>
 
 #define TCP_SYN_RETRANSMISSION_TIMEOUT holy_NET_INTERVAL
@@ -15,6 +16,30 @@
 #define TCP_RETRANSMISSION_TIMEOUT holy_NET_INTERVAL
 #define TCP_RETRANSMISSION_COUNT holy_NET_TRIES
 
+/* Receive window used unless overridden by the net_tcp_window variable,
+   and the range accepted from it.  */
+#define TCP_DEFAULT_WINDOW (1024 * 1024)
+#define TCP_MIN_WINDOW 8192
+#define TCP_MAX_WINDOW (16 * 1024 * 1024)
+
+/* RFC 7323 limits the window scale shift to 14.  */
+#define TCP_MAX_WSCALE 14
+
+/* Acknowledge at least every second in-order segment (RFC 1122).  Pending
+   acknowledgements are also flushed once the card has no more packets.  */
+#define TCP_DELAYED_ACK_SEGMENTS 2
+
+/* Number of SACK blocks we report.  Four blocks fit into the option
+   space as we don't use timestamps.  */
+#define TCP_MAX_SACK_BLOCKS 4
+
+/* Maximum size of the TCP options.  */
+#define TCP_MAX_OPTIONS_SIZE 40
+
+/* Sequence number comparisons which survive wrap around.  */
+#define TCP_SEQ_LT(a, b) ((holy_int32_t) ((holy_uint32_t) (a) - (holy_uint32_t) (b)) < 0)
+#define TCP_SEQ_LEQ(a, b) ((holy_int32_t) ((holy_uint32_t) (a) - (holy_uint32_t) (b)) <= 0)
+
 struct unacked
 {
   struct unacked *next;
@@ -34,6 +59,22 @@ enum
     TCP_URG = 0x20,
   };
 
+enum
+  {
+    TCP_OPT_END = 0,
+    TCP_OPT_NOP = 1,
+    TCP_OPT_MSS = 2,
+    TCP_OPT_WSCALE = 3,
+    TCP_OPT_SACK_PERMITTED = 4,
+    TCP_OPT_SACK = 5
+  };
+
+struct tcp_sack_block
+{
+  holy_uint32_t start;
+  holy_uint32_t end;
+};
+
 struct holy_net_tcp_socket
 {
   struct holy_net_tcp_socket *next;
@@ -52,7 +93,16 @@ struct holy_net_tcp_socket
   holy_uint32_t my_cur_seq;
   holy_uint32_t their_start_seq;
   holy_uint32_t their_cur_seq;
-  holy_uint16_t my_window;
+  /* Receive window in bytes and the shift applied when advertising it.  */
+  holy_uint32_t my_window;
+  holy_uint8_t my_wscale;
+  int wscale_ok;
+  int sack_permitted;
+  /* In-order segments received since we last sent an acknowledgement.  */
+  int delayed_acks;
+  /* Out-of-order data held in PQ, most recently changed block first.  */
+  struct tcp_sack_block sack[TCP_MAX_SACK_BLOCKS];
+  int n_sack;
   struct unacked *unack_first;
   struct unacked *unack_last;
   holy_err_t (*recv_hook) (holy_net_tcp_socket_t sock, struct holy_net_buff *nb,
@@ -117,6 +167,233 @@ static struct holy_net_tcp_listen *tcp_listens;
 #define FOR_TCP_SOCKETS(var) FOR_LIST_ELEMENTS (var, tcp_sockets)
 #define FOR_TCP_LISTENS(var) FOR_LIST_ELEMENTS (var, tcp_listens)
 
+/* Set up the receive window of SOCK from the net_tcp_window variable and
+   pick the smallest window scale that can advertise it.  */
+static void
+tcp_init_window (holy_net_tcp_socket_t sock)
+{
+  const char *val;
+  unsigned long window = TCP_DEFAULT_WINDOW;
+
+  val = holy_env_get ("net_tcp_window");
+  if (val)
+    {
+      window = holy_strtoul (val, 0, 0);
+      if (holy_errno)
+	{
+	  holy_errno = holy_ERR_NONE;
+	  window = TCP_DEFAULT_WINDOW;
+	}
+      if (window < TCP_MIN_WINDOW)
+	window = TCP_MIN_WINDOW;
+      if (window > TCP_MAX_WINDOW)
+	window = TCP_MAX_WINDOW;
+    }
+
+  sock->my_window = window;
+  sock->my_wscale = 0;
+  while ((sock->my_window >> sock->my_wscale) > 0xffff
+	 && sock->my_wscale < TCP_MAX_WSCALE)
+    sock->my_wscale++;
+}
+
+/* Window field of segments other than SYN.  */
+static holy_uint16_t
+tcp_window (holy_net_tcp_socket_t sock)
+{
+  holy_uint32_t window;
+
+  if (sock->i_stall)
+    return 0;
+  window = sock->my_window >> sock->my_wscale;
+  if (window > 0xffff)
+    window = 0xffff;
+  return holy_cpu_to_be16 (window);
+}
+
+/* Window field of SYN segments, which is never scaled.  */
+static holy_uint16_t
+tcp_syn_window (holy_net_tcp_socket_t sock)
+{
+  if (sock->my_window > 0xffff)
+    return holy_cpu_to_be16_compile_time (0xffff);
+  return holy_cpu_to_be16 (sock->my_window);
+}
+
+static void
+tcp_set_header_len (struct tcphdr *tcph, holy_size_t len)
+{
+  tcph->flags = ((tcph->flags & holy_cpu_to_be16_compile_time (0x0fff))
+		 | holy_cpu_to_be16 ((len / 4) << 12));
+}
+
+/* Append the options of our SYN to NB, which holds just the TCP header.
+   WSCALE and SACK select the optional parts.  */
+static holy_err_t
+tcp_put_syn_options (holy_net_tcp_socket_t sock, struct holy_net_buff *nb,
+		     int wscale, int sack)
+{
+  struct tcphdr *tcph = (struct tcphdr *) nb->data;
+  holy_uint8_t *opt = nb->tail;
+  holy_size_t len = 4, mss;
+  holy_err_t err;
+
+  if (wscale)
+    len += 4;
+  if (sack)
+    len += 4;
+  err = holy_netbuff_put (nb, len);
+  if (err)
+    return err;
+
+  if (sock->out_nla.type == holy_NET_NETWORK_LEVEL_PROTOCOL_IPV4)
+    mss = (sock->inf->card->mtu - holy_NET_OUR_IPV4_HEADER_SIZE
+	   - sizeof (*tcph));
+  else
+    mss = (sock->inf->card->mtu - holy_NET_OUR_IPV6_HEADER_SIZE
+	   - sizeof (*tcph));
+
+  *opt++ = TCP_OPT_MSS;
+  *opt++ = 4;
+  *opt++ = mss >> 8;
+  *opt++ = mss & 0xff;
+  if (wscale)
+    {
+      *opt++ = TCP_OPT_NOP;
+      *opt++ = TCP_OPT_WSCALE;
+      *opt++ = 3;
+      *opt++ = sock->my_wscale;
+    }
+  if (sack)
+    {
+      *opt++ = TCP_OPT_NOP;
+      *opt++ = TCP_OPT_NOP;
+      *opt++ = TCP_OPT_SACK_PERMITTED;
+      *opt++ = 2;
+    }
+  tcp_set_header_len (tcph, sizeof (*tcph) + len);
+  return holy_ERR_NONE;
+}
+
+/* Record which of our options the peer accepted in its SYN.  */
+static void
+tcp_parse_syn_options (holy_net_tcp_socket_t sock, struct tcphdr *tcph)
+{
+  holy_uint8_t *opt = (holy_uint8_t *) (tcph + 1);
+  holy_uint8_t *end = ((holy_uint8_t *) tcph
+		       + (holy_be_to_cpu16 (tcph->flags) >> 12) * 4);
+
+  sock->wscale_ok = 0;
+  sock->sack_permitted = 0;
+  while (opt < end && *opt != TCP_OPT_END)
+    {
+      if (*opt == TCP_OPT_NOP)
+	{
+	  opt++;
+	  continue;
+	}
+      if (opt + 1 >= end || opt[1] < 2 || opt + opt[1] > end)
+	break;
+      if (*opt == TCP_OPT_WSCALE && opt[1] == 3)
+	sock->wscale_ok = 1;
+      if (*opt == TCP_OPT_SACK_PERMITTED && opt[1] == 2)
+	sock->sack_permitted = 1;
+      opt += opt[1];
+    }
+
+  /* Scaling is only in effect if both sides asked for it.  */
+  if (!sock->wscale_ok)
+    sock->my_wscale = 0;
+}
+
+/* Append our SACK blocks to the acknowledgement in NB.  */
+static holy_err_t
+tcp_put_sack_option (holy_net_tcp_socket_t sock, struct holy_net_buff *nb)
+{
+  struct tcphdr *tcph = (struct tcphdr *) nb->data;
+  holy_uint8_t *opt = nb->tail;
+  holy_size_t len = 4 + sock->n_sack * 8;
+  holy_err_t err;
+  int i;
+
+  err = holy_netbuff_put (nb, len);
+  if (err)
+    return err;
+
+  *opt++ = TCP_OPT_NOP;
+  *opt++ = TCP_OPT_NOP;
+  *opt++ = TCP_OPT_SACK;
+  *opt++ = 2 + sock->n_sack * 8;
+  for (i = 0; i < sock->n_sack; i++)
+    {
+      holy_uint32_t v;
+      v = holy_cpu_to_be32 (sock->sack[i].start);
+      holy_memcpy (opt, &v, 4);
+      v = holy_cpu_to_be32 (sock->sack[i].end);
+      holy_memcpy (opt + 4, &v, 4);
+      opt += 8;
+    }
+  tcp_set_header_len (tcph, sizeof (*tcph) + len);
+  return holy_ERR_NONE;
+}
+
+/* Note that [START, END) was queued out of order.  Overlapping blocks are
+   merged and the result is reported first, as RFC 2018 asks.  */
+static void
+tcp_sack_add (holy_net_tcp_socket_t sock, holy_uint32_t start,
+	      holy_uint32_t end)
+{
+  struct tcp_sack_block others[TCP_MAX_SACK_BLOCKS];
+  int i, n = 0;
+
+  for (i = 0; i < sock->n_sack; i++)
+    {
+      struct tcp_sack_block *b = &sock->sack[i];
+
+      if (TCP_SEQ_LT (end, b->start) || TCP_SEQ_LT (b->end, start))
+	{
+	  if (n < TCP_MAX_SACK_BLOCKS - 1)
+	    others[n++] = *b;
+	  continue;
+	}
+      if (TCP_SEQ_LT (b->start, start))
+	start = b->start;
+      if (TCP_SEQ_LT (end, b->end))
+	end = b->end;
+    }
+
+  sock->sack[0].start = start;
+  sock->sack[0].end = end;
+  holy_memcpy (sock->sack + 1, others, n * sizeof (others[0]));
+  sock->n_sack = n + 1;
+}
+
+/* Forget the blocks which are now below their_cur_seq.  */
+static void
+tcp_sack_trim (holy_net_tcp_socket_t sock)
+{
+  int i, n = 0;
+
+  for (i = 0; i < sock->n_sack; i++)
+    if (TCP_SEQ_LT (sock->their_cur_seq, sock->sack[i].end))
+      sock->sack[n++] = sock->sack[i];
+  sock->n_sack = n;
+}
+
+/* Sequence space taken by the segment in NB, including a FIN.  */
+static holy_uint32_t
+tcp_segment_len (struct holy_net_buff *nb)
+{
+  struct tcphdr *tcph = (struct tcphdr *) nb->data;
+  holy_uint32_t len;
+
+  len = (nb->tail - nb->data
+	 - (holy_be_to_cpu16 (tcph->flags) >> 12) * sizeof (holy_uint32_t));
+  if (holy_be_to_cpu16 (tcph->flags) & TCP_FIN)
+    len++;
+  return len;
+}
+
 holy_net_tcp_listen_t
 holy_net_tcp_listen (holy_uint16_t port,
 		     const struct holy_net_network_level_interface *inf,
@@ -180,6 +457,10 @@ tcp_send (struct holy_net_buff *nb, holy_net_tcp_socket_t socket)
 
   tcph = (struct tcphdr *) nb->data;
 
+  /* Every segment we send acknowledges everything received so far.  */
+  if (holy_be_to_cpu16 (tcph->flags) & TCP_ACK)
+    socket->delayed_acks = 0;
+
   tcph->seqnr = holy_cpu_to_be32 (socket->my_cur_seq);
   size = (nb->tail - nb->data - (holy_be_to_cpu16 (tcph->flags) >> 12) * 4);
   if (holy_be_to_cpu16 (tcph->flags) & TCP_FIN)
@@ -288,7 +569,8 @@ ack_real (holy_net_tcp_socket_t sock, int res)
   struct tcphdr *tcph_ack;
   holy_err_t err;
 
-  nb_ack = holy_netbuff_alloc (sizeof (*tcph_ack) + 128);
+  nb_ack = holy_netbuff_alloc (sizeof (*tcph_ack) + TCP_MAX_OPTIONS_SIZE
+				+ 128);
   if (!nb_ack)
     return;
   err = holy_netbuff_reserve (nb_ack, 128);
@@ -319,8 +601,13 @@ ack_real (holy_net_tcp_socket_t sock, int res)
     {
       tcph_ack->ack = holy_cpu_to_be32 (sock->their_cur_seq);
       tcph_ack->flags = holy_cpu_to_be16_compile_time ((5 << 12) | TCP_ACK);
-      tcph_ack->window = !sock->i_stall ? holy_cpu_to_be16 (sock->my_window)
-	: 0;
+      tcph_ack->window = tcp_window (sock);
+      if (sock->sack_permitted && sock->n_sack
+	  && tcp_put_sack_option (sock, nb_ack))
+	{
+	  holy_dprintf ("net", "error adding SACK option\n");
+	  holy_errno = holy_ERR_NONE;
+	}
     }
   tcph_ack->urgent = 0;
   tcph_ack->src = holy_cpu_to_be16 (sock->in_port);
@@ -345,6 +632,16 @@ reset (holy_net_tcp_socket_t sock)
   ack_real (sock, 1);
 }
 
+void
+holy_net_tcp_flush_acks (void)
+{
+  holy_net_tcp_socket_t sock;
+
+  FOR_TCP_SOCKETS (sock)
+    if (sock->delayed_acks)
+      ack (sock);
+}
+
 void
 holy_net_tcp_retransmit (void)
 {
@@ -352,6 +649,8 @@ holy_net_tcp_retransmit (void)
   holy_uint64_t ctime = holy_get_time_ms ();
   holy_uint64_t limit_time = ctime - TCP_RETRANSMISSION_TIMEOUT;
 
+  holy_net_tcp_flush_acks ();
+
   FOR_TCP_SOCKETS (sock)
   {
     struct unacked *unack;
@@ -442,7 +741,6 @@ holy_net_ip_transport_checksum (struct holy_net_buff *nb,
   return holy_cpu_to_be16 (~c);
 }
 
-/* FIXME: overflow. */
 static int
 cmp (const void *a__, const void *b__)
 {
@@ -451,9 +749,9 @@ cmp (const void *a__, const void *b__)
   struct tcphdr *a = (struct tcphdr *) a_->data;
   struct tcphdr *b = (struct tcphdr *) b_->data;
   /* We want the first elements to be on top.  */
-  if (holy_be_to_cpu32 (a->seqnr) < holy_be_to_cpu32 (b->seqnr))
+  if (TCP_SEQ_LT (holy_be_to_cpu32 (a->seqnr), holy_be_to_cpu32 (b->seqnr)))
     return +1;
-  if (holy_be_to_cpu32 (a->seqnr) > holy_be_to_cpu32 (b->seqnr))
+  if (TCP_SEQ_LT (holy_be_to_cpu32 (b->seqnr), holy_be_to_cpu32 (a->seqnr)))
     return -1;
   return 0;
 }
@@ -501,7 +799,7 @@ holy_net_tcp_accept (holy_net_tcp_socket_t sock,
   if (err)
     return err;
 
-  nb_ack = holy_netbuff_alloc (sizeof (*tcph)
+  nb_ack = holy_netbuff_alloc (sizeof (*tcph) + TCP_MAX_OPTIONS_SIZE
 			       + holy_NET_OUR_MAX_IP_HEADER_SIZE
 			       + holy_NET_MAX_LINK_HEADER_SIZE);
   if (!nb_ack)
@@ -523,8 +821,15 @@ holy_net_tcp_accept (holy_net_tcp_socket_t sock,
   tcph = (void *) nb_ack->data;
   tcph->ack = holy_cpu_to_be32 (sock->their_cur_seq);
   tcph->flags = holy_cpu_to_be16_compile_time ((5 << 12) | TCP_SYN | TCP_ACK);
-  tcph->window = holy_cpu_to_be16 (sock->my_window);
+  tcph->window = tcp_syn_window (sock);
   tcph->urgent = 0;
+  err = tcp_put_syn_options (sock, nb_ack, sock->wscale_ok,
+			     sock->sack_permitted);
+  if (err)
+    {
+      holy_netbuff_free (nb_ack);
+      return err;
+    }
   sock->established = 1;
   tcp_socket_register (sock);
   err = tcp_send (nb_ack, sock);
@@ -591,7 +896,7 @@ holy_net_tcp_open (char *server,
   socket->fin_hook = fin_hook;
   socket->hook_data = hook_data;
 
-  nb = holy_netbuff_alloc (sizeof (*tcph) + 128);
+  nb = holy_netbuff_alloc (sizeof (*tcph) + TCP_MAX_OPTIONS_SIZE + 128);
   if (!nb)
     {
       holy_free (socket);
@@ -624,14 +929,22 @@ holy_net_tcp_open (char *server,
   tcph = (void *) nb->data;
   socket->my_start_seq = holy_get_time_ms ();
   socket->my_cur_seq = socket->my_start_seq + 1;
-  socket->my_window = 8192;
+  tcp_init_window (socket);
   tcph->seqnr = holy_cpu_to_be32 (socket->my_start_seq);
   tcph->ack = holy_cpu_to_be32_compile_time (0);
   tcph->flags = holy_cpu_to_be16_compile_time ((5 << 12) | TCP_SYN);
-  tcph->window = holy_cpu_to_be16 (socket->my_window);
+  tcph->window = tcp_syn_window (socket);
   tcph->urgent = 0;
   tcph->src = holy_cpu_to_be16 (socket->in_port);
   tcph->dst = holy_cpu_to_be16 (socket->out_port);
+  err = tcp_put_syn_options (socket, nb, 1, 1);
+  if (err)
+    {
+      destroy_pq (socket);
+      holy_free (socket);
+      holy_netbuff_free (nb);
+      return NULL;
+    }
   tcph->checksum = 0;
   tcph->checksum = holy_net_ip_transport_checksum (nb, holy_NET_IP_TCP,
 						   &socket->inf->address,
@@ -714,8 +1027,7 @@ holy_net_send_tcp_packet (const holy_net_tcp_socket_t socket,
       tcph = (struct tcphdr *) nb2->data;
       tcph->ack = holy_cpu_to_be32 (socket->their_cur_seq);
       tcph->flags = holy_cpu_to_be16_compile_time ((5 << 12) | TCP_ACK);
-      tcph->window = !socket->i_stall ? holy_cpu_to_be16 (socket->my_window)
-	: 0;
+      tcph->window = tcp_window (socket);
       tcph->urgent = 0;
       err = holy_netbuff_put (nb2, fraglen);
       if (err)
@@ -738,7 +1050,7 @@ holy_net_send_tcp_packet (const holy_net_tcp_socket_t socket,
   tcph->ack = holy_cpu_to_be32 (socket->their_cur_seq);
   tcph->flags = (holy_cpu_to_be16_compile_time ((5 << 12) | TCP_ACK)
 		 | (push ? holy_cpu_to_be16_compile_time (TCP_PUSH) : 0));
-  tcph->window = !socket->i_stall ? holy_cpu_to_be16 (socket->my_window) : 0;
+  tcph->window = tcp_window (socket);
   tcph->urgent = 0;
   return tcp_send (nb, socket);
 }
@@ -810,6 +1122,7 @@ holy_net_recv_tcp_packet (struct holy_net_buff *nb,
 	sock->their_start_seq = holy_be_to_cpu32 (tcph->seqnr);
 	sock->their_cur_seq = sock->their_start_seq + 1;
 	sock->established = 1;
+	tcp_parse_syn_options (sock, tcph);
       }
 
     if (holy_be_to_cpu16 (tcph->flags) & TCP_RST)
@@ -840,7 +1153,7 @@ holy_net_recv_tcp_packet (struct holy_net_buff *nb,
 	    if (holy_be_to_cpu16 (unack_tcph->flags) & TCP_FIN)
 	      seqnr++;
 
-	    if (seqnr > acked)
+	    if (TCP_SEQ_LT (acked, seqnr))
 	      break;
 	    holy_netbuff_free (unack->nb);
 	    holy_free (unack);
@@ -850,12 +1163,38 @@ holy_net_recv_tcp_packet (struct holy_net_buff *nb,
 	  sock->unack_last = NULL;
       }
 
-    if (holy_be_to_cpu32 (tcph->seqnr) < sock->their_cur_seq)
-      {
-	ack (sock);
-	holy_netbuff_free (nb);
-	return holy_ERR_NONE;
-      }
+    {
+      holy_uint32_t seqnr = holy_be_to_cpu32 (tcph->seqnr);
+      holy_uint32_t len = tcp_segment_len (nb);
+
+      /* Nothing new in this segment.  Acknowledge retransmissions and the
+	 SYN, silently drop pure ACKs.  */
+      if (TCP_SEQ_LEQ (seqnr + len, sock->their_cur_seq))
+	{
+	  if (len || (holy_be_to_cpu16 (tcph->flags) & TCP_SYN))
+	    ack (sock);
+	  holy_netbuff_free (nb);
+	  return holy_ERR_NONE;
+	}
+
+      if (TCP_SEQ_LEQ (sock->their_cur_seq + sock->my_window, seqnr))
+	{
+	  ack (sock);
+	  holy_netbuff_free (nb);
+	  return holy_ERR_NONE;
+	}
+
+      /* Data beyond a hole is queued and reported to the sender so that it
+	 only retransmits what is missing.  */
+      if (seqnr != sock->their_cur_seq
+	  && (nb->tail - nb->data
+	      - (holy_be_to_cpu16 (tcph->flags) >> 12) * sizeof (holy_uint32_t)))
+	tcp_sack_add (sock, seqnr,
+		      seqnr + (nb->tail - nb->data
+			       - (holy_be_to_cpu16 (tcph->flags) >> 12)
+			       * sizeof (holy_uint32_t)));
+    }
+
     if (sock->i_reseted && (nb->tail - nb->data
 			    - (holy_be_to_cpu16 (tcph->flags)
 			       >> 12) * sizeof (holy_uint32_t)) > 0)
@@ -874,37 +1213,37 @@ holy_net_recv_tcp_packet (struct holy_net_buff *nb,
       struct holy_net_buff **nb_top_p, *nb_top;
       int do_ack = 0;
       int just_closed = 0;
+      /* Out-of-order data is pending or has just been received; the ACK
+	 must go out at once in that case.  */
+      int ack_now = sock->n_sack;
+
       while (1)
 	{
-	  nb_top_p = holy_priority_queue_top (sock->pq);
-	  if (!nb_top_p)
-	    return holy_ERR_NONE;
-	  nb_top = *nb_top_p;
-	  tcph = (struct tcphdr *) nb_top->data;
-	  if (holy_be_to_cpu32 (tcph->seqnr) >= sock->their_cur_seq)
-	    break;
-	  holy_netbuff_free (nb_top);
-	  holy_priority_queue_pop (sock->pq);
-	}
-      if (holy_be_to_cpu32 (tcph->seqnr) != sock->their_cur_seq)
-	{
-	  ack (sock);
-	  return holy_ERR_NONE;
-	}
-      while (1)
-	{
+	  holy_uint32_t top_seq;
+
 	  nb_top_p = holy_priority_queue_top (sock->pq);
 	  if (!nb_top_p)
 	    break;
 	  nb_top = *nb_top_p;
 	  tcph = (struct tcphdr *) nb_top->data;
+	  top_seq = holy_be_to_cpu32 (tcph->seqnr);
 
-	  if (holy_be_to_cpu32 (tcph->seqnr) != sock->their_cur_seq)
+	  if (TCP_SEQ_LT (sock->their_cur_seq, top_seq))
 	    break;
 	  holy_priority_queue_pop (sock->pq);
 
+	  /* Entirely covered by data delivered before.  */
+	  if (TCP_SEQ_LEQ (top_seq + tcp_segment_len (nb_top),
+			   sock->their_cur_seq))
+	    {
+	      holy_netbuff_free (nb_top);
+	      continue;
+	    }
+
+	  /* Skip the header and any part already delivered.  */
 	  err = holy_netbuff_pull (nb_top, (holy_be_to_cpu16 (tcph->flags)
-					    >> 12) * sizeof (holy_uint32_t));
+					    >> 12) * sizeof (holy_uint32_t)
+				   + (sock->their_cur_seq - top_seq));
 	  if (err)
 	    {
 	      holy_netbuff_free (nb_top);
@@ -923,12 +1262,18 @@ holy_net_recv_tcp_packet (struct holy_net_buff *nb,
 	  if ((nb_top->tail - nb_top->data) > 0)
 	    {
 	      holy_net_put_packet (&sock->packs, nb_top);
+	      sock->delayed_acks++;
 	      do_ack = 1;
 	    }
 	  else
 	    holy_netbuff_free (nb_top);
 	}
-      if (do_ack)
+      tcp_sack_trim (sock);
+
+      /* In-order data is acknowledged every second segment; the rest is
+	 sent by holy_net_tcp_flush_acks once the receive queue is empty.  */
+      if (ack_now || (do_ack && (just_closed || sock->delayed_acks
+				 >= TCP_DELAYED_ACK_SEGMENTS)))
 	ack (sock);
       while (sock->packs.first)
 	{
@@ -966,7 +1311,8 @@ holy_net_recv_tcp_packet (struct holy_net_buff *nb,
 	sock->their_start_seq = holy_be_to_cpu32 (tcph->seqnr);
 	sock->their_cur_seq = sock->their_start_seq + 1;
 	sock->my_cur_seq = sock->my_start_seq = holy_get_time_ms ();
-	sock->my_window = 8192;
+	tcp_init_window (sock);
+	tcp_parse_syn_options (sock, tcph);
 
 	sock->pq = holy_priority_queue_new (sizeof (struct holy_net_buff *),
 					    cmp);
@@ -13,6 +13,8 @@
 #include <holy/dl.h>
 #include <holy/file.h>
 #include <holy/priority_queue.h>
+#include <holy/env.h>
+#include <holy/time.h>
 #include <holy/i18n.h>
 
 holy_MOD_LICENSE ("GPLv2+");
@@ -29,6 +31,14 @@ enum
 enum
   {
     TFTP_DEFAULTSIZE_PACKET = 512,
+    /* Block size asked for when the server rejected our first options.  */
+    TFTP_FALLBACK_BLKSIZE = 1024,
+    /* RFC 2348 limit.  */
+    TFTP_MAX_BLKSIZE = 65464,
+    /* RFC 7440 window.  Kept below the 50 packets after which reading
+       stalls, so that a whole window always fits.  */
+    TFTP_DEFAULT_WINDOWSIZE = 16,
+    TFTP_MAX_WINDOWSIZE = 32
   };
 
 enum
@@ -59,7 +69,8 @@ enum
     TFTP_EBADOP = 4,                   /* illegal TFTP operation */
     TFTP_EBADID = 5,                   /* unknown transfer ID */
     TFTP_EEXISTS = 6,                  /* file already exists */
-    TFTP_ENOUSER = 7                  /* no such user */
+    TFTP_ENOUSER = 7,                 /* no such user */
+    TFTP_EOPTNEG = 8                  /* option negotiation failed */
   };
 
 struct tftphdr {
@@ -89,8 +100,15 @@ typedef struct tftp_data
   holy_uint64_t file_size;
   holy_uint64_t block;
   holy_uint32_t block_size;
+  /* Blocks the server sends before waiting for an ACK; 1 without the
+     windowsize option.  */
+  holy_uint32_t window_size;
   holy_uint64_t ack_sent;
+  /* Last block for which a gap was reported, to send one ACK per gap.  */
+  holy_uint64_t gap_acked;
+  holy_uint64_t last_rx;
   int have_oack;
+  int options_refused;
   struct holy_error_saved save_err;
   holy_net_udp_socket_t sock;
   holy_priority_queue_t pq;
@@ -168,7 +186,8 @@ tftp_receive (holy_net_udp_socket_t sock __attribute__ ((unused)),
     {
     case TFTP_OACK:
       data->block_size = TFTP_DEFAULTSIZE_PACKET;
-      data->have_oack = 1; 
+      data->window_size = 1;
+      data->have_oack = 1;
       for (ptr = nb->data + sizeof (tftph->opcode); ptr < nb->tail;)
 	{
 	  if (holy_memcmp (ptr, "tsize\0", sizeof ("tsize\0") - 1) == 0)
@@ -177,10 +196,18 @@ tftp_receive (holy_net_udp_socket_t sock __attribute__ ((unused)),
 	  if (holy_memcmp (ptr, "blksize\0", sizeof ("blksize\0") - 1) == 0)
 	    data->block_size = holy_strtoul ((char *) ptr + sizeof ("blksize\0")
 					     - 1, 0, 0);
+	  if (holy_memcmp (ptr, "windowsize\0", sizeof ("windowsize\0") - 1) == 0)
+	    data->window_size = holy_strtoul ((char *) ptr
+					      + sizeof ("windowsize\0") - 1,
+					      0, 0);
 	  while (ptr < nb->tail && *ptr)
 	    ptr++;
 	  ptr++;
 	}
+      if (data->window_size == 0 || data->window_size > TFTP_MAX_WINDOWSIZE)
+	data->window_size = 1;
+      holy_dprintf ("tftp", "blksize %u windowsize %u\n", data->block_size,
+		    data->window_size);
       data->block = 0;
       holy_netbuff_free (nb);
       err = ack (data, 0);
@@ -194,6 +221,16 @@ tftp_receive (holy_net_udp_socket_t sock __attribute__ ((unused)),
 	  return holy_ERR_NONE;
 	}
 
+      /* A server which does not know about options answers the request
+	 with data right away.  */
+      if (!data->have_oack)
+	{
+	  data->block_size = TFTP_DEFAULTSIZE_PACKET;
+	  data->window_size = 1;
+	  data->have_oack = 1;
+	}
+      data->last_rx = holy_get_time_ms ();
+
       err = holy_priority_queue_push (data->pq, &nb);
       if (err)
 	return err;
@@ -209,10 +246,21 @@ tftp_receive (holy_net_udp_socket_t sock __attribute__ ((unused)),
 	    tftph = (struct tftphdr *) nb_top->data;
 	    if (cmp_block (holy_be_to_cpu16 (tftph->u.data.block), data->block + 1) >= 0)
 	      break;
-	    ack (data, holy_be_to_cpu16 (tftph->u.data.block));
+	    /* Inside a window duplicates are expected after a retransmission
+	       and must not rewind the sender.  */
+	    if (data->window_size == 1)
+	      ack (data, holy_be_to_cpu16 (tftph->u.data.block));
 	    holy_netbuff_free (nb_top);
 	    holy_priority_queue_pop (data->pq);
 	  }
+	/* A block is missing: acknowledge the last one received in order so
+	   that the sender restarts the window from there (RFC 7440).  */
+	if (cmp_block (holy_be_to_cpu16 (tftph->u.data.block), data->block + 1) > 0
+	    && data->window_size > 1 && data->gap_acked != data->block)
+	  {
+	    data->gap_acked = data->block;
+	    return ack (data, data->block);
+	  }
 	while (cmp_block (holy_be_to_cpu16 (tftph->u.data.block), data->block + 1) == 0)
 	  {
 	    unsigned size;
@@ -220,7 +268,13 @@ tftp_receive (holy_net_udp_socket_t sock __attribute__ ((unused)),
 	    holy_priority_queue_pop (data->pq);
 
 	    if (file->device->net->packs.count < 50)
-	      err = ack (data, data->block + 1);
+	      {
+		/* Only the last block of each window is acknowledged.  */
+		if (data->block + 1 >= data->ack_sent + data->window_size)
+		  err = ack (data, data->block + 1);
+		else
+		  err = holy_ERR_NONE;
+	      }
 	    else
 	      {
 		file->device->net->stall = 1;
@@ -259,11 +313,25 @@ tftp_receive (holy_net_udp_socket_t sock __attribute__ ((unused)),
 	      holy_net_put_packet (&file->device->net->packs, nb_top);
 	    else
 	      holy_netbuff_free (nb_top);
+
+	    /* Blocks which arrived early may follow right away.  */
+	    nb_top_p = holy_priority_queue_top (data->pq);
+	    if (!nb_top_p)
+	      break;
+	    nb_top = *nb_top_p;
+	    tftph = (struct tftphdr *) nb_top->data;
 	  }
       }
       return holy_ERR_NONE;
     case TFTP_ERROR:
       data->have_oack = 1;
+      if (holy_be_to_cpu16 (tftph->u.err.errcode) == TFTP_EOPTNEG
+	  && data->block == 0)
+	{
+	  data->options_refused = 1;
+	  holy_netbuff_free (nb);
+	  return holy_ERR_NONE;
+	}
       holy_netbuff_free (nb);
       holy_error (holy_ERR_IO, (char *) tftph->u.err.errmsg);
       holy_error_save (&data->save_err);
@@ -287,38 +355,90 @@ destroy_pq (tftp_data_t data)
   holy_priority_queue_destroy (data->pq);
 }
 
+/* Largest block size which fits in a single frame of the card used to
+   reach ADDR.  */
+static holy_uint32_t
+tftp_mtu_blksize (holy_net_network_level_address_t addr)
+{
+  struct holy_net_network_level_interface *inf;
+  holy_net_network_level_address_t gateway;
+  holy_uint32_t blksize;
+  holy_size_t overhead;
+
+  if (holy_net_route_address (addr, &gateway, &inf) || !inf->card->mtu)
+    {
+      holy_errno = holy_ERR_NONE;
+      return TFTP_FALLBACK_BLKSIZE;
+    }
+
+  overhead = (sizeof (struct udphdr) + sizeof (holy_uint16_t) * 2
+	      + (addr.type == holy_NET_NETWORK_LEVEL_PROTOCOL_IPV6
+		 ? holy_NET_OUR_IPV6_HEADER_SIZE
+		 : holy_NET_OUR_IPV4_HEADER_SIZE));
+  if (inf->card->mtu <= overhead + TFTP_DEFAULTSIZE_PACKET)
+    return TFTP_DEFAULTSIZE_PACKET;
+  blksize = inf->card->mtu - overhead;
+  if (blksize > TFTP_MAX_BLKSIZE)
+    blksize = TFTP_MAX_BLKSIZE;
+  return blksize;
+}
+
+static holy_uint32_t
+tftp_windowsize (void)
+{
+  const char *val;
+  unsigned long windowsize;
+
+  val = holy_env_get ("net_tftp_windowsize");
+  if (!val)
+    return TFTP_DEFAULT_WINDOWSIZE;
+  windowsize = holy_strtoul (val, 0, 0);
+  if (holy_errno)
+    {
+      holy_errno = holy_ERR_NONE;
+      return TFTP_DEFAULT_WINDOWSIZE;
+    }
+  if (windowsize < 1)
+    windowsize = 1;
+  if (windowsize > TFTP_MAX_WINDOWSIZE)
+    windowsize = TFTP_MAX_WINDOWSIZE;
+  return windowsize;
+}
+
+static void
+tftp_put_option (char **rrq, int *rrqlen, const char *name, holy_uint32_t val)
+{
+  char buf[sizeof ("4294967295")];
+
+  holy_strcpy (*rrq, name);
+  *rrqlen += holy_strlen (name) + 1;
+  *rrq += holy_strlen (name) + 1;
+
+  holy_snprintf (buf, sizeof (buf), "%u", val);
+  holy_strcpy (*rrq, buf);
+  *rrqlen += holy_strlen (buf) + 1;
+  *rrq += holy_strlen (buf) + 1;
+}
+
+/* Build a read request for FILENAME in NB.  WINDOWSIZE of 1 leaves the
+   windowsize option out.  */
 static holy_err_t
-tftp_open (struct holy_file *file, const char *filename)
+tftp_build_rrq (struct holy_net_buff *nb, const char *filename,
+		holy_uint32_t blksize, holy_uint32_t windowsize)
 {
   struct tftphdr *tftph;
   char *rrq;
-  int i;
   int rrqlen;
   int hdrlen;
-  holy_uint8_t open_data[1500];
-  struct holy_net_buff nb;
-  tftp_data_t data;
   holy_err_t err;
-  holy_uint8_t *nbd;
-  holy_net_network_level_address_t addr;
-
-  data = holy_zalloc (sizeof (*data));
-  if (!data)
-    return holy_errno;
 
-  nb.head = open_data;
-  nb.end = open_data + sizeof (open_data);
-  holy_netbuff_clear (&nb);
-
-  holy_netbuff_reserve (&nb, 1500);
-  err = holy_netbuff_push (&nb, sizeof (*tftph));
+  holy_netbuff_clear (nb);
+  holy_netbuff_reserve (nb, nb->end - nb->head);
+  err = holy_netbuff_push (nb, sizeof (*tftph));
   if (err)
-    {
-      holy_free (data);
-      return err;
-    }
+    return err;
 
-  tftph = (struct tftphdr *) nb.data;
+  tftph = (struct tftphdr *) nb->data;
 
   rrq = (char *) tftph->u.rrq;
   rrqlen = 0;
@@ -332,29 +452,68 @@ tftp_open (struct holy_file *file, const char *filename)
   rrqlen += holy_strlen ("octet") + 1;
   rrq += holy_strlen ("octet") + 1;
 
-  holy_strcpy (rrq, "blksize");
-  rrqlen += holy_strlen ("blksize") + 1;
-  rrq += holy_strlen ("blksize") + 1;
+  tftp_put_option (&rrq, &rrqlen, "blksize", blksize);
+  tftp_put_option (&rrq, &rrqlen, "tsize", 0);
+  if (windowsize > 1)
+    tftp_put_option (&rrq, &rrqlen, "windowsize", windowsize);
+  hdrlen = sizeof (tftph->opcode) + rrqlen;
 
-  holy_strcpy (rrq, "1024");
-  rrqlen += holy_strlen ("1024") + 1;
-  rrq += holy_strlen ("1024") + 1;
+  return holy_netbuff_unput (nb, nb->tail - (nb->data + hdrlen));
+}
 
-  holy_strcpy (rrq, "tsize");
-  rrqlen += holy_strlen ("tsize") + 1;
-  rrq += holy_strlen ("tsize") + 1;
+/* Send the request in NB until the server answers.  */
+static holy_err_t
+tftp_request (struct holy_file *file, holy_net_network_level_address_t addr,
+	      struct holy_net_buff *nb)
+{
+  tftp_data_t data = file->data;
+  holy_uint8_t *nbd;
+  holy_err_t err;
+  int i;
 
-  holy_strcpy (rrq, "0");
-  rrqlen += holy_strlen ("0") + 1;
-  rrq += holy_strlen ("0") + 1;
-  hdrlen = sizeof (tftph->opcode) + rrqlen;
+  data->sock = holy_net_udp_open (addr,
+				  TFTP_SERVER_PORT, tftp_receive,
+				  file);
+  if (!data->sock)
+    return holy_errno;
 
-  err = holy_netbuff_unput (&nb, nb.tail - (nb.data + hdrlen));
-  if (err)
+  /* Receive OACK packet.  */
+  nbd = nb->data;
+  for (i = 0; i < holy_NET_TRIES; i++)
     {
-      holy_free (data);
-      return err;
+      nb->data = nbd;
+      err = holy_net_send_udp_packet (data->sock, nb);
+      if (err)
+	return err;
+      holy_net_poll_cards (holy_NET_INTERVAL + (i * holy_NET_INTERVAL_ADDITION),
+                           &data->have_oack);
+      if (data->have_oack)
+	break;
     }
+  return holy_ERR_NONE;
+}
+
+static holy_err_t
+tftp_open (struct holy_file *file, const char *filename)
+{
+  holy_uint8_t open_data[1500];
+  struct holy_net_buff nb;
+  tftp_data_t data;
+  holy_err_t err;
+  holy_net_network_level_address_t addr;
+  holy_uint32_t windowsize;
+
+  if (holy_strlen (filename) + sizeof ("octet") + sizeof ("windowsize")
+      + sizeof ("blksize") + sizeof ("tsize") + 3 * sizeof ("4294967295")
+      > TFTP_DEFAULTSIZE_PACKET)
+    return holy_error (holy_ERR_BAD_FILENAME, N_("filename is too long"));
+
+  data = holy_zalloc (sizeof (*data));
+  if (!data)
+    return holy_errno;
+
+  nb.head = open_data;
+  nb.end = open_data + sizeof (open_data);
 
   file->not_easily_seekable = 1;
   file->data = data;
@@ -374,47 +533,46 @@ tftp_open (struct holy_file *file, const char *filename)
       return err;
     }
 
-  data->sock = holy_net_udp_open (addr,
-				  TFTP_SERVER_PORT, tftp_receive,
-				  file);
-  if (!data->sock)
+  data->block_size = TFTP_DEFAULTSIZE_PACKET;
+  data->window_size = 1;
+  data->gap_acked = (holy_uint64_t) -1;
+  windowsize = tftp_windowsize ();
+  err = tftp_build_rrq (&nb, filename, tftp_mtu_blksize (addr), windowsize);
+  if (!err)
+    err = tftp_request (file, addr, &nb);
+
+  /* Some servers refuse the whole request when they dislike an option;
+     retry once with the options older versions of this code sent.  */
+  if (!err && data->options_refused)
     {
-      destroy_pq (data);
-      holy_free (data);
-      return holy_errno;
-    }
-
-  /* Receive OACK packet.  */
-  nbd = nb.data;
-  for (i = 0; i < holy_NET_TRIES; i++)
-    {
-      nb.data = nbd;
-      err = holy_net_send_udp_packet (data->sock, &nb);
-      if (err)
-	{
-	  holy_net_udp_close (data->sock);
-	  destroy_pq (data);
-	  holy_free (data);
-	  return err;
-	}
-      holy_net_poll_cards (holy_NET_INTERVAL + (i * holy_NET_INTERVAL_ADDITION),
-                           &data->have_oack);
-      if (data->have_oack)
-	break;
+      holy_dprintf ("tftp", "options refused, retrying\n");
+      holy_net_udp_close (data->sock);
+      data->sock = NULL;
+      data->have_oack = 0;
+      data->options_refused = 0;
+      err = tftp_build_rrq (&nb, filename, TFTP_FALLBACK_BLKSIZE, 1);
+      if (!err)
+	err = tftp_request (file, addr, &nb);
+      if (!err && data->options_refused)
+	err = holy_error (holy_ERR_IO, N_("TFTP option negotiation failed"));
     }
 
-  if (!data->have_oack)
+  if (err)
+    ;
+  else if (!data->have_oack)
     holy_error (holy_ERR_TIMEOUT, N_("time out opening `%s'"), filename);
   else
     holy_error_load (&data->save_err);
   if (holy_errno)
     {
-      holy_net_udp_close (data->sock);
+      if (data->sock)
+	holy_net_udp_close (data->sock);
       destroy_pq (data);
       holy_free (data);
       return holy_errno;
     }
 
+  data->last_rx = holy_get_time_ms ();
   file->size = data->file_size;
 
   return holy_ERR_NONE;
@@ -469,6 +627,12 @@ tftp_packets_pulled (struct holy_file *file)
     file->device->net->stall = 0;
   if (data->ack_sent >= data->block)
     return 0;
+  /* Send the window ACK held back while stalled, or, when the sender has
+     gone quiet, tell it where to resume.  */
+  if (data->window_size > 1
+      && data->block < data->ack_sent + data->window_size
+      && holy_get_time_ms () - data->last_rx < holy_NET_INTERVAL)
+    return 0;
   return ack (data, data->block);
 }
 
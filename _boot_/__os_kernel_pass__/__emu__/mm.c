@@ -49,3 +49,11 @@ holy_realloc (void *ptr, holy_size_t size)
     holy_error (holy_ERR_OUT_OF_MEMORY, N_("out of memory"));
   return ret;
 }
+
+/* The host has no heap limit we could know about.  */
+void
+holy_mm_get_free (holy_size_t *total, holy_size_t *largest)
+{
+  *total = ~(holy_size_t) 0;
+  *largest = ~(holy_size_t) 0;
+}
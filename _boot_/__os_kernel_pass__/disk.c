@@ -12,13 +12,36 @@
 #include <holy/time.h>
 #include <holy/file.h>
 #include <holy/i18n.h>
+#include <holy/list.h>
+#if !defined (holy_UTIL) && !defined (holy_MACHINE_EMU)
+#include <holy/mm_private.h>
+#endif
 
 #define	holy_CACHE_TIMEOUT	2
 
 /* The last time the disk was used.  */
 static holy_uint64_t holy_last_time = 0;
 
-struct holy_disk_cache holy_disk_cache_table[holy_DISK_CACHE_NUM];
+struct holy_disk_cache *holy_disk_cache_table;
+unsigned holy_disk_cache_sets;
+
+/* Backing store for all cache blocks, allocated once together with the
+   table so that a miss never has to call the allocator.  */
+static char *holy_disk_cache_slab;
+
+/* Set when the slab could not be allocated, so that we don't retry on
+   every miss until memory is released again.  */
+static int holy_disk_cache_disabled;
+
+/* Logical clock for the LRU replacement.  */
+static holy_uint64_t holy_disk_cache_clock;
+
+/* Bounce buffer for read-ahead requests, holy_DISK_READAHEAD_MAX cache
+   blocks large.  BUSY is set while a driver is reading into it.  */
+static char *holy_disk_ra_buf;
+static int holy_disk_ra_busy;
+
+static struct holy_disk_cache_hook *holy_disk_cache_hooks;
 
 void (*holy_disk_firmware_fini) (void);
 int holy_disk_firmware_is_tainted;
@@ -42,21 +65,149 @@ holy_err_t (*holy_disk_write_weak) (holy_disk_t disk,
 				    const void *buf);
 #include "disk_common.c"
 
-void
-holy_disk_cache_invalidate_all (void)
+/* Drop all unlocked entries, and everything the hooks built from what
+   was read, but keep the memory around.  Return non-zero if some entry is
+   still locked.  */
+static int
+holy_disk_cache_invalidate_entries (void)
 {
+  struct holy_disk_cache_hook *hook;
   unsigned i;
+  int locked = 0;
+
+  FOR_LIST_ELEMENTS (hook, holy_disk_cache_hooks)
+    hook->invalidate ();
+
+  if (! holy_disk_cache_table)
+    return 0;
 
-  for (i = 0; i < holy_DISK_CACHE_NUM; i++)
+  for (i = 0; i < holy_disk_cache_sets * holy_DISK_CACHE_WAYS; i++)
     {
       struct holy_disk_cache *cache = holy_disk_cache_table + i;
 
-      if (cache->data && ! cache->lock)
+      if (cache->lock)
 	{
-	  holy_free (cache->data);
-	  cache->data = 0;
+	  locked = 1;
+	  continue;
 	}
+      cache->valid = 0;
+      cache->stamp = 0;
+    }
+
+  return locked;
+}
+
+void
+holy_disk_cache_register_hook (struct holy_disk_cache_hook *hook)
+{
+  holy_list_push (holy_AS_LIST_P (&holy_disk_cache_hooks),
+		  holy_AS_LIST (hook));
+}
+
+void
+holy_disk_cache_unregister_hook (struct holy_disk_cache_hook *hook)
+{
+  holy_list_remove (holy_AS_LIST (hook));
+}
+
+void
+holy_disk_cache_invalidate_all (void)
+{
+  holy_disk_cache_disabled = 0;
+
+  /* This is called from the memory manager when it runs short, so give
+     the whole slab back unless somebody is copying out of it.  */
+  if (! holy_disk_ra_busy)
+    {
+      holy_free (holy_disk_ra_buf);
+      holy_disk_ra_buf = 0;
+    }
+
+  if (holy_disk_cache_invalidate_entries ())
+    return;
+
+  holy_free (holy_disk_cache_slab);
+  holy_free (holy_disk_cache_table);
+  holy_disk_cache_slab = 0;
+  holy_disk_cache_table = 0;
+  holy_disk_cache_sets = 0;
+}
+
+/* Return the size of the heap the cache is sized against.  */
+static holy_size_t
+holy_disk_cache_heap_size (void)
+{
+#if defined (holy_UTIL) || defined (holy_MACHINE_EMU)
+  /* The host allocator has no fixed heap, use the upper bound.  */
+  return ((holy_size_t) holy_DISK_CACHE_MAX_BLOCKS
+	  << (holy_DISK_CACHE_BITS + holy_DISK_SECTOR_BITS + 3));
+#else
+  holy_mm_region_t r;
+  holy_size_t total = 0;
+
+  for (r = holy_mm_base; r; r = r->next)
+    total += r->size;
+  return total;
+#endif
+}
+
+/* Allocate the cache table and its slab, using about an eighth of the
+   heap.  Fall back to smaller sizes if memory is tight.  */
+static int
+holy_disk_cache_init (void)
+{
+  struct holy_disk_cache *table = 0;
+  char *slab = 0;
+  holy_size_t blocks, sets;
+  unsigned i;
+
+  if (holy_disk_cache_disabled)
+    return 0;
+
+  blocks = (holy_disk_cache_heap_size ()
+	    >> (holy_DISK_CACHE_BITS + holy_DISK_SECTOR_BITS + 3));
+  if (blocks > holy_DISK_CACHE_MAX_BLOCKS)
+    blocks = holy_DISK_CACHE_MAX_BLOCKS;
+  if (blocks < holy_DISK_CACHE_MIN_BLOCKS)
+    blocks = holy_DISK_CACHE_MIN_BLOCKS;
+
+  for (sets = blocks / holy_DISK_CACHE_WAYS;
+       sets >= holy_DISK_CACHE_MIN_BLOCKS / holy_DISK_CACHE_WAYS;
+       sets >>= 1)
+    {
+      blocks = sets * holy_DISK_CACHE_WAYS;
+      table = holy_zalloc (blocks * sizeof (*table));
+      if (! table)
+	continue;
+      slab = holy_malloc (blocks << (holy_DISK_CACHE_BITS
+				     + holy_DISK_SECTOR_BITS));
+      if (slab)
+	break;
+      holy_free (table);
+      table = 0;
+    }
+
+  /* The cache is only an optimization, don't report allocation
+     failures to the caller.  */
+  holy_errno = holy_ERR_NONE;
+
+  if (! slab)
+    {
+      holy_disk_cache_disabled = 1;
+      return 0;
     }
+
+  for (i = 0; i < blocks; i++)
+    table[i].data = slab + (i << (holy_DISK_CACHE_BITS
+				  + holy_DISK_SECTOR_BITS));
+
+  holy_disk_cache_table = table;
+  holy_disk_cache_slab = slab;
+  holy_disk_cache_sets = sets;
+
+  holy_dprintf ("disk", "disk cache: %u sets of %u blocks\n",
+		holy_disk_cache_sets, holy_DISK_CACHE_WAYS);
+  return 1;
 }
 
 static char *
@@ -64,15 +215,12 @@ holy_disk_cache_fetch (unsigned long dev_id, unsigned long disk_id,
 		       holy_disk_addr_t sector)
 {
   struct holy_disk_cache *cache;
-  unsigned cache_index;
-
-  cache_index = holy_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = holy_disk_cache_table + cache_index;
 
-  if (cache->dev_id == dev_id && cache->disk_id == disk_id
-      && cache->sector == sector)
+  cache = holy_disk_cache_lookup (dev_id, disk_id, sector);
+  if (cache)
     {
       cache->lock = 1;
+      cache->stamp = ++holy_disk_cache_clock;
 #if DISK_CACHE_STATS
       holy_disk_cache_hits++;
 #endif
@@ -91,45 +239,69 @@ holy_disk_cache_unlock (unsigned long dev_id, unsigned long disk_id,
 			holy_disk_addr_t sector)
 {
   struct holy_disk_cache *cache;
-  unsigned cache_index;
 
-  cache_index = holy_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = holy_disk_cache_table + cache_index;
-
-  if (cache->dev_id == dev_id && cache->disk_id == disk_id
-      && cache->sector == sector)
+  cache = holy_disk_cache_lookup (dev_id, disk_id, sector);
+  if (cache)
     cache->lock = 0;
 }
 
-static holy_err_t
-holy_disk_cache_store (unsigned long dev_id, unsigned long disk_id,
-		       holy_disk_addr_t sector, const char *data)
+/* Return the entry SECTOR should be stored in: the entry already holding
+   it, or else the least recently used unlocked way of its set.  Invalid
+   entries have a zero stamp and are therefore picked first.  */
+static struct holy_disk_cache *
+holy_disk_cache_get_victim (unsigned long dev_id, unsigned long disk_id,
+			    holy_disk_addr_t sector)
 {
-  unsigned cache_index;
-  struct holy_disk_cache *cache;
+  struct holy_disk_cache *cache, *victim = 0;
+  unsigned i;
 
-  cache_index = holy_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = holy_disk_cache_table + cache_index;
+  if (! holy_disk_cache_table && ! holy_disk_cache_init ())
+    return 0;
 
-  cache->lock = 1;
-  holy_free (cache->data);
-  cache->data = 0;
-  cache->lock = 0;
+  cache = holy_disk_cache_get_set (dev_id, disk_id, sector);
+  for (i = 0; i < holy_DISK_CACHE_WAYS; i++, cache++)
+    {
+      if (cache->lock)
+	continue;
+      if (cache->valid && cache->sector == sector
+	  && cache->dev_id == dev_id && cache->disk_id == disk_id)
+	return cache;
+      if (! victim || cache->stamp < victim->stamp)
+	victim = cache;
+    }
 
-  cache->data = holy_malloc (holy_DISK_SECTOR_SIZE << holy_DISK_CACHE_BITS);
-  if (! cache->data)
-    return holy_errno;
+  return victim;
+}
 
-  holy_memcpy (cache->data, data,
-	       holy_DISK_SECTOR_SIZE << holy_DISK_CACHE_BITS);
+static void
+holy_disk_cache_commit (struct holy_disk_cache *cache,
+			unsigned long dev_id, unsigned long disk_id,
+			holy_disk_addr_t sector)
+{
   cache->dev_id = dev_id;
   cache->disk_id = disk_id;
   cache->sector = sector;
+  cache->valid = 1;
+  cache->lock = 0;
+  cache->stamp = ++holy_disk_cache_clock;
+}
 
-  return holy_ERR_NONE;
+static void
+holy_disk_cache_store (unsigned long dev_id, unsigned long disk_id,
+		       holy_disk_addr_t sector, const char *data)
+{
+  struct holy_disk_cache *cache;
+
+  cache = holy_disk_cache_get_victim (dev_id, disk_id, sector);
+  if (! cache)
+    return;
+
+  holy_memcpy (cache->data, data,
+	       holy_DISK_SECTOR_SIZE << holy_DISK_CACHE_BITS);
+  holy_disk_cache_commit (cache, dev_id, disk_id, sector);
 }
 
-
+
 
 holy_disk_dev_t holy_disk_dev_list;
 
@@ -253,7 +425,7 @@ holy_disk_open (const char *name)
 
   if (current_time > (holy_last_time
 		      + holy_CACHE_TIMEOUT * 1000))
-    holy_disk_cache_invalidate_all ();
+    holy_disk_cache_invalidate_entries ();
 
   holy_last_time = current_time;
 
@@ -297,6 +469,102 @@ holy_disk_close (holy_disk_t disk)
   holy_free (disk);
 }
 
+/* Update the sequential access detector of DISK for a read of SIZE bytes
+   at SECTOR, OFFSET.  A read is sequential if it starts within the cache
+   block the previous one ended in.  */
+static void
+holy_disk_readahead_track (holy_disk_t disk, holy_disk_addr_t sector,
+			   holy_off_t offset, holy_size_t size)
+{
+  if (disk->ra_next && sector <= disk->ra_next
+      && sector + holy_DISK_CACHE_SIZE >= disk->ra_next)
+    {
+      if (! disk->ra_window)
+	disk->ra_window = 1;
+    }
+  else
+    disk->ra_window = 0;
+
+  disk->ra_next = sector + ((offset + size + holy_DISK_SECTOR_SIZE - 1)
+			    >> holy_DISK_SECTOR_BITS);
+}
+
+/* Read the cache block at SECTOR together with the following uncached
+   blocks of the read-ahead window in one request, put them all into the
+   cache and copy SIZE bytes at OFFSET of the first one to BUF.  Return
+   zero if nothing was read, the caller does a plain read then.  */
+static int
+holy_disk_readahead (holy_disk_t disk, holy_disk_addr_t sector,
+		     holy_off_t offset, holy_size_t size, void *buf)
+{
+  holy_disk_addr_t total;
+  unsigned n, i;
+  holy_err_t err;
+
+  /* Grow the window on every miss of a sequential stream.  */
+  disk->ra_window <<= 1;
+  if (disk->ra_window > holy_DISK_READAHEAD_MAX)
+    disk->ra_window = holy_DISK_READAHEAD_MAX;
+  n = disk->ra_window;
+  if (n > disk->max_agglomerate)
+    n = disk->max_agglomerate;
+
+  if (disk->total_sectors != holy_DISK_SIZE_UNKNOWN)
+    {
+      total = disk->total_sectors << (disk->log_sector_size
+				      - holy_DISK_SECTOR_BITS);
+      while (n && sector + ((holy_disk_addr_t) n << holy_DISK_CACHE_BITS)
+	     >= total)
+	n--;
+    }
+
+  /* Merge only adjacent misses, stop at the first cached block.  */
+  for (i = 1; i < n; i++)
+    if (holy_disk_cache_lookup (disk->dev->id, disk->id,
+				sector + (i << holy_DISK_CACHE_BITS)))
+      break;
+  n = i;
+
+  if (n < 2 || holy_disk_ra_busy)
+    return 0;
+
+  if (! holy_disk_ra_buf)
+    {
+      holy_disk_ra_buf = holy_malloc (holy_DISK_READAHEAD_MAX
+				      << (holy_DISK_CACHE_BITS
+					  + holy_DISK_SECTOR_BITS));
+      if (! holy_disk_ra_buf)
+	{
+	  holy_errno = holy_ERR_NONE;
+	  return 0;
+	}
+    }
+
+  holy_dprintf ("disk", "%s: read-ahead of %u blocks at 0x%llx\n",
+		disk->name, n, (unsigned long long) sector);
+
+  holy_disk_ra_busy = 1;
+  err = (disk->dev->read) (disk, transform_sector (disk, sector),
+			   n << (holy_DISK_CACHE_BITS + holy_DISK_SECTOR_BITS
+				 - disk->log_sector_size), holy_disk_ra_buf);
+  holy_disk_ra_busy = 0;
+  if (err)
+    {
+      holy_errno = holy_ERR_NONE;
+      return 0;
+    }
+
+  holy_memcpy (buf, holy_disk_ra_buf + offset, size);
+  for (i = 0; i < n; i++)
+    holy_disk_cache_store (disk->dev->id, disk->id,
+			   sector + (i << holy_DISK_CACHE_BITS),
+			   holy_disk_ra_buf
+			   + (i << (holy_DISK_CACHE_BITS
+				    + holy_DISK_SECTOR_BITS)));
+
+  return 1;
+}
+
 /* Small read (less than cache size and not pass across cache unit boundaries).
    sector is already adjusted and is divisible by cache unit size.
  */
@@ -306,6 +574,7 @@ holy_disk_read_small_real (holy_disk_t disk, holy_disk_addr_t sector,
 {
   char *data;
   char *tmp_buf;
+  struct holy_disk_cache *cache;
 
   /* Fetch the cache.  */
   data = holy_disk_cache_fetch (disk->dev->id, disk->id, sector);
@@ -317,10 +586,10 @@ holy_disk_read_small_real (holy_disk_t disk, holy_disk_addr_t sector,
       return holy_ERR_NONE;
     }
 
-  /* Allocate a temporary buffer.  */
-  tmp_buf = holy_malloc (holy_DISK_SECTOR_SIZE << holy_DISK_CACHE_BITS);
-  if (! tmp_buf)
-    return holy_errno;
+  /* Streams get the following blocks in the same request.  */
+  if (disk->ra_window
+      && holy_disk_readahead (disk, sector, offset, size, buf))
+    return holy_ERR_NONE;
 
   /* Otherwise read data from the disk actually.  */
   if (disk->total_sectors == holy_DISK_SIZE_UNKNOWN
@@ -328,22 +597,44 @@ holy_disk_read_small_real (holy_disk_t disk, holy_disk_addr_t sector,
       < (disk->total_sectors << (disk->log_sector_size - holy_DISK_SECTOR_BITS)))
     {
       holy_err_t err;
+
+      /* Read straight into the cache block we are about to replace, and
+	 only fall back to a temporary buffer if there is none.  */
+      cache = holy_disk_cache_get_victim (disk->dev->id, disk->id, sector);
+      if (cache)
+	{
+	  cache->lock = 1;
+	  cache->valid = 0;
+	  tmp_buf = cache->data;
+	}
+      else
+	{
+	  tmp_buf = holy_malloc (holy_DISK_SECTOR_SIZE << holy_DISK_CACHE_BITS);
+	  if (! tmp_buf)
+	    return holy_errno;
+	}
+
       err = (disk->dev->read) (disk, transform_sector (disk, sector),
 			       1U << (holy_DISK_CACHE_BITS
 				      + holy_DISK_SECTOR_BITS
 				      - disk->log_sector_size), tmp_buf);
       if (!err)
+	holy_memcpy (buf, tmp_buf + offset, size);
+
+      if (cache && !err)
+	holy_disk_cache_commit (cache, disk->dev->id, disk->id, sector);
+      else if (cache)
 	{
-	  /* Copy it and store it in the disk cache.  */
-	  holy_memcpy (buf, tmp_buf + offset, size);
-	  holy_disk_cache_store (disk->dev->id, disk->id,
-				 sector, tmp_buf);
-	  holy_free (tmp_buf);
-	  return holy_ERR_NONE;
+	  cache->lock = 0;
+	  cache->stamp = 0;
 	}
+      else
+	holy_free (tmp_buf);
+
+      if (!err)
+	return holy_ERR_NONE;
     }
 
-  holy_free (tmp_buf);
   holy_errno = holy_ERR_NONE;
 
   {
@@ -410,6 +701,8 @@ holy_disk_read (holy_disk_t disk, holy_disk_addr_t sector,
       return holy_errno;
     }
 
+  holy_disk_readahead_track (disk, sector, offset, size);
+
   /* First read until first cache boundary.   */
   if (offset || (sector & (holy_DISK_CACHE_SIZE - 1)))
     {
@@ -519,6 +812,102 @@ holy_disk_read (holy_disk_t disk, holy_disk_addr_t sector,
   return holy_errno;
 }
 
+/* Whether a read of SIZE bytes at SECTOR, OFFSET of DISK, already
+   adjusted, goes to the queued interface.  It has to cover whole native
+   sectors, and small reads are better served by the cache.  */
+static int
+holy_disk_read_queueable (holy_disk_t disk, holy_disk_addr_t sector,
+			  holy_off_t offset, holy_size_t size)
+{
+  return (disk->dev->read_submit && disk->dev->read_wait && ! offset
+	  && ! (sector & ((1 << (disk->log_sector_size
+				 - holy_DISK_SECTOR_BITS)) - 1))
+	  && ! (size & ((1 << disk->log_sector_size) - 1))
+	  && size >= (holy_DISK_CACHE_SIZE << holy_DISK_SECTOR_BITS));
+}
+
+holy_err_t
+holy_disk_read_batch (struct holy_disk_read_req *reqs, unsigned nreqs)
+{
+  holy_err_t err = holy_ERR_NONE;
+  holy_disk_addr_t sector;
+  holy_off_t offset;
+  unsigned i, j, submitted;
+
+  /* Start everything that can be queued.  */
+  for (submitted = 0; submitted < nreqs; submitted++)
+    {
+      holy_disk_t disk = reqs[submitted].disk;
+
+      sector = reqs[submitted].sector;
+      offset = 0;
+      if (holy_disk_adjust_range (disk, &sector, &offset,
+				  reqs[submitted].size) != holy_ERR_NONE)
+	{
+	  err = holy_errno;
+	  break;
+	}
+      if (! holy_disk_read_queueable (disk, sector, offset,
+				      reqs[submitted].size))
+	continue;
+      err = (disk->dev->read_submit) (disk, transform_sector (disk, sector),
+				      reqs[submitted].size
+				      >> disk->log_sector_size,
+				      reqs[submitted].buf);
+      if (err)
+	break;
+    }
+
+  /* The rest is done while the queued reads are in flight.  */
+  for (i = 0; i < nreqs && ! err; i++)
+    {
+      sector = reqs[i].sector;
+      offset = 0;
+      if (holy_disk_adjust_range (reqs[i].disk, &sector, &offset,
+				  reqs[i].size) == holy_ERR_NONE
+	  && holy_disk_read_queueable (reqs[i].disk, sector, offset,
+				       reqs[i].size))
+	continue;
+      err = holy_disk_read (reqs[i].disk, reqs[i].sector, 0, reqs[i].size,
+			    reqs[i].buf);
+    }
+
+  /* Whatever happened, nothing may be left writing into the buffers.  */
+  for (i = 0; i < submitted; i++)
+    {
+      holy_disk_t disk = reqs[i].disk;
+      holy_err_t werr;
+
+      if (! disk->dev->read_wait)
+	continue;
+      for (j = 0; j < i; j++)
+	if (reqs[j].disk == disk)
+	  break;
+      if (j < i)
+	continue;
+      werr = (disk->dev->read_wait) (disk);
+      if (werr && ! err)
+	err = werr;
+    }
+  if (err)
+    return err;
+
+  for (i = 0; i < nreqs; i++)
+    {
+      holy_disk_t disk = reqs[i].disk;
+
+      if (! disk->read_hook)
+	continue;
+      sector = reqs[i].sector;
+      offset = 0;
+      holy_disk_adjust_range (disk, &sector, &offset, reqs[i].size);
+      if (holy_disk_read_queueable (disk, sector, offset, reqs[i].size))
+	(disk->read_hook) (sector, 0, reqs[i].size, disk->read_hook_data);
+    }
+
+  return holy_ERR_NONE;
+}
+
 holy_uint64_t
 holy_disk_get_size (holy_disk_t disk)
 {
@@ -56,11 +56,36 @@ transform_sector (holy_disk_t disk, holy_disk_addr_t sector)
   return sector >> (disk->log_sector_size - holy_DISK_SECTOR_BITS);
 }
 
-static unsigned
-holy_disk_cache_get_index (unsigned long dev_id, unsigned long disk_id,
-			   holy_disk_addr_t sector)
+/* Return the first entry of the cache set SECTOR maps to.  The cache
+   table must be allocated.  */
+static struct holy_disk_cache *
+holy_disk_cache_get_set (unsigned long dev_id, unsigned long disk_id,
+			 holy_disk_addr_t sector)
 {
-  return ((dev_id * 524287UL + disk_id * 2606459UL
-	   + ((unsigned) (sector >> holy_DISK_CACHE_BITS)))
-	  % holy_DISK_CACHE_NUM);
+  unsigned index;
+
+  index = ((dev_id * 524287UL + disk_id * 2606459UL
+	    + ((unsigned) (sector >> holy_DISK_CACHE_BITS)))
+	   % holy_disk_cache_sets);
+  return holy_disk_cache_table + index * holy_DISK_CACHE_WAYS;
+}
+
+/* Find the valid cache entry holding SECTOR, if any.  */
+static struct holy_disk_cache *
+holy_disk_cache_lookup (unsigned long dev_id, unsigned long disk_id,
+			holy_disk_addr_t sector)
+{
+  struct holy_disk_cache *cache;
+  unsigned i;
+
+  if (! holy_disk_cache_table)
+    return 0;
+
+  cache = holy_disk_cache_get_set (dev_id, disk_id, sector);
+  for (i = 0; i < holy_DISK_CACHE_WAYS; i++, cache++)
+    if (cache->valid && cache->sector == sector
+	&& cache->dev_id == dev_id && cache->disk_id == disk_id)
+      return cache;
+
+  return 0;
 }
@@ -13,11 +13,228 @@
 #include <holy/mm.h>
 #include <holy/term.h>
 #include <holy/i18n.h>
+#include <holy/partition.h>
+#include <holy/time.h>
 
 holy_fs_t holy_fs_list = 0;
 
 holy_fs_autoload_hook_t holy_fs_autoload_hook = 0;
 
+struct holy_fs_cache_stats holy_fs_cache_stats;
+
+/* Filesystems found on the last few devices probed.  */
+#define holy_FS_PROBE_CACHE_SIZE	8
+
+static struct
+{
+  unsigned long dev_id;
+  unsigned long disk_id;
+  holy_disk_addr_t part_start;
+  holy_fs_t fs;
+} holy_fs_probe_cache[holy_FS_PROBE_CACHE_SIZE];
+static unsigned holy_fs_probe_cache_next;
+
+/* Mounts made with holy_fs_mount, in use or kept for the next user,
+   most recently used first.  */
+#define holy_FS_MOUNT_CACHE_IDLE	8
+
+struct holy_fs_mount_entry
+{
+  struct holy_fs_mount_entry *next;
+  unsigned long dev_id;
+  unsigned long disk_id;
+  holy_disk_addr_t part_start;
+  holy_fs_t fs;
+  void *data;
+  int busy;
+};
+
+static struct holy_fs_mount_entry *holy_fs_mounts;
+
+static int
+holy_fs_same_disk (unsigned long dev_id, unsigned long disk_id,
+		   holy_disk_addr_t part_start, holy_disk_t disk)
+{
+  return (dev_id == disk->dev->id && disk_id == disk->id
+	  && part_start == holy_partition_get_start (disk->partition));
+}
+
+/* Called whenever the disk cache is dropped, on its timeout as well as
+   when memory runs short, so it must not allocate.  Mounts in use lose
+   their entry and are unmounted when released.  */
+static void
+holy_fs_cache_flush (void)
+{
+  while (holy_fs_mounts)
+    {
+      struct holy_fs_mount_entry *e = holy_fs_mounts;
+
+      holy_fs_mounts = e->next;
+      if (! e->busy)
+	e->fs->unmount (e->data);
+      holy_free (e);
+    }
+  holy_memset (holy_fs_probe_cache, 0, sizeof (holy_fs_probe_cache));
+}
+
+static struct holy_disk_cache_hook holy_fs_cache_hook =
+  {
+    .invalidate = holy_fs_cache_flush
+  };
+
+static void
+holy_fs_cache_hook_register (void)
+{
+  static int registered;
+
+  if (registered)
+    return;
+  holy_disk_cache_register_hook (&holy_fs_cache_hook);
+  registered = 1;
+}
+
+void
+holy_fs_cache_forget (holy_fs_t fs)
+{
+  struct holy_fs_mount_entry **p, *e;
+  unsigned i;
+
+  for (p = &holy_fs_mounts; *p; )
+    {
+      e = *p;
+      if (e->fs != fs)
+	{
+	  p = &e->next;
+	  continue;
+	}
+      *p = e->next;
+      if (! e->busy)
+	fs->unmount (e->data);
+      holy_free (e);
+    }
+
+  for (i = 0; i < holy_FS_PROBE_CACHE_SIZE; i++)
+    if (holy_fs_probe_cache[i].fs == fs)
+      holy_fs_probe_cache[i].fs = 0;
+}
+
+/* Unmount whatever is kept beyond holy_FS_MOUNT_CACHE_IDLE mounts.  */
+static void
+holy_fs_mount_trim (void)
+{
+  struct holy_fs_mount_entry **p, *e;
+  unsigned idle = 0;
+
+  for (p = &holy_fs_mounts; *p; )
+    {
+      e = *p;
+      if (e->busy || ++idle <= holy_FS_MOUNT_CACHE_IDLE)
+	{
+	  p = &e->next;
+	  continue;
+	}
+      *p = e->next;
+      e->fs->unmount (e->data);
+      holy_free (e);
+    }
+}
+
+/* Drop the entry of DATA, if it still has one.  */
+static void
+holy_fs_mount_forget (void *data)
+{
+  struct holy_fs_mount_entry **p, *e;
+
+  for (p = &holy_fs_mounts; *p; p = &(*p)->next)
+    if ((*p)->data == data)
+      {
+	e = *p;
+	*p = e->next;
+	holy_free (e);
+	return;
+      }
+}
+
+void *
+holy_fs_mount (holy_fs_t fs, holy_device_t device)
+{
+  struct holy_fs_mount_entry *e;
+  holy_uint64_t start;
+  void *data;
+
+  if (! device->disk)
+    return fs->mount (device);
+
+  holy_fs_cache_hook_register ();
+
+  for (e = holy_fs_mounts; e; e = e->next)
+    if (! e->busy && e->fs == fs
+	&& holy_fs_same_disk (e->dev_id, e->disk_id, e->part_start,
+			      device->disk))
+      {
+	/* REMOUNT may allocate and so flush the cache, so E must not be
+	   used after it.  */
+	e->busy = 1;
+	data = e->data;
+	if (fs->remount (data, device) == holy_ERR_NONE)
+	  {
+	    holy_fs_cache_stats.mount_hits++;
+	    return data;
+	  }
+	holy_errno = holy_ERR_NONE;
+	holy_fs_mount_forget (data);
+	fs->unmount (data);
+	break;
+      }
+
+  start = holy_get_time_ms ();
+  data = fs->mount (device);
+  holy_fs_cache_stats.mounts++;
+  holy_fs_cache_stats.mount_ms += holy_get_time_ms () - start;
+  if (! data)
+    return 0;
+
+  e = holy_malloc (sizeof (*e));
+  if (! e)
+    {
+      /* It is unmounted for good when released.  */
+      holy_errno = holy_ERR_NONE;
+      return data;
+    }
+  e->dev_id = device->disk->dev->id;
+  e->disk_id = device->disk->id;
+  e->part_start = holy_partition_get_start (device->disk->partition);
+  e->fs = fs;
+  e->data = data;
+  e->busy = 1;
+  e->next = holy_fs_mounts;
+  holy_fs_mounts = e;
+  return data;
+}
+
+void
+holy_fs_unmount (holy_fs_t fs, void *data)
+{
+  struct holy_fs_mount_entry **p, *e;
+
+  if (! data)
+    return;
+
+  for (p = &holy_fs_mounts; *p; p = &(*p)->next)
+    if ((*p)->data == data)
+      {
+	e = *p;
+	*p = e->next;
+	e->busy = 0;
+	e->next = holy_fs_mounts;
+	holy_fs_mounts = e;
+	holy_fs_mount_trim ();
+	return;
+      }
+
+  fs->unmount (data);
+}
+
 /* Helper for holy_fs_probe.  */
 static int
 probe_dummy_iter (const char *filename __attribute__ ((unused)),
@@ -27,8 +244,8 @@ probe_dummy_iter (const char *filename __attribute__ ((unused)),
   return 1;
 }
 
-holy_fs_t
-holy_fs_probe (holy_device_t device)
+static holy_fs_t
+holy_fs_probe_real (holy_device_t device)
 {
   holy_fs_t p;
 
@@ -107,6 +324,45 @@ holy_fs_probe (holy_device_t device)
   return 0;
 }
 
+holy_fs_t
+holy_fs_probe (holy_device_t device)
+{
+  holy_disk_t disk = device->disk;
+  holy_uint64_t start;
+  holy_fs_t fs;
+  unsigned i;
+
+  if (! disk)
+    return holy_fs_probe_real (device);
+
+  holy_fs_cache_hook_register ();
+
+  for (i = 0; i < holy_FS_PROBE_CACHE_SIZE; i++)
+    if (holy_fs_probe_cache[i].fs
+	&& holy_fs_same_disk (holy_fs_probe_cache[i].dev_id,
+			      holy_fs_probe_cache[i].disk_id,
+			      holy_fs_probe_cache[i].part_start, disk))
+      {
+	holy_fs_cache_stats.probe_hits++;
+	return holy_fs_probe_cache[i].fs;
+      }
+
+  start = holy_get_time_ms ();
+  fs = holy_fs_probe_real (device);
+  holy_fs_cache_stats.probes++;
+  holy_fs_cache_stats.probe_ms += holy_get_time_ms () - start;
+  if (! fs)
+    return 0;
+
+  i = holy_fs_probe_cache_next++ % holy_FS_PROBE_CACHE_SIZE;
+  holy_fs_probe_cache[i].dev_id = disk->dev->id;
+  holy_fs_probe_cache[i].disk_id = disk->id;
+  holy_fs_probe_cache[i].part_start
+    = holy_partition_get_start (disk->partition);
+  holy_fs_probe_cache[i].fs = fs;
+  return fs;
+}
+
 
 
 /* Block list support routines.  */
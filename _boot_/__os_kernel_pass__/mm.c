@@ -25,6 +25,29 @@
 
 holy_mm_region_t holy_mm_base;
 
+/* Freed blocks of up to holy_MM_QUICK_UNITS units (header included) are
+   not merged back into their region right away but parked on a list per
+   exact size, so that the frequent small allocations and frees take
+   constant time.  At most holy_MM_QUICK_DEPTH blocks are kept per size,
+   and all of them are released when memory runs short.  */
+#define holy_MM_QUICK_UNITS	16
+#define holy_MM_QUICK_DEPTH	32
+
+static holy_mm_header_t holy_mm_quick[holy_MM_QUICK_UNITS + 1];
+static unsigned holy_mm_quick_count[holy_MM_QUICK_UNITS + 1];
+
+/* Lowest and highest address of any region, so that holy_free can tell
+   a stray pointer from a heap block without walking the regions.  */
+static holy_addr_t holy_mm_heap_start = ~(holy_addr_t) 0;
+static holy_addr_t holy_mm_heap_end;
+
+#ifdef MM_DEBUG
+static unsigned long holy_mm_quick_hits;
+static unsigned long holy_mm_quick_misses;
+#endif
+
+static void holy_mm_free_real (holy_mm_header_t p, holy_mm_region_t r);
+
 /* Get a header from the pointer PTR, and set *P and *R to a pointer
    to the header and a pointer to its region, respectively. PTR must
    be allocated.  */
@@ -43,13 +66,24 @@ get_header_from_pointer (void *ptr, holy_mm_header_t *p, holy_mm_region_t *r)
     holy_fatal ("out of range pointer %p", ptr);
 
   *p = (holy_mm_header_t) ptr - 1;
-  if ((*p)->magic == holy_MM_FREE_MAGIC)
+  if ((*p)->magic == holy_MM_FREE_MAGIC
+      || (*p)->magic == holy_MM_QUICK_MAGIC)
     holy_fatal ("double free at %p", *p);
   if ((*p)->magic != holy_MM_ALLOC_MAGIC)
     holy_fatal ("alloc magic is broken at %p: %lx", *p,
 		(unsigned long) (*p)->magic);
 }
 
+/* Widen the heap bounds to cover the region R.  */
+static void
+holy_mm_note_region (holy_mm_region_t r)
+{
+  if ((holy_addr_t) (r + 1) < holy_mm_heap_start)
+    holy_mm_heap_start = (holy_addr_t) (r + 1);
+  if ((holy_addr_t) (r + 1) + r->size > holy_mm_heap_end)
+    holy_mm_heap_end = (holy_addr_t) (r + 1) + r->size;
+}
+
 /* Initialize a region starting from ADDR and whose size is SIZE,
    to use it as free space.  */
 void
@@ -86,9 +120,10 @@ holy_mm_init_region (void *addr, holy_size_t size)
 	    r->size += h->size << holy_MM_ALIGN_LOG2;
 	    r->pre_size &= (holy_MM_ALIGN - 1);
 	    *p = r;
-	    holy_free (h + 1);
+	    holy_mm_free_real (h, r);
 	  }
 	*p = r;
+	holy_mm_note_region (r);
 	return;
       }
 
@@ -118,6 +153,7 @@ holy_mm_init_region (void *addr, holy_size_t size)
 
   *p = r;
   r->next = q;
+  holy_mm_note_region (r);
 }
 
 /* Allocate the number of units N with the alignment ALIGN from the ring
@@ -283,6 +319,25 @@ holy_memalign (holy_size_t align, holy_size_t size)
   if (align == 0)
     align = 1;
 
+  if (align == 1 && n <= holy_MM_QUICK_UNITS)
+    {
+      holy_mm_header_t p = holy_mm_quick[n];
+
+      if (p)
+	{
+	  holy_mm_quick[n] = p->next;
+	  holy_mm_quick_count[n]--;
+	  p->magic = holy_MM_ALLOC_MAGIC;
+#ifdef MM_DEBUG
+	  holy_mm_quick_hits++;
+#endif
+	  return p + 1;
+	}
+#ifdef MM_DEBUG
+      holy_mm_quick_misses++;
+#endif
+    }
+
  again:
 
   for (r = holy_mm_base; r; r = r->next)
@@ -298,8 +353,9 @@ holy_memalign (holy_size_t align, holy_size_t size)
   switch (count)
     {
     case 0:
-      /* Invalidate disk caches.  */
+      /* Invalidate disk caches and merge the cached small blocks.  */
       holy_disk_cache_invalidate_all ();
+      holy_mm_flush_quick ();
       count++;
       goto again;
 
@@ -340,18 +396,11 @@ holy_zalloc (holy_size_t size)
   return ret;
 }
 
-/* Deallocate the pointer PTR.  */
-void
-holy_free (void *ptr)
+/* Return the block P, which belongs to the region R, to the free ring
+   of R.  */
+static void
+holy_mm_free_real (holy_mm_header_t p, holy_mm_region_t r)
 {
-  holy_mm_header_t p;
-  holy_mm_region_t r;
-
-  if (! ptr)
-    return;
-
-  get_header_from_pointer (ptr, &p, &r);
-
   if (r->first->magic == holy_MM_ALLOC_MAGIC)
     {
       p->magic = holy_MM_FREE_MAGIC;
@@ -410,6 +459,90 @@ holy_free (void *ptr)
     }
 }
 
+/* Deallocate the pointer PTR.  */
+void
+holy_free (void *ptr)
+{
+  holy_mm_header_t p;
+  holy_mm_region_t r;
+
+  if (! ptr)
+    return;
+
+  /* Inside the heap bounds the header can be read.  Anything else, double
+     frees included, goes through the full check below; a block queued
+     from a gap between regions is caught when the lists are flushed.  */
+  p = (holy_mm_header_t) ptr - 1;
+  if (((holy_addr_t) ptr & (holy_MM_ALIGN - 1)) == 0
+      && (holy_addr_t) ptr > holy_mm_heap_start
+      && (holy_addr_t) ptr <= holy_mm_heap_end
+      && p->magic == holy_MM_ALLOC_MAGIC
+      && p->size <= holy_MM_QUICK_UNITS
+      && holy_mm_quick_count[p->size] < holy_MM_QUICK_DEPTH)
+    {
+      p->magic = holy_MM_QUICK_MAGIC;
+      p->next = holy_mm_quick[p->size];
+      holy_mm_quick[p->size] = p;
+      holy_mm_quick_count[p->size]++;
+      return;
+    }
+
+  get_header_from_pointer (ptr, &p, &r);
+  holy_mm_free_real (p, r);
+}
+
+void
+holy_mm_flush_quick (void)
+{
+  holy_mm_header_t p;
+  holy_mm_region_t r;
+  unsigned n;
+
+  for (n = 0; n <= holy_MM_QUICK_UNITS; n++)
+    {
+      while ((p = holy_mm_quick[n]))
+	{
+	  holy_mm_quick[n] = p->next;
+	  p->magic = holy_MM_ALLOC_MAGIC;
+	  get_header_from_pointer (p + 1, &p, &r);
+	  holy_mm_free_real (p, r);
+	}
+      holy_mm_quick_count[n] = 0;
+    }
+}
+
+/* Store the number of bytes that can still be allocated in *TOTAL, and
+   the largest single allocation that would succeed in *LARGEST.  The quick
+   lists are flushed first so that their blocks count.  */
+void
+holy_mm_get_free (holy_size_t *total, holy_size_t *largest)
+{
+  holy_mm_region_t r;
+
+  holy_mm_flush_quick ();
+
+  *total = 0;
+  *largest = 0;
+  for (r = holy_mm_base; r; r = r->next)
+    {
+      holy_mm_header_t p = r->first;
+
+      if (!p)
+	continue;
+      do
+	{
+	  /* One unit goes to the header.  */
+	  holy_size_t bytes = (p->size - 1) << holy_MM_ALIGN_LOG2;
+
+	  *total += bytes;
+	  if (bytes > *largest)
+	    *largest = bytes;
+	  p = p->next;
+	}
+      while (p != r->first);
+    }
+}
+
 /* Reallocate SIZE bytes and return the pointer. The contents will be
    the same as that of PTR.  */
 void *
@@ -475,6 +608,83 @@ holy_mm_dump_free (void)
   holy_printf ("\n");
 }
 
+/* Number of power of two size buckets in the histogram.  */
+#define holy_MM_HIST_BUCKETS	32
+
+/* Print a histogram of block sizes and the fragmentation of the heap.  */
+static void
+holy_mm_dump_stats (void)
+{
+  holy_mm_region_t r;
+  unsigned long free_blocks[holy_MM_HIST_BUCKETS];
+  unsigned long alloc_blocks[holy_MM_HIST_BUCKETS];
+  unsigned long nfree = 0, nquick = 0;
+  holy_size_t free_bytes = 0, alloc_bytes = 0, largest = 0;
+  unsigned i;
+
+  holy_memset (free_blocks, 0, sizeof (free_blocks));
+  holy_memset (alloc_blocks, 0, sizeof (alloc_blocks));
+
+  for (r = holy_mm_base; r; r = r->next)
+    {
+      holy_mm_header_t p;
+
+      for (p = (holy_mm_header_t) ALIGN_UP ((holy_addr_t) (r + 1),
+					    holy_MM_ALIGN);
+	   (holy_addr_t) p < (holy_addr_t) (r+1) + r->size;)
+	{
+	  holy_size_t bytes = p->size << holy_MM_ALIGN_LOG2;
+	  unsigned bucket = 0;
+
+	  if ((p->magic != holy_MM_FREE_MAGIC
+	       && p->magic != holy_MM_ALLOC_MAGIC
+	       && p->magic != holy_MM_QUICK_MAGIC) || p->size == 0)
+	    {
+	      p++;
+	      continue;
+	    }
+
+	  while (bucket < holy_MM_HIST_BUCKETS - 1
+		 && ((holy_size_t) 2 << bucket) <= bytes)
+	    bucket++;
+
+	  if (p->magic == holy_MM_ALLOC_MAGIC)
+	    {
+	      alloc_blocks[bucket]++;
+	      alloc_bytes += bytes;
+	    }
+	  else
+	    {
+	      /* Blocks on the quick lists are free too, but can't be
+		 merged with their neighbours.  */
+	      if (p->magic == holy_MM_QUICK_MAGIC)
+		nquick++;
+	      free_blocks[bucket]++;
+	      free_bytes += bytes;
+	      nfree++;
+	      if (bytes > largest)
+		largest = bytes;
+	    }
+	  p += p->size;
+	}
+    }
+
+  holy_printf ("block size: free allocated\n");
+  for (i = 0; i < holy_MM_HIST_BUCKETS; i++)
+    if (free_blocks[i] || alloc_blocks[i])
+      holy_printf ("%10lu: %lu %lu\n", 1UL << i, free_blocks[i],
+		   alloc_blocks[i]);
+
+  holy_printf ("allocated: %llu bytes\n", (unsigned long long) alloc_bytes);
+  holy_printf ("free: %llu bytes in %lu blocks (%lu quick), largest %llu,"
+	       " fragmentation %u%%\n",
+	       (unsigned long long) free_bytes, nfree, nquick,
+	       (unsigned long long) largest,
+	       free_bytes ? (unsigned) (100 - (largest * 100) / free_bytes) : 0);
+  holy_printf ("quick list hits: %lu, misses: %lu\n",
+	       holy_mm_quick_hits, holy_mm_quick_misses);
+}
+
 void
 holy_mm_dump (unsigned lineno)
 {
@@ -499,10 +709,14 @@ holy_mm_dump (unsigned lineno)
 	    case holy_MM_ALLOC_MAGIC:
 	      holy_printf ("A:%p:%u\n", p, (unsigned int) p->size << holy_MM_ALIGN_LOG2);
 	      break;
+	    case holy_MM_QUICK_MAGIC:
+	      holy_printf ("Q:%p:%u\n", p, (unsigned int) p->size << holy_MM_ALIGN_LOG2);
+	      break;
 	    }
 	}
     }
 
+  holy_mm_dump_stats ();
   holy_printf ("\n");
 }
 
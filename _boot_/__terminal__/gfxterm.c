@@ -24,14 +24,6 @@ holy_MOD_LICENSE ("GPLv2+");
 
 #define DEFAULT_STANDARD_COLOR  0x07
 
-struct holy_dirty_region
-{
-  int top_left_x;
-  int top_left_y;
-  int bottom_right_x;
-  int bottom_right_y;
-};
-
 struct holy_colored_char
 {
   /* An Unicode codepoint.  */
@@ -103,6 +95,7 @@ static struct holy_gfxterm_window window;
 static struct holy_virtual_screen virtual_screen;
 static int repaint_scheduled = 0;
 static int repaint_was_scheduled = 0;
+static struct holy_video_damage repaint_damage;
 
 static void destroy_window (void);
 
@@ -110,7 +103,7 @@ static struct holy_video_render_target *text_layer;
 
 struct holy_gfxterm_background holy_gfxterm_background;
 
-static struct holy_dirty_region dirty_region;
+static struct holy_video_damage dirty_region;
 
 static void dirty_region_reset (void);
 
@@ -271,6 +264,20 @@ holy_gfxterm_schedule_repaint (void)
   repaint_scheduled = 1;
 }
 
+void
+holy_gfxterm_schedule_repaint_rect (const holy_video_rect_t *rect)
+{
+  int x = rect->x - window.x, y = rect->y - window.y;
+  int x2 = x + rect->width, y2 = y + rect->height;
+
+  if (x2 > (int) window.width)
+    x2 = window.width;
+  if (y2 > (int) window.height)
+    y2 = window.height;
+  if (x2 > x && y2 > y)
+    holy_video_damage_add (&repaint_damage, x, y, x2 - x, y2 - y);
+}
+
 holy_err_t
 holy_gfxterm_set_window (struct holy_video_render_target *target,
 			 int x, int y, int width, int height,
@@ -301,6 +308,7 @@ holy_gfxterm_set_window (struct holy_video_render_target *target,
   window.double_repaint = double_repaint;
 
   dirty_region_reset ();
+  holy_video_damage_reset (&repaint_damage);
   holy_gfxterm_schedule_repaint ();
 
   return holy_errno;
@@ -501,45 +509,14 @@ redraw_screen_rect (unsigned int x, unsigned int y,
 static void
 dirty_region_reset (void)
 {
-  dirty_region.top_left_x = -1;
-  dirty_region.top_left_y = -1;
-  dirty_region.bottom_right_x = -1;
-  dirty_region.bottom_right_y = -1;
+  holy_video_damage_reset (&dirty_region);
   repaint_was_scheduled = 0;
 }
 
 static int
 dirty_region_is_empty (void)
 {
-  if ((dirty_region.top_left_x == -1)
-      || (dirty_region.top_left_y == -1)
-      || (dirty_region.bottom_right_x == -1)
-      || (dirty_region.bottom_right_y == -1))
-    return 1;
-  return 0;
-}
-
-static void
-dirty_region_add_real (int x, int y, unsigned int width, unsigned int height)
-{
-  if (dirty_region_is_empty ())
-    {
-      dirty_region.top_left_x = x;
-      dirty_region.top_left_y = y;
-      dirty_region.bottom_right_x = x + width - 1;
-      dirty_region.bottom_right_y = y + height - 1;
-    }
-  else
-    {
-      if (x < dirty_region.top_left_x)
-        dirty_region.top_left_x = x;
-      if (y < dirty_region.top_left_y)
-        dirty_region.top_left_y = y;
-      if ((x + (int)width - 1) > dirty_region.bottom_right_x)
-        dirty_region.bottom_right_x = x + width - 1;
-      if ((y + (int)height - 1) > dirty_region.bottom_right_y)
-        dirty_region.bottom_right_y = y + height - 1;
-    }
+  return holy_video_damage_is_empty (&dirty_region);
 }
 
 static void
@@ -550,12 +527,18 @@ dirty_region_add (int x, int y, unsigned int width, unsigned int height)
 
   if (repaint_scheduled)
     {
-      dirty_region_add_real (0, 0,
+      holy_video_damage_add (&dirty_region, 0, 0,
 			     window.width, window.height);
       repaint_scheduled = 0;
       repaint_was_scheduled = 1;
     }
-  dirty_region_add_real (x, y, width, height);
+  if (!holy_video_damage_is_empty (&repaint_damage))
+    {
+      holy_video_damage_merge (&dirty_region, &repaint_damage);
+      holy_video_damage_reset (&repaint_damage);
+      repaint_was_scheduled = 1;
+    }
+  holy_video_damage_add (&dirty_region, x, y, width, height);
 }
 
 static void
@@ -570,24 +553,18 @@ dirty_region_add_virtualscreen (void)
 static void
 dirty_region_redraw (void)
 {
-  int x;
-  int y;
-  int width;
-  int height;
+  unsigned i;
 
   if (dirty_region_is_empty ())
     return;
 
-  x = dirty_region.top_left_x;
-  y = dirty_region.top_left_y;
-
-  width = dirty_region.bottom_right_x - x + 1;
-  height = dirty_region.bottom_right_y - y + 1;
-
   if (repaint_was_scheduled && holy_gfxterm_decorator_hook)
     holy_gfxterm_decorator_hook ();
 
-  redraw_screen_rect (x, y, width, height);
+  for (i = 0; i < dirty_region.count; i++)
+    redraw_screen_rect (dirty_region.rects[i].x, dirty_region.rects[i].y,
+			dirty_region.rects[i].width,
+			dirty_region.rects[i].height);
 }
 
 static inline void
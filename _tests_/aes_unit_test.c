@@ -0,0 +1,261 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <holy/test.h>
+#include <holy/misc.h>
+#include <holy/crypto.h>
+#include <holy/aes.h>
+
+holy_MOD_LICENSE ("GPLv2+");
+
+#define MSG "aes test failed"
+
+#define BENCH_SIZE (1 << 20)
+#define BENCH_ROUNDS 16
+
+void holy_gcry_rijndael_init (void);
+
+static const char *const impls[] = { "vaes", "aesni", "bitslice" };
+
+/* FIPS-197 appendix C.  */
+static const holy_uint8_t fips_plain[16] = {
+  0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+  0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+};
+
+static const holy_uint8_t fips_cipher[3][16] = {
+  { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+    0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a },
+  { 0xdd, 0xa9, 0x7c, 0xa4, 0x86, 0x4c, 0xdf, 0xe0,
+    0x6e, 0xaf, 0x70, 0xa0, 0xec, 0x0d, 0x71, 0x91 },
+  { 0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf,
+    0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89 }
+};
+
+/* IEEE 1619-2007 XTS-AES-128 vectors 1 and 2.  */
+static const holy_uint8_t xts_cipher[2][32] = {
+  { 0x91, 0x7c, 0xf6, 0x9e, 0xbd, 0x68, 0xb2, 0xec,
+    0x9b, 0x9f, 0xe9, 0xa3, 0xea, 0xdd, 0xa6, 0x92,
+    0xcd, 0x43, 0xd2, 0xf5, 0x95, 0x98, 0xed, 0x85,
+    0x8c, 0x02, 0xc2, 0x65, 0x2f, 0xbf, 0x92, 0x2e },
+  { 0xc4, 0x54, 0x18, 0x5e, 0x6a, 0x16, 0x93, 0x6e,
+    0x39, 0x33, 0x40, 0x38, 0xac, 0xef, 0x83, 0x8b,
+    0xfb, 0x18, 0x6f, 0xff, 0x74, 0x80, 0xad, 0xc4,
+    0x28, 0x93, 0x82, 0xec, 0xd6, 0xd3, 0x94, 0xf0 }
+};
+
+static void
+test_vectors (const char *impl)
+{
+  struct holy_aes_key key, tkey;
+  holy_uint8_t raw[64], buf[32], tweak[16];
+  int i;
+
+  for (i = 0; i < 32; i++)
+    raw[i] = i;
+  for (i = 0; i < 3; i++)
+    {
+      holy_test_assert (holy_aes_set_key (&key, raw, 16 + 8 * i) == 0, MSG);
+      holy_aes_ecb_encrypt (&key, buf, fips_plain, 1);
+      holy_test_assert (holy_memcmp (buf, fips_cipher[i], 16) == 0,
+			"%s: FIPS-197 AES-%d encryption", impl, 128 + 64 * i);
+      holy_aes_ecb_decrypt (&key, buf, buf, 1);
+      holy_test_assert (holy_memcmp (buf, fips_plain, 16) == 0,
+			"%s: FIPS-197 AES-%d decryption", impl, 128 + 64 * i);
+    }
+
+  for (i = 0; i < 2; i++)
+    {
+      holy_memset (raw, i ? 0x11 : 0, 16);
+      holy_memset (raw + 16, i ? 0x22 : 0, 16);
+      holy_memset (tweak, 0, 16);
+      holy_memset (tweak, i ? 0x33 : 0, 5);
+      holy_memset (buf, i ? 0x44 : 0, 32);
+      holy_aes_set_key (&key, raw, 16);
+      holy_aes_set_key (&tkey, raw + 16, 16);
+      holy_aes_ecb_encrypt (&tkey, tweak, tweak, 1);
+      holy_aes_xts_encrypt (&key, buf, buf, 2, tweak);
+      holy_test_assert (holy_memcmp (buf, xts_cipher[i], 32) == 0,
+			"%s: IEEE 1619 vector %d", impl, i + 1);
+    }
+}
+
+/* Multiply the XTS tweak by x, one block at a time.  */
+static void
+xts_mul_x (holy_uint8_t *t)
+{
+  int carry = t[15] >> 7;
+  int i;
+
+  for (i = 15; i > 0; i--)
+    t[i] = (t[i] << 1) | (t[i - 1] >> 7);
+  t[0] = (t[0] << 1) ^ (carry ? 0x87 : 0);
+}
+
+static void
+xts_reference (holy_crypto_cipher_handle_t c, holy_uint8_t *buf,
+	       holy_size_t nblocks, holy_uint8_t *tweak, int do_encrypt)
+{
+  holy_size_t i;
+  int k;
+
+  for (i = 0; i < nblocks; i++, buf += 16)
+    {
+      for (k = 0; k < 16; k++)
+	buf[k] ^= tweak[k];
+      if (do_encrypt)
+	holy_crypto_ecb_encrypt (c, buf, buf, 16);
+      else
+	holy_crypto_ecb_decrypt (c, buf, buf, 16);
+      for (k = 0; k < 16; k++)
+	buf[k] ^= tweak[k];
+      xts_mul_x (tweak);
+    }
+}
+
+/* Compare every mode against the table-driven rijndael code, over all key
+   sizes and a range of lengths.  */
+static void
+test_against_gcry (const char *impl, holy_uint8_t *src, holy_uint8_t *a,
+		   holy_uint8_t *b)
+{
+  static const char *const names[] = { "AES", "AES192", "AES256" };
+  struct holy_aes_key key;
+  holy_uint8_t raw[32], iv0[16], iv_a[16], iv_b[16];
+  holy_size_t n;
+  int i, round;
+
+  for (i = 0; i < 3; i++)
+    for (round = 0; round < 20; round++)
+      {
+	const gcry_cipher_spec_t *spec;
+	holy_crypto_cipher_handle_t c;
+	holy_size_t len = 16 + 8 * i;
+	int k;
+
+	spec = holy_crypto_lookup_cipher_by_name (names[i]);
+	holy_test_assert (spec != NULL, "%s: no cipher %s", impl, names[i]);
+	if (!spec)
+	  return;
+	c = holy_crypto_cipher_open (spec);
+	if (!c)
+	  return;
+
+	for (k = 0; k < 32; k++)
+	  raw[k] = rand ();
+	for (k = 0; k < 16; k++)
+	  iv_a[k] = rand ();
+	holy_crypto_cipher_set_key (c, raw, len);
+	holy_aes_set_key (&key, raw, len);
+	n = 1 + rand () % 64;
+
+	holy_memcpy (a, src, n * 16);
+	holy_crypto_ecb_encrypt (c, a, a, n * 16);
+	holy_aes_ecb_encrypt (&key, b, src, n);
+	holy_test_assert (holy_memcmp (a, b, n * 16) == 0,
+			  "%s: ECB %s encryption, %d blocks", impl, names[i],
+			  (int) n);
+	holy_aes_ecb_decrypt (&key, b, b, n);
+	holy_test_assert (holy_memcmp (b, src, n * 16) == 0,
+			  "%s: ECB %s decryption, %d blocks", impl, names[i],
+			  (int) n);
+
+	holy_memcpy (iv_b, iv_a, 16);
+	holy_memcpy (iv0, iv_a, 16);
+	holy_memcpy (a, src, n * 16);
+	holy_memcpy (b, src, n * 16);
+	holy_crypto_cbc_decrypt (c, a, a, n * 16, iv_a);
+	holy_aes_cbc_decrypt (&key, b, b, n, iv_b);
+	holy_test_assert (holy_memcmp (a, b, n * 16) == 0
+			  && holy_memcmp (iv_a, iv_b, 16) == 0,
+			  "%s: CBC %s decryption, %d blocks", impl, names[i],
+			  (int) n);
+	holy_aes_cbc_encrypt (&key, b, b, n, iv0);
+	holy_test_assert (holy_memcmp (b, src, n * 16) == 0
+			  && holy_memcmp (iv0, iv_b, 16) == 0,
+			  "%s: CBC %s encryption, %d blocks", impl, names[i],
+			  (int) n);
+
+	/* The tweak is already encrypted here, so any value will do.  */
+	holy_memcpy (iv_b, iv_a, 16);
+	holy_memcpy (a, src, n * 16);
+	holy_memcpy (b, src, n * 16);
+	xts_reference (c, a, n, iv_a, 1);
+	holy_aes_xts_encrypt (&key, b, b, n, iv_b);
+	holy_test_assert (holy_memcmp (a, b, n * 16) == 0
+			  && holy_memcmp (iv_a, iv_b, 16) == 0,
+			  "%s: XTS %s encryption, %d blocks", impl, names[i],
+			  (int) n);
+	xts_reference (c, a, n, iv_a, 0);
+	holy_aes_xts_decrypt (&key, b, b, n, iv_b);
+	holy_test_assert (holy_memcmp (a, b, n * 16) == 0,
+			  "%s: XTS %s decryption, %d blocks", impl, names[i],
+			  (int) n);
+
+	holy_crypto_cipher_close (c);
+      }
+}
+
+static void
+bench (const char *name, holy_uint8_t *buf)
+{
+  struct holy_aes_key key;
+  holy_uint8_t tweak[16];
+  holy_uint64_t start;
+  int i;
+
+  if (!holy_test_bench_enabled ())
+    return;
+
+  holy_memset (tweak, 0, sizeof (tweak));
+  holy_aes_set_key (&key, buf, 32);
+
+  start = holy_test_bench_start ();
+  for (i = 0; i < BENCH_ROUNDS; i++)
+    holy_aes_xts_decrypt (&key, buf, buf, BENCH_SIZE / 16, tweak);
+  holy_test_bench_end (start, (double) BENCH_SIZE * BENCH_ROUNDS / (1 << 20),
+		       "MiB", "%s xts", name);
+}
+
+static void
+aes_test (void)
+{
+  holy_uint8_t *src, *a, *b;
+  unsigned i;
+  int n;
+
+  holy_gcry_rijndael_init ();
+
+  src = malloc (BENCH_SIZE);
+  a = malloc (64 * 16);
+  b = malloc (64 * 16);
+  holy_test_assert (src && a && b, MSG);
+  if (!src || !a || !b)
+    {
+      free (src);
+      free (a);
+      free (b);
+      return;
+    }
+  for (n = 0; n < BENCH_SIZE; n++)
+    src[n] = rand ();
+
+  for (i = 0; i < ARRAY_SIZE (impls); i++)
+    {
+      if (holy_aes_select (impls[i]) != 0)
+	continue;
+      test_vectors (impls[i]);
+      test_against_gcry (impls[i], src, a, b);
+      bench (impls[i], src);
+    }
+
+  free (src);
+  free (a);
+  free (b);
+}
+
+holy_UNIT_TEST ("aes_test", aes_test);
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <holy/test.h>
+#include <holy/misc.h>
+#include <holy/argon2.h>
+
+holy_MOD_LICENSE ("GPLv2+");
+
+#define MSG "argon2 test failed"
+
+/* KiB; large enough to leave the cache.  */
+#define BENCH_MEMORY (64 * 1024)
+
+static const char *const impls[] = { "avx2", "sse2", "generic" };
+
+/* RFC 9106, section 5.  */
+static const struct
+{
+  holy_argon2_type_t type;
+  const char *tag;
+} vectors[] = {
+  {
+    holy_ARGON2_D,
+    "\x51\x2b\x39\x1b\x6f\x11\x62\x97\x53\x71\xd3\x09\x19\x73\x42\x94"
+    "\xf8\x68\xe3\xbe\x39\x84\xf3\xc1\xa1\x3a\x4d\xb9\xfa\xbe\x4a\xcb"
+  },
+  {
+    holy_ARGON2_I,
+    "\xc8\x14\xd9\xd1\xdc\x7f\x37\xaa\x13\xf0\xd7\x7f\x24\x94\xbd\xa1"
+    "\xc8\xde\x6b\x01\x6d\xd3\x88\xd2\x99\x52\xa4\xc4\x67\x2b\x6c\xe8"
+  },
+  {
+    holy_ARGON2_ID,
+    "\x0d\x64\x0d\xf5\x8d\x78\x76\x6c\x08\xc0\x37\xa3\x4a\x8b\x53\xc9"
+    "\xd0\x1e\xf0\x45\x2d\x75\xb6\x5e\xb5\x25\x20\xe9\x6b\x01\xe6\x59"
+  }
+};
+
+static void
+test_vectors (const char *impl)
+{
+  holy_uint8_t P[32], S[16], K[8], X[12], tag[32];
+  struct holy_argon2_params params;
+  unsigned v;
+
+  memset (P, 0x01, sizeof (P));
+  memset (S, 0x02, sizeof (S));
+  memset (K, 0x03, sizeof (K));
+  memset (X, 0x04, sizeof (X));
+
+  for (v = 0; v < ARRAY_SIZE (vectors); v++)
+    {
+      params.type = vectors[v].type;
+      params.t_cost = 3;
+      params.m_cost = 32;
+      params.lanes = 4;
+      params.secret = K;
+      params.secret_len = sizeof (K);
+      params.ad = X;
+      params.ad_len = sizeof (X);
+      holy_test_assert (holy_argon2 (&params, P, sizeof (P), S, sizeof (S),
+				     tag, sizeof (tag)) == holy_ERR_NONE,
+			MSG);
+      holy_test_assert (memcmp (tag, vectors[v].tag, sizeof (tag)) == 0,
+			"%s: vector %d mismatch", impl, v);
+    }
+}
+
+/* Every implementation must agree with the generic one, whatever the
+   parameters and output length.  */
+static void
+test_cross (const char *impl)
+{
+  holy_uint8_t pwd[32], salt[16], tag[200], ref[200];
+  struct holy_argon2_params params;
+  int round, k;
+
+  for (round = 0; round < 10; round++)
+    {
+      for (k = 0; k < 32; k++)
+	pwd[k] = rand ();
+      for (k = 0; k < 16; k++)
+	salt[k] = rand ();
+      memset (&params, 0, sizeof (params));
+      params.type = rand () % 3;
+      params.t_cost = 1 + rand () % 3;
+      params.lanes = 1 + rand () % 4;
+      params.m_cost = 8 * params.lanes + rand () % 512;
+      k = 4 + rand () % 197;
+
+      holy_argon2_select ("generic");
+      holy_test_assert (holy_argon2 (&params, pwd, 32, salt, 16, ref, k)
+			== holy_ERR_NONE, MSG);
+      holy_argon2_select (impl);
+      holy_test_assert (holy_argon2 (&params, pwd, 32, salt, 16, tag, k)
+			== holy_ERR_NONE, MSG);
+      holy_test_assert (memcmp (tag, ref, k) == 0,
+			"%s: round %d differs from generic", impl, round);
+    }
+}
+
+static void
+bench (const char *impl)
+{
+  struct holy_argon2_params params;
+  holy_uint8_t tag[32];
+  holy_uint64_t start;
+
+  if (!holy_test_bench_enabled ())
+    return;
+
+  memset (&params, 0, sizeof (params));
+  params.type = holy_ARGON2_ID;
+  params.t_cost = 1;
+  params.m_cost = BENCH_MEMORY;
+  params.lanes = 4;
+
+  start = holy_test_bench_start ();
+  holy_argon2 (&params, "password", 8, "somesaltsomesalt", 16,
+	       tag, sizeof (tag));
+  holy_test_bench_end (start, BENCH_MEMORY / 1024, "MiB", "%s", impl);
+}
+
+static void
+argon2_test (void)
+{
+  unsigned i;
+
+  for (i = 0; i < ARRAY_SIZE (impls); i++)
+    {
+      if (holy_argon2_select (impls[i]) != 0)
+	continue;
+
+      test_vectors (impls[i]);
+      test_cross (impls[i]);
+      bench (impls[i]);
+    }
+}
+
+holy_UNIT_TEST ("argon2_test", argon2_test);
@@ -0,0 +1,218 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <holy/test.h>
+#include <holy/misc.h>
+#include <holy/crypto.h>
+#include <holy/lib/crc.h>
+
+holy_MOD_LICENSE ("GPLv2+");
+
+#define MSG "crc test failed"
+
+#define BENCH_SIZE (4 << 20)
+#define BENCH_ROUNDS 16
+
+void holy_adler32_init (void);
+void holy_crc64_init (void);
+
+/* Bit at a time, as in the specification.  */
+static holy_uint32_t
+crc32c_reference (holy_uint32_t crc, const holy_uint8_t *buf, holy_size_t len)
+{
+  int k;
+
+  crc = ~crc;
+  while (len--)
+    {
+      crc ^= *buf++;
+      for (k = 0; k < 8; k++)
+	crc = (crc >> 1) ^ (0x82f63b78 & -(crc & 1));
+    }
+  return ~crc;
+}
+
+/* The same for CRC64 (ECMA-182, reflected), on the raw register.  */
+static holy_uint64_t
+crc64_reference (holy_uint64_t crc, const holy_uint8_t *buf, holy_size_t len)
+{
+  int k;
+
+  crc = ~crc;
+  while (len--)
+    {
+      crc ^= *buf++;
+      for (k = 0; k < 8; k++)
+	crc = (crc >> 1) ^ (0xc96c5795d7870f42ULL & -(crc & 1));
+    }
+  return ~crc;
+}
+
+static const char *const crc64_impls[] = { "pclmul", "slice8" };
+
+/* Adler-32 reduced after every byte, as in RFC 1950.  */
+static holy_uint32_t
+adler32_reference (const holy_uint8_t *buf, holy_size_t len)
+{
+  holy_uint32_t a = 1, b = 0;
+
+  while (len--)
+    {
+      a = (a + *buf++) % 65521;
+      b = (b + a) % 65521;
+    }
+  return (b << 16) | a;
+}
+
+static const char *const adler32_impls[] = { "avx2", "ssse3", "generic" };
+
+static void
+bench (const char *name, const holy_uint8_t *buf,
+       void (*fn) (const holy_uint8_t *buf, holy_size_t len))
+{
+  holy_uint64_t start;
+  int i;
+
+  if (!holy_test_bench_enabled ())
+    return;
+
+  start = holy_test_bench_start ();
+  for (i = 0; i < BENCH_ROUNDS; i++)
+    fn (buf, BENCH_SIZE);
+  holy_test_bench_end (start, (double) BENCH_SIZE * BENCH_ROUNDS / (1 << 20),
+		       "MiB", "%s", name);
+}
+
+static volatile holy_uint32_t sink;
+
+static void
+bench_crc32c (const holy_uint8_t *buf, holy_size_t len)
+{
+  sink = holy_getcrc32c (sink, buf, len);
+}
+
+static void
+bench_md (const char *name, const holy_uint8_t *buf, holy_size_t len)
+{
+  const gcry_md_spec_t *md = holy_crypto_lookup_md_by_name (name);
+  holy_uint8_t out[8];
+
+  if (md)
+    holy_crypto_hash (md, out, buf, len);
+}
+
+static void
+bench_adler32 (const holy_uint8_t *buf, holy_size_t len)
+{
+  bench_md ("ADLER32", buf, len);
+}
+
+static void
+bench_crc64 (const holy_uint8_t *buf, holy_size_t len)
+{
+  bench_md ("CRC64", buf, len);
+}
+
+static void
+crc_test (void)
+{
+  static const char check[] = "123456789";
+  const gcry_md_spec_t *md;
+  holy_uint8_t out[8];
+  holy_uint8_t *buf;
+  holy_size_t off, len;
+  unsigned i;
+
+  holy_test_assert (holy_getcrc32c (0, check, 9) == 0xe3069283, MSG);
+
+  buf = malloc (BENCH_SIZE);
+  holy_test_assert (buf != NULL, MSG);
+  if (!buf)
+    return;
+  for (off = 0; off < BENCH_SIZE; off++)
+    buf[off] = rand ();
+
+  /* Every alignment and tail length of the word-at-a-time loops.  */
+  for (off = 0; off < 16; off++)
+    for (len = 0; len < 300; len++)
+      holy_test_assert (holy_getcrc32c (0x12345678, buf + off, len)
+			== crc32c_reference (0x12345678, buf + off, len),
+			"crc32c mismatch at offset %d length %d",
+			(int) off, (int) len);
+
+  /* Chaining.  */
+  holy_test_assert (holy_getcrc32c (holy_getcrc32c (0, buf, 1001),
+				    buf + 1001, 3000)
+		    == holy_getcrc32c (0, buf, 4001), MSG);
+
+  holy_adler32_init ();
+  holy_crc64_init ();
+
+  md = holy_crypto_lookup_md_by_name ("ADLER32");
+  holy_test_assert (md != NULL, MSG);
+  for (i = 0; md && i < ARRAY_SIZE (adler32_impls); i++)
+    {
+      if (holy_adler32_select (adler32_impls[i]) < 0)
+	continue;
+
+      holy_crypto_hash (md, out, check, 9);
+      holy_test_assert (holy_memcmp (out, "\x09\x1e\x01\xde", 4) == 0,
+			"%s: " MSG, adler32_impls[i]);
+
+      /* Lengths around the 32-byte blocks, and across several runs
+	 between reductions with the sums as large as they get.  */
+      for (off = 0; off < 16; off++)
+	for (len = 0; len < 300; len++)
+	  {
+	    holy_crypto_hash (md, out, buf + off, len);
+	    holy_test_assert (holy_get_unaligned32 (out)
+			      == holy_cpu_to_be32 (adler32_reference
+						   (buf + off, len)),
+			      "%s: adler32 mismatch at offset %d length %d",
+			      adler32_impls[i], (int) off, (int) len);
+	  }
+      memset (buf, 0xff, 20000);
+      holy_crypto_hash (md, out, buf, 20000);
+      holy_test_assert (holy_get_unaligned32 (out)
+			== holy_cpu_to_be32 (adler32_reference (buf, 20000)),
+			"%s: adler32 mismatch on 0xff bytes", adler32_impls[i]);
+      for (off = 0; off < 20000; off++)
+	buf[off] = rand ();
+    }
+
+  md = holy_crypto_lookup_md_by_name ("CRC64");
+  holy_test_assert (md != NULL, MSG);
+  for (i = 0; md && i < ARRAY_SIZE (crc64_impls); i++)
+    {
+      if (holy_crc64_select (crc64_impls[i]) < 0)
+	continue;
+
+      holy_crypto_hash (md, out, check, 9);
+      holy_test_assert (holy_memcmp (out, "\xfa\x39\x19\xdf\xbb\xc9\x5d\x99",
+				     8) == 0, "%s: " MSG, crc64_impls[i]);
+
+      /* Lengths around the 64- and 16-byte folding steps.  */
+      for (off = 0; off < 16; off++)
+	for (len = 0; len < 300; len++)
+	  {
+	    holy_crypto_hash (md, out, buf + off, len);
+	    holy_test_assert (holy_get_unaligned64 (out)
+			      == holy_cpu_to_le64 (crc64_reference
+						   (0, buf + off, len)),
+			      "%s: crc64 mismatch at offset %d length %d",
+			      crc64_impls[i], (int) off, (int) len);
+	  }
+    }
+
+  bench ("crc32c", buf, bench_crc32c);
+  bench ("adler32", buf, bench_adler32);
+  bench ("crc64", buf, bench_crc64);
+
+  free (buf);
+}
+
+holy_UNIT_TEST ("crc_test", crc_test);
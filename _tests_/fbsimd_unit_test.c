@@ -0,0 +1,210 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <holy/test.h>
+#include <holy/misc.h>
+#include <holy/fbutil.h>
+#include <holy/fbsimd.h>
+
+holy_MOD_LICENSE ("GPLv2+");
+
+#define ROW 80
+
+#define BENCH_WIDTH 3840
+#define BENCH_HEIGHT 2160
+#define BENCH_ROUNDS 8
+
+static const char *const impls[] = { "avx2", "sse2", "generic" };
+
+/* What the blitters computed pixel by pixel before the row kernels.  */
+static void
+ref_swap_rb (holy_uint32_t *dst, const holy_uint32_t *src, unsigned n)
+{
+  unsigned i;
+
+  for (i = 0; i < n; i++)
+    {
+      holy_uint32_t c = src[i];
+
+      dst[i] = ((c & 0xff00ff00) | ((c >> 16) & 0xff)
+		| ((c & 0xff) << 16));
+    }
+}
+
+static void
+ref_blend (holy_uint32_t *dst, const holy_uint32_t *src, unsigned n,
+	   int swap_rb)
+{
+  unsigned i;
+
+  for (i = 0; i < n; i++)
+    {
+      holy_uint32_t color = src[i], d = dst[i];
+      unsigned a = color >> 24, sr, sg, sb, dr, dg, db;
+
+      if (a == 0)
+	continue;
+
+      sr = swap_rb ? color & 0xff : (color >> 16) & 0xff;
+      sg = (color >> 8) & 0xff;
+      sb = swap_rb ? (color >> 16) & 0xff : color & 0xff;
+      if (a == 255)
+	{
+	  dr = sr;
+	  dg = sg;
+	  db = sb;
+	}
+      else
+	{
+	  dr = alpha_dilute ((d >> 16) & 0xff, sr, a);
+	  dg = alpha_dilute ((d >> 8) & 0xff, sg, a);
+	  db = alpha_dilute (d & 0xff, sb, a);
+	}
+      dst[i] = (a << 24) | (dr << 16) | (dg << 8) | db;
+    }
+}
+
+/* Mostly transparent or opaque, the way icons and fonts are, so that both
+   the shortcuts and the arithmetic get runs of every length.  */
+static holy_uint32_t
+random_pixel (int mode)
+{
+  holy_uint32_t c = ((holy_uint32_t) rand () << 16) ^ rand ();
+
+  switch (mode == 3 ? rand () % 3 : mode)
+    {
+    case 0:
+      return c & 0x00ffffff;
+    case 1:
+      return c | 0xff000000;
+    default:
+      return c;
+    }
+}
+
+static void
+test_rows (const char *impl)
+{
+  static holy_uint32_t src[ROW + 8], dst[ROW + 8], ref[ROW + 8];
+  int round, i;
+
+  for (round = 0; round < 2000; round++)
+    {
+      unsigned n = rand () % (ROW - 12);
+      unsigned soff = rand () % 8, doff = rand () % 8;
+      int mode = rand () % 4, swap = rand () & 1;
+      holy_uint32_t color;
+
+      for (i = 0; i < ROW + 8; i++)
+	{
+	  src[i] = random_pixel (mode);
+	  dst[i] = ref[i] = random_pixel (3);
+	}
+
+      ref_blend (ref + doff, src + soff, n, swap);
+      holy_video_fb_blend32 (dst + doff, src + soff, n, swap);
+      holy_test_assert (memcmp (dst, ref, sizeof (dst)) == 0,
+			"%s: blend of %u pixels differs", impl, n);
+
+      ref_swap_rb (ref + doff, src + soff, n);
+      holy_video_fb_swap_rb32 (dst + doff, src + soff, n);
+      holy_test_assert (memcmp (dst, ref, sizeof (dst)) == 0,
+			"%s: swap of %u pixels differs", impl, n);
+
+      color = random_pixel (3);
+      for (i = 0; i < (int) n; i++)
+	ref[doff + i] = color;
+      holy_video_fb_fill32 (dst + doff, color, n);
+      holy_test_assert (memcmp (dst, ref, sizeof (dst)) == 0,
+			"%s: fill of %u pixels differs", impl, n);
+    }
+
+  /* Every alpha against every channel value once.  */
+  for (i = 0; i < 256 * 256; i += ROW)
+    {
+      int k;
+
+      for (k = 0; k < ROW; k++)
+	{
+	  unsigned v = i + k;
+
+	  src[k] = ((v & 0xff) << 24) | ((v >> 8) * 0x010101);
+	  dst[k] = ref[k] = ((255 - (v >> 8)) * 0x010101) | 0x7f000000;
+	}
+      ref_blend (ref, src, ROW, 0);
+      holy_video_fb_blend32 (dst, src, ROW, 0);
+      holy_test_assert (memcmp (dst, ref, ROW * 4) == 0,
+			"%s: blend of alphas from %u differs", impl, i);
+    }
+}
+
+static const char *const bench_names[] = { "replace", "blend", "fill" };
+
+static void
+bench (const char *impl)
+{
+  holy_uint32_t *src, *dst;
+  holy_uint64_t start;
+  unsigned i, k;
+  int round;
+
+  if (!holy_test_bench_enabled ())
+    return;
+
+  src = malloc (BENCH_WIDTH * BENCH_HEIGHT * 4);
+  dst = malloc (BENCH_WIDTH * BENCH_HEIGHT * 4);
+  if (!src || !dst)
+    goto out;
+  for (i = 0; i < BENCH_WIDTH * BENCH_HEIGHT; i++)
+    {
+      src[i] = random_pixel (i / 64 % 4);
+      dst[i] = random_pixel (1);
+    }
+
+  for (k = 0; k < ARRAY_SIZE (bench_names); k++)
+    {
+      start = holy_test_bench_start ();
+      for (round = 0; round < BENCH_ROUNDS; round++)
+	for (i = 0; i < BENCH_HEIGHT; i++)
+	  switch (k)
+	    {
+	    case 0:
+	      holy_video_fb_swap_rb32 (dst + i * BENCH_WIDTH,
+				       src + i * BENCH_WIDTH, BENCH_WIDTH);
+	      break;
+	    case 1:
+	      holy_video_fb_blend32 (dst + i * BENCH_WIDTH,
+				     src + i * BENCH_WIDTH, BENCH_WIDTH, 1);
+	      break;
+	    default:
+	      holy_video_fb_fill32 (dst + i * BENCH_WIDTH, i, BENCH_WIDTH);
+	      break;
+	    }
+      holy_test_bench_end (start, BENCH_ROUNDS, "4K frames", "%s %s",
+			   impl, bench_names[k]);
+    }
+ out:
+  free (src);
+  free (dst);
+}
+
+static void
+fbsimd_test (void)
+{
+  unsigned i;
+
+  for (i = 0; i < ARRAY_SIZE (impls); i++)
+    {
+      if (holy_video_fb_simd_select (impls[i]) != 0)
+	continue;
+
+      test_rows (impls[i]);
+      bench (impls[i]);
+    }
+}
+
+holy_UNIT_TEST ("fbsimd_test", fbsimd_test);
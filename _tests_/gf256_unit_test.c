@@ -0,0 +1,142 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <holy/test.h>
+#include <holy/misc.h>
+#include <holy/gf256.h>
+
+holy_MOD_LICENSE ("GPLv2+");
+
+#define MSG "gf256 test failed"
+
+#define BENCH_SIZE (1 << 20)
+#define BENCH_ROUNDS 64
+
+static const char *const impls[] = { "avx2", "ssse3", "swar", "table" };
+
+/* Bitwise product, independent of the tables.  */
+static holy_uint8_t
+slow_mul (holy_uint8_t a, holy_uint8_t b)
+{
+  holy_uint8_t r = 0;
+
+  while (b)
+    {
+      if (b & 1)
+	r ^= a;
+      a = (a << 1) ^ ((a & 0x80) ? 0x1d : 0);
+      b >>= 1;
+    }
+  return r;
+}
+
+static void
+test_field (void)
+{
+  unsigned a, b;
+
+  for (a = 0; a < 256; a++)
+    for (b = 0; b < 256; b++)
+      holy_test_assert (holy_gf256_mul (a, b) == slow_mul (a, b),
+			"%u * %u mismatch", a, b);
+
+  for (a = 1; a < 256; a++)
+    {
+      holy_test_assert (holy_gf256_mul (a, holy_gf256_inv (a)) == 1,
+			"inverse of %u mismatch", a);
+      holy_test_assert (holy_gf256_exp (holy_gf256_log (a)) == a,
+			"log of %u mismatch", a);
+    }
+  holy_test_assert (holy_gf256_exp (255) == 1, MSG);
+}
+
+/* Random sizes and misalignments, compared with the bytewise product.  */
+static void
+test_blocks (const char *impl)
+{
+  static holy_uint8_t src[4100], dst[4100], ref[4100];
+  int round, i;
+
+  for (round = 0; round < 200; round++)
+    {
+      holy_size_t size = rand () % 4000;
+      holy_size_t soff = rand () % 32, doff = rand () % 32;
+      holy_uint8_t c = round < 3 ? round : rand ();
+
+      for (i = 0; i < (int) sizeof (src); i++)
+	{
+	  src[i] = rand ();
+	  dst[i] = ref[i] = rand ();
+	}
+
+      for (i = 0; i < (int) size; i++)
+	ref[doff + i] ^= slow_mul (src[soff + i], c);
+      holy_gf256_muladd_block (dst + doff, src + soff, c, size);
+      holy_test_assert (memcmp (dst, ref, sizeof (dst)) == 0,
+			"%s: muladd by %u of %u bytes differs", impl, c,
+			(unsigned) size);
+
+      for (i = 0; i < (int) size; i++)
+	ref[doff + i] = slow_mul (ref[doff + i], c);
+      holy_gf256_mul_block (dst + doff, c, size);
+      holy_test_assert (memcmp (dst, ref, sizeof (dst)) == 0,
+			"%s: mul by %u of %u bytes differs", impl, c,
+			(unsigned) size);
+
+      for (i = 0; i < (int) size; i++)
+	ref[doff + i] ^= src[soff + i];
+      holy_gf256_xor_block (dst + doff, src + soff, size);
+      holy_test_assert (memcmp (dst, ref, sizeof (dst)) == 0,
+			"%s: xor of %u bytes differs", impl, (unsigned) size);
+    }
+}
+
+static void
+bench (const char *impl)
+{
+  holy_uint8_t *src, *dst;
+  holy_uint64_t start;
+  int i;
+
+  if (!holy_test_bench_enabled ())
+    return;
+
+  src = malloc (BENCH_SIZE);
+  dst = malloc (BENCH_SIZE);
+  if (!src || !dst)
+    goto out;
+  for (i = 0; i < BENCH_SIZE; i++)
+    src[i] = dst[i] = rand ();
+
+  start = holy_test_bench_start ();
+  for (i = 0; i < BENCH_ROUNDS; i++)
+    holy_gf256_muladd_block (dst, src, 0x8e, BENCH_SIZE);
+  holy_test_bench_end (start, (double) BENCH_ROUNDS * BENCH_SIZE / (1 << 20),
+		       "MiB", "%s", impl);
+ out:
+  free (src);
+  free (dst);
+}
+
+static void
+gf256_test (void)
+{
+  unsigned i;
+
+  test_field ();
+
+  for (i = 0; i < ARRAY_SIZE (impls); i++)
+    {
+      if (holy_gf256_select (impls[i]) != 0)
+	continue;
+
+      test_blocks (impls[i]);
+      bench (impls[i]);
+    }
+}
+
+holy_UNIT_TEST ("gf256_test", gf256_test);
@@ -0,0 +1,408 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <holy/test.h>
+#include <holy/misc.h>
+#include <holy/deflate.h>
+
+holy_MOD_LICENSE ("GPLv2+");
+
+#define MSG "gzio test failed"
+
+#define PLAIN_SIZE 40000
+#define BENCH_ROUNDS 200
+
+/* Raw deflate streams of plain_text (): one with dynamic Huffman blocks,
+   one with fixed ones, and the first 300 bytes in a stored block.  */
+static const holy_uint8_t deflate_dynamic[] =
+{
+  0xed, 0x98, 0x41, 0x8e, 0x1d, 0x31, 0x08, 0x05, 0xf7, 0x3e, 0x05, 0x67,
+  0xf3, 0x8a, 0x05, 0x12, 0x1b, 0x16, 0xf1, 0xed, 0x53, 0xf4, 0x5c, 0x62,
+  0x12, 0x15, 0x51, 0x92, 0x3f, 0x7f, 0xdc, 0xf8, 0xf9, 0x41, 0x89, 0x96,
+  0xa7, 0xdf, 0x3b, 0x77, 0x3a, 0xfb, 0x74, 0xcc, 0xed, 0xee, 0x1b, 0xd1,
+  0xfc, 0x1f, 0xfd, 0x2a, 0xea, 0x55, 0x9d, 0x1b, 0xfc, 0xae, 0xe7, 0xbe,
+  0xee, 0xd7, 0x19, 0x6f, 0xa2, 0x73, 0xf2, 0xf6, 0x3b, 0xaf, 0x2b, 0xf9,
+  0x15, 0x4f, 0x26, 0x0f, 0x54, 0xdc, 0xae, 0xc7, 0xa7, 0xe9, 0x73, 0x58,
+  0xf3, 0x3a, 0xde, 0xab, 0x9e, 0x53, 0x1d, 0x37, 0x37, 0x65, 0xb0, 0x98,
+  0x15, 0x93, 0xf3, 0x3d, 0xf1, 0x86, 0x9f, 0xdf, 0x4b, 0xe2, 0x4e, 0x9e,
+  0xba, 0x8f, 0xf5, 0xa7, 0x3f, 0x11, 0x24, 0x0f, 0x36, 0xec, 0xc3, 0xb6,
+  0xc1, 0x93, 0x3d, 0xc3, 0xcf, 0xa7, 0x6b, 0x0e, 0xba, 0x7a, 0xc5, 0x04,
+  0xb2, 0x6f, 0xf5, 0xae, 0x62, 0xed, 0xec, 0xc6, 0xf7, 0x53, 0xd8, 0x55,
+  0x11, 0xf7, 0xc6, 0x3c, 0x3e, 0xf6, 0x46, 0xc5, 0x09, 0x64, 0xc7, 0x21,
+  0x5d, 0x24, 0xca, 0x6a, 0x72, 0x77, 0x3f, 0x28, 0x41, 0xe0, 0x3d, 0x3c,
+  0x34, 0x9b, 0x1e, 0x89, 0x28, 0x45, 0x0e, 0xa7, 0x3b, 0xa4, 0x64, 0x25,
+  0x0e, 0x90, 0x00, 0x5b, 0x58, 0xc8, 0x79, 0x39, 0xf1, 0xcb, 0xdd, 0xb3,
+  0x2f, 0xcb, 0x3b, 0xd7, 0x00, 0x36, 0x65, 0x7d, 0xf0, 0xdd, 0xe0, 0xe6,
+  0xdc, 0xfa, 0x6c, 0x78, 0x9c, 0xad, 0xf6, 0x63, 0x21, 0x04, 0x69, 0x58,
+  0xb7, 0x47, 0xda, 0xed, 0x86, 0xaf, 0x06, 0x2b, 0xf0, 0x82, 0xe3, 0x60,
+  0x7c, 0x7e, 0xe2, 0xea, 0xcd, 0xbc, 0x9b, 0x9c, 0xfd, 0x72, 0x92, 0xbb,
+  0xab, 0x6a, 0x95, 0xf4, 0xe0, 0x4d, 0x6f, 0xce, 0x35, 0x7b, 0xff, 0xe2,
+  0xcf, 0x5a, 0xc3, 0x96, 0x89, 0xdd, 0x08, 0xe5, 0x7c, 0xfd, 0x29, 0x40,
+  0x4f, 0xac, 0xf3, 0x64, 0x8b, 0x1b, 0x35, 0x18, 0x70, 0x8a, 0x27, 0x73,
+  0x8f, 0xcd, 0xb9, 0x2f, 0x8f, 0x9d, 0x38, 0x54, 0x05, 0x27, 0x0e, 0x59,
+  0xd6, 0x30, 0x7e, 0x93, 0x37, 0x0f, 0xae, 0xe5, 0xbb, 0x45, 0x6d, 0x22,
+  0xe3, 0xf3, 0xbd, 0xb6, 0x07, 0x28, 0xf7, 0x5a, 0x50, 0xf7, 0xde, 0x6c,
+  0xac, 0xe9, 0xbb, 0xce, 0x53, 0x5c, 0x3e, 0xac, 0x2f, 0xbd, 0xf6, 0x5d,
+  0xce, 0xfe, 0x19, 0x42, 0xff, 0x90, 0x03, 0x85, 0xac, 0xbd, 0xc8, 0x2f,
+  0x9c, 0xe6, 0x5c, 0x9d, 0x5b, 0xb6, 0x95, 0x78, 0xbf, 0x02, 0x1f, 0x9a,
+  0x05, 0x6d, 0x6f, 0xfb, 0x08, 0x53, 0xa8, 0x0a, 0xda, 0x8a, 0x33, 0x04,
+  0x6d, 0x35, 0xbb, 0x09, 0x82, 0x29, 0x49, 0xd6, 0xf6, 0x1f, 0x4a, 0xcf,
+  0x67, 0x29, 0x09, 0xd0, 0xc1, 0xe9, 0xd0, 0x45, 0x71, 0xd6, 0x0d, 0xf6,
+  0xd8, 0x7f, 0xf0, 0x38, 0xb7, 0xd3, 0xf8, 0x9a, 0x1c, 0xb4, 0x0f, 0x52,
+  0x87, 0xc7, 0xd0, 0xc5, 0x46, 0x13, 0xc5, 0x99, 0xcf, 0xca, 0xa1, 0x6e,
+  0x5f, 0x57, 0x6c, 0x42, 0x0e, 0xb6, 0x0a, 0xb6, 0x82, 0xf7, 0xfb, 0x6e,
+  0x5b, 0x0b, 0x3b, 0xd7, 0xb5, 0x4b, 0x9e, 0xaf, 0xf5, 0xb7, 0x22, 0x49,
+  0x85, 0xa3, 0x70, 0x82, 0x5a, 0x20, 0x81, 0x56, 0x67, 0x57, 0xfa, 0x19,
+  0x47, 0x70, 0x7c, 0xf6, 0xcf, 0x72, 0x41, 0xb6, 0x44, 0x02, 0xba, 0x72,
+  0x0b, 0x97, 0xf4, 0x50, 0xb0, 0x6d, 0xff, 0x74, 0x2b, 0x79, 0x71, 0x9f,
+  0x9a, 0xb0, 0xf5, 0x76, 0xc4, 0x5a, 0xb7, 0x65, 0xa5, 0x53, 0xf7, 0x6c,
+  0xa4, 0xff, 0x36, 0x5f, 0x2f, 0xd7, 0xc1, 0xed, 0x67, 0x6a, 0x5b, 0x95,
+  0xa4, 0xde, 0x66, 0x5c, 0x35, 0x5b, 0x12, 0x16, 0x57, 0xe6, 0x5a, 0xd9,
+  0x9f, 0x0c, 0x12, 0x6f, 0xf5, 0x3e, 0x74, 0x02, 0x9a, 0xb1, 0x90, 0xc2,
+  0xd4, 0xcc, 0x16, 0x0e, 0x2f, 0xb7, 0xdf, 0xe5, 0x5c, 0xce, 0xe5, 0x5c,
+  0xce, 0xe5, 0x5c, 0xce, 0xe5, 0x5c, 0xce, 0xe5, 0x5c, 0xce, 0xe5, 0xfc,
+  0xd7, 0x73, 0xfe, 0xc7, 0x30, 0x8c, 0xff, 0x3e, 0x9c, 0xe7, 0xce, 0x73,
+  0xe7, 0xb9, 0xef, 0xed, 0x72, 0x2e, 0xe7, 0x72, 0x2e, 0xe7, 0x72, 0x2e,
+  0xe7, 0x72, 0x2e, 0xe7, 0x72, 0x2e, 0xe7, 0x72, 0xee, 0x3d, 0x9c, 0x61,
+  0x18, 0xde, 0xc3, 0x39, 0xcf, 0x9d, 0xe7, 0xce, 0x73, 0xdf, 0xdb, 0xe5,
+  0x5c, 0xce, 0xe5, 0x5c, 0xce, 0xe5, 0x5c, 0xce, 0xe5, 0x5c, 0xce, 0xe5,
+  0x5c, 0xce, 0xbd, 0x87, 0x33, 0x0c, 0xc3, 0x7b, 0x38, 0xe7, 0xb9, 0xf3,
+  0xdc, 0x79, 0xee, 0x7b, 0xbb, 0x9c, 0xcb, 0xb9, 0x9c, 0xcb, 0xb9, 0x9c,
+  0xcb, 0xb9, 0x9c, 0xcb, 0xb9, 0x9c, 0xcb, 0xb9, 0x9c, 0x7b, 0x0f, 0x67,
+  0x18, 0x86, 0xf7, 0x70, 0xce, 0x73, 0xe7, 0xb9, 0xf3, 0xdc, 0xf7, 0x76,
+  0x39, 0x97, 0x73, 0x39, 0x97, 0x73, 0x39, 0x97, 0x73, 0x39, 0x97, 0x73,
+  0x39, 0x97, 0x73, 0xef, 0xe1, 0x0c, 0xc3, 0xf0, 0x1e, 0xce, 0x79, 0xee,
+  0x3c, 0x77, 0x9e, 0xfb, 0xde, 0x2e, 0xe7, 0x72, 0x2e, 0xe7, 0x72, 0x2e,
+  0xe7, 0x72, 0x2e, 0xe7, 0x72, 0x2e, 0xe7, 0x72, 0x2e, 0xe7, 0xde, 0xc3,
+  0x19, 0x86, 0xf7, 0x70, 0xce, 0x73, 0xe7, 0xb9, 0xf3, 0xdc, 0xf7, 0x76,
+  0x39, 0x97, 0x73, 0x39, 0x97, 0x73, 0x39, 0x97, 0x73, 0x39, 0x97, 0x73,
+  0x39, 0x97, 0x73, 0x39, 0xf7, 0x1e, 0xce, 0x30, 0x0c, 0xef, 0xe1, 0x9c,
+  0xe7, 0xce, 0x73, 0xe7, 0xb9, 0xef, 0xed, 0x72, 0x2e, 0xe7, 0x72, 0x2e,
+  0xe7, 0x72, 0x2e, 0xe7, 0x72, 0x2e, 0xe7, 0x72, 0x2e, 0xe7, 0xde, 0xc3,
+  0x19, 0x86, 0xf1, 0xef, 0xc4, 0x5f
+};
+
+static const holy_uint8_t deflate_fixed[] =
+{
+  0x2b, 0xc9, 0xaf, 0xac, 0xe4, 0x4a, 0x2a, 0xc9, 0xcf, 0xc8, 0xe7, 0xca,
+  0x57, 0x28, 0x49, 0xca, 0xcf, 0xcf, 0x4f, 0x52, 0x50, 0xc8, 0x07, 0xd2,
+  0x0a, 0xf9, 0x95, 0x39, 0x0a, 0x39, 0x95, 0x39, 0x39, 0x5c, 0x49, 0x0a,
+  0x40, 0xb9, 0xfc, 0x92, 0xa4, 0xca, 0xfc, 0xfc, 0xca, 0xfc, 0x0c, 0x85,
+  0xca, 0x12, 0x85, 0xfc, 0x8c, 0x92, 0x8c, 0xa4, 0xfc, 0x4a, 0xae, 0xca,
+  0xfc, 0x9c, 0x0c, 0xa0, 0x14, 0x50, 0x67, 0x06, 0x50, 0x43, 0x8e, 0x42,
+  0x52, 0x7e, 0x4e, 0x25, 0x90, 0x55, 0x92, 0xcf, 0xc5, 0x05, 0x54, 0x53,
+  0x99, 0xaf, 0x50, 0x59, 0x99, 0x93, 0x5f, 0xc2, 0x95, 0x93, 0xaf, 0x90,
+  0x94, 0x01, 0x32, 0x52, 0x01, 0xa8, 0x18, 0xa8, 0xa2, 0x24, 0xa3, 0x04,
+  0xac, 0xa3, 0xb2, 0x04, 0xc8, 0xaf, 0xac, 0xcc, 0x00, 0x82, 0xa4, 0x92,
+  0x0c, 0xae, 0x9c, 0xa4, 0x4a, 0xa0, 0x7a, 0xae, 0x7c, 0xb0, 0x23, 0x80,
+  0x86, 0x2b, 0x00, 0x2d, 0xcc, 0xe7, 0x02, 0x5a, 0xab, 0x00, 0xd4, 0x99,
+  0x5f, 0x52, 0x02, 0xe4, 0x73, 0xe5, 0xe7, 0x94, 0x70, 0x01, 0xdd, 0x95,
+  0x0f, 0x72, 0x8c, 0x02, 0xd0, 0xd9, 0x49, 0x39, 0xf9, 0x20, 0x55, 0x40,
+  0xb5, 0x25, 0x20, 0x8b, 0x93, 0xc0, 0x2e, 0xcc, 0xcf, 0xc9, 0x51, 0x50,
+  0x48, 0x4a, 0x52, 0x28, 0xa9, 0x04, 0x32, 0xf3, 0x41, 0x20, 0x47, 0x81,
+  0x4b, 0x01, 0xe8, 0x6c, 0x05, 0x2e, 0xa0, 0x71, 0x0a, 0x19, 0x40, 0x97,
+  0xe5, 0x94, 0x64, 0x80, 0x6c, 0xe7, 0x02, 0xba, 0x04, 0xe8, 0xc0, 0x24,
+  0x2e, 0xa0, 0xa6, 0x12, 0x90, 0xf1, 0x40, 0x27, 0x02, 0x5d, 0x0a, 0x74,
+  0x0e, 0xd0, 0x77, 0x5c, 0x40, 0x23, 0x81, 0x2a, 0x81, 0x21, 0x00, 0x34,
+  0x00, 0x18, 0x2c, 0x40, 0x85, 0x40, 0xff, 0x02, 0x7d, 0x5c, 0x99, 0x01,
+  0xb2, 0x33, 0x3f, 0x09, 0xa8, 0x3c, 0x3f, 0x03, 0x14, 0x00, 0x40, 0x4b,
+  0x81, 0xea, 0x15, 0x80, 0x62, 0x25, 0xc0, 0xd0, 0x2c, 0x49, 0xca, 0x01,
+  0x07, 0x43, 0x25, 0xd0, 0x6f, 0x39, 0x20, 0x66, 0x0e, 0xd0, 0x21, 0x40,
+  0xa7, 0x01, 0x83, 0x0e, 0xe4, 0x25, 0x90, 0x75, 0x25, 0x40, 0xa1, 0x12,
+  0x60, 0x50, 0x00, 0xc3, 0x02, 0xe8, 0x1d, 0x60, 0xc0, 0x67, 0x80, 0x1d,
+  0x97, 0x53, 0x59, 0x52, 0x52, 0x99, 0x94, 0x01, 0xf4, 0x7b, 0x12, 0xd0,
+  0x27, 0x49, 0x20, 0x55, 0x39, 0x20, 0x97, 0xe4, 0x97, 0x00, 0xc3, 0x26,
+  0x1f, 0x64, 0x26, 0x28, 0xb0, 0x41, 0x18, 0x18, 0x3e, 0xa0, 0xa0, 0x01,
+  0x5a, 0x99, 0x01, 0x0c, 0x6e, 0xa0, 0x43, 0x81, 0xfe, 0xcb, 0x07, 0xbb,
+  0x00, 0xe8, 0x1e, 0x05, 0x50, 0xc8, 0x03, 0x4d, 0x53, 0x48, 0x52, 0xc8,
+  0x29, 0x01, 0x06, 0x00, 0x57, 0x0e, 0x50, 0x67, 0x06, 0xc8, 0xdb, 0x40,
+  0x7f, 0x27, 0x01, 0xb5, 0x71, 0x29, 0x70, 0x01, 0x63, 0x05, 0x18, 0x12,
+  0x5c, 0x40, 0x53, 0x40, 0x01, 0x06, 0x94, 0xc9, 0x48, 0xca, 0xe0, 0x02,
+  0x86, 0x5a, 0x46, 0x65, 0x52, 0x0e, 0x30, 0x6e, 0x14, 0x32, 0x14, 0xc0,
+  0xe1, 0x9e, 0x03, 0x4a, 0x03, 0xc0, 0xe8, 0x06, 0x05, 0x41, 0x4e, 0x52,
+  0x52, 0x52, 0x46, 0x3e, 0x30, 0x68, 0xf2, 0x93, 0x40, 0x21, 0x0f, 0x8c,
+  0x5c, 0x20, 0x03, 0x14, 0x2e, 0xf9, 0xa0, 0xe0, 0x4b, 0x02, 0xfa, 0x1d,
+  0x1c, 0x20, 0xc0, 0xf4, 0x03, 0x34, 0x03, 0xe8, 0x42, 0xa0, 0xda, 0x24,
+  0xa0, 0xf3, 0x73, 0x80, 0x21, 0x0d, 0xf4, 0x57, 0x7e, 0x06, 0x28, 0xda,
+  0x40, 0x4e, 0x4c, 0x02, 0x47, 0x30, 0x17, 0x30, 0xb1, 0x00, 0xdd, 0x56,
+  0x09, 0x4a, 0x47, 0xc0, 0x40, 0x01, 0xc6, 0x0a, 0xd0, 0x6d, 0x39, 0x40,
+  0x3f, 0x28, 0x00, 0x93, 0x55, 0x09, 0xc8, 0x12, 0xa0, 0x83, 0x81, 0x51,
+  0x92, 0x91, 0x03, 0x4a, 0x7f, 0x40, 0x97, 0x72, 0x81, 0x83, 0x14, 0x68,
+  0x00, 0xd0, 0x1d, 0x40, 0xdf, 0x01, 0xdd, 0x05, 0x8c, 0x1c, 0x50, 0x68,
+  0x00, 0xed, 0x00, 0x11, 0xc0, 0x30, 0xce, 0x00, 0xa5, 0x34, 0xa0, 0x30,
+  0xd0, 0x0c, 0x60, 0xf2, 0x01, 0x3a, 0xb5, 0x04, 0xa8, 0x0d, 0xe8, 0x2e,
+  0xa0, 0x45, 0x25, 0x0a, 0x39, 0x40, 0x3f, 0x73, 0x81, 0x9c, 0x03, 0x8c,
+  0x37, 0x70, 0xaa, 0x00, 0x19, 0x08, 0xf4, 0x18, 0xc8, 0x05, 0xa0, 0x18,
+  0x4c, 0x02, 0x8b, 0x81, 0x92, 0x16, 0x30, 0x38, 0x41, 0xa1, 0x96, 0x04,
+  0x34, 0x07, 0x9c, 0xf4, 0x41, 0x31, 0x92, 0x01, 0x8c, 0x61, 0x85, 0x1c,
+  0x60, 0x48, 0x00, 0xe3, 0x02, 0xe8, 0x04, 0x60, 0x52, 0x07, 0xda, 0x0a,
+  0x4c, 0xcf, 0xc0, 0x10, 0x01, 0x86, 0x78, 0x09, 0x08, 0x82, 0xf2, 0x05,
+  0xd0, 0xb4, 0x0c, 0xa0, 0x13, 0x80, 0xee, 0xca, 0x00, 0x45, 0x5c, 0x06,
+  0x30, 0x0d, 0x29, 0x00, 0xad, 0xcd, 0x87, 0xa4, 0x56, 0xa0, 0xb9, 0xc0,
+  0xd0, 0x07, 0xc6, 0x09, 0xd0, 0x6a, 0x50, 0x8a, 0x00, 0x05, 0x1d, 0x28,
+  0x5a, 0x81, 0x29, 0x15, 0xe4, 0x37, 0xa0, 0xf1, 0x60, 0xcb, 0x41, 0x61,
+  0x09, 0x0a, 0x41, 0x50, 0x7a, 0x06, 0xc6, 0x6d, 0x4e, 0x4e, 0x06, 0xd0,
+  0x68, 0x50, 0x62, 0x04, 0xb9, 0x06, 0x14, 0x25, 0x40, 0xc5, 0x39, 0x19,
+  0x19, 0xa0, 0xa0, 0xcc, 0x07, 0x3b, 0x03, 0x68, 0x30, 0x28, 0xf6, 0xc0,
+  0x59, 0x47, 0x01, 0x98, 0x9b, 0x81, 0x41, 0x08, 0x8c, 0x98, 0x9c, 0x92,
+  0x12, 0x50, 0xc4, 0x01, 0xc3, 0x12, 0x94, 0xde, 0x47, 0xf3, 0xf9, 0x68,
+  0x3e, 0x1f, 0xcd, 0xe7, 0xa3, 0xf9, 0x7c, 0x34, 0x9f, 0x8f, 0xe6, 0xf3,
+  0xd1, 0x7c, 0x3e, 0x9a, 0xcf, 0x47, 0xf3, 0xf9, 0x68, 0x3e, 0x1f, 0xcd,
+  0xe7, 0x83, 0x3e, 0x9f, 0x57, 0x8c, 0x82, 0x51, 0x30, 0x0a, 0x86, 0x3d,
+  0x18, 0xad, 0xcf, 0x47, 0xeb, 0xf3, 0xd1, 0xfa, 0x7c, 0xb4, 0xdd, 0x3e,
+  0x9a, 0xcf, 0x47, 0xf3, 0xf9, 0x68, 0x3e, 0x1f, 0xcd, 0xe7, 0xa3, 0xf9,
+  0x7c, 0x34, 0x9f, 0x8f, 0xe6, 0xf3, 0xd1, 0x7c, 0x3e, 0x9a, 0xcf, 0x47,
+  0xf3, 0xf9, 0x68, 0x3e, 0x1f, 0x1d, 0x87, 0x1b, 0x05, 0xa3, 0x60, 0x14,
+  0x8c, 0x8e, 0xc3, 0x8d, 0xd6, 0xe7, 0xa3, 0xf5, 0xf9, 0x68, 0x7d, 0x3e,
+  0xda, 0x6e, 0x1f, 0xcd, 0xe7, 0xa3, 0xf9, 0x7c, 0x34, 0x9f, 0x8f, 0xe6,
+  0xf3, 0xd1, 0x7c, 0x3e, 0x9a, 0xcf, 0x47, 0xf3, 0xf9, 0x68, 0x3e, 0x1f,
+  0xcd, 0xe7, 0xa3, 0xf9, 0x7c, 0x74, 0x1c, 0x6e, 0x14, 0x8c, 0x82, 0x51,
+  0x30, 0x3a, 0x0e, 0x37, 0x5a, 0x9f, 0x8f, 0xd6, 0xe7, 0xa3, 0xf5, 0xf9,
+  0x68, 0xbb, 0x7d, 0x34, 0x9f, 0x8f, 0xe6, 0xf3, 0xd1, 0x7c, 0x3e, 0x9a,
+  0xcf, 0x47, 0xf3, 0xf9, 0x68, 0x3e, 0x1f, 0xcd, 0xe7, 0xa3, 0xf9, 0x7c,
+  0x34, 0x9f, 0x8f, 0xe6, 0xf3, 0xd1, 0x7c, 0x3e, 0x3a, 0x0e, 0x37, 0x0a,
+  0x46, 0xc1, 0x28, 0x18, 0x1d, 0x87, 0x1b, 0xad, 0xcf, 0x47, 0xeb, 0xf3,
+  0xd1, 0xfa, 0x7c, 0xb4, 0xdd, 0x3e, 0x9a, 0xcf, 0x47, 0xf3, 0xf9, 0x68,
+  0x3e, 0x1f, 0xcd, 0xe7, 0xa3, 0xf9, 0x7c, 0x34, 0x9f, 0x8f, 0xe6, 0xf3,
+  0xd1, 0x7c, 0x3e, 0x9a, 0xcf, 0x47, 0xf3, 0xf9, 0xe8, 0x38, 0xdc, 0x28,
+  0x18, 0x05, 0xa3, 0x60, 0x74, 0x1c, 0x6e, 0xb4, 0x3e, 0x1f, 0xad, 0xcf,
+  0x47, 0xeb, 0xf3, 0xd1, 0x76, 0xfb, 0x68, 0x3e, 0x1f, 0xcd, 0xe7, 0xa3,
+  0xf9, 0x7c, 0x34, 0x9f, 0x8f, 0xe6, 0xf3, 0xd1, 0x7c, 0x3e, 0x9a, 0xcf,
+  0x47, 0xf3, 0xf9, 0x68, 0x3e, 0x1f, 0xcd, 0xe7, 0xa3, 0xf9, 0x7c, 0x74,
+  0x1c, 0x6e, 0x14, 0x8c, 0x82, 0xd1, 0x71, 0xb8, 0xd1, 0xfa, 0x7c, 0xb4,
+  0x3e, 0x1f, 0xad, 0xcf, 0x47, 0xdb, 0xed, 0xa3, 0xf9, 0x7c, 0x34, 0x9f,
+  0x8f, 0xe6, 0xf3, 0xd1, 0x7c, 0x3e, 0x9a, 0xcf, 0x47, 0xf3, 0xf9, 0x68,
+  0x3e, 0x1f, 0xcd, 0xe7, 0xa3, 0xf9, 0x7c, 0x34, 0x9f, 0x8f, 0xe6, 0xf3,
+  0xd1, 0x71, 0xb8, 0x51, 0x30, 0x0a, 0x46, 0xc1, 0xe8, 0x38, 0xdc, 0x68,
+  0x7d, 0x3e, 0x5a, 0x9f, 0x8f, 0xd6, 0xe7, 0xa3, 0xed, 0xf6, 0xd1, 0x7c,
+  0x3e, 0x9a, 0xcf, 0x47, 0xf3, 0xf9, 0x68, 0x3e, 0x1f, 0xcd, 0xe7, 0xa3,
+  0xf9, 0x7c, 0x34, 0x9f, 0x8f, 0xe6, 0xf3, 0xd1, 0x7c, 0x3e, 0x9a, 0xcf,
+  0x47, 0xc7, 0xe1, 0x46, 0xc1, 0x28, 0x18, 0x05, 0x43, 0x07, 0x00, 0x00
+};
+
+static const holy_uint8_t deflate_stored[] =
+{
+  0x01, 0x2c, 0x01, 0xd3, 0xfe, 0x74, 0x6f, 0x79, 0x79, 0x0a, 0x62, 0x74,
+  0x6f, 0x68, 0x6f, 0x0a, 0x6f, 0x20, 0x74, 0x62, 0x6f, 0x6f, 0x6f, 0x62,
+  0x20, 0x20, 0x6f, 0x62, 0x6f, 0x6f, 0x20, 0x6f, 0x79, 0x6c, 0x20, 0x6c,
+  0x79, 0x6c, 0x6c, 0x0a, 0x62, 0x20, 0x6f, 0x0a, 0x6f, 0x6f, 0x74, 0x62,
+  0x79, 0x6f, 0x6f, 0x79, 0x6f, 0x68, 0x20, 0x79, 0x74, 0x20, 0x6f, 0x68,
+  0x74, 0x68, 0x62, 0x6f, 0x79, 0x0a, 0x79, 0x6f, 0x6c, 0x68, 0x0a, 0x6f,
+  0x6f, 0x0a, 0x6f, 0x20, 0x68, 0x6f, 0x6f, 0x20, 0x6c, 0x20, 0x62, 0x6f,
+  0x6c, 0x79, 0x68, 0x6f, 0x6f, 0x74, 0x6f, 0x0a, 0x0a, 0x20, 0x6f, 0x68,
+  0x79, 0x6f, 0x20, 0x79, 0x79, 0x6c, 0x6f, 0x74, 0x0a, 0x6c, 0x6f, 0x20,
+  0x62, 0x68, 0x62, 0x6f, 0x6f, 0x20, 0x20, 0x0a, 0x6f, 0x6f, 0x6c, 0x79,
+  0x68, 0x74, 0x68, 0x74, 0x6f, 0x20, 0x68, 0x6f, 0x6f, 0x79, 0x74, 0x0a,
+  0x6f, 0x6f, 0x79, 0x79, 0x68, 0x68, 0x68, 0x68, 0x62, 0x74, 0x68, 0x0a,
+  0x6c, 0x62, 0x79, 0x79, 0x79, 0x6c, 0x0a, 0x6f, 0x62, 0x6f, 0x6f, 0x6f,
+  0x62, 0x79, 0x0a, 0x79, 0x20, 0x79, 0x6f, 0x6f, 0x6f, 0x0a, 0x62, 0x79,
+  0x6f, 0x20, 0x6f, 0x20, 0x20, 0x6f, 0x74, 0x74, 0x20, 0x79, 0x6f, 0x0a,
+  0x6f, 0x6c, 0x74, 0x0a, 0x79, 0x6c, 0x20, 0x6f, 0x62, 0x79, 0x6f, 0x6f,
+  0x20, 0x62, 0x74, 0x6f, 0x62, 0x6c, 0x6f, 0x79, 0x6f, 0x6f, 0x6f, 0x79,
+  0x20, 0x79, 0x74, 0x68, 0x6f, 0x6f, 0x74, 0x62, 0x6f, 0x79, 0x6f, 0x68,
+  0x20, 0x6f, 0x6c, 0x6c, 0x20, 0x20, 0x62, 0x62, 0x20, 0x74, 0x79, 0x20,
+  0x6f, 0x6c, 0x6f, 0x6f, 0x6f, 0x6f, 0x6f, 0x6c, 0x20, 0x0a, 0x20, 0x74,
+  0x20, 0x6f, 0x20, 0x0a, 0x0a, 0x62, 0x79, 0x20, 0x68, 0x68, 0x79, 0x6f,
+  0x6c, 0x74, 0x68, 0x79, 0x74, 0x0a, 0x6f, 0x0a, 0x68, 0x74, 0x6f, 0x6f,
+  0x74, 0x0a, 0x62, 0x0a, 0x68, 0x20, 0x6f, 0x74, 0x79, 0x6f, 0x0a, 0x6f,
+  0x20, 0x20, 0x0a, 0x68, 0x62, 0x6f, 0x68, 0x62, 0x74, 0x6f, 0x79, 0x0a,
+  0x0a, 0x74, 0x68, 0x6f, 0x79, 0x6f, 0x6c, 0x6c, 0x6c, 0x0a, 0x6f, 0x6f,
+  0x6c, 0x6f, 0x62, 0x20, 0x6f
+};
+
+/* Blocks of 1000 bytes; every fifth one is a run of 'x' and the rest
+   repeat the same pseudo-random text, so matches reach back both within
+   and across the 32K window.  */
+static void
+plain_text (holy_uint8_t *buf, holy_size_t len)
+{
+  static const char alpha[] = "holy boot\n";
+  holy_uint32_t x = 1;
+  holy_size_t i;
+
+  for (i = 0; i < len; i++)
+    {
+      if ((i / 1000) % 5 == 4)
+	{
+	  buf[i] = 'x';
+	  continue;
+	}
+      if (i % 1000 == 0)
+	x = 1;
+      x = x * 1103515245 + 12345;
+      buf[i] = alpha[(x >> 16) % 10];
+    }
+}
+
+static holy_uint32_t
+crc32_gzip (const holy_uint8_t *buf, holy_size_t len)
+{
+  static holy_uint32_t table[256];
+  holy_uint32_t crc = 0xffffffff;
+  int i, j;
+
+  if (!table[1])
+    for (i = 0; i < 256; i++)
+      {
+	holy_uint32_t c = i;
+	for (j = 0; j < 8; j++)
+	  c = (c >> 1) ^ (0xedb88320 & -(c & 1));
+	table[i] = c;
+      }
+
+  while (len--)
+    crc = (crc >> 8) ^ table[(crc ^ *buf++) & 0xff];
+  return ~crc;
+}
+
+static void
+check_stream (const char *name, const holy_uint8_t *in, holy_size_t insize,
+	      const holy_uint8_t *plain, holy_size_t size)
+{
+  holy_uint8_t *out;
+  holy_ssize_t ret;
+  holy_size_t off, len;
+
+  out = malloc (size);
+  holy_test_assert (out != NULL, MSG);
+  if (!out)
+    return;
+
+  ret = holy_deflate_decompress ((char *) in, insize, 0, (char *) out, size);
+  holy_test_assert (ret == (holy_ssize_t) size
+		    && memcmp (out, plain, size) == 0,
+		    "%s: full decode mismatch", name);
+
+  /* Reads starting anywhere, including across window boundaries.  */
+  for (off = 0; off < size; off += 2999)
+    for (len = 1; len <= 40000 && off + len <= size; len *= 7)
+      {
+	ret = holy_deflate_decompress ((char *) in, insize, off,
+				       (char *) out, len);
+	holy_test_assert (ret == (holy_ssize_t) len
+			  && memcmp (out, plain + off, len) == 0,
+			  "%s: mismatch at offset %d length %d",
+			  name, (int) off, (int) len);
+      }
+
+  free (out);
+}
+
+/* Decode one single-member gzip file from the corpus, check it against
+   its trailer and report the throughput.  */
+static void
+bench_file (const char *path)
+{
+  holy_uint8_t *in, *out;
+  holy_size_t insize, hdr, size;
+  holy_ssize_t ret;
+  holy_uint64_t start;
+  FILE *fp;
+  long n;
+
+  fp = fopen (path, "rb");
+  if (!fp)
+    return;
+  fseek (fp, 0, SEEK_END);
+  n = ftell (fp);
+  rewind (fp);
+  in = malloc (n);
+  if (!in || n < 18 || fread (in, 1, n, fp) != (size_t) n
+      || in[0] != 0x1f || in[1] != 0x8b || in[2] != 8)
+    {
+      printf ("%s: not a gzip file, skipped\n", path);
+      free (in);
+      fclose (fp);
+      return;
+    }
+  fclose (fp);
+  insize = n;
+
+  hdr = 10;
+  if (in[3] & 4)
+    hdr += 2 + (in[hdr] | (in[hdr + 1] << 8));
+  if (in[3] & 8)
+    hdr += strnlen ((char *) in + hdr, insize - hdr) + 1;
+  if (in[3] & 16)
+    hdr += strnlen ((char *) in + hdr, insize - hdr) + 1;
+  if (in[3] & 2)
+    hdr += 2;
+  size = holy_get_unaligned32 (in + insize - 4);
+
+  out = malloc (size);
+  holy_test_assert (out != NULL, MSG);
+  if (!out || hdr >= insize - 8)
+    {
+      free (in);
+      free (out);
+      return;
+    }
+
+  start = holy_test_bench_start ();
+  ret = holy_deflate_decompress ((char *) in + hdr, insize - hdr - 8, 0,
+				 (char *) out, size);
+  holy_test_bench_end (start, (double) size / (1 << 20), "MiB", "%s", path);
+  holy_test_assert (ret == (holy_ssize_t) size
+		    && crc32_gzip (out, size)
+		    == holy_get_unaligned32 (in + insize - 8),
+		    "%s: decoded data does not match the trailer", path);
+  free (in);
+  free (out);
+}
+
+static void
+gzio_test (void)
+{
+  holy_uint8_t *plain;
+  const char *corpus;
+  char *list, *path;
+  holy_uint64_t start;
+  int i;
+
+  plain = malloc (PLAIN_SIZE);
+  holy_test_assert (plain != NULL, MSG);
+  if (!plain)
+    return;
+  plain_text (plain, PLAIN_SIZE);
+
+  check_stream ("dynamic", deflate_dynamic, sizeof (deflate_dynamic),
+		plain, PLAIN_SIZE);
+  check_stream ("fixed", deflate_fixed, sizeof (deflate_fixed),
+		plain, PLAIN_SIZE);
+  check_stream ("stored", deflate_stored, sizeof (deflate_stored),
+		plain, 300);
+
+  if (holy_test_bench_enabled ())
+    {
+      start = holy_test_bench_start ();
+      for (i = 0; i < BENCH_ROUNDS; i++)
+	holy_deflate_decompress ((char *) deflate_dynamic,
+				 sizeof (deflate_dynamic), 0,
+				 (char *) plain, PLAIN_SIZE);
+      holy_test_bench_end (start,
+			   (double) PLAIN_SIZE * BENCH_ROUNDS / (1 << 20),
+			   "MiB", "builtin");
+    }
+
+  /* HOLY_GZIO_CORPUS is a space-separated list of gzip files, such as
+     real initrds, to benchmark.  The test only uses the public
+     decompression interface, so the same run against an older tree
+     gives the baseline to compare with.  */
+  corpus = getenv ("HOLY_GZIO_CORPUS");
+  if (corpus)
+    {
+      list = strdup (corpus);
+      for (path = strtok (list, " "); path; path = strtok (NULL, " "))
+	bench_file (path);
+      free (list);
+    }
+
+  free (plain);
+}
+
+holy_UNIT_TEST ("gzio_test", gzio_test);
@@ -7,10 +7,41 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <time.h>
 
 #include <holy/list.h>
 #include <holy/test.h>
 
+int
+holy_test_bench_enabled (void)
+{
+  const char *env = getenv ("HOLY_TEST_BENCH");
+
+  return env && *env && strcmp (env, "0") != 0;
+}
+
+holy_uint64_t
+holy_test_bench_start (void)
+{
+  return clock ();
+}
+
+void
+holy_test_bench_end (holy_uint64_t start, double amount, const char *unit,
+		     const char *fmt, ...)
+{
+  double secs = (double) (clock () - (clock_t) start) / CLOCKS_PER_SEC;
+  char name[64];
+  va_list ap;
+
+  va_start (ap, fmt);
+  vsnprintf (name, sizeof (name), fmt, ap);
+  va_end (ap);
+
+  if (secs > 0)
+    printf ("%-24s %10.1f %s/s\n", name, amount / secs, unit);
+}
+
 int
 main (int argc __attribute__ ((unused)),
       char *argv[] __attribute__ ((unused)))
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <holy/test.h>
+#include <holy/misc.h>
+#include <holy/crypto.h>
+
+holy_MOD_LICENSE ("GPLv2+");
+
+#define MSG "pbkdf2 test failed"
+
+#define BENCH_ITERATIONS 200000
+
+static const char *const impls[] = { "shani", "avx2", "generic" };
+
+static struct
+{
+  const gcry_md_spec_t *md;
+  const char *P;
+  const char *S;
+  unsigned int c;
+  holy_size_t dkLen;
+  const char *DK;
+} vectors[] = {
+  /* RFC 6070.  */
+  {
+    holy_MD_SHA1, "password", "salt", 4096, 20,
+    "\x4b\x00\x79\x01\xb7\x65\x48\x9a\xbe\xad\x49\xd9\x26\xf7"
+    "\x21\xd0\x65\xa4\x29\xc1"
+  },
+  {
+    holy_MD_SHA1, "passwordPASSWORDpassword",
+    "saltSALTsaltSALTsaltSALTsaltSALTsalt", 4096, 25,
+    "\x3d\x2e\xec\x4f\xe4\x1c\x84\x9b\x80\xc8\xd8\x36\x62\xc0"
+    "\xe4\x4a\x8b\x29\x1a\x96\x4c\xf2\xf0\x70\x38"
+  },
+  /* RFC 7914, section 11.  */
+  {
+    holy_MD_SHA256, "passwd", "salt", 1, 64,
+    "\x55\xac\x04\x6e\x56\xe3\x08\x9f\xec\x16\x91\xc2\x25\x44\xb6\x05"
+    "\xf9\x41\x85\x21\x6d\xde\x04\x65\xe6\x8b\x9d\x57\xc2\x0d\xac\xbc"
+    "\x49\xca\x9c\xcc\xf1\x79\xb6\x45\x99\x16\x64\xb3\x9d\x77\xef\x31"
+    "\x7c\x71\xb8\x45\xb1\xe3\x0b\xd5\x09\x11\x20\x41\xd3\xa1\x97\x83"
+  },
+  {
+    holy_MD_SHA256, "Password", "NaCl", 80000, 64,
+    "\x4d\xdc\xd8\xf6\x0b\x98\xbe\x21\x83\x0c\xee\x5e\xf2\x27\x01\xf9"
+    "\x64\x1a\x44\x18\xd0\x4c\x04\x14\xae\xff\x08\x87\x6b\x34\xab\x56"
+    "\xa1\xd4\x25\xa1\x22\x58\x33\x54\x9a\xdb\x84\x1b\x51\xc9\xb3\x17"
+    "\x6a\x27\x2b\xde\xbb\xa1\xd0\x78\x47\x8f\x62\xb3\x97\xf3\x3c\x8d"
+  }
+};
+
+/* Several jobs at once must give what they give one at a time, whatever
+   their iteration counts and lengths.  */
+static void
+test_multi (const char *impl, const gcry_md_spec_t *md)
+{
+  struct holy_crypto_pbkdf2_job jobs[4];
+  holy_uint8_t salt[4][40], dk[4][100], ref[100];
+  const char *P = "correct horse battery staple";
+  int round, j, k;
+
+  for (round = 0; round < 10; round++)
+    {
+      int njobs = 1 + rand () % 4;
+
+      for (j = 0; j < njobs; j++)
+	{
+	  for (k = 0; k < 40; k++)
+	    salt[j][k] = rand ();
+	  jobs[j].salt = salt[j];
+	  jobs[j].salt_len = 1 + rand () % 40;
+	  jobs[j].iterations = 1 + rand () % 1000;
+	  jobs[j].dk = dk[j];
+	  jobs[j].dk_len = 1 + rand () % 100;
+	}
+      holy_test_assert (holy_crypto_pbkdf2_multi (md, (const holy_uint8_t *) P,
+						  strlen (P), jobs, njobs)
+			== GPG_ERR_NO_ERROR, MSG);
+
+      /* The single-job path is checked against the vectors.  */
+      for (j = 0; j < njobs; j++)
+	{
+	  holy_crypto_pbkdf2 (md, (const holy_uint8_t *) P, strlen (P),
+			      jobs[j].salt, jobs[j].salt_len,
+			      jobs[j].iterations, ref, jobs[j].dk_len);
+	  holy_test_assert (memcmp (ref, dk[j], jobs[j].dk_len) == 0,
+			    "%s: %s job %d of %d differs", impl, md->name,
+			    j, njobs);
+	}
+    }
+}
+
+static void
+bench (const char *impl, const gcry_md_spec_t *md)
+{
+  holy_uint8_t dk[64];
+  holy_uint64_t start;
+
+  if (!holy_test_bench_enabled ())
+    return;
+
+  start = holy_test_bench_start ();
+  holy_crypto_pbkdf2 (md, (const holy_uint8_t *) "password", 8,
+		      (const holy_uint8_t *) "salt", 4, BENCH_ITERATIONS,
+		      dk, md->mdlen);
+  holy_test_bench_end (start, BENCH_ITERATIONS, "iterations", "%s %s",
+		       impl, md->name);
+}
+
+static void
+pbkdf2_test (void)
+{
+  holy_uint8_t DK[64];
+  unsigned i, v;
+
+  for (i = 0; i < ARRAY_SIZE (impls); i++)
+    {
+      if (holy_crypto_pbkdf2_select (impls[i]) != 0)
+	continue;
+
+      for (v = 0; v < ARRAY_SIZE (vectors); v++)
+	{
+	  holy_crypto_pbkdf2 (vectors[v].md,
+			      (const holy_uint8_t *) vectors[v].P,
+			      strlen (vectors[v].P),
+			      (const holy_uint8_t *) vectors[v].S,
+			      strlen (vectors[v].S), vectors[v].c,
+			      DK, vectors[v].dkLen);
+	  holy_test_assert (memcmp (DK, vectors[v].DK, vectors[v].dkLen) == 0,
+			    "%s: vector %d mismatch", impls[i], v);
+	}
+
+      test_multi (impls[i], holy_MD_SHA1);
+      test_multi (impls[i], holy_MD_SHA256);
+
+      bench (impls[i], holy_MD_SHA1);
+      bench (impls[i], holy_MD_SHA256);
+    }
+
+  /* Everything else goes through the gcry code.  */
+  bench ("gcry", holy_MD_SHA512);
+}
+
+holy_UNIT_TEST ("pbkdf2_test", pbkdf2_test);
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <holy/test.h>
+#include <holy/misc.h>
+#include <holy/video.h>
+
+holy_MOD_LICENSE ("GPLv2+");
+
+#define W 256
+#define H 192
+
+static unsigned char wanted[H][W];
+
+static holy_uint64_t
+damage_area (const struct holy_video_damage *damage)
+{
+  holy_uint64_t area = 0;
+  unsigned i;
+
+  for (i = 0; i < damage->count; i++)
+    area += (holy_uint64_t) damage->rects[i].width * damage->rects[i].height;
+  return area;
+}
+
+static int
+covered (const struct holy_video_damage *damage, unsigned x, unsigned y)
+{
+  unsigned i;
+
+  for (i = 0; i < damage->count; i++)
+    if (x >= damage->rects[i].x && x < damage->rects[i].x
+	+ damage->rects[i].width
+	&& y >= damage->rects[i].y && y < damage->rects[i].y
+	+ damage->rects[i].height)
+      return 1;
+  return 0;
+}
+
+static void
+test_shapes (void)
+{
+  struct holy_video_damage damage;
+  unsigned i;
+
+  holy_video_damage_reset (&damage);
+  holy_test_assert (holy_video_damage_is_empty (&damage), "not empty");
+
+  /* A line of glyphs is one rectangle.  */
+  for (i = 0; i < 40; i++)
+    holy_video_damage_add (&damage, 100 + i * 8, 300, 8, 16);
+  holy_test_assert (damage.count == 1, "glyphs left %u rectangles",
+		    damage.count);
+  holy_test_assert (damage_area (&damage) == 40 * 8 * 16,
+		    "glyphs grew to %llu pixels",
+		    (unsigned long long) damage_area (&damage));
+
+  /* A cursor far away from a timeout label stays apart from it.  */
+  holy_video_damage_reset (&damage);
+  holy_video_damage_add (&damage, 10, 2000, 8, 2);
+  holy_video_damage_add (&damage, 3500, 40, 200, 24);
+  holy_test_assert (damage.count == 2, "cursor and label merged");
+  holy_test_assert (damage_area (&damage) == 8 * 2 + 200 * 24,
+		    "cursor and label grew");
+
+  /* Clipping at the top left corner.  */
+  holy_video_damage_reset (&damage);
+  holy_video_damage_add (&damage, -5, -5, 5, 100);
+  holy_video_damage_add (&damage, -5, 3, 10, 0);
+  holy_test_assert (holy_video_damage_is_empty (&damage),
+		    "offscreen rectangle kept");
+  holy_video_damage_add (&damage, -5, -3, 10, 10);
+  holy_test_assert (damage.count == 1 && damage.rects[0].x == 0
+		    && damage.rects[0].y == 0 && damage.rects[0].width == 5
+		    && damage.rects[0].height == 7, "bad clipping");
+}
+
+/* Whatever is added stays covered, however many rectangles come in.  */
+static void
+test_cover (void)
+{
+  struct holy_video_damage damage, other;
+  int round, i;
+  unsigned x, y;
+
+  for (round = 0; round < 300; round++)
+    {
+      int n = 1 + rand () % 60;
+
+      memset (wanted, 0, sizeof (wanted));
+      holy_video_damage_reset (&damage);
+      holy_video_damage_reset (&other);
+      for (i = 0; i < n; i++)
+	{
+	  unsigned rx = rand () % W, ry = rand () % H;
+	  unsigned rw = 1 + rand () % (round & 1 ? 8 : 64);
+	  unsigned rh = 1 + rand () % (round & 1 ? 8 : 64);
+
+	  if (rx + rw > W)
+	    rw = W - rx;
+	  if (ry + rh > H)
+	    rh = H - ry;
+	  for (y = ry; y < ry + rh; y++)
+	    memset (&wanted[y][rx], 1, rw);
+	  holy_video_damage_add (i & 1 ? &other : &damage, rx, ry, rw, rh);
+	}
+      holy_video_damage_merge (&damage, &other);
+
+      holy_test_assert (damage.count <= holy_VIDEO_DAMAGE_MAX_RECTS,
+			"%u rectangles", damage.count);
+      for (y = 0; y < H; y++)
+	for (x = 0; x < W; x++)
+	  if (wanted[y][x] && !covered (&damage, x, y))
+	    {
+	      holy_test_assert (0, "round %d: %u,%u lost", round, x, y);
+	      return;
+	    }
+    }
+}
+
+/* A blinking cursor and a countdown on a 4K screen: what the flush copies
+   now, against the span of whole lines it used to.  */
+static void
+report_flush (void)
+{
+  struct holy_video_damage damage;
+  holy_uint64_t rows = 2000 + 2 - 40;
+
+  holy_video_damage_reset (&damage);
+  holy_video_damage_add (&damage, 10, 2000, 8, 2);
+  holy_video_damage_add (&damage, 3500, 40, 200, 24);
+  printf ("cursor + timeout: %llu bytes, was %llu\n",
+	  (unsigned long long) damage_area (&damage) * 4,
+	  (unsigned long long) rows * 3840 * 4);
+}
+
+static void
+video_damage_test (void)
+{
+  test_shapes ();
+  test_cover ();
+  report_flush ();
+}
+
+holy_UNIT_TEST ("video_damage_test", video_damage_test);
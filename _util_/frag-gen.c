@@ -0,0 +1,76 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+/* Write a sparse file of COUNT blocks of BLOCKSIZE bytes, made of short
+   runs of data between short holes.  Every run ends up in an extent of
+   its own, so filesystems have to build deep extent trees for it.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+int
+main (int argc, char **argv)
+{
+  unsigned long long *buffer;
+  unsigned long blocksize, count, i, j;
+  unsigned long seed = 1;
+  int fd;
+
+  if (argc != 4)
+    {
+      fprintf (stderr, "usage: %s BLOCKSIZE COUNT FILE\n", argv[0]);
+      return 1;
+    }
+  blocksize = strtoul (argv[1], 0, 0);
+  count = strtoul (argv[2], 0, 0);
+  if (blocksize < sizeof (buffer[0]) || blocksize % sizeof (buffer[0]))
+    {
+      fprintf (stderr, "%s: invalid block size %lu\n", argv[0], blocksize);
+      return 1;
+    }
+
+  buffer = malloc (blocksize);
+  fd = open (argv[3], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (!buffer || fd < 0)
+    {
+      perror (argv[3]);
+      return 1;
+    }
+
+  for (i = 0; i < count; )
+    {
+      unsigned long run, hole;
+
+      seed = seed * 1103515245 + 12345;
+      run = 1 + (seed >> 16) % 4;
+      hole = 1 + (seed >> 20) % 3;
+
+      for (; run && i < count; run--, i++)
+	{
+	  /* Every word tells its block apart, so that a block read from
+	     the wrong place never compares equal.  */
+	  for (j = 0; j < blocksize / sizeof (buffer[0]); j++)
+	    buffer[j] = ((unsigned long long) i << 32) ^ (j * 0x9e3779b1ULL);
+	  if (pwrite (fd, buffer, blocksize, (off_t) i * blocksize)
+	      != (ssize_t) blocksize)
+	    {
+	      perror (argv[3]);
+	      return 1;
+	    }
+	}
+      i += hole;
+    }
+
+  if (ftruncate (fd, (off_t) count * blocksize) || close (fd))
+    {
+      perror (argv[3]);
+      return 1;
+    }
+  free (buffer);
+  return 0;
+}
@@ -21,6 +21,8 @@
 #include <holy/i18n.h>
 #include <holy/zfs/zfs.h>
 #include <holy/emu/hostfile.h>
+#include <holy/fshelp.h>
+#include <holy/time.h>
 
 #include <stdio.h>
 #include <errno.h>
@@ -55,7 +57,10 @@ enum {
   CMD_BLOCKLIST,
   CMD_TESTLOAD,
   CMD_ZFSINFO,
-  CMD_XNU_UUID
+  CMD_XNU_UUID,
+  CMD_BENCH,
+  CMD_REOPEN,
+  CMD_MEDIACHANGE
 };
 #define BUF_SIZE  32256
 
@@ -353,6 +358,214 @@ cmd_crc (char *pathname)
   free (crc32_context);
 }
 
+#define BENCH_BUF_SIZE  (1 << 20)
+
+/* Read PATHNAME through the filesystem once mapping block by block and
+   once by extents, from a cold cache each time.  */
+static void
+cmd_bench (char *pathname)
+{
+  static const char *const modes[] = { "per-block", "extents" };
+  char *buf = xmalloc (BENCH_BUF_SIZE);
+  int per_block;
+
+  if (uncompress == 0)
+    holy_file_filter_disable_compression ();
+
+  for (per_block = 1; per_block >= 0; per_block--)
+    {
+      holy_file_t file;
+      holy_uint64_t start, ms;
+      holy_off_t total = 0;
+      holy_ssize_t sz;
+
+      holy_disk_cache_invalidate_all ();
+      holy_memset (&holy_fshelp_stats, 0, sizeof (holy_fshelp_stats));
+      holy_fshelp_per_block = per_block;
+
+      file = holy_file_open (pathname);
+      if (!file)
+	holy_util_error (_("cannot open `%s': %s"), pathname, holy_errmsg);
+
+      start = holy_get_time_ms ();
+      while ((sz = holy_file_read (file, buf, BENCH_BUF_SIZE)) > 0)
+	total += sz;
+      ms = holy_get_time_ms () - start;
+      holy_file_close (file);
+      if (sz < 0)
+	holy_util_error (_("read error at offset %llu: %s"),
+			 (unsigned long long) total, holy_errmsg);
+
+      printf ("%-9s %llu bytes, %llu map calls, %llu disk reads, "
+	      "%llu ms", modes[per_block ? 0 : 1],
+	      (unsigned long long) total,
+	      (unsigned long long) holy_fshelp_stats.map_calls,
+	      (unsigned long long) holy_fshelp_stats.disk_reads,
+	      (unsigned long long) ms);
+      if (ms)
+	printf (", %llu MiB/s",
+		(unsigned long long) (total * 1000 / ms) >> 20);
+      printf ("\n");
+    }
+
+  holy_fshelp_per_block = 0;
+  free (buf);
+}
+
+/* Context for cmd_reopen.  */
+struct reopen_ctx
+{
+  char **names;
+  int *seen;
+  int nnames;
+};
+
+/* Helper for cmd_reopen.  */
+static int
+reopen_dir_hook (const char *filename,
+		 const struct holy_dirhook_info *info __attribute__ ((unused)),
+		 void *data)
+{
+  struct reopen_ctx *ctx = data;
+  int i;
+
+  for (i = 0; i < ctx->nnames; i++)
+    if (strcmp (filename, ctx->names[i]) == 0)
+      ctx->seen[i] = 1;
+  return 0;
+}
+
+#define REOPEN_PASSES 2
+
+/* List DIR and compare DIR/NAME with LOCAL/NAME for every NAME, then make
+   sure a missing name stays missing, all in one process and more than
+   once.  Every open after the first finds the device probed, the
+   filesystem mounted and, where fshelp caches them, the names looked up
+   already, so this is what exercises those caches.  */
+static void
+cmd_reopen (int n, char **argv)
+{
+  char *dir = argv[0], *local = argv[1], *missing, *device_name;
+  const char *path;
+  struct reopen_ctx ctx;
+  int pass, i;
+
+  ctx.names = argv + 2;
+  ctx.nnames = n - 2;
+  ctx.seen = xmalloc (ctx.nnames * sizeof (ctx.seen[0]));
+  missing = xasprintf ("%s/.holy-fstest-missing", dir);
+
+  device_name = holy_file_get_device_name (dir);
+  path = strchr (dir, ')');
+  path = path ? path + 1 : dir;
+  if (! *path)
+    path = "/";
+
+  for (pass = 0; pass < REOPEN_PASSES; pass++)
+    {
+      holy_device_t dev;
+      holy_fs_t fs;
+      holy_file_t file;
+
+      dev = holy_device_open (device_name);
+      if (! dev)
+	holy_util_error ("%s", holy_errmsg);
+      fs = holy_fs_probe (dev);
+      if (! fs)
+	holy_util_error ("%s", holy_errmsg);
+      memset (ctx.seen, 0, ctx.nnames * sizeof (ctx.seen[0]));
+      if ((fs->dir) (dev, path, reopen_dir_hook, &ctx))
+	holy_util_error (_("cannot list `%s': %s"), dir, holy_errmsg);
+      holy_device_close (dev);
+
+      for (i = 0; i < ctx.nnames; i++)
+	{
+	  char *src, *dest;
+
+	  if (! strchr (ctx.names[i], '/') && ! ctx.seen[i])
+	    holy_util_error (_("`%s' is not listed in `%s'"),
+			     ctx.names[i], dir);
+	  src = xasprintf ("%s/%s", dir, ctx.names[i]);
+	  dest = xasprintf ("%s/%s", local, ctx.names[i]);
+	  cmd_cmp (src, dest);
+	  free (src);
+	  free (dest);
+	}
+
+      file = holy_file_open (missing);
+      if (file)
+	holy_util_error (_("`%s' should not exist"), missing);
+      holy_errno = holy_ERR_NONE;
+    }
+
+  free (missing);
+  holy_free (device_name);
+  free (ctx.seen);
+  execute_command ("fs_cache_stats", 0, NULL);
+}
+
+/* Longer than the disk cache timeout in kern/disk.c.  */
+#define MEDIACHANGE_WAIT 3
+
+/* Check PATH against LOCAL, or that it is missing if LOCAL is "-".  */
+static void
+mediachange_check (char *path, char *local)
+{
+  holy_file_t file;
+
+  if (strcmp (local, "-") != 0)
+    {
+      cmd_cmp (path, local);
+      return;
+    }
+  file = holy_file_open (path);
+  if (file)
+    holy_util_error (_("`%s' should not exist"), path);
+  holy_errno = holy_ERR_NONE;
+}
+
+/* ARGV is NEWIMAGE followed by triples PATH OLD NEW.  Check every PATH
+   against OLD, so that what was found is cached, then write NEWIMAGE
+   over IMAGE, as if the medium had been changed, wait for the disk cache
+   to time out and check every PATH against NEW.  */
+static void
+cmd_mediachange (const char *image, int n, char **argv)
+{
+  FILE *in, *out;
+  char *buf;
+  size_t len;
+  int i;
+
+  if ((n - 1) % 3)
+    holy_util_error ("%s", _("mediachange needs NEWIMAGE and triples of "
+			     "PATH OLD NEW"));
+
+  for (i = 1; i < n; i += 3)
+    mediachange_check (argv[i], argv[i + 1]);
+
+  /* Overwrite in place, as a loopback keeps the file open.  */
+  in = holy_util_fopen (argv[0], "rb");
+  if (! in)
+    holy_util_error (_("cannot open `%s': %s"), argv[0], strerror (errno));
+  out = holy_util_fopen (image, "r+b");
+  if (! out)
+    holy_util_error (_("cannot open `%s': %s"), image, strerror (errno));
+  buf = xmalloc (BUF_SIZE);
+  while ((len = fread (buf, 1, BUF_SIZE, in)) > 0)
+    if (fwrite (buf, 1, len, out) != len)
+      holy_util_error (_("cannot write to `%s': %s"), image,
+		       strerror (errno));
+  if (fclose (out) != 0)
+    holy_util_error (_("cannot write to `%s': %s"), image, strerror (errno));
+  fclose (in);
+  free (buf);
+
+  holy_sleep (MEDIACHANGE_WAIT);
+
+  for (i = 1; i < n; i += 3)
+    mediachange_check (argv[i], argv[i + 2]);
+}
+
 static const char *root = NULL;
 static int args_count = 0;
 static int nparm = 0;
@@ -436,6 +649,15 @@ fstest (int n)
     case CMD_CRC:
       cmd_crc (args[0]);
       break;
+    case CMD_BENCH:
+      cmd_bench (args[0]);
+      break;
+    case CMD_REOPEN:
+      cmd_reopen (n, args);
+      break;
+    case CMD_MEDIACHANGE:
+      cmd_mediachange (images[0], n, args);
+      break;
     case CMD_BLOCKLIST:
       execute_command ("blocklist", n, args);
       holy_printf ("\n");
@@ -498,6 +720,9 @@ static struct argp_option options[] = {
   {N_("crc FILE"), 0, 0     , OPTION_DOC, N_("Get crc32 checksum of FILE."), 1},
   {N_("blocklist FILE"), 0, 0, OPTION_DOC, N_("Display blocklist of FILE."), 1},
   {N_("xnu_uuid DEVICE"), 0, 0, OPTION_DOC, N_("Compute XNU UUID of the device."), 1},
+  {N_("bench FILE"), 0, 0    , OPTION_DOC, N_("Time reading FILE block by block and by extents."), 1},
+  {N_("reopen DIR LOCAL NAME..."), 0, 0, OPTION_DOC, N_("List DIR and compare each DIR/NAME with LOCAL/NAME, twice in one run, and show the filesystem cache statistics."), 1},
+  {N_("mediachange NEWIMAGE PATH OLD NEW..."), 0, 0, OPTION_DOC, N_("Compare each PATH with OLD, write NEWIMAGE over the first image, wait for the disk cache to time out and compare each PATH with NEW.  \"-\" means PATH must not exist."), 1},
   
   {"root",      'r', N_("DEVICE_NAME"), 0, N_("Set root device."),                 2},
   {"skip",      's', N_("NUM"),           0, N_("Skip N bytes from output file."),   2},
@@ -687,6 +912,21 @@ argp_parser (int key, char *arg, struct argp_state *state)
 	  cmd = CMD_TESTLOAD;
           nparm = 1;
 	}
+      else if (!holy_strcmp (arg, "bench"))
+	{
+	  cmd = CMD_BENCH;
+	  nparm = 1;
+	}
+      else if (!holy_strcmp (arg, "reopen"))
+	{
+	  cmd = CMD_REOPEN;
+	  nparm = 3;
+	}
+      else if (!holy_strcmp (arg, "mediachange"))
+	{
+	  cmd = CMD_MEDIACHANGE;
+	  nparm = 4;
+	}
       else if (holy_strcmp (arg, "xnu_uuid") == 0)
 	{
 	  cmd = CMD_XNU_UUID;
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#ifndef holy_AES_HEADER
+#define holy_AES_HEADER 1
+
+#include <holy/types.h>
+#include <holy/crypto.h>
+
+#define holy_AES_BLOCK_SIZE	16
+#define holy_AES_MAX_ROUNDS	14
+
+/* Expanded AES key, usable by every implementation.  */
+struct holy_aes_key
+{
+  /* Round keys in FIPS-197 byte order.  */
+  holy_uint8_t enc[holy_AES_MAX_ROUNDS + 1][holy_AES_BLOCK_SIZE];
+  /* Round keys of the equivalent inverse cipher, in the order used.  */
+  holy_uint8_t dec[holy_AES_MAX_ROUNDS + 1][holy_AES_BLOCK_SIZE];
+  /* ENC as bit planes, for the bitsliced code.  */
+  holy_uint64_t planes[holy_AES_MAX_ROUNDS + 1][8];
+  unsigned rounds;
+};
+
+gcry_err_code_t
+holy_aes_set_key (struct holy_aes_key *key, const void *data,
+		  holy_size_t len);
+
+/* All lengths are in blocks.  IN and OUT may be the same buffer.  */
+void holy_aes_ecb_encrypt (const struct holy_aes_key *key, void *out,
+			   const void *in, holy_size_t nblocks);
+void holy_aes_ecb_decrypt (const struct holy_aes_key *key, void *out,
+			   const void *in, holy_size_t nblocks);
+void holy_aes_cbc_encrypt (const struct holy_aes_key *key, void *out,
+			   const void *in, holy_size_t nblocks, void *iv);
+void holy_aes_cbc_decrypt (const struct holy_aes_key *key, void *out,
+			   const void *in, holy_size_t nblocks, void *iv);
+/* TWEAK is the already encrypted XTS tweak of the first block; it is
+   advanced past the last one.  */
+void holy_aes_xts_encrypt (const struct holy_aes_key *key, void *out,
+			   const void *in, holy_size_t nblocks, void *tweak);
+void holy_aes_xts_decrypt (const struct holy_aes_key *key, void *out,
+			   const void *in, holy_size_t nblocks, void *tweak);
+
+/* The AES code in use, and switching it; see holy/cpu_impl.h.  */
+const char *holy_aes_implementation (void);
+int holy_aes_select (const char *name);
+
+#endif
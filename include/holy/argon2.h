@@ -0,0 +1,47 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#ifndef holy_ARGON2_HEADER
+#define holy_ARGON2_HEADER 1
+
+#include <holy/types.h>
+#include <holy/err.h>
+
+typedef enum
+  {
+    holy_ARGON2_D = 0,
+    holy_ARGON2_I = 1,
+    holy_ARGON2_ID = 2
+  } holy_argon2_type_t;
+
+struct holy_argon2_params
+{
+  holy_argon2_type_t type;
+  /* Number of passes over the memory.  */
+  holy_uint32_t t_cost;
+  /* Memory in KiB.  */
+  holy_uint32_t m_cost;
+  holy_uint32_t lanes;
+  /* Optional key and associated data; NULL if not used.  */
+  const void *secret;
+  holy_size_t secret_len;
+  const void *ad;
+  holy_size_t ad_len;
+};
+
+/* Derive OUT_LEN bytes into OUT from the password PWD and SALT with
+   Argon2 version 1.3.  If the heap cannot hold the memory PARAMS asks
+   for, fail with holy_ERR_OUT_OF_MEMORY before doing any work.  */
+holy_err_t
+holy_argon2 (const struct holy_argon2_params *params,
+	     const void *pwd, holy_size_t pwd_len,
+	     const void *salt, holy_size_t salt_len,
+	     void *out, holy_size_t out_len);
+
+/* The block mixing code in use, and switching it; see holy/cpu_impl.h.  */
+const char *holy_argon2_implementation (void);
+int holy_argon2_select (const char *name);
+
+#endif
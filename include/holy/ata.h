@@ -71,6 +71,7 @@ enum holy_ata_commands
     holy_ATA_CMD_READ_SECTORS_EXT	= 0x24,
     holy_ATA_CMD_READ_SECTORS_DMA	= 0xc8,
     holy_ATA_CMD_READ_SECTORS_DMA_EXT	= 0x25,
+    holy_ATA_CMD_READ_FPDMA_QUEUED	= 0x60,
 
     holy_ATA_CMD_SECURITY_FREEZE_LOCK	= 0xf5,
     holy_ATA_CMD_SET_FEATURES		= 0xef,
@@ -170,6 +171,11 @@ struct holy_ata
 
   holy_size_t maxbuffer;
 
+  /* Depth of the command queue read_submit may use, or 0 to read one
+     command at a time.  Set by the controller driver's open, then
+     limited to what IDENTIFY reports.  */
+  holy_uint32_t queue_depth;
+
   int *present;
 
   void *data;
@@ -199,6 +205,16 @@ struct holy_ata_dev
 			   struct holy_disk_ata_pass_through_parms *parms,
 			   int spinup);
 
+  /* Optional queued reads, used while QUEUE_DEPTH is non-zero.  Start
+     reading SIZE sectors from the sector SECTOR into BUF and return
+     without waiting for the data; block only while every queue slot is
+     busy.  */
+  holy_err_t (*read_submit) (struct holy_ata *ata, holy_disk_addr_t sector,
+			     holy_size_t size, char *buf);
+
+  /* Wait until every read started with read_submit is done.  */
+  holy_err_t (*read_wait) (struct holy_ata *ata);
+
   /* The next scsi device.  */
   struct holy_ata_dev *next;
 };
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#ifndef holy_CPU_IMPL_HEADER
+#define holy_CPU_IMPL_HEADER	1
+
+/* Kernels with versions for CPU extensions.  The rest of the tree is built
+   without SSE and the like, so such versions turn it on for themselves
+   with __attribute__ ((target)) and are only called once CPUID says they
+   can be.
+
+   A module keeps its versions in a table, best first, each entry starting
+   with a struct holy_cpu_impl, and picks one with holy_cpu_impl_find.  It
+   exports FOO_implementation, which returns the name of the version in
+   use, and FOO_select, which switches to the version called NAME for
+   tests and benchmarks and returns 0, or -1 if there is no such version
+   this CPU can run.  */
+
+#include <holy/types.h>
+#include <holy/misc.h>
+#include <holy/mm.h>
+
+#if defined (__i386__) || defined (__x86_64__)
+#include <holy/i386/cpuid.h>
+#endif
+
+struct holy_cpu_impl
+{
+  const char *name;
+  /* holy_CPU_* features needed, or 0 for portable code.  */
+  holy_uint32_t features;
+};
+
+static inline int
+holy_cpu_impl_usable (const struct holy_cpu_impl *impl)
+{
+#if defined (__i386__) || defined (__x86_64__)
+  return holy_cpu_has (impl->features);
+#else
+  return impl->features == 0;
+#endif
+}
+
+/* Return the best usable one of the N entries of SIZE bytes at IMPLS, or
+   if NAME is not NULL, the one called NAME if it is usable.  Return NULL if
+   there is none.  */
+static inline const void *
+holy_cpu_impl_find (const void *impls, holy_size_t n, holy_size_t size,
+		    const char *name)
+{
+  const char *p = impls;
+  holy_size_t i;
+
+  for (i = 0; i < n; i++, p += size)
+    {
+      const struct holy_cpu_impl *impl = (const struct holy_cpu_impl *) p;
+
+      if ((!name || holy_strcmp (impl->name, name) == 0)
+	  && holy_cpu_impl_usable (impl))
+	return impl;
+    }
+  return NULL;
+}
+
+#endif /* ! holy_CPU_IMPL_HEADER */
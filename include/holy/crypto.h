@@ -376,6 +376,32 @@ holy_crypto_pbkdf2 (const struct gcry_md_spec *md,
 		    unsigned int c,
 		    holy_uint8_t *DK, holy_size_t dkLen);
 
+/* One derivation of holy_crypto_pbkdf2_multi.  */
+struct holy_crypto_pbkdf2_job
+{
+  const holy_uint8_t *salt;
+  holy_size_t salt_len;
+  unsigned int iterations;
+  holy_uint8_t *dk;
+  holy_size_t dk_len;
+};
+
+/* Derive a key for each of the NJOBS JOBS from the same password P, all
+   at once.  Faster than one holy_crypto_pbkdf2 call per job when the
+   hash is SHA-1 or SHA-256.  */
+gcry_err_code_t
+holy_crypto_pbkdf2_multi (const struct gcry_md_spec *md,
+			  const holy_uint8_t *P, holy_size_t Plen,
+			  const struct holy_crypto_pbkdf2_job *jobs,
+			  unsigned njobs);
+
+/* The SHA-1/SHA-256 code in use by PBKDF2, and switching it; see
+   holy/cpu_impl.h.  */
+const char *
+holy_crypto_pbkdf2_implementation (void);
+int
+holy_crypto_pbkdf2_select (const char *name);
+
 int
 holy_crypto_memcmp (const void *a, const void *b, holy_size_t n);
 
@@ -8,6 +8,7 @@
 
 #include <holy/disk.h>
 #include <holy/crypto.h>
+#include <holy/aes.h>
 #include <holy/list.h>
 #ifdef holy_UTIL
 #include <holy/emu/hostdisk.h>
@@ -85,6 +86,13 @@ struct holy_cryptodisk
   holy_uint64_t last_rekey;
   int rekey_derived_size;
   holy_disk_addr_t partition_start;
+  /* Data and tweak keys for the AES code, when the cipher is AES and the
+     mode is one it handles.  */
+  struct holy_aes_key *aes;
+  /* Kept across requests: the IVs of one batch of sectors, and a context
+     for iv_hash.  */
+  holy_uint8_t *ivs;
+  void *iv_hash_ctx;
 };
 typedef struct holy_cryptodisk *holy_cryptodisk_t;
 
@@ -117,6 +125,9 @@ holy_cryptodisk_dev_unregister (holy_cryptodisk_dev_t cr)
 
 #define FOR_CRYPTODISK_DEVS(var) FOR_LIST_ELEMENTS((var), (holy_cryptodisk_list))
 
+holy_err_t
+holy_cryptodisk_setcipher (holy_cryptodisk_t dev, const char *ciphername,
+			   const char *ciphermode);
 gcry_err_code_t
 holy_cryptodisk_setkey (holy_cryptodisk_t dev,
 			holy_uint8_t *key, holy_size_t keysize);
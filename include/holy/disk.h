@@ -36,6 +36,7 @@ enum holy_disk_dev_id
     holy_DISK_DEVICE_CBFSDISK_ID,
     holy_DISK_DEVICE_UBOOTDISK_ID,
     holy_DISK_DEVICE_XEN,
+    holy_DISK_DEVICE_NVME_ID,
   };
 
 /*typedef enum
@@ -134,6 +135,16 @@ struct holy_disk_dev
   holy_err_t (*write) (struct holy_disk *disk, holy_disk_addr_t sector,
 		       holy_size_t size, const char *buf);
 
+  /* Optional queued reads, used by holy_disk_read_batch.  Start reading
+     SIZE sectors from the sector SECTOR of the disk DISK into BUF and
+     return without waiting for the data; block only while the device
+     queue is full.  */
+  holy_err_t (*read_submit) (struct holy_disk *disk, holy_disk_addr_t sector,
+			     holy_size_t size, char *buf);
+
+  /* Wait until every read started with read_submit on DISK is done.  */
+  holy_err_t (*read_wait) (struct holy_disk *disk);
+
 #ifdef holy_UTIL
   struct holy_disk_memberlist *(*memberlist) (struct holy_disk *disk);
   const char * (*raidname) (struct holy_disk *disk);
@@ -175,6 +186,14 @@ struct holy_disk
   /* The id used by the disk cache manager.  */
   unsigned long id;
 
+  /* The sector following the previous read, used to detect sequential
+     access.  */
+  holy_disk_addr_t ra_next;
+
+  /* Current read-ahead window in units of holy_DISK_CACHE_SIZE, or 0 if
+     the access pattern is not sequential.  */
+  unsigned int ra_window;
+
   /* The partition information. This is machine-specific.  */
   struct holy_partition *partition;
 
@@ -203,21 +222,44 @@ typedef struct holy_disk_memberlist *holy_disk_memberlist_t;
 #define holy_DISK_SECTOR_SIZE	0x200
 #define holy_DISK_SECTOR_BITS	9
 
-/* The maximum number of disk caches.  */
-#define holy_DISK_CACHE_NUM	1021
+/* The number of blocks in each set of the set-associative disk cache.  */
+#define holy_DISK_CACHE_WAYS	8
+
+/* Lower and upper bound on the number of disk cache blocks.  The actual
+   number is derived from the heap size when the cache is first used.  */
+#define holy_DISK_CACHE_MIN_BLOCKS	64
+#define holy_DISK_CACHE_MAX_BLOCKS	2048
 
 /* The size of a disk cache in 512B units. Must be at least as big as the
    largest supported sector size, currently 16K.  */
 #define holy_DISK_CACHE_BITS	6
 #define holy_DISK_CACHE_SIZE	(1 << holy_DISK_CACHE_BITS)
 
+/* Upper bound of the read-ahead window in units of holy_DISK_CACHE_SIZE.  */
+#define holy_DISK_READAHEAD_MAX	32
+
 #define holy_DISK_MAX_MAX_AGGLOMERATE ((1 << (30 - holy_DISK_CACHE_BITS - holy_DISK_SECTOR_BITS)) - 1)
 
 /* Return value of holy_disk_get_size() in case disk size is unknown. */
 #define holy_DISK_SIZE_UNKNOWN	 0xffffffffffffffffULL
 
-/* This is called from the memory manager.  */
-void holy_disk_cache_invalidate_all (void);
+/* This is called from the memory manager, and before large allocations
+   that are sized against the free heap.  */
+void EXPORT_FUNC(holy_disk_cache_invalidate_all) (void);
+
+/* Caches built from what was read off disks, which are dropped together
+   with the disk cache.  INVALIDATE must not allocate memory.  */
+struct holy_disk_cache_hook
+{
+  struct holy_disk_cache_hook *next;
+  struct holy_disk_cache_hook **prev;
+  void (*invalidate) (void);
+};
+
+void
+EXPORT_FUNC(holy_disk_cache_register_hook) (struct holy_disk_cache_hook *hook);
+void
+EXPORT_FUNC(holy_disk_cache_unregister_hook) (struct holy_disk_cache_hook *hook);
 
 void EXPORT_FUNC(holy_disk_dev_register) (holy_disk_dev_t dev);
 void EXPORT_FUNC(holy_disk_dev_unregister) (holy_disk_dev_t dev);
@@ -242,6 +284,22 @@ holy_err_t EXPORT_FUNC(holy_disk_read) (holy_disk_t disk,
 					holy_off_t offset,
 					holy_size_t size,
 					void *buf);
+
+/* One read of a batch, in the units of holy_disk_read.  */
+struct holy_disk_read_req
+{
+  holy_disk_t disk;
+  holy_disk_addr_t sector;
+  holy_size_t size;
+  void *buf;
+};
+
+/* Do all of REQS.  Requests on devices with queued reads are all started
+   before any is waited for, so reads on different disks, or several on
+   one, overlap.  The others are done one at a time, in order.  */
+holy_err_t EXPORT_FUNC(holy_disk_read_batch) (struct holy_disk_read_req *reqs,
+					      unsigned nreqs);
+
 holy_err_t holy_disk_write (holy_disk_t disk,
 			    holy_disk_addr_t sector,
 			    holy_off_t offset,
@@ -282,11 +340,18 @@ struct holy_disk_cache
   enum holy_disk_dev_id dev_id;
   unsigned long disk_id;
   holy_disk_addr_t sector;
+  /* Points into the preallocated cache slab.  */
   char *data;
   int lock;
+  int valid;
+  /* Time of the last access, used to pick the least recently used way.  */
+  holy_uint64_t stamp;
 };
 
-extern struct holy_disk_cache EXPORT_VAR(holy_disk_cache_table)[holy_DISK_CACHE_NUM];
+/* holy_disk_cache_sets sets of holy_DISK_CACHE_WAYS entries each, or NULL
+   when the cache has not been allocated yet.  */
+extern struct holy_disk_cache *EXPORT_VAR(holy_disk_cache_table);
+extern unsigned EXPORT_VAR(holy_disk_cache_sets);
 
 #if defined (holy_UTIL)
 void holy_lvm_init (void);
@@ -0,0 +1,38 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#ifndef holy_FBSIMD_HEADER
+#define holy_FBSIMD_HEADER	1
+
+/* NOTE: This header is private header for fb driver and should not be used
+   in other parts of the code.  */
+
+#include <holy/symbol.h>
+#include <holy/types.h>
+
+/* Row kernels for the 32-bit blits and fills that themes and menus spend
+   their time in.  A pixel is a 32-bit word with alpha in the top byte; the
+   other three bytes are either red, green, blue from the bottom up
+   (RGBA8888) or the other way round (BGRA8888).  */
+
+/* Copy N pixels from SRC to DST, swapping red and blue.  */
+void holy_video_fb_swap_rb32 (holy_uint32_t *dst, const holy_uint32_t *src,
+			      unsigned int n);
+
+/* Blend N pixels of SRC over DST by the alpha of SRC, exactly as the generic
+   blend blitter does.  If SWAP_RB, SRC has red and blue the other way
+   round from DST.  */
+void holy_video_fb_blend32 (holy_uint32_t *dst, const holy_uint32_t *src,
+			    unsigned int n, int swap_rb);
+
+/* Set N pixels at DST to COLOR.  */
+void holy_video_fb_fill32 (holy_uint32_t *dst, holy_uint32_t color,
+			   unsigned int n);
+
+/* The row code in use, and switching it; see holy/cpu_impl.h.  */
+const char *EXPORT_FUNC (holy_video_fb_simd_implementation) (void);
+int EXPORT_FUNC (holy_video_fb_simd_select) (const char *name);
+
+#endif /* ! holy_FBSIMD_HEADER */
@@ -40,4 +40,18 @@ holy_video_color_t get_pixel (struct holy_video_fbblit_info *source,
 void set_pixel (struct holy_video_fbblit_info *source,
                 unsigned int x, unsigned int y, holy_video_color_t color);
 
+static inline holy_uint8_t
+alpha_dilute (holy_uint8_t bg, holy_uint8_t fg, holy_uint8_t alpha)
+{
+  holy_uint16_t s;
+  holy_uint16_t h, l;
+  s = (fg * alpha) + (bg * (255 ^ alpha));
+  /* Optimised division by 255.  */
+  h = s >> 8;
+  l = s & 0xff;
+  if (h + l >= 255)
+    h++;
+  return h;
+}
+
 #endif /* ! holy_VBEUTIL_MACHINE_HEADER */
@@ -87,9 +87,10 @@ typedef enum holy_file_filter_id
     holy_FILE_FILTER_GZIO,
     holy_FILE_FILTER_XZIO,
     holy_FILE_FILTER_LZOPIO,
+    holy_FILE_FILTER_ZSTDIO,
     holy_FILE_FILTER_MAX,
     holy_FILE_FILTER_COMPRESSION_FIRST = holy_FILE_FILTER_GZIO,
-    holy_FILE_FILTER_COMPRESSION_LAST = holy_FILE_FILTER_LZOPIO,
+    holy_FILE_FILTER_COMPRESSION_LAST = holy_FILE_FILTER_ZSTDIO,
   } holy_file_filter_id_t;
 
 typedef holy_file_t (*holy_file_filter_t) (holy_file_t in, const char *filename);
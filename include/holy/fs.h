@@ -83,6 +83,15 @@ struct holy_fs
   /* Get writing time of filesystem. */
   holy_err_t (*mtime) (holy_device_t device, holy_int32_t *timebuf);
 
+  /* Optional.  Mount the filesystem on DEVICE for holy_fs_mount, which
+     keeps the result after it is unmounted.  REMOUNT prepares a kept
+     mount for another user on DEVICE, forgetting whatever the last user
+     left in it.  UNMOUNT must not allocate memory, as it is also called
+     when memory runs short.  */
+  void *(*mount) (holy_device_t device);
+  holy_err_t (*remount) (void *data, holy_device_t device);
+  void (*unmount) (void *data);
+
 #ifdef holy_UTIL
   /* Determine sectors available for embedding.  */
   holy_err_t (*embed) (holy_device_t device, unsigned int *nsectors,
@@ -118,9 +127,13 @@ holy_fs_register (holy_fs_t fs)
 }
 #endif
 
+/* Drop what is cached about FS, before it goes away.  */
+void EXPORT_FUNC(holy_fs_cache_forget) (holy_fs_t fs);
+
 static inline void
 holy_fs_unregister (holy_fs_t fs)
 {
+  holy_fs_cache_forget (fs);
   holy_list_remove (holy_AS_LIST (fs));
 }
 
@@ -128,4 +141,23 @@ holy_fs_unregister (holy_fs_t fs)
 
 holy_fs_t EXPORT_FUNC(holy_fs_probe) (holy_device_t device);
 
+/* Mount FS on DEVICE with its MOUNT method, or reuse a mount of the same
+   device that was kept after holy_fs_unmount.  Kept mounts are dropped
+   together with the disk cache.  */
+void *EXPORT_FUNC(holy_fs_mount) (holy_fs_t fs, holy_device_t device);
+void EXPORT_FUNC(holy_fs_unmount) (holy_fs_t fs, void *data);
+
+/* What probing and mounting cost, and how often the cache spared it.  */
+struct holy_fs_cache_stats
+{
+  holy_uint64_t probe_hits;
+  holy_uint64_t probes;
+  holy_uint64_t probe_ms;
+  holy_uint64_t mount_hits;
+  holy_uint64_t mounts;
+  holy_uint64_t mount_ms;
+};
+
+extern struct holy_fs_cache_stats EXPORT_VAR (holy_fs_cache_stats);
+
 #endif /* ! holy_FS_HEADER */
@@ -59,6 +59,69 @@ EXPORT_FUNC(holy_fshelp_find_file_lookup) (const char *path,
 					   char *(*read_symlink) (holy_fshelp_node_t node),
 					   enum holy_fshelp_filetype expect);
 
+/* Like holy_fshelp_find_file, but LOOKUP_FILE is tried first on each
+   directory.  It returns holy_ERR_NOT_IMPLEMENTED_YET for directories
+   without an index, which are then searched with ITERATE_DIR.  */
+holy_err_t
+EXPORT_FUNC(holy_fshelp_find_file_indexed) (const char *path,
+					    holy_fshelp_node_t rootnode,
+					    holy_fshelp_node_t *foundnode,
+					    int (*iterate_dir) (holy_fshelp_node_t dir,
+								holy_fshelp_iterate_dir_hook_t hook,
+								void *hook_data),
+					    holy_err_t (*lookup_file) (holy_fshelp_node_t dir,
+								       const char *name,
+								       holy_fshelp_node_t *foundnode,
+								       enum holy_fshelp_filetype *foundtype),
+					    char *(*read_symlink) (holy_fshelp_node_t node),
+					    enum holy_fshelp_filetype expect);
+
+/* How holy_fshelp_find_file_cached remembers what it found on a disk
+   from one mount to the next.  */
+struct holy_fshelp_dcache_ops
+{
+  /* Keeps apart the entries of different filesystems on one disk.  */
+  const char *name;
+
+  /* Return a new node like NODE that belongs to the mount of ROOTNODE.
+     NODE may come from an earlier mount that is gone, so nothing it
+     points to may be used.  */
+  holy_fshelp_node_t (*dup_node) (holy_fshelp_node_t node,
+				  holy_fshelp_node_t rootnode);
+};
+
+/* Like holy_fshelp_find_file_indexed, with either of ITERATE_DIR and
+   LOOKUP_FILE optional, but look each name up in a cache of the names
+   found and not found before on DISK.  The cache is dropped together
+   with the disk cache.  */
+holy_err_t
+EXPORT_FUNC(holy_fshelp_find_file_cached) (const struct holy_fshelp_dcache_ops *ops,
+					   holy_disk_t disk,
+					   const char *path,
+					   holy_fshelp_node_t rootnode,
+					   holy_fshelp_node_t *foundnode,
+					   int (*iterate_dir) (holy_fshelp_node_t dir,
+							       holy_fshelp_iterate_dir_hook_t hook,
+							       void *hook_data),
+					   holy_err_t (*lookup_file) (holy_fshelp_node_t dir,
+								      const char *name,
+								      holy_fshelp_node_t *foundnode,
+								      enum holy_fshelp_filetype *foundtype),
+					   char *(*read_symlink) (holy_fshelp_node_t node),
+					   enum holy_fshelp_filetype expect);
+
+/* Translate the file block BLOCK of NODE to a disk block, or 0 if it is
+   not stored (a hole).  */
+typedef holy_disk_addr_t (*holy_fshelp_get_block_t) (holy_fshelp_node_t node,
+						     holy_disk_addr_t block);
+
+/* Like holy_fshelp_get_block_t, and also set *LEN to the number of file
+   blocks from BLOCK on that are stored contiguously (or that are all
+   holes).  *LEN is 1 on entry.  */
+typedef holy_disk_addr_t (*holy_fshelp_get_extent_t) (holy_fshelp_node_t node,
+						      holy_disk_addr_t block,
+						      holy_disk_addr_t *len);
+
 /* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
    beginning with the block POS.  READ_HOOK should be set before
    reading a block from the file.  GET_BLOCK is used to translate file
@@ -69,9 +132,39 @@ EXPORT_FUNC(holy_fshelp_read_file) (holy_disk_t disk, holy_fshelp_node_t node,
 				    holy_disk_read_hook_t read_hook,
 				    void *read_hook_data,
 				    holy_off_t pos, holy_size_t len, char *buf,
-				    holy_disk_addr_t (*get_block) (holy_fshelp_node_t node,
-                                                                   holy_disk_addr_t block),
+				    holy_fshelp_get_block_t get_block,
 				    holy_off_t filesize, int log2blocksize,
 				    holy_disk_addr_t blocks_start);
 
+/* Like holy_fshelp_read_file, but map whole runs of blocks with
+   GET_EXTENT and read each run with one disk request.  */
+holy_ssize_t
+EXPORT_FUNC(holy_fshelp_read_file_extents) (holy_disk_t disk,
+					    holy_fshelp_node_t node,
+					    holy_disk_read_hook_t read_hook,
+					    void *read_hook_data,
+					    holy_off_t pos, holy_size_t len,
+					    char *buf,
+					    holy_fshelp_get_extent_t get_extent,
+					    holy_off_t filesize,
+					    int log2blocksize,
+					    holy_disk_addr_t blocks_start);
+
+/* Counts of the work done looking up names and mapping and reading file
+   data.  */
+struct holy_fshelp_stats
+{
+  holy_uint64_t map_calls;
+  holy_uint64_t disk_reads;
+  holy_uint64_t bytes;
+  holy_uint64_t dentry_hits;
+  holy_uint64_t dentry_misses;
+};
+
+extern struct holy_fshelp_stats EXPORT_VAR (holy_fshelp_stats);
+
+/* Map and read one block at a time, as before runs were merged.  For
+   benchmarks.  */
+extern int EXPORT_VAR (holy_fshelp_per_block);
+
 #endif /* ! holy_FSHELP_HEADER */
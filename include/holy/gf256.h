@@ -0,0 +1,34 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#ifndef holy_GF256_HEADER
+#define holy_GF256_HEADER 1
+
+#include <holy/types.h>
+
+/* Arithmetic in GF(2^8) modulo x^8 + x^4 + x^3 + x^2 + 1, the field of
+   Linux md RAID6 and ZFS RAIDZ parity.  The generator is x (2).  */
+
+holy_uint8_t holy_gf256_mul (holy_uint8_t a, holy_uint8_t b);
+/* x**E; E is taken modulo 255.  */
+holy_uint8_t holy_gf256_exp (unsigned e);
+/* Such an E that x**E = A, for nonzero A.  */
+unsigned holy_gf256_log (holy_uint8_t a);
+/* Multiplicative inverse of nonzero A.  */
+holy_uint8_t holy_gf256_inv (holy_uint8_t a);
+
+/* BUF = C * BUF.  */
+void holy_gf256_mul_block (void *buf, holy_uint8_t c, holy_size_t size);
+/* DST = DST + C * SRC.  */
+void holy_gf256_muladd_block (void *dst, const void *src, holy_uint8_t c,
+			      holy_size_t size);
+/* DST = DST + SRC.  */
+void holy_gf256_xor_block (void *dst, const void *src, holy_size_t size);
+
+/* The GF(2^8) block code in use, and switching it; see holy/cpu_impl.h.  */
+const char *holy_gf256_implementation (void);
+int holy_gf256_select (const char *name);
+
+#endif
@@ -19,6 +19,9 @@ EXPORT_FUNC (holy_gfxterm_set_window) (struct holy_video_render_target *target,
 				       holy_font_t font, int border_width);
 
 void EXPORT_FUNC (holy_gfxterm_schedule_repaint) (void);
+/* Repaint only the part of the window under R, in screen coordinates.  */
+void
+EXPORT_FUNC (holy_gfxterm_schedule_repaint_rect) (const holy_video_rect_t *r);
 
 extern void (*EXPORT_VAR (holy_gfxterm_decorator_hook)) (void);
 
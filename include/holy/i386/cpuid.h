@@ -57,16 +57,91 @@ holy_cpu_is_cpuid_supported (void)
 
 #endif
 
-#ifdef __PIC__
+/* holy_cpuid_count is for the leaves that take a subleaf in ECX.  Only
+   32-bit PIC code keeps the GOT pointer in EBX; on x86_64 a 32-bit xchg
+   would clear the top half of RBX instead.  */
+#if defined (__PIC__) && !defined (__x86_64__)
 #define holy_cpuid(num,a,b,c,d) \
   asm volatile ("xchgl %%ebx, %1; cpuid; xchgl %%ebx, %1" \
                 : "=a" (a), "=r" (b), "=c" (c), "=d" (d)  \
                 : "0" (num))
+#define holy_cpuid_count(num,sub,a,b,c,d) \
+  asm volatile ("xchgl %%ebx, %1; cpuid; xchgl %%ebx, %1" \
+                : "=a" (a), "=r" (b), "=c" (c), "=d" (d)  \
+                : "0" (num), "2" (sub))
 #else
 #define holy_cpuid(num,a,b,c,d) \
   asm volatile ("cpuid" \
                 : "=a" (a), "=b" (b), "=c" (c), "=d" (d)  \
                 : "0" (num))
+#define holy_cpuid_count(num,sub,a,b,c,d) \
+  asm volatile ("cpuid" \
+                : "=a" (a), "=b" (b), "=c" (c), "=d" (d)  \
+                : "0" (num), "2" (sub))
 #endif
 
+/* CPU features, for holy_cpu_has.  */
+#define holy_CPU_SSE2		(1 << 0)
+#define holy_CPU_SSSE3		(1 << 1)
+#define holy_CPU_SSE4_1		(1 << 2)
+#define holy_CPU_SSE4_2		(1 << 3)
+#define holy_CPU_AES		(1 << 4)
+#define holy_CPU_AVX2		(1 << 5)
+#define holy_CPU_SHA		(1 << 6)
+#define holy_CPU_PCLMUL		(1 << 7)
+#define holy_CPU_VAES		(1 << 8)
+
+/* Return the holy_CPU_* features of this CPU.  AVX2 and VAES are only
+   reported if the AVX register state is turned on as well, which firmware
+   does not always do.  */
+static __inline holy_uint32_t
+holy_cpu_features (void)
+{
+  holy_uint32_t max, a, b, c, d, xcr0, xcr0_hi, features = 0;
+  int avx_state;
+
+  if (!holy_cpu_is_cpuid_supported ())
+    return 0;
+  holy_cpuid (0, max, b, c, d);
+  if (max < 1)
+    return 0;
+  holy_cpuid (1, a, b, c, d);
+  if (d & (1 << 26))
+    features |= holy_CPU_SSE2;
+  if (c & (1 << 1))
+    features |= holy_CPU_PCLMUL;
+  if (c & (1 << 9))
+    features |= holy_CPU_SSSE3;
+  if (c & (1 << 19))
+    features |= holy_CPU_SSE4_1;
+  if (c & (1 << 20))
+    features |= holy_CPU_SSE4_2;
+  if (c & (1 << 25))
+    features |= holy_CPU_AES;
+  /* OSXSAVE[bit 27] and AVX[bit 28], then XCR0.SSE[bit 1] and AVX[bit 2].  */
+  avx_state = 0;
+  if ((c & (3 << 27)) == (3 << 27))
+    {
+      __asm__ __volatile__ ("xgetbv" : "=a" (xcr0), "=d" (xcr0_hi) : "c" (0));
+      avx_state = ((xcr0 & 6) == 6);
+    }
+  if (max < 7)
+    return features;
+  holy_cpuid_count (7, 0, a, b, c, d);
+  if ((b & (1 << 5)) && avx_state)
+    features |= holy_CPU_AVX2;
+  if (b & (1 << 29))
+    features |= holy_CPU_SHA;
+  if ((c & (1 << 9)) && avx_state)
+    features |= holy_CPU_VAES;
+  return features;
+}
+
+/* Return whether this CPU has all of FEATURES.  */
+static __inline int
+holy_cpu_has (holy_uint32_t features)
+{
+  return (holy_cpu_features () & features) == features;
+}
+
 #endif
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#ifndef holy_JSON_HEADER
+#define holy_JSON_HEADER 1
+
+#include <holy/types.h>
+#include <holy/err.h>
+
+typedef enum
+  {
+    holy_JSON_OBJECT,
+    holy_JSON_ARRAY,
+    holy_JSON_STRING,
+    holy_JSON_PRIMITIVE,
+    holy_JSON_UNDEFINED
+  } holy_json_type_t;
+
+struct holy_json_token;
+
+/* A value in a parsed document.  Values found by the getters share the
+   document's storage and stay valid until it is freed.  */
+struct holy_json
+{
+  struct holy_json_token *tokens;
+  char *string;
+  holy_size_t idx;
+};
+typedef struct holy_json holy_json_t;
+
+/* Parse the STRING_LEN bytes at STRING, which are modified in place and
+   must outlive the result.  */
+holy_err_t holy_json_parse (holy_json_t **out, char *string,
+			    holy_size_t string_len);
+void holy_json_free (holy_json_t *json);
+
+holy_json_type_t holy_json_gettype (const holy_json_t *json);
+/* Number of elements of an array or members of an object.  */
+holy_err_t holy_json_getsize (holy_size_t *out, const holy_json_t *json);
+/* Element N of an array, or the value of member N of an object.  */
+holy_err_t holy_json_getchild (holy_json_t *out, const holy_json_t *parent,
+			       holy_size_t n);
+/* Name of member N of an object.  */
+holy_err_t holy_json_getkey (const char **out, const holy_json_t *parent,
+			     holy_size_t n);
+holy_err_t holy_json_getvalue (holy_json_t *out, const holy_json_t *parent,
+			       const char *key);
+
+/* The value of member KEY of PARENT, or PARENT itself if KEY is NULL, as
+   a C string or a number.  Numbers may be given as JSON strings, the way
+   LUKS2 stores 64-bit ones.  */
+holy_err_t holy_json_getstring (const char **out, const holy_json_t *parent,
+				const char *key);
+holy_err_t holy_json_getuint64 (holy_uint64_t *out,
+				const holy_json_t *parent, const char *key);
+holy_err_t holy_json_getint64 (holy_int64_t *out, const holy_json_t *parent,
+			       const char *key);
+
+#endif
@@ -8,4 +8,11 @@
 
 holy_uint32_t holy_getcrc32c (holy_uint32_t crc, const void *buf, int size);
 
+/* The CRC64 and Adler-32 code in use, and switching it; see
+   holy/cpu_impl.h.  */
+const char *holy_crc64_implementation (void);
+int holy_crc64_select (const char *name);
+const char *holy_adler32_implementation (void);
+int holy_adler32_select (const char *name);
+
 #endif /* ! holy_CRC_H */
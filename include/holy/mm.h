@@ -36,6 +36,10 @@ void *EXPORT_FUNC(holy_realloc) (void *ptr, holy_size_t size);
 void *EXPORT_FUNC(holy_memalign) (holy_size_t align, holy_size_t size);
 #endif
 
+/* Free heap space in bytes, and the largest block of it.  */
+void EXPORT_FUNC(holy_mm_get_free) (holy_size_t *total,
+				    holy_size_t *largest);
+
 void holy_mm_check_real (const char *file, int line);
 #define holy_mm_check() holy_mm_check_real (holy_FILE, __LINE__);
 
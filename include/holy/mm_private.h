@@ -11,6 +11,8 @@
 /* Magic words.  */
 #define holy_MM_FREE_MAGIC	0x2d3c2808
 #define holy_MM_ALLOC_MAGIC	0x6db08fa4
+/* Freed small block parked on a quick list.  */
+#define holy_MM_QUICK_MAGIC	0x51c3a7e2
 
 typedef struct holy_mm_header
 {
@@ -46,6 +48,9 @@ typedef struct holy_mm_region
 
 #ifndef holy_MACHINE_EMU
 extern holy_mm_region_t EXPORT_VAR (holy_mm_base);
+
+/* Give the blocks cached on the quick lists back to their regions.  */
+void EXPORT_FUNC (holy_mm_flush_quick) (void);
 #endif
 
 #endif
@@ -119,6 +119,8 @@ struct holy_net_card
   holy_size_t rcvbufsize;
   holy_size_t txbufsize;
   int txbusy;
+  /* Receive buffers, allocated when the card is opened.  */
+  struct holy_net_buff_pool *rx_pool;
   union
   {
 #ifdef holy_MACHINE_EFI
@@ -363,6 +365,14 @@ holy_net_card_register (struct holy_net_card *card)
 void
 holy_net_card_unregister (struct holy_net_card *card);
 
+/* Receive buffers per card.  Two bytes of headroom make the 14 or 18 bytes
+   of ethernet header end on a 4-byte boundary, aligning the IP header.  */
+#define holy_NET_RX_POOL_SIZE 128
+#define holy_NET_RX_HEADROOM 2
+
+struct holy_net_buff *
+holy_net_card_rx_buff (struct holy_net_card *card, holy_size_t len);
+
 #define FOR_NET_CARDS(var) for (var = holy_net_cards; var; var = var->next)
 #define FOR_NET_CARDS_SAFE(var, next) for (var = holy_net_cards, next = (var ? var->next : 0); var; var = next, next = (var ? var->next : 0))
 
@@ -518,6 +528,9 @@ holy_net_network_level_interface_unregister (struct holy_net_network_level_inter
 void
 holy_net_tcp_retransmit (void);
 
+void
+holy_net_tcp_flush_acks (void);
+
 void
 holy_net_link_layer_add_address (struct holy_net_card *card,
 				 const holy_net_network_level_address_t *nl,
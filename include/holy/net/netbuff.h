@@ -11,6 +11,8 @@
 #define NETBUFF_ALIGN 2048
 #define NETBUFFMINLEN 64
 
+struct holy_net_buff_pool;
+
 struct holy_net_buff
 {
   /* Pointer to the start of the buffer.  */
@@ -21,6 +23,29 @@ struct holy_net_buff
   holy_uint8_t *tail;
   /* Pointer to the end of the buffer.  */
   holy_uint8_t *end;
+  /* Pool the buffer is returned to when freed, or NULL.  */
+  struct holy_net_buff_pool *pool;
+};
+
+/* A fixed set of equally sized buffers allocated in one block.  Freed
+   buffers go back to the pool instead of the heap.  */
+struct holy_net_buff_pool
+{
+  holy_uint8_t *mem;
+  /* Usable bytes in each buffer after HEADROOM.  */
+  holy_size_t size;
+  holy_size_t headroom;
+  holy_size_t stride;
+  unsigned count;
+  /* Free buffers, used as a stack so the most recently used (and likely
+     cached) one is handed out first.  */
+  struct holy_net_buff **free_list;
+  unsigned n_free;
+  /* Set by holy_netbuff_pool_destroy while buffers are still in use.  */
+  int dead;
+  /* Requests served from the pool and ones that fell back to the heap.  */
+  unsigned long hits;
+  unsigned long misses;
 };
 
 holy_err_t holy_netbuff_put (struct holy_net_buff *net_buff, holy_size_t len);
@@ -33,4 +58,10 @@ struct holy_net_buff * holy_netbuff_alloc (holy_size_t len);
 struct holy_net_buff * holy_netbuff_make_pkt (holy_size_t len);
 void holy_netbuff_free (struct holy_net_buff *net_buff);
 
+struct holy_net_buff_pool *
+holy_netbuff_pool_new (unsigned count, holy_size_t size, holy_size_t headroom);
+struct holy_net_buff *
+holy_netbuff_pool_get (struct holy_net_buff_pool *pool, holy_size_t len);
+void holy_netbuff_pool_destroy (struct holy_net_buff_pool *pool);
+
 #endif
@@ -60,6 +60,20 @@ void holy_test_assert_helper (int cond, const char *file,
 void holy_unit_test_init (void);
 void holy_unit_test_fini (void);
 
+/* Benchmarks in unit tests.  The throughput loops only run when
+   HOLY_TEST_BENCH is set in the environment, so that the checks stay
+   quick; `make bench' sets it.  */
+int holy_test_bench_enabled (void);
+
+/* Return the time to pass to holy_test_bench_end.  */
+holy_uint64_t holy_test_bench_start (void);
+
+/* Print the benchmark named by FMT and the rate of AMOUNT UNITs done
+   since START.  */
+void holy_test_bench_end (holy_uint64_t start, double amount,
+			  const char *unit, const char *fmt, ...)
+  __attribute__ ((format (GNU_PRINTF, 4, 5)));
+
 /* Macro to define a unit test.  */
 #define holy_UNIT_TEST(name, funp)		\
   void holy_unit_test_init (void)		\
@@ -194,6 +194,27 @@ struct holy_video_signed_rect
 };
 typedef struct holy_video_signed_rect holy_video_signed_rect_t;
 
+/* Damaged parts of a surface, kept as a short list of rectangles so that a
+   cursor blinking at one end of the screen and a label updating at the
+   other are redrawn and flushed separately.  Rectangles are merged when
+   their union costs no more than the two of them, or when the list is
+   full.  */
+#define holy_VIDEO_DAMAGE_MAX_RECTS	16
+
+struct holy_video_damage
+{
+  unsigned count;
+  holy_video_rect_t rects[holy_VIDEO_DAMAGE_MAX_RECTS];
+};
+
+/* What the double buffered framebuffer drivers copied to the screen.  */
+struct holy_video_flush_stats
+{
+  holy_uint64_t frames;
+  holy_uint64_t bytes;
+  holy_uint64_t last_bytes;
+};
+
 struct holy_video_palette_data
 {
   holy_uint8_t r; /* Red color value (0-255).  */
@@ -587,6 +608,22 @@ holy_video_capture_get_framebuffer (void);
 extern holy_video_adapter_t EXPORT_VAR (holy_video_adapter_active);
 extern void (*holy_video_capture_refresh_cb) (void);
 
+void EXPORT_FUNC (holy_video_damage_reset) (struct holy_video_damage *damage);
+void EXPORT_FUNC (holy_video_damage_add) (struct holy_video_damage *damage,
+					  int x, int y,
+					  unsigned int width,
+					  unsigned int height);
+void EXPORT_FUNC (holy_video_damage_merge) (struct holy_video_damage *dst,
+					    const struct holy_video_damage *src);
+
+static inline int
+holy_video_damage_is_empty (const struct holy_video_damage *damage)
+{
+  return damage->count == 0;
+}
+
+extern struct holy_video_flush_stats EXPORT_VAR (holy_video_flush_stats);
+
 #define holy_VIDEO_MI_RGB555(x)						\
   x.mode_type = holy_VIDEO_MODE_TYPE_RGB,				\
     x.bpp = 15,								\
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2025 Felix P. A. Gillberg HolyBooter
+ * SPDX-License-Identifier: GPL-2.0
+ */
+
+#ifndef holy_ZSTD_HEADER
+#define holy_ZSTD_HEADER 1
+
+#include <holy/types.h>
+#include <holy/err.h>
+
+#define holy_ZSTD_MAGIC			0xfd2fb528
+/* Skippable frames use 16 magics differing in the low 4 bits.  */
+#define holy_ZSTD_SKIPPABLE_MAGIC	0x184d2a50
+#define holy_ZSTD_SKIPPABLE_MASK	0xfffffff0
+
+/* Longest frame header, including the magic.  */
+#define holy_ZSTD_FRAME_HEADER_MAX	18
+#define holy_ZSTD_BLOCK_HEADER_SIZE	3
+#define holy_ZSTD_BLOCK_MAX		(128 * 1024)
+#define holy_ZSTD_CHECKSUM_SIZE		4
+
+#define holy_ZSTD_CONTENT_SIZE_UNKNOWN	((holy_uint64_t) -1)
+
+struct holy_zstd_frame
+{
+  /* Uncompressed size or holy_ZSTD_CONTENT_SIZE_UNKNOWN.  */
+  holy_uint64_t content_size;
+  holy_uint64_t window_size;
+  /* Whether the frame ends with a 4-byte content checksum.  */
+  int has_checksum;
+  /* Length of the header, including the magic.  */
+  holy_size_t header_size;
+};
+
+struct holy_zstd_dctx;
+
+/* Parse the frame header at IN.  Return the header size, 0 if SIZE is too
+   short to tell, or -1 with holy_errno set if it is not a frame we can
+   decode.  */
+holy_ssize_t
+holy_zstd_frame_header (const holy_uint8_t *in, holy_size_t size,
+			struct holy_zstd_frame *frame);
+
+struct holy_zstd_dctx *holy_zstd_dctx_new (void);
+void holy_zstd_dctx_free (struct holy_zstd_dctx *dctx);
+
+/* Reset DCTX for decoding the blocks of FRAME.  */
+holy_err_t
+holy_zstd_frame_begin (struct holy_zstd_dctx *dctx,
+		       const struct holy_zstd_frame *frame);
+
+/* Size of the block starting at IN, header included, and whether it is
+   the last one of its frame.  */
+holy_size_t
+holy_zstd_block_size (const holy_uint8_t *in, int *last);
+
+/* Decode the whole block at IN (header included, see holy_zstd_block_size).
+   Return the number of bytes produced, which are at *OUT until the next
+   call, or -1 on error.  */
+holy_ssize_t
+holy_zstd_decode_block (struct holy_zstd_dctx *dctx, const holy_uint8_t *in,
+			const holy_uint8_t **out);
+
+/* Decompress the frames in INBUF and store OUTSIZE bytes starting at
+   uncompressed offset OFF in OUTBUF, like holy_zlib_decompress.  */
+holy_ssize_t
+holy_zstd_decompress (char *inbuf, holy_size_t insize, holy_off_t off,
+		      char *outbuf, holy_size_t outsize);
+
+#endif